@@ -250,6 +250,63 @@ do
             echo -e "::group::Running CA Recovery Unit Tests"
             ./build_pc_linux/demos/projects/PC/linux/test_ca_recovery
 
+            echo -e "::group::Running Controller Frame Parser Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_frame_parser
+
+            echo -e "::group::Running Controller UART DMA Reception Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_uart_dma_rx
+
+            echo -e "::group::Running Controller Sensor Statistics Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_running_stats
+
+            echo -e "::group::Running Controller Sample Store Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_sample_store
+
+            echo -e "::group::Running Controller Fixed Point Sensor Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_sensor_value
+
+            echo -e "::group::Running Controller Frame Decoding Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_frame_decode
+
+            echo -e "::group::Running Controller RX Ring Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_spsc_ring
+
+            echo -e "::group::Running Controller Telemetry Schema Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_telemetry_schema
+
+            echo -e "::group::Running Controller Scratch Arena Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_scratch_arena
+
+            echo -e "::group::Running Controller Telemetry Delta Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_telemetry_delta
+
+            echo -e "::group::Running Controller Telemetry CBOR Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_telemetry_cbor
+
+            echo -e "::group::Running Controller Telemetry Queue Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_telemetry_queue
+
+            echo -e "::group::Running Controller Telemetry Batch Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_telemetry_batch
+
+            echo -e "::group::Running Controller State Alarm Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_state_alarm
+
+            echo -e "::group::Running Controller Time Service Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_time_service
+
+            echo -e "::group::Running Send Coalescer Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_send_coalescer
+
+            echo -e "::group::Running Sockets Poll Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_sockets_poll
+
+            echo -e "::group::Running DNS Cache Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_dns_cache
+
+            echo -e "::group::Running DPS Assignment Tests"
+            ./build_pc_linux/demos/projects/PC/linux/test_dps_assignment
+
             ;;
         * )
             echo "build for $arg not found";;
@@ -0,0 +1,303 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file dns_cache.c
+ * @brief Addresses of the hosts connected to, kept for their time to live.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+#include "dns_cache.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The entry of a host, NULL when not cached.
+ */
+static DnsCacheEntry_t * prvFind( DnsCache_t * pxCache,
+                                  const char * pcHostName );
+
+/**
+ * @brief A free entry, or the least recently looked up one emptied.
+ */
+static DnsCacheEntry_t * prvAllocate( DnsCache_t * pxCache,
+                                      uint32_t ulNowTick );
+
+/**
+ * @brief Whether the TTL of the entry has passed.
+ */
+static int prvIsExpired( const DnsCacheEntry_t * pxEntry,
+                         uint32_t ulNowTick );
+
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * prvFind( DnsCache_t * pxCache,
+                                  const char * pcHostName )
+{
+    size_t xIndex;
+
+    for( xIndex = 0; xIndex < DNS_CACHE_ENTRIES; xIndex++ )
+    {
+        if( ( pxCache->xEntries[ xIndex ].cHostName[ 0 ] != '\0' ) &&
+            ( strcmp( pxCache->xEntries[ xIndex ].cHostName, pcHostName ) == 0 ) )
+        {
+            return &pxCache->xEntries[ xIndex ];
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * prvAllocate( DnsCache_t * pxCache,
+                                      uint32_t ulNowTick )
+{
+    DnsCacheEntry_t * pxOldest = &pxCache->xEntries[ 0 ];
+    size_t xIndex;
+
+    for( xIndex = 0; xIndex < DNS_CACHE_ENTRIES; xIndex++ )
+    {
+        if( pxCache->xEntries[ xIndex ].cHostName[ 0 ] == '\0' )
+        {
+            return &pxCache->xEntries[ xIndex ];
+        }
+
+        if( ( ulNowTick - pxCache->xEntries[ xIndex ].ulUsedTick ) > ( ulNowTick - pxOldest->ulUsedTick ) )
+        {
+            pxOldest = &pxCache->xEntries[ xIndex ];
+        }
+    }
+
+    pxCache->xStats.ulEvictions++;
+    memset( pxOldest, 0, sizeof( *pxOldest ) );
+
+    return pxOldest;
+}
+/*-----------------------------------------------------------*/
+
+static int prvIsExpired( const DnsCacheEntry_t * pxEntry,
+                         uint32_t ulNowTick )
+{
+    return ( ulNowTick - pxEntry->ulResolvedTick ) >= pxEntry->ulTtlTicks;
+}
+/*-----------------------------------------------------------*/
+
+void DnsCache_Init( DnsCache_t * pxCache,
+                    uint32_t ulTtlTicks,
+                    uint32_t ulNegativeTtlTicks,
+                    uint32_t ulRefreshAheadTicks,
+                    uint32_t ulIdleTicks )
+{
+    memset( pxCache, 0, sizeof( *pxCache ) );
+    pxCache->ulTtlTicks = ulTtlTicks;
+    pxCache->ulNegativeTtlTicks = ulNegativeTtlTicks;
+    pxCache->ulRefreshAheadTicks = ulRefreshAheadTicks;
+    pxCache->ulIdleTicks = ulIdleTicks;
+}
+/*-----------------------------------------------------------*/
+
+DnsCacheResult_t DnsCache_Lookup( DnsCache_t * pxCache,
+                                  const char * pcHostName,
+                                  uint32_t ulNowTick,
+                                  uint32_t * pulAddress )
+{
+    DnsCacheEntry_t * pxEntry = prvFind( pxCache, pcHostName );
+
+    if( pxEntry != NULL )
+    {
+        pxEntry->ulUsedTick = ulNowTick;
+
+        if( !prvIsExpired( pxEntry, ulNowTick ) )
+        {
+            if( pxEntry->xAddressCount == 0 )
+            {
+                pxCache->xStats.ulNegativeHits++;
+
+                return eDnsCacheNegativeHit;
+            }
+
+            *pulAddress = pxEntry->ulAddresses[ pxEntry->xCurrent ];
+            pxCache->xStats.ulHits++;
+
+            return eDnsCacheHit;
+        }
+    }
+
+    pxCache->xStats.ulMisses++;
+
+    return eDnsCacheMiss;
+}
+/*-----------------------------------------------------------*/
+
+void DnsCache_Update( DnsCache_t * pxCache,
+                      const char * pcHostName,
+                      const uint32_t * pulAddresses,
+                      size_t xAddressCount,
+                      uint32_t ulTtlTicks,
+                      uint32_t ulNowTick )
+{
+    DnsCacheEntry_t * pxEntry;
+    uint32_t ulKnown[ DNS_CACHE_ADDRESSES ];
+    size_t xKnownCount = 0;
+    size_t xIndex, xCheck;
+
+    if( strlen( pcHostName ) > DNS_CACHE_HOST_NAME_LENGTH )
+    {
+        return;
+    }
+
+    if( ( pxEntry = prvFind( pxCache, pcHostName ) ) == NULL )
+    {
+        pxEntry = prvAllocate( pxCache, ulNowTick );
+        strcpy( pxEntry->cHostName, pcHostName );
+        pxEntry->ulUsedTick = ulNowTick;
+    }
+    else if( xAddressCount == 0 )
+    {
+        /* A refresh that failed, the addresses held are still good. */
+        if( ( pxEntry->xAddressCount > 0 ) && !prvIsExpired( pxEntry, ulNowTick ) )
+        {
+            return;
+        }
+    }
+    else
+    {
+        /* Addresses seen before that did not fail, behind the new ones. */
+        for( xIndex = 0; xIndex < pxEntry->xAddressCount; xIndex++ )
+        {
+            if( ( pxEntry->ulFailed & ( 1UL << xIndex ) ) == 0U )
+            {
+                ulKnown[ xKnownCount++ ] = pxEntry->ulAddresses[ xIndex ];
+            }
+        }
+    }
+
+    pxEntry->xAddressCount = 0;
+
+    for( xIndex = 0; ( xIndex < xAddressCount ) && ( pxEntry->xAddressCount < DNS_CACHE_ADDRESSES ); xIndex++ )
+    {
+        pxEntry->ulAddresses[ pxEntry->xAddressCount++ ] = pulAddresses[ xIndex ];
+    }
+
+    for( xIndex = 0; ( xIndex < xKnownCount ) && ( pxEntry->xAddressCount < DNS_CACHE_ADDRESSES ); xIndex++ )
+    {
+        for( xCheck = 0; xCheck < pxEntry->xAddressCount; xCheck++ )
+        {
+            if( pxEntry->ulAddresses[ xCheck ] == ulKnown[ xIndex ] )
+            {
+                break;
+            }
+        }
+
+        if( xCheck == pxEntry->xAddressCount )
+        {
+            pxEntry->ulAddresses[ pxEntry->xAddressCount++ ] = ulKnown[ xIndex ];
+        }
+    }
+
+    pxEntry->xCurrent = 0;
+    pxEntry->ulFailed = 0;
+    pxEntry->ulResolvedTick = ulNowTick;
+    pxEntry->ucRefreshTried = 0;
+
+    if( pxEntry->xAddressCount == 0 )
+    {
+        pxEntry->ulTtlTicks = pxCache->ulNegativeTtlTicks;
+    }
+    else
+    {
+        pxEntry->ulTtlTicks = ( ulTtlTicks != 0 ) ? ulTtlTicks : pxCache->ulTtlTicks;
+    }
+}
+/*-----------------------------------------------------------*/
+
+void DnsCache_ConnectFailed( DnsCache_t * pxCache,
+                             const char * pcHostName,
+                             uint32_t ulAddress )
+{
+    DnsCacheEntry_t * pxEntry = prvFind( pxCache, pcHostName );
+    size_t xIndex;
+
+    if( pxEntry == NULL )
+    {
+        return;
+    }
+
+    for( xIndex = 0; xIndex < pxEntry->xAddressCount; xIndex++ )
+    {
+        if( pxEntry->ulAddresses[ xIndex ] == ulAddress )
+        {
+            break;
+        }
+    }
+
+    /* Not handed out by the cache, or resolved again since. */
+    if( ( xIndex == pxEntry->xAddressCount ) || ( ( pxEntry->ulFailed & ( 1UL << xIndex ) ) != 0U ) )
+    {
+        return;
+    }
+
+    pxEntry->ulFailed |= 1UL << xIndex;
+    pxCache->xStats.ulFailovers++;
+
+    for( xIndex = 1; xIndex <= pxEntry->xAddressCount; xIndex++ )
+    {
+        if( ( pxEntry->ulFailed & ( 1UL << ( ( pxEntry->xCurrent + xIndex ) % pxEntry->xAddressCount ) ) ) == 0U )
+        {
+            pxEntry->xCurrent = ( pxEntry->xCurrent + xIndex ) % pxEntry->xAddressCount;
+
+            return;
+        }
+    }
+
+    /* Every address failed, the next lookup resolves the host again. */
+    pxEntry->ulTtlTicks = 0;
+}
+/*-----------------------------------------------------------*/
+
+const char * DnsCache_NextRefresh( DnsCache_t * pxCache,
+                                   uint32_t ulNowTick,
+                                   uint32_t * pulWaitTicks )
+{
+    DnsCacheEntry_t * pxEntry;
+    uint32_t ulAge, ulDue;
+    size_t xIndex;
+
+    *pulWaitTicks = DNS_CACHE_NO_REFRESH;
+
+    for( xIndex = 0; xIndex < DNS_CACHE_ENTRIES; xIndex++ )
+    {
+        pxEntry = &pxCache->xEntries[ xIndex ];
+
+        /* Failed lookups and idle hosts are left to expire, and a host is
+         * tried once each TTL. */
+        if( ( pxEntry->cHostName[ 0 ] == '\0' ) || ( pxEntry->xAddressCount == 0 ) ||
+            ( pxEntry->ucRefreshTried != 0 ) || prvIsExpired( pxEntry, ulNowTick ) ||
+            ( ( ulNowTick - pxEntry->ulUsedTick ) >= pxCache->ulIdleTicks ) )
+        {
+            continue;
+        }
+
+        ulAge = ulNowTick - pxEntry->ulResolvedTick;
+        ulDue = ( pxEntry->ulTtlTicks > pxCache->ulRefreshAheadTicks ) ?
+                ( pxEntry->ulTtlTicks - pxCache->ulRefreshAheadTicks ) : 0;
+
+        if( ulAge >= ulDue )
+        {
+            pxEntry->ucRefreshTried = 1;
+            pxCache->xStats.ulRefreshes++;
+
+            return pxEntry->cHostName;
+        }
+
+        if( ( ulDue - ulAge ) < *pulWaitTicks )
+        {
+            *pulWaitTicks = ulDue - ulAge;
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,187 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file dns_cache.h
+ * @brief Addresses of the hosts connected to, kept for their time to live.
+ *
+ * Every connect resolved the host name again, each attempt of the connect
+ * backoff and each reconnect of a download waited on the resolver. The cache
+ * keeps the addresses of a host for the TTL and a failed lookup for a shorter
+ * time, and tells which hosts to resolve again before they expire.
+ *
+ * A host keeps more than one address, those resolved last first and then
+ * those seen before. After a connect to an address fails the next one is
+ * handed out.
+ *
+ * Not thread safe, callers serialise the calls. No FreeRTOS dependency, ticks
+ * are passed in and resolving is left to the caller.
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hosts kept, the least recently looked up is replaced.
+ */
+#ifndef DNS_CACHE_ENTRIES
+    #define DNS_CACHE_ENTRIES    4
+#endif
+
+/**
+ * @brief Addresses kept for a host.
+ */
+#ifndef DNS_CACHE_ADDRESSES
+    #define DNS_CACHE_ADDRESSES    4
+#endif
+
+#if ( DNS_CACHE_ADDRESSES > 32 )
+    #error "DNS_CACHE_ADDRESSES must be at most 32, one bit each in ulFailed"
+#endif
+
+/**
+ * @brief Longest host name kept, longer ones are not cached.
+ */
+#define DNS_CACHE_HOST_NAME_LENGTH    128
+
+/**
+ * @brief Wait of DnsCache_NextRefresh when no host is to be refreshed.
+ */
+#define DNS_CACHE_NO_REFRESH          UINT32_MAX
+
+/**
+ * @brief Outcome of a lookup.
+ */
+typedef enum DnsCacheResult
+{
+    eDnsCacheHit = 0,     /**< An address of the host. */
+    eDnsCacheNegativeHit, /**< The host failed to resolve a short time ago. */
+    eDnsCacheMiss         /**< The host is to be resolved and the result passed to DnsCache_Update. */
+} DnsCacheResult_t;
+
+/**
+ * @brief What the cache saved.
+ */
+typedef struct DnsCacheStats
+{
+    uint32_t ulHits;         /**< Lookups answered with an address. */
+    uint32_t ulNegativeHits; /**< Lookups answered with a recent failure. */
+    uint32_t ulMisses;       /**< Lookups left to the resolver. */
+    uint32_t ulRefreshes;    /**< Hosts resolved again ahead of expiry. */
+    uint32_t ulFailovers;    /**< Addresses passed over after a failed connect. */
+    uint32_t ulEvictions;    /**< Hosts replaced by another. */
+} DnsCacheStats_t;
+
+/**
+ * @brief A host in the cache.
+ */
+typedef struct DnsCacheEntry
+{
+    char cHostName[ DNS_CACHE_HOST_NAME_LENGTH + 1 ]; /**< Empty for a free entry. */
+    uint32_t ulAddresses[ DNS_CACHE_ADDRESSES ];
+    size_t xAddressCount;                            /**< 0 for a failed lookup. */
+    size_t xCurrent;                                 /**< Address handed out. */
+    uint32_t ulFailed;                               /**< Addresses a connect failed to, one bit each. */
+    uint32_t ulResolvedTick;
+    uint32_t ulTtlTicks;
+    uint32_t ulUsedTick;                             /**< Last lookup. */
+    uint8_t ucRefreshTried;                          /**< Handed out by DnsCache_NextRefresh since resolved. */
+} DnsCacheEntry_t;
+
+/**
+ * @brief Cache state, set up with DnsCache_Init.
+ */
+typedef struct DnsCache
+{
+    DnsCacheEntry_t xEntries[ DNS_CACHE_ENTRIES ];
+    uint32_t ulTtlTicks;
+    uint32_t ulNegativeTtlTicks;
+    uint32_t ulRefreshAheadTicks;
+    uint32_t ulIdleTicks;
+    DnsCacheStats_t xStats;
+} DnsCache_t;
+
+/**
+ * @brief Set up an empty cache.
+ *
+ * @param[out] pxCache The cache.
+ * @param[in] ulTtlTicks How long addresses are kept when the resolver gives no TTL.
+ * @param[in] ulNegativeTtlTicks How long a failed lookup is kept.
+ * @param[in] ulRefreshAheadTicks How long before expiry a host is resolved again.
+ * @param[in] ulIdleTicks Hosts not looked up for this long are left to expire.
+ */
+void DnsCache_Init( DnsCache_t * pxCache,
+                    uint32_t ulTtlTicks,
+                    uint32_t ulNegativeTtlTicks,
+                    uint32_t ulRefreshAheadTicks,
+                    uint32_t ulIdleTicks );
+
+/**
+ * @brief Look up a host.
+ *
+ * @param[in] pxCache The cache.
+ * @param[in] pcHostName Host name.
+ * @param[in] ulNowTick Current tick.
+ * @param[out] pulAddress The address to connect to on a hit.
+ * @return #eDnsCacheHit, #eDnsCacheNegativeHit or #eDnsCacheMiss.
+ */
+DnsCacheResult_t DnsCache_Lookup( DnsCache_t * pxCache,
+                                  const char * pcHostName,
+                                  uint32_t ulNowTick,
+                                  uint32_t * pulAddress );
+
+/**
+ * @brief Keep what the resolver returned for a host.
+ *
+ * A failure does not replace addresses still alive, the host is then not
+ * refreshed again before it expires.
+ *
+ * @param[in] pxCache The cache.
+ * @param[in] pcHostName Host name.
+ * @param[in] pulAddresses Addresses resolved.
+ * @param[in] xAddressCount Number of @p pulAddresses, 0 when the host did not resolve.
+ * @param[in] ulTtlTicks TTL of the answer, 0 for the cache default.
+ * @param[in] ulNowTick Current tick.
+ */
+void DnsCache_Update( DnsCache_t * pxCache,
+                      const char * pcHostName,
+                      const uint32_t * pulAddresses,
+                      size_t xAddressCount,
+                      uint32_t ulTtlTicks,
+                      uint32_t ulNowTick );
+
+/**
+ * @brief Pass over an address a connect failed to.
+ *
+ * The next lookup returns the next address of the host, or misses once every
+ * address has failed.
+ *
+ * @param[in] pxCache The cache.
+ * @param[in] pcHostName Host name.
+ * @param[in] ulAddress Address the connect failed to.
+ */
+void DnsCache_ConnectFailed( DnsCache_t * pxCache,
+                             const char * pcHostName,
+                             uint32_t ulAddress );
+
+/**
+ * @brief Next host to resolve again ahead of expiry.
+ *
+ * Hosts looked up within the idle time are refreshed once each TTL, in the
+ * last @p ulRefreshAheadTicks of it.
+ *
+ * @param[in] pxCache The cache.
+ * @param[in] ulNowTick Current tick.
+ * @param[out] pulWaitTicks When no host is due, ticks until the next one is,
+ * #DNS_CACHE_NO_REFRESH for none.
+ * @return The host name, valid until the cache is next updated, or NULL when
+ * none is due.
+ */
+const char * DnsCache_NextRefresh( DnsCache_t * pxCache,
+                                   uint32_t ulNowTick,
+                                   uint32_t * pulWaitTicks );
+
+#endif /* DNS_CACHE_H */
@@ -0,0 +1,198 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file send_coalescer.c
+ * @brief Gathers small writes to a socket into one send.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+#include "send_coalescer.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Send data on the socket, counted and with a failure kept.
+ */
+static int32_t prvSend( SendCoalescer_t * pxCoalescer,
+                        const uint8_t * pucData,
+                        size_t xDataLength );
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvSend( SendCoalescer_t * pxCoalescer,
+                        const uint8_t * pucData,
+                        size_t xDataLength )
+{
+    int32_t lSent = pxCoalescer->xSend( pxCoalescer->pvSendContext, pucData, xDataLength );
+
+    pxCoalescer->xStats.ulSends++;
+
+    if( lSent < 0 )
+    {
+        pxCoalescer->lError = lSent;
+    }
+    else if( ( size_t ) lSent > xDataLength )
+    {
+        /* More than asked for, taken as all of it. */
+        lSent = ( int32_t ) xDataLength;
+    }
+
+    if( lSent > 0 )
+    {
+        pxCoalescer->xStats.ulBytes += ( uint32_t ) lSent;
+    }
+
+    return lSent;
+}
+/*-----------------------------------------------------------*/
+
+void SendCoalescer_Init( SendCoalescer_t * pxCoalescer,
+                         uint8_t * pucBuffer,
+                         size_t xBufferSize,
+                         uint32_t ulDeadlineTicks,
+                         SendCoalescerSend_t xSend,
+                         void * pvSendContext )
+{
+    memset( pxCoalescer, 0, sizeof( *pxCoalescer ) );
+    pxCoalescer->pucBuffer = pucBuffer;
+    pxCoalescer->xBufferSize = xBufferSize;
+    pxCoalescer->ulDeadlineTicks = ulDeadlineTicks;
+    pxCoalescer->xSend = xSend;
+    pxCoalescer->pvSendContext = pvSendContext;
+}
+/*-----------------------------------------------------------*/
+
+int32_t SendCoalescer_Write( SendCoalescer_t * pxCoalescer,
+                             const uint8_t * pucData,
+                             size_t xDataLength,
+                             uint32_t ulNowTick )
+{
+    int32_t lResult;
+    size_t xTaken;
+
+    if( pxCoalescer->lError < 0 )
+    {
+        return pxCoalescer->lError;
+    }
+
+    if( xDataLength == 0 )
+    {
+        return 0;
+    }
+
+    /* Held data past the deadline goes out before anything is added to it. */
+    if( ( lResult = SendCoalescer_FlushIfDue( pxCoalescer, ulNowTick ) ) < 0 )
+    {
+        return lResult;
+    }
+
+    if( ( pxCoalescer->xPending + xDataLength > pxCoalescer->xBufferSize ) &&
+        ( ( lResult = SendCoalescer_Flush( pxCoalescer ) ) < 0 ) )
+    {
+        return lResult;
+    }
+
+    /* Nothing to gather it with, a copy would not save a send. */
+    if( ( pxCoalescer->xPending == 0 ) && ( xDataLength >= pxCoalescer->xBufferSize ) )
+    {
+        pxCoalescer->xStats.ulWrites++;
+
+        return prvSend( pxCoalescer, pucData, xDataLength );
+    }
+
+    xTaken = pxCoalescer->xBufferSize - pxCoalescer->xPending;
+
+    if( xTaken > xDataLength )
+    {
+        xTaken = xDataLength;
+    }
+
+    /* The socket did not take what was held. */
+    if( xTaken == 0 )
+    {
+        return 0;
+    }
+
+    if( pxCoalescer->xPending == 0 )
+    {
+        pxCoalescer->ulFirstTick = ulNowTick;
+    }
+
+    memcpy( pxCoalescer->pucBuffer + pxCoalescer->xPending, pucData, xTaken );
+    pxCoalescer->xPending += xTaken;
+    pxCoalescer->xStats.ulWrites++;
+
+    if( pxCoalescer->xPending == pxCoalescer->xBufferSize )
+    {
+        pxCoalescer->xStats.ulFullFlushes++;
+
+        if( ( lResult = SendCoalescer_Flush( pxCoalescer ) ) < 0 )
+        {
+            return lResult;
+        }
+    }
+
+    return ( int32_t ) xTaken;
+}
+/*-----------------------------------------------------------*/
+
+int32_t SendCoalescer_Flush( SendCoalescer_t * pxCoalescer )
+{
+    int32_t lSent;
+
+    if( pxCoalescer->lError < 0 )
+    {
+        return pxCoalescer->lError;
+    }
+
+    while( pxCoalescer->xPending > 0 )
+    {
+        lSent = prvSend( pxCoalescer, pxCoalescer->pucBuffer, pxCoalescer->xPending );
+
+        if( lSent < 0 )
+        {
+            return lSent;
+        }
+
+        if( lSent == 0 )
+        {
+            /* Timed out, kept for the next flush. */
+            break;
+        }
+
+        pxCoalescer->xPending -= ( size_t ) lSent;
+        memmove( pxCoalescer->pucBuffer, pxCoalescer->pucBuffer + lSent, pxCoalescer->xPending );
+    }
+
+    return ( int32_t ) pxCoalescer->xPending;
+}
+/*-----------------------------------------------------------*/
+
+int32_t SendCoalescer_FlushIfDue( SendCoalescer_t * pxCoalescer,
+                                  uint32_t ulNowTick )
+{
+    if( pxCoalescer->lError < 0 )
+    {
+        return pxCoalescer->lError;
+    }
+
+    if( ( pxCoalescer->xPending == 0 ) ||
+        ( ( ulNowTick - pxCoalescer->ulFirstTick ) < pxCoalescer->ulDeadlineTicks ) )
+    {
+        return ( int32_t ) pxCoalescer->xPending;
+    }
+
+    pxCoalescer->xStats.ulDeadlineFlushes++;
+
+    return SendCoalescer_Flush( pxCoalescer );
+}
+/*-----------------------------------------------------------*/
+
+size_t SendCoalescer_Pending( const SendCoalescer_t * pxCoalescer )
+{
+    return pxCoalescer->xPending;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,122 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file send_coalescer.h
+ * @brief Gathers small writes to a socket into one send.
+ *
+ * mbedTLS sends every record on its own, so one MQTT PUBLISH written as
+ * header, topic and payload becomes three socket sends. On a socket offloaded
+ * to a WiFi module each send is a command exchange with the module. The
+ * coalescer holds the records up to the size of one exchange and sends them
+ * together when it is full, when flushed, or once the oldest byte held is
+ * older than the deadline.
+ *
+ * Not thread safe, callers serialise the calls. No FreeRTOS dependency, ticks
+ * are passed in.
+ */
+
+#ifndef SEND_COALESCER_H
+#define SEND_COALESCER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Sends data on the socket under the coalescer.
+ *
+ * @return Bytes sent, 0 when nothing could be sent before the timeout, negative on error.
+ */
+typedef int32_t ( * SendCoalescerSend_t )( void * pvContext,
+                                           const uint8_t * pucData,
+                                           size_t xDataLength );
+
+/**
+ * @brief What the coalescer saved.
+ */
+typedef struct SendCoalescerStats
+{
+    uint32_t ulWrites;          /**< Writes taken, each one socket send without the coalescer. */
+    uint32_t ulSends;           /**< Socket sends made, partial ones included. */
+    uint32_t ulBytes;           /**< Bytes sent. */
+    uint32_t ulFullFlushes;     /**< Sends because the buffer filled up. */
+    uint32_t ulDeadlineFlushes; /**< Sends because the deadline passed. */
+} SendCoalescerStats_t;
+
+/**
+ * @brief Coalescer state, set up with SendCoalescer_Init.
+ */
+typedef struct SendCoalescer
+{
+    uint8_t * pucBuffer;
+    size_t xBufferSize;
+    size_t xPending;            /**< Bytes held at the start of pucBuffer. */
+    uint32_t ulFirstTick;       /**< When the oldest byte held was written. */
+    uint32_t ulDeadlineTicks;
+    SendCoalescerSend_t xSend;
+    void * pvSendContext;
+    int32_t lError;             /**< First send error, returned from every later call. */
+    SendCoalescerStats_t xStats;
+} SendCoalescer_t;
+
+/**
+ * @brief Set up a coalescer.
+ *
+ * @param[out] pxCoalescer The coalescer.
+ * @param[in] pucBuffer Where writes are held, one socket send at most.
+ * @param[in] xBufferSize Size of @p pucBuffer, the module payload size.
+ * @param[in] ulDeadlineTicks Longest a byte is held.
+ * @param[in] xSend Sends on the socket.
+ * @param[in] pvSendContext Passed to @p xSend.
+ */
+void SendCoalescer_Init( SendCoalescer_t * pxCoalescer,
+                         uint8_t * pucBuffer,
+                         size_t xBufferSize,
+                         uint32_t ulDeadlineTicks,
+                         SendCoalescerSend_t xSend,
+                         void * pvSendContext );
+
+/**
+ * @brief Take data to send.
+ *
+ * Data is copied into the buffer, which is sent first when the data does not
+ * fit. A write at least the buffer size into an empty buffer is sent straight
+ * away without the copy.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] pucData Data to send.
+ * @param[in] xDataLength Length of @p pucData.
+ * @param[in] ulNowTick Current tick.
+ * @return Bytes taken, less than @p xDataLength when the socket did not take the
+ * held data, negative on a send error, this one or an earlier one.
+ */
+int32_t SendCoalescer_Write( SendCoalescer_t * pxCoalescer,
+                             const uint8_t * pucData,
+                             size_t xDataLength,
+                             uint32_t ulNowTick );
+
+/**
+ * @brief Send everything held.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @return Bytes still held when the socket did not take them all, 0 when
+ * everything was sent, negative on a send error.
+ */
+int32_t SendCoalescer_Flush( SendCoalescer_t * pxCoalescer );
+
+/**
+ * @brief Send everything held when the oldest byte is past the deadline.
+ *
+ * @param[in] pxCoalescer The coalescer.
+ * @param[in] ulNowTick Current tick.
+ * @return As SendCoalescer_Flush, bytes held when the deadline is still ahead.
+ */
+int32_t SendCoalescer_FlushIfDue( SendCoalescer_t * pxCoalescer,
+                                  uint32_t ulNowTick );
+
+/**
+ * @brief Bytes held.
+ */
+size_t SendCoalescer_Pending( const SendCoalescer_t * pxCoalescer );
+
+#endif /* SEND_COALESCER_H */
@@ -0,0 +1,255 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file sockets_dns_cache.c
+ * @brief Host name lookups of the socket wrappers through a shared DNS cache.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "sockets_dns_cache.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief How long resolved addresses are kept.
+ */
+#ifndef socketsDNS_CACHE_TTL_SECONDS
+    #define socketsDNS_CACHE_TTL_SECONDS              ( 300 )
+#endif
+
+/**
+ * @brief How long a failed lookup is kept, the connect backoff does not wait
+ * on the resolver again for it.
+ */
+#ifndef socketsDNS_CACHE_NEGATIVE_TTL_SECONDS
+    #define socketsDNS_CACHE_NEGATIVE_TTL_SECONDS     ( 10 )
+#endif
+
+/**
+ * @brief How long before expiry a host in use is resolved again.
+ */
+#ifndef socketsDNS_CACHE_REFRESH_AHEAD_SECONDS
+    #define socketsDNS_CACHE_REFRESH_AHEAD_SECONDS    ( 30 )
+#endif
+
+/**
+ * @brief Hosts not looked up for this long are left to expire.
+ */
+#ifndef socketsDNS_CACHE_IDLE_SECONDS
+    #define socketsDNS_CACHE_IDLE_SECONDS             ( 60 * 60 )
+#endif
+
+/**
+ * @brief Set to 0 to resolve only on a miss, without the refresh task.
+ */
+#ifndef socketsDNS_CACHE_REFRESH_IN_BACKGROUND
+    #define socketsDNS_CACHE_REFRESH_IN_BACKGROUND    ( 1 )
+#endif
+
+#ifndef socketsDNS_CACHE_REFRESH_TASK_STACKSIZE
+    #define socketsDNS_CACHE_REFRESH_TASK_STACKSIZE    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+#ifndef socketsDNS_CACHE_REFRESH_TASK_PRIORITY
+    #define socketsDNS_CACHE_REFRESH_TASK_PRIORITY     ( tskIDLE_PRIORITY )
+#endif
+
+#define socketsDNS_CACHE_SECONDS_TO_TICKS( x )    ( ( uint32_t ) ( x ) * ( uint32_t ) configTICK_RATE_HZ )
+
+/*-----------------------------------------------------------*/
+
+static DnsCache_t xDnsCache;
+
+/* Guards xDnsCache, never held while resolving. */
+static SemaphoreHandle_t xDnsCacheMutex = NULL;
+static StaticSemaphore_t xDnsCacheMutexBuffer;
+
+/* One lookup at a time, the lwIP resolver is not reentrant. */
+static SemaphoreHandle_t xDnsResolveMutex = NULL;
+static StaticSemaphore_t xDnsResolveMutexBuffer;
+
+static SocketsDnsResolve_t xDnsResolve = NULL;
+
+#if ( socketsDNS_CACHE_REFRESH_IN_BACKGROUND == 1 )
+    static TaskHandle_t xDnsRefreshTask = NULL;
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Set up the cache and its mutexes on first use.
+ */
+static void prvInit( void )
+{
+    vTaskSuspendAll();
+    {
+        if( xDnsCacheMutex == NULL )
+        {
+            DnsCache_Init( &xDnsCache,
+                           socketsDNS_CACHE_SECONDS_TO_TICKS( socketsDNS_CACHE_TTL_SECONDS ),
+                           socketsDNS_CACHE_SECONDS_TO_TICKS( socketsDNS_CACHE_NEGATIVE_TTL_SECONDS ),
+                           socketsDNS_CACHE_SECONDS_TO_TICKS( socketsDNS_CACHE_REFRESH_AHEAD_SECONDS ),
+                           socketsDNS_CACHE_SECONDS_TO_TICKS( socketsDNS_CACHE_IDLE_SECONDS ) );
+            xDnsResolveMutex = xSemaphoreCreateMutexStatic( &xDnsResolveMutexBuffer );
+            xDnsCacheMutex = xSemaphoreCreateMutexStatic( &xDnsCacheMutexBuffer );
+        }
+    }
+    ( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Resolve the host and keep the result.
+ *
+ * @return The address resolved, 0 for none.
+ */
+static uint32_t prvResolve( const char * pcHostName )
+{
+    uint32_t ulAddress;
+
+    ( void ) xSemaphoreTake( xDnsResolveMutex, portMAX_DELAY );
+    ulAddress = xDnsResolve( pcHostName );
+    ( void ) xSemaphoreGive( xDnsResolveMutex );
+
+    ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+    DnsCache_Update( &xDnsCache, pcHostName, &ulAddress, ( ulAddress != 0 ) ? 1 : 0, 0,
+                     ( uint32_t ) xTaskGetTickCount() );
+    ( void ) xSemaphoreGive( xDnsCacheMutex );
+
+    return ulAddress;
+}
+/*-----------------------------------------------------------*/
+
+#if ( socketsDNS_CACHE_REFRESH_IN_BACKGROUND == 1 )
+
+    /**
+     * @brief Resolves the hosts in use ahead of expiry, woken when a host is added.
+     */
+    static void prvRefreshTask( void * pvParameters )
+    {
+        char cHostName[ DNS_CACHE_HOST_NAME_LENGTH + 1 ];
+        const char * pcDue;
+        uint32_t ulWaitTicks;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+
+            if( ( pcDue = DnsCache_NextRefresh( &xDnsCache, ( uint32_t ) xTaskGetTickCount(), &ulWaitTicks ) ) != NULL )
+            {
+                strcpy( cHostName, pcDue );
+            }
+
+            ( void ) xSemaphoreGive( xDnsCacheMutex );
+
+            if( pcDue != NULL )
+            {
+                ( void ) prvResolve( cHostName );
+            }
+            else
+            {
+                ( void ) ulTaskNotifyTake( pdTRUE, ( ulWaitTicks == DNS_CACHE_NO_REFRESH ) ?
+                                           portMAX_DELAY : ( TickType_t ) ulWaitTicks );
+            }
+        }
+    }
+/*-----------------------------------------------------------*/
+
+    /**
+     * @brief Start the refresh task on the first host resolved, or wake it to see
+     * a new one. Called with xDnsCacheMutex held.
+     */
+    static void prvWakeRefreshTask( void )
+    {
+        if( xDnsRefreshTask == NULL )
+        {
+            /* Resolved without it when it cannot be created. */
+            ( void ) xTaskCreate( prvRefreshTask,
+                                  "DNSRefresh",
+                                  socketsDNS_CACHE_REFRESH_TASK_STACKSIZE,
+                                  NULL,
+                                  socketsDNS_CACHE_REFRESH_TASK_PRIORITY,
+                                  &xDnsRefreshTask );
+        }
+        else
+        {
+            ( void ) xTaskNotifyGive( xDnsRefreshTask );
+        }
+    }
+/*-----------------------------------------------------------*/
+
+#endif /* if ( socketsDNS_CACHE_REFRESH_IN_BACKGROUND == 1 ) */
+
+uint32_t SocketsDnsCache_GetHostByName( const char * pcHostName,
+                                        SocketsDnsResolve_t xResolve )
+{
+    DnsCacheResult_t xResult;
+    uint32_t ulAddress = 0;
+
+    if( strlen( pcHostName ) > DNS_CACHE_HOST_NAME_LENGTH )
+    {
+        return xResolve( pcHostName );
+    }
+
+    prvInit();
+
+    ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+    xDnsResolve = xResolve;
+    xResult = DnsCache_Lookup( &xDnsCache, pcHostName, ( uint32_t ) xTaskGetTickCount(), &ulAddress );
+    ( void ) xSemaphoreGive( xDnsCacheMutex );
+
+    if( xResult == eDnsCacheMiss )
+    {
+        ulAddress = prvResolve( pcHostName );
+
+        #if ( socketsDNS_CACHE_REFRESH_IN_BACKGROUND == 1 )
+            if( ulAddress != 0 )
+            {
+                ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+                prvWakeRefreshTask();
+                ( void ) xSemaphoreGive( xDnsCacheMutex );
+            }
+        #endif
+    }
+
+    return ulAddress;
+}
+/*-----------------------------------------------------------*/
+
+void SocketsDnsCache_ConnectFailed( const char * pcHostName,
+                                    uint32_t ulAddress )
+{
+    if( xDnsCacheMutex == NULL )
+    {
+        return;
+    }
+
+    ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+    DnsCache_ConnectFailed( &xDnsCache, pcHostName, ulAddress );
+    ( void ) xSemaphoreGive( xDnsCacheMutex );
+}
+/*-----------------------------------------------------------*/
+
+void SocketsDnsCache_GetStats( DnsCacheStats_t * pxStats )
+{
+    if( xDnsCacheMutex == NULL )
+    {
+        memset( pxStats, 0, sizeof( *pxStats ) );
+        return;
+    }
+
+    ( void ) xSemaphoreTake( xDnsCacheMutex, portMAX_DELAY );
+    *pxStats = xDnsCache.xStats;
+    ( void ) xSemaphoreGive( xDnsCacheMutex );
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,55 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/**
+ * @file sockets_dns_cache.h
+ * @brief Host name lookups of the socket wrappers through a shared DNS cache.
+ *
+ * The resolver of the wrapper is called on a miss, one lookup at a time, and
+ * a low priority task resolves the hosts in use again ahead of expiry so a
+ * reconnect does not wait on the resolver. The resolvers of the network stacks
+ * return no TTL, addresses are kept for socketsDNS_CACHE_TTL_SECONDS.
+ */
+
+#ifndef SOCKETS_DNS_CACHE_H
+#define SOCKETS_DNS_CACHE_H
+
+#include <stdint.h>
+
+#include "dns_cache.h"
+
+/**
+ * @brief Resolves a host name with the network stack, blocking.
+ *
+ * @return The IPv4 address in network order, 0 when not resolved.
+ */
+typedef uint32_t ( * SocketsDnsResolve_t )( const char * pcHostName );
+
+/**
+ * @brief Resolve a host name, from the cache when it can.
+ *
+ * @param[in] pcHostName Host name.
+ * @param[in] xResolve Resolver of the wrapper, also used by the refresh task.
+ * @return The address to connect to, 0 when the host did not resolve.
+ */
+uint32_t SocketsDnsCache_GetHostByName( const char * pcHostName,
+                                        SocketsDnsResolve_t xResolve );
+
+/**
+ * @brief Report a connect to an address from SocketsDnsCache_GetHostByName failed,
+ * the next lookup returns another address of the host when it has one.
+ *
+ * @param[in] pcHostName Host name.
+ * @param[in] ulAddress Address the connect failed to.
+ */
+void SocketsDnsCache_ConnectFailed( const char * pcHostName,
+                                    uint32_t ulAddress );
+
+/**
+ * @brief Copy the cache counters.
+ *
+ * @param[out] pxStats Hits, misses, refreshes and failovers so far.
+ */
+void SocketsDnsCache_GetStats( DnsCacheStats_t * pxStats );
+
+#endif /* SOCKETS_DNS_CACHE_H */
@@ -42,6 +42,23 @@ typedef void * SocketHandle;
 #define SOCKETS_SO_RCVTIMEO         ( 0 )          /**< Set the receive timeout. */
 #define SOCKETS_SO_SNDTIMEO         ( 1 )          /**< Set the send timeout. */
 
+/**
+ * @brief Events of Sockets_Poll.
+ */
+#define SOCKETS_POLL_READ           ( 1UL << 0 )   /**< Data to receive, or the connection was closed. */
+#define SOCKETS_POLL_WRITE          ( 1UL << 1 )   /**< Data can be sent. */
+#define SOCKETS_POLL_ERROR          ( 1UL << 2 )   /**< The socket failed or is closed, reported without asking. */
+
+/**
+ * @brief A socket waited on by Sockets_Poll.
+ */
+typedef struct SocketsPollEntry
+{
+    SocketHandle xSocket; /**< Socket to wait on. */
+    uint32_t ulEvents;    /**< SOCKETS_POLL_READ and SOCKETS_POLL_WRITE waited for. */
+    uint32_t ulReady;     /**< Set to the events ready on return. */
+} SocketsPollEntry_t;
+
 /**
  * @brief Initialize the sockets
  *
@@ -88,6 +105,17 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
                             const char * pcHostName,
                             uint16_t usPort );
 
+/**
+ * @brief Resolve a host name through the cache of the wrapper.
+ *
+ * A later Sockets_Connect to the host does not wait on the resolver, so the
+ * lookup can be done while waiting on something else.
+ *
+ * @param[in] pcHostName `NULL` terminated hostname
+ * @return The IPv4 address in network order, 0 when the host did not resolve.
+ */
+uint32_t Sockets_GetHostByName( const char * pcHostName );
+
 /**
  * @brief Disconnect socket handle.
  *
@@ -122,6 +150,25 @@ BaseType_t Sockets_Send( SocketHandle xSocket,
                          const uint8_t * pucData,
                          size_t xDataLength );
 
+/**
+ * @brief Wait until one of the sockets is ready to receive or send.
+ *
+ * Lets one task serve several connections, it sleeps until a socket has data
+ * instead of inside the receive timeout of each in turn. Bytes a TLS
+ * connection already read from its socket are not seen, check the connection
+ * before polling its socket.
+ *
+ * @param[in,out] pxEntries Sockets and the events waited for, ulReady is set on return.
+ * @param[in] xEntryCount Number of entries.
+ * @param[in] xTimeout Longest wait, 0 to only check, portMAX_DELAY to wait forever.
+ * @return A #BaseType_t with the result of the operation.
+ *        - The number of entries with events ready, 0 on timeout.
+ *        - On failure returns a negative error code.
+ */
+BaseType_t Sockets_Poll( SocketsPollEntry_t * pxEntries,
+                         size_t xEntryCount,
+                         TickType_t xTimeout );
+
 /**
  * @brief Set option for socket handle.
  *
@@ -7,6 +7,7 @@
  */
 
 #include "sockets_wrapper.h"
+#include "sockets_dns_cache.h"
 
 /* Standard includes. */
 #include <string.h>
@@ -76,7 +77,7 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
     uint32_t ulIPAddres;
 
     /* Check for errors from DNS lookup. */
-    if( ( ulIPAddres = ( uint32_t ) FreeRTOS_gethostbyname( pcHostName ) ) == 0 )
+    if( ( ulIPAddres = SocketsDnsCache_GetHostByName( pcHostName, FreeRTOS_gethostbyname ) ) == 0 )
     {
         lRetVal = SOCKETS_SOCKET_ERROR;
     }
@@ -90,6 +91,7 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 
         if( FreeRTOS_connect( xTcpSocket, &xServerAddress, sizeof( xServerAddress ) ) != 0 )
         {
+            SocketsDnsCache_ConnectFailed( pcHostName, ulIPAddres );
             lRetVal = SOCKETS_SOCKET_ERROR;
         }
     }
@@ -98,6 +100,12 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+uint32_t Sockets_GetHostByName( const char * pcHostName )
+{
+    return SocketsDnsCache_GetHostByName( pcHostName, FreeRTOS_gethostbyname );
+}
+/*-----------------------------------------------------------*/
+
 void Sockets_Disconnect( SocketHandle xSocket )
 {
     BaseType_t xWaitForShutdownLoopCount = 0;
@@ -142,6 +150,93 @@ BaseType_t Sockets_Send( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t Sockets_Poll( SocketsPollEntry_t * pxEntries,
+                         size_t xEntryCount,
+                         TickType_t xTimeout )
+{
+    BaseType_t xRetVal = 0;
+
+    #if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 )
+        SocketSet_t xSocketSet;
+        EventBits_t xBits;
+        size_t xIndex;
+
+        /* A socket belongs to one set at a time, a set per call lets tasks
+         * poll at the same time. */
+        if( ( pxEntries == NULL ) || ( xEntryCount == 0 ) )
+        {
+            xRetVal = SOCKETS_EINVAL;
+        }
+        else if( ( xSocketSet = FreeRTOS_CreateSocketSet() ) == NULL )
+        {
+            xRetVal = SOCKETS_ENOMEM;
+        }
+        else
+        {
+            for( xIndex = 0; xIndex < xEntryCount; xIndex++ )
+            {
+                xBits = eSELECT_EXCEPT;
+
+                if( ( pxEntries[ xIndex ].ulEvents & SOCKETS_POLL_READ ) != 0U )
+                {
+                    xBits |= eSELECT_READ;
+                }
+
+                if( ( pxEntries[ xIndex ].ulEvents & SOCKETS_POLL_WRITE ) != 0U )
+                {
+                    xBits |= eSELECT_WRITE;
+                }
+
+                pxEntries[ xIndex ].ulReady = 0;
+                FreeRTOS_FD_SET( ( Socket_t ) pxEntries[ xIndex ].xSocket, xSocketSet, xBits );
+            }
+
+            /* Blocks on the event group of the set, woken by the IP task. */
+            ( void ) FreeRTOS_select( xSocketSet, xTimeout );
+
+            for( xIndex = 0; xIndex < xEntryCount; xIndex++ )
+            {
+                xBits = FreeRTOS_FD_ISSET( ( Socket_t ) pxEntries[ xIndex ].xSocket, xSocketSet );
+
+                if( ( xBits & eSELECT_READ ) != 0 )
+                {
+                    pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_READ;
+                }
+
+                if( ( xBits & eSELECT_WRITE ) != 0 )
+                {
+                    pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_WRITE;
+                }
+
+                if( ( xBits & eSELECT_EXCEPT ) != 0 )
+                {
+                    pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_ERROR;
+                }
+
+                if( pxEntries[ xIndex ].ulReady != 0U )
+                {
+                    xRetVal++;
+                }
+
+                /* Leaves the socket free for the next set. */
+                FreeRTOS_FD_CLR( ( Socket_t ) pxEntries[ xIndex ].xSocket, xSocketSet, eSELECT_ALL );
+            }
+
+            FreeRTOS_DeleteSocketSet( xSocketSet );
+        }
+    #else /* if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 ) */
+        ( void ) pxEntries;
+        ( void ) xEntryCount;
+        ( void ) xTimeout;
+
+        /* FreeRTOS_select() is only built with ipconfigSUPPORT_SELECT_FUNCTION. */
+        xRetVal = SOCKETS_ENOPROTOOPT;
+    #endif /* if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 ) */
+
+    return xRetVal;
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t Sockets_SetSockOpt( SocketHandle xSocket,
                                int32_t lOptionName,
                                const void * pvOptionValue,
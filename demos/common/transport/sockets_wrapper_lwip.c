@@ -7,6 +7,7 @@
  */
 
 #include "sockets_wrapper.h"
+#include "sockets_dns_cache.h"
 
 /* Standard includes. */
 #include <stdbool.h>
@@ -179,7 +180,7 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
     uint32_t ulIPAddres = 0;
     struct sockaddr_in xSockAddr = { 0 };
 
-    if( ( ulIPAddres = prvGetHostByName( pcHostName ) ) == 0 )
+    if( ( ulIPAddres = SocketsDnsCache_GetHostByName( pcHostName, prvGetHostByName ) ) == 0 )
     {
         lRetVal = SOCKETS_SOCKET_ERROR;
     }
@@ -191,6 +192,7 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 
         if( lwip_connect( ulSocketNumber, ( struct sockaddr * ) &xSockAddr, sizeof( xSockAddr ) ) < 0 )
         {
+            SocketsDnsCache_ConnectFailed( pcHostName, ulIPAddres );
             lRetVal = SOCKETS_SOCKET_ERROR;
         }
     }
@@ -199,6 +201,12 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+uint32_t Sockets_GetHostByName( const char * pcHostName )
+{
+    return SocketsDnsCache_GetHostByName( pcHostName, prvGetHostByName );
+}
+/*-----------------------------------------------------------*/
+
 void Sockets_Disconnect( SocketHandle xSocket )
 {
     lwip_close( ( uint32_t ) xSocket );
@@ -257,6 +265,98 @@ BaseType_t Sockets_Send( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t Sockets_Poll( SocketsPollEntry_t * pxEntries,
+                         size_t xEntryCount,
+                         TickType_t xTimeout )
+{
+    BaseType_t xRetVal = 0;
+    fd_set xReadSet;
+    fd_set xWriteSet;
+    fd_set xExceptSet;
+    struct timeval xTV;
+    int lMaxSocket = -1;
+    int lSocket;
+    size_t xIndex;
+
+    if( ( pxEntries == NULL ) || ( xEntryCount == 0 ) )
+    {
+        return SOCKETS_EINVAL;
+    }
+
+    FD_ZERO( &xReadSet );
+    FD_ZERO( &xWriteSet );
+    FD_ZERO( &xExceptSet );
+
+    for( xIndex = 0; xIndex < xEntryCount; xIndex++ )
+    {
+        lSocket = ( int ) ( uint32_t ) pxEntries[ xIndex ].xSocket;
+
+        /* FD_SET leaves out numbers past the set, lwIP sockets fit it. */
+        if( lSocket < 0 )
+        {
+            return SOCKETS_EINVAL;
+        }
+
+        if( ( pxEntries[ xIndex ].ulEvents & SOCKETS_POLL_READ ) != 0U )
+        {
+            FD_SET( lSocket, &xReadSet );
+        }
+
+        if( ( pxEntries[ xIndex ].ulEvents & SOCKETS_POLL_WRITE ) != 0U )
+        {
+            FD_SET( lSocket, &xWriteSet );
+        }
+
+        FD_SET( lSocket, &xExceptSet );
+        pxEntries[ xIndex ].ulReady = 0;
+
+        if( lSocket > lMaxSocket )
+        {
+            lMaxSocket = lSocket;
+        }
+    }
+
+    xTV.tv_sec = TICK_TO_S( xTimeout );
+    xTV.tv_usec = TICK_TO_US( xTimeout % configTICK_RATE_HZ );
+
+    /* Blocks on the select semaphore, woken by the tcpip thread. */
+    if( lwip_select( lMaxSocket + 1, &xReadSet, &xWriteSet, &xExceptSet,
+                     ( xTimeout == portMAX_DELAY ) ? NULL : &xTV ) < 0 )
+    {
+        xRetVal = SOCKETS_SOCKET_ERROR;
+    }
+    else
+    {
+        for( xIndex = 0; xIndex < xEntryCount; xIndex++ )
+        {
+            lSocket = ( int ) ( uint32_t ) pxEntries[ xIndex ].xSocket;
+
+            if( FD_ISSET( lSocket, &xReadSet ) )
+            {
+                pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_READ;
+            }
+
+            if( FD_ISSET( lSocket, &xWriteSet ) )
+            {
+                pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_WRITE;
+            }
+
+            if( FD_ISSET( lSocket, &xExceptSet ) )
+            {
+                pxEntries[ xIndex ].ulReady |= SOCKETS_POLL_ERROR;
+            }
+
+            if( pxEntries[ xIndex ].ulReady != 0U )
+            {
+                xRetVal++;
+            }
+        }
+    }
+
+    return xRetVal;
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t Sockets_SetSockOpt( SocketHandle xSocket,
                                int32_t lOptionName,
                                const void * pvOptionValue,
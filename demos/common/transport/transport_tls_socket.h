@@ -38,6 +38,22 @@ typedef struct NetworkCredentials
     size_t xClientCertSize;        /**< @brief Size associated with #NetworkCredentials.pClientCert. */
     const uint8_t * pucPrivateKey; /**< @brief String representing the client certificate's private key. */
     size_t xPrivateKeySize;        /**< @brief Size associated with #NetworkCredentials.pPrivateKey. */
+
+    /**
+     * @brief Offer the session of the last connection to the same host and port,
+     * by session ticket or session ID, and keep this one for the next. The server
+     * does a full handshake when it does not take it.
+     */
+    BaseType_t xEnableSessionResumption;
+
+    /**
+     * @brief Gather the TLS records sent into socket sends of up to this many
+     * bytes, sent when full, before a receive, on TLS_Socket_Flush or by the
+     * first send or receive after a short deadline. Set to the payload size of a
+     * socket offloaded to a module that takes a command exchange per send, 0
+     * sends every record at once.
+     */
+    size_t xSendCoalesceSize;
 } NetworkCredentials_t;
 
 /**
@@ -55,6 +71,24 @@ typedef enum TlsTransportStatus
     eTLSTransportCAVerifyFailed      /**< Verification of TLS CA cert failed. */
 } TlsTransportStatus_t;
 
+/**
+ * @brief What the TLS handshakes cost, resumed ones counted apart.
+ */
+typedef struct TlsTransportStats
+{
+    uint32_t ulFullHandshakes;      /**< Handshakes with certificate verify and key exchange. */
+    uint32_t ulResumedHandshakes;   /**< Handshakes that resumed a cached session. */
+    uint32_t ulRejectedSessions;    /**< Cached sessions the server did not take, a full handshake followed. */
+    uint32_t ulFailedResumptions;   /**< Handshakes that failed with a cached session offered, the session is dropped. */
+    uint32_t ulLastHandshakeMs;     /**< Duration of the last successful handshake. */
+    uint32_t ulLastHandshakeBytes;  /**< Bytes sent and received by the last successful handshake. */
+    uint32_t ulConfigBuilds;        /**< Connections that parsed the credentials into a new TLS configuration. */
+    uint32_t ulConfigReuses;        /**< Connections that reused a configuration already parsed. */
+    uint32_t ulLastConfigBuildMs;   /**< Duration of the last configuration build, DRBG seeding included. */
+    uint32_t ulCoalescedWrites;     /**< Records written by closed connections gathering their sends. */
+    uint32_t ulCoalescedSends;      /**< Socket sends those records took. */
+} TlsTransportStats_t;
+
 /**
  * @brief Connect to TLS endpoint
  *
@@ -73,6 +107,23 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pxNetworkContext,
                                          uint32_t ulReceiveTimeoutMs,
                                          uint32_t ulSendTimeoutMs );
 
+/**
+ * @brief Get the handshake counters of all connections so far.
+ *
+ * @param[out] pxStats Where the counters are copied to.
+ */
+void TLS_Socket_GetStats( TlsTransportStats_t * pxStats );
+
+/**
+ * @brief Drop the TLS configurations parsed from the credentials.
+ *
+ * Connections parse the root CA, client certificate and key once and share the
+ * result with every later connection given the same credential buffers. Call
+ * this after changing a credential buffer in place; a configuration still used
+ * by a connection is freed when that connection is closed.
+ */
+void TLS_Socket_FlushCredentials( void );
+
 /**
  * @brief Disconnect the TLS connection
  *
@@ -80,6 +131,16 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pxNetworkContext,
  */
 void TLS_Socket_Disconnect( NetworkContext_t * pxNetworkContext );
 
+/**
+ * @brief Send the TLS records gathered by a connection with
+ * #NetworkCredentials_t.xSendCoalesceSize set.
+ *
+ * @param pxNetworkContext Pointer to the Network context.
+ * @return 0 when everything was sent, the number of bytes still held when the
+ * socket timed out, negative on a send error.
+ */
+int32_t TLS_Socket_Flush( NetworkContext_t * pxNetworkContext );
+
 /**
  * @brief Receive data from TLS.
  *
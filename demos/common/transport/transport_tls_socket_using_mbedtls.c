@@ -40,6 +40,9 @@ extern void vLoggingPrintf( const char * pcFormatString,
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
 
 /* TLS transport header. */
 #include "transport_tls_socket.h"
@@ -47,6 +50,8 @@ extern void vLoggingPrintf( const char * pcFormatString,
 /* FreeRTOS Socket wrapper include. */
 #include "sockets_wrapper.h"
 
+#include "send_coalescer.h"
+
 /* mbedTLS util includes. */
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
@@ -57,6 +62,36 @@ extern void vLoggingPrintf( const char * pcFormatString,
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Hosts whose last TLS session is kept for resumption, DPS and the hub.
+ */
+#ifndef transportTLS_SESSION_CACHE_SIZE
+    #define transportTLS_SESSION_CACHE_SIZE    2
+#endif
+
+/**
+ * @brief Longest host name a session is kept for, terminator included.
+ */
+#define transportTLS_SESSION_HOST_LENGTH       128
+
+/**
+ * @brief Credential sets whose parsed TLS configuration is kept. DPS and the hub
+ * share one, a second covers ADU or a different root CA.
+ */
+#ifndef transportTLS_SHARED_CONFIG_COUNT
+    #define transportTLS_SHARED_CONFIG_COUNT    2
+#endif
+
+/**
+ * @brief Longest a gathered record waits for more to share its socket send.
+ * coreMQTT writes the parts of a PUBLISH back to back, well within it.
+ */
+#ifndef transportTLS_SEND_COALESCE_DEADLINE_MS
+    #define transportTLS_SEND_COALESCE_DEADLINE_MS    5
+#endif
+
+/*-----------------------------------------------------------*/
+
 /* Each transport defines the same NetworkContext. The user then passes their respective transport */
 /* as pParams for the transport which is defined in the transport header file */
 /* (here it's TlsTransportParams_t) */
@@ -67,20 +102,96 @@ struct NetworkContext
 };
 
 /**
- * @brief Secured connection context.
+ * @brief SSL configuration parsed from a set of credentials, shared by all the
+ * connections given the same credential buffers. Read only once built.
  */
-typedef struct MbedSSLContext
+typedef struct TlsSharedConfig
 {
+    const uint8_t * pucRootCa;               /**< @brief Credential buffers the configuration was built from, the cache key. */
+    size_t xRootCaSize;
+    const uint8_t * pucClientCert;
+    size_t xClientCertSize;
+    const uint8_t * pucPrivateKey;
+    size_t xPrivateKeySize;
+    const char ** ppcAlpnProtos;
+    BaseType_t xEnableSessionResumption;
+    BaseType_t xBuilt;                       /**< @brief pdFALSE when the entry is free. */
+    BaseType_t xStale;                       /**< @brief Flushed while in use, freed by the last connection. */
+    uint32_t ulUsers;                        /**< @brief Connections set up with the configuration. */
+    uint32_t ulLastUsed;                     /**< @brief The least recently used unused entry is replaced. */
     mbedtls_ssl_config config;               /**< @brief SSL connection configuration. */
-    mbedtls_ssl_context context;             /**< @brief SSL connection context */
-    mbedtls_x509_crt_profile certProfile;    /**< @brief Certificate security profile for this connection. */
+    mbedtls_x509_crt_profile certProfile;    /**< @brief Certificate security profile. */
     mbedtls_x509_crt rootCa;                 /**< @brief Root CA certificate context. */
     mbedtls_x509_crt clientCert;             /**< @brief Client certificate context. */
     mbedtls_pk_context privKey;              /**< @brief Client private key context. */
-    mbedtls_entropy_context entropyContext;  /**< @brief Entropy context for random number generation. */
-    mbedtls_ctr_drbg_context ctrDrgbContext; /**< @brief CTR DRBG context for random number generation. */
+} TlsSharedConfig_t;
+
+/**
+ * @brief Secured connection context.
+ */
+typedef struct MbedSSLContext
+{
+    mbedtls_ssl_context context;             /**< @brief SSL connection context */
+    TlsSharedConfig_t * pxSharedConfig;      /**< @brief Configuration of the connection, NULL before the setup. */
+    SocketHandle xTCPSocket;                 /**< @brief Socket under the connection. */
+    uint32_t ulBytesSent;                    /**< @brief Bytes sent on the socket, handshake included. */
+    uint32_t ulBytesReceived;                /**< @brief Bytes received on the socket, handshake included. */
+    SendCoalescer_t xCoalescer;              /**< @brief Gathers the records sent, unused while its buffer is NULL. */
+    TimerHandle_t xCoalescerTimer;           /**< @brief Its ID is set once the deadline of the bytes held passed. */
 } MbedSSLContext_t;
 
+/**
+ * @brief Last session with a host, offered on the next connect to it.
+ */
+typedef struct TlsSessionCacheEntry
+{
+    char cHostName[ transportTLS_SESSION_HOST_LENGTH ]; /**< @brief Empty when the entry is free. */
+    uint16_t usPort;                                    /**< @brief Port of the host. */
+    uint32_t ulLastUsed;                                /**< @brief The least recently used entry is replaced. */
+    mbedtls_ssl_session xSession;                       /**< @brief Session ID or ticket and master secret. */
+} TlsSessionCacheEntry_t;
+
+/**
+ * @brief Sessions kept across connections. Only touched with the scheduler
+ * suspended, DPS, the hub and ADU can connect from different tasks.
+ */
+static TlsSessionCacheEntry_t xSessionCache[ transportTLS_SESSION_CACHE_SIZE ];
+
+/**
+ * @brief Use counter giving the age of the cache entries.
+ */
+static uint32_t ulSessionCacheUses;
+
+/**
+ * @brief Handshake counters of all connections.
+ */
+static TlsTransportStats_t xTlsStats;
+
+/**
+ * @brief Parsed configurations, built and freed with xSharedConfigMutex held.
+ */
+static TlsSharedConfig_t xSharedConfigs[ transportTLS_SHARED_CONFIG_COUNT ];
+
+/**
+ * @brief Use counter giving the age of the shared configurations.
+ */
+static uint32_t ulSharedConfigUses;
+
+/**
+ * @brief Random number generation of all connections, seeded once. The CTR DRBG
+ * takes its own mutex, connections use it concurrently.
+ */
+static mbedtls_entropy_context xEntropyContext;
+static mbedtls_ctr_drbg_context xCtrDrbgContext;
+static BaseType_t xRngSeeded = pdFALSE;
+
+/**
+ * @brief Serialises building, taking and releasing the shared configurations.
+ * Created on the first connect.
+ */
+static StaticSemaphore_t xSharedConfigMutexBuffer;
+static SemaphoreHandle_t xSharedConfigMutex = NULL;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -121,7 +232,8 @@ static const char * pcNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Code>";
 static void sslContextInit( MbedSSLContext_t * pxSslContext );
 
 /**
- * @brief Free the mbed TLS structures in a network connection.
+ * @brief Free the mbed TLS structures in a network connection and release its
+ * shared configuration.
  *
  * @param[in] pxSslContext The SSL context to free.
  */
@@ -134,39 +246,39 @@ static void sslContextFree( MbedSSLContext_t * pxSslContext );
  * from files into stores, so the file API must be called. Start with the
  * root certificate.
  *
- * @param[out] pxSslContext SSL context to which the trusted server root CA is to be added.
+ * @param[out] pxSharedConfig Configuration to which the trusted server root CA is to be added.
  * @param[in] pucRootCa PEM-encoded string of the trusted server root CA.
  * @param[in] xRootCaSize Size of the trusted server root CA.
  *
  * @return 0 on success; otherwise, failure;
  */
-static int32_t setRootCa( MbedSSLContext_t * pxSslContext,
+static int32_t setRootCa( TlsSharedConfig_t * pxSharedConfig,
                           const uint8_t * pucRootCa,
                           size_t xRootCaSize );
 
 /**
  * @brief Set X509 certificate as client certificate for the server to authenticate.
  *
- * @param[out] pxSslContext SSL context to which the client certificate is to be set.
+ * @param[out] pxSharedConfig Configuration to which the client certificate is to be set.
  * @param[in] pucClientCert PEM-encoded string of the client certificate.
  * @param[in] xClientCertSize Size of the client certificate.
  *
  * @return 0 on success; otherwise, failure;
  */
-static int32_t setClientCertificate( MbedSSLContext_t * pxSslContext,
+static int32_t setClientCertificate( TlsSharedConfig_t * pxSharedConfig,
                                      const uint8_t * pucClientCert,
                                      size_t xClientCertSize );
 
 /**
  * @brief Set private key for the client's certificate.
  *
- * @param[out] pxSslContext SSL context to which the private key is to be set.
+ * @param[out] pxSharedConfig Configuration to which the private key is to be set.
  * @param[in] pucPrivateKey PEM-encoded string of the client private key.
  * @param[in] xPrivateKeySize Size of the client private key.
  *
  * @return 0 on success; otherwise, failure;
  */
-static int32_t setPrivateKey( MbedSSLContext_t * pxSslContext,
+static int32_t setPrivateKey( TlsSharedConfig_t * pxSharedConfig,
                               const uint8_t * pucPrivateKey,
                               size_t xPrivateKeySize );
 
@@ -177,29 +289,28 @@ static int32_t setPrivateKey( MbedSSLContext_t * pxSslContext,
  * OpenSSL library. If the client certificate or private key is not NULL, mutual
  * authentication is used when performing the TLS handshake.
  *
- * @param[out] pxSslContext SSL context to which the credentials are to be imported.
+ * @param[out] pxSharedConfig Configuration to which the credentials are to be imported.
  * @param[in] pxNetworkCredentials TLS credentials to be imported.
  *
  * @return 0 on success; otherwise, failure;
  */
-static int32_t setCredentials( MbedSSLContext_t * pxSslContext,
+static int32_t setCredentials( TlsSharedConfig_t * pxSharedConfig,
                                const NetworkCredentials_t * pxNetworkCredentials );
 
 /**
- * @brief Set optional configurations for the TLS connection.
+ * @brief Set optional configurations for the TLS connections.
  *
- * This function is used to set SNI and ALPN protocols.
+ * This function is used to set ALPN protocols, session tickets and the maximum
+ * fragment length.
  *
- * @param[in] pxSslContext SSL context to which the optional configurations are to be set.
- * @param[in] pcHostName Remote host name, used for server name indication.
+ * @param[in] pxSharedConfig Configuration to which the optional configurations are to be set.
  * @param[in] pxNetworkCredentials TLS setup parameters.
  */
-static void setOptionalConfigurations( MbedSSLContext_t * pxSslContext,
-                                       const char * pcHostName,
+static void setOptionalConfigurations( TlsSharedConfig_t * pxSharedConfig,
                                        const NetworkCredentials_t * pxNetworkCredentials );
 
 /**
- * @brief Setup TLS by initializing contexts and setting configurations.
+ * @brief Setup TLS by taking the shared configuration and setting SNI.
  *
  * @param[in] pxNetworkContext Network context.
  * @param[in] pcHostName Remote host name, used for server name indication.
@@ -215,14 +326,130 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pxNetworkContext,
 /**
  * @brief Perform the TLS handshake on a TCP connection.
  *
+ * Offers the cached session of the host when resumption is enabled, and keeps
+ * the new one after a successful handshake.
+ *
  * @param[in] pxNetworkContext Network context.
+ * @param[in] pcHostName Remote host name, the session cache key.
+ * @param[in] usPort Remote port, the session cache key.
  * @param[in] pxNetworkCredentials TLS setup parameters.
  *
  * @return #eTLSTransportSuccess, #eTLSTransportHandshakeFailed, or #eTLSTransportInternalError.
  */
 static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
+                                          const char * pcHostName,
+                                          uint16_t usPort,
                                           const NetworkCredentials_t * pxNetworkCredentials );
 
+/**
+ * @brief Find the cached session of a host. Called with the scheduler suspended.
+ *
+ * @param[in] pcHostName Remote host name.
+ * @param[in] usPort Remote port.
+ *
+ * @return The cache entry, or NULL when there is none.
+ */
+static TlsSessionCacheEntry_t * sessionCacheFind( const char * pcHostName,
+                                                  uint16_t usPort );
+
+/**
+ * @brief Set the cached session of a host on a connection before its handshake.
+ *
+ * @param[in] pxSslContext SSL context of the connection.
+ * @param[in] pcHostName Remote host name.
+ * @param[in] usPort Remote port.
+ * @param[out] pucMaster Master secret of the offered session, the same after a resumed handshake.
+ *
+ * @return pdTRUE when a session was offered.
+ */
+static BaseType_t sessionCacheOffer( MbedSSLContext_t * pxSslContext,
+                                     const char * pcHostName,
+                                     uint16_t usPort,
+                                     unsigned char * pucMaster );
+
+/**
+ * @brief Keep the session of a connection after its handshake, replacing the
+ * one of the same host or the least recently used.
+ *
+ * @param[in] pxSslContext SSL context of the connection.
+ * @param[in] pcHostName Remote host name.
+ * @param[in] usPort Remote port.
+ */
+static void sessionCacheStore( MbedSSLContext_t * pxSslContext,
+                               const char * pcHostName,
+                               uint16_t usPort );
+
+/**
+ * @brief Forget the session of a host, it failed a handshake.
+ *
+ * @param[in] pcHostName Remote host name.
+ * @param[in] usPort Remote port.
+ */
+static void sessionCacheDrop( const char * pcHostName,
+                              uint16_t usPort );
+
+/**
+ * @brief mbed TLS send callback counting the bytes of the connection.
+ */
+static int countingSend( void * pvContext,
+                         const unsigned char * pucData,
+                         size_t xDataLength );
+
+/**
+ * @brief mbed TLS receive callback counting the bytes of the connection.
+ */
+static int countingRecv( void * pvContext,
+                         unsigned char * pucData,
+                         size_t xDataLength );
+
+/**
+ * @brief Allocate the send coalescer of a connection and its deadline timer.
+ *
+ * @param[in] pxSslContext The SSL context.
+ * @param[in] xBufferSize Largest socket send the records are gathered into.
+ *
+ * @return #eTLSTransportSuccess, or #eTLSTransportInsufficientMemory.
+ */
+static TlsTransportStatus_t coalescerSetup( MbedSSLContext_t * pxSslContext,
+                                            size_t xBufferSize );
+
+/**
+ * @brief Stop the deadline timer and free the send coalescer of a connection,
+ * what it still holds is dropped.
+ */
+static void coalescerFree( MbedSSLContext_t * pxSslContext );
+
+/**
+ * @brief Send what the coalescer holds when the deadline timer expired since
+ * the last call.
+ */
+static void coalescerService( MbedSSLContext_t * pxSslContext );
+
+/**
+ * @brief Send everything the coalescer holds.
+ *
+ * @return As SendCoalescer_Flush.
+ */
+static int32_t coalescerFlush( MbedSSLContext_t * pxSslContext );
+
+/**
+ * @brief Set the deadline timer to the deadline of the bytes held, if any.
+ */
+static void coalescerArm( MbedSSLContext_t * pxSslContext );
+
+/**
+ * @brief Coalescer send callback, sends on the socket of the connection.
+ */
+static int32_t coalescerSend( void * pvContext,
+                              const uint8_t * pucData,
+                              size_t xDataLength );
+
+/**
+ * @brief Deadline timer callback, runs in the timer task and only marks the
+ * timer as expired.
+ */
+static void coalescerTimerCallback( TimerHandle_t xTimer );
+
 /**
  * @brief Initialize mbedTLS.
  *
@@ -234,17 +461,68 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
 static TlsTransportStatus_t initMbedtls( mbedtls_entropy_context * pxEntropyContext,
                                          mbedtls_ctr_drbg_context * pxCtrDrgbContext );
 
+/**
+ * @brief Set the shared configuration built from the credentials on a connection,
+ * building it when no connection used these credentials before.
+ *
+ * Seeds the random number generator on the first call.
+ *
+ * @param[in] pxSslContext SSL context of the connection.
+ * @param[in] pxNetworkCredentials TLS setup parameters.
+ *
+ * @return #eTLSTransportSuccess, #eTLSTransportInsufficientMemory, #eTLSTransportInvalidCredentials,
+ * or #eTLSTransportInternalError.
+ */
+static TlsTransportStatus_t sharedConfigAcquire( MbedSSLContext_t * pxSslContext,
+                                                 const NetworkCredentials_t * pxNetworkCredentials );
+
+/**
+ * @brief Release the shared configuration of a connection, freeing it when it
+ * was flushed and this was its last connection.
+ *
+ * @param[in] pxSharedConfig Configuration of the connection.
+ */
+static void sharedConfigRelease( TlsSharedConfig_t * pxSharedConfig );
+
+/**
+ * @brief Parse the credentials into a free configuration entry.
+ *
+ * @param[out] pxSharedConfig Free entry to build.
+ * @param[in] pxNetworkCredentials TLS setup parameters.
+ *
+ * @return #eTLSTransportSuccess, #eTLSTransportInsufficientMemory, or #eTLSTransportInvalidCredentials.
+ */
+static TlsTransportStatus_t sharedConfigBuild( TlsSharedConfig_t * pxSharedConfig,
+                                               const NetworkCredentials_t * pxNetworkCredentials );
+
+/**
+ * @brief Free a configuration entry no connection uses.
+ *
+ * @param[in] pxSharedConfig Entry to free.
+ */
+static void sharedConfigFree( TlsSharedConfig_t * pxSharedConfig );
+
+/**
+ * @brief Check whether a configuration was built from the same credential buffers.
+ *
+ * @param[in] pxSharedConfig Built entry.
+ * @param[in] pxNetworkCredentials TLS setup parameters.
+ *
+ * @return pdTRUE when the entry can be used for the credentials.
+ */
+static BaseType_t sharedConfigMatches( const TlsSharedConfig_t * pxSharedConfig,
+                                       const NetworkCredentials_t * pxNetworkCredentials );
+
 /*-----------------------------------------------------------*/
 
 static void sslContextInit( MbedSSLContext_t * pxSslContext )
 {
     configASSERT( pxSslContext != NULL );
 
-    mbedtls_ssl_config_init( &( pxSslContext->config ) );
-    mbedtls_x509_crt_init( &( pxSslContext->rootCa ) );
-    mbedtls_pk_init( &( pxSslContext->privKey ) );
-    mbedtls_x509_crt_init( &( pxSslContext->clientCert ) );
     mbedtls_ssl_init( &( pxSslContext->context ) );
+    pxSslContext->pxSharedConfig = NULL;
+    pxSslContext->xCoalescer.pucBuffer = NULL;
+    pxSslContext->xCoalescerTimer = NULL;
 }
 /*-----------------------------------------------------------*/
 
@@ -253,26 +531,270 @@ static void sslContextFree( MbedSSLContext_t * pxSslContext )
     configASSERT( pxSslContext != NULL );
 
     mbedtls_ssl_free( &( pxSslContext->context ) );
-    mbedtls_x509_crt_free( &( pxSslContext->rootCa ) );
-    mbedtls_x509_crt_free( &( pxSslContext->clientCert ) );
-    mbedtls_pk_free( &( pxSslContext->privKey ) );
-    mbedtls_entropy_free( &( pxSslContext->entropyContext ) );
-    mbedtls_ctr_drbg_free( &( pxSslContext->ctrDrgbContext ) );
-    mbedtls_ssl_config_free( &( pxSslContext->config ) );
+    coalescerFree( pxSslContext );
+
+    if( pxSslContext->pxSharedConfig != NULL )
+    {
+        sharedConfigRelease( pxSslContext->pxSharedConfig );
+        pxSslContext->pxSharedConfig = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t sharedConfigAcquire( MbedSSLContext_t * pxSslContext,
+                                                 const NetworkCredentials_t * pxNetworkCredentials )
+{
+    TlsTransportStatus_t xRetVal = eTLSTransportSuccess;
+    TlsSharedConfig_t * pxSharedConfig = NULL;
+    BaseType_t xNewConfig = pdFALSE;
+    TickType_t xStartTicks;
+    uint32_t ulBuildMs = 0;
+    uint32_t ulIndex;
+
+    configASSERT( pxSslContext != NULL );
+    configASSERT( pxNetworkCredentials != NULL );
+
+    vTaskSuspendAll();
+    {
+        if( xSharedConfigMutex == NULL )
+        {
+            xSharedConfigMutex = xSemaphoreCreateMutexStatic( &xSharedConfigMutexBuffer );
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    ( void ) xSemaphoreTake( xSharedConfigMutex, portMAX_DELAY );
+    xStartTicks = xTaskGetTickCount();
+
+    if( xRngSeeded == pdFALSE )
+    {
+        xRetVal = initMbedtls( &xEntropyContext, &xCtrDrbgContext );
+
+        if( xRetVal == eTLSTransportSuccess )
+        {
+            xRngSeeded = pdTRUE;
+        }
+        else
+        {
+            /* Initialized again on the next connect. */
+            mbedtls_ctr_drbg_free( &xCtrDrbgContext );
+            mbedtls_entropy_free( &xEntropyContext );
+        }
+    }
+
+    for( ulIndex = 0; ( xRetVal == eTLSTransportSuccess ) && ( pxSharedConfig == NULL ) && ( ulIndex < transportTLS_SHARED_CONFIG_COUNT ); ulIndex++ )
+    {
+        if( ( xSharedConfigs[ ulIndex ].xBuilt != pdFALSE ) &&
+            ( xSharedConfigs[ ulIndex ].xStale == pdFALSE ) &&
+            ( sharedConfigMatches( &( xSharedConfigs[ ulIndex ] ), pxNetworkCredentials ) != pdFALSE ) )
+        {
+            pxSharedConfig = &( xSharedConfigs[ ulIndex ] );
+        }
+    }
+
+    if( ( xRetVal == eTLSTransportSuccess ) && ( pxSharedConfig == NULL ) )
+    {
+        /* A free entry, else the least recently used one no connection holds. */
+        for( ulIndex = 0; ( pxSharedConfig == NULL ) && ( ulIndex < transportTLS_SHARED_CONFIG_COUNT ); ulIndex++ )
+        {
+            if( xSharedConfigs[ ulIndex ].xBuilt == pdFALSE )
+            {
+                pxSharedConfig = &( xSharedConfigs[ ulIndex ] );
+            }
+        }
+
+        if( pxSharedConfig == NULL )
+        {
+            for( ulIndex = 0; ulIndex < transportTLS_SHARED_CONFIG_COUNT; ulIndex++ )
+            {
+                if( ( xSharedConfigs[ ulIndex ].ulUsers == 0 ) &&
+                    ( ( pxSharedConfig == NULL ) || ( xSharedConfigs[ ulIndex ].ulLastUsed < pxSharedConfig->ulLastUsed ) ) )
+                {
+                    pxSharedConfig = &( xSharedConfigs[ ulIndex ] );
+                }
+            }
+        }
+
+        if( pxSharedConfig == NULL )
+        {
+            LogError( ( "All %d TLS configurations are used by open connections.",
+                        transportTLS_SHARED_CONFIG_COUNT ) );
+            xRetVal = eTLSTransportInsufficientMemory;
+        }
+        else
+        {
+            if( pxSharedConfig->xBuilt != pdFALSE )
+            {
+                sharedConfigFree( pxSharedConfig );
+            }
+
+            xRetVal = sharedConfigBuild( pxSharedConfig, pxNetworkCredentials );
+            xNewConfig = pdTRUE;
+        }
+    }
+
+    if( xRetVal == eTLSTransportSuccess )
+    {
+        pxSharedConfig->ulUsers++;
+        pxSharedConfig->ulLastUsed = ++ulSharedConfigUses;
+        pxSslContext->pxSharedConfig = pxSharedConfig;
+        ulBuildMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStartTicks ) * portTICK_PERIOD_MS );
+    }
+
+    ( void ) xSemaphoreGive( xSharedConfigMutex );
+
+    if( xRetVal == eTLSTransportSuccess )
+    {
+        vTaskSuspendAll();
+        {
+            if( xNewConfig != pdFALSE )
+            {
+                xTlsStats.ulConfigBuilds++;
+                xTlsStats.ulLastConfigBuildMs = ulBuildMs;
+            }
+            else
+            {
+                xTlsStats.ulConfigReuses++;
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        if( xNewConfig != pdFALSE )
+        {
+            LogInfo( ( "TLS configuration built in %u ms.", ( unsigned ) ulBuildMs ) );
+        }
+    }
+
+    return xRetVal;
 }
 /*-----------------------------------------------------------*/
 
-static int32_t setRootCa( MbedSSLContext_t * pxSslContext,
+static void sharedConfigRelease( TlsSharedConfig_t * pxSharedConfig )
+{
+    configASSERT( pxSharedConfig != NULL );
+    configASSERT( xSharedConfigMutex != NULL );
+
+    ( void ) xSemaphoreTake( xSharedConfigMutex, portMAX_DELAY );
+    {
+        configASSERT( pxSharedConfig->ulUsers > 0 );
+        pxSharedConfig->ulUsers--;
+
+        if( ( pxSharedConfig->xStale != pdFALSE ) && ( pxSharedConfig->ulUsers == 0 ) )
+        {
+            sharedConfigFree( pxSharedConfig );
+        }
+    }
+    ( void ) xSemaphoreGive( xSharedConfigMutex );
+}
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t sharedConfigBuild( TlsSharedConfig_t * pxSharedConfig,
+                                               const NetworkCredentials_t * pxNetworkCredentials )
+{
+    TlsTransportStatus_t xRetVal = eTLSTransportSuccess;
+    int32_t lMbedtlsError = 0;
+
+    configASSERT( pxSharedConfig != NULL );
+    configASSERT( pxNetworkCredentials != NULL );
+
+    mbedtls_ssl_config_init( &( pxSharedConfig->config ) );
+    mbedtls_x509_crt_init( &( pxSharedConfig->rootCa ) );
+    mbedtls_pk_init( &( pxSharedConfig->privKey ) );
+    mbedtls_x509_crt_init( &( pxSharedConfig->clientCert ) );
+
+    lMbedtlsError = mbedtls_ssl_config_defaults( &( pxSharedConfig->config ),
+                                                 MBEDTLS_SSL_IS_CLIENT,
+                                                 MBEDTLS_SSL_TRANSPORT_STREAM,
+                                                 MBEDTLS_SSL_PRESET_DEFAULT );
+
+    if( lMbedtlsError != 0 )
+    {
+        LogError( ( "Failed to set default SSL configuration: lMbedtlsError[%d]= %s : %s.",
+                    lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
+                    mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
+
+        /* Per mbed TLS docs, mbedtls_ssl_config_defaults only fails on memory allocation. */
+        xRetVal = eTLSTransportInsufficientMemory;
+    }
+
+    if( xRetVal == eTLSTransportSuccess )
+    {
+        lMbedtlsError = setCredentials( pxSharedConfig,
+                                        pxNetworkCredentials );
+
+        if( lMbedtlsError != 0 )
+        {
+            xRetVal = eTLSTransportInvalidCredentials;
+        }
+        else
+        {
+            /* Optionally set ALPN protocols, session tickets and the fragment length. */
+            setOptionalConfigurations( pxSharedConfig,
+                                       pxNetworkCredentials );
+        }
+    }
+
+    if( xRetVal == eTLSTransportSuccess )
+    {
+        pxSharedConfig->pucRootCa = pxNetworkCredentials->pucRootCa;
+        pxSharedConfig->xRootCaSize = pxNetworkCredentials->xRootCaSize;
+        pxSharedConfig->pucClientCert = pxNetworkCredentials->pucClientCert;
+        pxSharedConfig->xClientCertSize = pxNetworkCredentials->xClientCertSize;
+        pxSharedConfig->pucPrivateKey = pxNetworkCredentials->pucPrivateKey;
+        pxSharedConfig->xPrivateKeySize = pxNetworkCredentials->xPrivateKeySize;
+        pxSharedConfig->ppcAlpnProtos = pxNetworkCredentials->ppcAlpnProtos;
+        pxSharedConfig->xEnableSessionResumption = pxNetworkCredentials->xEnableSessionResumption;
+        pxSharedConfig->ulUsers = 0;
+        pxSharedConfig->xStale = pdFALSE;
+        pxSharedConfig->xBuilt = pdTRUE;
+    }
+    else
+    {
+        sharedConfigFree( pxSharedConfig );
+    }
+
+    return xRetVal;
+}
+/*-----------------------------------------------------------*/
+
+static void sharedConfigFree( TlsSharedConfig_t * pxSharedConfig )
+{
+    configASSERT( pxSharedConfig != NULL );
+
+    mbedtls_x509_crt_free( &( pxSharedConfig->rootCa ) );
+    mbedtls_x509_crt_free( &( pxSharedConfig->clientCert ) );
+    mbedtls_pk_free( &( pxSharedConfig->privKey ) );
+    mbedtls_ssl_config_free( &( pxSharedConfig->config ) );
+    pxSharedConfig->xBuilt = pdFALSE;
+    pxSharedConfig->xStale = pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t sharedConfigMatches( const TlsSharedConfig_t * pxSharedConfig,
+                                       const NetworkCredentials_t * pxNetworkCredentials )
+{
+    return ( ( pxSharedConfig->pucRootCa == pxNetworkCredentials->pucRootCa ) &&
+             ( pxSharedConfig->xRootCaSize == pxNetworkCredentials->xRootCaSize ) &&
+             ( pxSharedConfig->pucClientCert == pxNetworkCredentials->pucClientCert ) &&
+             ( pxSharedConfig->xClientCertSize == pxNetworkCredentials->xClientCertSize ) &&
+             ( pxSharedConfig->pucPrivateKey == pxNetworkCredentials->pucPrivateKey ) &&
+             ( pxSharedConfig->xPrivateKeySize == pxNetworkCredentials->xPrivateKeySize ) &&
+             ( pxSharedConfig->ppcAlpnProtos == pxNetworkCredentials->ppcAlpnProtos ) &&
+             ( pxSharedConfig->xEnableSessionResumption == pxNetworkCredentials->xEnableSessionResumption ) ) ? pdTRUE : pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t setRootCa( TlsSharedConfig_t * pxSharedConfig,
                           const uint8_t * pucRootCa,
                           size_t xRootCaSize )
 {
     int32_t lMbedtlsError = -1;
 
-    configASSERT( pxSslContext != NULL );
+    configASSERT( pxSharedConfig != NULL );
     configASSERT( pucRootCa != NULL );
 
     /* Parse the server root CA certificate into the SSL context. */
-    lMbedtlsError = mbedtls_x509_crt_parse( &( pxSslContext->rootCa ),
+    lMbedtlsError = mbedtls_x509_crt_parse( &( pxSharedConfig->rootCa ),
                                             pucRootCa,
                                             xRootCaSize );
 
@@ -284,8 +806,8 @@ static int32_t setRootCa( MbedSSLContext_t * pxSslContext,
     }
     else
     {
-        mbedtls_ssl_conf_ca_chain( &( pxSslContext->config ),
-                                   &( pxSslContext->rootCa ),
+        mbedtls_ssl_conf_ca_chain( &( pxSharedConfig->config ),
+                                   &( pxSharedConfig->rootCa ),
                                    NULL );
     }
 
@@ -293,17 +815,17 @@ static int32_t setRootCa( MbedSSLContext_t * pxSslContext,
 }
 /*-----------------------------------------------------------*/
 
-static int32_t setClientCertificate( MbedSSLContext_t * pxSslContext,
+static int32_t setClientCertificate( TlsSharedConfig_t * pxSharedConfig,
                                      const uint8_t * pucClientCert,
                                      size_t xClientCertSize )
 {
     int32_t lMbedtlsError = -1;
 
-    configASSERT( pxSslContext != NULL );
+    configASSERT( pxSharedConfig != NULL );
     configASSERT( pucClientCert != NULL );
 
     /* Setup the client certificate. */
-    lMbedtlsError = mbedtls_x509_crt_parse( &( pxSslContext->clientCert ),
+    lMbedtlsError = mbedtls_x509_crt_parse( &( pxSharedConfig->clientCert ),
                                             pucClientCert,
                                             xClientCertSize );
 
@@ -318,17 +840,17 @@ static int32_t setClientCertificate( MbedSSLContext_t * pxSslContext,
 }
 /*-----------------------------------------------------------*/
 
-static int32_t setPrivateKey( MbedSSLContext_t * pxSslContext,
+static int32_t setPrivateKey( TlsSharedConfig_t * pxSharedConfig,
                               const uint8_t * pucPrivateKey,
                               size_t xPrivateKeySize )
 {
     int32_t lMbedtlsError = -1;
 
-    configASSERT( pxSslContext != NULL );
+    configASSERT( pxSharedConfig != NULL );
     configASSERT( pucPrivateKey != NULL );
 
     /* Setup the client private key. */
-    lMbedtlsError = mbedtls_pk_parse_key( &( pxSslContext->privKey ),
+    lMbedtlsError = mbedtls_pk_parse_key( &( pxSharedConfig->privKey ),
                                           pucPrivateKey,
                                           xPrivateKeySize,
                                           NULL,
@@ -345,27 +867,27 @@ static int32_t setPrivateKey( MbedSSLContext_t * pxSslContext,
 }
 /*-----------------------------------------------------------*/
 
-static int32_t setCredentials( MbedSSLContext_t * pxSslContext,
+static int32_t setCredentials( TlsSharedConfig_t * pxSharedConfig,
                                const NetworkCredentials_t * pxNetworkCredentials )
 {
     int32_t lMbedtlsError = -1;
 
-    configASSERT( pxSslContext != NULL );
+    configASSERT( pxSharedConfig != NULL );
     configASSERT( pxNetworkCredentials != NULL );
 
     /* Set up the certificate security profile, starting from the default value. */
-    pxSslContext->certProfile = mbedtls_x509_crt_profile_default;
+    pxSharedConfig->certProfile = mbedtls_x509_crt_profile_default;
 
     /* Set SSL authmode and the RNG context. */
-    mbedtls_ssl_conf_authmode( &( pxSslContext->config ),
+    mbedtls_ssl_conf_authmode( &( pxSharedConfig->config ),
                                MBEDTLS_SSL_VERIFY_REQUIRED );
-    mbedtls_ssl_conf_rng( &( pxSslContext->config ),
+    mbedtls_ssl_conf_rng( &( pxSharedConfig->config ),
                           mbedtls_ctr_drbg_random,
-                          &( pxSslContext->ctrDrgbContext ) );
-    mbedtls_ssl_conf_cert_profile( &( pxSslContext->config ),
-                                   &( pxSslContext->certProfile ) );
+                          &xCtrDrbgContext );
+    mbedtls_ssl_conf_cert_profile( &( pxSharedConfig->config ),
+                                   &( pxSharedConfig->certProfile ) );
 
-    lMbedtlsError = setRootCa( pxSslContext,
+    lMbedtlsError = setRootCa( pxSharedConfig,
                                pxNetworkCredentials->pucRootCa,
                                pxNetworkCredentials->xRootCaSize );
 
@@ -374,23 +896,23 @@ static int32_t setCredentials( MbedSSLContext_t * pxSslContext,
     {
         if( lMbedtlsError == 0 )
         {
-            lMbedtlsError = setClientCertificate( pxSslContext,
+            lMbedtlsError = setClientCertificate( pxSharedConfig,
                                                   pxNetworkCredentials->pucClientCert,
                                                   pxNetworkCredentials->xClientCertSize );
         }
 
         if( lMbedtlsError == 0 )
         {
-            lMbedtlsError = setPrivateKey( pxSslContext,
+            lMbedtlsError = setPrivateKey( pxSharedConfig,
                                            pxNetworkCredentials->pucPrivateKey,
                                            pxNetworkCredentials->xPrivateKeySize );
         }
 
         if( lMbedtlsError == 0 )
         {
-            lMbedtlsError = mbedtls_ssl_conf_own_cert( &( pxSslContext->config ),
-                                                       &( pxSslContext->clientCert ),
-                                                       &( pxSslContext->privKey ) );
+            lMbedtlsError = mbedtls_ssl_conf_own_cert( &( pxSharedConfig->config ),
+                                                       &( pxSharedConfig->clientCert ),
+                                                       &( pxSharedConfig->privKey ) );
         }
     }
 
@@ -398,21 +920,19 @@ static int32_t setCredentials( MbedSSLContext_t * pxSslContext,
 }
 /*-----------------------------------------------------------*/
 
-static void setOptionalConfigurations( MbedSSLContext_t * pxSslContext,
-                                       const char * pcHostName,
+static void setOptionalConfigurations( TlsSharedConfig_t * pxSharedConfig,
                                        const NetworkCredentials_t * pxNetworkCredentials )
 {
     int32_t lMbedtlsError = -1;
 
-    configASSERT( pxSslContext != NULL );
-    configASSERT( pcHostName != NULL );
+    configASSERT( pxSharedConfig != NULL );
     configASSERT( pxNetworkCredentials != NULL );
 
     if( pxNetworkCredentials->ppcAlpnProtos != NULL )
     {
         /* Include an application protocol list in the TLS ClientHello
          * message. */
-        lMbedtlsError = mbedtls_ssl_conf_alpn_protocols( &( pxSslContext->config ),
+        lMbedtlsError = mbedtls_ssl_conf_alpn_protocols( &( pxSharedConfig->config ),
                                                          pxNetworkCredentials->ppcAlpnProtos );
 
         if( lMbedtlsError != 0 )
@@ -423,19 +943,12 @@ static void setOptionalConfigurations( MbedSSLContext_t * pxSslContext,
         }
     }
 
-    /* Enable SNI if requested. */
-    if( pxNetworkCredentials->xDisableSni == pdFALSE )
-    {
-        lMbedtlsError = mbedtls_ssl_set_hostname( &( pxSslContext->context ),
-                                                  pcHostName );
-
-        if( lMbedtlsError != 0 )
-        {
-            LogError( ( "Failed to set server name: lMbedtlsError[%d]= %s : %s.",
-                        lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
-        }
-    }
+    /* Ask for a session ticket only when it is kept. */
+    #ifdef MBEDTLS_SSL_SESSION_TICKETS
+        mbedtls_ssl_conf_session_tickets( &( pxSharedConfig->config ),
+                                          ( pxNetworkCredentials->xEnableSessionResumption != pdFALSE ) ?
+                                          MBEDTLS_SSL_SESSION_TICKETS_ENABLED : MBEDTLS_SSL_SESSION_TICKETS_DISABLED );
+    #endif
 
     /* Set Maximum Fragment Length if enabled. */
     #ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
@@ -445,7 +958,7 @@ static void setOptionalConfigurations( MbedSSLContext_t * pxSslContext,
          *
          * Smaller values can be found in "mbedtls/include/ssl.h".
          */
-        lMbedtlsError = mbedtls_ssl_conf_max_frag_len( &( pxSslContext->config ), MBEDTLS_SSL_MAX_FRAG_LEN_4096 );
+        lMbedtlsError = mbedtls_ssl_conf_max_frag_len( &( pxSharedConfig->config ), MBEDTLS_SSL_MAX_FRAG_LEN_4096 );
 
         if( lMbedtlsError != 0 )
         {
@@ -477,39 +990,29 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pxNetworkContext,
 
     pxSSLContext = ( MbedSSLContext_t * ) pxTlsTransportParams->xSSLContext;
 
-    /* Initialize the mbed TLS context structures. */
-    sslContextInit( pxSSLContext );
-
-    lMbedtlsError = mbedtls_ssl_config_defaults( &( pxSSLContext->config ),
-                                                 MBEDTLS_SSL_IS_CLIENT,
-                                                 MBEDTLS_SSL_TRANSPORT_STREAM,
-                                                 MBEDTLS_SSL_PRESET_DEFAULT );
+    /* Parsing the credentials is only done by the first connection using them. */
+    xRetVal = sharedConfigAcquire( pxSSLContext,
+                                   pxNetworkCredentials );
 
-    if( lMbedtlsError != 0 )
+    if( ( xRetVal == eTLSTransportSuccess ) &&
+        ( pxNetworkCredentials->xSendCoalesceSize > 0 ) )
     {
-        LogError( ( "Failed to set default SSL configuration: lMbedtlsError[%d]= %s : %s.",
-                    lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
-
-        /* Per mbed TLS docs, mbedtls_ssl_config_defaults only fails on memory allocation. */
-        xRetVal = eTLSTransportInsufficientMemory;
+        xRetVal = coalescerSetup( pxSSLContext,
+                                  pxNetworkCredentials->xSendCoalesceSize );
     }
 
-    if( xRetVal == eTLSTransportSuccess )
+    /* Enable SNI if requested. */
+    if( ( xRetVal == eTLSTransportSuccess ) &&
+        ( pxNetworkCredentials->xDisableSni == pdFALSE ) )
     {
-        lMbedtlsError = setCredentials( pxSSLContext,
-                                        pxNetworkCredentials );
+        lMbedtlsError = mbedtls_ssl_set_hostname( &( pxSSLContext->context ),
+                                                  pcHostName );
 
         if( lMbedtlsError != 0 )
         {
-            xRetVal = eTLSTransportInvalidCredentials;
-        }
-        else
-        {
-            /* Optionally set SNI and ALPN protocols. */
-            setOptionalConfigurations( pxSSLContext,
-                                       pcHostName,
-                                       pxNetworkCredentials );
+            LogError( ( "Failed to set server name: lMbedtlsError[%d]= %s : %s.",
+                        lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
+                        mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
         }
     }
 
@@ -518,15 +1021,23 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pxNetworkContext,
 /*-----------------------------------------------------------*/
 
 static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
+                                          const char * pcHostName,
+                                          uint16_t usPort,
                                           const NetworkCredentials_t * pxNetworkCredentials )
 {
     TlsTransportParams_t * pxTlsTransportParams = NULL;
     TlsTransportStatus_t xRetVal = eTLSTransportSuccess;
     int32_t lMbedtlsError = 0;
     MbedSSLContext_t * pxSSLContext = NULL;
+    unsigned char ucOfferedMaster[ sizeof( ( ( mbedtls_ssl_session * ) NULL )->master ) ];
+    BaseType_t xOffered = pdFALSE;
+    BaseType_t xResumed = pdFALSE;
+    TickType_t xStartTicks;
+    uint32_t ulHandshakeMs;
 
     configASSERT( pxNetworkContext != NULL );
     configASSERT( pxNetworkContext->pParams != NULL );
+    configASSERT( pcHostName != NULL );
     configASSERT( pxNetworkCredentials != NULL );
 
     pxTlsTransportParams = ( TlsTransportParams_t * ) pxNetworkContext->pParams;
@@ -536,7 +1047,7 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
 
     /* Initialize the mbed TLS secured connection context. */
     lMbedtlsError = mbedtls_ssl_setup( &( pxSSLContext->context ),
-                                       &( pxSSLContext->config ) );
+                                       &( pxSSLContext->pxSharedConfig->config ) );
 
     if( lMbedtlsError != 0 )
     {
@@ -548,22 +1059,27 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
     }
     else
     {
-        /* Set the underlying IO for the TLS connection. */
-
-        /* MISRA Rule 11.2 flags the following line for casting the second
-         * parameter to void *. This rule is suppressed because
-         * #mbedtls_ssl_set_bio requires the second parameter as void *.
-         */
-        /* coverity[misra_c_2012_rule_11_2_violation] */
+        /* Set the underlying IO for the TLS connection, counting the bytes
+         * of the handshake. */
+        pxSSLContext->xTCPSocket = pxTlsTransportParams->xTCPSocket;
+        pxSSLContext->ulBytesSent = 0;
+        pxSSLContext->ulBytesReceived = 0;
         mbedtls_ssl_set_bio( &( pxSSLContext->context ),
-                             ( void * ) pxTlsTransportParams->xTCPSocket,
-                             mbedtls_platform_send,
-                             mbedtls_platform_recv,
+                             ( void * ) pxSSLContext,
+                             countingSend,
+                             countingRecv,
                              NULL );
+
+        if( pxNetworkCredentials->xEnableSessionResumption != pdFALSE )
+        {
+            xOffered = sessionCacheOffer( pxSSLContext, pcHostName, usPort, ucOfferedMaster );
+        }
     }
 
     if( xRetVal == eTLSTransportSuccess )
     {
+        xStartTicks = xTaskGetTickCount();
+
         /* Perform the TLS handshake. */
         do
         {
@@ -585,18 +1101,395 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pxNetworkContext,
             {
                 xRetVal = eTLSTransportHandshakeFailed;
             }
+
+            /* The next connect does a full handshake. */
+            if( xOffered != pdFALSE )
+            {
+                sessionCacheDrop( pcHostName, usPort );
+            }
         }
         else
         {
-            LogInfo( ( "(Network connection %p) TLS handshake successful.",
-                       pxNetworkContext ) );
+            ulHandshakeMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStartTicks ) * portTICK_PERIOD_MS );
+
+            /* A resumed session keeps the master secret, a full handshake makes a new one. */
+            xResumed = ( ( xOffered != pdFALSE ) &&
+                         ( memcmp( pxSSLContext->context.session->master, ucOfferedMaster, sizeof( ucOfferedMaster ) ) == 0 ) ) ? pdTRUE : pdFALSE;
+
+            if( pxNetworkCredentials->xEnableSessionResumption != pdFALSE )
+            {
+                sessionCacheStore( pxSSLContext, pcHostName, usPort );
+            }
+
+            LogInfo( ( "(Network connection %p) TLS handshake successful, %s in %u ms, %u bytes sent, %u received.",
+                       pxNetworkContext, ( xResumed != pdFALSE ) ? "resumed" : "full", ( unsigned ) ulHandshakeMs,
+                       ( unsigned ) pxSSLContext->ulBytesSent, ( unsigned ) pxSSLContext->ulBytesReceived ) );
+        }
+
+        vTaskSuspendAll();
+        {
+            if( xRetVal == eTLSTransportSuccess )
+            {
+                if( xResumed != pdFALSE )
+                {
+                    xTlsStats.ulResumedHandshakes++;
+                }
+                else
+                {
+                    xTlsStats.ulFullHandshakes++;
+                    xTlsStats.ulRejectedSessions += ( xOffered != pdFALSE ) ? 1 : 0;
+                }
+
+                xTlsStats.ulLastHandshakeMs = ulHandshakeMs;
+                xTlsStats.ulLastHandshakeBytes = pxSSLContext->ulBytesSent + pxSSLContext->ulBytesReceived;
+            }
+            else if( xOffered != pdFALSE )
+            {
+                xTlsStats.ulFailedResumptions++;
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+    return xRetVal;
+}
+/*-----------------------------------------------------------*/
+
+static TlsSessionCacheEntry_t * sessionCacheFind( const char * pcHostName,
+                                                  uint16_t usPort )
+{
+    uint32_t ulIndex;
+
+    for( ulIndex = 0; ulIndex < transportTLS_SESSION_CACHE_SIZE; ulIndex++ )
+    {
+        if( ( xSessionCache[ ulIndex ].usPort == usPort ) &&
+            ( strcmp( xSessionCache[ ulIndex ].cHostName, pcHostName ) == 0 ) )
+        {
+            return &( xSessionCache[ ulIndex ] );
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t sessionCacheOffer( MbedSSLContext_t * pxSslContext,
+                                     const char * pcHostName,
+                                     uint16_t usPort,
+                                     unsigned char * pucMaster )
+{
+    TlsSessionCacheEntry_t * pxEntry;
+    int32_t lMbedtlsError = 0;
+    BaseType_t xOffered = pdFALSE;
+
+    vTaskSuspendAll();
+    {
+        pxEntry = sessionCacheFind( pcHostName, usPort );
+
+        if( pxEntry != NULL )
+        {
+            lMbedtlsError = mbedtls_ssl_set_session( &( pxSslContext->context ), &( pxEntry->xSession ) );
+
+            if( lMbedtlsError == 0 )
+            {
+                memcpy( pucMaster, pxEntry->xSession.master, sizeof( pxEntry->xSession.master ) );
+                pxEntry->ulLastUsed = ++ulSessionCacheUses;
+                xOffered = pdTRUE;
+            }
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    if( lMbedtlsError != 0 )
+    {
+        LogWarn( ( "Failed to offer the cached TLS session, doing a full handshake: lMbedtlsError[%d]= %s : %s.",
+                   lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
+                   mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
+    }
+
+    return xOffered;
+}
+/*-----------------------------------------------------------*/
+
+static void sessionCacheStore( MbedSSLContext_t * pxSslContext,
+                               const char * pcHostName,
+                               uint16_t usPort )
+{
+    TlsSessionCacheEntry_t * pxEntry;
+    uint32_t ulIndex;
+    int32_t lMbedtlsError;
+
+    if( strlen( pcHostName ) >= transportTLS_SESSION_HOST_LENGTH )
+    {
+        return;
+    }
+
+    vTaskSuspendAll();
+    {
+        pxEntry = sessionCacheFind( pcHostName, usPort );
+
+        for( ulIndex = 0; ( pxEntry == NULL ) && ( ulIndex < transportTLS_SESSION_CACHE_SIZE ); ulIndex++ )
+        {
+            if( xSessionCache[ ulIndex ].cHostName[ 0 ] == '\0' )
+            {
+                pxEntry = &( xSessionCache[ ulIndex ] );
+            }
+        }
+
+        if( pxEntry == NULL )
+        {
+            pxEntry = &( xSessionCache[ 0 ] );
+
+            for( ulIndex = 1; ulIndex < transportTLS_SESSION_CACHE_SIZE; ulIndex++ )
+            {
+                if( xSessionCache[ ulIndex ].ulLastUsed < pxEntry->ulLastUsed )
+                {
+                    pxEntry = &( xSessionCache[ ulIndex ] );
+                }
+            }
+        }
+
+        /* Freeing leaves the session zeroed, as initialized. */
+        mbedtls_ssl_session_free( &( pxEntry->xSession ) );
+        lMbedtlsError = mbedtls_ssl_get_session( &( pxSslContext->context ), &( pxEntry->xSession ) );
+
+        if( lMbedtlsError == 0 )
+        {
+            strcpy( pxEntry->cHostName, pcHostName );
+            pxEntry->usPort = usPort;
+            pxEntry->ulLastUsed = ++ulSessionCacheUses;
+        }
+        else
+        {
+            mbedtls_ssl_session_free( &( pxEntry->xSession ) );
+            pxEntry->cHostName[ 0 ] = '\0';
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    if( lMbedtlsError != 0 )
+    {
+        LogWarn( ( "Failed to keep the TLS session of %s: lMbedtlsError[%d]= %s : %s.",
+                   pcHostName, lMbedtlsError, mbedtlsHighLevelCodeOrDefault( lMbedtlsError ),
+                   mbedtlsLowLevelCodeOrDefault( lMbedtlsError ) ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void sessionCacheDrop( const char * pcHostName,
+                              uint16_t usPort )
+{
+    TlsSessionCacheEntry_t * pxEntry;
+
+    vTaskSuspendAll();
+    {
+        pxEntry = sessionCacheFind( pcHostName, usPort );
+
+        if( pxEntry != NULL )
+        {
+            mbedtls_ssl_session_free( &( pxEntry->xSession ) );
+            pxEntry->cHostName[ 0 ] = '\0';
+        }
+    }
+    ( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+static int countingSend( void * pvContext,
+                         const unsigned char * pucData,
+                         size_t xDataLength )
+{
+    MbedSSLContext_t * pxSslContext = ( MbedSSLContext_t * ) pvContext;
+    int lSent;
+
+    if( pxSslContext->xCoalescer.pucBuffer == NULL )
+    {
+        /* MISRA Rule 11.2 flags the following line for casting the first
+         * parameter to void *. This rule is suppressed because
+         * #mbedtls_platform_send requires the first parameter as void *.
+         */
+        /* coverity[misra_c_2012_rule_11_2_violation] */
+        lSent = mbedtls_platform_send( ( void * ) pxSslContext->xTCPSocket, pucData, xDataLength );
+    }
+    else
+    {
+        lSent = ( int ) SendCoalescer_Write( &( pxSslContext->xCoalescer ),
+                                             pucData,
+                                             xDataLength,
+                                             ( uint32_t ) xTaskGetTickCount() );
+        coalescerArm( pxSslContext );
+    }
+
+    if( lSent > 0 )
+    {
+        pxSslContext->ulBytesSent += ( uint32_t ) lSent;
+    }
+
+    return lSent;
+}
+/*-----------------------------------------------------------*/
+
+static int countingRecv( void * pvContext,
+                         unsigned char * pucData,
+                         size_t xDataLength )
+{
+    MbedSSLContext_t * pxSslContext = ( MbedSSLContext_t * ) pvContext;
+    int lReceived = 0;
+
+    /* Whatever is awaited answers what was sent, nothing is held back. */
+    if( pxSslContext->xCoalescer.pucBuffer != NULL )
+    {
+        lReceived = ( int ) coalescerFlush( pxSslContext );
+    }
+
+    if( lReceived >= 0 )
+    {
+        /* coverity[misra_c_2012_rule_11_2_violation] */
+        lReceived = mbedtls_platform_recv( ( void * ) pxSslContext->xTCPSocket, pucData, xDataLength );
+
+        if( lReceived > 0 )
+        {
+            pxSslContext->ulBytesReceived += ( uint32_t ) lReceived;
         }
     }
 
+    return lReceived;
+}
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t coalescerSetup( MbedSSLContext_t * pxSslContext,
+                                            size_t xBufferSize )
+{
+    TlsTransportStatus_t xRetVal = eTLSTransportSuccess;
+    TickType_t xDeadline = pdMS_TO_TICKS( transportTLS_SEND_COALESCE_DEADLINE_MS );
+    uint8_t * pucBuffer;
+
+    if( xDeadline == 0 )
+    {
+        xDeadline = 1;
+    }
+
+    if( ( pucBuffer = pvPortMalloc( xBufferSize ) ) == NULL )
+    {
+        LogError( ( "Failed to allocate the %u byte send coalescing buffer.",
+                    ( unsigned int ) xBufferSize ) );
+        xRetVal = eTLSTransportInsufficientMemory;
+    }
+    else if( ( pxSslContext->xCoalescerTimer = xTimerCreate( "TLSFlush",
+                                                             xDeadline,
+                                                             pdFALSE,
+                                                             NULL,
+                                                             coalescerTimerCallback ) ) == NULL )
+    {
+        LogError( ( "Failed to create the send coalescing timer." ) );
+        vPortFree( pucBuffer );
+        xRetVal = eTLSTransportInsufficientMemory;
+    }
+    else
+    {
+        SendCoalescer_Init( &( pxSslContext->xCoalescer ),
+                            pucBuffer,
+                            xBufferSize,
+                            ( uint32_t ) xDeadline,
+                            coalescerSend,
+                            ( void * ) pxSslContext );
+    }
+
     return xRetVal;
 }
 /*-----------------------------------------------------------*/
 
+static void coalescerFree( MbedSSLContext_t * pxSslContext )
+{
+    if( pxSslContext->xCoalescer.pucBuffer != NULL )
+    {
+        /* The delete is only queued to the timer task, which may still run
+         * an expiry ahead of it at any priority. The callback touches nothing
+         * but the timer, which the timer task frees itself. */
+        ( void ) xTimerDelete( pxSslContext->xCoalescerTimer, portMAX_DELAY );
+        pxSslContext->xCoalescerTimer = NULL;
+
+        LogInfo( ( "Sent %u records in %u socket sends.",
+                   ( unsigned int ) pxSslContext->xCoalescer.xStats.ulWrites,
+                   ( unsigned int ) pxSslContext->xCoalescer.xStats.ulSends ) );
+
+        vTaskSuspendAll();
+        {
+            xTlsStats.ulCoalescedWrites += pxSslContext->xCoalescer.xStats.ulWrites;
+            xTlsStats.ulCoalescedSends += pxSslContext->xCoalescer.xStats.ulSends;
+        }
+        ( void ) xTaskResumeAll();
+
+        vPortFree( pxSslContext->xCoalescer.pucBuffer );
+        pxSslContext->xCoalescer.pucBuffer = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void coalescerService( MbedSSLContext_t * pxSslContext )
+{
+    if( ( pxSslContext->xCoalescer.pucBuffer != NULL ) &&
+        ( pvTimerGetTimerID( pxSslContext->xCoalescerTimer ) != NULL ) )
+    {
+        vTimerSetTimerID( pxSslContext->xCoalescerTimer, NULL );
+
+        /* A send error is kept by the coalescer and returned by the next write. */
+        ( void ) SendCoalescer_FlushIfDue( &( pxSslContext->xCoalescer ),
+                                           ( uint32_t ) xTaskGetTickCount() );
+        coalescerArm( pxSslContext );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int32_t coalescerFlush( MbedSSLContext_t * pxSslContext )
+{
+    int32_t lResult = SendCoalescer_Flush( &( pxSslContext->xCoalescer ) );
+
+    coalescerArm( pxSslContext );
+
+    return lResult;
+}
+/*-----------------------------------------------------------*/
+
+static void coalescerArm( MbedSSLContext_t * pxSslContext )
+{
+    SendCoalescer_t * pxCoalescer = &( pxSslContext->xCoalescer );
+    uint32_t ulHeld;
+
+    if( ( pxCoalescer->lError == 0 ) && ( SendCoalescer_Pending( pxCoalescer ) > 0 ) )
+    {
+        ulHeld = ( uint32_t ) xTaskGetTickCount() - pxCoalescer->ulFirstTick;
+
+        /* Restarts the timer for what is left until the deadline. Past it the
+         * held bytes wait on the socket, tried again a tick later. */
+        ( void ) xTimerChangePeriod( pxSslContext->xCoalescerTimer,
+                                     ( ulHeld < pxCoalescer->ulDeadlineTicks ) ?
+                                     ( TickType_t ) ( pxCoalescer->ulDeadlineTicks - ulHeld ) : 1,
+                                     0 );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static int32_t coalescerSend( void * pvContext,
+                              const uint8_t * pucData,
+                              size_t xDataLength )
+{
+    MbedSSLContext_t * pxSslContext = ( MbedSSLContext_t * ) pvContext;
+
+    /* coverity[misra_c_2012_rule_11_2_violation] */
+    return ( int32_t ) mbedtls_platform_send( ( void * ) pxSslContext->xTCPSocket, pucData, xDataLength );
+}
+/*-----------------------------------------------------------*/
+
+static void coalescerTimerCallback( TimerHandle_t xTimer )
+{
+    /* No socket I/O in the timer task, the connection sends the held bytes on
+     * its next TLS_Socket_Send or TLS_Socket_Recv, which the MQTT process loop
+     * keeps calling. */
+    vTimerSetTimerID( xTimer, ( void * ) xTimer );
+}
+/*-----------------------------------------------------------*/
+
 static TlsTransportStatus_t initMbedtls( mbedtls_entropy_context * pxEntropyContext,
                                          mbedtls_ctr_drbg_context * pxCtrDrgbContext )
 {
@@ -695,6 +1588,7 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pxNetworkContext,
     {
         pxTlsTransportParams = pxNetworkContext->pParams;
         pxTlsTransportParams->xSSLContext = ( SSLContextHandle ) pxSSLContext;
+        sslContextInit( pxSSLContext );
 
         if( ( pxTlsTransportParams->xTCPSocket = Sockets_Open() ) == SOCKETS_INVALID_SOCKET )
         {
@@ -726,17 +1620,13 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pxNetworkContext,
                         xSocketStatus ) );
             xRetVal = eTLSTransportConnectFailure;
         }
-        else if( ( xRetVal = initMbedtls( &( pxSSLContext->entropyContext ),
-                                          &( pxSSLContext->ctrDrgbContext ) ) ) != eTLSTransportSuccess )
-        {
-            LogError( ( "Failed to initialize Mbedtls %d.", xRetVal ) );
-        }
         else if( ( xRetVal = tlsSetup( pxNetworkContext, pcHostName,
                                        pxNetworkCredentials ) ) != eTLSTransportSuccess )
         {
             LogError( ( "Failed to setup Mbedtls %d.", xRetVal ) );
         }
-        else if( ( xRetVal = tlsHandshake( pxNetworkContext, pxNetworkCredentials ) ) != eTLSTransportSuccess )
+        else if( ( xRetVal = tlsHandshake( pxNetworkContext, pcHostName, usPort,
+                                           pxNetworkCredentials ) ) != eTLSTransportSuccess )
         {
             LogError( ( "Failed to do TLS handshake %d.", xRetVal ) );
         }
@@ -769,6 +1659,48 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pxNetworkContext,
 }
 /*-----------------------------------------------------------*/
 
+void TLS_Socket_GetStats( TlsTransportStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    vTaskSuspendAll();
+    {
+        *pxStats = xTlsStats;
+    }
+    ( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+void TLS_Socket_FlushCredentials( void )
+{
+    uint32_t ulIndex;
+
+    /* Nothing was built before the first connect. */
+    if( xSharedConfigMutex != NULL )
+    {
+        ( void ) xSemaphoreTake( xSharedConfigMutex, portMAX_DELAY );
+        {
+            for( ulIndex = 0; ulIndex < transportTLS_SHARED_CONFIG_COUNT; ulIndex++ )
+            {
+                if( xSharedConfigs[ ulIndex ].xBuilt == pdFALSE )
+                {
+                    /* Free entry. */
+                }
+                else if( xSharedConfigs[ ulIndex ].ulUsers == 0 )
+                {
+                    sharedConfigFree( &( xSharedConfigs[ ulIndex ] ) );
+                }
+                else
+                {
+                    xSharedConfigs[ ulIndex ].xStale = pdTRUE;
+                }
+            }
+        }
+        ( void ) xSemaphoreGive( xSharedConfigMutex );
+    }
+}
+/*-----------------------------------------------------------*/
+
 void TLS_Socket_Disconnect( NetworkContext_t * pxNetworkContext )
 {
     TlsTransportParams_t * pxTlsTransportParams = NULL;
@@ -828,16 +1760,44 @@ void TLS_Socket_Disconnect( NetworkContext_t * pxNetworkContext )
                    pxNetworkContext ) );
     }
 
+    /* The close-notify may still be gathered. */
+    if( pxSSLContext->xCoalescer.pucBuffer != NULL )
+    {
+        ( void ) coalescerFlush( pxSSLContext );
+    }
+
     /* Call socket shutdown function to close connection. */
     Sockets_Disconnect( pxTlsTransportParams->xTCPSocket );
     Sockets_Close( pxTlsTransportParams->xTCPSocket );
 
-    /* Free mbed TLS contexts. */
+    /* Free mbed TLS contexts. The mutex functions stay set, the shared
+     * random number generator and configurations still use them. */
     sslContextFree( pxSSLContext );
     vPortFree( pxSSLContext );
+}
+/*-----------------------------------------------------------*/
+
+int32_t TLS_Socket_Flush( NetworkContext_t * pxNetworkContext )
+{
+    int32_t lResult = 0;
+    MbedSSLContext_t * pxSSLContext;
+    TlsTransportParams_t * pxTlsTransportParams = NULL;
+
+    configASSERT( ( pxNetworkContext != NULL ) &&
+                  ( pxNetworkContext->pParams != NULL ) );
+
+    pxTlsTransportParams = ( TlsTransportParams_t * ) pxNetworkContext->pParams;
+
+    configASSERT( pxTlsTransportParams->xSSLContext != NULL );
+
+    pxSSLContext = ( MbedSSLContext_t * ) pxTlsTransportParams->xSSLContext;
+
+    if( pxSSLContext->xCoalescer.pucBuffer != NULL )
+    {
+        lResult = coalescerFlush( pxSSLContext );
+    }
 
-    /* Clear the mutex functions for mbed TLS thread safety. */
-    mbedtls_threading_free_alt();
+    return lResult;
 }
 /*-----------------------------------------------------------*/
 
@@ -857,6 +1817,8 @@ int32_t TLS_Socket_Recv( NetworkContext_t * pxNetworkContext,
     configASSERT( pxTlsTransportParams->xSSLContext != NULL );
 
     pxSSLContext = ( MbedSSLContext_t * ) pxTlsTransportParams->xSSLContext;
+    coalescerService( pxSSLContext );
+
     lMbedtlsError = ( int32_t ) mbedtls_ssl_read( &( pxSSLContext->context ),
                                                   pvBuffer,
                                                   xBytesToRecv );
@@ -905,6 +1867,8 @@ int32_t TLS_Socket_Send( NetworkContext_t * pxNetworkContext,
     configASSERT( pxTlsTransportParams->xSSLContext != NULL );
 
     pxSSLContext = ( MbedSSLContext_t * ) pxTlsTransportParams->xSSLContext;
+    coalescerService( pxSSLContext );
+
     lMbedtlsError = ( int32_t ) mbedtls_ssl_write( &( pxSSLContext->context ),
                                                    pvBuffer,
                                                    xBytesToSend );
@@ -43,6 +43,7 @@
 #define MBEDTLS_SSL_PROTO_TLS1_2
 #define MBEDTLS_SSL_ALPN
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_SSL_SESSION_TICKETS
 
 /* Check certificate key usage. */
 #define MBEDTLS_X509_CHECK_KEY_USAGE
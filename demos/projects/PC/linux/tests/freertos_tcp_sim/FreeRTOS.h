@@ -0,0 +1,25 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * Just enough of FreeRTOS.h for the sockets wrapper under a host harness,
+ * time is virtual and kept by the test.
+ */
+
+#ifndef FREERTOS_TCP_SIM_FREERTOS_H
+#define FREERTOS_TCP_SIM_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE               ( ( BaseType_t ) 0 )
+#define pdTRUE                ( ( BaseType_t ) 1 )
+#define portMAX_DELAY         ( ( TickType_t ) 0xffffffffUL )
+#define configTICK_RATE_HZ    ( 1000 )
+#define pdMS_TO_TICKS( x )    ( ( TickType_t ) ( x ) )
+
+#endif /* FREERTOS_TCP_SIM_FREERTOS_H */
@@ -0,0 +1,15 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * FreeRTOS+TCP DNS calls made by the sockets wrapper, implemented by the test.
+ */
+
+#ifndef FREERTOS_TCP_SIM_FREERTOS_DNS_H
+#define FREERTOS_TCP_SIM_FREERTOS_DNS_H
+
+#include "FreeRTOS.h"
+
+uint32_t FreeRTOS_gethostbyname( const char * pcHostName );
+
+#endif /* FREERTOS_TCP_SIM_FREERTOS_DNS_H */
@@ -0,0 +1,17 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * FreeRTOS+TCP configuration seen by the sockets wrapper under a host harness.
+ */
+
+#ifndef FREERTOS_TCP_SIM_FREERTOS_IP_H
+#define FREERTOS_TCP_SIM_FREERTOS_IP_H
+
+#include "FreeRTOS.h"
+
+#define ipconfigSUPPORT_SELECT_FUNCTION    1
+
+#define FreeRTOS_htons( usIn )    ( ( uint16_t ) ( ( ( usIn ) << 8U ) | ( ( usIn ) >> 8U ) ) )
+
+#endif /* FREERTOS_TCP_SIM_FREERTOS_IP_H */
@@ -0,0 +1,38 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * Controller frames recorded on the bench, shared by the host harnesses.
+ */
+
+#ifndef RECORDED_CONTROLLER_FRAMES_H
+#define RECORDED_CONTROLLER_FRAMES_H
+
+#include <stdint.h>
+
+#include "frame_parser.h"
+
+/* UNIT frame captured from the controller: 9 heaters around 95-103 C, fan and butterfly 1 on. */
+static const uint8_t ucRecordedUnitFrame[ MESSAGE_LENGTH_UNIT_STATUS ] =
+{
+    0x44, 0x00, 0x55, 0x00, 0x08, 0x02, 0x01, 0xFF, 0x00, 0x5F, 0x80, 0x00,
+    0x00, 0x60, 0x40, 0x00, 0x00, 0x61, 0x00, 0x00, 0x00, 0x62, 0x80, 0x00,
+    0x00, 0x63, 0x00, 0x00, 0x00, 0x64, 0x40, 0x00, 0x00, 0x65, 0x00, 0x00,
+    0x00, 0x66, 0x80, 0x00, 0x00, 0x67, 0x00, 0x00, 0x03, 0x00, 0x00, 0xD9,
+    0x9A, 0x00, 0x2D, 0x80, 0x00, 0x00, 0x15, 0xC0, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x42
+};
+
+/* SKID frame captured from the controller: O2 20.9 %, mass flow 12.5, tank 4.2 bar. */
+static const uint8_t ucRecordedSkidFrame[ MESSAGE_LENGTH_SKID_STATUS ] =
+{
+    0x44, 0x00, 0x53, 0x00, 0x00, 0x02, 0x00, 0xC3, 0x00, 0x14, 0xE6, 0x66,
+    0x00, 0x0C, 0x80, 0x00, 0x00, 0x00, 0x0A, 0x3D, 0x00, 0x04, 0x33, 0x33,
+    0x00, 0x01, 0x0C, 0xCD, 0x00, 0x19, 0x80, 0x00, 0x00, 0x28, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xB4
+};
+
+/* Line noise seen between frames after a controller reset. */
+static const uint8_t ucRecordedNoise[] = { 0x00, 0xFF, 0x13, 0x44, 0x00, 0x7A, 0x00 };
+
+#endif /* RECORDED_CONTROLLER_FRAMES_H */
@@ -0,0 +1,558 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE DNS CACHE
+ *
+ * A stub resolver stands in for the network stack, answering from a table of
+ * hosts with their addresses and TTL, and counts the lookups it serves. Checks
+ * hits and misses over the TTL, negative caching, refreshing ahead of expiry,
+ * failover between the addresses of a host, replacement of the least recently
+ * used host and the tick wrap. Then the reconnects of a session are counted
+ * with and without the cache, each lookup costing the stub resolver latency.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dns_cache.h"
+
+#define TEST_DNS_CACHE_SUCCESS    0
+#define TEST_DNS_CACHE_FAIL       1
+
+#define TEST_TTL                  300000 /* Ticks of 1 ms */
+#define TEST_NEGATIVE_TTL         10000
+#define TEST_REFRESH_AHEAD        30000
+#define TEST_IDLE                 3600000
+#define TEST_RESOLVE_TICKS        120    /* Latency of a lookup through the stub resolver */
+#define TEST_HUB                  "contoso-hub.azure-devices.net"
+#define TEST_DPS                  "global.azure-devices-provisioning.net"
+#define TEST_BLOB                 "contoso.blob.core.windows.net"
+
+/* A host the stub resolver answers for. */
+typedef struct StubHost
+{
+    const char * pcHostName;
+    uint32_t ulAddresses[ 3 ];
+    size_t xAddressCount;
+    uint32_t ulTtlTicks;
+    int xRotate;             /* One address per answer, the next each time */
+    uint32_t ulAnswers;
+} StubHost_t;
+
+static StubHost_t xStubHosts[] =
+{
+    { TEST_HUB,  { 0x0A000001, 0x0A000002, 0x0A000003 }, 3, 0,      0, 0 },
+    { TEST_DPS,  { 0x0B000001 },                         1, 60000,  0, 0 },
+    { TEST_BLOB, { 0x0C000001, 0x0C000002, 0x0C000003 }, 3, 0,      1, 0 },
+};
+
+static DnsCache_t xCache;
+static uint32_t ulNow;
+static uint32_t ulResolves;
+static int xResolverDown;
+
+/*-----------------------------------------------------------*/
+
+/* Stands for a lookup on the network, TEST_RESOLVE_TICKS each. */
+static size_t prvStubResolve( const char * pcHostName,
+                              uint32_t * pulAddresses,
+                              uint32_t * pulTtlTicks )
+{
+    size_t xIndex;
+    StubHost_t * pxHost;
+
+    ulResolves++;
+
+    for( xIndex = 0; ( xResolverDown == 0 ) && ( xIndex < sizeof( xStubHosts ) / sizeof( xStubHosts[ 0 ] ) ); xIndex++ )
+    {
+        pxHost = &xStubHosts[ xIndex ];
+
+        if( strcmp( pxHost->pcHostName, pcHostName ) == 0 )
+        {
+            *pulTtlTicks = pxHost->ulTtlTicks;
+
+            if( pxHost->xRotate )
+            {
+                pulAddresses[ 0 ] = pxHost->ulAddresses[ pxHost->ulAnswers++ % pxHost->xAddressCount ];
+                return 1;
+            }
+
+            memcpy( pulAddresses, pxHost->ulAddresses, pxHost->xAddressCount * sizeof( uint32_t ) );
+            pxHost->ulAnswers++;
+
+            return pxHost->xAddressCount;
+        }
+    }
+
+    return 0;
+}
+
+/* A connect's lookup, from the cache and the stub resolver on a miss. */
+static uint32_t prvGetHostByName( const char * pcHostName )
+{
+    uint32_t ulAddresses[ 3 ];
+    uint32_t ulTtlTicks = 0;
+    uint32_t ulAddress = 0;
+    size_t xCount;
+
+    if( DnsCache_Lookup( &xCache, pcHostName, ulNow, &ulAddress ) != eDnsCacheMiss )
+    {
+        return ulAddress;
+    }
+
+    xCount = prvStubResolve( pcHostName, ulAddresses, &ulTtlTicks );
+    DnsCache_Update( &xCache, pcHostName, ulAddresses, xCount, ulTtlTicks, ulNow );
+
+    return ( xCount > 0 ) ? ulAddresses[ 0 ] : 0;
+}
+
+/* What the refresh task does when woken, returns the hosts refreshed. */
+static uint32_t prvRefreshDue( void )
+{
+    uint32_t ulAddresses[ 3 ];
+    uint32_t ulTtlTicks = 0;
+    uint32_t ulWait;
+    uint32_t ulRefreshed = 0;
+    char cHostName[ DNS_CACHE_HOST_NAME_LENGTH + 1 ];
+    const char * pcDue;
+    size_t xCount;
+
+    while( ( pcDue = DnsCache_NextRefresh( &xCache, ulNow, &ulWait ) ) != NULL )
+    {
+        strcpy( cHostName, pcDue );
+        xCount = prvStubResolve( cHostName, ulAddresses, &ulTtlTicks );
+        DnsCache_Update( &xCache, cHostName, ulAddresses, xCount, ulTtlTicks, ulNow );
+        ulRefreshed++;
+    }
+
+    return ulRefreshed;
+}
+
+static void prvReset( void )
+{
+    size_t xIndex;
+
+    DnsCache_Init( &xCache, TEST_TTL, TEST_NEGATIVE_TTL, TEST_REFRESH_AHEAD, TEST_IDLE );
+    ulNow = 1000;
+    ulResolves = 0;
+    xResolverDown = 0;
+
+    for( xIndex = 0; xIndex < sizeof( xStubHosts ) / sizeof( xStubHosts[ 0 ] ); xIndex++ )
+    {
+        xStubHosts[ xIndex ].ulAnswers = 0;
+    }
+}
+
+static int prvCheckStats( uint32_t ulHits,
+                          uint32_t ulNegativeHits,
+                          uint32_t ulMisses )
+{
+    if( ( xCache.xStats.ulHits != ulHits ) || ( xCache.xStats.ulNegativeHits != ulNegativeHits ) ||
+        ( xCache.xStats.ulMisses != ulMisses ) )
+    {
+        printf( "\tFailed! %u hits, %u negative hits, %u misses, expected %u, %u, %u\n",
+                xCache.xStats.ulHits, xCache.xStats.ulNegativeHits, xCache.xStats.ulMisses,
+                ulHits, ulNegativeHits, ulMisses );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvHitsAndMisses( void )
+{
+    uint32_t ulIndex;
+    uint32_t ulResolved;
+
+    printf( "Checking hits and misses over the TTL\n" );
+    prvReset();
+
+    for( ulIndex = 0; ulIndex < 10; ulIndex++ )
+    {
+        if( prvGetHostByName( TEST_HUB ) != 0x0A000001 )
+        {
+            printf( "\tFailed! Wrong address for the hub\n" );
+            return 0;
+        }
+    }
+
+    if( ( ulResolves != 1 ) || !prvCheckStats( 9, 0, 1 ) )
+    {
+        return 0;
+    }
+
+    /* The TTL of the answer is kept over the default. */
+    ( void ) prvGetHostByName( TEST_DPS );
+    ulResolved = ulNow;
+    ulNow = ulResolved + 59999;
+    ( void ) prvGetHostByName( TEST_DPS );
+    ulNow = ulResolved + 60000;
+    ( void ) prvGetHostByName( TEST_DPS );
+
+    if( ( ulResolves != 3 ) || !prvCheckStats( 10, 0, 3 ) )
+    {
+        printf( "\tFailed! TTL of the answer not kept\n" );
+        return 0;
+    }
+
+    /* Names longer than kept are not cached. */
+    DnsCache_Update( &xCache, "x234567890123456789012345678901234567890123456789012345678901234567890"
+                              "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+                     &ulResolved, 1, 0, ulNow );
+
+    return 1;
+}
+
+static int prvNegative( void )
+{
+    uint32_t ulIndex;
+
+    printf( "Checking failed lookups are kept\n" );
+    prvReset();
+    xResolverDown = 1;
+
+    /* The connect backoff retries the lookup. */
+    for( ulIndex = 0; ulIndex < 5; ulIndex++ )
+    {
+        if( prvGetHostByName( TEST_HUB ) != 0 )
+        {
+            printf( "\tFailed! Address without a resolver\n" );
+            return 0;
+        }
+
+        ulNow += 1000;
+    }
+
+    if( ( ulResolves != 1 ) || !prvCheckStats( 0, 4, 1 ) )
+    {
+        return 0;
+    }
+
+    xResolverDown = 0;
+    ulNow += TEST_NEGATIVE_TTL;
+
+    if( ( prvGetHostByName( TEST_HUB ) != 0x0A000001 ) || ( ulResolves != 2 ) )
+    {
+        printf( "\tFailed! Not resolved again after the negative TTL\n" );
+        return 0;
+    }
+
+    /* A failed refresh keeps the addresses, and is not retried. */
+    ulNow += TEST_TTL - TEST_REFRESH_AHEAD;
+    xResolverDown = 1;
+
+    if( ( prvRefreshDue() != 1 ) || ( prvRefreshDue() != 0 ) )
+    {
+        printf( "\tFailed! Failed refresh retried\n" );
+        return 0;
+    }
+
+    if( prvGetHostByName( TEST_HUB ) != 0x0A000001 )
+    {
+        printf( "\tFailed! Addresses dropped by a failed refresh\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvRefresh( void )
+{
+    uint32_t ulWait = 0;
+    uint32_t ulResolved;
+
+    printf( "Checking hosts are refreshed ahead of expiry\n" );
+    prvReset();
+
+    if( ( DnsCache_NextRefresh( &xCache, ulNow, &ulWait ) != NULL ) || ( ulWait != DNS_CACHE_NO_REFRESH ) )
+    {
+        printf( "\tFailed! Refresh of an empty cache\n" );
+        return 0;
+    }
+
+    ( void ) prvGetHostByName( TEST_HUB );
+    ulResolved = ulNow;
+
+    if( ( DnsCache_NextRefresh( &xCache, ulNow, &ulWait ) != NULL ) || ( ulWait != TEST_TTL - TEST_REFRESH_AHEAD ) )
+    {
+        printf( "\tFailed! Refresh due in %u ticks\n", ulWait );
+        return 0;
+    }
+
+    ulNow += ulWait - 1;
+
+    if( prvRefreshDue() != 0 )
+    {
+        printf( "\tFailed! Refreshed early\n" );
+        return 0;
+    }
+
+    ulNow += 1;
+
+    if( ( prvRefreshDue() != 1 ) || ( xCache.xStats.ulRefreshes != 1 ) )
+    {
+        printf( "\tFailed! Not refreshed when due\n" );
+        return 0;
+    }
+
+    /* No lookup waits on the resolver past the first TTL. */
+    ulNow = ulResolved + TEST_TTL + 1;
+
+    if( ( prvGetHostByName( TEST_HUB ) != 0x0A000001 ) || ( ulResolves != 2 ) || ( xCache.xStats.ulMisses != 1 ) )
+    {
+        printf( "\tFailed! Lookup missed after a refresh\n" );
+        return 0;
+    }
+
+    /* Hosts not looked up for the idle time are left to expire. */
+    ( void ) prvGetHostByName( TEST_DPS );
+    ulNow += TEST_IDLE;
+
+    while( DnsCache_NextRefresh( &xCache, ulNow, &ulWait ) != NULL || ulWait != DNS_CACHE_NO_REFRESH )
+    {
+        ulNow += ( ulWait != DNS_CACHE_NO_REFRESH ) ? ulWait : 0;
+    }
+
+    ulResolves = 0;
+    ulNow += 1000;
+    ( void ) prvGetHostByName( TEST_HUB );
+
+    if( ulResolves != 1 )
+    {
+        printf( "\tFailed! Idle host refreshed\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvFailover( void )
+{
+    uint32_t ulAddress;
+    uint32_t ulIndex;
+
+    printf( "Checking failover between the addresses of a host\n" );
+    prvReset();
+
+    ulAddress = prvGetHostByName( TEST_HUB );
+    DnsCache_ConnectFailed( &xCache, TEST_HUB, ulAddress );
+
+    /* Reported again by a second connect, or not an address of the host. */
+    DnsCache_ConnectFailed( &xCache, TEST_HUB, ulAddress );
+    DnsCache_ConnectFailed( &xCache, TEST_HUB, 0x7F000001 );
+    DnsCache_ConnectFailed( &xCache, TEST_DPS, 0x0A000002 );
+
+    if( ( ( ulAddress = prvGetHostByName( TEST_HUB ) ) != 0x0A000002 ) || ( xCache.xStats.ulFailovers != 1 ) )
+    {
+        printf( "\tFailed! Failed over to %08x\n", ulAddress );
+        return 0;
+    }
+
+    DnsCache_ConnectFailed( &xCache, TEST_HUB, ulAddress );
+
+    if( ( ulAddress = prvGetHostByName( TEST_HUB ) ) != 0x0A000003 )
+    {
+        printf( "\tFailed! Failed over to %08x\n", ulAddress );
+        return 0;
+    }
+
+    /* Every address failed, the host is resolved again. */
+    DnsCache_ConnectFailed( &xCache, TEST_HUB, ulAddress );
+
+    if( ( prvGetHostByName( TEST_HUB ) != 0x0A000001 ) || ( ulResolves != 2 ) )
+    {
+        printf( "\tFailed! Not resolved again after every address failed\n" );
+        return 0;
+    }
+
+    /* Round robin answers of one address each are gathered, newest first. */
+    for( ulIndex = 0; ulIndex < 3; ulIndex++ )
+    {
+        ( void ) prvGetHostByName( TEST_BLOB );
+        ulNow += TEST_TTL;
+    }
+
+    ulNow -= TEST_TTL;
+
+    if( ( ( ulAddress = prvGetHostByName( TEST_BLOB ) ) != 0x0C000003 ) ||
+        ( DnsCache_ConnectFailed( &xCache, TEST_BLOB, ulAddress ), prvGetHostByName( TEST_BLOB ) != 0x0C000002 ) ||
+        ( DnsCache_ConnectFailed( &xCache, TEST_BLOB, 0x0C000002 ), prvGetHostByName( TEST_BLOB ) != 0x0C000001 ) )
+    {
+        printf( "\tFailed! Earlier answers not kept\n" );
+        return 0;
+    }
+
+    /* The failed ones are dropped, the one left is answered again. */
+    ulNow += TEST_TTL;
+
+    if( ( prvGetHostByName( TEST_BLOB ) != 0x0C000001 ) || ( xCache.xEntries[ 1 ].xAddressCount != 1 ) )
+    {
+        printf( "\tFailed! %u addresses after a resolve\n", ( unsigned ) xCache.xEntries[ 1 ].xAddressCount );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvEvictionAndWrap( void )
+{
+    char cHostName[ 32 ];
+    uint32_t ulIndex;
+
+    printf( "Checking replacement and the tick wrap\n" );
+    prvReset();
+    ulNow = 0xFFFFFF00UL;
+
+    ( void ) prvGetHostByName( TEST_HUB );
+
+    for( ulIndex = 0; ulIndex < DNS_CACHE_ENTRIES; ulIndex++ )
+    {
+        snprintf( cHostName, sizeof( cHostName ), "host%u", ulIndex );
+        DnsCache_Update( &xCache, cHostName, &ulIndex, 1, 0, ulNow );
+        ulNow += 100;
+
+        /* The hub stays the most recently used. */
+        ( void ) prvGetHostByName( TEST_HUB );
+    }
+
+    if( ( xCache.xStats.ulEvictions != 1 ) || ( ulResolves != 1 ) ||
+        ( DnsCache_Lookup( &xCache, "host0", ulNow, &ulIndex ) != eDnsCacheMiss ) )
+    {
+        printf( "\tFailed! %u evictions, %u lookups of the hub\n", xCache.xStats.ulEvictions, ulResolves );
+        return 0;
+    }
+
+    ulNow += TEST_TTL - 2000;
+
+    if( ( prvGetHostByName( TEST_HUB ) != 0x0A000001 ) || ( ulResolves != 1 ) )
+    {
+        printf( "\tFailed! Expired across the tick wrap\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/* The refresh task, woken when a host is due until the tick given, returns
+ * the hosts refreshed. */
+static uint32_t prvRunRefreshTask( uint32_t * pulTaskTick,
+                                   uint32_t ulUntil )
+{
+    uint32_t ulAddresses[ 3 ];
+    uint32_t ulTtlTicks = 0;
+    uint32_t ulWait;
+    uint32_t ulRefreshed = 0;
+    char cHostName[ DNS_CACHE_HOST_NAME_LENGTH + 1 ];
+    const char * pcDue;
+    size_t xCount;
+
+    for( ; ; )
+    {
+        if( ( pcDue = DnsCache_NextRefresh( &xCache, *pulTaskTick, &ulWait ) ) != NULL )
+        {
+            strcpy( cHostName, pcDue );
+            xCount = prvStubResolve( cHostName, ulAddresses, &ulTtlTicks );
+            DnsCache_Update( &xCache, cHostName, ulAddresses, xCount, ulTtlTicks, *pulTaskTick );
+            ulRefreshed++;
+        }
+        else if( ( ulWait == DNS_CACHE_NO_REFRESH ) || ( ulWait > ulUntil - *pulTaskTick ) )
+        {
+            break;
+        }
+        else
+        {
+            *pulTaskTick += ulWait;
+        }
+    }
+
+    *pulTaskTick = ulUntil;
+
+    return ulRefreshed;
+}
+
+/* A connect's lookup, the resolver called every time without the cache. */
+static void prvConnect( const char * pcHostName,
+                        int xCached )
+{
+    uint32_t ulAddresses[ 3 ];
+    uint32_t ulTtlTicks;
+
+    if( xCached )
+    {
+        ( void ) prvGetHostByName( pcHostName );
+    }
+    else
+    {
+        ( void ) prvStubResolve( pcHostName, ulAddresses, &ulTtlTicks );
+    }
+}
+
+/* Connects of a day: the hub reconnecting every 20 minutes, and a download
+ * reconnecting for each of its chunks once. */
+static int prvSession( void )
+{
+    uint32_t ulConnects, ulRefreshed, ulTaskTick, ulResolved;
+    uint32_t ulWaited[ 2 ];
+    uint32_t ulIndex, ulChunk;
+    int xCached;
+
+    printf( "Counting lookups over a day of reconnects\n" );
+
+    for( xCached = 0; xCached < 2; xCached++ )
+    {
+        prvReset();
+        ulConnects = 0;
+        ulRefreshed = 0;
+        ulTaskTick = ulNow;
+
+        for( ulIndex = 0; ulIndex < 72; ulIndex++ )
+        {
+            /* Lookups of the refresh task are not waited on. */
+            if( xCached )
+            {
+                ulResolved = ulResolves;
+                ulRefreshed += prvRunRefreshTask( &ulTaskTick, ulNow );
+                ulResolves = ulResolved;
+            }
+
+            prvConnect( TEST_HUB, xCached );
+            ulConnects++;
+
+            for( ulChunk = 0; ( ulIndex == 36 ) && ( ulChunk < 100 ); ulChunk++ )
+            {
+                prvConnect( TEST_BLOB, xCached );
+                ulNow += 500;
+                ulConnects++;
+            }
+
+            ulNow += 20 * 60 * 1000;
+        }
+
+        ulWaited[ xCached ] = ulResolves * TEST_RESOLVE_TICKS;
+        printf( "\t%s: %u connects waited %u ms on the resolver, %u lookups in the background\n",
+                xCached ? "Cached  " : "Uncached", ulConnects, ulWaited[ xCached ], ulRefreshed );
+    }
+
+    /* Only the first lookup of each host. */
+    if( ulWaited[ 1 ] != 2 * TEST_RESOLVE_TICKS )
+    {
+        printf( "\tFailed! Cached connects waited on the resolver\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+int vStartTestTask( void )
+{
+    int xResult = prvHitsAndMisses() &&
+                  prvNegative() &&
+                  prvRefresh() &&
+                  prvFailover() &&
+                  prvEvictionAndWrap() &&
+                  prvSession();
+
+    return xResult ? TEST_DNS_CACHE_SUCCESS : TEST_DNS_CACHE_FAIL;
+}
@@ -0,0 +1,415 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE STORED DPS ASSIGNMENT
+ *
+ * A RAM page standing in for the flash page of the board, with NOR semantics:
+ * erase sets every byte, programming only clears bits. Checks the assignment
+ * round trips, identical saves leave the page alone, and a record written for
+ * other settings, corrupted or torn by a reset is not used. Then boots the demo
+ * connection sequence against stand-ins for the resolver, TCP, TLS, DPS and the
+ * hub, each costing the latency measured on the board, and compares the time
+ * from boot to the first telemetry with and without the stored assignment.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dps_assignment.h"
+
+#define TEST_DPS_ASSIGNMENT_SUCCESS    0
+#define TEST_DPS_ASSIGNMENT_FAIL       1
+
+#define TEST_PAGE_SIZE                 2048
+#define TEST_ID_SCOPE                  "0ne00AFD579"
+#define TEST_REGISTRATION_ID           "skytree_iotkit_office"
+#define TEST_DPS                       "global.azure-devices-provisioning.net"
+#define TEST_HUB_A                     "contoso-hub-a.azure-devices.net"
+#define TEST_HUB_B                     "contoso-hub-b.azure-devices.net"
+
+/* Stand-in latencies in ms, the WiFi module of the board on a home network. */
+#define TEST_DNS_MS                    150
+#define TEST_TCP_MS                    80   /* One round trip */
+#define TEST_TLS_MS                    1100 /* Two round trips and the ECDHE and RSA operations */
+#define TEST_MQTT_MS                   80   /* CONNECT to CONNACK, SUBSCRIBE to SUBACK, PUBLISH to PUBACK */
+#define TEST_SUBSCRIBES                3
+#define TEST_RETRY_AFTER_MS            3000 /* DPS answers the registration with assigning */
+#define TEST_CLOSE_MS                  40
+
+/* Flash page of the board. */
+static uint8_t ucPage[ TEST_PAGE_SIZE ];
+static uint32_t ulWrites;
+static uint32_t ulErases;
+static int32_t lTearAfter = -1; /* Bytes programmed before a reset cuts the write, -1 for none */
+
+/* Network stand-ins. */
+static uint32_t ulNowMs;
+static const char * pcAssignedHub;   /* Hub DPS assigns */
+static const char * pcRefusingHub;   /* Hub refusing the CONNECT, NULL for none */
+static const char * pcResolved[ 4 ]; /* Hosts in the DNS cache since boot */
+static uint32_t ulResolvedCount;
+static uint32_t ulHandshakes;
+static uint32_t ulRegistrations;
+
+/*-----------------------------------------------------------*/
+
+bool dps_assignment_storage_read( uint8_t * record,
+                                  uint32_t size )
+{
+    memcpy( record, ucPage, size );
+
+    return true;
+}
+
+bool dps_assignment_storage_erase( void )
+{
+    ulErases++;
+    memset( ucPage, 0xFF, sizeof( ucPage ) );
+
+    return true;
+}
+
+bool dps_assignment_storage_write( const uint8_t * record,
+                                   uint32_t size )
+{
+    uint32_t ulIndex;
+
+    ulWrites++;
+    ( void ) dps_assignment_storage_erase();
+
+    for( ulIndex = 0; ulIndex < size; ulIndex++ )
+    {
+        if( ( lTearAfter >= 0 ) && ( ulIndex >= ( uint32_t ) lTearAfter ) )
+        {
+            return false;
+        }
+
+        ucPage[ ulIndex ] &= record[ ulIndex ];
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetAssignment( dps_assignment_t * pxAssignment,
+                              const char * pcHostName,
+                              const char * pcDeviceId )
+{
+    memset( pxAssignment, 0, sizeof( *pxAssignment ) );
+    pxAssignment->hostname_length = ( uint32_t ) strlen( pcHostName );
+    memcpy( pxAssignment->hostname, pcHostName, pxAssignment->hostname_length );
+    pxAssignment->device_id_length = ( uint32_t ) strlen( pcDeviceId );
+    memcpy( pxAssignment->device_id, pcDeviceId, pxAssignment->device_id_length );
+}
+
+static void prvErasePage( void )
+{
+    memset( ucPage, 0xFF, sizeof( ucPage ) );
+    ulWrites = 0;
+    ulErases = 0;
+    lTearAfter = -1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvRoundTrip( void )
+{
+    dps_assignment_t xSaved, xLoaded;
+    char cLongest[ DPS_ASSIGNMENT_MAX_LENGTH + 2 ];
+
+    printf( "Checking the assignment round trips\n" );
+    prvErasePage();
+
+    if( dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+    {
+        printf( "\tFailed! Loaded from an erased page\n" );
+        return 0;
+    }
+
+    prvSetAssignment( &xSaved, TEST_HUB_A, TEST_REGISTRATION_ID );
+
+    if( !dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) ||
+        !dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) ||
+        ( memcmp( &xSaved, &xLoaded, sizeof( xSaved ) ) != 0 ) )
+    {
+        printf( "\tFailed! Assignment not loaded as saved\n" );
+        return 0;
+    }
+
+    /* The longest names fit with their terminator, longer ones are refused. */
+    memset( cLongest, 'h', sizeof( cLongest ) );
+    cLongest[ DPS_ASSIGNMENT_MAX_LENGTH ] = '\0';
+    prvSetAssignment( &xSaved, cLongest, cLongest );
+
+    if( !dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) ||
+        !dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) ||
+        ( strlen( ( const char * ) xLoaded.hostname ) != DPS_ASSIGNMENT_MAX_LENGTH ) ||
+        ( strlen( ( const char * ) xLoaded.device_id ) != DPS_ASSIGNMENT_MAX_LENGTH ) )
+    {
+        printf( "\tFailed! Longest names not kept\n" );
+        return 0;
+    }
+
+    xSaved.hostname_length = DPS_ASSIGNMENT_MAX_LENGTH + 1;
+
+    if( dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+    {
+        printf( "\tFailed! Saved a hostname too long for the buffers\n" );
+        return 0;
+    }
+
+    xSaved.hostname_length = 0;
+
+    if( dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+    {
+        printf( "\tFailed! Saved an empty hostname\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvWear( void )
+{
+    dps_assignment_t xSaved;
+    uint32_t ulIndex;
+
+    printf( "Checking identical saves leave the page alone\n" );
+    prvErasePage();
+    prvSetAssignment( &xSaved, TEST_HUB_A, TEST_REGISTRATION_ID );
+
+    for( ulIndex = 0; ulIndex < 100; ulIndex++ )
+    {
+        ( void ) dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+    }
+
+    if( ( ulWrites != 1 ) || ( ulErases != 1 ) )
+    {
+        printf( "\tFailed! %u writes and %u erases for one assignment\n", ulWrites, ulErases );
+        return 0;
+    }
+
+    prvSetAssignment( &xSaved, TEST_HUB_B, TEST_REGISTRATION_ID );
+    ( void ) dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+
+    if( ulWrites != 2 )
+    {
+        printf( "\tFailed! A new hub was not written\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvInvalid( void )
+{
+    dps_assignment_t xSaved, xLoaded;
+    uint32_t ulByte;
+
+    printf( "Checking records not for this device are not used\n" );
+    prvErasePage();
+    prvSetAssignment( &xSaved, TEST_HUB_A, TEST_REGISTRATION_ID );
+    ( void ) dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+
+    /* Flashed again for another site. */
+    if( dps_assignment_load( &xLoaded, TEST_ID_SCOPE, "skytree_iotkit_home" ) ||
+        dps_assignment_load( &xLoaded, "0ne00BF2AFD", TEST_REGISTRATION_ID ) ||
+        dps_assignment_load( &xLoaded, TEST_ID_SCOPE "s", "kytree_iotkit_office" ) )
+    {
+        printf( "\tFailed! Loaded for other settings\n" );
+        return 0;
+    }
+
+    /* Every single bit flipped. */
+    for( ulByte = 0; ulByte < DPS_ASSIGNMENT_RECORD_SIZE * 8; ulByte++ )
+    {
+        ucPage[ ulByte / 8 ] ^= ( uint8_t ) ( 1U << ( ulByte % 8 ) );
+
+        if( dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+        {
+            printf( "\tFailed! Loaded with bit %u flipped\n", ulByte );
+            return 0;
+        }
+
+        ucPage[ ulByte / 8 ] ^= ( uint8_t ) ( 1U << ( ulByte % 8 ) );
+    }
+
+    /* A reset at any point of the write. */
+    for( lTearAfter = 0; lTearAfter < DPS_ASSIGNMENT_RECORD_SIZE; lTearAfter += 8 )
+    {
+        prvSetAssignment( &xSaved, TEST_HUB_B, TEST_REGISTRATION_ID );
+        ( void ) dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+
+        if( dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+        {
+            printf( "\tFailed! Loaded a record torn after %d bytes\n", lTearAfter );
+            return 0;
+        }
+    }
+
+    lTearAfter = -1;
+    ( void ) dps_assignment_save( &xSaved, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+    dps_assignment_clear();
+
+    if( dps_assignment_load( &xLoaded, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+    {
+        printf( "\tFailed! Loaded after clear\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+/* A lookup through the cache of the socket wrapper, empty at boot. */
+static void prvLookup( const char * pcHostName )
+{
+    uint32_t ulIndex;
+
+    for( ulIndex = 0; ulIndex < ulResolvedCount; ulIndex++ )
+    {
+        if( strcmp( pcResolved[ ulIndex ], pcHostName ) == 0 )
+        {
+            return;
+        }
+    }
+
+    pcResolved[ ulResolvedCount++ ] = pcHostName;
+    ulNowMs += TEST_DNS_MS;
+}
+
+static void prvTlsConnect( const char * pcHostName )
+{
+    prvLookup( pcHostName );
+    ulNowMs += TEST_TCP_MS + TEST_TLS_MS;
+    ulHandshakes++;
+}
+
+/* prvIoTHubInfoGet, the last hub is looked up while the registration waits. */
+static void prvRegister( dps_assignment_t * pxAssignment,
+                         const char * pcLastHostname )
+{
+    uint32_t ulPendingMs;
+
+    prvTlsConnect( TEST_DPS );
+    ulNowMs += TEST_MQTT_MS + TEST_MQTT_MS;
+    ulPendingMs = ulNowMs;
+
+    if( pcLastHostname != NULL )
+    {
+        prvLookup( pcLastHostname );
+    }
+
+    ulNowMs = ulPendingMs + TEST_RETRY_AFTER_MS + TEST_MQTT_MS;
+    ulNowMs += TEST_CLOSE_MS;
+    ulRegistrations++;
+
+    prvSetAssignment( pxAssignment, pcAssignedHub, TEST_REGISTRATION_ID );
+    ( void ) dps_assignment_save( pxAssignment, TEST_ID_SCOPE, TEST_REGISTRATION_ID );
+}
+
+/* The connect sequence of prvAzureDemoTask, returns the ms from boot to the
+ * first telemetry the hub took. */
+static uint32_t prvBoot( void )
+{
+    dps_assignment_t xAssignment;
+    int xUsable;
+
+    ulNowMs = 0;
+    ulResolvedCount = 0;
+    ulHandshakes = 0;
+    ulRegistrations = 0;
+
+    if( !dps_assignment_load( &xAssignment, TEST_ID_SCOPE, TEST_REGISTRATION_ID ) )
+    {
+        prvRegister( &xAssignment, NULL );
+    }
+
+    for( ; ; )
+    {
+        prvTlsConnect( ( const char * ) xAssignment.hostname );
+        ulNowMs += TEST_MQTT_MS;
+
+        xUsable = ( pcRefusingHub == NULL ) || ( strcmp( ( const char * ) xAssignment.hostname, pcRefusingHub ) != 0 );
+
+        if( xUsable )
+        {
+            break;
+        }
+
+        /* prvReprovision */
+        ulNowMs += TEST_CLOSE_MS;
+        dps_assignment_clear();
+        prvRegister( &xAssignment, ( const char * ) xAssignment.hostname );
+    }
+
+    ulNowMs += TEST_SUBSCRIBES * TEST_MQTT_MS + TEST_MQTT_MS;
+
+    return ulNowMs;
+}
+
+static int prvBootToFirstTelemetry( void )
+{
+    uint32_t ulFirstBoot, ulStoredBoot, ulMovedBoot, ulAfterMoveBoot, ulIndex;
+
+    printf( "Measuring boot to first telemetry\n" );
+    prvErasePage();
+    pcAssignedHub = TEST_HUB_A;
+    pcRefusingHub = NULL;
+
+    ulFirstBoot = prvBoot();
+    printf( "\tFirst boot, DPS:            %5u ms, %u handshakes\n", ulFirstBoot, ulHandshakes );
+
+    ulStoredBoot = prvBoot();
+    printf( "\tLater boot, stored hub:     %5u ms, %u handshakes\n", ulStoredBoot, ulHandshakes );
+
+    if( ( ulRegistrations != 0 ) || ( ulHandshakes != 1 ) || ( ulStoredBoot >= ulFirstBoot ) )
+    {
+        printf( "\tFailed! Registered again with a stored hub\n" );
+        return 0;
+    }
+
+    for( ulIndex = 0; ulIndex < 50; ulIndex++ )
+    {
+        ( void ) prvBoot();
+    }
+
+    if( ulWrites != 1 )
+    {
+        printf( "\tFailed! %u writes over 52 boots to the same hub\n", ulWrites );
+        return 0;
+    }
+
+    /* The device was moved to another hub, the stored one refuses it. */
+    pcAssignedHub = TEST_HUB_B;
+    pcRefusingHub = TEST_HUB_A;
+    ulMovedBoot = prvBoot();
+    printf( "\tStored hub refused:         %5u ms, %u handshakes\n", ulMovedBoot, ulHandshakes );
+
+    ulAfterMoveBoot = prvBoot();
+    printf( "\tBoot after the move:        %5u ms, %u handshakes\n", ulAfterMoveBoot, ulHandshakes );
+
+    if( ( ulRegistrations != 0 ) || ( ulAfterMoveBoot != ulStoredBoot ) )
+    {
+        printf( "\tFailed! New hub not stored\n" );
+        return 0;
+    }
+
+    printf( "\tSaved by the stored hub:    %5u ms\n", ulFirstBoot - ulStoredBoot );
+
+    return 1;
+}
+
+int vStartTestTask( void )
+{
+    int xResult = prvRoundTrip() &&
+                  prvWear() &&
+                  prvInvalid() &&
+                  prvBootToFirstTelemetry();
+
+    return xResult ? TEST_DPS_ASSIGNMENT_SUCCESS : TEST_DPS_ASSIGNMENT_FAIL;
+}
@@ -0,0 +1,410 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER FRAME DECODING
+ *
+ * Checks the crc lookup table against the bitwise crc, and both the layout
+ * table walk and the layouts' own decoders against the field decoding they
+ * replaced, on random frames. Then reports frames per second for each and for
+ * the whole path the uart task takes, from the received bytes to the decoded
+ * status.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_parser.h"
+#include "frame_layout.h"
+#include "recorded_controller_frames.h"
+
+#define TEST_FRAME_DECODE_SUCCESS    0
+#define TEST_FRAME_DECODE_FAIL       1
+
+#define TEST_FUZZ_ITERATIONS         200000
+#define TEST_BENCHMARK_FRAMES        2000000
+
+static uint8_t ucFrame[ FRAME_MAX_LENGTH ];
+
+/* The bitwise crc CalcCrc used before the table. */
+static uint8_t prvBitwiseCrc( const uint8_t * pucData,
+                              uint8_t ucLength )
+{
+    uint8_t ucCrc = 0xFF;
+    uint8_t i;
+    uint8_t ucBit;
+
+    for( i = 0; i < ucLength; i++ )
+    {
+        ucCrc ^= pucData[ i ];
+
+        for( ucBit = 8; ucBit > 0; --ucBit )
+        {
+            ucCrc = ( ucCrc & 0x80 ) ? ( uint8_t ) ( ( ucCrc << 1 ) ^ CRC_POLYNOMIAL ) : ( uint8_t ) ( ucCrc << 1 );
+        }
+    }
+
+    return ucCrc;
+}
+
+static uint32_t prvReadU32( const uint8_t * pucData )
+{
+    return ( ( uint32_t ) pucData[ 0 ] << 24 ) | ( ( uint32_t ) pucData[ 1 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 8 ) | ( uint32_t ) pucData[ 3 ];
+}
+
+/* Field by field decoding as read_unit_status did it before the layout tables. */
+static void prvReferenceUnit( const uint8_t * pucData,
+                              UNIT_status_t * pxStatus )
+{
+    uint32_t ulEnd = FRAME_HEADER_LENGTH;
+    int i;
+
+    pxStatus->unit_status = pucData[ ulEnd++ ];
+    pxStatus->unit_state = pucData[ ulEnd++ ];
+    pxStatus->heater_status = ( uint16_t ) ( ( pucData[ ulEnd ] << 8 ) | pucData[ ulEnd + 1 ] );
+    ulEnd += 2;
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++, ulEnd += 4 )
+    {
+        pxStatus->heater_temperatures[ i ] = SENSOR_VALUE_FROM_UQ16( prvReadU32( pucData + ulEnd ) );
+    }
+
+    pxStatus->valve_status = pucData[ ulEnd++ ];
+    pxStatus->vacuum_sensor = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucData + ulEnd ) );
+    ulEnd += 4;
+    pxStatus->ambient_humidity = SENSOR_VALUE_FROM_UQ16( prvReadU32( pucData + ulEnd ) );
+    ulEnd += 4;
+    pxStatus->ambient_temperature = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucData + ulEnd ) );
+    ulEnd += 4;
+    pxStatus->errors = prvReadU32( pucData + ulEnd );
+}
+
+/* Field by field decoding as read_skid_status did it before the layout tables. */
+static void prvReferenceSkid( const uint8_t * pucData,
+                              SKID_status_t * pxStatus )
+{
+    const uint8_t * pucValues = pucData + FRAME_HEADER_LENGTH + 4;
+
+    pxStatus->skid_status = pucData[ FRAME_HEADER_LENGTH ];
+    pxStatus->skid_state = pucData[ FRAME_HEADER_LENGTH + 1 ];
+    pxStatus->outputs_status = ( uint16_t ) ( ( pucData[ FRAME_HEADER_LENGTH + 2 ] << 8 ) | pucData[ FRAME_HEADER_LENGTH + 3 ] );
+    pxStatus->o2_sensor = SENSOR_VALUE_FROM_UQ16( prvReadU32( pucValues ) );
+    pxStatus->mass_flow = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucValues + 4 ) );
+    pxStatus->co2_sensor = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucValues + 8 ) );
+    pxStatus->tank_pressure = SENSOR_VALUE_FROM_UQ16( prvReadU32( pucValues + 12 ) );
+    pxStatus->proportional_valve_pressure = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucValues + 16 ) );
+    pxStatus->temperature = SENSOR_VALUE_FROM_Q16( ( int32_t ) prvReadU32( pucValues + 20 ) );
+    pxStatus->humidity = SENSOR_VALUE_FROM_UQ16( prvReadU32( pucValues + 24 ) );
+    pxStatus->errors = prvReadU32( pucValues + 28 );
+}
+
+static void prvRandomFrame( uint8_t ucType,
+                            uint8_t ucLength )
+{
+    uint8_t i;
+
+    for( i = 0; i < ucLength; i++ )
+    {
+        ucFrame[ i ] = ( uint8_t ) rand();
+    }
+
+    ucFrame[ 0 ] = 'D';
+    ucFrame[ 2 ] = ucType;
+    ucFrame[ ucLength - 1 ] = prvBitwiseCrc( ucFrame, ucLength - 1 );
+}
+
+static int prvFuzz( void )
+{
+    UNIT_status_t xUnitExpected;
+    UNIT_status_t xUnitActual;
+    SKID_status_t xSkidExpected;
+    SKID_status_t xSkidActual;
+    uint32_t ulIteration;
+    uint8_t ucLength;
+
+    for( ulIteration = 0; ulIteration < TEST_FUZZ_ITERATIONS; ulIteration++ )
+    {
+        ucLength = ( uint8_t ) ( rand() % ( FRAME_MAX_LENGTH + 1 ) );
+        prvRandomFrame( 'U', FRAME_MAX_LENGTH );
+
+        if( CalcCrc( ucFrame, ucLength ) != prvBitwiseCrc( ucFrame, ucLength ) )
+        {
+            printf( "\tFailed! crc of %u random bytes differs\n", ucLength );
+            return 0;
+        }
+
+        /* Zeroed first so padding compares equal. */
+        memset( &xUnitExpected, 0, sizeof( xUnitExpected ) );
+        memset( &xUnitActual, 0, sizeof( xUnitActual ) );
+        prvReferenceUnit( ucFrame, &xUnitExpected );
+        frame_layout_decode( &unit_status_layout, ucFrame, &xUnitActual );
+
+        if( memcmp( &xUnitExpected, &xUnitActual, sizeof( xUnitActual ) ) != 0 )
+        {
+            printf( "\tFailed! UNIT frame decoded differently at iteration %u\n", ulIteration );
+            return 0;
+        }
+
+        memset( &xUnitActual, 0, sizeof( xUnitActual ) );
+        frame_layout_decode_fields( &unit_status_layout, ucFrame, &xUnitActual );
+
+        if( memcmp( &xUnitExpected, &xUnitActual, sizeof( xUnitActual ) ) != 0 )
+        {
+            printf( "\tFailed! UNIT table decoded differently at iteration %u\n", ulIteration );
+            return 0;
+        }
+
+        prvRandomFrame( 'S', MESSAGE_LENGTH_SKID_STATUS );
+        memset( &xSkidExpected, 0, sizeof( xSkidExpected ) );
+        memset( &xSkidActual, 0, sizeof( xSkidActual ) );
+        prvReferenceSkid( ucFrame, &xSkidExpected );
+        frame_layout_decode( &skid_status_layout, ucFrame, &xSkidActual );
+
+        if( memcmp( &xSkidExpected, &xSkidActual, sizeof( xSkidActual ) ) != 0 )
+        {
+            printf( "\tFailed! SKID frame decoded differently at iteration %u\n", ulIteration );
+            return 0;
+        }
+
+        memset( &xSkidActual, 0, sizeof( xSkidActual ) );
+        frame_layout_decode_fields( &skid_status_layout, ucFrame, &xSkidActual );
+
+        if( memcmp( &xSkidExpected, &xSkidActual, sizeof( xSkidActual ) ) != 0 )
+        {
+            printf( "\tFailed! SKID table decoded differently at iteration %u\n", ulIteration );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* All value bytes 0xFF: the unsigned channels read 65535.99998 in double and
+ * have to stay the highest positive value in Q16.16, signed ones read -1 LSB. */
+static int prvAllOnes( void )
+{
+    UNIT_status_t xUnit;
+    SKID_status_t xSkid;
+    int lDecoder;
+    int i;
+
+    for( lDecoder = 0; lDecoder < 2; lDecoder++ )
+    {
+        memset( ucFrame, 0xFF, sizeof( ucFrame ) );
+        memset( &xUnit, 0, sizeof( xUnit ) );
+        memset( &xSkid, 0, sizeof( xSkid ) );
+
+        if( lDecoder == 0 )
+        {
+            frame_layout_decode( &unit_status_layout, ucFrame, &xUnit );
+            frame_layout_decode( &skid_status_layout, ucFrame, &xSkid );
+        }
+        else
+        {
+            frame_layout_decode_fields( &unit_status_layout, ucFrame, &xUnit );
+            frame_layout_decode_fields( &skid_status_layout, ucFrame, &xSkid );
+        }
+
+        for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+        {
+            if( xUnit.heater_temperatures[ i ] != SENSOR_VALUE_FROM_UQ16( 0xFFFFFFFFU ) )
+            {
+                printf( "\tFailed! heater %d read 0x%08x\n", i, ( unsigned ) xUnit.heater_temperatures[ i ] );
+                return 0;
+            }
+        }
+
+        if( ( xUnit.ambient_humidity != INT32_MAX ) || ( xSkid.o2_sensor != INT32_MAX ) ||
+            ( xSkid.tank_pressure != INT32_MAX ) || ( xSkid.humidity != INT32_MAX ) )
+        {
+            printf( "\tFailed! unsigned channel turned negative, decoder %d\n", lDecoder );
+            return 0;
+        }
+
+        if( ( xUnit.vacuum_sensor != -1 ) || ( xSkid.mass_flow != -1 ) || ( xSkid.temperature != -1 ) )
+        {
+            printf( "\tFailed! signed channel not -1 LSB, decoder %d\n", lDecoder );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+static double prvFramesPerSecond( uint32_t ulFrames,
+                                  double xStart )
+{
+    return ( double ) ulFrames * 1e9 / ( prvCpuTimeNs() - xStart );
+}
+
+int vStartTestTask( void )
+{
+    const uint8_t * pucFrames[ 2 ] = { ucRecordedUnitFrame, ucRecordedSkidFrame };
+    const uint8_t ucLengths[ 2 ] = { MESSAGE_LENGTH_UNIT_STATUS, MESSAGE_LENGTH_SKID_STATUS };
+    static uint8_t ucIncoming[ FRAME_MAX_LENGTH ];
+    frame_parser_t xParser;
+    UNIT_status_t xUnit;
+    SKID_status_t xSkid;
+    volatile uint32_t ulSink = 0;
+    double xStart;
+    double xBitwiseCrc;
+    double xTableCrc;
+    double xReferenceDecode;
+    double xLayoutDecode;
+    double xTableDecode;
+    double xBefore;
+    double xAfter;
+    uint32_t i;
+
+    srand( 1 );
+
+    printf( "Checking layouts against the frame lengths\n" );
+
+    if( ( frame_layout_length( &unit_status_layout ) != MESSAGE_LENGTH_UNIT_STATUS ) ||
+        ( frame_layout_length( &skid_status_layout ) != MESSAGE_LENGTH_SKID_STATUS ) )
+    {
+        printf( "\tFailed! UNIT layout %u bytes, SKID layout %u bytes\n",
+                frame_layout_length( &unit_status_layout ), frame_layout_length( &skid_status_layout ) );
+        return TEST_FRAME_DECODE_FAIL;
+    }
+
+    printf( "Checking unsigned readings of 32768 and above\n" );
+
+    if( !prvAllOnes() )
+    {
+        return TEST_FRAME_DECODE_FAIL;
+    }
+
+    printf( "Fuzzing crc and decoding against the previous code\n" );
+
+    if( !prvFuzz() )
+    {
+        return TEST_FRAME_DECODE_FAIL;
+    }
+
+    printf( "Measuring frames per second\n" );
+
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        ulSink += prvBitwiseCrc( pucFrames[ i & 1 ], ucLengths[ i & 1 ] - 1 );
+    }
+
+    xBitwiseCrc = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        ulSink += CalcCrc( ( uint8_t * ) pucFrames[ i & 1 ], ucLengths[ i & 1 ] - 1 );
+    }
+
+    xTableCrc = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        prvReferenceUnit( ucRecordedUnitFrame, &xUnit );
+        ulSink += xUnit.errors;
+    }
+
+    xReferenceDecode = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        frame_layout_decode( &unit_status_layout, ucRecordedUnitFrame, &xUnit );
+        ulSink += xUnit.errors;
+    }
+
+    xLayoutDecode = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        frame_layout_decode_fields( &unit_status_layout, ucRecordedUnitFrame, &xUnit );
+        ulSink += xUnit.errors;
+    }
+
+    xTableDecode = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+
+    /* Whole uart task path: before, bytes staged in incoming_data, pushed to the
+     * parser, bitwise crc and field by field decoding. */
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; i++ )
+    {
+        const uint8_t * pucFrame = pucFrames[ i & 1 ];
+
+        memcpy( ucIncoming, pucFrame, ucLengths[ i & 1 ] );
+
+        if( prvBitwiseCrc( ucIncoming, ucLengths[ i & 1 ] - 1 ) == ucIncoming[ ucLengths[ i & 1 ] - 1 ] )
+        {
+            memcpy( xParser.data, ucIncoming, ucLengths[ i & 1 ] );
+
+            if( xParser.data[ 2 ] == 'U' )
+            {
+                prvReferenceUnit( xParser.data, &xUnit );
+            }
+            else
+            {
+                prvReferenceSkid( xParser.data, &xSkid );
+            }
+
+            ulSink++;
+        }
+    }
+
+    xBefore = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+
+    /* After: bytes copied once into the parser, table crc, layout decoding. */
+    frame_parser_init( &xParser );
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_FRAMES; )
+    {
+        const uint8_t * pucFrame = pucFrames[ i & 1 ];
+        uint16_t usNeeded = frame_parser_bytes_needed( &xParser );
+
+        memcpy( frame_parser_next_bytes( &xParser ), pucFrame + xParser.length, usNeeded );
+
+        switch( frame_parser_commit( &xParser, usNeeded ) )
+        {
+            case FRAME_UNIT_STATUS:
+                frame_layout_decode( &unit_status_layout, xParser.data, &xUnit );
+                i++;
+                break;
+
+            case FRAME_SKID_STATUS:
+                frame_layout_decode( &skid_status_layout, xParser.data, &xSkid );
+                i++;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    xAfter = prvFramesPerSecond( TEST_BENCHMARK_FRAMES, xStart );
+
+    printf( "\tcrc: bitwise %.0f, table %.0f frames/s\n", xBitwiseCrc, xTableCrc );
+    printf( "\tUNIT decoding: hand written %.0f, layout %.0f, layout table walk %.0f frames/s\n",
+            xReferenceDecode, xLayoutDecode, xTableDecode );
+    printf( "\tuart task path: before %.0f, after %.0f frames/s\n", xBefore, xAfter );
+
+    return TEST_FRAME_DECODE_SUCCESS;
+}
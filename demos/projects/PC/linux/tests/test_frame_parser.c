@@ -0,0 +1,294 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER UART FRAME PARSER
+ *
+ * Feeds recorded UNIT/SKID byte streams through the parser, the same way the
+ * uart task does on target, checks that every valid frame is found and reports
+ * the CPU time spent per frame. Then damages one frame in a few (lost byte,
+ * flipped byte, stray header) and checks no more than the damaged frames are lost.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_parser.h"
+#include "recorded_controller_frames.h"
+
+#define TEST_FRAME_PARSER_SUCCESS    0
+#define TEST_FRAME_PARSER_FAIL       1
+
+#define TEST_ITERATIONS              20000
+#define TEST_DAMAGE_CYCLES           5000
+
+/* Noise + UNIT + SKID + UNIT with a broken crc. */
+static uint8_t ucStream[ sizeof( ucRecordedNoise ) + 2 * MESSAGE_LENGTH_UNIT_STATUS + MESSAGE_LENGTH_SKID_STATUS ];
+static uint32_t ulStreamLength = 0;
+
+#define TEST_VALID_FRAMES_PER_STREAM    2
+
+/* UNIT + SKID per cycle, plus a stray 4 byte header now and then. */
+static uint8_t ucDamagedStream[ TEST_DAMAGE_CYCLES * ( MESSAGE_LENGTH_UNIT_STATUS + MESSAGE_LENGTH_SKID_STATUS + FRAME_HEADER_LENGTH ) ];
+static uint32_t ulDamagedStreamLength = 0;
+
+static void prvBuildStream( void )
+{
+    memcpy( ucStream + ulStreamLength, ucRecordedNoise, sizeof( ucRecordedNoise ) );
+    ulStreamLength += sizeof( ucRecordedNoise );
+    memcpy( ucStream + ulStreamLength, ucRecordedUnitFrame, sizeof( ucRecordedUnitFrame ) );
+    ulStreamLength += sizeof( ucRecordedUnitFrame );
+    memcpy( ucStream + ulStreamLength, ucRecordedSkidFrame, sizeof( ucRecordedSkidFrame ) );
+    ulStreamLength += sizeof( ucRecordedSkidFrame );
+    memcpy( ucStream + ulStreamLength, ucRecordedUnitFrame, sizeof( ucRecordedUnitFrame ) );
+    ulStreamLength += sizeof( ucRecordedUnitFrame );
+    ucStream[ ulStreamLength - 1 ] ^= 0x5A;
+}
+
+/* Hands the parser exactly what it asks for, like read_incoming_system_data. */
+static uint32_t prvFeedLikeUartTask( frame_parser_t * pxParser,
+                                     uint32_t * pulUnitFrames,
+                                     uint32_t * pulSkidFrames )
+{
+    uint32_t ulOffset = 0;
+    uint32_t ulReads = 0;
+    uint16_t usNeeded;
+
+    while( ulOffset < ulStreamLength )
+    {
+        usNeeded = frame_parser_bytes_needed( pxParser );
+
+        if( usNeeded > ulStreamLength - ulOffset )
+        {
+            break;
+        }
+
+        switch( frame_parser_push( pxParser, ucStream + ulOffset, usNeeded, NULL ) )
+        {
+            case FRAME_UNIT_STATUS:
+                ( *pulUnitFrames )++;
+                break;
+
+            case FRAME_SKID_STATUS:
+                ( *pulSkidFrames )++;
+                break;
+
+            default:
+                break;
+        }
+
+        ulOffset += usNeeded;
+        ulReads++;
+    }
+
+    return ulReads;
+}
+
+/* Pushes the stream in odd sized chunks to check the consumed count is honoured. */
+static uint32_t prvFeedInChunks( frame_parser_t * pxParser,
+                                 uint16_t usChunkSize )
+{
+    uint32_t ulOffset = 0;
+    uint32_t ulFrames = 0;
+    uint16_t usChunk;
+    uint16_t usConsumed;
+
+    while( ulOffset < ulStreamLength )
+    {
+        usChunk = ( ulStreamLength - ulOffset < usChunkSize ) ? ( uint16_t ) ( ulStreamLength - ulOffset ) : usChunkSize;
+
+        if( frame_parser_push( pxParser, ucStream + ulOffset, usChunk, &usConsumed ) != FRAME_NONE )
+        {
+            ulFrames++;
+        }
+
+        ulOffset += usConsumed;
+    }
+
+    return ulFrames;
+}
+
+/* Appends a frame, damaged one time in eight. Returns 1 if it was damaged. */
+static uint32_t prvAppendDamaged( const uint8_t * pucFrame,
+                                  uint32_t ulLength )
+{
+    static const uint8_t ucStrayHeader[ FRAME_HEADER_LENGTH ] = { 'D', 0x00, 'U', 0x00 };
+    uint8_t * pucOut = ucDamagedStream + ulDamagedStreamLength;
+    uint32_t ulPosition = ( uint32_t ) rand() % ulLength;
+
+    switch( rand() % 8 )
+    {
+        case 0: /* Byte lost on the line */
+            memcpy( pucOut, pucFrame, ulPosition );
+            memcpy( pucOut + ulPosition, pucFrame + ulPosition + 1, ulLength - ulPosition - 1 );
+            ulDamagedStreamLength += ulLength - 1;
+            return 1;
+
+        case 1: /* Byte corrupted */
+            memcpy( pucOut, pucFrame, ulLength );
+            pucOut[ ulPosition ] ^= ( uint8_t ) ( 1 + rand() % 255 );
+            ulDamagedStreamLength += ulLength;
+            return 1;
+
+        case 2: /* Header of a frame that never came, right before this one */
+            memcpy( pucOut, ucStrayHeader, sizeof( ucStrayHeader ) );
+            memcpy( pucOut + sizeof( ucStrayHeader ), pucFrame, ulLength );
+            ulDamagedStreamLength += sizeof( ucStrayHeader ) + ulLength;
+            return 0;
+
+        default:
+            memcpy( pucOut, pucFrame, ulLength );
+            ulDamagedStreamLength += ulLength;
+            return 0;
+    }
+}
+
+/* The controller polynomial 0x42 is even, which leaves 7 useful crc bits: about
+ * one damaged frame in 128 passes. Such a frame can take the next one with it. */
+static uint32_t ulDamagedAccepted = 0;
+
+/* Counts the frames that come out of the damaged stream intact. */
+static uint32_t prvFeedDamaged( frame_parser_t * pxParser )
+{
+    uint32_t ulOffset = 0;
+    uint32_t ulIntact = 0;
+    uint16_t usChunk;
+    uint16_t usConsumed;
+    frame_type_t xType;
+
+    while( ulOffset < ulDamagedStreamLength )
+    {
+        usChunk = ( uint16_t ) ( 1 + rand() % 80 );
+        usChunk = ( ulDamagedStreamLength - ulOffset < usChunk ) ? ( uint16_t ) ( ulDamagedStreamLength - ulOffset ) : usChunk;
+        xType = frame_parser_push( pxParser, ucDamagedStream + ulOffset, usChunk, &usConsumed );
+
+        if( ( ( xType == FRAME_UNIT_STATUS ) && ( memcmp( pxParser->data, ucRecordedUnitFrame, MESSAGE_LENGTH_UNIT_STATUS ) == 0 ) ) ||
+            ( ( xType == FRAME_SKID_STATUS ) && ( memcmp( pxParser->data, ucRecordedSkidFrame, MESSAGE_LENGTH_SKID_STATUS ) == 0 ) ) )
+        {
+            ulIntact++;
+        }
+        else if( xType != FRAME_NONE )
+        {
+            ulDamagedAccepted++;
+        }
+
+        ulOffset += usConsumed;
+    }
+
+    /* The last frame may still be held, bytes kept from a failed frame are parsed on the next call. */
+    while( ( xType = frame_parser_push( pxParser, NULL, 0, NULL ) ) != FRAME_NONE )
+    {
+        ulIntact++;
+    }
+
+    return ulIntact;
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+int vStartTestTask( void )
+{
+    frame_parser_t xParser;
+    uint32_t ulUnitFrames = 0;
+    uint32_t ulSkidFrames = 0;
+    uint32_t ulReads = 0;
+    uint32_t ulDamaged = 0;
+    uint32_t ulIntact;
+    uint16_t usChunkSize;
+    double xStart;
+    double xElapsed;
+    int i;
+
+    prvBuildStream();
+
+    printf( "Checking recorded frames\n" );
+
+    if( ( CalcCrc( ( uint8_t * ) ucRecordedUnitFrame, MESSAGE_LENGTH_UNIT_STATUS - 1 ) != ucRecordedUnitFrame[ MESSAGE_LENGTH_UNIT_STATUS - 1 ] ) ||
+        ( CalcCrc( ( uint8_t * ) ucRecordedSkidFrame, MESSAGE_LENGTH_SKID_STATUS - 1 ) != ucRecordedSkidFrame[ MESSAGE_LENGTH_SKID_STATUS - 1 ] ) )
+    {
+        printf( "\tRecorded frame crc Failed!\n" );
+        return TEST_FRAME_PARSER_FAIL;
+    }
+
+    printf( "Parsing stream the way the uart task reads it\n" );
+    frame_parser_init( &xParser );
+    prvFeedLikeUartTask( &xParser, &ulUnitFrames, &ulSkidFrames );
+
+    if( ( ulUnitFrames != 1 ) || ( ulSkidFrames != 1 ) )
+    {
+        printf( "\tFailed! unit=%u skid=%u\n", ulUnitFrames, ulSkidFrames );
+        return TEST_FRAME_PARSER_FAIL;
+    }
+
+    printf( "Parsing stream in arbitrary chunks\n" );
+
+    for( usChunkSize = 1; usChunkSize <= 64; usChunkSize++ )
+    {
+        frame_parser_init( &xParser );
+
+        if( prvFeedInChunks( &xParser, usChunkSize ) != TEST_VALID_FRAMES_PER_STREAM )
+        {
+            printf( "\tFailed with chunk size %u!\n", usChunkSize );
+            return TEST_FRAME_PARSER_FAIL;
+        }
+    }
+
+    printf( "Measuring CPU time per frame\n" );
+    ulUnitFrames = 0;
+    ulSkidFrames = 0;
+    frame_parser_init( &xParser );
+
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_ITERATIONS; i++ )
+    {
+        ulReads += prvFeedLikeUartTask( &xParser, &ulUnitFrames, &ulSkidFrames );
+    }
+
+    xElapsed = prvCpuTimeNs() - xStart;
+
+    if( ulUnitFrames + ulSkidFrames != TEST_ITERATIONS * TEST_VALID_FRAMES_PER_STREAM )
+    {
+        printf( "\tFailed! frames=%u\n", ulUnitFrames + ulSkidFrames );
+        return TEST_FRAME_PARSER_FAIL;
+    }
+
+    printf( "\t%u frames, %u reads, %.1f ns CPU per frame, %.2f reads per frame\n",
+            ulUnitFrames + ulSkidFrames, ulReads,
+            xElapsed / ( double ) ( ulUnitFrames + ulSkidFrames ),
+            ( double ) ulReads / ( double ) ( ulUnitFrames + ulSkidFrames ) );
+
+    printf( "Resynchronising after damaged frames\n" );
+    srand( 1 );
+
+    for( i = 0; i < TEST_DAMAGE_CYCLES; i++ )
+    {
+        ulDamaged += prvAppendDamaged( ucRecordedUnitFrame, MESSAGE_LENGTH_UNIT_STATUS );
+        ulDamaged += prvAppendDamaged( ucRecordedSkidFrame, MESSAGE_LENGTH_SKID_STATUS );
+    }
+
+    frame_parser_init( &xParser );
+    ulIntact = prvFeedDamaged( &xParser );
+
+    if( ulIntact + ulDamaged + ulDamagedAccepted < 2 * TEST_DAMAGE_CYCLES )
+    {
+        printf( "\tFailed! %u damaged frames but %u lost\n", ulDamaged, 2 * TEST_DAMAGE_CYCLES - ulIntact );
+        return TEST_FRAME_PARSER_FAIL;
+    }
+
+    printf( "\t%u frames sent, %u damaged, %u received intact, %u damaged passed the crc; crc failures %u, header mismatches %u, skipped bytes %u\n",
+            2 * TEST_DAMAGE_CYCLES, ulDamaged, ulIntact, ulDamagedAccepted, xParser.counters.crc_failures,
+            xParser.counters.header_mismatches, xParser.counters.skipped_bytes );
+
+    return TEST_FRAME_PARSER_SUCCESS;
+}
@@ -0,0 +1,230 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER SENSOR STATISTICS
+ *
+ * Feeds random walks through the incremental statistics and checks them
+ * against a full rescan of the window after every sample. Then times the
+ * rescan the getters used to do (walk the sample structs, qsort for the
+ * median) against updating on arrival and copying on get.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "running_stats.h"
+
+#define TEST_RUNNING_STATS_SUCCESS    0
+#define TEST_RUNNING_STATS_FAIL       1
+
+/* 9 heaters + 10 other sensors, as in get_unit_status/get_skid_status. */
+#define TEST_CHANNELS                 19
+#define TEST_FRAMES                   20000
+#define TEST_WINDOW                   30
+#define TEST_VALID_MIN                0.0
+#define TEST_VALID_MAX                100.0
+
+/* Sample layout the rescan walked, one struct of doubles per frame. */
+typedef struct
+{
+    double channel[ TEST_CHANNELS ];
+} TestSample_t;
+
+static TestSample_t xSamples[ TEST_WINDOW ];
+static uint32_t ulSampleIndex = 0;
+static running_stats_t xStats[ TEST_CHANNELS ];
+static double xWindows[ TEST_CHANNELS ][ TEST_WINDOW ];
+static running_stats_node_t xNodes[ TEST_CHANNELS ][ TEST_WINDOW ];
+
+/* Controller values are Q16.16, keep the walk on that grid. */
+static double prvNextValue( double xPrevious )
+{
+    int32_t lStep = ( rand() % 0x40000 ) - 0x20000;
+    double xValue = xPrevious + ( double ) lStep / ( 1 << 16 );
+
+    /* Now and then a reading out of range, like a disconnected sensor. */
+    if( rand() % 50 == 0 )
+    {
+        return -1.0;
+    }
+
+    return ( xValue < -5.0 || xValue > 105.0 ) ? 50.0 : xValue;
+}
+
+static int prvCompare( const void * pvA,
+                       const void * pvB )
+{
+    double xA = *( const double * ) pvA;
+    double xB = *( const double * ) pvB;
+
+    return ( xA > xB ) - ( xA < xB );
+}
+
+/* What the getters did before: rescan the window and sort a copy. */
+static void prvRescan( uint32_t ulChannel,
+                       sensor_stats_t * pxResult )
+{
+    double xSorted[ TEST_WINDOW ];
+    double xTotal = 0.0;
+    uint32_t ulValid = 0;
+    uint32_t i;
+
+    pxResult->min = pxResult->max = xSamples[ 0 ].channel[ ulChannel ];
+
+    for( i = 0; i < TEST_WINDOW; i++ )
+    {
+        double xValue = xSorted[ i ] = xSamples[ i ].channel[ ulChannel ];
+
+        if( ( xValue >= TEST_VALID_MIN ) && ( xValue <= TEST_VALID_MAX ) )
+        {
+            xTotal += xValue;
+            ulValid++;
+        }
+
+        if( xValue > pxResult->max )
+        {
+            pxResult->max = xValue;
+        }
+
+        if( xValue < pxResult->min )
+        {
+            pxResult->min = xValue;
+        }
+    }
+
+    qsort( xSorted, TEST_WINDOW, sizeof( double ), prvCompare );
+    pxResult->median = ( TEST_WINDOW % 2 == 0 ) ?
+                       ( xSorted[ TEST_WINDOW / 2 - 1 ] + xSorted[ TEST_WINDOW / 2 ] ) / 2.0 :
+                       xSorted[ TEST_WINDOW / 2 ];
+    pxResult->avg = ( ulValid != 0 ) ? xTotal / ( double ) ulValid : xSamples[ ( ulSampleIndex + TEST_WINDOW - 1 ) % TEST_WINDOW ].channel[ ulChannel ];
+}
+
+static void prvAddFrame( int xUpdateStats )
+{
+    TestSample_t * pxSlot = &xSamples[ ulSampleIndex ];
+    const TestSample_t * pxPrevious = &xSamples[ ( ulSampleIndex + TEST_WINDOW - 1 ) % TEST_WINDOW ];
+    uint32_t i;
+
+    for( i = 0; i < TEST_CHANNELS; i++ )
+    {
+        double xNew = prvNextValue( pxPrevious->channel[ i ] < 0 ? 50.0 : pxPrevious->channel[ i ] );
+
+        pxSlot->channel[ i ] = xNew;
+
+        if( xUpdateStats )
+        {
+            running_stats_replace( &xStats[ i ], ( uint16_t ) ulSampleIndex, xNew );
+        }
+    }
+
+    ulSampleIndex = ( ulSampleIndex + 1 ) % TEST_WINDOW;
+}
+
+static void prvReset( void )
+{
+    uint32_t i;
+
+    srand( 1 );
+    memset( xSamples, 0, sizeof( xSamples ) );
+    ulSampleIndex = 0;
+
+    for( i = 0; i < TEST_CHANNELS; i++ )
+    {
+        running_stats_init( &xStats[ i ], xWindows[ i ], xNodes[ i ], TEST_WINDOW, TEST_VALID_MIN, TEST_VALID_MAX, 0.0 );
+    }
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+int vStartTestTask( void )
+{
+    sensor_stats_t xExpected;
+    sensor_stats_t xActual;
+    volatile double xSink = 0.0;
+    double xStart;
+    double xRescanNs;
+    double xUpdateNs;
+    double xGetNs;
+    uint32_t ulFrame;
+    uint32_t i;
+
+    printf( "Checking incremental statistics against a rescan\n" );
+    prvReset();
+
+    for( ulFrame = 0; ulFrame < TEST_FRAMES; ulFrame++ )
+    {
+        prvAddFrame( 1 );
+
+        for( i = 0; i < TEST_CHANNELS; i++ )
+        {
+            prvRescan( i, &xExpected );
+            running_stats_get( &xStats[ i ], &xActual );
+
+            /* Q16.16 sums are exact in a double, so the results have to match bit for bit. */
+            if( memcmp( &xExpected, &xActual, sizeof( xActual ) ) != 0 )
+            {
+                printf( "\tFailed at frame %u channel %u: avg %f/%f min %f/%f max %f/%f median %f/%f\n",
+                        ulFrame, i, xExpected.avg, xActual.avg, xExpected.min, xActual.min,
+                        xExpected.max, xActual.max, xExpected.median, xActual.median );
+                return TEST_RUNNING_STATS_FAIL;
+            }
+        }
+    }
+
+    printf( "Measuring rescan on every get\n" );
+    prvReset();
+    xStart = prvCpuTimeNs();
+
+    for( ulFrame = 0; ulFrame < TEST_FRAMES; ulFrame++ )
+    {
+        prvAddFrame( 0 );
+
+        for( i = 0; i < TEST_CHANNELS; i++ )
+        {
+            prvRescan( i, &xExpected );
+            xSink += xExpected.median;
+        }
+    }
+
+    xRescanNs = ( prvCpuTimeNs() - xStart ) / TEST_FRAMES;
+
+    printf( "Measuring update on arrival\n" );
+    prvReset();
+    xStart = prvCpuTimeNs();
+
+    for( ulFrame = 0; ulFrame < TEST_FRAMES; ulFrame++ )
+    {
+        prvAddFrame( 1 );
+    }
+
+    xUpdateNs = ( prvCpuTimeNs() - xStart ) / TEST_FRAMES;
+
+    xStart = prvCpuTimeNs();
+
+    for( ulFrame = 0; ulFrame < TEST_FRAMES; ulFrame++ )
+    {
+        for( i = 0; i < TEST_CHANNELS; i++ )
+        {
+            running_stats_get( &xStats[ i ], &xActual );
+            xSink += xActual.median;
+        }
+    }
+
+    xGetNs = ( prvCpuTimeNs() - xStart ) / TEST_FRAMES;
+
+    printf( "\twindow %u, %u channels: rescan get %.0f ns, incremental update %.0f ns (incl. sample generation) + get %.0f ns\n",
+            TEST_WINDOW, TEST_CHANNELS, xRescanNs, xUpdateNs, xGetNs );
+
+    return TEST_RUNNING_STATS_SUCCESS;
+}
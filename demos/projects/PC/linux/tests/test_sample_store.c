@@ -0,0 +1,280 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER SAMPLE STORE
+ *
+ * Fills the column wise sample store and the struct per frame layout it
+ * replaced with the same UNIT samples, checks a full pass over every channel
+ * gives the same result on both, and times that pass plus the per frame
+ * update for windows of 30, 300 and 3000 samples.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sample_store.h"
+#include "running_stats.h"
+
+#define TEST_SAMPLE_STORE_SUCCESS    0
+#define TEST_SAMPLE_STORE_FAIL       1
+
+#define TEST_HEATERS                 9
+#define TEST_CHANNELS                ( TEST_HEATERS + 3 )
+#define TEST_MAX_WINDOW              3000
+#define TEST_SAMPLES_PER_RUN         300000
+#define TEST_VALID_MIN               0.0
+#define TEST_VALID_MAX               150.0
+
+/* Layout of UNIT_status_t, one struct per received frame. */
+typedef struct
+{
+    uint8_t unit_status;
+    uint8_t unit_state;
+    uint16_t heater_status;
+    double heater_temperatures[ TEST_HEATERS ];
+    uint8_t valve_status;
+    double vacuum_sensor;
+    double ambient_humidity;
+    double ambient_temperature;
+    uint32_t errors;
+} TestUnitStatus_t;
+
+typedef struct
+{
+    double total;
+    double min;
+    double max;
+    uint32_t valid;
+} TestScan_t;
+
+static TestUnitStatus_t xFrames[ TEST_MAX_WINDOW ];
+static double xColumns[ TEST_CHANNELS * TEST_MAX_WINDOW ];
+static running_stats_node_t xNodes[ TEST_CHANNELS ][ TEST_MAX_WINDOW ];
+static sample_store_t xStore;
+static running_stats_t xStats[ TEST_CHANNELS ];
+
+/* Per sample switch, the way get_sensor_value picked a field out of a frame. */
+static double prvGetFrameValue( uint32_t ulIndex,
+                                uint32_t ulChannel )
+{
+    switch( ulChannel )
+    {
+        case TEST_HEATERS:
+            return xFrames[ ulIndex ].vacuum_sensor;
+
+        case TEST_HEATERS + 1:
+            return xFrames[ ulIndex ].ambient_humidity;
+
+        case TEST_HEATERS + 2:
+            return xFrames[ ulIndex ].ambient_temperature;
+
+        default:
+            return xFrames[ ulIndex ].heater_temperatures[ ulChannel ];
+    }
+}
+
+static void prvScanFrames( uint32_t ulWindow,
+                           uint32_t ulChannel,
+                           TestScan_t * pxScan )
+{
+    uint32_t i;
+
+    pxScan->total = 0.0;
+    pxScan->valid = 0;
+    pxScan->min = pxScan->max = prvGetFrameValue( 0, ulChannel );
+
+    for( i = 0; i < ulWindow; i++ )
+    {
+        double xValue = prvGetFrameValue( i, ulChannel );
+
+        if( ( xValue >= TEST_VALID_MIN ) && ( xValue <= TEST_VALID_MAX ) )
+        {
+            pxScan->total += xValue;
+            pxScan->valid++;
+        }
+
+        pxScan->min = ( xValue < pxScan->min ) ? xValue : pxScan->min;
+        pxScan->max = ( xValue > pxScan->max ) ? xValue : pxScan->max;
+    }
+}
+
+static void prvScanColumn( uint32_t ulWindow,
+                           uint32_t ulChannel,
+                           TestScan_t * pxScan )
+{
+    const double * pxColumn = sample_store_column( &xStore, ulChannel );
+    uint32_t i;
+
+    pxScan->total = 0.0;
+    pxScan->valid = 0;
+    pxScan->min = pxScan->max = pxColumn[ 0 ];
+
+    for( i = 0; i < ulWindow; i++ )
+    {
+        double xValue = pxColumn[ i ];
+        int xValid = ( xValue >= TEST_VALID_MIN ) && ( xValue <= TEST_VALID_MAX );
+
+        pxScan->total += xValid ? xValue : 0.0;
+        pxScan->valid += xValid;
+        pxScan->min = ( xValue < pxScan->min ) ? xValue : pxScan->min;
+        pxScan->max = ( xValue > pxScan->max ) ? xValue : pxScan->max;
+    }
+}
+
+/* Q16.16 value as the controller sends it, now and then out of range. */
+static double prvRandomValue( void )
+{
+    if( rand() % 50 == 0 )
+    {
+        return -1.0;
+    }
+
+    return ( double ) ( rand() % ( 120 << 16 ) ) / ( 1 << 16 );
+}
+
+static void prvFill( uint32_t ulWindow )
+{
+    uint32_t i;
+    uint32_t c;
+
+    srand( 1 );
+    memset( xFrames, 0, sizeof( xFrames ) );
+    sample_store_init( &xStore, xColumns, TEST_CHANNELS, ( uint16_t ) ulWindow );
+
+    for( c = 0; c < TEST_CHANNELS; c++ )
+    {
+        running_stats_init( &xStats[ c ], sample_store_column( &xStore, c ), xNodes[ c ], ( uint16_t ) ulWindow, TEST_VALID_MIN, TEST_VALID_MAX, 0.0 );
+    }
+
+    for( i = 0; i < ulWindow; i++ )
+    {
+        for( c = 0; c < TEST_CHANNELS; c++ )
+        {
+            double xValue = prvRandomValue();
+
+            if( c < TEST_HEATERS )
+            {
+                xFrames[ i ].heater_temperatures[ c ] = xValue;
+            }
+            else if( c == TEST_HEATERS )
+            {
+                xFrames[ i ].vacuum_sensor = xValue;
+            }
+            else if( c == TEST_HEATERS + 1 )
+            {
+                xFrames[ i ].ambient_humidity = xValue;
+            }
+            else
+            {
+                xFrames[ i ].ambient_temperature = xValue;
+            }
+
+            running_stats_replace( &xStats[ c ], sample_store_slot( &xStore ), xValue );
+        }
+
+        sample_store_advance( &xStore );
+    }
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+int vStartTestTask( void )
+{
+    static const uint32_t ulWindows[] = { 30, 300, 3000 };
+    TestScan_t xFrameScan;
+    TestScan_t xColumnScan;
+    volatile double xSink = 0.0;
+    double xStart;
+    double xFramesNs;
+    double xColumnsNs;
+    double xUpdateNs;
+    uint32_t ulPasses;
+    uint32_t w;
+    uint32_t p;
+    uint32_t c;
+
+    for( w = 0; w < sizeof( ulWindows ) / sizeof( ulWindows[ 0 ] ); w++ )
+    {
+        uint32_t ulWindow = ulWindows[ w ];
+
+        printf( "Window of %u samples\n", ulWindow );
+        prvFill( ulWindow );
+
+        for( c = 0; c < TEST_CHANNELS; c++ )
+        {
+            prvScanFrames( ulWindow, c, &xFrameScan );
+            prvScanColumn( ulWindow, c, &xColumnScan );
+
+            if( ( xFrameScan.total != xColumnScan.total ) || ( xFrameScan.valid != xColumnScan.valid ) ||
+                ( xFrameScan.min != xColumnScan.min ) || ( xFrameScan.max != xColumnScan.max ) )
+            {
+                printf( "\tFailed! channel %u differs between layouts\n", c );
+                return TEST_SAMPLE_STORE_FAIL;
+            }
+
+            if( sample_store_latest( &xStore, c ) != prvGetFrameValue( ulWindow - 1, c ) )
+            {
+                printf( "\tFailed! latest sample of channel %u\n", c );
+                return TEST_SAMPLE_STORE_FAIL;
+            }
+        }
+
+        ulPasses = TEST_SAMPLES_PER_RUN / ulWindow;
+
+        xStart = prvCpuTimeNs();
+
+        for( p = 0; p < ulPasses; p++ )
+        {
+            for( c = 0; c < TEST_CHANNELS; c++ )
+            {
+                prvScanFrames( ulWindow, c, &xFrameScan );
+                xSink += xFrameScan.total;
+            }
+        }
+
+        xFramesNs = ( prvCpuTimeNs() - xStart ) / ulPasses;
+        xStart = prvCpuTimeNs();
+
+        for( p = 0; p < ulPasses; p++ )
+        {
+            for( c = 0; c < TEST_CHANNELS; c++ )
+            {
+                prvScanColumn( ulWindow, c, &xColumnScan );
+                xSink += xColumnScan.total;
+            }
+        }
+
+        xColumnsNs = ( prvCpuTimeNs() - xStart ) / ulPasses;
+        xStart = prvCpuTimeNs();
+
+        for( p = 0; p < TEST_SAMPLES_PER_RUN / 10; p++ )
+        {
+            for( c = 0; c < TEST_CHANNELS; c++ )
+            {
+                double xValue = sample_store_latest( &xStore, c );
+
+                running_stats_replace( &xStats[ c ], sample_store_slot( &xStore ), xValue );
+            }
+
+            sample_store_advance( &xStore );
+        }
+
+        xUpdateNs = ( prvCpuTimeNs() - xStart ) / ( TEST_SAMPLES_PER_RUN / 10 );
+
+        printf( "\tfull pass over %u channels: struct per frame %.0f ns, per channel columns %.0f ns; frame update %.0f ns\n",
+                TEST_CHANNELS, xFramesNs, xColumnsNs, xUpdateNs );
+    }
+
+    return TEST_SAMPLE_STORE_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE SCRATCH ARENA
+ *
+ * Checks allocation, mark and reset on the bump allocator the demo builds its
+ * messages in. Then lays the arena out the way a publish cycle does, property
+ * bag first and one message on top, writes each message type for the longest
+ * values its fields can take and reports the peak, so SCRATCH_BUFFER_LENGTH
+ * can be sized from it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scratch_arena.h"
+#include "telemetry_schema.h"
+#include "sensor_value.h"
+
+#define TEST_SCRATCH_ARENA_SUCCESS    0
+#define TEST_SCRATCH_ARENA_FAIL       1
+
+/* Same sizes as sample_azure_iot.c. */
+#define TEST_SCRATCH_BUFFER_LENGTH    3456
+#define TEST_PROPERTY_BUFFER_LENGTH   80
+
+static uint8_t ucBuffer[ TEST_SCRATCH_BUFFER_LENGTH ];
+static scratch_arena_t xArena;
+static telemetry_data_t xData;
+
+static int prvCheckArena( void )
+{
+    scratch_arena_mark_t xOuter;
+    scratch_arena_mark_t xInner;
+    uint8_t * pucTop;
+    uint8_t * pucFirst;
+    uint8_t * pucSecond;
+
+    scratch_arena_init( &xArena, ucBuffer, 100 );
+
+    pucFirst = scratch_arena_alloc( &xArena, 30 );
+    xOuter = scratch_arena_mark( &xArena );
+    pucSecond = scratch_arena_alloc( &xArena, 50 );
+
+    if( ( pucFirst != ucBuffer ) || ( pucSecond != ucBuffer + 30 ) || ( xArena.used != 80 ) )
+    {
+        printf( "\tFailed! allocations not taken from the top\n" );
+        return 0;
+    }
+
+    if( ( scratch_arena_alloc( &xArena, 21 ) != NULL ) || ( xArena.used != 80 ) )
+    {
+        printf( "\tFailed! allocation past the end\n" );
+        return 0;
+    }
+
+    if( ( scratch_arena_remaining( &xArena, &pucTop ) != 20 ) || ( pucTop != ucBuffer + 80 ) ||
+        ( scratch_arena_alloc( &xArena, 20 ) != pucTop ) )
+    {
+        printf( "\tFailed! remaining space does not match the next allocation\n" );
+        return 0;
+    }
+
+    xInner = scratch_arena_mark( &xArena );
+    scratch_arena_reset( &xArena, xOuter );
+
+    if( ( xArena.used != 30 ) || ( xArena.peak != 100 ) )
+    {
+        printf( "\tFailed! reset to %u left %u used, peak %u\n", xOuter, xArena.used, xArena.peak );
+        return 0;
+    }
+
+    /* A mark above the top, from a scope already given back, changes nothing. */
+    scratch_arena_reset( &xArena, xInner );
+
+    if( xArena.used != 30 )
+    {
+        printf( "\tFailed! reset to a stale mark grew the arena\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/* The longest text every field can produce. */
+static void prvLongestData( sequence_state_t xState )
+{
+    sensor_info_t xSensor;
+    uint32_t i;
+
+    memset( &xData, 0, sizeof( xData ) ); /* Index 0 is the longest name in every table but the states. */
+
+    xSensor.status = ZERO;
+    xSensor.stats.avg = SENSOR_VALUE( -32767.999 );
+    xSensor.stats.max = xSensor.stats.avg;
+    xSensor.stats.min = xSensor.stats.avg;
+    xSensor.stats.median = xSensor.stats.avg;
+
+    xData.skid.skid_state = xState;
+    xData.skid.o2_sensor = xSensor;
+    xData.skid.mass_flow = xSensor;
+    xData.skid.co2_sensor = xSensor;
+    xData.skid.tank_pressure = xSensor;
+    xData.skid.proportional_valve_pressure = xSensor;
+    xData.skid.temperature = xSensor;
+    xData.skid.humidity = xSensor;
+
+    xData.unit.unit_state = xState;
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        xData.unit.heater_info[ i ] = xSensor;
+    }
+
+    xData.unit.vacuum_sensor = xSensor;
+    xData.unit.ambient_humidity = xSensor;
+    xData.unit.ambient_temperature = xSensor;
+
+    memset( xData.timestamp_utc, '0', sizeof( xData.timestamp_utc ) - 1 );
+    memset( xData.ccu_serial_number, 'S', sizeof( xData.ccu_serial_number ) - 1 );
+    memset( xData.skid_error_code, 'E', sizeof( xData.skid_error_code ) - 1 );
+    memset( xData.unit_error_code, 'E', sizeof( xData.unit_error_code ) - 1 );
+}
+
+/* Property bag for the session, then the message on top, as the demo task does. */
+static uint32_t prvPeakFor( const telemetry_schema_t * pxSchema )
+{
+    scratch_arena_mark_t xSession;
+    uint8_t * pucTop;
+    uint32_t ulRemaining;
+    uint32_t ulLength;
+
+    scratch_arena_init( &xArena, ucBuffer, sizeof( ucBuffer ) );
+    xSession = scratch_arena_mark( &xArena );
+    scratch_arena_alloc( &xArena, TEST_PROPERTY_BUFFER_LENGTH );
+
+    ulRemaining = scratch_arena_remaining( &xArena, &pucTop );
+    ulLength = telemetry_schema_write( pxSchema, &xData, pucTop, ulRemaining );
+
+    if( ( ulLength == 0 ) || ( scratch_arena_alloc( &xArena, ulLength ) != pucTop ) )
+    {
+        return 0;
+    }
+
+    scratch_arena_reset( &xArena, xSession );
+
+    return xArena.peak;
+}
+
+int vStartTestTask( void )
+{
+    static const char * pcNames[] = { "boot-up", "error", "telemetry" };
+    const telemetry_schema_t * pxSchemas[] = { &bootup_message_schema, &error_message_schema, &telemetry_message_schema };
+    const sequence_state_t xStates[] = { Lock_State, Lock_State, Vacuum_Release_State };
+    uint32_t ulPeak;
+    uint32_t i;
+
+    printf( "Checking allocation, mark and reset\n" );
+
+    if( !prvCheckArena() )
+    {
+        return TEST_SCRATCH_ARENA_FAIL;
+    }
+
+    printf( "Peak arena usage per message type, longest values\n" );
+
+    for( i = 0; i < sizeof( pxSchemas ) / sizeof( pxSchemas[ 0 ] ); i++ )
+    {
+        prvLongestData( xStates[ i ] );
+        ulPeak = prvPeakFor( pxSchemas[ i ] );
+
+        if( ulPeak == 0 )
+        {
+            printf( "\tFailed! %s message does not fit in %u bytes\n", pcNames[ i ], TEST_SCRATCH_BUFFER_LENGTH );
+            return TEST_SCRATCH_ARENA_FAIL;
+        }
+
+        printf( "\t%-9s %4u of %u bytes\n", pcNames[ i ], ulPeak, TEST_SCRATCH_BUFFER_LENGTH );
+    }
+
+    return TEST_SCRATCH_ARENA_SUCCESS;
+}
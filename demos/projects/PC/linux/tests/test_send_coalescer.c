@@ -0,0 +1,503 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE SEND COALESCER
+ *
+ * A mock transport stands in for the WiFi module and counts the socket sends,
+ * each one a command exchange with the module. Telemetry is published the way
+ * coreMQTT writes it over mbedTLS, one record per part of the PUBLISH, and the
+ * exchanges per publish are compared with and without the coalescer. Then
+ * checks the sends when the buffer fills up, records larger than the buffer,
+ * the deadline across the tick wrap, partial sends, timeouts and errors, and
+ * that random writes reach the socket unchanged and in order.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "send_coalescer.h"
+
+#define TEST_SEND_COALESCER_SUCCESS    0
+#define TEST_SEND_COALESCER_FAIL       1
+
+#define TEST_PAYLOAD_SIZE              1200 /* ES_WIFI_PAYLOAD_SIZE */
+#define TEST_DEADLINE_TICKS            5
+#define TEST_RECORD_OVERHEAD           29   /* Header, explicit nonce and tag of an AES-GCM record */
+#define TEST_TOPIC                     "devices/skytree_growy_with_alten/messages/events/"
+#define TEST_PUBLISHES                 100
+#define TEST_RANDOM_WRITES             50000
+#define TEST_WIRE_SIZE                 ( 8 * 1024 * 1024 )
+
+/* What the module was sent. */
+typedef struct MockTransport
+{
+    uint8_t * pucWire;
+    size_t xWireLength;
+    uint32_t ulSends;
+    size_t xMaxSend;       /* Largest send taken whole, more is sent in part */
+    uint32_t ulTimeouts;   /* Sends left that time out */
+    int32_t lError;        /* Returned by the next send when negative */
+} MockTransport_t;
+
+static MockTransport_t xMock;
+static SendCoalescer_t xCoalescer;
+static uint8_t ucBuffer[ TEST_PAYLOAD_SIZE ];
+static uint8_t ucExpected[ TEST_WIRE_SIZE ];
+static size_t xExpectedLength;
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvMockSend( void * pvContext,
+                            const uint8_t * pucData,
+                            size_t xDataLength )
+{
+    MockTransport_t * pxMock = ( MockTransport_t * ) pvContext;
+    int32_t lError;
+
+    pxMock->ulSends++;
+
+    if( pxMock->lError < 0 )
+    {
+        lError = pxMock->lError;
+        pxMock->lError = 0;
+        return lError;
+    }
+
+    if( pxMock->ulTimeouts > 0 )
+    {
+        pxMock->ulTimeouts--;
+        return 0;
+    }
+
+    if( xDataLength > pxMock->xMaxSend )
+    {
+        xDataLength = pxMock->xMaxSend;
+    }
+
+    memcpy( pxMock->pucWire + pxMock->xWireLength, pucData, xDataLength );
+    pxMock->xWireLength += xDataLength;
+
+    return ( int32_t ) xDataLength;
+}
+
+static void prvReset( void )
+{
+    xMock.xWireLength = 0;
+    xMock.ulSends = 0;
+    xMock.xMaxSend = TEST_WIRE_SIZE;
+    xMock.ulTimeouts = 0;
+    xMock.lError = 0;
+    xExpectedLength = 0;
+    SendCoalescer_Init( &xCoalescer, ucBuffer, sizeof( ucBuffer ), TEST_DEADLINE_TICKS, prvMockSend, &xMock );
+}
+
+/* A TLS record of the data, as mbedTLS hands it to the send callback. */
+static size_t prvRecord( uint8_t * pucRecord,
+                         const uint8_t * pucData,
+                         size_t xDataLength )
+{
+    pucRecord[ 0 ] = 0x17;
+    pucRecord[ 1 ] = 0x03;
+    pucRecord[ 2 ] = 0x03;
+    pucRecord[ 3 ] = ( uint8_t ) ( ( xDataLength + TEST_RECORD_OVERHEAD - 5 ) >> 8 );
+    pucRecord[ 4 ] = ( uint8_t ) ( xDataLength + TEST_RECORD_OVERHEAD - 5 );
+    memset( pucRecord + 5, 0xA5, 8 );
+    memcpy( pucRecord + 13, pucData, xDataLength );
+    memset( pucRecord + 13 + xDataLength, 0x5A, 16 );
+
+    return xDataLength + TEST_RECORD_OVERHEAD;
+}
+
+/* One record written, through the coalescer or straight to the socket. */
+static int prvWriteRecord( const uint8_t * pucData,
+                           size_t xDataLength,
+                           int xCoalesce,
+                           uint32_t ulTick )
+{
+    uint8_t ucRecord[ 4096 ];
+    size_t xRecordLength = prvRecord( ucRecord, pucData, xDataLength );
+    size_t xOffset = 0;
+    int32_t lSent;
+
+    memcpy( ucExpected + xExpectedLength, ucRecord, xRecordLength );
+    xExpectedLength += xRecordLength;
+
+    /* mbedTLS sends the rest of a record until it is all taken. */
+    while( xOffset < xRecordLength )
+    {
+        lSent = xCoalesce ? SendCoalescer_Write( &xCoalescer, ucRecord + xOffset, xRecordLength - xOffset, ulTick ) :
+                prvMockSend( &xMock, ucRecord + xOffset, xRecordLength - xOffset );
+
+        if( lSent <= 0 )
+        {
+            printf( "\tFailed! Record write returned %d\n", ( int ) lSent );
+            return 0;
+        }
+
+        xOffset += ( size_t ) lSent;
+    }
+
+    return 1;
+}
+
+/* The parts of a QoS 1 PUBLISH as coreMQTT writes them without writev. */
+static int prvPublish( size_t xPayloadLength,
+                       int xCoalesce,
+                       uint32_t ulTick )
+{
+    uint8_t ucHeader[ 7 ];
+    uint8_t ucPacketId[ 2 ] = { 0x00, 0x2A };
+    uint8_t ucPayload[ 2048 ];
+    size_t xTopicLength = strlen( TEST_TOPIC );
+    size_t xRemaining = 2 + xTopicLength + 2 + xPayloadLength;
+    size_t xHeaderLength = 0;
+
+    memset( ucPayload, '7', xPayloadLength );
+
+    ucHeader[ xHeaderLength++ ] = 0x32;
+
+    do
+    {
+        ucHeader[ xHeaderLength ] = ( uint8_t ) ( xRemaining & 0x7F );
+        xRemaining >>= 7;
+        ucHeader[ xHeaderLength++ ] |= ( xRemaining > 0 ) ? 0x80 : 0;
+    } while( xRemaining > 0 );
+
+    ucHeader[ xHeaderLength++ ] = ( uint8_t ) ( xTopicLength >> 8 );
+    ucHeader[ xHeaderLength++ ] = ( uint8_t ) xTopicLength;
+
+    return prvWriteRecord( ucHeader, xHeaderLength, xCoalesce, ulTick ) &&
+           prvWriteRecord( ( const uint8_t * ) TEST_TOPIC, xTopicLength, xCoalesce, ulTick ) &&
+           prvWriteRecord( ucPacketId, sizeof( ucPacketId ), xCoalesce, ulTick ) &&
+           prvWriteRecord( ucPayload, xPayloadLength, xCoalesce, ulTick );
+}
+
+static int prvCheckWire( const char * pcCase )
+{
+    if( ( xMock.xWireLength != xExpectedLength ) || ( memcmp( xMock.pucWire, ucExpected, xExpectedLength ) != 0 ) )
+    {
+        printf( "\tFailed! %s sent %u bytes, not the %u written in order\n",
+                pcCase, ( unsigned ) xMock.xWireLength, ( unsigned ) xExpectedLength );
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Telemetry published and flushed by the wait for the PUBACK. */
+static int prvExchangesPerPublish( size_t xPayloadLength,
+                                   uint32_t ulMaxExchanges )
+{
+    uint32_t ulDirectSends;
+    uint32_t ulIndex;
+
+    prvReset();
+
+    for( ulIndex = 0; ulIndex < TEST_PUBLISHES; ulIndex++ )
+    {
+        if( !prvPublish( xPayloadLength, 0, ulIndex ) )
+        {
+            return 0;
+        }
+    }
+
+    ulDirectSends = xMock.ulSends;
+
+    if( !prvCheckWire( "Direct publish" ) )
+    {
+        return 0;
+    }
+
+    prvReset();
+
+    for( ulIndex = 0; ulIndex < TEST_PUBLISHES; ulIndex++ )
+    {
+        if( !prvPublish( xPayloadLength, 1, ulIndex ) || ( SendCoalescer_Flush( &xCoalescer ) != 0 ) )
+        {
+            printf( "\tFailed! Publish %u not flushed\n", ulIndex );
+            return 0;
+        }
+    }
+
+    if( !prvCheckWire( "Coalesced publish" ) )
+    {
+        return 0;
+    }
+
+    printf( "\t%4u byte payload: %.2f exchanges per publish, %.2f coalesced\n",
+            ( unsigned ) xPayloadLength,
+            ( double ) ulDirectSends / TEST_PUBLISHES,
+            ( double ) xMock.ulSends / TEST_PUBLISHES );
+
+    if( xMock.ulSends > ulMaxExchanges * TEST_PUBLISHES )
+    {
+        printf( "\tFailed! %u exchanges for %u publishes\n", xMock.ulSends, TEST_PUBLISHES );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvPublishes( void )
+{
+    printf( "Counting exchanges per publish\n" );
+
+    return prvExchangesPerPublish( 50, 1 ) &&
+           prvExchangesPerPublish( 400, 1 ) &&
+           prvExchangesPerPublish( 1000, 2 ) &&
+           prvExchangesPerPublish( 2000, 2 );
+}
+
+static int prvFull( void )
+{
+    uint8_t ucData[ 50 ];
+    uint32_t ulIndex;
+
+    printf( "Sending when the buffer fills up\n" );
+    prvReset();
+    memset( ucData, 0x3C, sizeof( ucData ) );
+
+    for( ulIndex = 0; ulIndex < 100; ulIndex++ )
+    {
+        if( SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 ) != sizeof( ucData ) )
+        {
+            printf( "\tFailed! Write %u not taken\n", ulIndex );
+            return 0;
+        }
+
+        memcpy( ucExpected + xExpectedLength, ucData, sizeof( ucData ) );
+        xExpectedLength += sizeof( ucData );
+    }
+
+    /* 5000 bytes, four full buffers and 200 held. */
+    if( ( xMock.ulSends != 4 ) || ( xCoalescer.xStats.ulFullFlushes != 4 ) || ( SendCoalescer_Pending( &xCoalescer ) != 200 ) )
+    {
+        printf( "\tFailed! %u sends, %u full, %u held\n", xMock.ulSends, xCoalescer.xStats.ulFullFlushes,
+                ( unsigned ) SendCoalescer_Pending( &xCoalescer ) );
+        return 0;
+    }
+
+    if( ( SendCoalescer_Flush( &xCoalescer ) != 0 ) || ( xMock.ulSends != 5 ) )
+    {
+        printf( "\tFailed! Last 200 bytes not sent in one\n" );
+        return 0;
+    }
+
+    return prvCheckWire( "Full buffer" );
+}
+
+static int prvLarge( void )
+{
+    uint8_t ucData[ 3000 ];
+
+    printf( "Sending records larger than the buffer\n" );
+    prvReset();
+    memset( ucData, 0x42, sizeof( ucData ) );
+
+    /* Empty buffer, straight to the socket. */
+    if( ( SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 ) != sizeof( ucData ) ) ||
+        ( xMock.ulSends != 1 ) || ( SendCoalescer_Pending( &xCoalescer ) != 0 ) )
+    {
+        printf( "\tFailed! Large record into an empty buffer not sent at once\n" );
+        return 0;
+    }
+
+    /* Held bytes go first. */
+    if( ( SendCoalescer_Write( &xCoalescer, ucData, 10, 0 ) != 10 ) ||
+        ( SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 ) != sizeof( ucData ) ) ||
+        ( xMock.ulSends != 3 ) || ( SendCoalescer_Pending( &xCoalescer ) != 0 ) )
+    {
+        printf( "\tFailed! %u sends for held bytes and a large record\n", xMock.ulSends );
+        return 0;
+    }
+
+    memcpy( ucExpected, ucData, sizeof( ucData ) );
+    memcpy( ucExpected + sizeof( ucData ), ucData, 10 );
+    memcpy( ucExpected + sizeof( ucData ) + 10, ucData, sizeof( ucData ) );
+    xExpectedLength = 2 * sizeof( ucData ) + 10;
+
+    return prvCheckWire( "Large record" );
+}
+
+static int prvDeadline( void )
+{
+    uint8_t ucData[ 10 ] = { 0 };
+    uint32_t ulStart = 0xFFFFFFFEu;
+
+    printf( "Sending at the deadline across the tick wrap\n" );
+    prvReset();
+
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), ulStart );
+
+    /* Later writes do not move the deadline. */
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), ulStart + 3 );
+
+    if( ( SendCoalescer_FlushIfDue( &xCoalescer, ulStart + TEST_DEADLINE_TICKS - 1 ) != 20 ) || ( xMock.ulSends != 0 ) )
+    {
+        printf( "\tFailed! Sent before the deadline\n" );
+        return 0;
+    }
+
+    if( ( SendCoalescer_FlushIfDue( &xCoalescer, ulStart + TEST_DEADLINE_TICKS ) != 0 ) || ( xMock.ulSends != 1 ) ||
+        ( xCoalescer.xStats.ulDeadlineFlushes != 1 ) )
+    {
+        printf( "\tFailed! Not sent at the deadline\n" );
+        return 0;
+    }
+
+    /* Held bytes past the deadline go out before a write is added. */
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 100 );
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 100 + TEST_DEADLINE_TICKS );
+
+    if( ( xMock.ulSends != 2 ) || ( SendCoalescer_Pending( &xCoalescer ) != 10 ) )
+    {
+        printf( "\tFailed! Overdue bytes not sent by the next write\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvTimeoutsAndErrors( void )
+{
+    uint8_t ucData[ 700 ];
+
+    printf( "Checking partial sends, timeouts and errors\n" );
+    prvReset();
+    memset( ucData, 0x11, sizeof( ucData ) );
+    xMock.xMaxSend = 256;
+
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 );
+
+    if( ( SendCoalescer_Flush( &xCoalescer ) != 0 ) || ( xMock.ulSends != 3 ) )
+    {
+        printf( "\tFailed! %u sends for 700 bytes at 256 a send\n", xMock.ulSends );
+        return 0;
+    }
+
+    /* The third write does not fit, the held bytes time out, then the full
+     * buffer does. */
+    ( void ) SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 );
+    xMock.ulTimeouts = 2;
+
+    if( SendCoalescer_Write( &xCoalescer, ucData, sizeof( ucData ), 0 ) != 500 )
+    {
+        printf( "\tFailed! Write not cut to the room left\n" );
+        return 0;
+    }
+
+    xMock.ulTimeouts = 1;
+
+    if( ( SendCoalescer_Write( &xCoalescer, ucData, 200, 0 ) != 0 ) || ( SendCoalescer_Pending( &xCoalescer ) != 1200 ) )
+    {
+        printf( "\tFailed! Write taken into a full buffer\n" );
+        return 0;
+    }
+
+    xMock.ulTimeouts = 1;
+
+    if( SendCoalescer_Flush( &xCoalescer ) != 1200 )
+    {
+        printf( "\tFailed! Timed out flush did not keep the bytes\n" );
+        return 0;
+    }
+
+    xMock.lError = -1;
+
+    if( ( SendCoalescer_Flush( &xCoalescer ) != -1 ) || ( SendCoalescer_Write( &xCoalescer, ucData, 1, 0 ) != -1 ) ||
+        ( SendCoalescer_FlushIfDue( &xCoalescer, 1000 ) != -1 ) )
+    {
+        printf( "\tFailed! Send error not kept\n" );
+        return 0;
+    }
+
+    memcpy( ucExpected, ucData, sizeof( ucData ) );
+    xExpectedLength = sizeof( ucData );
+
+    return prvCheckWire( "Partial sends" );
+}
+
+static int prvRandom( void )
+{
+    uint8_t ucData[ 1500 ];
+    uint32_t ulIndex;
+    uint32_t ulTick = 0;
+    size_t xLength;
+    int32_t lTaken;
+
+    printf( "Checking random writes reach the socket in order\n" );
+    prvReset();
+    srand( 22 );
+
+    for( ulIndex = 0; ulIndex < TEST_RANDOM_WRITES; ulIndex++ )
+    {
+        xLength = ( rand() % 8 == 0 ) ? ( size_t ) ( rand() % sizeof( ucData ) ) : ( size_t ) ( rand() % 64 );
+        memset( ucData, ( int ) ( ulIndex & 0xFF ), xLength );
+        ucData[ 0 ] = ( uint8_t ) rand();
+        xMock.xMaxSend = ( rand() % 4 == 0 ) ? ( size_t ) ( 1 + rand() % 700 ) : TEST_WIRE_SIZE;
+        xMock.ulTimeouts = ( rand() % 16 == 0 ) ? 1 : 0;
+        ulTick += ( uint32_t ) ( rand() % 3 );
+
+        if( rand() % 4 == 0 )
+        {
+            ( void ) SendCoalescer_FlushIfDue( &xCoalescer, ulTick );
+        }
+
+        lTaken = SendCoalescer_Write( &xCoalescer, ucData, xLength, ulTick );
+
+        if( ( lTaken < 0 ) || ( ( size_t ) lTaken > xLength ) || ( xExpectedLength + ( size_t ) lTaken > TEST_WIRE_SIZE ) )
+        {
+            printf( "\tFailed! Write of %u returned %d\n", ( unsigned ) xLength, ( int ) lTaken );
+            return 0;
+        }
+
+        memcpy( ucExpected + xExpectedLength, ucData, ( size_t ) lTaken );
+        xExpectedLength += ( size_t ) lTaken;
+
+        if( SendCoalescer_Pending( &xCoalescer ) > sizeof( ucBuffer ) )
+        {
+            printf( "\tFailed! %u bytes held\n", ( unsigned ) SendCoalescer_Pending( &xCoalescer ) );
+            return 0;
+        }
+    }
+
+    xMock.xMaxSend = TEST_WIRE_SIZE;
+    xMock.ulTimeouts = 0;
+
+    if( SendCoalescer_Flush( &xCoalescer ) != 0 )
+    {
+        printf( "\tFailed! Last bytes not sent\n" );
+        return 0;
+    }
+
+    printf( "\t%u writes in %u sends\n", xCoalescer.xStats.ulWrites, xMock.ulSends );
+
+    return prvCheckWire( "Random writes" );
+}
+
+int vStartTestTask( void )
+{
+    int xResult;
+
+    xMock.pucWire = malloc( TEST_WIRE_SIZE );
+
+    if( xMock.pucWire == NULL )
+    {
+        printf( "\tFailed! No memory for the wire\n" );
+        return TEST_SEND_COALESCER_FAIL;
+    }
+
+    xResult = prvPublishes() &&
+              prvFull() &&
+              prvLarge() &&
+              prvDeadline() &&
+              prvTimeoutsAndErrors() &&
+              prvRandom();
+
+    free( xMock.pucWire );
+
+    return xResult ? TEST_SEND_COALESCER_SUCCESS : TEST_SEND_COALESCER_FAIL;
+}
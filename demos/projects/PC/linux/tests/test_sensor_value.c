@@ -0,0 +1,230 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE FIXED POINT SENSOR PIPELINE
+ *
+ * Built with SENSOR_VALUE_FIXED_POINT=1. Runs Q16.16 sample streams through
+ * the integer statistics and compares every result, and the JSON text made
+ * from it, with the same statistics computed in double precision. The text
+ * has to be identical.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "running_stats.h"
+#include "sensor_value.h"
+
+#define TEST_SENSOR_VALUE_SUCCESS    0
+#define TEST_SENSOR_VALUE_FAIL       1
+
+#define TEST_WINDOW                  30
+#define TEST_SAMPLES                 200000
+#define TEST_FRACTIONAL_DIGITS       SENSOR_VALUE_DECIMALS
+
+/* The last Q16.16 bit, the most an average or median may be moved to keep its digits. */
+#define TEST_LSB                     ( 1.0 / 65536.0 )
+
+#if !SENSOR_VALUE_FIXED_POINT
+    #error "This harness checks the fixed point path"
+#endif
+
+static int32_t lWindow[ TEST_WINDOW ];
+static sensor_value_t xSamples[ TEST_WINDOW ];
+static running_stats_node_t xNodes[ TEST_WINDOW ];
+static running_stats_t xStats;
+
+static uint32_t ulTextsExact = 0;
+
+/* Double path reference: the same statistics as the getters had before, on the same raw samples. */
+static void prvReference( int32_t lValidMin,
+                          int32_t lValidMax,
+                          int32_t lLatest,
+                          double * pxAvg,
+                          double * pxMin,
+                          double * pxMax,
+                          double * pxMedian )
+{
+    double xSortedReference[ TEST_WINDOW ];
+    double xTotal = 0.0;
+    uint32_t ulValid = 0;
+    uint32_t i;
+    uint32_t j;
+
+    for( i = 0; i < TEST_WINDOW; i++ )
+    {
+        double xValue = ( double ) lWindow[ i ] / 65536.0;
+
+        if( ( lWindow[ i ] >= lValidMin ) && ( lWindow[ i ] <= lValidMax ) )
+        {
+            xTotal += xValue;
+            ulValid++;
+        }
+
+        /* Insertion sort, the window is small. */
+        for( j = i; ( j > 0 ) && ( xSortedReference[ j - 1 ] > xValue ); j-- )
+        {
+            xSortedReference[ j ] = xSortedReference[ j - 1 ];
+        }
+
+        xSortedReference[ j ] = xValue;
+    }
+
+    *pxMin = xSortedReference[ 0 ];
+    *pxMax = xSortedReference[ TEST_WINDOW - 1 ];
+    *pxMedian = ( xSortedReference[ TEST_WINDOW / 2 - 1 ] + xSortedReference[ TEST_WINDOW / 2 ] ) / 2.0;
+    *pxAvg = ( ulValid != 0 ) ? xTotal / ( double ) ulValid : ( double ) lLatest / 65536.0;
+}
+
+/* How the JSON writer prints a double: truncated to the digits asked for, no trailing zeros. */
+static void prvDoubleToText( double xValue,
+                             char * pcBuffer,
+                             size_t xBufferSize )
+{
+    int64_t llScaled = ( int64_t ) ( xValue * 1000.0 );
+    int64_t llMagnitude = ( llScaled < 0 ) ? -llScaled : llScaled;
+    int32_t lLength;
+
+    lLength = snprintf( pcBuffer, xBufferSize, "%s%lld.%03lld", ( llScaled < 0 ) ? "-" : "",
+                        ( long long ) ( llMagnitude / 1000 ), ( long long ) ( llMagnitude % 1000 ) );
+
+    while( pcBuffer[ lLength - 1 ] == '0' )
+    {
+        pcBuffer[ --lLength ] = '\0';
+    }
+
+    if( pcBuffer[ lLength - 1 ] == '.' )
+    {
+        pcBuffer[ --lLength ] = '\0';
+    }
+}
+
+/* Min and max are exact. Average and median may differ by a bit, but all of them must print the same. */
+static int prvCompare( const char * pcWhat,
+                       sensor_value_t xFixed,
+                       double xDouble,
+                       int xExact )
+{
+    char cFixedText[ SENSOR_VALUE_TEXT_LENGTH ];
+    char cDoubleText[ 32 ];
+    double xDifference = fabs( ( double ) xFixed / 65536.0 - xDouble );
+
+    if( xDifference > ( xExact ? 0.0 : TEST_LSB ) )
+    {
+        printf( "\tFailed! %s %.9f fixed vs %.9f double\n", pcWhat, ( double ) xFixed / 65536.0, xDouble );
+        return 0;
+    }
+
+    if( sensor_value_to_text( xFixed, TEST_FRACTIONAL_DIGITS, cFixedText, sizeof( cFixedText ) ) == 0 )
+    {
+        printf( "\tFailed! %s does not fit the text buffer\n", pcWhat );
+        return 0;
+    }
+
+    prvDoubleToText( xDouble, cDoubleText, sizeof( cDoubleText ) );
+
+    if( strcmp( cFixedText, cDoubleText ) != 0 )
+    {
+        printf( "\tFailed! %s printed as %s, double path prints %s\n", pcWhat, cFixedText, cDoubleText );
+        return 0;
+    }
+
+    ulTextsExact++;
+
+    return 1;
+}
+
+static int prvRun( int32_t lCentre,
+                   int32_t lSpread,
+                   int32_t lValidMin,
+                   int32_t lValidMax )
+{
+    sensor_stats_t xResult;
+    double xAvg;
+    double xMin;
+    double xMax;
+    double xMedian;
+    uint32_t ulNext = 0;
+    uint32_t i;
+
+    memset( lWindow, 0, sizeof( lWindow ) );
+    running_stats_init( &xStats, xSamples, xNodes, TEST_WINDOW, lValidMin, lValidMax, 0 );
+
+    for( i = 0; i < TEST_SAMPLES; i++ )
+    {
+        int32_t lValue = lCentre + ( int32_t ) ( rand() % ( 2 * lSpread + 1 ) ) - lSpread;
+
+        running_stats_replace( &xStats, ( uint16_t ) ulNext, lValue );
+        lWindow[ ulNext ] = lValue;
+        ulNext = ( ulNext + 1 ) % TEST_WINDOW;
+
+        running_stats_get( &xStats, &xResult );
+        prvReference( lValidMin, lValidMax, lValue, &xAvg, &xMin, &xMax, &xMedian );
+
+        if( !prvCompare( "min", xResult.min, xMin, 1 ) ||
+            !prvCompare( "max", xResult.max, xMax, 1 ) ||
+            !prvCompare( "avg", xResult.avg, xAvg, 0 ) ||
+            !prvCompare( "median", xResult.median, xMedian, 0 ) )
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int vStartTestTask( void )
+{
+    char cText[ SENSOR_VALUE_TEXT_LENGTH ];
+
+    srand( 1 );
+
+    printf( "Checking number formatting\n" );
+    sensor_value_to_text( SENSOR_VALUE( -0.0625 ), 3, cText, sizeof( cText ) );
+
+    if( strcmp( cText, "-0.062" ) != 0 )
+    {
+        printf( "\tFailed! -0.0625 printed as %s\n", cText );
+        return TEST_SENSOR_VALUE_FAIL;
+    }
+
+    printf( "Checking unsigned raw values\n" );
+
+    if( ( SENSOR_VALUE_FROM_UQ16( 0xFFFFFFFFU ) != INT32_MAX ) ||
+        ( SENSOR_VALUE_FROM_UQ16( 0x80000000U ) != INT32_MAX ) ||
+        ( SENSOR_VALUE_FROM_UQ16( 0x7FFFFFFFU ) != INT32_MAX ) ||
+        ( SENSOR_VALUE_FROM_UQ16( 0x00960000U ) != SENSOR_VALUE( 150 ) ) )
+    {
+        printf( "\tFailed! 0xFFFFFFFF read as 0x%08x\n", ( unsigned ) SENSOR_VALUE_FROM_UQ16( 0xFFFFFFFFU ) );
+        return TEST_SENSOR_VALUE_FAIL;
+    }
+
+    printf( "Comparing heater temperatures (0..150 C)\n" );
+
+    if( !prvRun( SENSOR_VALUE( 100 ), SENSOR_VALUE( 60 ), SENSOR_VALUE( 0 ), SENSOR_VALUE( 150 ) ) )
+    {
+        return TEST_SENSOR_VALUE_FAIL;
+    }
+
+    printf( "Comparing vacuum readings (0..1.2 bar, some below range)\n" );
+
+    if( !prvRun( SENSOR_VALUE( 0.5 ), SENSOR_VALUE( 0.8 ), SENSOR_VALUE( 0 ), SENSOR_VALUE( 1.2 ) ) )
+    {
+        return TEST_SENSOR_VALUE_FAIL;
+    }
+
+    printf( "Comparing ambient temperatures (-20..120 C, around zero)\n" );
+
+    if( !prvRun( SENSOR_VALUE( 0 ), SENSOR_VALUE( 25 ), SENSOR_VALUE( -20 ), SENSOR_VALUE( 120 ) ) )
+    {
+        return TEST_SENSOR_VALUE_FAIL;
+    }
+
+    printf( "\t%u values printed identically\n", ulTextsExact );
+
+    return TEST_SENSOR_VALUE_SUCCESS;
+}
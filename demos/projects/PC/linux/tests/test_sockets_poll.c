@@ -0,0 +1,695 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR SOCKETS_POLL
+ *
+ * Runs the FreeRTOS+TCP sockets wrapper over a simulated stack. The Linux port
+ * of FreeRTOS+TCP needs a pcap device, so the socket calls the wrapper makes
+ * are implemented here on virtual time, FreeRTOS_select() included. Checks the
+ * events reported for reading, writing and closed sockets, zero, finite and
+ * endless timeouts, and that the socket sets are freed. Then an MQTT and an
+ * HTTP connection are served by one task, once by receiving on each in turn
+ * and once by polling both, and the delay until each message is read compared.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sockets_wrapper.h"
+#include "sockets_dns_cache.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+#include "FreeRTOS_DNS.h"
+
+#define TEST_SOCKETS_POLL_SUCCESS    0
+#define TEST_SOCKETS_POLL_FAIL       1
+
+#define TEST_MAX_SOCKETS             4
+#define TEST_MAX_MESSAGES            512
+#define TEST_NOT_CLOSED              portMAX_DELAY
+#define TEST_RECV_TIMEOUT            pdMS_TO_TICKS( 100 ) /* Transport receive timeout of the samples */
+#define TEST_MQTT_MESSAGES           300
+#define TEST_HTTP_MESSAGES           60
+#define TEST_TRAFFIC_TICKS           pdMS_TO_TICKS( 60000 )
+
+/* A message from the peer. */
+typedef struct TestMessage
+{
+    TickType_t xArrival;
+    size_t xLength;
+} TestMessage_t;
+
+/* A connection of the simulated stack. */
+struct xSOCKET
+{
+    BaseType_t xOpen;
+    BaseType_t xConnected;
+    TickType_t xClosed;         /* When the peer closes, TEST_NOT_CLOSED for never */
+    TickType_t xRecvTimeout;
+    TestMessage_t xMessages[ TEST_MAX_MESSAGES ];
+    size_t xMessageCount;
+    size_t xNextMessage;        /* First message not read yet */
+    struct xSOCKET_SET * pxSet; /* Set the socket is in, one at a time */
+    EventBits_t xSelectBits;
+    EventBits_t xReadyBits;
+};
+
+/* A socket set of the simulated stack. */
+struct xSOCKET_SET
+{
+    BaseType_t xInUse;
+};
+
+static struct xSOCKET xSockets[ TEST_MAX_SOCKETS ];
+static struct xSOCKET_SET xSet;
+static TickType_t xNow;
+static uint32_t ulSetsCreated;
+static uint32_t ulSetsDeleted;
+static BaseType_t xFailCreateSet;
+static BaseType_t xBlockedForever;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvIsClosed( struct xSOCKET * pxSocket,
+                               TickType_t xTime )
+{
+    return ( pxSocket->xClosed != TEST_NOT_CLOSED ) && ( pxSocket->xClosed <= xTime );
+}
+
+/* Events of the socket at the time. */
+static EventBits_t prvEventsAt( struct xSOCKET * pxSocket,
+                                TickType_t xTime )
+{
+    EventBits_t xBits = 0;
+
+    if( ( pxSocket->xNextMessage < pxSocket->xMessageCount ) &&
+        ( pxSocket->xMessages[ pxSocket->xNextMessage ].xArrival <= xTime ) )
+    {
+        xBits |= eSELECT_READ;
+    }
+
+    if( prvIsClosed( pxSocket, xTime ) )
+    {
+        xBits |= eSELECT_READ | eSELECT_EXCEPT;
+    }
+    else if( pxSocket->xConnected )
+    {
+        xBits |= eSELECT_WRITE;
+    }
+
+    return xBits;
+}
+
+/* When the asked events are next ready, portMAX_DELAY for never. */
+static TickType_t prvNextEvent( struct xSOCKET * pxSocket,
+                                EventBits_t xBits )
+{
+    TickType_t xNext = portMAX_DELAY;
+    TickType_t xTime;
+
+    if( ( prvEventsAt( pxSocket, xNow ) & xBits ) != 0 )
+    {
+        return xNow;
+    }
+
+    if( ( ( xBits & eSELECT_READ ) != 0 ) && ( pxSocket->xNextMessage < pxSocket->xMessageCount ) )
+    {
+        xNext = pxSocket->xMessages[ pxSocket->xNextMessage ].xArrival;
+    }
+
+    if( ( ( xBits & ( eSELECT_READ | eSELECT_EXCEPT ) ) != 0 ) && ( pxSocket->xClosed != TEST_NOT_CLOSED ) )
+    {
+        xTime = pxSocket->xClosed;
+
+        if( xTime < xNext )
+        {
+            xNext = xTime;
+        }
+    }
+
+    return xNext;
+}
+
+/*-----------------------------------------------------------*/
+
+Socket_t FreeRTOS_socket( BaseType_t xDomain,
+                          BaseType_t xType,
+                          BaseType_t xProtocol )
+{
+    size_t xIndex;
+
+    ( void ) xDomain;
+    ( void ) xType;
+    ( void ) xProtocol;
+
+    for( xIndex = 0; xIndex < TEST_MAX_SOCKETS; xIndex++ )
+    {
+        if( !xSockets[ xIndex ].xOpen )
+        {
+            memset( &xSockets[ xIndex ], 0, sizeof( xSockets[ xIndex ] ) );
+            xSockets[ xIndex ].xOpen = pdTRUE;
+            xSockets[ xIndex ].xClosed = TEST_NOT_CLOSED;
+            xSockets[ xIndex ].xRecvTimeout = portMAX_DELAY;
+
+            return &xSockets[ xIndex ];
+        }
+    }
+
+    return FREERTOS_INVALID_SOCKET;
+}
+
+BaseType_t FreeRTOS_connect( Socket_t xClientSocket,
+                             struct freertos_sockaddr * pxAddress,
+                             socklen_t xAddressLength )
+{
+    ( void ) pxAddress;
+    ( void ) xAddressLength;
+
+    xClientSocket->xConnected = pdTRUE;
+
+    return 0;
+}
+
+BaseType_t FreeRTOS_send( Socket_t xSocket,
+                          const void * pvBuffer,
+                          size_t uxDataLength,
+                          BaseType_t xFlags )
+{
+    ( void ) pvBuffer;
+    ( void ) xFlags;
+
+    return prvIsClosed( xSocket, xNow ) ? -128 : ( BaseType_t ) uxDataLength;
+}
+
+/* Takes the next message, whole, waiting for it up to the receive timeout. */
+BaseType_t FreeRTOS_recv( Socket_t xSocket,
+                          void * pvBuffer,
+                          size_t uxBufferLength,
+                          BaseType_t xFlags )
+{
+    TestMessage_t * pxMessage;
+    TickType_t xNext = prvNextEvent( xSocket, eSELECT_READ );
+
+    ( void ) xFlags;
+
+    if( ( xNext == portMAX_DELAY ) || ( xNext - xNow > xSocket->xRecvTimeout ) )
+    {
+        if( xSocket->xRecvTimeout == portMAX_DELAY )
+        {
+            xBlockedForever = pdTRUE;
+        }
+        else
+        {
+            xNow += xSocket->xRecvTimeout;
+        }
+
+        return 0;
+    }
+
+    xNow = xNext;
+
+    if( ( xSocket->xNextMessage < xSocket->xMessageCount ) &&
+        ( xSocket->xMessages[ xSocket->xNextMessage ].xArrival <= xNow ) )
+    {
+        pxMessage = &xSocket->xMessages[ xSocket->xNextMessage++ ];
+        memset( pvBuffer, 0xA5, uxBufferLength < pxMessage->xLength ? uxBufferLength : pxMessage->xLength );
+
+        return ( BaseType_t ) pxMessage->xLength;
+    }
+
+    /* Closed by the peer. */
+    return -128;
+}
+
+BaseType_t FreeRTOS_shutdown( Socket_t xSocket,
+                              BaseType_t xHow )
+{
+    ( void ) xHow;
+
+    xSocket->xClosed = xNow;
+
+    return 0;
+}
+
+BaseType_t FreeRTOS_closesocket( Socket_t xSocket )
+{
+    xSocket->xOpen = pdFALSE;
+
+    return 1;
+}
+
+BaseType_t FreeRTOS_setsockopt( Socket_t xSocket,
+                                int32_t lLevel,
+                                int32_t lOptionName,
+                                const void * pvOptionValue,
+                                size_t uxOptionLength )
+{
+    ( void ) lLevel;
+    ( void ) uxOptionLength;
+
+    if( lOptionName == FREERTOS_SO_RCVTIMEO )
+    {
+        xSocket->xRecvTimeout = *( ( const TickType_t * ) pvOptionValue );
+    }
+
+    return 0;
+}
+
+uint32_t FreeRTOS_gethostbyname( const char * pcHostName )
+{
+    ( void ) pcHostName;
+
+    return 0x0100007FUL;
+}
+
+/* The DNS cache needs the scheduler, lookups go straight to the resolver. */
+uint32_t SocketsDnsCache_GetHostByName( const char * pcHostName,
+                                        SocketsDnsResolve_t xResolve )
+{
+    return xResolve( pcHostName );
+}
+
+void SocketsDnsCache_ConnectFailed( const char * pcHostName,
+                                    uint32_t ulAddress )
+{
+    ( void ) pcHostName;
+    ( void ) ulAddress;
+}
+
+SocketSet_t FreeRTOS_CreateSocketSet( void )
+{
+    if( xFailCreateSet || xSet.xInUse )
+    {
+        return NULL;
+    }
+
+    xSet.xInUse = pdTRUE;
+    ulSetsCreated++;
+
+    return &xSet;
+}
+
+void FreeRTOS_DeleteSocketSet( SocketSet_t xSocketSet )
+{
+    xSocketSet->xInUse = pdFALSE;
+    ulSetsDeleted++;
+}
+
+void FreeRTOS_FD_SET( Socket_t xSocket,
+                      SocketSet_t xSocketSet,
+                      EventBits_t xBitsToSet )
+{
+    if( ( xSocket->pxSet == NULL ) || ( xSocket->pxSet == xSocketSet ) )
+    {
+        xSocket->pxSet = xSocketSet;
+        xSocket->xSelectBits |= xBitsToSet;
+    }
+}
+
+void FreeRTOS_FD_CLR( Socket_t xSocket,
+                      SocketSet_t xSocketSet,
+                      EventBits_t xBitsToClear )
+{
+    if( xSocket->pxSet == xSocketSet )
+    {
+        xSocket->xSelectBits &= ~xBitsToClear;
+        xSocket->xReadyBits &= ~xBitsToClear;
+
+        if( xSocket->xSelectBits == 0 )
+        {
+            xSocket->pxSet = NULL;
+        }
+    }
+}
+
+EventBits_t FreeRTOS_FD_ISSET( Socket_t xSocket,
+                               SocketSet_t xSocketSet )
+{
+    return ( xSocket->pxSet == xSocketSet ) ? xSocket->xReadyBits : 0;
+}
+
+/* Blocks in virtual time until an asked event or the timeout. */
+BaseType_t FreeRTOS_select( SocketSet_t xSocketSet,
+                            TickType_t xBlockTimeTicks )
+{
+    TickType_t xNext = portMAX_DELAY;
+    TickType_t xTime;
+    BaseType_t xReady = 0;
+    size_t xIndex;
+
+    for( xIndex = 0; xIndex < TEST_MAX_SOCKETS; xIndex++ )
+    {
+        if( xSockets[ xIndex ].pxSet == xSocketSet )
+        {
+            xTime = prvNextEvent( &xSockets[ xIndex ], xSockets[ xIndex ].xSelectBits );
+
+            if( xTime < xNext )
+            {
+                xNext = xTime;
+            }
+        }
+    }
+
+    if( ( xNext == portMAX_DELAY ) || ( ( xBlockTimeTicks != portMAX_DELAY ) && ( xNext - xNow > xBlockTimeTicks ) ) )
+    {
+        if( xBlockTimeTicks == portMAX_DELAY )
+        {
+            xBlockedForever = pdTRUE;
+        }
+        else
+        {
+            xNow += xBlockTimeTicks;
+        }
+
+        return 0;
+    }
+
+    xNow = xNext;
+
+    for( xIndex = 0; xIndex < TEST_MAX_SOCKETS; xIndex++ )
+    {
+        if( xSockets[ xIndex ].pxSet == xSocketSet )
+        {
+            xSockets[ xIndex ].xReadyBits = prvEventsAt( &xSockets[ xIndex ], xNow ) & xSockets[ xIndex ].xSelectBits;
+
+            if( xSockets[ xIndex ].xReadyBits != 0 )
+            {
+                xReady++;
+            }
+        }
+    }
+
+    return xReady;
+}
+
+/*-----------------------------------------------------------*/
+
+static SocketHandle prvConnect( void )
+{
+    SocketHandle xSocket = Sockets_Open();
+    TickType_t xTimeout = TEST_RECV_TIMEOUT;
+
+    if( ( xSocket == SOCKETS_INVALID_SOCKET ) ||
+        ( Sockets_Connect( xSocket, "localhost", 8883 ) != 0 ) ||
+        ( Sockets_SetSockOpt( xSocket, SOCKETS_SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) ) != SOCKETS_ERROR_NONE ) )
+    {
+        printf( "\tFailed! Simulated socket not connected\n" );
+        return SOCKETS_INVALID_SOCKET;
+    }
+
+    return xSocket;
+}
+
+static void prvReset( void )
+{
+    memset( xSockets, 0, sizeof( xSockets ) );
+    memset( &xSet, 0, sizeof( xSet ) );
+    xNow = 1000;
+    ulSetsCreated = 0;
+    ulSetsDeleted = 0;
+    xFailCreateSet = pdFALSE;
+    xBlockedForever = pdFALSE;
+}
+
+static void prvAddMessage( SocketHandle xSocket,
+                           TickType_t xArrival,
+                           size_t xLength )
+{
+    struct xSOCKET * pxSocket = ( struct xSOCKET * ) xSocket;
+
+    pxSocket->xMessages[ pxSocket->xMessageCount ].xArrival = xArrival;
+    pxSocket->xMessages[ pxSocket->xMessageCount ].xLength = xLength;
+    pxSocket->xMessageCount++;
+}
+
+/* Every set freed and no socket left in one. */
+static int prvCheckSetsFreed( void )
+{
+    size_t xIndex;
+
+    if( ( ulSetsCreated != ulSetsDeleted ) || xSet.xInUse )
+    {
+        printf( "\tFailed! %u sets created, %u deleted\n", ulSetsCreated, ulSetsDeleted );
+        return 0;
+    }
+
+    for( xIndex = 0; xIndex < TEST_MAX_SOCKETS; xIndex++ )
+    {
+        if( xSockets[ xIndex ].pxSet != NULL )
+        {
+            printf( "\tFailed! Socket %u left in a set\n", ( unsigned ) xIndex );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int prvArguments( void )
+{
+    SocketsPollEntry_t xEntry = { 0 };
+
+    printf( "Checking arguments\n" );
+    prvReset();
+    xEntry.xSocket = prvConnect();
+    xEntry.ulEvents = SOCKETS_POLL_READ;
+
+    if( ( Sockets_Poll( NULL, 1, 0 ) != SOCKETS_EINVAL ) ||
+        ( Sockets_Poll( &xEntry, 0, 0 ) != SOCKETS_EINVAL ) )
+    {
+        printf( "\tFailed! Missing entries not rejected\n" );
+        return 0;
+    }
+
+    xFailCreateSet = pdTRUE;
+
+    if( Sockets_Poll( &xEntry, 1, 0 ) != SOCKETS_ENOMEM )
+    {
+        printf( "\tFailed! No set not reported\n" );
+        return 0;
+    }
+
+    return prvCheckSetsFreed();
+}
+
+static int prvTimeouts( void )
+{
+    SocketsPollEntry_t xEntries[ 2 ] = { 0 };
+    BaseType_t xResult;
+
+    printf( "Checking timeouts\n" );
+    prvReset();
+    xEntries[ 0 ].xSocket = prvConnect();
+    xEntries[ 0 ].ulEvents = SOCKETS_POLL_READ;
+    xEntries[ 1 ].xSocket = prvConnect();
+    xEntries[ 1 ].ulEvents = SOCKETS_POLL_READ;
+    prvAddMessage( xEntries[ 1 ].xSocket, xNow + 5000, 100 );
+
+    if( ( ( xResult = Sockets_Poll( xEntries, 2, 0 ) ) != 0 ) || ( xNow != 1000 ) )
+    {
+        printf( "\tFailed! Zero timeout returned %d after %u ticks\n", ( int ) xResult, xNow - 1000 );
+        return 0;
+    }
+
+    if( ( ( xResult = Sockets_Poll( xEntries, 2, 100 ) ) != 0 ) || ( xNow != 1100 ) ||
+        ( xEntries[ 0 ].ulReady != 0 ) || ( xEntries[ 1 ].ulReady != 0 ) )
+    {
+        printf( "\tFailed! Timeout returned %d after %u ticks\n", ( int ) xResult, xNow - 1000 );
+        return 0;
+    }
+
+    if( ( ( xResult = Sockets_Poll( xEntries, 2, portMAX_DELAY ) ) != 1 ) || ( xNow != 6000 ) ||
+        ( xEntries[ 1 ].ulReady != SOCKETS_POLL_READ ) || xBlockedForever )
+    {
+        printf( "\tFailed! Endless wait returned %d at %u\n", ( int ) xResult, xNow );
+        return 0;
+    }
+
+    return prvCheckSetsFreed();
+}
+
+static int prvEvents( void )
+{
+    SocketsPollEntry_t xEntries[ 3 ] = { 0 };
+    BaseType_t xResult;
+
+    printf( "Checking events\n" );
+    prvReset();
+    xEntries[ 0 ].xSocket = prvConnect();
+    xEntries[ 0 ].ulEvents = SOCKETS_POLL_READ;
+    xEntries[ 1 ].xSocket = prvConnect();
+    xEntries[ 1 ].ulEvents = SOCKETS_POLL_READ;
+    xEntries[ 2 ].xSocket = prvConnect();
+    xEntries[ 2 ].ulEvents = SOCKETS_POLL_READ;
+
+    /* Only the socket with data. */
+    prvAddMessage( xEntries[ 1 ].xSocket, xNow + 30, 100 );
+
+    if( ( ( xResult = Sockets_Poll( xEntries, 3, 1000 ) ) != 1 ) || ( xNow != 1030 ) ||
+        ( xEntries[ 0 ].ulReady != 0 ) || ( xEntries[ 1 ].ulReady != SOCKETS_POLL_READ ) ||
+        ( xEntries[ 2 ].ulReady != 0 ) )
+    {
+        printf( "\tFailed! Data on one socket returned %d at %u\n", ( int ) xResult, xNow );
+        return 0;
+    }
+
+    /* Still there until read, then with the next at the same time. */
+    prvAddMessage( xEntries[ 0 ].xSocket, xNow, 100 );
+
+    if( ( xResult = Sockets_Poll( xEntries, 3, 1000 ) ) != 2 )
+    {
+        printf( "\tFailed! Data on two sockets returned %d\n", ( int ) xResult );
+        return 0;
+    }
+
+    ( void ) Sockets_Recv( xEntries[ 0 ].xSocket, ( uint8_t * ) &xResult, sizeof( xResult ) );
+    ( void ) Sockets_Recv( xEntries[ 1 ].xSocket, ( uint8_t * ) &xResult, sizeof( xResult ) );
+
+    /* Writing is ready at once, reading is not asked for. */
+    xEntries[ 2 ].ulEvents = SOCKETS_POLL_WRITE;
+
+    if( ( ( xResult = Sockets_Poll( xEntries, 3, 1000 ) ) != 1 ) || ( xNow != 1030 ) ||
+        ( xEntries[ 2 ].ulReady != SOCKETS_POLL_WRITE ) )
+    {
+        printf( "\tFailed! Writable socket returned %d at %u\n", ( int ) xResult, xNow );
+        return 0;
+    }
+
+    /* A closed socket is reported without asking. */
+    ( ( struct xSOCKET * ) xEntries[ 2 ].xSocket )->xClosed = xNow + 10;
+    xEntries[ 2 ].ulEvents = 0;
+
+    if( ( ( xResult = Sockets_Poll( &xEntries[ 2 ], 1, 1000 ) ) != 1 ) || ( xNow != 1040 ) ||
+        ( xEntries[ 2 ].ulReady != SOCKETS_POLL_ERROR ) )
+    {
+        printf( "\tFailed! Closed socket returned %d at %u\n", ( int ) xResult, xNow );
+        return 0;
+    }
+
+    xEntries[ 2 ].ulEvents = SOCKETS_POLL_READ | SOCKETS_POLL_WRITE;
+
+    if( ( ( xResult = Sockets_Poll( &xEntries[ 2 ], 1, 1000 ) ) != 1 ) ||
+        ( xEntries[ 2 ].ulReady != ( SOCKETS_POLL_READ | SOCKETS_POLL_ERROR ) ) )
+    {
+        printf( "\tFailed! Closed socket gave events %x\n", xEntries[ 2 ].ulReady );
+        return 0;
+    }
+
+    return prvCheckSetsFreed();
+}
+
+/* Schedules the traffic of an MQTT and an HTTP connection. */
+static void prvTraffic( SocketHandle xMqtt,
+                        SocketHandle xHttp )
+{
+    TickType_t xStart = xNow;
+    size_t xIndex;
+
+    srand( 23 );
+
+    /* Cloud to device messages and acks, ordered. */
+    for( xIndex = 0; xIndex < TEST_MQTT_MESSAGES; xIndex++ )
+    {
+        prvAddMessage( xMqtt, xStart + ( TickType_t ) ( ( TEST_TRAFFIC_TICKS * xIndex ) / TEST_MQTT_MESSAGES ) +
+                       ( TickType_t ) ( rand() % 50 ), 64 + ( size_t ) ( rand() % 256 ) );
+    }
+
+    /* Firmware blob chunks. */
+    for( xIndex = 0; xIndex < TEST_HTTP_MESSAGES; xIndex++ )
+    {
+        prvAddMessage( xHttp, xStart + ( TickType_t ) ( ( TEST_TRAFFIC_TICKS * xIndex ) / TEST_HTTP_MESSAGES ) +
+                       ( TickType_t ) ( rand() % 200 ), 1024 );
+    }
+}
+
+/* Delay from arrival until read of the message just taken. */
+static TickType_t prvLatency( SocketHandle xSocket )
+{
+    struct xSOCKET * pxSocket = ( struct xSOCKET * ) xSocket;
+
+    return xNow - pxSocket->xMessages[ pxSocket->xNextMessage - 1 ].xArrival;
+}
+
+static int prvMultiplex( void )
+{
+    SocketsPollEntry_t xEntries[ 2 ] = { 0 };
+    SocketHandle xSockets[ 2 ];
+    uint8_t ucBuffer[ 1024 ];
+    uint64_t ullTotal[ 2 ] = { 0 };
+    TickType_t xMax[ 2 ] = { 0 };
+    TickType_t xLatency;
+    size_t xRead, xIndex;
+    int xPolling;
+
+    printf( "Serving MQTT and HTTP from one task\n" );
+
+    for( xPolling = 0; xPolling < 2; xPolling++ )
+    {
+        prvReset();
+        xSockets[ 0 ] = prvConnect();
+        xSockets[ 1 ] = prvConnect();
+        prvTraffic( xSockets[ 0 ], xSockets[ 1 ] );
+        xRead = 0;
+
+        while( xRead < TEST_MQTT_MESSAGES + TEST_HTTP_MESSAGES )
+        {
+            for( xIndex = 0; xIndex < 2; xIndex++ )
+            {
+                xEntries[ xIndex ].xSocket = xSockets[ xIndex ];
+                xEntries[ xIndex ].ulEvents = SOCKETS_POLL_READ;
+                xEntries[ xIndex ].ulReady = SOCKETS_POLL_READ;
+            }
+
+            /* Polled, or round robin receives on each socket in turn up to its timeout. */
+            if( xPolling && ( Sockets_Poll( xEntries, 2, portMAX_DELAY ) <= 0 ) )
+            {
+                printf( "\tFailed! Poll returned without data at %u\n", xNow );
+                return 0;
+            }
+
+            for( xIndex = 0; xIndex < 2; xIndex++ )
+            {
+                if( ( ( xEntries[ xIndex ].ulReady & SOCKETS_POLL_READ ) != 0 ) &&
+                    ( ( ( struct xSOCKET * ) xSockets[ xIndex ] )->xNextMessage <
+                      ( ( struct xSOCKET * ) xSockets[ xIndex ] )->xMessageCount ) &&
+                    ( Sockets_Recv( xSockets[ xIndex ], ucBuffer, sizeof( ucBuffer ) ) > 0 ) )
+                {
+                    xLatency = prvLatency( xSockets[ xIndex ] );
+                    ullTotal[ xIndex ] += xLatency;
+                    xMax[ xIndex ] = ( xLatency > xMax[ xIndex ] ) ? xLatency : xMax[ xIndex ];
+                    xRead++;
+                }
+            }
+        }
+
+        printf( "\t%s: MQTT read after %.1f ms on average, %u at most, HTTP after %.1f ms, %u at most\n",
+                xPolling ? "Sockets_Poll" : "Round robin ",
+                ( double ) ullTotal[ 0 ] / TEST_MQTT_MESSAGES, xMax[ 0 ],
+                ( double ) ullTotal[ 1 ] / TEST_HTTP_MESSAGES, xMax[ 1 ] );
+
+        if( xPolling && ( ( xMax[ 0 ] != 0 ) || ( xMax[ 1 ] != 0 ) || !prvCheckSetsFreed() ) )
+        {
+            printf( "\tFailed! Polled messages not read on arrival\n" );
+            return 0;
+        }
+
+        ullTotal[ 0 ] = ullTotal[ 1 ] = 0;
+        xMax[ 0 ] = xMax[ 1 ] = 0;
+    }
+
+    return 1;
+}
+
+int vStartTestTask( void )
+{
+    int xResult = prvArguments() &&
+                  prvTimeouts() &&
+                  prvEvents() &&
+                  prvMultiplex();
+
+    return xResult ? TEST_SOCKETS_POLL_SUCCESS : TEST_SOCKETS_POLL_FAIL;
+}
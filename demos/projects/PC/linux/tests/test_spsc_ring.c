@@ -0,0 +1,197 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER RX RING
+ *
+ * A producer thread (the uart interrupt on target) and a consumer thread (the
+ * uart task) hammer a small lock free ring at the same time, with random burst
+ * and read sizes. The producer writes a known byte sequence, the consumer checks
+ * every byte arrives once and in order, reading through both peek/consume and
+ * the copying read.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+
+#define TEST_SPSC_RING_SUCCESS    0
+#define TEST_SPSC_RING_FAIL       1
+
+/* Small, so both sides wrap and run into a full or empty ring all the time. */
+#define TEST_RING_CAPACITY        64
+#define TEST_BYTES                ( 16u * 1024u * 1024u )
+#define TEST_MAX_BURST            100
+
+static uint8_t ucRingBuffer[ TEST_RING_CAPACITY ];
+static spsc_ring_t xRing;
+static volatile int xFailed = 0;
+
+/* Byte n of the stream, the same on both sides. */
+static uint8_t prvStreamByte( uint32_t ulIndex )
+{
+    uint32_t ulValue = ulIndex * 2654435761u;
+
+    return ( uint8_t ) ( ( ulValue >> 24 ) ^ ulValue );
+}
+
+/* Each thread its own generator, rand() is not thread safe. */
+static uint32_t prvNext( uint32_t * pulState )
+{
+    *pulState ^= *pulState << 13;
+    *pulState ^= *pulState >> 17;
+    *pulState ^= *pulState << 5;
+
+    return *pulState;
+}
+
+static void * prvProducer( void * pvArg )
+{
+    uint8_t ucBurst[ TEST_MAX_BURST ];
+    uint32_t ulState = 0x12345678;
+    uint32_t ulSent = 0;
+    uint32_t ulBurst;
+    uint32_t i;
+
+    ( void ) pvArg;
+
+    while( ( ulSent < TEST_BYTES ) && !xFailed )
+    {
+        ulBurst = 1 + prvNext( &ulState ) % TEST_MAX_BURST;
+        ulBurst = ( ulBurst > TEST_BYTES - ulSent ) ? TEST_BYTES - ulSent : ulBurst;
+
+        for( i = 0; i < ulBurst; i++ )
+        {
+            ucBurst[ i ] = prvStreamByte( ulSent + i );
+        }
+
+        /* Unlike the interrupt, retry what did not fit so the stream stays complete. */
+        for( i = 0; i < ulBurst; )
+        {
+            uint32_t ulWritten = spsc_ring_write( &xRing, ucBurst + i, ulBurst - i );
+
+            if( ulWritten == 0 )
+            {
+                sched_yield(); /* Let the consumer run on a single core machine. */
+            }
+
+            i += ulWritten;
+        }
+
+        ulSent += ulBurst;
+    }
+
+    return NULL;
+}
+
+static int prvCheck( const uint8_t * pucData,
+                     uint32_t ulLength,
+                     uint32_t * pulReceived )
+{
+    uint32_t i;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        if( pucData[ i ] != prvStreamByte( *pulReceived + i ) )
+        {
+            printf( "\tFailed! byte %u is 0x%02X, expected 0x%02X\n",
+                    *pulReceived + i, pucData[ i ], prvStreamByte( *pulReceived + i ) );
+            return 0;
+        }
+    }
+
+    *pulReceived += ulLength;
+
+    return 1;
+}
+
+static void * prvConsumer( void * pvArg )
+{
+    uint8_t ucCopy[ TEST_RING_CAPACITY ];
+    uint32_t ulState = 0x87654321;
+    uint32_t * pulReceived = ( uint32_t * ) pvArg;
+    const uint8_t * pucFirst;
+    const uint8_t * pucSecond;
+    uint32_t ulFirstLength;
+    uint32_t ulSecondLength;
+    uint32_t ulWanted;
+
+    while( ( *pulReceived < TEST_BYTES ) && !xFailed )
+    {
+        ulWanted = 1 + prvNext( &ulState ) % TEST_RING_CAPACITY;
+        ulWanted = ( ulWanted > TEST_BYTES - *pulReceived ) ? TEST_BYTES - *pulReceived : ulWanted;
+
+        if( ulWanted & 1 )
+        {
+            /* Zero copy: check in place, give back only part of it. */
+            if( spsc_ring_peek( &xRing, &pucFirst, &ulFirstLength, &pucSecond, &ulSecondLength ) == 0 )
+            {
+                sched_yield();
+                continue;
+            }
+
+            ulFirstLength = ( ulFirstLength > ulWanted ) ? ulWanted : ulFirstLength;
+            ulSecondLength = ( ulSecondLength > ulWanted - ulFirstLength ) ? ulWanted - ulFirstLength : ulSecondLength;
+
+            if( !prvCheck( pucFirst, ulFirstLength, pulReceived ) ||
+                !prvCheck( pucSecond, ulSecondLength, pulReceived ) )
+            {
+                xFailed = 1;
+                break;
+            }
+
+            spsc_ring_consume( &xRing, ulFirstLength + ulSecondLength );
+        }
+        else if( spsc_ring_read( &xRing, ucCopy, ulWanted ) == ulWanted )
+        {
+            if( !prvCheck( ucCopy, ulWanted, pulReceived ) )
+            {
+                xFailed = 1;
+                break;
+            }
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int vStartTestTask( void )
+{
+    pthread_t xProducer;
+    pthread_t xConsumer;
+    uint32_t ulReceived = 0;
+
+    printf( "Streaming %u bytes through a %u byte ring from two threads\n", TEST_BYTES, TEST_RING_CAPACITY );
+    spsc_ring_init( &xRing, ucRingBuffer, TEST_RING_CAPACITY );
+
+    pthread_create( &xConsumer, NULL, prvConsumer, &ulReceived );
+    pthread_create( &xProducer, NULL, prvProducer, NULL );
+    pthread_join( xProducer, NULL );
+    pthread_join( xConsumer, NULL );
+
+    if( xFailed || ( ulReceived != TEST_BYTES ) || ( spsc_ring_available( &xRing ) != 0 ) )
+    {
+        printf( "\tFailed! received %u bytes\n", ulReceived );
+        return TEST_SPSC_RING_FAIL;
+    }
+
+    printf( "Checking a full ring refuses more data\n" );
+    memset( ucRingBuffer, 0, sizeof( ucRingBuffer ) );
+
+    if( ( spsc_ring_write( &xRing, ucRingBuffer, TEST_RING_CAPACITY + 10 ) != TEST_RING_CAPACITY ) ||
+        ( spsc_ring_free( &xRing ) != 0 ) || ( spsc_ring_write( &xRing, ucRingBuffer, 1 ) != 0 ) )
+    {
+        printf( "\tFailed! ring does not hold exactly %u bytes\n", TEST_RING_CAPACITY );
+        return TEST_SPSC_RING_FAIL;
+    }
+
+    return TEST_SPSC_RING_SUCCESS;
+}
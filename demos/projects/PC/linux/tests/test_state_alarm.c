@@ -0,0 +1,467 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE LOCK/SAFE STATE ALARM PATH
+ *
+ * First checks which frames raise an alarm. Then measures the time from a
+ * Lock_State transition to its error message being published, with threads
+ * standing in for the firmware tasks and time scaled down:
+ * - a decoder thread decodes a frame every few milliseconds, the SKID and unit
+ *   walking between running, Lock_State and Safe_State,
+ * - an alarm thread, woken by the notify callback, queues the error message,
+ * - a network thread runs one process loop interval at a time and publishes
+ *   whatever error is queued after each.
+ * The same trace is also run through the previous path, the states compared
+ * with the last ones at every publish cycle, for the latency it had and the
+ * short Lock_State periods it missed.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "state_alarm.h"
+
+#define TEST_STATE_ALARM_SUCCESS    0
+#define TEST_STATE_ALARM_FAIL       1
+
+/* Firmware timings scaled down: frames at 10 Hz, 500 ms process loop, 30 s publish cycle. */
+#define TEST_FRAME_MS               2
+#define TEST_PROCESS_LOOP_MS        10
+#define TEST_PUBLISH_CYCLE_MS       300
+#define TEST_RUN_MS                 1500
+
+/* Scheduling jitter allowed on top of one process loop interval. */
+#define TEST_SLACK_MS               15
+
+#define TEST_MAX_TRANSITIONS        256
+
+typedef enum
+{
+    eModeNotify = 0, /* Decoder notifies the alarm thread. */
+    eModePoll        /* States compared once per publish cycle, as before. */
+} TestMode_t;
+
+typedef struct
+{
+    uint32_t ulTick;
+    int xReported;
+} TestTransition_t;
+
+typedef struct
+{
+    uint32_t ulTransitions;
+    uint32_t ulReported;
+    uint32_t ulMissed;
+    uint32_t ulMaxLatency;
+    uint64_t ullTotalLatency;
+} TestResult_t;
+
+static TestMode_t xMode;
+static state_alarm_t xAlarm;
+static sem_t xAlarmNotification;
+static pthread_mutex_t xLock = PTHREAD_MUTEX_INITIALIZER;
+static int xRunning;
+
+/* Shared with the decoder, what get_skid_status/get_unit_status would read. */
+static sequence_state_t xCurrentState[ STATE_ALARM_SOURCES ];
+
+/* Every Lock_State transition the decoder made, the ground truth. */
+static TestTransition_t xTransitions[ STATE_ALARM_SOURCES ][ TEST_MAX_TRANSITIONS ];
+static uint32_t ulTransitionCount[ STATE_ALARM_SOURCES ];
+
+/* The queued error message: the latest transition it reports per source. */
+static int xErrorQueued;
+static uint32_t ulQueuedTick[ STATE_ALARM_SOURCES ];
+static int xQueuedSource[ STATE_ALARM_SOURCES ];
+
+static TestResult_t xResult;
+
+static uint32_t prvNowMs( void )
+{
+    struct timespec xNow;
+
+    clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( uint32_t ) ( xNow.tv_sec * 1000u + xNow.tv_nsec / 1000000u );
+}
+
+static void prvSleepMs( uint32_t ulMs )
+{
+    struct timespec xDelay = { ulMs / 1000u, ( long ) ( ulMs % 1000u ) * 1000000L };
+
+    nanosleep( &xDelay, NULL );
+}
+
+/* Each thread its own generator, rand() is not thread safe. */
+static uint32_t prvNext( uint32_t * pulState )
+{
+    *pulState ^= *pulState << 13;
+    *pulState ^= *pulState >> 17;
+    *pulState ^= *pulState << 5;
+
+    return *pulState;
+}
+
+static void prvNotify( void * pvContext )
+{
+    sem_post( ( sem_t * ) pvContext );
+}
+
+/* Called with xLock held. */
+static void prvQueueError( state_alarm_source_t xSource,
+                           uint32_t ulTick )
+{
+    ulQueuedTick[ xSource ] = ulTick;
+    xQueuedSource[ xSource ] = 1;
+    xErrorQueued = 1;
+}
+
+static void * prvDecoder( void * pvArg )
+{
+    uint32_t ulState = 0x9E3779B9u;
+    uint32_t ulStart = prvNowMs();
+    uint32_t ulNextChange[ STATE_ALARM_SOURCES ] = { 0 };
+    sequence_state_t xState[ STATE_ALARM_SOURCES ] = { Adsorb_State, Adsorb_State };
+    uint32_t ulNow;
+    int i;
+
+    ( void ) pvArg;
+
+    while( ( ulNow = prvNowMs() ) - ulStart < TEST_RUN_MS )
+    {
+        for( i = 0; i < STATE_ALARM_SOURCES; i++ )
+        {
+            if( ( int32_t ) ( ulNow - ulNextChange[ i ] ) >= 0 )
+            {
+                /* Running for a while, then Lock_State, now and then Safe_State,
+                 * locks as short as a few frames. */
+                if( xState[ i ] != Adsorb_State )
+                {
+                    xState[ i ] = Adsorb_State;
+                    ulNextChange[ i ] = ulNow + 40 + prvNext( &ulState ) % 200;
+                }
+                else
+                {
+                    xState[ i ] = ( prvNext( &ulState ) % 4 == 0 ) ? Safe_State : Lock_State;
+                    ulNextChange[ i ] = ulNow + 10 + prvNext( &ulState ) % 300;
+                }
+
+                if( ( xState[ i ] == Lock_State ) && ( ulTransitionCount[ i ] < TEST_MAX_TRANSITIONS ) )
+                {
+                    pthread_mutex_lock( &xLock );
+                    xTransitions[ i ][ ulTransitionCount[ i ] ].ulTick = ulNow;
+                    xTransitions[ i ][ ulTransitionCount[ i ] ].xReported = 0;
+                    ulTransitionCount[ i ]++;
+                    pthread_mutex_unlock( &xLock );
+                }
+            }
+
+            /* The frame: read_skid_status/read_unit_status. */
+            __atomic_store_n( &xCurrentState[ i ], xState[ i ], __ATOMIC_RELAXED );
+
+            if( xMode == eModeNotify )
+            {
+                state_alarm_update( &xAlarm, ( state_alarm_source_t ) i, xState[ i ], ulNow );
+            }
+        }
+
+        prvSleepMs( TEST_FRAME_MS );
+    }
+
+    __atomic_store_n( &xRunning, 0, __ATOMIC_RELAXED );
+    sem_post( &xAlarmNotification );
+
+    return NULL;
+}
+
+/* prvAlarmTask */
+static void * prvAlarmThread( void * pvArg )
+{
+    uint32_t ulAlarms;
+    state_alarm_event_t xEvent;
+    int i;
+
+    ( void ) pvArg;
+
+    while( __atomic_load_n( &xRunning, __ATOMIC_RELAXED ) )
+    {
+        sem_wait( &xAlarmNotification );
+        ulAlarms = state_alarm_take( &xAlarm );
+
+        pthread_mutex_lock( &xLock );
+
+        for( i = 0; i < STATE_ALARM_SOURCES; i++ )
+        {
+            if( ulAlarms & STATE_ALARM_BIT( i ) )
+            {
+                xEvent = state_alarm_last_event( &xAlarm, ( state_alarm_source_t ) i );
+
+                if( xEvent.state == Lock_State )
+                {
+                    prvQueueError( ( state_alarm_source_t ) i, xEvent.tick );
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &xLock );
+    }
+
+    return NULL;
+}
+
+/* The sampling task before: states compared with the last ones once a cycle. */
+static void * prvPollThread( void * pvArg )
+{
+    sequence_state_t xLastState[ STATE_ALARM_SOURCES ] = { Error_Handling, Error_Handling };
+    sequence_state_t xState;
+    uint32_t ulNow;
+    int i;
+
+    ( void ) pvArg;
+
+    while( __atomic_load_n( &xRunning, __ATOMIC_RELAXED ) )
+    {
+        prvSleepMs( TEST_PUBLISH_CYCLE_MS );
+        ulNow = prvNowMs();
+
+        pthread_mutex_lock( &xLock );
+
+        for( i = 0; i < STATE_ALARM_SOURCES; i++ )
+        {
+            xState = __atomic_load_n( &xCurrentState[ i ], __ATOMIC_RELAXED );
+
+            if( ( xState == Lock_State ) && ( xLastState[ i ] != Lock_State ) )
+            {
+                prvQueueError( ( state_alarm_source_t ) i, ulNow );
+            }
+
+            xLastState[ i ] = xState;
+        }
+
+        pthread_mutex_unlock( &xLock );
+    }
+
+    return NULL;
+}
+
+/* Marks the transitions up to the reported one, measured from their own tick. */
+static void prvPublished( state_alarm_source_t xSource,
+                          uint32_t ulReportedTick,
+                          uint32_t ulNow )
+{
+    uint32_t ulLatency;
+    uint32_t n;
+
+    for( n = 0; n < ulTransitionCount[ xSource ]; n++ )
+    {
+        TestTransition_t * pxTransition = &xTransitions[ xSource ][ n ];
+
+        if( pxTransition->xReported || ( ( int32_t ) ( ulReportedTick - pxTransition->ulTick ) < 0 ) )
+        {
+            continue;
+        }
+
+        /* Polling reports the state it finds, not every transition before it. */
+        if( ( xMode == eModePoll ) && ( n + 1 < ulTransitionCount[ xSource ] ) &&
+            ( ( int32_t ) ( ulReportedTick - xTransitions[ xSource ][ n + 1 ].ulTick ) >= 0 ) )
+        {
+            continue;
+        }
+
+        pxTransition->xReported = 1;
+        ulLatency = ulNow - pxTransition->ulTick;
+        xResult.ulReported++;
+        xResult.ullTotalLatency += ulLatency;
+
+        if( ulLatency > xResult.ulMaxLatency )
+        {
+            xResult.ulMaxLatency = ulLatency;
+        }
+    }
+}
+
+/* prvAzureDemoTask: one process loop, then send what is due. */
+static void * prvNetworkThread( void * pvArg )
+{
+    uint32_t ulNow;
+    int i;
+
+    ( void ) pvArg;
+
+    while( __atomic_load_n( &xRunning, __ATOMIC_RELAXED ) )
+    {
+        prvSleepMs( TEST_PROCESS_LOOP_MS );
+        ulNow = prvNowMs();
+
+        pthread_mutex_lock( &xLock );
+
+        if( xErrorQueued )
+        {
+            for( i = 0; i < STATE_ALARM_SOURCES; i++ )
+            {
+                if( xQueuedSource[ i ] )
+                {
+                    prvPublished( ( state_alarm_source_t ) i, ulQueuedTick[ i ], ulNow );
+                    xQueuedSource[ i ] = 0;
+                }
+            }
+
+            xErrorQueued = 0;
+        }
+
+        pthread_mutex_unlock( &xLock );
+    }
+
+    return NULL;
+}
+
+static TestResult_t prvRun( TestMode_t xRunMode )
+{
+    pthread_t xDecoder;
+    pthread_t xPublisher;
+    pthread_t xNetwork;
+    uint32_t n;
+    int i;
+
+    xMode = xRunMode;
+    xRunning = 1;
+    xErrorQueued = 0;
+    memset( &xResult, 0, sizeof( xResult ) );
+    memset( ulTransitionCount, 0, sizeof( ulTransitionCount ) );
+    memset( xQueuedSource, 0, sizeof( xQueuedSource ) );
+    state_alarm_init( &xAlarm );
+    sem_init( &xAlarmNotification, 0, 0 );
+    state_alarm_set_notify( &xAlarm, prvNotify, &xAlarmNotification );
+
+    pthread_create( &xNetwork, NULL, prvNetworkThread, NULL );
+    pthread_create( &xPublisher, NULL, ( xRunMode == eModeNotify ) ? prvAlarmThread : prvPollThread, NULL );
+    pthread_create( &xDecoder, NULL, prvDecoder, NULL );
+    pthread_join( xDecoder, NULL );
+    pthread_join( xPublisher, NULL );
+    pthread_join( xNetwork, NULL );
+    sem_destroy( &xAlarmNotification );
+
+    for( i = 0; i < STATE_ALARM_SOURCES; i++ )
+    {
+        xResult.ulTransitions += ulTransitionCount[ i ];
+
+        for( n = 0; n < ulTransitionCount[ i ]; n++ )
+        {
+            xResult.ulMissed += xTransitions[ i ][ n ].xReported ? 0 : 1;
+        }
+    }
+
+    return xResult;
+}
+
+static int prvCheckTransitions( void )
+{
+    state_alarm_t xLocal;
+    state_alarm_event_t xEvent;
+    uint32_t ulNotified = 0;
+
+    /* Zeroed, the last states start at Error_Handling. */
+    memset( &xLocal, 0, sizeof( xLocal ) );
+
+    if( state_alarm_update( &xLocal, STATE_ALARM_SKID, Adsorb_State, 1 ) ||
+        !state_alarm_update( &xLocal, STATE_ALARM_SKID, Lock_State, 2 ) ||
+        state_alarm_update( &xLocal, STATE_ALARM_SKID, Lock_State, 3 ) ||
+        !state_alarm_update( &xLocal, STATE_ALARM_SKID, Safe_State, 4 ) ||
+        state_alarm_update( &xLocal, STATE_ALARM_SKID, Unlock_State, 5 ) ||
+        !state_alarm_update( &xLocal, STATE_ALARM_UNIT, Lock_State, 6 ) )
+    {
+        printf( "\tFailed! wrong frames raise an alarm\n" );
+        return 0;
+    }
+
+    xEvent = state_alarm_last_event( &xLocal, STATE_ALARM_SKID );
+
+    if( ( xLocal.transitions != 3 ) || ( xEvent.state != Safe_State ) || ( xEvent.tick != 4 ) )
+    {
+        printf( "\tFailed! %u transitions, last SKID event state %d at %u\n",
+                xLocal.transitions, xEvent.state, xEvent.tick );
+        return 0;
+    }
+
+    if( ( state_alarm_take( &xLocal ) != ( STATE_ALARM_BIT( STATE_ALARM_SKID ) | STATE_ALARM_BIT( STATE_ALARM_UNIT ) ) ) ||
+        ( state_alarm_take( &xLocal ) != 0 ) )
+    {
+        printf( "\tFailed! pending alarms not taken once\n" );
+        return 0;
+    }
+
+    /* One notify per transition. */
+    state_alarm_init( &xLocal );
+    sem_init( &xAlarmNotification, 0, 0 );
+    state_alarm_set_notify( &xLocal, prvNotify, &xAlarmNotification );
+    state_alarm_update( &xLocal, STATE_ALARM_UNIT, Lock_State, 1 );
+    state_alarm_update( &xLocal, STATE_ALARM_UNIT, Lock_State, 2 );
+    state_alarm_update( &xLocal, STATE_ALARM_UNIT, Evacuation_State, 3 );
+    state_alarm_update( &xLocal, STATE_ALARM_UNIT, Lock_State, 4 );
+
+    while( sem_trywait( &xAlarmNotification ) == 0 )
+    {
+        ulNotified++;
+    }
+
+    sem_destroy( &xAlarmNotification );
+
+    if( ( ulNotified != 2 ) || ( state_alarm_take( &xLocal ) != STATE_ALARM_BIT( STATE_ALARM_UNIT ) ) ||
+        ( state_alarm_last_event( &xLocal, STATE_ALARM_UNIT ).tick != 4 ) )
+    {
+        printf( "\tFailed! %u notifications for 2 transitions\n", ulNotified );
+        return 0;
+    }
+
+    return 1;
+}
+
+static void prvPrintResult( const char * pcName,
+                            const TestResult_t * pxResult )
+{
+    printf( "\t%-28s transitions=%u reported=%u missed=%u latency avg=%ums max=%ums\n",
+            pcName, pxResult->ulTransitions, pxResult->ulReported, pxResult->ulMissed,
+            pxResult->ulReported ? ( uint32_t ) ( pxResult->ullTotalLatency / pxResult->ulReported ) : 0,
+            pxResult->ulMaxLatency );
+}
+
+int vStartTestTask( void )
+{
+    TestResult_t xNotifyResult;
+    TestResult_t xPollResult;
+
+    printf( "Checking which frames raise an alarm\n" );
+
+    if( !prvCheckTransitions() )
+    {
+        return TEST_STATE_ALARM_FAIL;
+    }
+
+    printf( "Measuring Lock_State transition to publish, %u ms frames, %u ms process loop, %u ms publish cycle\n",
+            TEST_FRAME_MS, TEST_PROCESS_LOOP_MS, TEST_PUBLISH_CYCLE_MS );
+    xNotifyResult = prvRun( eModeNotify );
+    xPollResult = prvRun( eModePoll );
+    prvPrintResult( "decoder notifies:", &xNotifyResult );
+    prvPrintResult( "checked every publish cycle:", &xPollResult );
+
+    if( ( xNotifyResult.ulTransitions == 0 ) || ( xNotifyResult.ulMissed != 0 ) )
+    {
+        printf( "\tFailed! %u of %u Lock_State transitions not published\n",
+                xNotifyResult.ulMissed, xNotifyResult.ulTransitions );
+        return TEST_STATE_ALARM_FAIL;
+    }
+
+    if( xNotifyResult.ulMaxLatency > TEST_PROCESS_LOOP_MS + TEST_SLACK_MS )
+    {
+        printf( "\tFailed! published %u ms after the transition, more than one process loop\n",
+                xNotifyResult.ulMaxLatency );
+        return TEST_STATE_ALARM_FAIL;
+    }
+
+    return TEST_STATE_ALARM_SUCCESS;
+}
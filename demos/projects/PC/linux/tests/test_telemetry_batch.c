@@ -0,0 +1,483 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE TELEMETRY BATCHING
+ *
+ * First checks the range of the telemetryBatchSize and telemetryFlushTimeout
+ * writable properties. Then runs the publish loop of the demo on virtual ticks:
+ * a window is queued every sampling period, now and then an error message that
+ * does not wait, and the network side asks whether the batch is due once per
+ * process loop interval. Every answer is compared with the rule worked out from
+ * the queued messages themselves, across random settings, failed sends and the
+ * tick count wrapping around. Then the longest wait of a window is checked
+ * against the batch size and flush timeout for a few settings.
+ *
+ * Last the backpressure: batches are taken from a small telemetry queue while
+ * sampling goes on during the send and the full queue drops its oldest records.
+ * Once a batch is acknowledged every record has to be either sent once, in
+ * order, dropped and counted, or still queued.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_batch.h"
+#include "telemetry_queue.h"
+
+#define TEST_TELEMETRY_BATCH_SUCCESS    0
+#define TEST_TELEMETRY_BATCH_FAIL       1
+
+/* Firmware timings: 1 ms ticks, 30 s sampling period, 500 ms process loop. */
+#define TEST_TICKS_PER_SECOND           1000
+#define TEST_SAMPLE_PERIOD              30000
+#define TEST_LOOP_INTERVAL              500
+#define TEST_START_TICK                 ( UINT32_MAX - 3600000U )
+
+#define TEST_FUZZ_STEPS                 2000000
+#define TEST_RUN_STEPS                  200000
+#define TEST_MODEL_MESSAGES             4096    /* Far more than a run of failed sends queues */
+
+#define TEST_QUEUE_LENGTH               256     /* 25 records */
+#define TEST_RECORD_LENGTH              8
+#define TEST_BATCH_LENGTH               128
+#define TEST_BATCH_RECORDS              8
+#define TEST_SENDS                      100000
+
+static telemetry_batch_t xBatch;
+
+/*-----------------------------------------------------------*/
+
+/* Queued messages, oldest first, and whether a flush is pending. */
+typedef struct
+{
+    uint32_t ulTicks[ TEST_MODEL_MESSAGES ];
+    uint32_t ulHead;
+    uint32_t ulCount;
+    int xFlush;
+} TestModel_t;
+
+static TestModel_t xModel;
+
+static void prvModelQueue( uint32_t ulTick,
+                           int xFlush )
+{
+    telemetry_batch_queued( &xBatch, xModel.ulCount, ulTick, xFlush != 0 );
+    xModel.ulTicks[ ( xModel.ulHead + xModel.ulCount ) % TEST_MODEL_MESSAGES ] = ulTick;
+    xModel.ulCount++;
+
+    if( xFlush )
+    {
+        xModel.xFlush = 1;
+    }
+}
+
+static int prvModelDue( uint32_t ulTick )
+{
+    uint32_t ulAge;
+
+    if( xModel.xFlush )
+    {
+        return 1;
+    }
+
+    if( xModel.ulCount == 0 )
+    {
+        return 0;
+    }
+
+    ulAge = ulTick - xModel.ulTicks[ xModel.ulHead ];
+
+    return ( xModel.ulCount >= xBatch.size ) || ( ulAge >= xBatch.flush_timeout * TEST_TICKS_PER_SECOND );
+}
+
+/* Sends everything queued, returns the longest wait. */
+static uint32_t prvModelSend( uint32_t ulTick )
+{
+    uint32_t ulWait = ( xModel.ulCount != 0 ) ? ( ulTick - xModel.ulTicks[ xModel.ulHead ] ) : 0;
+
+    xModel.ulHead = 0;
+    xModel.ulCount = 0;
+    xModel.xFlush = 0;
+    telemetry_batch_sent( &xBatch, 0 );
+
+    return ulWait;
+}
+
+static void prvModelReset( uint32_t ulSize,
+                           uint32_t ulFlushTimeout )
+{
+    telemetry_batch_init( &xBatch, ulSize, ulFlushTimeout, TEST_TICKS_PER_SECOND );
+    xModel.ulHead = 0;
+    xModel.ulCount = 0;
+    xModel.xFlush = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCheckSettings( void )
+{
+    static const struct
+    {
+        int32_t lValue;
+        int xTaken;
+    } xSizes[] = { { -1, 0 }, { 0, 0 }, { 1, 1 }, { 7, 1 }, { TELEMETRY_BATCH_MAX_SIZE, 1 }, { TELEMETRY_BATCH_MAX_SIZE + 1, 0 }, { INT32_MIN, 0 }, { INT32_MAX, 0 } },
+      xTimeouts[] = { { -1, 0 }, { 0, 1 }, { 300, 1 }, { TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT, 1 }, { TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT + 1, 0 }, { INT32_MIN, 0 }, { INT32_MAX, 0 } };
+    uint32_t ulExpected;
+    uint32_t i;
+
+    prvModelReset( 1, 300 );
+    ulExpected = xBatch.size;
+
+    for( i = 0; i < sizeof( xSizes ) / sizeof( xSizes[ 0 ] ); i++ )
+    {
+        ulExpected = xSizes[ i ].xTaken ? ( uint32_t ) xSizes[ i ].lValue : ulExpected;
+
+        if( ( telemetry_batch_set_size( &xBatch, xSizes[ i ].lValue ) != ( xSizes[ i ].xTaken != 0 ) ) || ( xBatch.size != ulExpected ) )
+        {
+            printf( "\tFailed! batch size %ld %s\n", ( long ) xSizes[ i ].lValue, xSizes[ i ].xTaken ? "refused" : "taken" );
+            return 0;
+        }
+    }
+
+    ulExpected = xBatch.flush_timeout;
+
+    for( i = 0; i < sizeof( xTimeouts ) / sizeof( xTimeouts[ 0 ] ); i++ )
+    {
+        ulExpected = xTimeouts[ i ].xTaken ? ( uint32_t ) xTimeouts[ i ].lValue : ulExpected;
+
+        if( ( telemetry_batch_set_flush_timeout( &xBatch, xTimeouts[ i ].lValue ) != ( xTimeouts[ i ].xTaken != 0 ) ) ||
+            ( xBatch.flush_timeout != ulExpected ) )
+        {
+            printf( "\tFailed! flush timeout %ld %s\n", ( long ) xTimeouts[ i ].lValue, xTimeouts[ i ].xTaken ? "refused" : "taken" );
+            return 0;
+        }
+    }
+
+    /* The longest timeout in ticks must not wrap. */
+    if( ( uint64_t ) TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT * TEST_TICKS_PER_SECOND > UINT32_MAX / 2 )
+    {
+        printf( "\tFailed! longest flush timeout wraps the tick count\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCheckDecisions( void )
+{
+    uint32_t ulTick = TEST_START_TICK;
+    uint32_t ulNextSample = ulTick;
+    uint32_t ulStep;
+    uint32_t ulSends = 0;
+    uint32_t ulFailures = 0;
+    int xDue;
+    int xExpected;
+
+    srand( 1 );
+    prvModelReset( 1, 300 );
+
+    for( ulStep = 0; ulStep < TEST_FUZZ_STEPS; ulStep++ )
+    {
+        /* The settings change now and then, out of range ones are refused. */
+        if( ( rand() % 5000 ) == 0 )
+        {
+            ( void ) telemetry_batch_set_size( &xBatch, ( rand() % ( TELEMETRY_BATCH_MAX_SIZE + 4 ) ) - 2 );
+        }
+
+        if( ( rand() % 5000 ) == 0 )
+        {
+            ( void ) telemetry_batch_set_flush_timeout( &xBatch, ( rand() % 1200 ) - 10 );
+        }
+
+        if( ( int32_t ) ( ulTick - ulNextSample ) >= 0 )
+        {
+            prvModelQueue( ulTick, 0 );
+            ulNextSample += TEST_SAMPLE_PERIOD;
+        }
+
+        if( ( rand() % 3000 ) == 0 )
+        {
+            prvModelQueue( ulTick, 1 );
+        }
+
+        xDue = telemetry_batch_due( &xBatch, xModel.ulCount, ulTick );
+        xExpected = prvModelDue( ulTick );
+
+        if( xDue != xExpected )
+        {
+            printf( "\tFailed! step %u: due %d, expected %d with %u waiting, size %u, timeout %us\n", ulStep, xDue, xExpected,
+                    xModel.ulCount, xBatch.size, xBatch.flush_timeout );
+            return 0;
+        }
+
+        if( xDue )
+        {
+            if( ( rand() % 10 ) == 0 )
+            {
+                /* The send failed, everything is kept for the next session. */
+                telemetry_batch_sent( &xBatch, xModel.ulCount );
+                ulFailures++;
+            }
+            else
+            {
+                ( void ) prvModelSend( ulTick );
+                ulSends++;
+            }
+        }
+
+        ulTick += TEST_LOOP_INTERVAL;
+    }
+
+    printf( "\t%u decisions, %u sends, %u failed sends, tick count wrapped\n", TEST_FUZZ_STEPS, ulSends, ulFailures );
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCheckWait( uint32_t ulSize,
+                         uint32_t ulFlushTimeout )
+{
+    uint32_t ulTick = TEST_START_TICK;
+    uint32_t ulNextSample = ulTick;
+    uint32_t ulStep;
+    uint32_t ulPublishes = 0;
+    uint32_t ulWindows = 0;
+    uint32_t ulWait;
+    uint32_t ulLongest = 0;
+    uint32_t ulBound;
+
+    prvModelReset( ulSize, ulFlushTimeout );
+
+    /* Sampled right after the process loop looked, a window misses it by one interval. */
+    ulBound = ( ulSize - 1 ) * TEST_SAMPLE_PERIOD;
+
+    if( ulBound > ulFlushTimeout * TEST_TICKS_PER_SECOND )
+    {
+        ulBound = ulFlushTimeout * TEST_TICKS_PER_SECOND;
+    }
+
+    ulBound += TEST_LOOP_INTERVAL;
+
+    for( ulStep = 0; ulStep < TEST_RUN_STEPS; ulStep++ )
+    {
+        if( ( int32_t ) ( ulTick - ulNextSample ) >= 0 )
+        {
+            prvModelQueue( ulTick, 0 );
+            ulNextSample += TEST_SAMPLE_PERIOD;
+            ulWindows++;
+        }
+
+        if( telemetry_batch_due( &xBatch, xModel.ulCount, ulTick ) )
+        {
+            ulWait = prvModelSend( ulTick );
+            ulLongest = ( ulWait > ulLongest ) ? ulWait : ulLongest;
+            ulPublishes++;
+        }
+
+        ulTick += TEST_LOOP_INTERVAL;
+    }
+
+    printf( "\tsize %2u timeout %3us: %5u publishes, %4.1f windows each, longest wait %5.1fs of %5.1fs\n",
+            ulSize, ulFlushTimeout, ulPublishes, ( double ) ulWindows / ulPublishes,
+            ulLongest / ( double ) TEST_TICKS_PER_SECOND, ulBound / ( double ) TEST_TICKS_PER_SECOND );
+
+    if( ulLongest > ulBound )
+    {
+        printf( "\tFailed! a window waited longer than the batch size or timeout allow\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+static telemetry_queue_t xQueue;
+static uint8_t ucQueueBuffer[ TEST_QUEUE_LENGTH ];
+
+static void prvPushRecord( uint32_t ulSequence )
+{
+    char cRecord[ TEST_RECORD_LENGTH + 1 ];
+
+    snprintf( cRecord, sizeof( cRecord ), "%08u", ulSequence );
+    ( void ) telemetry_queue_push( &xQueue, ( const uint8_t * ) cRecord, TEST_RECORD_LENGTH, false );
+}
+
+/* Sequence number of the oldest queued record. */
+static uint32_t prvOldestRecord( void )
+{
+    char cBatch[ TEST_BATCH_LENGTH ];
+    uint32_t ulRecords;
+
+    ( void ) telemetry_queue_batch( &xQueue, 1, &telemetry_queue_json, ( uint8_t * ) cBatch, sizeof( cBatch ) - 1, &ulRecords );
+
+    return ( uint32_t ) strtoul( &cBatch[ 1 ], NULL, 10 );
+}
+
+static int prvCheckBackpressure( void )
+{
+    char cBatch[ TEST_BATCH_LENGTH ];
+    uint32_t ulLength;
+    uint32_t ulRecords;
+    uint32_t ulDropped;
+    uint32_t ulPushed = 0;
+    uint32_t ulDelivered = 0;
+    uint32_t ulNextExpected = 0;
+    uint32_t ulSequence;
+    uint32_t ulSend;
+    uint32_t ulDroppedInFlight = 0;
+    uint32_t i;
+    char * pcRecord;
+
+    telemetry_queue_init( &xQueue, ucQueueBuffer, sizeof( ucQueueBuffer ), TELEMETRY_QUEUE_DROP_OLDEST, NULL );
+    srand( 2 );
+
+    for( ulSend = 0; ulSend < TEST_SENDS; ulSend++ )
+    {
+        /* Sampling between two sends. */
+        for( i = rand() % 3; i != 0; i-- )
+        {
+            prvPushRecord( ulPushed++ );
+        }
+
+        if( telemetry_queue_count( &xQueue ) == 0 )
+        {
+            continue;
+        }
+
+        ulLength = telemetry_queue_batch( &xQueue, 1 + rand() % TEST_BATCH_RECORDS, &telemetry_queue_json,
+                                          ( uint8_t * ) cBatch, sizeof( cBatch ) - 1, &ulRecords );
+        cBatch[ ulLength ] = '\0';
+        ulDropped = xQueue.stats.dropped;
+
+        /* Sampling goes on while the batch is sent, a slow send fills the queue. */
+        for( i = ( ( rand() % 8 ) == 0 ) ? ( rand() % 40 ) : ( rand() % 2 ); i != 0; i-- )
+        {
+            prvPushRecord( ulPushed++ );
+        }
+
+        if( ( rand() % 10 ) == 0 )
+        {
+            /* The send failed, the batch stays queued. */
+            continue;
+        }
+
+        /* The broker took every record of the batch, in order and once. */
+        for( pcRecord = &cBatch[ 1 ], i = 0; i < ulRecords; i++, pcRecord += TEST_RECORD_LENGTH + 1 )
+        {
+            ulSequence = ( uint32_t ) strtoul( pcRecord, NULL, 10 );
+
+            if( ulSequence < ulNextExpected )
+            {
+                printf( "\tFailed! record %u sent again after %u\n", ulSequence, ulNextExpected - 1 );
+                return 0;
+            }
+
+            ulNextExpected = ulSequence + 1;
+            ulDelivered++;
+        }
+
+        ulDroppedInFlight += ( xQueue.stats.dropped - ulDropped < ulRecords ) ? ( xQueue.stats.dropped - ulDropped ) : ulRecords;
+        telemetry_queue_drop( &xQueue, telemetry_batch_acknowledged( ulRecords, xQueue.stats.dropped - ulDropped ) );
+
+        if( ( telemetry_queue_count( &xQueue ) != 0 ) && ( prvOldestRecord() < ulNextExpected ) )
+        {
+            printf( "\tFailed! record %u still queued after it was sent\n", prvOldestRecord() );
+            return 0;
+        }
+
+        /* Each record was sent, dropped or is still queued. Those the queue dropped
+         * from a batch in flight were sent all the same. */
+        if( ulDelivered + xQueue.stats.dropped - ulDroppedInFlight + telemetry_queue_count( &xQueue ) != ulPushed )
+        {
+            printf( "\tFailed! %u records pushed, %u sent, %u dropped, %u queued\n", ulPushed, ulDelivered,
+                    xQueue.stats.dropped - ulDroppedInFlight, telemetry_queue_count( &xQueue ) );
+            return 0;
+        }
+    }
+
+    printf( "\t%u records, %u sent, %u dropped, %u of them while their batch was sent\n", ulPushed, ulDelivered,
+            xQueue.stats.dropped - ulDroppedInFlight, ulDroppedInFlight );
+
+    return 1;
+}
+
+static int prvCheckLatency( void )
+{
+    telemetry_latency_t xLatency;
+
+    memset( &xLatency, 0, sizeof( xLatency ) );
+
+    if( telemetry_latency_average( &xLatency ) != 0 )
+    {
+        printf( "\tFailed! average of no latency\n" );
+        return 0;
+    }
+
+    telemetry_latency_add( &xLatency, 30 );
+    telemetry_latency_add( &xLatency, 90 );
+    telemetry_latency_add( &xLatency, 0 );
+
+    if( ( xLatency.count != 3 ) || ( xLatency.last != 0 ) || ( xLatency.max != 90 ) || ( telemetry_latency_average( &xLatency ) != 40 ) )
+    {
+        printf( "\tFailed! latency count %u last %u max %u average %u\n", xLatency.count, xLatency.last, xLatency.max,
+                telemetry_latency_average( &xLatency ) );
+        return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+int vStartTestTask( void )
+{
+    static const uint32_t ulSettings[][ 2 ] = { { 1, 300 }, { 4, 300 }, { 16, 300 }, { 16, 60 }, { 4, 0 } };
+    uint32_t i;
+
+    printf( "Checking the batching settings\n" );
+
+    if( !prvCheckSettings() )
+    {
+        return TEST_TELEMETRY_BATCH_FAIL;
+    }
+
+    printf( "Checking when the batch is due\n" );
+
+    if( !prvCheckDecisions() )
+    {
+        return TEST_TELEMETRY_BATCH_FAIL;
+    }
+
+    printf( "Checking how long windows wait, %us sampling period\n", TEST_SAMPLE_PERIOD / TEST_TICKS_PER_SECOND );
+
+    for( i = 0; i < sizeof( ulSettings ) / sizeof( ulSettings[ 0 ] ); i++ )
+    {
+        if( !prvCheckWait( ulSettings[ i ][ 0 ], ulSettings[ i ][ 1 ] ) )
+        {
+            return TEST_TELEMETRY_BATCH_FAIL;
+        }
+    }
+
+    printf( "Checking the backpressure, sampling during the send\n" );
+
+    if( !prvCheckBackpressure() )
+    {
+        return TEST_TELEMETRY_BATCH_FAIL;
+    }
+
+    printf( "Checking the latency stats\n" );
+
+    if( !prvCheckLatency() )
+    {
+        return TEST_TELEMETRY_BATCH_FAIL;
+    }
+
+    return TEST_TELEMETRY_BATCH_SUCCESS;
+}
@@ -0,0 +1,299 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CBOR TELEMETRY ENCODING
+ *
+ * Writes every message type as CBOR for random data, reads it back and checks
+ * that the JSON written from what was read is byte for byte the JSON of the
+ * original data, so both encodings carry the same fields at the same
+ * precision. Damaged and truncated messages have to be refused. Then compares
+ * message sizes and the CPU time both encoders take.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry_schema.h"
+#include "telemetry_cbor.h"
+#include "sensor_value.h"
+
+#define TEST_TELEMETRY_CBOR_SUCCESS    0
+#define TEST_TELEMETRY_CBOR_FAIL       1
+
+#define TEST_MESSAGE_LENGTH            4096
+#define TEST_FUZZ_ITERATIONS           20000
+#define TEST_BENCHMARK_MESSAGES        200000
+
+static const telemetry_schema_t * pxJsonSchemas[] = { &telemetry_message_schema, &error_message_schema, &bootup_message_schema };
+static const telemetry_cbor_schema_t * pxCborSchemas[] = { &telemetry_message_cbor, &error_message_cbor, &bootup_message_cbor };
+static const char * pcMessageNames[] = { "telemetry", "error", "boot-up" };
+
+#define TEST_MESSAGE_TYPES    ( sizeof( pxJsonSchemas ) / sizeof( pxJsonSchemas[ 0 ] ) )
+
+static uint8_t ucJson[ TEST_MESSAGE_LENGTH ];
+static uint8_t ucJsonRead[ TEST_MESSAGE_LENGTH ];
+static uint8_t ucCbor[ TEST_MESSAGE_LENGTH ];
+static telemetry_data_t xData;
+static telemetry_data_t xRead;
+
+/*-----------------------------------------------------------*/
+
+/* Any value the statistics can hold, not just 3 decimals, so truncation is exercised. */
+static sensor_value_t prvRandomValue( void )
+{
+    #if SENSOR_VALUE_FIXED_POINT
+        return ( sensor_value_t ) ( ( ( uint32_t ) rand() << 16 ) ^ ( uint32_t ) rand() );
+    #else
+        return ( ( double ) rand() / RAND_MAX - 0.5 ) * 65536.0;
+    #endif
+}
+
+static void prvRandomSensor( sensor_info_t * pxSensor )
+{
+    pxSensor->status = ( component_status_t ) ( rand() % 2 );
+    pxSensor->stats.avg = prvRandomValue();
+    pxSensor->stats.max = prvRandomValue();
+    pxSensor->stats.min = prvRandomValue();
+    pxSensor->stats.median = prvRandomValue();
+}
+
+static sequence_state_t prvRandomState( void )
+{
+    /* Lock_State often, it decides what goes into the error message. */
+    return ( rand() % 3 == 0 ) ? Lock_State : ( sequence_state_t ) ( rand() % 10 );
+}
+
+static void prvRandomData( telemetry_data_t * pxData )
+{
+    SKID_iot_status_t * pxSkid = &pxData->skid;
+    UNIT_iot_status_t * pxUnit = &pxData->unit;
+    uint8_t i;
+
+    pxSkid->error_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->halt_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->reset_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->skid_state = prvRandomState();
+    pxSkid->two_way_gas_valve_before_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->two_way_gas_valve_in_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->two_way_gas_valve_after_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->vacuum_release_valve_in_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->three_way_vacuum_release_valve_before_condenser = ( component_status_t ) ( rand() % 2 );
+    pxSkid->three_valve_after_vacuum_pump = ( component_status_t ) ( rand() % 2 );
+    pxSkid->compressor = ( component_status_t ) ( rand() % 2 );
+    pxSkid->vacuum_pump = ( component_status_t ) ( rand() % 2 );
+    pxSkid->condenser = ( component_status_t ) ( rand() % 2 );
+    prvRandomSensor( &pxSkid->o2_sensor );
+    prvRandomSensor( &pxSkid->mass_flow );
+    prvRandomSensor( &pxSkid->co2_sensor );
+    prvRandomSensor( &pxSkid->tank_pressure );
+    prvRandomSensor( &pxSkid->proportional_valve_pressure );
+    prvRandomSensor( &pxSkid->temperature );
+    prvRandomSensor( &pxSkid->humidity );
+
+    pxUnit->error_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->halt_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->reset_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->just_started_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->setup_state_synching_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->unit_state = prvRandomState();
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        prvRandomSensor( &pxUnit->heater_info[ i ] );
+    }
+
+    pxUnit->fan_status = ( component_status_t ) ( rand() % 2 );
+    pxUnit->butterfly_valve_1_status = ( component_status_t ) ( rand() % 2 );
+    pxUnit->butterfly_valve_2_status = ( component_status_t ) ( rand() % 2 );
+    prvRandomSensor( &pxUnit->vacuum_sensor );
+    prvRandomSensor( &pxUnit->ambient_humidity );
+    prvRandomSensor( &pxUnit->ambient_temperature );
+
+    snprintf( pxData->timestamp_utc, sizeof( pxData->timestamp_utc ), "2024-%02d-%02dT%02d:%02d:%02dZ",
+              1 + rand() % 12, 1 + rand() % 28, rand() % 24, rand() % 60, rand() % 60 );
+    snprintf( pxData->ccu_serial_number, sizeof( pxData->ccu_serial_number ), "Ccu%d", rand() );
+    snprintf( pxData->skid_error_code, sizeof( pxData->skid_error_code ), "UNKNOWN_CODE: %d", rand() );
+    snprintf( pxData->unit_error_code, sizeof( pxData->unit_error_code ), "UNKNOWN_CODE: %d", rand() );
+}
+
+/* Same readings as the recorded controller frames, what a message looks like on the bench. */
+static void prvTypicalData( telemetry_data_t * pxData )
+{
+    static const double pdHeaters[ NUMBER_OF_HEATERS ] = { 95.5, 96.25, 97, 98.5, 99, 100.25, 101, 102.5, 103 };
+    sensor_info_t xSensor = { 0 };
+    uint8_t i;
+
+    memset( pxData, 0, sizeof( *pxData ) );
+    strcpy( pxData->timestamp_utc, "2024-02-02T10:00:00Z" );
+    strcpy( pxData->ccu_serial_number, "Ccu123" );
+    pxData->skid.skid_state = Adsorb_State;
+    pxData->unit.unit_state = Adsorb_State;
+
+    #define TEST_SENSOR( pxSensor, dValue )                                                     \
+    xSensor.stats.avg = SENSOR_VALUE( dValue );                                                 \
+    xSensor.stats.max = SENSOR_VALUE( ( dValue ) * 1.01 );                                      \
+    xSensor.stats.min = SENSOR_VALUE( ( dValue ) * 0.99 );                                      \
+    xSensor.stats.median = SENSOR_VALUE( ( dValue ) * 1.001 );                                  \
+    *( pxSensor ) = xSensor
+
+    TEST_SENSOR( &pxData->skid.o2_sensor, 20.9 );
+    TEST_SENSOR( &pxData->skid.mass_flow, 12.5 );
+    TEST_SENSOR( &pxData->skid.co2_sensor, 0.04 );
+    TEST_SENSOR( &pxData->skid.tank_pressure, 4.2 );
+    TEST_SENSOR( &pxData->skid.proportional_valve_pressure, 1.05 );
+    TEST_SENSOR( &pxData->skid.temperature, 25.5 );
+    TEST_SENSOR( &pxData->skid.humidity, 40 );
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        TEST_SENSOR( &pxData->unit.heater_info[ i ], pdHeaters[ i ] );
+    }
+
+    TEST_SENSOR( &pxData->unit.vacuum_sensor, 0.85 );
+    TEST_SENSOR( &pxData->unit.ambient_humidity, 45.5 );
+    TEST_SENSOR( &pxData->unit.ambient_temperature, 21.75 );
+
+    #undef TEST_SENSOR
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvRoundTrip( uint32_t ulType,
+                         uint32_t ulIteration )
+{
+    uint32_t ulCborLength;
+    uint32_t ulJsonLength;
+    uint32_t ulReadLength;
+
+    ulCborLength = telemetry_cbor_write( pxCborSchemas[ ulType ], &xData, ucCbor, sizeof( ucCbor ) );
+    ulJsonLength = telemetry_schema_write( pxJsonSchemas[ ulType ], &xData, ucJson, sizeof( ucJson ) );
+
+    if( ( ulCborLength == 0 ) || ( ulJsonLength == 0 ) )
+    {
+        printf( "\tFailed! %s message %u not written\n", pcMessageNames[ ulType ], ulIteration );
+        return 0;
+    }
+
+    memset( &xRead, 0, sizeof( xRead ) );
+
+    if( !telemetry_cbor_read( pxCborSchemas[ ulType ], ucCbor, ulCborLength, &xRead ) )
+    {
+        printf( "\tFailed! %s message %u not read back\n", pcMessageNames[ ulType ], ulIteration );
+        return 0;
+    }
+
+    ulReadLength = telemetry_schema_write( pxJsonSchemas[ ulType ], &xRead, ucJsonRead, sizeof( ucJsonRead ) );
+
+    if( ( ulReadLength != ulJsonLength ) || ( memcmp( ucJson, ucJsonRead, ulJsonLength ) != 0 ) )
+    {
+        printf( "\tFailed! %s message %u reads back differently\n\t%.*s\n\t%.*s\n", pcMessageNames[ ulType ], ulIteration,
+                ( int ) ulJsonLength, ucJson, ( int ) ulReadLength, ucJsonRead );
+        return 0;
+    }
+
+    /* Every shorter buffer has to be refused, by the writer and by the reader. */
+    if( ( telemetry_cbor_write( pxCborSchemas[ ulType ], &xData, ucCbor, ulCborLength - 1 ) != 0 ) ||
+        telemetry_cbor_read( pxCborSchemas[ ulType ], ucCbor, ulCborLength - 1 - ( uint32_t ) rand() % ulCborLength, &xRead ) )
+    {
+        printf( "\tFailed! %s message %u accepted a short buffer\n", pcMessageNames[ ulType ], ulIteration );
+        return 0;
+    }
+
+    /* Another message type is never taken for this one. */
+    if( telemetry_cbor_read( pxCborSchemas[ ( ulType + 1 ) % TEST_MESSAGE_TYPES ], ucCbor, ulCborLength, &xRead ) )
+    {
+        printf( "\tFailed! %s message %u read as a %s message\n", pcMessageNames[ ulType ], ulIteration,
+                pcMessageNames[ ( ulType + 1 ) % TEST_MESSAGE_TYPES ] );
+        return 0;
+    }
+
+    return 1;
+}
+
+static void prvBenchmark( void )
+{
+    uint32_t ulJsonLength;
+    uint32_t ulCborLength;
+    double xStart;
+    double xJsonNs;
+    double xCborNs;
+    uint32_t ulType;
+    uint32_t i;
+
+    prvTypicalData( &xData );
+
+    for( ulType = 0; ulType < TEST_MESSAGE_TYPES; ulType++ )
+    {
+        xData.skid.skid_state = ( ulType == 1 ) ? Lock_State : Adsorb_State;
+        xData.unit.unit_state = xData.skid.skid_state;
+
+        xStart = prvCpuTimeNs();
+
+        for( i = 0; i < TEST_BENCHMARK_MESSAGES; i++ )
+        {
+            ulJsonLength = telemetry_schema_write( pxJsonSchemas[ ulType ], &xData, ucJson, sizeof( ucJson ) );
+        }
+
+        xJsonNs = ( prvCpuTimeNs() - xStart ) / TEST_BENCHMARK_MESSAGES;
+        xStart = prvCpuTimeNs();
+
+        for( i = 0; i < TEST_BENCHMARK_MESSAGES; i++ )
+        {
+            ulCborLength = telemetry_cbor_write( pxCborSchemas[ ulType ], &xData, ucCbor, sizeof( ucCbor ) );
+        }
+
+        xCborNs = ( prvCpuTimeNs() - xStart ) / TEST_BENCHMARK_MESSAGES;
+
+        printf( "\t%-9s json %4u bytes %6.0f ns, cbor %4u bytes %6.0f ns, %.1fx smaller\n", pcMessageNames[ ulType ],
+                ulJsonLength, xJsonNs, ulCborLength, xCborNs, ( double ) ulJsonLength / ulCborLength );
+    }
+}
+
+int vStartTestTask( void )
+{
+    uint32_t ulType;
+    uint32_t i;
+
+    printf( "Round trip of %u random messages of each type\n", TEST_FUZZ_ITERATIONS );
+    srand( 1 );
+
+    for( i = 0; i < TEST_FUZZ_ITERATIONS; i++ )
+    {
+        prvRandomData( &xData );
+
+        for( ulType = 0; ulType < TEST_MESSAGE_TYPES; ulType++ )
+        {
+            if( !prvRoundTrip( ulType, i ) )
+            {
+                return TEST_TELEMETRY_CBOR_FAIL;
+            }
+        }
+    }
+
+    /* A field value the schema has no name for is refused, as in the JSON. */
+    xData.skid.compressor = ( component_status_t ) 7;
+
+    if( telemetry_cbor_write( &telemetry_message_cbor, &xData, ucCbor, sizeof( ucCbor ) ) != 0 )
+    {
+        printf( "\tFailed! enum out of range written\n" );
+        return TEST_TELEMETRY_CBOR_FAIL;
+    }
+
+    printf( "Size and CPU time per message, bench readings\n" );
+    prvBenchmark();
+
+    return TEST_TELEMETRY_CBOR_SUCCESS;
+}
@@ -0,0 +1,551 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE DELTA TELEMETRY
+ *
+ * Checks keyframes, change detection, deadbands that let slow drifts add up
+ * and that a message which did not fit publishes nothing. Then replays a
+ * controller trace through the same aggregation system_data.c does and
+ * reports the bytes the delta messages save over sending the full message
+ * every cycle. The trace is synthesised from the recorded frames, a raw uart
+ * capture can be replayed instead by pointing TELEMETRY_TRACE at it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_parser.h"
+#include "frame_layout.h"
+#include "running_stats.h"
+#include "sensor_value.h"
+#include "telemetry_schema.h"
+#include "telemetry_delta.h"
+#include "recorded_controller_frames.h"
+
+#define TEST_TELEMETRY_DELTA_SUCCESS    0
+#define TEST_TELEMETRY_DELTA_FAIL       1
+
+#define TEST_BUFFER_LENGTH              3456 /* SCRATCH_BUFFER_LENGTH in sample_azure_iot.c */
+#define TEST_WINDOW                     30   /* NUMBER_OF_SAMPLES in system_data.c */
+#define TEST_FRAMES_PER_PUBLISH         30   /* A frame a second, a publish every 30 seconds */
+#define TEST_TRACE_SECONDS              ( 2 * 60 * 60 )
+#define TEST_CYCLE_SECONDS              ( 40 * 60 )
+
+/* Statistics window of one sensor, as system_data.c keeps them. */
+typedef struct
+{
+    running_stats_t xStats;
+    running_stats_node_t xNodes[ TEST_WINDOW ];
+    sensor_value_t xSamples[ TEST_WINDOW ];
+    uint32_t ulOldest;
+} Channel_t;
+
+typedef struct
+{
+    uint32_t ulPublishes;
+    uint32_t ulKeyframes;
+    uint32_t ulDeltas;
+    uint32_t ulSkipped;
+    uint64_t ullFullBytes;
+    uint64_t ullDeltaBytes;
+} ReplayTotals_t;
+
+enum
+{
+    eSkidO2, eSkidMassFlow, eSkidCO2, eSkidTankPressure, eSkidValvePressure, eSkidTemperature, eSkidHumidity,
+    eUnitVacuum = eSkidHumidity + 1 + NUMBER_OF_HEATERS, eUnitAmbientHumidity, eUnitAmbientTemperature,
+    eChannelCount
+};
+#define eUnitHeater    ( eSkidHumidity + 1 )
+
+/* sensor_ranges in system_data.c, the heaters all share the first heater's. */
+static const sensor_value_t xRanges[ eChannelCount ][ 2 ] =
+{
+    [ eSkidO2 ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 100 ) },
+    [ eSkidMassFlow ] = { SENSOR_VALUE_LOWEST, SENSOR_VALUE( 60 ) },
+    [ eSkidCO2 ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 1 ) },
+    [ eSkidTankPressure ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 6 ) },
+    [ eSkidValvePressure ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 3 ) },
+    [ eSkidTemperature ] = { SENSOR_VALUE( -20 ), SENSOR_VALUE( 120 ) },
+    [ eSkidHumidity ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 100 ) },
+    [ eUnitHeater ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 150 ) },
+    [ eUnitVacuum ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 1.2 ) },
+    [ eUnitAmbientHumidity ] = { SENSOR_VALUE( 0 ), SENSOR_VALUE( 100 ) },
+    [ eUnitAmbientTemperature ] = { SENSOR_VALUE( -20 ), SENSOR_VALUE( 120 ) }
+};
+
+static Channel_t xChannels[ eChannelCount ];
+static UNIT_status_t xUnitFrame;
+static SKID_status_t xSkidFrame;
+static telemetry_data_t xData;
+static telemetry_delta_t xDelta;
+static uint8_t ucFull[ TEST_BUFFER_LENGTH ];
+static uint8_t ucMessage[ TEST_BUFFER_LENGTH ];
+
+/*-----------------------------------------------------------*/
+
+static void prvChannelsInit( void )
+{
+    uint32_t ulRange;
+    uint32_t i;
+
+    memset( xChannels, 0, sizeof( xChannels ) );
+
+    for( i = 0; i < eChannelCount; i++ )
+    {
+        ulRange = ( ( i > eUnitHeater ) && ( i < eUnitVacuum ) ) ? eUnitHeater : i;
+        running_stats_init( &xChannels[ i ].xStats, xChannels[ i ].xSamples, xChannels[ i ].xNodes, TEST_WINDOW,
+                            xRanges[ ulRange ][ 0 ], xRanges[ ulRange ][ 1 ], 0 );
+    }
+}
+
+static void prvAddSample( uint32_t ulChannel,
+                          sensor_value_t xValue )
+{
+    Channel_t * pxChannel = &xChannels[ ulChannel ];
+
+    running_stats_replace( &pxChannel->xStats, ( uint16_t ) pxChannel->ulOldest, xValue );
+    pxChannel->ulOldest = ( pxChannel->ulOldest + 1 ) % TEST_WINDOW;
+}
+
+static void prvFeedUnit( const UNIT_status_t * pxUnit )
+{
+    uint32_t i;
+
+    xUnitFrame = *pxUnit;
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        prvAddSample( eUnitHeater + i, pxUnit->heater_temperatures[ i ] );
+    }
+
+    prvAddSample( eUnitVacuum, pxUnit->vacuum_sensor );
+    prvAddSample( eUnitAmbientHumidity, pxUnit->ambient_humidity );
+    prvAddSample( eUnitAmbientTemperature, pxUnit->ambient_temperature );
+}
+
+static void prvFeedSkid( const SKID_status_t * pxSkid )
+{
+    xSkidFrame = *pxSkid;
+
+    prvAddSample( eSkidO2, pxSkid->o2_sensor );
+    prvAddSample( eSkidMassFlow, pxSkid->mass_flow );
+    prvAddSample( eSkidCO2, pxSkid->co2_sensor );
+    prvAddSample( eSkidTankPressure, pxSkid->tank_pressure );
+    prvAddSample( eSkidValvePressure, pxSkid->proportional_valve_pressure );
+    prvAddSample( eSkidTemperature, pxSkid->temperature );
+    prvAddSample( eSkidHumidity, pxSkid->humidity );
+}
+
+/* What get_skid_status and get_unit_status hand the demo task. */
+static void prvFillData( void )
+{
+    uint32_t i;
+
+    xData.skid.error_flag = ( xSkidFrame.skid_status & 0x01 ) ? FLAG_SET : FLAG_UNSET;
+    xData.skid.halt_flag = ( xSkidFrame.skid_status & 0x02 ) ? FLAG_SET : FLAG_UNSET;
+    xData.skid.reset_flag = ( xSkidFrame.skid_status & 0x04 ) ? FLAG_SET : FLAG_UNSET;
+    xData.skid.skid_state = xSkidFrame.skid_state;
+    xData.skid.two_way_gas_valve_before_water_trap = ( xSkidFrame.outputs_status & 0x0001 ) ? ONE : ZERO;
+    xData.skid.two_way_gas_valve_in_water_trap = ( xSkidFrame.outputs_status & 0x0002 ) ? ONE : ZERO;
+    xData.skid.two_way_gas_valve_after_water_trap = ( xSkidFrame.outputs_status & 0x0004 ) ? ONE : ZERO;
+    xData.skid.vacuum_release_valve_in_water_trap = ( xSkidFrame.outputs_status & 0x0008 ) ? ONE : ZERO;
+    xData.skid.three_way_vacuum_release_valve_before_condenser = ( xSkidFrame.outputs_status & 0x0010 ) ? ONE : ZERO;
+    xData.skid.three_valve_after_vacuum_pump = ( xSkidFrame.outputs_status & 0x0020 ) ? ONE : ZERO;
+    xData.skid.compressor = ( xSkidFrame.outputs_status & 0x0040 ) ? ONE : ZERO;
+    xData.skid.vacuum_pump = ( xSkidFrame.outputs_status & 0x0080 ) ? ONE : ZERO;
+    xData.skid.condenser = ( xSkidFrame.outputs_status & 0x0100 ) ? ONE : ZERO;
+    running_stats_get( &xChannels[ eSkidO2 ].xStats, &xData.skid.o2_sensor.stats );
+    running_stats_get( &xChannels[ eSkidMassFlow ].xStats, &xData.skid.mass_flow.stats );
+    running_stats_get( &xChannels[ eSkidCO2 ].xStats, &xData.skid.co2_sensor.stats );
+    running_stats_get( &xChannels[ eSkidTankPressure ].xStats, &xData.skid.tank_pressure.stats );
+    running_stats_get( &xChannels[ eSkidValvePressure ].xStats, &xData.skid.proportional_valve_pressure.stats );
+    running_stats_get( &xChannels[ eSkidTemperature ].xStats, &xData.skid.temperature.stats );
+    running_stats_get( &xChannels[ eSkidHumidity ].xStats, &xData.skid.humidity.stats );
+
+    xData.unit.error_flag = ( xUnitFrame.unit_status & 0x01 ) ? FLAG_SET : FLAG_UNSET;
+    xData.unit.halt_flag = ( xUnitFrame.unit_status & 0x02 ) ? FLAG_SET : FLAG_UNSET;
+    xData.unit.reset_flag = ( xUnitFrame.unit_status & 0x04 ) ? FLAG_SET : FLAG_UNSET;
+    xData.unit.just_started_flag = ( xUnitFrame.unit_status & 0x08 ) ? FLAG_SET : FLAG_UNSET;
+    xData.unit.setup_state_synching_flag = ( xUnitFrame.unit_status & 0x10 ) ? FLAG_SET : FLAG_UNSET;
+    xData.unit.unit_state = xUnitFrame.unit_state;
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        xData.unit.heater_info[ i ].status = ( xUnitFrame.heater_status & ( 1 << i ) ) ? ONE : ZERO;
+        running_stats_get( &xChannels[ eUnitHeater + i ].xStats, &xData.unit.heater_info[ i ].stats );
+    }
+
+    xData.unit.fan_status = ( xUnitFrame.valve_status & 0x01 ) ? ONE : ZERO;
+    xData.unit.butterfly_valve_1_status = ( xUnitFrame.valve_status & 0x02 ) ? ONE : ZERO;
+    xData.unit.butterfly_valve_2_status = ( xUnitFrame.valve_status & 0x04 ) ? ONE : ZERO;
+    running_stats_get( &xChannels[ eUnitVacuum ].xStats, &xData.unit.vacuum_sensor.stats );
+    running_stats_get( &xChannels[ eUnitAmbientHumidity ].xStats, &xData.unit.ambient_humidity.stats );
+    running_stats_get( &xChannels[ eUnitAmbientTemperature ].xStats, &xData.unit.ambient_temperature.stats );
+}
+
+/* One publish cycle, the full message for comparison and what the delta sends. */
+static int prvPublish( ReplayTotals_t * pxTotals,
+                       uint32_t ulSecond )
+{
+    telemetry_delta_result_t xResult;
+    uint32_t ulFullLength;
+    uint32_t ulLength;
+
+    prvFillData();
+    snprintf( xData.timestamp_utc, sizeof( xData.timestamp_utc ), "2024-02-02T%02u:%02u:%02uZ",
+              ( ulSecond / 3600 ) % 24, ( ulSecond / 60 ) % 60, ulSecond % 60 );
+
+    ulFullLength = telemetry_schema_write( &telemetry_message_schema, &xData, ucFull, sizeof( ucFull ) );
+    xResult = telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength );
+
+    if( ( ulFullLength == 0 ) || ( xResult == TELEMETRY_DELTA_NO_SPACE ) )
+    {
+        printf( "\tFailed! telemetry at %us does not fit\n", ulSecond );
+        return 0;
+    }
+
+    pxTotals->ulPublishes++;
+    pxTotals->ullFullBytes += ulFullLength;
+    pxTotals->ullDeltaBytes += ulLength;
+    pxTotals->ulKeyframes += ( xResult == TELEMETRY_DELTA_KEYFRAME );
+    pxTotals->ulDeltas += ( xResult == TELEMETRY_DELTA_CHANGES );
+    pxTotals->ulSkipped += ( xResult == TELEMETRY_DELTA_NO_CHANGE );
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+static double prvNoise( double dAmplitude )
+{
+    return dAmplitude * ( ( double ) rand() / RAND_MAX * 2.0 - 1.0 );
+}
+
+/* Two hours of a unit going through adsorb, evacuation, desorb and vacuum release,
+ * built on the values of the recorded frames. */
+static int prvReplaySynthetic( ReplayTotals_t * pxTotals )
+{
+    static const struct
+    {
+        uint32_t ulUntil; /* Seconds into the cycle */
+        sequence_state_t xState;
+        uint16_t usOutputs;
+        uint8_t ucValves;
+        uint16_t usHeaters;
+    }
+    xPhases[] =
+    {
+        { 25 * 60, Adsorb_State,         0x0041, 0x03, 0x0000 },
+        { 28 * 60, Evacuation_State,     0x00A4, 0x00, 0x0000 },
+        { 38 * 60, Desorb_State,         0x01A4, 0x00, 0x01FF },
+        { 40 * 60, Vacuum_Release_State, 0x0018, 0x04, 0x0000 }
+    };
+    UNIT_status_t xUnitBase;
+    SKID_status_t xSkidBase;
+    UNIT_status_t xUnit;
+    SKID_status_t xSkid;
+    double dHeater = 25.0;
+    double dVacuum = 1.0;
+    uint32_t ulSecond;
+    uint32_t ulPhase;
+    uint32_t i;
+
+    frame_layout_decode( &unit_status_layout, ucRecordedUnitFrame, &xUnitBase );
+    frame_layout_decode( &skid_status_layout, ucRecordedSkidFrame, &xSkidBase );
+    srand( 1 );
+
+    for( ulSecond = 1; ulSecond <= TEST_TRACE_SECONDS; ulSecond++ )
+    {
+        for( ulPhase = 0; ( ulSecond % TEST_CYCLE_SECONDS ) >= xPhases[ ulPhase ].ulUntil; ulPhase++ )
+        {
+        }
+
+        xUnit = xUnitBase;
+        xSkid = xSkidBase;
+
+        xUnit.unit_state = xPhases[ ulPhase ].xState;
+        xUnit.heater_status = xPhases[ ulPhase ].usHeaters;
+        xUnit.valve_status = xPhases[ ulPhase ].ucValves;
+        xSkid.skid_state = xPhases[ ulPhase ].xState;
+        xSkid.outputs_status = xPhases[ ulPhase ].usOutputs;
+
+        /* Heaters ramp to 100 C while on and cool down slowly otherwise, the vacuum follows the pump. */
+        dHeater += ( xUnit.heater_status != 0 ) ? ( 100.0 - dHeater ) / 60.0 : ( 25.0 - dHeater ) / 600.0;
+        dVacuum += ( xSkid.outputs_status & 0x0080 ) ? ( 0.02 - dVacuum ) / 30.0 : ( 1.0 - dVacuum ) / 20.0;
+
+        for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+        {
+            xUnit.heater_temperatures[ i ] = SENSOR_VALUE( dHeater + i * 0.25 + prvNoise( 0.3 ) );
+        }
+
+        xUnit.vacuum_sensor = SENSOR_VALUE( dVacuum + prvNoise( 0.005 ) );
+        xUnit.ambient_humidity = SENSOR_VALUE( 45.0 + 5.0 * ulSecond / TEST_TRACE_SECONDS + prvNoise( 0.4 ) );
+        xUnit.ambient_temperature = SENSOR_VALUE( 21.0 + 1.5 * ulSecond / TEST_TRACE_SECONDS + prvNoise( 0.2 ) );
+
+        xSkid.o2_sensor += SENSOR_VALUE( prvNoise( 0.05 ) );
+        xSkid.mass_flow = ( xSkid.outputs_status & 0x0040 ) ? xSkid.mass_flow + SENSOR_VALUE( prvNoise( 0.3 ) ) : 0;
+        xSkid.co2_sensor += SENSOR_VALUE( prvNoise( 0.002 ) );
+        xSkid.tank_pressure += SENSOR_VALUE( 0.3 * ulSecond / TEST_TRACE_SECONDS + prvNoise( 0.01 ) );
+        xSkid.proportional_valve_pressure += SENSOR_VALUE( prvNoise( 0.01 ) );
+        xSkid.temperature += SENSOR_VALUE( prvNoise( 0.2 ) );
+        xSkid.humidity += SENSOR_VALUE( prvNoise( 0.4 ) );
+
+        prvFeedUnit( &xUnit );
+        prvFeedSkid( &xSkid );
+
+        if( ( ( ulSecond % TEST_FRAMES_PER_PUBLISH ) == 0 ) && !prvPublish( pxTotals, ulSecond ) )
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Raw bytes captured from the controller uart, publishing every TEST_FRAMES_PER_PUBLISH unit frames. */
+static int prvReplayCapture( const char * pcPath,
+                             ReplayTotals_t * pxTotals )
+{
+    static frame_parser_t xParser;
+    UNIT_status_t xUnit;
+    SKID_status_t xSkid;
+    uint8_t ucChunk[ 256 ];
+    uint16_t usConsumed;
+    uint32_t ulUnitFrames = 0;
+    size_t xRead;
+    size_t xOffset;
+    FILE * pxFile = fopen( pcPath, "rb" );
+
+    if( pxFile == NULL )
+    {
+        printf( "\tFailed! cannot open %s\n", pcPath );
+        return 0;
+    }
+
+    frame_parser_init( &xParser );
+
+    while( ( xRead = fread( ucChunk, 1, sizeof( ucChunk ), pxFile ) ) > 0 )
+    {
+        for( xOffset = 0; xOffset < xRead; xOffset += usConsumed )
+        {
+            switch( frame_parser_push( &xParser, ucChunk + xOffset, ( uint16_t ) ( xRead - xOffset ), &usConsumed ) )
+            {
+                case FRAME_UNIT_STATUS:
+                    frame_layout_decode( &unit_status_layout, xParser.data, &xUnit );
+                    prvFeedUnit( &xUnit );
+
+                    if( ( ( ++ulUnitFrames % TEST_FRAMES_PER_PUBLISH ) == 0 ) && !prvPublish( pxTotals, ulUnitFrames ) )
+                    {
+                        fclose( pxFile );
+                        return 0;
+                    }
+
+                    break;
+
+                case FRAME_SKID_STATUS:
+                    frame_layout_decode( &skid_status_layout, xParser.data, &xSkid );
+                    prvFeedSkid( &xSkid );
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    fclose( pxFile );
+    printf( "\t%s: %u frames, %u crc failures, %u bytes skipped\n", pcPath, xParser.counters.frames,
+            xParser.counters.crc_failures, xParser.counters.skipped_bytes );
+
+    return 1;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCheckResult( const char * pcStep,
+                           telemetry_delta_result_t xResult,
+                           telemetry_delta_result_t xExpected )
+{
+    if( xResult != xExpected )
+    {
+        printf( "\tFailed! %s: result %d, expected %d\n", pcStep, xResult, xExpected );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvCheckDelta( void )
+{
+    uint32_t ulLength;
+    uint32_t ulFullLength;
+    uint32_t i;
+
+    memset( &xData, 0, sizeof( xData ) );
+    strcpy( xData.timestamp_utc, "2024-02-02T10:00:00Z" );
+    strcpy( xData.ccu_serial_number, "CCU-1" );
+    xData.skid.skid_state = Adsorb_State;
+    xData.skid.temperature.stats.avg = SENSOR_VALUE( 20 );
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        xData.unit.heater_info[ i ].stats.avg = SENSOR_VALUE( 95 );
+    }
+
+    telemetry_delta_init( &xDelta, 3 );
+    ulFullLength = telemetry_schema_write( &telemetry_message_schema, &xData, ucFull, sizeof( ucFull ) );
+
+    if( !prvCheckResult( "first message", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_KEYFRAME ) )
+    {
+        return 0;
+    }
+
+    if( ( ulLength != ulFullLength ) || ( memcmp( ucMessage, ucFull, ulLength ) != 0 ) )
+    {
+        printf( "\tFailed! keyframe is not the full telemetry message\n" );
+        return 0;
+    }
+
+    if( !prvCheckResult( "unchanged", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_NO_CHANGE ) || ( ulLength != 0 ) )
+    {
+        return 0;
+    }
+
+    /* A component switching is sent on its own, the heaters above the deadband are not. */
+    xData.skid.compressor = ONE;
+    xData.unit.heater_info[ 4 ].stats.avg += SENSOR_VALUE( 0.3 );
+
+    if( !prvCheckResult( "compressor on", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_CHANGES ) )
+    {
+        return 0;
+    }
+
+    ucMessage[ ulLength ] = '\0';
+
+    if( ( xDelta.changes != 1 ) || ( strstr( ( char * ) ucMessage, "\"ccu.component_status.compressor\":\"ON\"" ) == NULL ) ||
+        ( strncmp( ( char * ) ucMessage, "{\"version\":\"1.0\",\"timestamp_utc\":\"2024-02-02T10:00:00Z\"", 55 ) != 0 ) ||
+        ( strcmp( ( char * ) ucMessage + ulLength - 2, "}}" ) != 0 ) )
+    {
+        printf( "\tFailed! unexpected delta: %s\n", ucMessage );
+        return 0;
+    }
+
+    /* Keyframe interval 3: the 4th message is a full one again. */
+    if( !prvCheckResult( "keyframe interval", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_KEYFRAME ) )
+    {
+        return 0;
+    }
+
+    /* Drift below the deadband is held back until it adds up past it. */
+    telemetry_delta_init( &xDelta, TELEMETRY_KEYFRAME_INTERVAL );
+
+    if( !prvCheckResult( "restart", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_KEYFRAME ) )
+    {
+        return 0;
+    }
+
+    xData.unit.heater_info[ 4 ].stats.avg += SENSOR_VALUE( 0.3 );
+
+    if( !prvCheckResult( "small drift", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_NO_CHANGE ) )
+    {
+        return 0;
+    }
+
+    xData.unit.heater_info[ 4 ].stats.avg += SENSOR_VALUE( 0.3 );
+
+    /* Not enough space publishes nothing, the change is still sent next time. */
+    if( !prvCheckResult( "short buffer", telemetry_delta_write( &xDelta, &xData, ucMessage, 120, &ulLength ),
+                         TELEMETRY_DELTA_NO_SPACE ) || ( ulLength != 0 ) )
+    {
+        return 0;
+    }
+
+    if( !prvCheckResult( "added up drift", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_CHANGES ) )
+    {
+        return 0;
+    }
+
+    ucMessage[ ulLength ] = '\0';
+
+    if( ( xDelta.changes != 1 ) || ( strstr( ( char * ) ucMessage, "\"units.1.cartridges.2.zones.2\":{\"status\":\"OFF\",\"avg\":95.8" ) == NULL ) )
+    {
+        printf( "\tFailed! unexpected delta: %s\n", ucMessage );
+        return 0;
+    }
+
+    /* A tighter deadband catches the same step, a forced keyframe overrides the interval. */
+    telemetry_delta_set_deadband( &xDelta, DEADBAND_TEMPERATURE, SENSOR_VALUE( 0.1 ) );
+    xData.unit.heater_info[ 4 ].stats.avg += SENSOR_VALUE( 0.2 );
+    telemetry_delta_force_keyframe( &xDelta );
+
+    if( !prvCheckResult( "forced keyframe", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                         TELEMETRY_DELTA_KEYFRAME ) )
+    {
+        return 0;
+    }
+
+    xData.unit.heater_info[ 4 ].stats.avg += SENSOR_VALUE( 0.2 );
+
+    return prvCheckResult( "tighter deadband", telemetry_delta_write( &xDelta, &xData, ucMessage, sizeof( ucMessage ), &ulLength ),
+                           TELEMETRY_DELTA_CHANGES );
+}
+
+int vStartTestTask( void )
+{
+    ReplayTotals_t xTotals = { 0 };
+    const char * pcTrace = getenv( "TELEMETRY_TRACE" );
+    int lReplayed;
+
+    printf( "Checking keyframes, changes and deadbands\n" );
+
+    if( !prvCheckDelta() )
+    {
+        return TEST_TELEMETRY_DELTA_FAIL;
+    }
+
+    memset( &xData, 0, sizeof( xData ) );
+    strcpy( xData.ccu_serial_number, "CCU-1" );
+    prvChannelsInit();
+    telemetry_delta_init( &xDelta, TELEMETRY_KEYFRAME_INTERVAL );
+
+    if( pcTrace != NULL )
+    {
+        printf( "Replaying %s, keyframe every %u publishes\n", pcTrace, TELEMETRY_KEYFRAME_INTERVAL );
+        lReplayed = prvReplayCapture( pcTrace, &xTotals );
+    }
+    else
+    {
+        printf( "Replaying %u s of synthesised trace, keyframe every %u publishes\n", TEST_TRACE_SECONDS, TELEMETRY_KEYFRAME_INTERVAL );
+        lReplayed = prvReplaySynthetic( &xTotals );
+    }
+
+    if( !lReplayed || ( xTotals.ulPublishes == 0 ) )
+    {
+        return TEST_TELEMETRY_DELTA_FAIL;
+    }
+
+    printf( "\t%u publishes: %u keyframes, %u deltas, %u without changes\n",
+            xTotals.ulPublishes, xTotals.ulKeyframes, xTotals.ulDeltas, xTotals.ulSkipped );
+    printf( "\tfull messages %llu bytes, delta %llu bytes, %.1f %% saved\n",
+            ( unsigned long long ) xTotals.ullFullBytes, ( unsigned long long ) xTotals.ullDeltaBytes,
+            100.0 * ( double ) ( xTotals.ullFullBytes - xTotals.ullDeltaBytes ) / ( double ) xTotals.ullFullBytes );
+
+    if( xTotals.ullDeltaBytes >= xTotals.ullFullBytes )
+    {
+        printf( "\tFailed! delta telemetry is not smaller than the full messages\n" );
+        return TEST_TELEMETRY_DELTA_FAIL;
+    }
+
+    return TEST_TELEMETRY_DELTA_SUCCESS;
+}
@@ -0,0 +1,701 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE STORE-AND-FORWARD TELEMETRY QUEUE
+ *
+ * First pushes, batches and drops random records against a plain FIFO model of
+ * what the queue should hold, so wrapping, drop-oldest and drop-newest are
+ * checked on every step, and no record is left without the one it depends on. Then runs the publish cycle of the demo against a
+ * loopback broker: a TCP listener that acknowledges every batch like a QoS1
+ * PUBACK. The broker is cut in the middle of the run and brought back later,
+ * the records sampled during the outage have to arrive in order once the
+ * publisher reconnects, minus what the policy dropped. The run is repeated with
+ * a file standing in for the flash spill, nothing may be lost then.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "telemetry_queue.h"
+
+#define TEST_TELEMETRY_QUEUE_SUCCESS    0
+#define TEST_TELEMETRY_QUEUE_FAIL       1
+
+#define TEST_QUEUE_LENGTH               1024
+#define TEST_RECORD_LENGTH              96
+#define TEST_MODEL_RECORDS              ( TEST_QUEUE_LENGTH / 3 + 1 )
+#define TEST_FUZZ_STEPS                 200000
+#define TEST_BATCH_LENGTH               512
+#define TEST_BATCH_RECORDS              8
+
+#define TEST_CYCLES                     200
+#define TEST_OUTAGE_START               50
+#define TEST_OUTAGE_END                 150
+#define TEST_RECONNECT_CYCLES           5    /* Cycles between attempts while the broker is away */
+#define TEST_GROUP_RECORDS              5    /* A keyframe and the deltas after it */
+
+#define TEST_SPILL_RECORDS              256
+
+static uint8_t ucQueueBuffer[ TEST_QUEUE_LENGTH ];
+static uint8_t ucBatch[ TEST_BATCH_LENGTH ];
+static uint8_t ucExpected[ TEST_BATCH_LENGTH ];
+static telemetry_queue_t xQueue;
+
+/*-----------------------------------------------------------*/
+
+/* What the queue should hold, oldest first. */
+typedef struct
+{
+    uint8_t ucRecords[ TEST_MODEL_RECORDS ][ TEST_RECORD_LENGTH ];
+    uint16_t usLengths[ TEST_MODEL_RECORDS ];
+    bool xDependent[ TEST_MODEL_RECORDS ];
+    uint32_t ulHead;
+    uint32_t ulCount;
+} ModelQueue_t;
+
+static ModelQueue_t xModel;
+
+static void prvModelPush( const uint8_t * pucRecord,
+                          uint16_t usLength,
+                          bool xDependent )
+{
+    uint32_t ulIndex = ( xModel.ulHead + xModel.ulCount ) % TEST_MODEL_RECORDS;
+
+    memcpy( xModel.ucRecords[ ulIndex ], pucRecord, usLength );
+    xModel.usLengths[ ulIndex ] = usLength;
+    xModel.xDependent[ ulIndex ] = xDependent;
+    xModel.ulCount++;
+}
+
+static void prvModelDrop( uint32_t ulRecords )
+{
+    xModel.ulHead = ( xModel.ulHead + ulRecords ) % TEST_MODEL_RECORDS;
+    xModel.ulCount -= ulRecords;
+}
+
+/* The batch the queue should write for the first ulRecords of the model. */
+static uint32_t prvModelBatch( uint32_t ulRecords,
+                               const telemetry_queue_format_t * pxFormat )
+{
+    uint32_t ulLength = 0;
+    uint32_t i;
+
+    if( ulRecords == 1 )
+    {
+        memcpy( ucExpected, xModel.ucRecords[ xModel.ulHead ], xModel.usLengths[ xModel.ulHead ] );
+        return xModel.usLengths[ xModel.ulHead ];
+    }
+
+    memcpy( ucExpected, pxFormat->begin, strlen( pxFormat->begin ) );
+    ulLength += strlen( pxFormat->begin );
+
+    for( i = 0; i < ulRecords; i++ )
+    {
+        uint32_t ulIndex = ( xModel.ulHead + i ) % TEST_MODEL_RECORDS;
+
+        if( i != 0 )
+        {
+            memcpy( ucExpected + ulLength, pxFormat->separator, strlen( pxFormat->separator ) );
+            ulLength += strlen( pxFormat->separator );
+        }
+
+        memcpy( ucExpected + ulLength, xModel.ucRecords[ ulIndex ], xModel.usLengths[ ulIndex ] );
+        ulLength += xModel.usLengths[ ulIndex ];
+    }
+
+    memcpy( ucExpected + ulLength, pxFormat->end, strlen( pxFormat->end ) );
+    return ulLength + strlen( pxFormat->end );
+}
+
+static int prvFuzz( telemetry_queue_policy_t xPolicy,
+                    const telemetry_queue_format_t * pxFormat )
+{
+    uint8_t ucRecord[ TEST_RECORD_LENGTH ];
+    uint32_t ulStep;
+
+    telemetry_queue_init( &xQueue, ucQueueBuffer, sizeof( ucQueueBuffer ), xPolicy, NULL );
+    memset( &xModel, 0, sizeof( xModel ) );
+    srand( 1 );
+
+    for( ulStep = 0; ulStep < TEST_FUZZ_STEPS; ulStep++ )
+    {
+        /* Pushing a bit more often than sending keeps the queue full most of the time. */
+        if( rand() % 5 < 3 )
+        {
+            uint16_t usLength = 1 + rand() % TEST_RECORD_LENGTH;
+            bool xDependent = ( rand() % 4 != 0 );
+            uint32_t ulDropped = xQueue.stats.dropped;
+            uint32_t ulRejected = xQueue.stats.rejected;
+            telemetry_queue_result_t xResult;
+            uint16_t i;
+
+            for( i = 0; i < usLength; i++ )
+            {
+                ucRecord[ i ] = ( uint8_t ) ( ulStep + i );
+            }
+
+            xResult = telemetry_queue_push( &xQueue, ucRecord, usLength, xDependent );
+            prvModelDrop( xQueue.stats.dropped - ulDropped );
+
+            /* Drop-oldest only refuses a record when the one it depends on went. */
+            if( xResult == TELEMETRY_QUEUE_REJECTED )
+            {
+                if( ( xQueue.stats.rejected != ulRejected + 1 ) ||
+                    ( ( xPolicy == TELEMETRY_QUEUE_DROP_OLDEST ) && ( !xDependent || ( xModel.ulCount != 0 ) ) ) )
+                {
+                    printf( "\tFailed! step %u: %u byte record rejected\n", ulStep, usLength );
+                    return TEST_TELEMETRY_QUEUE_FAIL;
+                }
+            }
+            else
+            {
+                if( ( xResult == TELEMETRY_QUEUE_DROPPED ) != ( xQueue.stats.dropped != ulDropped ) )
+                {
+                    printf( "\tFailed! step %u: result does not match the dropped count\n", ulStep );
+                    return TEST_TELEMETRY_QUEUE_FAIL;
+                }
+
+                prvModelPush( ucRecord, usLength, xDependent );
+            }
+
+            if( ( xQueue.stats.dropped != ulDropped ) && ( xModel.ulCount != 0 ) && xModel.xDependent[ xModel.ulHead ] )
+            {
+                printf( "\tFailed! step %u: oldest record left without the one it depends on\n", ulStep );
+                return TEST_TELEMETRY_QUEUE_FAIL;
+            }
+        }
+        else
+        {
+            uint32_t ulMaxRecords = 1 + rand() % TEST_BATCH_RECORDS;
+            uint32_t ulSize = 16 + rand() % ( TEST_BATCH_LENGTH - 16 );
+            uint32_t ulRecords;
+            uint32_t ulLength = telemetry_queue_batch( &xQueue, ulMaxRecords, pxFormat, ucBatch, ulSize, &ulRecords );
+
+            if( ( ulRecords > ulMaxRecords ) || ( ulRecords > xModel.ulCount ) || ( ulLength > ulSize ) ||
+                ( ( ulRecords == 0 ) && ( xModel.ulCount != 0 ) && ( xModel.usLengths[ xModel.ulHead ] <= ulSize ) ) )
+            {
+                printf( "\tFailed! step %u: batch of %u records, %u bytes\n", ulStep, ulRecords, ulLength );
+                return TEST_TELEMETRY_QUEUE_FAIL;
+            }
+
+            if( ulRecords == 0 )
+            {
+                continue;
+            }
+
+            if( ( prvModelBatch( ulRecords, pxFormat ) != ulLength ) || ( memcmp( ucBatch, ucExpected, ulLength ) != 0 ) )
+            {
+                printf( "\tFailed! step %u: batch of %u records does not hold the oldest ones\n", ulStep, ulRecords );
+                return TEST_TELEMETRY_QUEUE_FAIL;
+            }
+
+            /* Every other send fails, the records have to stay. */
+            if( rand() % 2 == 0 )
+            {
+                telemetry_queue_drop( &xQueue, ulRecords );
+                prvModelDrop( ulRecords );
+            }
+        }
+
+        if( telemetry_queue_count( &xQueue ) != xModel.ulCount )
+        {
+            printf( "\tFailed! step %u: %u records queued, %u expected\n", ulStep,
+                    telemetry_queue_count( &xQueue ), xModel.ulCount );
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+    }
+
+    printf( "\t%u steps, queued=%u sent=%u dropped=%u rejected=%u\n", TEST_FUZZ_STEPS,
+            xQueue.stats.queued, xQueue.stats.sent, xQueue.stats.dropped, xQueue.stats.rejected );
+
+    return TEST_TELEMETRY_QUEUE_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+/* Data flash stand-in: records appended to a file, an index of where each one starts. */
+typedef struct
+{
+    FILE * pxFile;
+    long lOffsets[ TEST_SPILL_RECORDS ];
+    uint16_t usLengths[ TEST_SPILL_RECORDS ];
+    bool xDependent[ TEST_SPILL_RECORDS ];
+    uint32_t ulFirst;
+    uint32_t ulCount;
+    uint32_t ulLimit;  /* Records it takes before it counts as full */
+} FileSpill_t;
+
+static FileSpill_t xFileSpill;
+
+static bool prvSpillPush( void * pvContext,
+                          const uint8_t * pucRecord,
+                          uint16_t usLength,
+                          bool xDependent )
+{
+    FileSpill_t * pxSpill = ( FileSpill_t * ) pvContext;
+    uint32_t ulIndex = ( pxSpill->ulFirst + pxSpill->ulCount ) % TEST_SPILL_RECORDS;
+
+    if( pxSpill->ulCount >= pxSpill->ulLimit )
+    {
+        return false;
+    }
+
+    fseek( pxSpill->pxFile, 0, SEEK_END );
+    pxSpill->lOffsets[ ulIndex ] = ftell( pxSpill->pxFile );
+    pxSpill->usLengths[ ulIndex ] = usLength;
+    pxSpill->xDependent[ ulIndex ] = xDependent;
+    pxSpill->ulCount++;
+
+    return fwrite( pucRecord, 1, usLength, pxSpill->pxFile ) == usLength;
+}
+
+static uint16_t prvSpillRead( void * pvContext,
+                              uint32_t ulIndex,
+                              uint8_t * pucBuffer,
+                              uint32_t ulSize )
+{
+    FileSpill_t * pxSpill = ( FileSpill_t * ) pvContext;
+
+    ulIndex = ( pxSpill->ulFirst + ulIndex ) % TEST_SPILL_RECORDS;
+
+    if( pxSpill->usLengths[ ulIndex ] > ulSize )
+    {
+        return 0;
+    }
+
+    fseek( pxSpill->pxFile, pxSpill->lOffsets[ ulIndex ], SEEK_SET );
+
+    return ( uint16_t ) fread( pucBuffer, 1, pxSpill->usLengths[ ulIndex ], pxSpill->pxFile );
+}
+
+static void prvSpillDrop( void * pvContext,
+                          uint32_t ulRecords )
+{
+    FileSpill_t * pxSpill = ( FileSpill_t * ) pvContext;
+
+    pxSpill->ulFirst = ( pxSpill->ulFirst + ulRecords ) % TEST_SPILL_RECORDS;
+    pxSpill->ulCount -= ulRecords;
+
+    /* Erase once everything went out, like a flash sector. */
+    if( pxSpill->ulCount == 0 )
+    {
+        pxSpill->ulFirst = 0;
+        fflush( pxSpill->pxFile );
+
+        if( ftruncate( fileno( pxSpill->pxFile ), 0 ) != 0 )
+        {
+            printf( "\tFailed! spill file not erased\n" );
+        }
+    }
+}
+
+static uint32_t prvSpillCount( void * pvContext )
+{
+    return ( ( FileSpill_t * ) pvContext )->ulCount;
+}
+
+static bool prvSpillDependent( void * pvContext )
+{
+    FileSpill_t * pxSpill = ( FileSpill_t * ) pvContext;
+
+    return pxSpill->xDependent[ pxSpill->ulFirst ];
+}
+
+static const telemetry_queue_spill_t xSpill =
+{
+    .context   = &xFileSpill,
+    .push      = prvSpillPush,
+    .read      = prvSpillRead,
+    .drop      = prvSpillDrop,
+    .count     = prvSpillCount,
+    .dependent = prvSpillDependent
+};
+/*-----------------------------------------------------------*/
+
+/* Loopback broker: takes one connection, answers every frame with a one byte PUBACK. */
+typedef struct
+{
+    int lListener;
+    int lConnection;
+    uint16_t usPort;
+    uint32_t ulNextSequence;  /* Lowest sequence number it may see next */
+    uint32_t ulReceived;
+    uint32_t ulFirstMissing;  /* Sequence numbers that never arrived, expected in one run */
+    uint32_t ulMissing;
+    uint32_t ulFrames;
+} Broker_t;
+
+static Broker_t xBroker;
+
+static int prvBrokerStart( void )
+{
+    struct sockaddr_in xAddress = { 0 };
+    socklen_t xAddressLength = sizeof( xAddress );
+    int lReuse = 1;
+
+    xBroker.lListener = socket( AF_INET, SOCK_STREAM, 0 );
+    setsockopt( xBroker.lListener, SOL_SOCKET, SO_REUSEADDR, &lReuse, sizeof( lReuse ) );
+
+    /* The first start picks a free port, a restart listens on the same one. */
+    xAddress.sin_family = AF_INET;
+    xAddress.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    xAddress.sin_port = htons( xBroker.usPort );
+
+    if( ( bind( xBroker.lListener, ( struct sockaddr * ) &xAddress, sizeof( xAddress ) ) != 0 ) ||
+        ( listen( xBroker.lListener, 1 ) != 0 ) ||
+        ( getsockname( xBroker.lListener, ( struct sockaddr * ) &xAddress, &xAddressLength ) != 0 ) )
+    {
+        printf( "\tFailed! loopback broker could not listen\n" );
+        return -1;
+    }
+
+    xBroker.usPort = ntohs( xAddress.sin_port );
+    xBroker.lConnection = -1;
+
+    return 0;
+}
+
+/* Cuts the connection and stops listening, like the WiFi going away. */
+static void prvBrokerCut( void )
+{
+    if( xBroker.lConnection >= 0 )
+    {
+        close( xBroker.lConnection );
+        xBroker.lConnection = -1;
+    }
+
+    close( xBroker.lListener );
+    xBroker.lListener = -1;
+}
+
+static bool prvReadAll( int lSocket,
+                        uint8_t * pucBuffer,
+                        uint32_t ulLength )
+{
+    while( ulLength != 0 )
+    {
+        ssize_t lRead = recv( lSocket, pucBuffer, ulLength, 0 );
+
+        if( lRead <= 0 )
+        {
+            return false;
+        }
+
+        pucBuffer += lRead;
+        ulLength -= ( uint32_t ) lRead;
+    }
+
+    return true;
+}
+
+/* Takes the sequence numbers out of a batch and checks they only go up, and
+ * that a gap is never followed by a record that depends on what is missing. */
+static bool prvBrokerReceive( const char * pcMessage )
+{
+    const char * pcRecord = pcMessage;
+    unsigned int ulSequence;
+    unsigned int ulDependent;
+
+    while( ( pcRecord = strstr( pcRecord, "\"seq\":" ) ) != NULL )
+    {
+        sscanf( pcRecord, "\"seq\":%u,\"dep\":%u", &ulSequence, &ulDependent );
+        pcRecord++;
+
+        if( ulSequence < xBroker.ulNextSequence )
+        {
+            printf( "\tFailed! record %u arrived after %u\n", ulSequence, xBroker.ulNextSequence - 1 );
+            return false;
+        }
+
+        if( ulSequence > xBroker.ulNextSequence )
+        {
+            if( xBroker.ulMissing != 0 )
+            {
+                printf( "\tFailed! records %u to %u missing as well\n", xBroker.ulNextSequence, ulSequence - 1 );
+                return false;
+            }
+
+            if( ulDependent != 0 )
+            {
+                printf( "\tFailed! record %u arrived without the one it depends on\n", ulSequence );
+                return false;
+            }
+
+            xBroker.ulFirstMissing = xBroker.ulNextSequence;
+            xBroker.ulMissing = ulSequence - xBroker.ulNextSequence;
+        }
+
+        xBroker.ulNextSequence = ulSequence + 1;
+        xBroker.ulReceived++;
+    }
+
+    return true;
+}
+
+/* Serves what the publisher sent, run between its send and the wait for the PUBACK. */
+static bool prvBrokerService( void )
+{
+    uint8_t ucHeader[ 4 ];
+    static char cMessage[ TEST_BATCH_LENGTH + 1 ];
+    uint32_t ulLength;
+    uint8_t ucAck = 0x40;
+
+    if( xBroker.lConnection < 0 )
+    {
+        if( xBroker.lListener < 0 )
+        {
+            return true;
+        }
+
+        xBroker.lConnection = accept( xBroker.lListener, NULL, NULL );
+    }
+
+    if( !prvReadAll( xBroker.lConnection, ucHeader, sizeof( ucHeader ) ) )
+    {
+        return true;
+    }
+
+    ulLength = ( uint32_t ) ucHeader[ 0 ] | ( ( uint32_t ) ucHeader[ 1 ] << 8 );
+
+    if( ( ulLength > TEST_BATCH_LENGTH ) || !prvReadAll( xBroker.lConnection, ( uint8_t * ) cMessage, ulLength ) )
+    {
+        printf( "\tFailed! broker got a broken frame\n" );
+        return false;
+    }
+
+    cMessage[ ulLength ] = '\0';
+    xBroker.ulFrames++;
+
+    if( !prvBrokerReceive( cMessage ) )
+    {
+        return false;
+    }
+
+    return send( xBroker.lConnection, &ucAck, 1, MSG_NOSIGNAL ) == 1;
+}
+/*-----------------------------------------------------------*/
+
+static int prvPublisherConnect( void )
+{
+    struct sockaddr_in xAddress = { 0 };
+    struct timeval xTimeout = { .tv_sec = 1 };
+    int lSocket = socket( AF_INET, SOCK_STREAM, 0 );
+
+    xAddress.sin_family = AF_INET;
+    xAddress.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    xAddress.sin_port = htons( xBroker.usPort );
+
+    if( connect( lSocket, ( struct sockaddr * ) &xAddress, sizeof( xAddress ) ) != 0 )
+    {
+        close( lSocket );
+        return -1;
+    }
+
+    setsockopt( lSocket, SOL_SOCKET, SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+    return lSocket;
+}
+
+/* AzureIoTHubClient_SendTelemetry with QoS1: the batch only counts as sent once acknowledged. */
+static bool prvPublisherSend( int lSocket,
+                              const uint8_t * pucMessage,
+                              uint32_t ulLength,
+                              bool * pxBrokerOk )
+{
+    static uint8_t ucFrame[ 4 + TEST_BATCH_LENGTH ] = { 0 };
+    uint8_t ucAck;
+
+    /* One send per frame, a header on its own would wait for the delayed ACK. */
+    ucFrame[ 0 ] = ( uint8_t ) ulLength;
+    ucFrame[ 1 ] = ( uint8_t ) ( ulLength >> 8 );
+    memcpy( ucFrame + 4, pucMessage, ulLength );
+
+    if( send( lSocket, ucFrame, 4 + ulLength, MSG_NOSIGNAL ) != ( ssize_t ) ( 4 + ulLength ) )
+    {
+        return false;
+    }
+
+    *pxBrokerOk = prvBrokerService();
+
+    return recv( lSocket, &ucAck, 1, 0 ) == 1;
+}
+
+/* The publish cycle of the demo: sample into the queue, then drain it while the hub is there. */
+static int prvOutage( telemetry_queue_policy_t xPolicy,
+                      const telemetry_queue_spill_t * pxSpill )
+{
+    char cRecord[ TEST_RECORD_LENGTH ];
+    uint32_t ulCycle;
+    uint32_t ulSessions = 0;
+    int lSocket = -1;
+    bool xBrokerOk = true;
+    bool xKeyframeDue = true;
+
+    memset( &xBroker, 0, sizeof( xBroker ) );
+    telemetry_queue_init( &xQueue, ucQueueBuffer, sizeof( ucQueueBuffer ), xPolicy, pxSpill );
+
+    if( prvBrokerStart() != 0 )
+    {
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    for( ulCycle = 0; ( ulCycle < TEST_CYCLES ) || ( telemetry_queue_count( &xQueue ) != 0 ); ulCycle++ )
+    {
+        if( ulCycle == TEST_OUTAGE_START )
+        {
+            prvBrokerCut();
+        }
+        else if( ( ulCycle == TEST_OUTAGE_END ) && ( prvBrokerStart() != 0 ) )
+        {
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+        else if( ulCycle > TEST_CYCLES + TEST_RECONNECT_CYCLES )
+        {
+            printf( "\tFailed! %u records never went out\n", telemetry_queue_count( &xQueue ) );
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+
+        /* Keyframes and deltas, a delta that could not be queued makes the next record a keyframe. */
+        if( ulCycle < TEST_CYCLES )
+        {
+            bool xDependent = !xKeyframeDue && ( ulCycle % TEST_GROUP_RECORDS != 0 );
+            int lLength = snprintf( cRecord, sizeof( cRecord ), "{\"seq\":%u,\"dep\":%u,\"avg\":%u}",
+                                    ulCycle, xDependent, rand() % 100000 );
+
+            xKeyframeDue = telemetry_queue_push( &xQueue, ( const uint8_t * ) cRecord, ( uint16_t ) lLength, xDependent ) ==
+                           TELEMETRY_QUEUE_REJECTED;
+        }
+
+        if( ( lSocket < 0 ) && ( ulCycle % TEST_RECONNECT_CYCLES == 0 ) )
+        {
+            lSocket = prvPublisherConnect();
+            ulSessions += ( lSocket >= 0 ) ? 1 : 0;
+        }
+
+        while( ( lSocket >= 0 ) && ( telemetry_queue_count( &xQueue ) != 0 ) )
+        {
+            uint32_t ulRecords;
+            uint32_t ulLength = telemetry_queue_batch( &xQueue, TEST_BATCH_RECORDS, &telemetry_queue_json,
+                                                       ucBatch, sizeof( ucBatch ), &ulRecords );
+
+            if( !prvPublisherSend( lSocket, ucBatch, ulLength, &xBrokerOk ) )
+            {
+                /* Records stay queued, reconnect later. */
+                close( lSocket );
+                lSocket = -1;
+                break;
+            }
+
+            telemetry_queue_drop( &xQueue, ulRecords );
+        }
+
+        if( !xBrokerOk )
+        {
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+    }
+
+    close( lSocket );
+    prvBrokerCut();
+
+    printf( "\t%u records in %u frames over %u sessions, dropped=%u rejected=%u spilled=%u, %u lost from record %u\n",
+            xBroker.ulReceived, xBroker.ulFrames, ulSessions, xQueue.stats.dropped, xQueue.stats.rejected, xQueue.stats.spilled,
+            xBroker.ulMissing, xBroker.ulFirstMissing );
+
+    if( ( xBroker.ulReceived + xBroker.ulMissing != TEST_CYCLES ) ||
+        ( xBroker.ulMissing != xQueue.stats.dropped + xQueue.stats.rejected ) ||
+        ( xQueue.stats.sent != xBroker.ulReceived ) )
+    {
+        printf( "\tFailed! records unaccounted for\n" );
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    if( ulSessions < 2 )
+    {
+        printf( "\tFailed! the outage was not noticed\n" );
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    /* Whatever was lost was sampled during the outage, the policy decides which end. */
+    if( xBroker.ulMissing != 0 )
+    {
+        bool xOldestDropped = ( xBroker.ulFirstMissing == TEST_OUTAGE_START ) &&
+                              ( xBroker.ulFirstMissing + xBroker.ulMissing < TEST_OUTAGE_END );
+        bool xNewestDropped = ( xBroker.ulFirstMissing > TEST_OUTAGE_START ) &&
+                              ( xBroker.ulFirstMissing + xBroker.ulMissing >= TEST_OUTAGE_END );
+
+        if( ( ( xPolicy == TELEMETRY_QUEUE_DROP_OLDEST ) && !xOldestDropped ) ||
+            ( ( xPolicy == TELEMETRY_QUEUE_DROP_NEWEST ) && !xNewestDropped ) )
+        {
+            printf( "\tFailed! the wrong records were lost\n" );
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+    }
+
+    return TEST_TELEMETRY_QUEUE_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+int vStartTestTask( void )
+{
+    const telemetry_queue_format_t * pxFormats[] = { &telemetry_queue_json, &telemetry_queue_cbor };
+    uint32_t i;
+
+    for( i = 0; i < 2; i++ )
+    {
+        printf( "Random pushes, batches and drops, %s batches\n", i == 0 ? "JSON" : "CBOR" );
+
+        if( ( prvFuzz( TELEMETRY_QUEUE_DROP_OLDEST, pxFormats[ i ] ) != TEST_TELEMETRY_QUEUE_SUCCESS ) ||
+            ( prvFuzz( TELEMETRY_QUEUE_DROP_NEWEST, pxFormats[ i ] ) != TEST_TELEMETRY_QUEUE_SUCCESS ) )
+        {
+            return TEST_TELEMETRY_QUEUE_FAIL;
+        }
+    }
+
+    printf( "Broker cut for cycles %u to %u, RAM only, dropping the oldest\n", TEST_OUTAGE_START, TEST_OUTAGE_END );
+
+    if( prvOutage( TELEMETRY_QUEUE_DROP_OLDEST, NULL ) != TEST_TELEMETRY_QUEUE_SUCCESS )
+    {
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    printf( "Broker cut for cycles %u to %u, RAM only, dropping the newest\n", TEST_OUTAGE_START, TEST_OUTAGE_END );
+
+    if( prvOutage( TELEMETRY_QUEUE_DROP_NEWEST, NULL ) != TEST_TELEMETRY_QUEUE_SUCCESS )
+    {
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    printf( "Broker cut for cycles %u to %u, spilling to a file\n", TEST_OUTAGE_START, TEST_OUTAGE_END );
+    xFileSpill.pxFile = tmpfile();
+    xFileSpill.ulLimit = TEST_SPILL_RECORDS;
+
+    if( ( xFileSpill.pxFile == NULL ) || ( prvOutage( TELEMETRY_QUEUE_DROP_OLDEST, &xSpill ) != TEST_TELEMETRY_QUEUE_SUCCESS ) ||
+        ( xQueue.stats.spilled == 0 ) || ( xQueue.stats.dropped != 0 ) )
+    {
+        printf( "\tFailed! spilling to a file\n" );
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    printf( "Broker cut for cycles %u to %u, spilling to a file that fills up\n", TEST_OUTAGE_START, TEST_OUTAGE_END );
+    xFileSpill.ulLimit = TEST_SPILL_RECORDS / 8;
+
+    if( ( prvOutage( TELEMETRY_QUEUE_DROP_OLDEST, &xSpill ) != TEST_TELEMETRY_QUEUE_SUCCESS ) ||
+        ( xQueue.stats.spilled == 0 ) || ( xQueue.stats.dropped == 0 ) )
+    {
+        printf( "\tFailed! spilling to a full file\n" );
+        return TEST_TELEMETRY_QUEUE_FAIL;
+    }
+
+    fclose( xFileSpill.pxFile );
+
+    return TEST_TELEMETRY_QUEUE_SUCCESS;
+}
+/*-----------------------------------------------------------*/
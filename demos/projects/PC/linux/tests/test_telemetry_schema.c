@@ -0,0 +1,547 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE TELEMETRY SCHEMAS
+ *
+ * Writes the telemetry, error and boot-up messages from random UNIT/SKID data
+ * with the schemas and with the Azure IoT JSON writer, the way the demo built
+ * them before, and checks both come out byte for byte the same. Then reports
+ * bytes per second and cycles per message for each.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "azure_iot_json_writer.h"
+
+#include "telemetry_schema.h"
+#include "sensor_value.h"
+
+#define TEST_TELEMETRY_SCHEMA_SUCCESS    0
+#define TEST_TELEMETRY_SCHEMA_FAIL       1
+
+#define TEST_FUZZ_ITERATIONS             20000
+#define TEST_BENCHMARK_MESSAGES          50000
+#define TEST_MESSAGE_LENGTH              3200
+#define TEST_PART_LENGTH                 2304
+
+#define lengthof( x )    ( sizeof( x ) - 1 )
+
+/* Checks an Append call the way the demo's configASSERT did, without the reset. */
+#define prvCheck( x )                               \
+    if( ( x ) != eAzureIoTSuccess )                 \
+    {                                               \
+        printf( "\tFailed! %s\n", # x );            \
+        exit( TEST_TELEMETRY_SCHEMA_FAIL );         \
+    }
+
+static const char * pcValveStatus[] = { "CLOSED", "OPENED" };
+static const char * pcThreeWayValve[] = { "to_Tank", "to_Air" };
+static const char * pcComponentStatus[] = { "OFF", "ON" };
+static const char * pcSensorStatus[] = { "NO-ERROR", "ERROR" };
+static const char * pcFlagState[] = { "UNSET", "SET" };
+static const char * pcSequenceState[] =
+{
+    "Error_Handling",       "Init_State", "Adsorb_State", "Evacuation_State",   "Desorb_State",
+    "Vacuum_Release_State", "Lock_State", "Desorb_Setup_State", "Safe_State", "Unlock_State"
+};
+
+static uint8_t ucSchemaMessage[ TEST_MESSAGE_LENGTH ];
+static uint8_t ucWriterMessage[ TEST_MESSAGE_LENGTH ];
+static uint8_t ucPartBuffer[ TEST_PART_LENGTH ];
+static telemetry_data_t xData;
+
+/*-----------------------------------------------------------*/
+
+/* The writer the demo used, kept here as the reference. */
+
+static void prvString( AzureIoTJSONWriter_t * pxWriter,
+                       const char * pcName,
+                       const char * pcValue )
+{
+    prvCheck( AzureIoTJSONWriter_AppendPropertyWithStringValue( pxWriter, ( const uint8_t * ) pcName, strlen( pcName ),
+                                                                ( const uint8_t * ) pcValue, strlen( pcValue ) ) );
+}
+
+static void prvValue( AzureIoTJSONWriter_t * pxWriter,
+                      const char * pcName,
+                      sensor_value_t xValue )
+{
+    #if SENSOR_VALUE_FIXED_POINT
+        char cNumber[ SENSOR_VALUE_TEXT_LENGTH ];
+        uint32_t ulNumberLength = sensor_value_to_text( xValue, 3, cNumber, sizeof( cNumber ) );
+
+        prvCheck( AzureIoTJSONWriter_AppendPropertyName( pxWriter, ( const uint8_t * ) pcName, strlen( pcName ) ) );
+        prvCheck( AzureIoTJSONWriter_AppendJSONText( pxWriter, ( const uint8_t * ) cNumber, ulNumberLength ) );
+    #else
+        prvCheck( AzureIoTJSONWriter_AppendPropertyWithDoubleValue( pxWriter, ( const uint8_t * ) pcName, strlen( pcName ), xValue, 3 ) );
+    #endif
+}
+
+static void prvBeginArray( AzureIoTJSONWriter_t * pxWriter,
+                           const char * pcName )
+{
+    prvCheck( AzureIoTJSONWriter_AppendPropertyName( pxWriter, ( const uint8_t * ) pcName, strlen( pcName ) ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginArray( pxWriter ) );
+}
+
+static void prvBeginObject( AzureIoTJSONWriter_t * pxWriter,
+                            const char * pcName )
+{
+    prvCheck( AzureIoTJSONWriter_AppendPropertyName( pxWriter, ( const uint8_t * ) pcName, strlen( pcName ) ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( pxWriter ) );
+}
+
+/* Sensor entries were written into a scratch buffer and appended as text. */
+static void prvSensor( AzureIoTJSONWriter_t * pxWriter,
+                       const char * pcName,
+                       const sensor_info_t * pxStatusAndMedian,
+                       const sensor_info_t * pxAvgMaxMin )
+{
+    AzureIoTJSONWriter_t xPart;
+
+    memset( ucPartBuffer, '\0', sizeof( ucPartBuffer ) );
+    prvCheck( AzureIoTJSONWriter_Init( &xPart, ucPartBuffer, sizeof( ucPartBuffer ) ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xPart ) );
+    prvString( &xPart, "name", pcName );
+    prvString( &xPart, "status", pcSensorStatus[ pxStatusAndMedian->status ] );
+    prvValue( &xPart, "avg", pxAvgMaxMin->stats.avg );
+    prvValue( &xPart, "max", pxAvgMaxMin->stats.max );
+    prvValue( &xPart, "min", pxAvgMaxMin->stats.min );
+    prvValue( &xPart, "median", pxStatusAndMedian->stats.median );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xPart ) );
+
+    prvCheck( AzureIoTJSONWriter_AppendJSONText( pxWriter, ucPartBuffer, AzureIoTJSONWriter_GetBytesUsed( &xPart ) ) );
+}
+
+static void prvSkidSensors( AzureIoTJSONWriter_t * pxWriter,
+                            const SKID_iot_status_t * pxSkid )
+{
+    prvSensor( pxWriter, "o2", &pxSkid->o2_sensor, &pxSkid->o2_sensor );
+    prvSensor( pxWriter, "mass_flow", &pxSkid->mass_flow, &pxSkid->mass_flow );
+    prvSensor( pxWriter, "co2", &pxSkid->co2_sensor, &pxSkid->co2_sensor );
+    prvSensor( pxWriter, "propotional_valve_pressure", &pxSkid->proportional_valve_pressure, &pxSkid->proportional_valve_pressure );
+    prvSensor( pxWriter, "temperature", &pxSkid->temperature, &pxSkid->temperature );
+    prvSensor( pxWriter, "humidity", &pxSkid->humidity, &pxSkid->humidity );
+}
+
+static void prvUnitSensors( AzureIoTJSONWriter_t * pxWriter,
+                            const UNIT_iot_status_t * pxUnit )
+{
+    prvSensor( pxWriter, "vacuum_sensor", &pxUnit->vacuum_sensor, &pxUnit->vacuum_sensor );
+    prvSensor( pxWriter, "ambient_humidity", &pxUnit->ambient_humidity, &pxUnit->ambient_humidity );
+    prvSensor( pxWriter, "ambient_temperature", &pxUnit->ambient_humidity, &pxUnit->ambient_temperature );
+}
+
+static void prvCartridges( AzureIoTJSONWriter_t * pxWriter,
+                           const UNIT_iot_status_t * pxUnit )
+{
+    AzureIoTJSONWriter_t xPart;
+    char cSerialNumber[ 15 ];
+    uint8_t ucCartridge;
+    uint8_t ucZone;
+
+    for( ucCartridge = 0; ucCartridge < NUMBER_OF_CARTRIDGES; ucCartridge++ )
+    {
+        prvCheck( AzureIoTJSONWriter_AppendBeginObject( pxWriter ) );
+        sprintf( cSerialNumber, "%s%d", "Cartridge", ucCartridge + 1 );
+        prvString( pxWriter, "serial_number", cSerialNumber );
+        prvCheck( AzureIoTJSONWriter_AppendPropertyWithInt32Value( pxWriter, ( const uint8_t * ) "slot", lengthof( "slot" ), ucCartridge + 1 ) );
+        prvBeginArray( pxWriter, "zones" );
+
+        for( ucZone = 0; ucZone < NUMBER_OF_ZONES_PER_CARTRIDGE; ucZone++ )
+        {
+            uint8_t ucHeater = ucCartridge * NUMBER_OF_ZONES_PER_CARTRIDGE + ucZone;
+            const sensor_info_t * pxHeater = &pxUnit->heater_info[ ucHeater ];
+
+            memset( ucPartBuffer, '\0', sizeof( ucPartBuffer ) );
+            prvCheck( AzureIoTJSONWriter_Init( &xPart, ucPartBuffer, sizeof( ucPartBuffer ) ) );
+            prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xPart ) );
+            prvCheck( AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xPart, ( const uint8_t * ) "zone", lengthof( "zone" ),
+                                                                      ( ucHeater % NUMBER_OF_CARTRIDGES ) + 1 ) );
+            prvString( &xPart, "status", pcComponentStatus[ pxHeater->status ] );
+            prvValue( &xPart, "avg", pxHeater->stats.avg );
+            prvValue( &xPart, "max", pxHeater->stats.max );
+            prvValue( &xPart, "min", pxHeater->stats.avg );
+            prvValue( &xPart, "median", pxHeater->stats.median );
+            prvCheck( AzureIoTJSONWriter_AppendEndObject( &xPart ) );
+            prvCheck( AzureIoTJSONWriter_AppendJSONText( pxWriter, ucPartBuffer, AzureIoTJSONWriter_GetBytesUsed( &xPart ) ) );
+        }
+
+        prvCheck( AzureIoTJSONWriter_AppendEndArray( pxWriter ) );
+        prvCheck( AzureIoTJSONWriter_AppendEndObject( pxWriter ) );
+    }
+}
+
+static uint32_t prvWriterTelemetry( const telemetry_data_t * pxData,
+                                    uint8_t * pucBuffer,
+                                    uint32_t ulBufferLength )
+{
+    const SKID_iot_status_t * pxSkid = &pxData->skid;
+    const UNIT_iot_status_t * pxUnit = &pxData->unit;
+    AzureIoTJSONWriter_t xWriter;
+
+    prvCheck( AzureIoTJSONWriter_Init( &xWriter, pucBuffer, ulBufferLength ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "version", "1.0" );
+    prvCheck( AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xWriter, ( const uint8_t * ) "measurement_count", lengthof( "measurement_count" ), 30 ) );
+    prvString( &xWriter, "timestamp_utc", pxData->timestamp_utc );
+    prvString( &xWriter, "message_type", "telemetry" );
+
+    prvBeginObject( &xWriter, "ccu" );
+    prvString( &xWriter, "serial_number", pxData->ccu_serial_number );
+    prvString( &xWriter, "ccu_state", pcSequenceState[ pxSkid->skid_state ] );
+    prvBeginArray( &xWriter, "sensor_measurements" );
+    prvSkidSensors( &xWriter, pxSkid );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvBeginObject( &xWriter, "ccu_status" );
+    prvString( &xWriter, "error_flag", pcFlagState[ pxSkid->error_flag ] );
+    prvString( &xWriter, "halt_flag", pcFlagState[ pxSkid->halt_flag ] );
+    prvString( &xWriter, "reset_flag", pcFlagState[ pxSkid->reset_flag ] );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvBeginObject( &xWriter, "component_status" );
+    prvString( &xWriter, "two_way_gas_valve_before_water_trap", pcValveStatus[ pxSkid->two_way_gas_valve_before_water_trap ] );
+    prvString( &xWriter, "two_way_gas_valve_in_water_trap", pcValveStatus[ pxSkid->two_way_gas_valve_in_water_trap ] );
+    prvString( &xWriter, "two_way_gas_valve_after_water_trap", pcValveStatus[ pxSkid->two_way_gas_valve_after_water_trap ] );
+    prvString( &xWriter, "vacuum_release_valve_in_water_trap", pcValveStatus[ pxSkid->vacuum_release_valve_in_water_trap ] );
+    prvString( &xWriter, "three_way_vacuum_release_valve_before_condenser", pcThreeWayValve[ pxSkid->three_way_vacuum_release_valve_before_condenser ] );
+    prvString( &xWriter, "three_way_valve_after_vacuum_pump", pcThreeWayValve[ pxSkid->three_valve_after_vacuum_pump ] );
+    prvString( &xWriter, "compressor", pcComponentStatus[ pxSkid->compressor ] );
+    prvString( &xWriter, "vacuum_pump", pcComponentStatus[ pxSkid->vacuum_pump ] );
+    prvString( &xWriter, "condenser", pcComponentStatus[ pxSkid->condenser ] );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+
+    prvBeginArray( &xWriter, "units" );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "serial_number", "Unit123" );
+    prvString( &xWriter, "unit_state", pcSequenceState[ pxUnit->unit_state ] );
+    prvBeginArray( &xWriter, "cartridges" );
+    prvCartridges( &xWriter, pxUnit );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvBeginObject( &xWriter, "unit_status" );
+    prvString( &xWriter, "error_flag", pcFlagState[ pxUnit->error_flag ] );
+    prvString( &xWriter, "halt_flag", pcFlagState[ pxUnit->halt_flag ] );
+    prvString( &xWriter, "reset_flag", pcFlagState[ pxUnit->reset_flag ] );
+    prvString( &xWriter, "just_started_flag", pcFlagState[ pxUnit->just_started_flag ] );
+    prvString( &xWriter, "setup_state_synching_flag", pcFlagState[ pxUnit->setup_state_synching_flag ] );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvBeginObject( &xWriter, "component_status" );
+    prvString( &xWriter, "fan_status", pcComponentStatus[ pxUnit->fan_status ] );
+    prvString( &xWriter, "butterfly_valve_1_status", pcValveStatus[ pxUnit->butterfly_valve_1_status ] );
+    prvString( &xWriter, "butterfly_valve_2_status", pcValveStatus[ pxUnit->butterfly_valve_2_status ] );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvBeginArray( &xWriter, "sensor_measurements" );
+    prvUnitSensors( &xWriter, pxUnit );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+
+    prvBeginObject( &xWriter, "tank" );
+    prvString( &xWriter, "serial_number", "Tank123" );
+    prvBeginArray( &xWriter, "sensor_measurements" );
+    prvSensor( &xWriter, "tank_pressure", &pxSkid->tank_pressure, &pxSkid->tank_pressure );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+
+    return ( uint32_t ) AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+}
+
+static uint32_t prvWriterError( const telemetry_data_t * pxData,
+                                uint8_t * pucBuffer,
+                                uint32_t ulBufferLength )
+{
+    const SKID_iot_status_t * pxSkid = &pxData->skid;
+    const UNIT_iot_status_t * pxUnit = &pxData->unit;
+    AzureIoTJSONWriter_t xWriter;
+
+    prvCheck( AzureIoTJSONWriter_Init( &xWriter, pucBuffer, ulBufferLength ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "message_type", "error" );
+    prvString( &xWriter, "version", "1.0" );
+    prvString( &xWriter, "timestamp_utc", pxData->timestamp_utc );
+    prvBeginArray( &xWriter, "errors" );
+
+    if( pxSkid->skid_state == Lock_State )
+    {
+        prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+        prvString( &xWriter, "timestamp_utc", pxData->timestamp_utc );
+        prvString( &xWriter, "error_code", pxData->skid_error_code );
+        prvString( &xWriter, "version", "1.0" );
+        prvString( &xWriter, "location", "CCU" );
+        prvString( &xWriter, "current_state", pcSequenceState[ pxSkid->skid_state ] );
+        prvString( &xWriter, "previous_state", pcSequenceState[ pxSkid->skid_state ] );
+        prvBeginArray( &xWriter, "sensor_measurements" );
+        prvSkidSensors( &xWriter, pxSkid );
+        prvSensor( &xWriter, "tank_pressure", &pxSkid->tank_pressure, &pxSkid->tank_pressure );
+        prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+        prvBeginObject( &xWriter, "body" );
+        prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+        prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    }
+
+    if( pxUnit->unit_state == Lock_State )
+    {
+        prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+        prvString( &xWriter, "timestamp_utc", pxData->timestamp_utc );
+        prvString( &xWriter, "error_code", pxData->unit_error_code );
+        prvString( &xWriter, "version", "1.0" );
+        prvString( &xWriter, "location", "UNIT1" );
+        prvString( &xWriter, "current_state", pcSequenceState[ pxUnit->unit_state ] );
+        prvString( &xWriter, "previous_state", pcSequenceState[ pxUnit->unit_state ] );
+        prvBeginArray( &xWriter, "sensor_measurements" );
+        prvUnitSensors( &xWriter, pxUnit );
+        prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+        prvBeginObject( &xWriter, "body" );
+        prvBeginArray( &xWriter, "cartridges" );
+        prvCartridges( &xWriter, pxUnit );
+        prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+        prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+        prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    }
+
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+
+    return ( uint32_t ) AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+}
+
+static uint32_t prvWriterBootUp( const telemetry_data_t * pxData,
+                                 uint8_t * pucBuffer,
+                                 uint32_t ulBufferLength )
+{
+    AzureIoTJSONWriter_t xWriter;
+
+    prvCheck( AzureIoTJSONWriter_Init( &xWriter, pucBuffer, ulBufferLength ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "message_type", "boot-up" );
+    prvString( &xWriter, "version", "1.0" );
+    prvString( &xWriter, "azure_sdk_version", "0.0.0" );
+    prvString( &xWriter, "timestamp_utc", pxData->timestamp_utc );
+    prvBeginArray( &xWriter, "firmware_versions" );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "identifier", "CCU" );
+    prvString( &xWriter, "version", "0.0.0" );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendBeginObject( &xWriter ) );
+    prvString( &xWriter, "identifier", "UNIT1" );
+    prvString( &xWriter, "version", "0.0.0" );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndArray( &xWriter ) );
+    prvCheck( AzureIoTJSONWriter_AppendEndObject( &xWriter ) );
+
+    return ( uint32_t ) AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+}
+
+/*-----------------------------------------------------------*/
+
+typedef uint32_t ( * prvWriteFunction_t )( const telemetry_data_t * pxData,
+                                           uint8_t * pucBuffer,
+                                           uint32_t ulBufferLength );
+
+static const telemetry_schema_t * pxSchemas[] = { &telemetry_message_schema, &error_message_schema, &bootup_message_schema };
+static const prvWriteFunction_t pxWriters[] = { prvWriterTelemetry, prvWriterError, prvWriterBootUp };
+static const char * pcMessageNames[] = { "telemetry", "error", "boot-up" };
+
+#define TEST_MESSAGE_TYPES    ( sizeof( pxSchemas ) / sizeof( pxSchemas[ 0 ] ) )
+
+/* Values as the statistics hold them, 3 decimals or fewer, up to a few thousands either way. */
+static sensor_value_t prvRandomValue( void )
+{
+    int32_t lThousandths = ( rand() % 10000000 ) - 5000000;
+
+    #if SENSOR_VALUE_FIXED_POINT
+        return ( sensor_value_t ) ( ( ( int64_t ) lThousandths << SENSOR_VALUE_FRACTION_BITS ) / 1000 );
+    #else
+        return ( sensor_value_t ) lThousandths / 1000.0;
+    #endif
+}
+
+static void prvRandomSensor( sensor_info_t * pxSensor )
+{
+    pxSensor->status = ( component_status_t ) ( rand() % 2 );
+    pxSensor->stats.avg = prvRandomValue();
+    pxSensor->stats.max = prvRandomValue();
+    pxSensor->stats.min = prvRandomValue();
+    pxSensor->stats.median = prvRandomValue();
+}
+
+static sequence_state_t prvRandomState( void )
+{
+    /* Lock_State often, it decides what goes into the error message. */
+    return ( rand() % 3 == 0 ) ? Lock_State : ( sequence_state_t ) ( rand() % 10 );
+}
+
+static void prvRandomData( telemetry_data_t * pxData )
+{
+    SKID_iot_status_t * pxSkid = &pxData->skid;
+    UNIT_iot_status_t * pxUnit = &pxData->unit;
+    uint8_t i;
+
+    pxSkid->error_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->halt_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->reset_flag = ( flag_state_t ) ( rand() % 2 );
+    pxSkid->skid_state = prvRandomState();
+    pxSkid->two_way_gas_valve_before_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->two_way_gas_valve_in_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->two_way_gas_valve_after_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->vacuum_release_valve_in_water_trap = ( component_status_t ) ( rand() % 2 );
+    pxSkid->three_way_vacuum_release_valve_before_condenser = ( component_status_t ) ( rand() % 2 );
+    pxSkid->three_valve_after_vacuum_pump = ( component_status_t ) ( rand() % 2 );
+    pxSkid->compressor = ( component_status_t ) ( rand() % 2 );
+    pxSkid->vacuum_pump = ( component_status_t ) ( rand() % 2 );
+    pxSkid->condenser = ( component_status_t ) ( rand() % 2 );
+    prvRandomSensor( &pxSkid->o2_sensor );
+    prvRandomSensor( &pxSkid->mass_flow );
+    prvRandomSensor( &pxSkid->co2_sensor );
+    prvRandomSensor( &pxSkid->tank_pressure );
+    prvRandomSensor( &pxSkid->proportional_valve_pressure );
+    prvRandomSensor( &pxSkid->temperature );
+    prvRandomSensor( &pxSkid->humidity );
+
+    pxUnit->error_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->halt_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->reset_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->just_started_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->setup_state_synching_flag = ( flag_state_t ) ( rand() % 2 );
+    pxUnit->unit_state = prvRandomState();
+
+    for( i = 0; i < NUMBER_OF_HEATERS; i++ )
+    {
+        prvRandomSensor( &pxUnit->heater_info[ i ] );
+    }
+
+    pxUnit->fan_status = ( component_status_t ) ( rand() % 2 );
+    pxUnit->butterfly_valve_1_status = ( component_status_t ) ( rand() % 2 );
+    pxUnit->butterfly_valve_2_status = ( component_status_t ) ( rand() % 2 );
+    prvRandomSensor( &pxUnit->vacuum_sensor );
+    prvRandomSensor( &pxUnit->ambient_humidity );
+    prvRandomSensor( &pxUnit->ambient_temperature );
+
+    snprintf( pxData->timestamp_utc, sizeof( pxData->timestamp_utc ), "2024-%02d-%02dT%02d:%02d:%02dZ",
+              1 + rand() % 12, 1 + rand() % 28, rand() % 24, rand() % 60, rand() % 60 );
+    snprintf( pxData->skid_error_code, sizeof( pxData->skid_error_code ), "UNKNOWN_CODE: %d", rand() );
+    snprintf( pxData->unit_error_code, sizeof( pxData->unit_error_code ), "UNKNOWN_CODE: %d", rand() );
+}
+
+static int prvCompareMessages( void )
+{
+    uint32_t ulIteration;
+    uint32_t ulType;
+    uint32_t ulSchemaLength;
+    uint32_t ulWriterLength;
+
+    for( ulIteration = 0; ulIteration < TEST_FUZZ_ITERATIONS; ulIteration++ )
+    {
+        prvRandomData( &xData );
+
+        for( ulType = 0; ulType < TEST_MESSAGE_TYPES; ulType++ )
+        {
+            ulSchemaLength = telemetry_schema_write( pxSchemas[ ulType ], &xData, ucSchemaMessage, sizeof( ucSchemaMessage ) );
+            ulWriterLength = pxWriters[ ulType ]( &xData, ucWriterMessage, sizeof( ucWriterMessage ) );
+
+            if( ( ulSchemaLength != ulWriterLength ) || ( memcmp( ucSchemaMessage, ucWriterMessage, ulWriterLength ) != 0 ) )
+            {
+                printf( "\tFailed! %s message differs at iteration %u\n\tschema: %.*s\n\twriter: %.*s\n",
+                        pcMessageNames[ ulType ], ulIteration,
+                        ( int ) ulSchemaLength, ucSchemaMessage, ( int ) ulWriterLength, ucWriterMessage );
+                return 0;
+            }
+
+            /* One byte short must be refused, never cut. */
+            if( telemetry_schema_write( pxSchemas[ ulType ], &xData, ucSchemaMessage, ulWriterLength - 1 ) != 0 )
+            {
+                printf( "\tFailed! %s message written into a buffer too small\n", pcMessageNames[ ulType ] );
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+static uint64_t prvCycles( void )
+{
+    #if defined( __x86_64__ ) || defined( __i386__ )
+        return __builtin_ia32_rdtsc();
+    #else
+        return 0; /* No cycle counter, only the time is reported. */
+    #endif
+}
+
+int vStartTestTask( void )
+{
+    volatile uint32_t ulSink = 0;
+    uint64_t ullBytes;
+    uint64_t ullCycles;
+    double xStart;
+    double xSeconds;
+    uint32_t ulType;
+    uint32_t i;
+
+    srand( 1 );
+
+    printf( "Comparing schema messages with the json writer\n" );
+
+    if( !prvCompareMessages() )
+    {
+        return TEST_TELEMETRY_SCHEMA_FAIL;
+    }
+
+    printf( "Measuring bytes per second and cycles per message\n" );
+
+    prvRandomData( &xData );
+    xData.skid.skid_state = Lock_State;
+    xData.unit.unit_state = Lock_State;
+
+    for( ulType = 0; ulType < TEST_MESSAGE_TYPES; ulType++ )
+    {
+        ullBytes = 0;
+        ullCycles = prvCycles();
+        xStart = prvCpuTimeNs();
+
+        for( i = 0; i < TEST_BENCHMARK_MESSAGES; i++ )
+        {
+            ullBytes += pxWriters[ ulType ]( &xData, ucWriterMessage, sizeof( ucWriterMessage ) );
+        }
+
+        xSeconds = ( prvCpuTimeNs() - xStart ) / 1e9;
+        ullCycles = prvCycles() - ullCycles;
+        printf( "\t%-9s json writer: %8.1f MB/s, %8llu cycles per message\n", pcMessageNames[ ulType ],
+                ( double ) ullBytes / xSeconds / 1e6, ( unsigned long long ) ( ullCycles / TEST_BENCHMARK_MESSAGES ) );
+        ulSink += ucWriterMessage[ 0 ];
+
+        ullBytes = 0;
+        ullCycles = prvCycles();
+        xStart = prvCpuTimeNs();
+
+        for( i = 0; i < TEST_BENCHMARK_MESSAGES; i++ )
+        {
+            ullBytes += telemetry_schema_write( pxSchemas[ ulType ], &xData, ucSchemaMessage, sizeof( ucSchemaMessage ) );
+        }
+
+        xSeconds = ( prvCpuTimeNs() - xStart ) / 1e9;
+        ullCycles = prvCycles() - ullCycles;
+        printf( "\t%-9s schema:      %8.1f MB/s, %8llu cycles per message\n", pcMessageNames[ ulType ],
+                ( double ) ullBytes / xSeconds / 1e6, ( unsigned long long ) ( ullCycles / TEST_BENCHMARK_MESSAGES ) );
+        ulSink += ucSchemaMessage[ 0 ];
+    }
+
+    ( void ) ulSink;
+
+    return TEST_TELEMETRY_SCHEMA_SUCCESS;
+}
@@ -0,0 +1,355 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE TIME SERVICE
+ *
+ * Checks the cached ISO-8601 string against gmtime for random times up to
+ * 2100, the drift statistics of ticks running fast, that time handed out never
+ * goes back across a resync, the resync and retry intervals, and the time over
+ * several wraps of the tick counter. Then compares the cost of a timestamp with
+ * the RTC read and sprintf done for every message before, and the reference
+ * round trips of an hour of middleware calls.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "time_service.h"
+
+#define TEST_TIME_SERVICE_SUCCESS    0
+#define TEST_TIME_SERVICE_FAIL       1
+
+#define TEST_TICK_RATE_HZ            1000
+#define TEST_RESYNC_INTERVAL_S       3600
+#define TEST_FORMAT_CHECKS           1000000
+#define TEST_LAST_TIME               4102444800u /* 2100-01-01T00:00:00Z */
+#define TEST_START_TIME              1706875200u /* 2024-02-02T12:00:00Z */
+#define TEST_DRIFT_PPM               100
+#define TEST_BENCHMARK_CALLS         1000000
+#define TEST_UNIX_TIME_PERIOD_MS     500         /* SAS token checks of the middleware */
+
+static time_service_t xService;
+
+/*-----------------------------------------------------------*/
+
+static double prvCpuTimeNs( void )
+{
+    struct timespec xTime;
+
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &xTime );
+
+    return ( double ) xTime.tv_sec * 1e9 + ( double ) xTime.tv_nsec;
+}
+
+/* What get_timestamp_utc did for every message. */
+static void prvFormatGmtime( uint32_t ulUnixTime,
+                             char * pcBuffer )
+{
+    time_t xTime = ( time_t ) ulUnixTime;
+    struct tm xTm;
+
+    gmtime_r( &xTime, &xTm );
+    sprintf( pcBuffer, "%04d-%02d-%02dT%02d:%02d:%02dZ",
+             xTm.tm_year + 1900, xTm.tm_mon + 1, xTm.tm_mday,
+             xTm.tm_hour, xTm.tm_min, xTm.tm_sec );
+}
+
+static int prvCheckFormat( uint32_t ulUnixTime )
+{
+    char cExpected[ 32 ];
+    const char * pcTimestamp;
+
+    time_service_init( &xService, TEST_TICK_RATE_HZ, TEST_RESYNC_INTERVAL_S );
+    time_service_sync( &xService, ulUnixTime, 0 );
+    pcTimestamp = time_service_iso8601( &xService, 0 );
+    prvFormatGmtime( ulUnixTime, cExpected );
+
+    if( ( strlen( pcTimestamp ) != TIME_SERVICE_ISO8601_LENGTH - 1 ) || ( strcmp( pcTimestamp, cExpected ) != 0 ) )
+    {
+        printf( "\tFailed! %u formatted as %s, not %s\n", ulUnixTime, pcTimestamp, cExpected );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvFormat( void )
+{
+    const uint32_t ulEdges[] =
+    {
+        0, 59, 86399, 86400, 951782399, 951782400, 951868800, 978307199,
+        1709164800, 2147483647, 2147483648u, 4107542399u, TEST_LAST_TIME - 1
+    };
+    uint32_t i;
+
+    for( i = 0; i < sizeof( ulEdges ) / sizeof( ulEdges[ 0 ] ); i++ )
+    {
+        if( !prvCheckFormat( ulEdges[ i ] ) )
+        {
+            return 0;
+        }
+    }
+
+    for( i = 0; i < TEST_FORMAT_CHECKS; i++ )
+    {
+        if( !prvCheckFormat( ( uint32_t ) ( ( ( uint64_t ) rand() << 16 ^ ( uint64_t ) rand() ) % TEST_LAST_TIME ) ) )
+        {
+            return 0;
+        }
+    }
+
+    /* Before the first sync. */
+    time_service_init( &xService, TEST_TICK_RATE_HZ, TEST_RESYNC_INTERVAL_S );
+
+    if( ( strcmp( time_service_iso8601( &xService, 1234 ), "1970-01-01T00:00:00Z" ) != 0 ) ||
+        ( time_service_unix_ms( &xService, 1234 ) != 0 ) || time_service_synced( &xService ) )
+    {
+        printf( "\tFailed! time before the first sync\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Ticks at TEST_DRIFT_PPM fast, the reference resynced at whole seconds. */
+static int prvDrift( void )
+{
+    uint64_t ullLast = 0;
+    uint64_t ullNow;
+    uint32_t ulTick = 0;
+    uint32_t ulReal;
+    uint32_t ulHour;
+
+    time_service_init( &xService, TEST_TICK_RATE_HZ, TEST_RESYNC_INTERVAL_S );
+    time_service_sync( &xService, TEST_START_TIME, 0 );
+
+    for( ulHour = 1; ulHour <= 4; ulHour++ )
+    {
+        /* Read every 100 ms of real time until the hour is up. */
+        for( ulReal = ( ulHour - 1 ) * 36000u; ulReal <= ulHour * 36000u; ulReal++ )
+        {
+            ulTick = ( uint32_t ) ( ( uint64_t ) ulReal * 100u * ( 1000000u + TEST_DRIFT_PPM ) / 1000000u );
+
+            if( ( ulTick - xService.attempt_tick < TEST_RESYNC_INTERVAL_S * TEST_TICK_RATE_HZ ) &&
+                time_service_resync_due( &xService, ulTick ) )
+            {
+                printf( "\tFailed! resync due %u ticks after the last\n", ulTick - xService.attempt_tick );
+                return 0;
+            }
+
+            ullNow = time_service_unix_ms( &xService, ulTick );
+
+            if( ullNow < ullLast )
+            {
+                printf( "\tFailed! time went back from %llu to %llu\n", ( unsigned long long ) ullLast, ( unsigned long long ) ullNow );
+                return 0;
+            }
+
+            ullLast = ullNow;
+        }
+
+        if( !time_service_resync_due( &xService, ulTick ) )
+        {
+            printf( "\tFailed! no resync due after an hour\n" );
+            return 0;
+        }
+
+        time_service_sync( &xService, TEST_START_TIME + ulHour * 3600u, ulTick );
+
+        /* Held where it was until the reference catches up. */
+        if( time_service_unix_ms( &xService, ulTick + 100 ) != ullLast )
+        {
+            printf( "\tFailed! time not held after the resync\n" );
+            return 0;
+        }
+    }
+
+    if( ( xService.stats.syncs != 5 ) || ( xService.stats.last_drift_ms != 360 ) ||
+        ( xService.stats.max_drift_ms != 360 ) || ( xService.stats.drift_ppm != TEST_DRIFT_PPM ) )
+    {
+        printf( "\tFailed! %u syncs, drift last=%dms max=%dms rate=%dppm\n", xService.stats.syncs,
+                xService.stats.last_drift_ms, xService.stats.max_drift_ms, xService.stats.drift_ppm );
+        return 0;
+    }
+
+    printf( "\tdrift last=%dms max=%dms rate=%dppm\n", xService.stats.last_drift_ms,
+            xService.stats.max_drift_ms, xService.stats.drift_ppm );
+
+    /* A reference that jumps back minutes is a wrong time that got corrected, no hold then. */
+    time_service_sync( &xService, TEST_START_TIME, ulTick + 1000 );
+
+    if( time_service_unix( &xService, ulTick + 1000 ) != TEST_START_TIME )
+    {
+        printf( "\tFailed! time held after a step back of hours\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+static int prvRetry( void )
+{
+    time_service_init( &xService, TEST_TICK_RATE_HZ, TEST_RESYNC_INTERVAL_S );
+
+    if( !time_service_resync_due( &xService, 0 ) )
+    {
+        printf( "\tFailed! no sync due at the start\n" );
+        return 0;
+    }
+
+    /* Failing before the first sync, retried every TIME_SERVICE_RETRY_S. */
+    time_service_sync_failed( &xService, 1000 );
+
+    if( time_service_resync_due( &xService, 1000 + TIME_SERVICE_RETRY_S * TEST_TICK_RATE_HZ - 1 ) ||
+        !time_service_resync_due( &xService, 1000 + TIME_SERVICE_RETRY_S * TEST_TICK_RATE_HZ ) )
+    {
+        printf( "\tFailed! retry after a failed first sync\n" );
+        return 0;
+    }
+
+    time_service_sync( &xService, TEST_START_TIME, 100000 );
+    time_service_sync_failed( &xService, 100000 + TEST_RESYNC_INTERVAL_S * TEST_TICK_RATE_HZ );
+
+    if( time_service_resync_due( &xService, 100000 + ( TEST_RESYNC_INTERVAL_S + TIME_SERVICE_RETRY_S ) * TEST_TICK_RATE_HZ - 1 ) ||
+        !time_service_resync_due( &xService, 100000 + ( TEST_RESYNC_INTERVAL_S + TIME_SERVICE_RETRY_S ) * TEST_TICK_RATE_HZ ) ||
+        ( xService.stats.failures != 2 ) )
+    {
+        printf( "\tFailed! retry after a failed resync\n" );
+        return 0;
+    }
+
+    /* The interval is clamped and a shorter one applies to the retry as well. */
+    time_service_set_resync_interval( &xService, 0 );
+
+    if( ( xService.resync_interval_s != 1 ) || !time_service_resync_due( &xService, 100000 + ( TEST_RESYNC_INTERVAL_S + 1 ) * TEST_TICK_RATE_HZ ) )
+    {
+        printf( "\tFailed! resync interval of 0\n" );
+        return 0;
+    }
+
+    time_service_set_resync_interval( &xService, UINT32_MAX );
+
+    if( xService.resync_interval_s != TIME_SERVICE_MAX_INTERVAL_S )
+    {
+        printf( "\tFailed! resync interval not clamped\n" );
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Time kept over several wraps of the tick counter without a resync. */
+static int prvWrap( uint32_t ulTickRate )
+{
+    const uint32_t ulStartTick = 0xFFFFF000u;
+    uint64_t ullElapsed;
+    uint64_t ullExpected;
+    uint64_t ullNow;
+
+    time_service_init( &xService, ulTickRate, TEST_RESYNC_INTERVAL_S );
+    time_service_sync( &xService, TEST_START_TIME, ulStartTick );
+
+    for( ullElapsed = 0; ullElapsed < 3 * ( 1ull << 32 ); ullElapsed += 999983 )
+    {
+        ullNow = time_service_unix_ms( &xService, ( uint32_t ) ( ulStartTick + ullElapsed ) );
+        ullExpected = ( uint64_t ) TEST_START_TIME * 1000u + ullElapsed * 1000u / ulTickRate;
+
+        if( ullNow != ullExpected )
+        {
+            printf( "\tFailed! %llu ticks at %u Hz gave %llu ms, not %llu\n", ( unsigned long long ) ullElapsed, ulTickRate,
+                    ( unsigned long long ) ullNow, ( unsigned long long ) ullExpected );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void prvBenchmark( void )
+{
+    char cTimestamp[ 32 ];
+    double xStart;
+    double xGmtimeNs;
+    double xCachedNs;
+    uint32_t ulRoundTrips = 0;
+    uint32_t ulTick;
+    uint32_t i;
+
+    time_service_init( &xService, TEST_TICK_RATE_HZ, TEST_RESYNC_INTERVAL_S );
+    time_service_sync( &xService, TEST_START_TIME, 0 );
+
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_CALLS; i++ )
+    {
+        prvFormatGmtime( TEST_START_TIME + i / 1000u, cTimestamp );
+    }
+
+    xGmtimeNs = ( prvCpuTimeNs() - xStart ) / TEST_BENCHMARK_CALLS;
+    xStart = prvCpuTimeNs();
+
+    for( i = 0; i < TEST_BENCHMARK_CALLS; i++ )
+    {
+        memcpy( cTimestamp, time_service_iso8601( &xService, i ), TIME_SERVICE_ISO8601_LENGTH );
+    }
+
+    xCachedNs = ( prvCpuTimeNs() - xStart ) / TEST_BENCHMARK_CALLS;
+
+    /* An hour of ullGetUnixTime calls, each one was an AT command round trip. */
+    for( ulTick = TEST_TICK_RATE_HZ; ulTick <= TEST_RESYNC_INTERVAL_S * TEST_TICK_RATE_HZ; ulTick += TEST_UNIX_TIME_PERIOD_MS )
+    {
+        if( time_service_resync_due( &xService, ulTick ) )
+        {
+            time_service_sync( &xService, TEST_START_TIME + ulTick / TEST_TICK_RATE_HZ, ulTick );
+            ulRoundTrips++;
+        }
+
+        ( void ) time_service_unix( &xService, ulTick );
+    }
+
+    printf( "\ttimestamp: gmtime+sprintf %.1f ns, cached %.1f ns\n", xGmtimeNs, xCachedNs );
+    printf( "\treference round trips in an hour: %u before, %u now\n",
+            TEST_RESYNC_INTERVAL_S * 1000u / TEST_UNIX_TIME_PERIOD_MS, ulRoundTrips );
+}
+
+int vStartTestTask( void )
+{
+    srand( 1 );
+
+    printf( "Checking ISO-8601 timestamps against gmtime\n" );
+
+    if( !prvFormat() )
+    {
+        return TEST_TIME_SERVICE_FAIL;
+    }
+
+    printf( "Ticks running %u ppm fast, resynced every hour\n", TEST_DRIFT_PPM );
+
+    if( !prvDrift() )
+    {
+        return TEST_TIME_SERVICE_FAIL;
+    }
+
+    printf( "Checking resync and retry intervals\n" );
+
+    if( !prvRetry() )
+    {
+        return TEST_TIME_SERVICE_FAIL;
+    }
+
+    printf( "Wrapping the tick counter\n" );
+
+    if( !prvWrap( 1000 ) || !prvWrap( 1024 ) )
+    {
+        return TEST_TIME_SERVICE_FAIL;
+    }
+
+    printf( "Timestamp cost\n" );
+    prvBenchmark();
+
+    return TEST_TIME_SERVICE_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST HARNESS FOR THE CONTROLLER UART DMA RECEPTION
+ *
+ * A fake DMA writes recorded UNIT/SKID frames into a circular buffer the way
+ * USART3 does on target and raises the same events (half transfer, transfer
+ * complete, idle line). Checks that every byte reaches the sink once and in
+ * order, that the frames still parse, and reports interrupts per frame.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_parser.h"
+#include "uart_dma_rx.h"
+#include "recorded_controller_frames.h"
+
+#define TEST_UART_DMA_RX_SUCCESS    0
+#define TEST_UART_DMA_RX_FAIL       1
+
+/* Same size as UART_RX_DMA_BUFFER_LENGTH in uart_api.c. */
+#define TEST_DMA_BUFFER_LENGTH      256
+#define TEST_CYCLES                 2000
+
+/* One controller cycle: UNIT + SKID, with some noise every few cycles. */
+#define TEST_MAX_STREAM_LENGTH      ( TEST_CYCLES * ( MESSAGE_LENGTH_UNIT_STATUS + MESSAGE_LENGTH_SKID_STATUS + sizeof( ucRecordedNoise ) ) )
+
+static uint8_t ucDmaBuffer[ TEST_DMA_BUFFER_LENGTH ];
+static uint16_t usDmaPosition = 0;
+static uart_dma_rx_t xDmaRx;
+
+static uint8_t ucSent[ TEST_MAX_STREAM_LENGTH ];
+static uint32_t ulSentLength = 0;
+static uint8_t ucReceived[ TEST_MAX_STREAM_LENGTH ];
+static uint32_t ulReceivedLength = 0;
+
+static frame_parser_t xParser;
+static uint32_t ulFrames = 0;
+static uint32_t ulSinkCalls = 0;
+static uint32_t ulInterrupts = 0;
+
+/* Stands in for gui_comm_rx_buffer_add_block. */
+static void prvSink( const uint8_t * pucData,
+                     uint16_t usDataSize )
+{
+    uint16_t usConsumed;
+
+    ulSinkCalls++;
+    memcpy( ucReceived + ulReceivedLength, pucData, usDataSize );
+    ulReceivedLength += usDataSize;
+
+    while( usDataSize > 0 )
+    {
+        if( frame_parser_push( &xParser, pucData, usDataSize, &usConsumed ) != FRAME_NONE )
+        {
+            ulFrames++;
+        }
+
+        pucData += usConsumed;
+        usDataSize -= usConsumed;
+    }
+}
+
+/* Moves bytes into the circular buffer, raising half transfer and transfer complete. */
+static void prvFakeDmaWrite( const uint8_t * pucData,
+                             uint32_t ulLength )
+{
+    uint32_t i;
+
+    memcpy( ucSent + ulSentLength, pucData, ulLength );
+    ulSentLength += ulLength;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        ucDmaBuffer[ usDmaPosition++ ] = pucData[ i ];
+
+        if( usDmaPosition == TEST_DMA_BUFFER_LENGTH / 2 )
+        {
+            ulInterrupts++;
+            uart_dma_rx_update( &xDmaRx, usDmaPosition );
+        }
+        else if( usDmaPosition == TEST_DMA_BUFFER_LENGTH )
+        {
+            /* The counter reloads, the handler reads back a full count. */
+            usDmaPosition = 0;
+            ulInterrupts++;
+            uart_dma_rx_update( &xDmaRx, TEST_DMA_BUFFER_LENGTH );
+        }
+    }
+}
+
+static void prvFakeIdleLine( void )
+{
+    ulInterrupts++;
+    uart_dma_rx_update( &xDmaRx, usDmaPosition );
+}
+
+/* Sends a frame, sometimes with a pause in the middle that triggers an extra idle line. */
+static void prvSendFrame( const uint8_t * pucFrame,
+                          uint32_t ulLength )
+{
+    uint32_t ulSplit = ( rand() % 4 == 0 ) ? ( uint32_t ) ( rand() % ulLength ) : 0;
+
+    if( ulSplit > 0 )
+    {
+        prvFakeDmaWrite( pucFrame, ulSplit );
+        prvFakeIdleLine();
+    }
+
+    prvFakeDmaWrite( pucFrame + ulSplit, ulLength - ulSplit );
+    prvFakeIdleLine();
+}
+
+int vStartTestTask( void )
+{
+    uint32_t ulCycle;
+    uint32_t ulExpectedFrames = 0;
+
+    srand( 1 );
+    frame_parser_init( &xParser );
+    uart_dma_rx_init( &xDmaRx, ucDmaBuffer, TEST_DMA_BUFFER_LENGTH, prvSink );
+
+    printf( "Streaming recorded frames through the fake DMA\n" );
+
+    for( ulCycle = 0; ulCycle < TEST_CYCLES; ulCycle++ )
+    {
+        if( ulCycle % 7 == 0 )
+        {
+            prvFakeDmaWrite( ucRecordedNoise, sizeof( ucRecordedNoise ) );
+            prvFakeIdleLine();
+        }
+
+        prvSendFrame( ucRecordedUnitFrame, MESSAGE_LENGTH_UNIT_STATUS );
+        prvSendFrame( ucRecordedSkidFrame, MESSAGE_LENGTH_SKID_STATUS );
+        ulExpectedFrames += 2;
+    }
+
+    if( ( ulReceivedLength != ulSentLength ) || ( memcmp( ucReceived, ucSent, ulSentLength ) != 0 ) )
+    {
+        printf( "\tFailed! sent %u bytes, received %u bytes\n", ulSentLength, ulReceivedLength );
+        return TEST_UART_DMA_RX_FAIL;
+    }
+
+    if( ulFrames != ulExpectedFrames )
+    {
+        printf( "\tFailed! expected %u frames, parsed %u\n", ulExpectedFrames, ulFrames );
+        return TEST_UART_DMA_RX_FAIL;
+    }
+
+    printf( "Checking an update without new data is a no-op\n" );
+    ulSinkCalls = 0;
+    uart_dma_rx_update( &xDmaRx, usDmaPosition );
+
+    if( ulSinkCalls != 0 )
+    {
+        printf( "\tFailed! sink called %u times\n", ulSinkCalls );
+        return TEST_UART_DMA_RX_FAIL;
+    }
+
+    printf( "\t%u bytes, %u frames, %.2f rx interrupts per frame (byte interrupts: %.2f)\n",
+            ulSentLength, ulFrames,
+            ( double ) ulInterrupts / ( double ) ulFrames,
+            ( double ) ulSentLength / ( double ) ulFrames );
+
+    return TEST_UART_DMA_RX_SUCCESS;
+}
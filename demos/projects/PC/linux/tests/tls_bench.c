@@ -0,0 +1,1073 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+/*
+ * HOST BENCH FOR THE TLS TRANSPORT HANDSHAKE
+ *
+ * Makes the mbed TLS calls of transport_tls_socket_using_mbedtls.c against a
+ * local TLS server and reports what one connect costs. Built and run by
+ * tls_bench.sh against the system mbed TLS, not part of the CMake build.
+ *
+ *   tls_bench <port> handshake <full|ticket|id> <connects>
+ *   tls_bench <port> setup <per-connect|shared> <connects>
+ *   tls_bench <port> session <persistent|recycle> <publishes>
+ *
+ * handshake times the handshake and counts its bytes on the wire. full never
+ * offers a session, ticket and id offer the one saved after the previous
+ * handshake, with session tickets enabled or disabled.
+ *
+ * setup measures what a connect costs before the handshake starts: time, heap
+ * still held and calloc calls. per-connect seeds the DRBG and parses the
+ * credentials on every connect as the transport used to, shared builds them
+ * once and only sets up the SSL context per connect.
+ *
+ * session runs the publish loop of sample_azure_iot.c against a stand-in MQTT
+ * broker the bench serves itself on <port>, TLS with session tickets and a
+ * session cache. A session is the handshake offering the last session, CONNECT
+ * and the three SUBSCRIBEs of the hub client, then QoS1 PUBLISHes of one CBOR
+ * telemetry message. persistent keeps the session until the broker cuts it,
+ * as sampleazureiotPERSISTENT_CONNECTION 1 does, recycle also ends it cleanly
+ * every 15 publishes as 0 does. The broker cuts the connection every 100
+ * publishes in both modes. Reported are the handshakes and the reconnect
+ * latency, from the last publish of a session to the subscriptions of the next
+ * one restored. The delay the sample waits between sessions is left out.
+ *
+ * The first connect of a handshake or setup run is left out of the average.
+ * The credentials are read from cli.pem and cli.key in the working directory,
+ * the root CAs from ca.pem for handshake and session and roots.pem for setup.
+ * The stand-in broker uses srv.pem and srv.key.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/x509_crt.h"
+
+#define TLS_BENCH_SUCCESS    0
+#define TLS_BENCH_FAIL       1
+
+#define TLS_BENCH_HOSTNAME   "localhost"
+
+#define TLS_BENCH_RECYCLE_PUBLISHES    15  /* sampleazureiotMAX_PUBLISH_COUNT */
+#define TLS_BENCH_CUT_EVERY            100 /* Publishes between connections cut by the broker */
+#define TLS_BENCH_PAYLOAD_LENGTH       420 /* One CBOR telemetry message */
+#define TLS_BENCH_MQTT_MAX_PACKET      1024
+#define TLS_BENCH_TICKET_LIFETIME      ( 24 * 60 * 60 )
+
+#define TLS_BENCH_MQTT_CONNECT        0x10
+#define TLS_BENCH_MQTT_CONNACK        0x20
+#define TLS_BENCH_MQTT_PUBLISH        0x30
+#define TLS_BENCH_MQTT_PUBACK         0x40
+#define TLS_BENCH_MQTT_SUBSCRIBE      0x80
+#define TLS_BENCH_MQTT_SUBACK         0x90
+#define TLS_BENCH_MQTT_UNSUBSCRIBE    0xA0
+#define TLS_BENCH_MQTT_UNSUBACK       0xB0
+#define TLS_BENCH_MQTT_DISCONNECT     0xE0
+#define TLS_BENCH_MQTT_TYPE( x )      ( ( x ) & 0xF0 )
+
+/* mbed TLS allocates through calloc, counted here on the way to glibc. */
+extern void * __libc_calloc( size_t xCount,
+                             size_t xSize );
+
+static unsigned long ulCallocs;
+
+static int lSocket;
+static unsigned long ulBytesSent;
+static unsigned long ulBytesReceived;
+
+static mbedtls_entropy_context xEntropy;
+static mbedtls_ctr_drbg_context xDrbg;
+static mbedtls_ssl_config xConfig;
+static mbedtls_x509_crt xRootCa;
+static mbedtls_x509_crt xClientCert;
+static mbedtls_pk_context xClientKey;
+static mbedtls_ssl_context xSsl;
+static mbedtls_ssl_session xSession;
+
+static unsigned char * pucRootCa;
+static size_t xRootCaLength;
+static unsigned char * pucClientCert;
+static size_t xClientCertLength;
+static unsigned char * pucClientKey;
+static size_t xClientKeyLength;
+static unsigned char * pucServerCert;
+static size_t xServerCertLength;
+static unsigned char * pucServerKey;
+static size_t xServerKeyLength;
+
+/* What the hub client subscribes to, one SUBSCRIBE each. */
+static const char * const pcTopicFilters[] =
+{
+    "devices/bench-device/messages/devicebound/#",
+    "$iothub/methods/POST/#",
+    "$iothub/twin/res/#"
+};
+
+#define TLS_BENCH_TOPIC_FILTERS    ( sizeof( pcTopicFilters ) / sizeof( pcTopicFilters[ 0 ] ) )
+
+static uint16_t usPacketId;
+static int xSessionSaved;
+
+/* Stand-in broker: takes one connection at a time, acknowledges what the
+ * device sends and cuts the connection every TLS_BENCH_CUT_EVERY publishes. */
+typedef struct Broker
+{
+    int lListener;
+    int lConnection;
+    unsigned long ulPublishes;
+    pthread_t xThread;
+} Broker_t;
+
+static Broker_t xBroker;
+
+static mbedtls_entropy_context xBrokerEntropy;
+static mbedtls_ctr_drbg_context xBrokerDrbg;
+static mbedtls_ssl_config xBrokerConfig;
+static mbedtls_x509_crt xBrokerRootCa;
+static mbedtls_x509_crt xBrokerCert;
+static mbedtls_pk_context xBrokerKey;
+static mbedtls_ssl_cache_context xBrokerCache;
+static mbedtls_ssl_ticket_context xBrokerTicket;
+static mbedtls_ssl_context xBrokerSsl;
+
+/*-----------------------------------------------------------*/
+
+void * calloc( size_t xCount,
+               size_t xSize )
+{
+    ulCallocs++;
+
+    return __libc_calloc( xCount, xSize );
+}
+
+static int prvSend( void * pvContext,
+                    const unsigned char * pucData,
+                    size_t xLength )
+{
+    ssize_t xSent = send( lSocket, pucData, xLength, MSG_NOSIGNAL );
+
+    ( void ) pvContext;
+
+    if( xSent < 0 )
+    {
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    ulBytesSent += ( unsigned long ) xSent;
+
+    return ( int ) xSent;
+}
+
+static int prvRecv( void * pvContext,
+                    unsigned char * pucData,
+                    size_t xLength )
+{
+    ssize_t xReceived = recv( lSocket, pucData, xLength, 0 );
+
+    ( void ) pvContext;
+
+    if( xReceived < 0 )
+    {
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+
+    ulBytesReceived += ( unsigned long ) xReceived;
+
+    return ( int ) xReceived;
+}
+
+static double prvNowMs( void )
+{
+    struct timespec xNow;
+
+    clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return xNow.tv_sec * 1e3 + xNow.tv_nsec / 1e6;
+}
+
+/* Whole file plus a terminator, mbed TLS takes PEM with its NUL. */
+static unsigned char * prvReadFile( const char * pcPath,
+                                    size_t * pxLength )
+{
+    FILE * pxFile = fopen( pcPath, "rb" );
+    unsigned char * pucData;
+    long lSize;
+
+    if( pxFile == NULL )
+    {
+        return NULL;
+    }
+
+    fseek( pxFile, 0, SEEK_END );
+    lSize = ftell( pxFile );
+    rewind( pxFile );
+
+    pucData = malloc( ( size_t ) lSize + 1 );
+
+    if( ( pucData != NULL ) && ( fread( pucData, 1, ( size_t ) lSize, pxFile ) == ( size_t ) lSize ) )
+    {
+        pucData[ lSize ] = '\0';
+        *pxLength = ( size_t ) lSize + 1;
+    }
+    else
+    {
+        free( pucData );
+        pucData = NULL;
+    }
+
+    fclose( pxFile );
+
+    return pucData;
+}
+
+static int prvConnectSocket( int lPort )
+{
+    struct sockaddr_in xAddress;
+    int lNoDelay = 1;
+
+    memset( &xAddress, 0, sizeof( xAddress ) );
+    xAddress.sin_family = AF_INET;
+    xAddress.sin_port = htons( ( uint16_t ) lPort );
+    xAddress.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    lSocket = socket( AF_INET, SOCK_STREAM, 0 );
+
+    /* mbed TLS sends a flight a record at a time, the device's stack does not
+     * hold the last one back until the server acknowledges the first. */
+    setsockopt( lSocket, IPPROTO_TCP, TCP_NODELAY, &lNoDelay, sizeof( lNoDelay ) );
+
+    return ( lSocket >= 0 ) && ( connect( lSocket, ( struct sockaddr * ) &xAddress, sizeof( xAddress ) ) == 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* What the transport builds from NetworkCredentials_t: seeded DRBG, defaults,
+ * root CAs, client certificate and key. */
+static int prvBuildConfig( int xSessionTickets )
+{
+    mbedtls_entropy_init( &xEntropy );
+    mbedtls_ctr_drbg_init( &xDrbg );
+    mbedtls_ssl_config_init( &xConfig );
+    mbedtls_x509_crt_init( &xRootCa );
+    mbedtls_x509_crt_init( &xClientCert );
+    mbedtls_pk_init( &xClientKey );
+
+    if( ( mbedtls_ctr_drbg_seed( &xDrbg, mbedtls_entropy_func, &xEntropy, NULL, 0 ) != 0 ) ||
+        ( mbedtls_ssl_config_defaults( &xConfig, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT ) != 0 ) )
+    {
+        return 0;
+    }
+
+    mbedtls_ssl_conf_authmode( &xConfig, MBEDTLS_SSL_VERIFY_REQUIRED );
+    mbedtls_ssl_conf_rng( &xConfig, mbedtls_ctr_drbg_random, &xDrbg );
+
+    if( mbedtls_x509_crt_parse( &xRootCa, pucRootCa, xRootCaLength ) != 0 )
+    {
+        return 0;
+    }
+
+    mbedtls_ssl_conf_ca_chain( &xConfig, &xRootCa, NULL );
+
+    if( ( mbedtls_x509_crt_parse( &xClientCert, pucClientCert, xClientCertLength ) != 0 ) ||
+        ( mbedtls_pk_parse_key( &xClientKey, pucClientKey, xClientKeyLength, NULL, 0 ) != 0 ) ||
+        ( mbedtls_ssl_conf_own_cert( &xConfig, &xClientCert, &xClientKey ) != 0 ) )
+    {
+        return 0;
+    }
+
+    mbedtls_ssl_conf_session_tickets( &xConfig, xSessionTickets ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED :
+                                      MBEDTLS_SSL_SESSION_TICKETS_DISABLED );
+
+    return 1;
+}
+
+static void prvFreeConfig( void )
+{
+    mbedtls_x509_crt_free( &xRootCa );
+    mbedtls_x509_crt_free( &xClientCert );
+    mbedtls_pk_free( &xClientKey );
+    mbedtls_ssl_config_free( &xConfig );
+    mbedtls_ctr_drbg_free( &xDrbg );
+    mbedtls_entropy_free( &xEntropy );
+}
+
+/* The per connection part of TLS_Socket_Connect, up to the handshake. */
+static int prvSetupConnection( void )
+{
+    mbedtls_ssl_init( &xSsl );
+
+    if( ( mbedtls_ssl_setup( &xSsl, &xConfig ) != 0 ) ||
+        ( mbedtls_ssl_set_hostname( &xSsl, TLS_BENCH_HOSTNAME ) != 0 ) )
+    {
+        return 0;
+    }
+
+    mbedtls_ssl_set_bio( &xSsl, NULL, prvSend, prvRecv, NULL );
+
+    return 1;
+}
+
+static int prvHandshake( void )
+{
+    int lResult;
+
+    do
+    {
+        lResult = mbedtls_ssl_handshake( &xSsl );
+    } while( ( lResult == MBEDTLS_ERR_SSL_WANT_READ ) || ( lResult == MBEDTLS_ERR_SSL_WANT_WRITE ) );
+
+    if( lResult != 0 )
+    {
+        printf( "\tFailed! handshake -0x%04x\n", ( unsigned ) -lResult );
+    }
+
+    return lResult == 0;
+}
+
+static void prvDisconnect( void )
+{
+    ( void ) mbedtls_ssl_close_notify( &xSsl );
+    mbedtls_ssl_free( &xSsl );
+    close( lSocket );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvBenchHandshake( int lPort,
+                              const char * pcMode,
+                              int lConnects )
+{
+    int xResume = ( strcmp( pcMode, "full" ) != 0 );
+    int xSessionTickets = ( strcmp( pcMode, "id" ) != 0 );
+    int xHaveSession = 0;
+    double dStart;
+    double dTotalMs = 0;
+    unsigned long ulTotalBytes = 0;
+    int i;
+
+    if( !prvBuildConfig( xSessionTickets ) )
+    {
+        printf( "\tFailed! credentials not taken\n" );
+        return TLS_BENCH_FAIL;
+    }
+
+    mbedtls_ssl_session_init( &xSession );
+
+    for( i = 0; i <= lConnects; i++ )
+    {
+        if( !prvConnectSocket( lPort ) || !prvSetupConnection() )
+        {
+            printf( "\tFailed! connect %d\n", i );
+            return TLS_BENCH_FAIL;
+        }
+
+        /* As the transport's session cache: offer the last session, keep the new one. */
+        if( xResume && xHaveSession && ( mbedtls_ssl_set_session( &xSsl, &xSession ) != 0 ) )
+        {
+            printf( "\tFailed! session not offered\n" );
+            return TLS_BENCH_FAIL;
+        }
+
+        ulBytesSent = 0;
+        ulBytesReceived = 0;
+        dStart = prvNowMs();
+
+        if( !prvHandshake() )
+        {
+            return TLS_BENCH_FAIL;
+        }
+
+        if( i != 0 )
+        {
+            dTotalMs += prvNowMs() - dStart;
+            ulTotalBytes += ulBytesSent + ulBytesReceived;
+        }
+
+        if( xResume )
+        {
+            mbedtls_ssl_session_free( &xSession );
+            mbedtls_ssl_session_init( &xSession );
+            xHaveSession = ( mbedtls_ssl_get_session( &xSsl, &xSession ) == 0 );
+        }
+
+        prvDisconnect();
+    }
+
+    printf( "\t%-6s handshake %7.2f ms %6lu bytes, average of %d connects\n", pcMode, dTotalMs / lConnects,
+            ulTotalBytes / ( unsigned long ) lConnects, lConnects );
+
+    mbedtls_ssl_session_free( &xSession );
+    prvFreeConfig();
+
+    return TLS_BENCH_SUCCESS;
+}
+
+static int prvBenchSetup( int lPort,
+                          const char * pcMode,
+                          int lConnects )
+{
+    int xShared = ( strcmp( pcMode, "shared" ) == 0 );
+    struct mallinfo2 xHeapBefore;
+    unsigned long ulCallocsBefore;
+    double dStart;
+    double dSetupDone;
+    double dSetupMs = 0;
+    double dHandshakeMs = 0;
+    unsigned long ulHeldBytes = 0;
+    unsigned long ulAllocations = 0;
+    int i;
+
+    if( xShared && !prvBuildConfig( 1 ) )
+    {
+        printf( "\tFailed! credentials not taken\n" );
+        return TLS_BENCH_FAIL;
+    }
+
+    for( i = 0; i <= lConnects; i++ )
+    {
+        if( !prvConnectSocket( lPort ) )
+        {
+            printf( "\tFailed! connect %d\n", i );
+            return TLS_BENCH_FAIL;
+        }
+
+        xHeapBefore = mallinfo2();
+        ulCallocsBefore = ulCallocs;
+        dStart = prvNowMs();
+
+        if( ( !xShared && !prvBuildConfig( 1 ) ) || !prvSetupConnection() )
+        {
+            printf( "\tFailed! setup %d\n", i );
+            return TLS_BENCH_FAIL;
+        }
+
+        dSetupDone = prvNowMs();
+
+        if( i != 0 )
+        {
+            dSetupMs += dSetupDone - dStart;
+            ulHeldBytes += ( unsigned long ) ( mallinfo2().uordblks - xHeapBefore.uordblks );
+            ulAllocations += ulCallocs - ulCallocsBefore;
+        }
+
+        if( !prvHandshake() )
+        {
+            return TLS_BENCH_FAIL;
+        }
+
+        if( i != 0 )
+        {
+            dHandshakeMs += prvNowMs() - dSetupDone;
+        }
+
+        prvDisconnect();
+
+        if( !xShared )
+        {
+            prvFreeConfig();
+        }
+    }
+
+    printf( "\t%-11s setup %6.3f ms %6lu bytes held %3lu allocations, handshake %6.2f ms, average of %d connects\n",
+            pcMode, dSetupMs / lConnects, ulHeldBytes / ( unsigned long ) lConnects,
+            ulAllocations / ( unsigned long ) lConnects, dHandshakeMs / lConnects, lConnects );
+
+    if( xShared )
+    {
+        prvFreeConfig();
+    }
+
+    return TLS_BENCH_SUCCESS;
+}
+
+/* Whole buffer, mbed TLS may take or hand out a record at a time. */
+static int prvWriteAll( mbedtls_ssl_context * pxSsl,
+                        const uint8_t * pucData,
+                        size_t xLength )
+{
+    int lResult;
+
+    while( xLength > 0 )
+    {
+        lResult = mbedtls_ssl_write( pxSsl, pucData, xLength );
+
+        if( lResult <= 0 )
+        {
+            if( ( lResult != MBEDTLS_ERR_SSL_WANT_READ ) && ( lResult != MBEDTLS_ERR_SSL_WANT_WRITE ) )
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            pucData += lResult;
+            xLength -= ( size_t ) lResult;
+        }
+    }
+
+    return 1;
+}
+
+static int prvReadAll( mbedtls_ssl_context * pxSsl,
+                       uint8_t * pucData,
+                       size_t xLength )
+{
+    int lResult;
+
+    while( xLength > 0 )
+    {
+        lResult = mbedtls_ssl_read( pxSsl, pucData, xLength );
+
+        if( lResult <= 0 )
+        {
+            if( ( lResult != MBEDTLS_ERR_SSL_WANT_READ ) && ( lResult != MBEDTLS_ERR_SSL_WANT_WRITE ) )
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            pucData += lResult;
+            xLength -= ( size_t ) lResult;
+        }
+    }
+
+    return 1;
+}
+
+/* One MQTT packet: type, remaining length, body. */
+static int prvMqttWrite( mbedtls_ssl_context * pxSsl,
+                         uint8_t ucType,
+                         const uint8_t * pucBody,
+                         size_t xLength )
+{
+    uint8_t ucPacket[ TLS_BENCH_MQTT_MAX_PACKET + 5 ];
+    size_t xUsed = 1;
+    size_t xRemaining = xLength;
+
+    ucPacket[ 0 ] = ucType;
+
+    do
+    {
+        ucPacket[ xUsed ] = ( uint8_t ) ( xRemaining & 0x7F );
+        xRemaining >>= 7;
+
+        if( xRemaining != 0 )
+        {
+            ucPacket[ xUsed ] |= 0x80;
+        }
+
+        xUsed++;
+    } while( xRemaining != 0 );
+
+    memcpy( ucPacket + xUsed, pucBody, xLength );
+
+    return prvWriteAll( pxSsl, ucPacket, xUsed + xLength );
+}
+
+/* Returns the packet type, 0 when the connection failed. */
+static uint8_t prvMqttRead( mbedtls_ssl_context * pxSsl,
+                            uint8_t * pucBody,
+                            size_t * pxLength )
+{
+    uint8_t ucType;
+    uint8_t ucByte;
+    size_t xLength = 0;
+    int lShift = 0;
+
+    if( !prvReadAll( pxSsl, &ucType, 1 ) )
+    {
+        return 0;
+    }
+
+    do
+    {
+        if( ( lShift > 21 ) || !prvReadAll( pxSsl, &ucByte, 1 ) )
+        {
+            return 0;
+        }
+
+        xLength |= ( size_t ) ( ucByte & 0x7F ) << lShift;
+        lShift += 7;
+    } while( ucByte & 0x80 );
+
+    if( ( xLength > TLS_BENCH_MQTT_MAX_PACKET ) || !prvReadAll( pxSsl, pucBody, xLength ) )
+    {
+        return 0;
+    }
+
+    *pxLength = xLength;
+
+    return ucType;
+}
+
+static size_t prvPutString( uint8_t * pucBody,
+                            size_t xUsed,
+                            const char * pcString )
+{
+    size_t xLength = strlen( pcString );
+
+    pucBody[ xUsed ] = ( uint8_t ) ( xLength >> 8 );
+    pucBody[ xUsed + 1 ] = ( uint8_t ) xLength;
+    memcpy( pucBody + xUsed + 2, pcString, xLength );
+
+    return xUsed + 2 + xLength;
+}
+
+static size_t prvPutPacketId( uint8_t * pucBody,
+                              size_t xUsed )
+{
+    usPacketId = ( uint16_t ) ( ( usPacketId == 0xFFFF ) ? 1 : ( usPacketId + 1 ) );
+    pucBody[ xUsed ] = ( uint8_t ) ( usPacketId >> 8 );
+    pucBody[ xUsed + 1 ] = ( uint8_t ) usPacketId;
+
+    return xUsed + 2;
+}
+
+/* Sends a packet on the device connection and waits for its acknowledgement. */
+static int prvMqttExchange( uint8_t ucType,
+                            const uint8_t * pucBody,
+                            size_t xLength,
+                            uint8_t ucAckType )
+{
+    uint8_t ucAck[ TLS_BENCH_MQTT_MAX_PACKET ];
+    size_t xAckLength;
+
+    return prvMqttWrite( &xSsl, ucType, pucBody, xLength ) &&
+           ( TLS_BENCH_MQTT_TYPE( prvMqttRead( &xSsl, ucAck, &xAckLength ) ) == ucAckType );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvBrokerSend( void * pvContext,
+                          const unsigned char * pucData,
+                          size_t xLength )
+{
+    ssize_t xSent = send( *( int * ) pvContext, pucData, xLength, MSG_NOSIGNAL );
+
+    return ( xSent < 0 ) ? MBEDTLS_ERR_NET_SEND_FAILED : ( int ) xSent;
+}
+
+static int prvBrokerRecv( void * pvContext,
+                          unsigned char * pucData,
+                          size_t xLength )
+{
+    ssize_t xReceived = recv( *( int * ) pvContext, pucData, xLength, 0 );
+
+    return ( xReceived < 0 ) ? MBEDTLS_ERR_NET_RECV_FAILED : ( int ) xReceived;
+}
+
+/* Answers one packet, returns 0 once the connection is to be closed. */
+static int prvBrokerAnswer( void )
+{
+    uint8_t ucBody[ TLS_BENCH_MQTT_MAX_PACKET ];
+    uint8_t ucAck[ 3 ];
+    size_t xLength;
+    size_t xTopicLength;
+
+    switch( TLS_BENCH_MQTT_TYPE( prvMqttRead( &xBrokerSsl, ucBody, &xLength ) ) )
+    {
+        case TLS_BENCH_MQTT_CONNECT:
+            ucAck[ 0 ] = 0;
+            ucAck[ 1 ] = 0;
+
+            return prvMqttWrite( &xBrokerSsl, TLS_BENCH_MQTT_CONNACK, ucAck, 2 );
+
+        case TLS_BENCH_MQTT_SUBSCRIBE:
+            ucAck[ 0 ] = ucBody[ 0 ];
+            ucAck[ 1 ] = ucBody[ 1 ];
+            ucAck[ 2 ] = 1;
+
+            return prvMqttWrite( &xBrokerSsl, TLS_BENCH_MQTT_SUBACK, ucAck, 3 );
+
+        case TLS_BENCH_MQTT_UNSUBSCRIBE:
+            return prvMqttWrite( &xBrokerSsl, TLS_BENCH_MQTT_UNSUBACK, ucBody, 2 );
+
+        case TLS_BENCH_MQTT_PUBLISH:
+            xTopicLength = ( ( size_t ) ucBody[ 0 ] << 8 ) | ucBody[ 1 ];
+
+            if( ( xTopicLength + 4 > xLength ) ||
+                !prvMqttWrite( &xBrokerSsl, TLS_BENCH_MQTT_PUBACK, ucBody + 2 + xTopicLength, 2 ) )
+            {
+                return 0;
+            }
+
+            /* Cut after the acknowledgement, without a close notify. */
+            return ( ++xBroker.ulPublishes % TLS_BENCH_CUT_EVERY ) != 0;
+
+        default:
+            /* DISCONNECT, or the device went away. */
+            return 0;
+    }
+}
+
+static void * prvBrokerTask( void * pvParameters )
+{
+    int lResult;
+    int lNoDelay = 1;
+
+    ( void ) pvParameters;
+
+    while( ( xBroker.lConnection = accept( xBroker.lListener, NULL, NULL ) ) >= 0 )
+    {
+        /* As on the device socket. */
+        setsockopt( xBroker.lConnection, IPPROTO_TCP, TCP_NODELAY, &lNoDelay, sizeof( lNoDelay ) );
+        mbedtls_ssl_init( &xBrokerSsl );
+
+        if( mbedtls_ssl_setup( &xBrokerSsl, &xBrokerConfig ) == 0 )
+        {
+            mbedtls_ssl_set_bio( &xBrokerSsl, &xBroker.lConnection, prvBrokerSend, prvBrokerRecv, NULL );
+
+            do
+            {
+                lResult = mbedtls_ssl_handshake( &xBrokerSsl );
+            } while( ( lResult == MBEDTLS_ERR_SSL_WANT_READ ) || ( lResult == MBEDTLS_ERR_SSL_WANT_WRITE ) );
+
+            while( ( lResult == 0 ) && prvBrokerAnswer() )
+            {
+            }
+        }
+
+        mbedtls_ssl_free( &xBrokerSsl );
+        close( xBroker.lConnection );
+    }
+
+    return NULL;
+}
+
+static int prvBrokerStart( int lPort )
+{
+    struct sockaddr_in xAddress;
+    int lReuse = 1;
+
+    mbedtls_entropy_init( &xBrokerEntropy );
+    mbedtls_ctr_drbg_init( &xBrokerDrbg );
+    mbedtls_ssl_config_init( &xBrokerConfig );
+    mbedtls_x509_crt_init( &xBrokerRootCa );
+    mbedtls_x509_crt_init( &xBrokerCert );
+    mbedtls_pk_init( &xBrokerKey );
+    mbedtls_ssl_cache_init( &xBrokerCache );
+    mbedtls_ssl_ticket_init( &xBrokerTicket );
+
+    /* Like the hub: the device certificate is asked for and checked, sessions
+     * resume from a ticket or the session ID. */
+    if( ( mbedtls_ctr_drbg_seed( &xBrokerDrbg, mbedtls_entropy_func, &xBrokerEntropy, NULL, 0 ) != 0 ) ||
+        ( mbedtls_ssl_config_defaults( &xBrokerConfig, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                       MBEDTLS_SSL_PRESET_DEFAULT ) != 0 ) ||
+        ( mbedtls_x509_crt_parse( &xBrokerRootCa, pucRootCa, xRootCaLength ) != 0 ) ||
+        ( mbedtls_x509_crt_parse( &xBrokerCert, pucServerCert, xServerCertLength ) != 0 ) ||
+        ( mbedtls_pk_parse_key( &xBrokerKey, pucServerKey, xServerKeyLength, NULL, 0 ) != 0 ) ||
+        ( mbedtls_ssl_ticket_setup( &xBrokerTicket, mbedtls_ctr_drbg_random, &xBrokerDrbg,
+                                    MBEDTLS_CIPHER_AES_256_GCM, TLS_BENCH_TICKET_LIFETIME ) != 0 ) )
+    {
+        printf( "\tFailed! broker credentials not taken\n" );
+        return 0;
+    }
+
+    mbedtls_ssl_conf_rng( &xBrokerConfig, mbedtls_ctr_drbg_random, &xBrokerDrbg );
+    mbedtls_ssl_conf_authmode( &xBrokerConfig, MBEDTLS_SSL_VERIFY_REQUIRED );
+    mbedtls_ssl_conf_ca_chain( &xBrokerConfig, &xBrokerRootCa, NULL );
+    mbedtls_ssl_conf_session_cache( &xBrokerConfig, &xBrokerCache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set );
+    mbedtls_ssl_conf_session_tickets_cb( &xBrokerConfig, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse,
+                                         &xBrokerTicket );
+
+    if( mbedtls_ssl_conf_own_cert( &xBrokerConfig, &xBrokerCert, &xBrokerKey ) != 0 )
+    {
+        printf( "\tFailed! broker certificate not taken\n" );
+        return 0;
+    }
+
+    memset( &xAddress, 0, sizeof( xAddress ) );
+    xAddress.sin_family = AF_INET;
+    xAddress.sin_port = htons( ( uint16_t ) lPort );
+    xAddress.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    xBroker.ulPublishes = 0;
+    xBroker.lListener = socket( AF_INET, SOCK_STREAM, 0 );
+    setsockopt( xBroker.lListener, SOL_SOCKET, SO_REUSEADDR, &lReuse, sizeof( lReuse ) );
+
+    if( ( bind( xBroker.lListener, ( struct sockaddr * ) &xAddress, sizeof( xAddress ) ) != 0 ) ||
+        ( listen( xBroker.lListener, 1 ) != 0 ) ||
+        ( pthread_create( &xBroker.xThread, NULL, prvBrokerTask, NULL ) != 0 ) )
+    {
+        printf( "\tFailed! broker could not listen on %d\n", lPort );
+        return 0;
+    }
+
+    return 1;
+}
+
+static void prvBrokerStop( void )
+{
+    /* Wakes the accept, the device has closed its last connection. */
+    shutdown( xBroker.lListener, SHUT_RDWR );
+    pthread_join( xBroker.xThread, NULL );
+    close( xBroker.lListener );
+
+    mbedtls_ssl_ticket_free( &xBrokerTicket );
+    mbedtls_ssl_cache_free( &xBrokerCache );
+    mbedtls_x509_crt_free( &xBrokerRootCa );
+    mbedtls_x509_crt_free( &xBrokerCert );
+    mbedtls_pk_free( &xBrokerKey );
+    mbedtls_ssl_config_free( &xBrokerConfig );
+    mbedtls_ctr_drbg_free( &xBrokerDrbg );
+    mbedtls_entropy_free( &xBrokerEntropy );
+}
+
+/*-----------------------------------------------------------*/
+
+/* What a session costs the device before the first publish: the handshake
+ * with the last session offered, CONNECT and the subscriptions. */
+static int prvSessionStart( int lPort,
+                            double * pdHandshakeMs )
+{
+    uint8_t ucBody[ TLS_BENCH_MQTT_MAX_PACKET ];
+    size_t xUsed;
+    size_t i;
+    double dStart;
+
+    if( !prvConnectSocket( lPort ) || !prvSetupConnection() ||
+        ( xSessionSaved && ( mbedtls_ssl_set_session( &xSsl, &xSession ) != 0 ) ) )
+    {
+        printf( "\tFailed! device could not connect\n" );
+        return 0;
+    }
+
+    dStart = prvNowMs();
+
+    if( !prvHandshake() )
+    {
+        return 0;
+    }
+
+    *pdHandshakeMs += prvNowMs() - dStart;
+
+    mbedtls_ssl_session_free( &xSession );
+    mbedtls_ssl_session_init( &xSession );
+    xSessionSaved = ( mbedtls_ssl_get_session( &xSsl, &xSession ) == 0 );
+
+    /* MQTT 3.1.1, user name, clean session, 60 s keep alive. */
+    xUsed = prvPutString( ucBody, 0, "MQTT" );
+    ucBody[ xUsed++ ] = 4;
+    ucBody[ xUsed++ ] = 0x82;
+    ucBody[ xUsed++ ] = 0;
+    ucBody[ xUsed++ ] = 60;
+    xUsed = prvPutString( ucBody, xUsed, "bench-device" );
+    xUsed = prvPutString( ucBody, xUsed, "bench-hub.azure-devices.net/bench-device/?api-version=2021-04-12" );
+
+    if( !prvMqttExchange( TLS_BENCH_MQTT_CONNECT, ucBody, xUsed, TLS_BENCH_MQTT_CONNACK ) )
+    {
+        printf( "\tFailed! CONNECT not acknowledged\n" );
+        return 0;
+    }
+
+    for( i = 0; i < TLS_BENCH_TOPIC_FILTERS; i++ )
+    {
+        xUsed = prvPutPacketId( ucBody, 0 );
+        xUsed = prvPutString( ucBody, xUsed, pcTopicFilters[ i ] );
+        ucBody[ xUsed++ ] = 1;
+
+        if( !prvMqttExchange( TLS_BENCH_MQTT_SUBSCRIBE | 0x02, ucBody, xUsed, TLS_BENCH_MQTT_SUBACK ) )
+        {
+            printf( "\tFailed! SUBSCRIBE not acknowledged\n" );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* A planned end unsubscribes and disconnects first, a lost session is just closed. */
+static void prvSessionEnd( int xPlanned )
+{
+    uint8_t ucBody[ TLS_BENCH_MQTT_MAX_PACKET ];
+    size_t xUsed;
+    size_t i;
+
+    for( i = 0; xPlanned && ( i < TLS_BENCH_TOPIC_FILTERS ); i++ )
+    {
+        xUsed = prvPutPacketId( ucBody, 0 );
+        xUsed = prvPutString( ucBody, xUsed, pcTopicFilters[ i ] );
+        xPlanned = prvMqttExchange( TLS_BENCH_MQTT_UNSUBSCRIBE | 0x02, ucBody, xUsed, TLS_BENCH_MQTT_UNSUBACK );
+    }
+
+    if( xPlanned )
+    {
+        ( void ) prvMqttWrite( &xSsl, TLS_BENCH_MQTT_DISCONNECT, ucBody, 0 );
+    }
+
+    prvDisconnect();
+}
+
+/* One telemetry message, QoS1. Returns 0 when the session was lost. */
+static int prvPublish( void )
+{
+    static uint8_t ucBody[ TLS_BENCH_MQTT_MAX_PACKET ];
+    size_t xUsed;
+
+    xUsed = prvPutString( ucBody, 0, "devices/bench-device/messages/events/" );
+    xUsed = prvPutPacketId( ucBody, xUsed );
+    memset( ucBody + xUsed, 0xA5, TLS_BENCH_PAYLOAD_LENGTH );
+
+    return prvMqttExchange( TLS_BENCH_MQTT_PUBLISH | 0x02, ucBody, xUsed + TLS_BENCH_PAYLOAD_LENGTH,
+                            TLS_BENCH_MQTT_PUBACK );
+}
+
+static int prvBenchSession( int lPort,
+                            const char * pcMode,
+                            int lPublishes )
+{
+    int xPersistent = ( strcmp( pcMode, "persistent" ) == 0 );
+    int xConnected = 0;
+    int lPublished = 0;
+    int lSessionPublishes = 0;
+    unsigned long ulSessions = 0;
+    double dHandshakeMs = 0;
+    double dSessionEnd = 0;
+    double dReconnectMs;
+    double dTotalReconnectMs = 0;
+    double dMaxReconnectMs = 0;
+    double dStart;
+
+    if( !prvBrokerStart( lPort ) || !prvBuildConfig( 1 ) )
+    {
+        return TLS_BENCH_FAIL;
+    }
+
+    mbedtls_ssl_session_init( &xSession );
+    xSessionSaved = 0;
+    ulBytesSent = 0;
+    ulBytesReceived = 0;
+    dStart = prvNowMs();
+
+    while( lPublished < lPublishes )
+    {
+        if( !xConnected )
+        {
+            if( !prvSessionStart( lPort, &dHandshakeMs ) )
+            {
+                return TLS_BENCH_FAIL;
+            }
+
+            if( ulSessions != 0 )
+            {
+                dReconnectMs = prvNowMs() - dSessionEnd;
+                dTotalReconnectMs += dReconnectMs;
+                dMaxReconnectMs = ( dReconnectMs > dMaxReconnectMs ) ? dReconnectMs : dMaxReconnectMs;
+            }
+
+            ulSessions++;
+            lSessionPublishes = 0;
+            xConnected = 1;
+        }
+
+        if( prvPublish() )
+        {
+            lPublished++;
+            lSessionPublishes++;
+
+            if( !xPersistent && ( lSessionPublishes >= TLS_BENCH_RECYCLE_PUBLISHES ) && ( lPublished < lPublishes ) )
+            {
+                dSessionEnd = prvNowMs();
+                prvSessionEnd( 1 );
+                xConnected = 0;
+            }
+        }
+        else
+        {
+            /* Sent again with the next session, as the queued message is. */
+            dSessionEnd = prvNowMs();
+            prvSessionEnd( 0 );
+            xConnected = 0;
+        }
+    }
+
+    prvSessionEnd( 1 );
+
+    printf( "\t%-10s %d publishes in %7.1f ms: %3lu handshakes %6.1f ms, %3lu reconnects %6.2f ms average %6.2f ms max, %7lu bytes\n",
+            pcMode, lPublished, prvNowMs() - dStart, ulSessions, dHandshakeMs, ulSessions - 1,
+            ( ulSessions > 1 ) ? dTotalReconnectMs / ( double ) ( ulSessions - 1 ) : 0.0, dMaxReconnectMs,
+            ulBytesSent + ulBytesReceived );
+
+    prvBrokerStop();
+    mbedtls_ssl_session_free( &xSession );
+    prvFreeConfig();
+
+    return TLS_BENCH_SUCCESS;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    int lPort;
+    int lConnects;
+
+    if( argc != 5 )
+    {
+        printf( "usage: %s <port> handshake <full|ticket|id> <connects>\n"
+                "       %s <port> setup <per-connect|shared> <connects>\n"
+                "       %s <port> session <persistent|recycle> <publishes>\n", argv[ 0 ], argv[ 0 ], argv[ 0 ] );
+        return TLS_BENCH_FAIL;
+    }
+
+    lPort = atoi( argv[ 1 ] );
+    lConnects = atoi( argv[ 4 ] );
+
+    pucRootCa = prvReadFile( ( strcmp( argv[ 2 ], "setup" ) == 0 ) ? "roots.pem" : "ca.pem", &xRootCaLength );
+    pucClientCert = prvReadFile( "cli.pem", &xClientCertLength );
+    pucClientKey = prvReadFile( "cli.key", &xClientKeyLength );
+
+    if( ( pucRootCa == NULL ) || ( pucClientCert == NULL ) || ( pucClientKey == NULL ) || ( lConnects < 1 ) )
+    {
+        printf( "\tFailed! credentials not found or no connects\n" );
+        return TLS_BENCH_FAIL;
+    }
+
+    if( strcmp( argv[ 2 ], "handshake" ) == 0 )
+    {
+        return prvBenchHandshake( lPort, argv[ 3 ], lConnects );
+    }
+
+    if( strcmp( argv[ 2 ], "setup" ) == 0 )
+    {
+        return prvBenchSetup( lPort, argv[ 3 ], lConnects );
+    }
+
+    if( strcmp( argv[ 2 ], "session" ) == 0 )
+    {
+        pucServerCert = prvReadFile( "srv.pem", &xServerCertLength );
+        pucServerKey = prvReadFile( "srv.key", &xServerKeyLength );
+
+        if( ( pucServerCert == NULL ) || ( pucServerKey == NULL ) )
+        {
+            printf( "\tFailed! broker credentials not found\n" );
+            return TLS_BENCH_FAIL;
+        }
+
+        return prvBenchSession( lPort, argv[ 3 ], lConnects );
+    }
+
+    printf( "\tFailed! unknown bench %s\n", argv[ 2 ] );
+
+    return TLS_BENCH_FAIL;
+}
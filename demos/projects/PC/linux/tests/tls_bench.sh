@@ -0,0 +1,75 @@
+#! /bin/bash
+
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#
+# Runs tls_bench.c against a local OpenSSL s_server with throwaway credentials:
+# a test CA, an RSA 2048 server certificate and a P-256 client certificate.
+# The setup bench parses the demo's root CA bundle plus the test CA, as the
+# device would. The session bench serves its own stand-in MQTT broker on the
+# next port up.
+# Needs gcc, openssl and the mbed TLS 2.x development files (libmbedtls-dev).
+# TLS_BENCH_CFLAGS is added to the compile line, e.g. for another include path.
+#
+#   tls_bench.sh [connects] [publishes]
+
+set -e
+
+TESTS_DIR=$(cd "$(dirname "$0")" && pwd)
+DEMO_CONFIG="$TESTS_DIR/../../../ST/b-l475e-iot01a/config/demo_config.h"
+CONNECTS=${1:-20}
+PUBLISHES=${2:-300}
+PORT=${TLS_BENCH_PORT:-44330}
+WORK=$(mktemp -d)
+SERVER_PID=
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+    fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+cd "$WORK"
+
+openssl req -x509 -newkey rsa:2048 -nodes -keyout ca.key -out ca.pem -days 1 -subj "/CN=TLS bench CA" 2>/dev/null
+openssl req -newkey rsa:2048 -nodes -keyout srv.key -out srv.csr -subj "/CN=localhost" 2>/dev/null
+echo "subjectAltName=DNS:localhost" > srv.ext
+openssl x509 -req -in srv.csr -CA ca.pem -CAkey ca.key -CAcreateserial -out srv.pem -days 1 -extfile srv.ext 2>/dev/null
+openssl ecparam -name prime256v1 -genkey -noout -out cli.key
+openssl req -new -key cli.key -out cli.csr -subj "/CN=TLS bench device" 2>/dev/null
+openssl x509 -req -in cli.csr -CA ca.pem -CAkey ca.key -CAcreateserial -out cli.pem -days 1 2>/dev/null
+
+# democonfigROOT_CA_PEM back from C string literals to PEM
+sed -n '/#define democonfigROOT_CA_PEM/,/^$/p' "$DEMO_CONFIG" | grep -o '"[^"]*"' \
+    | sed -e 's/^"//' -e 's/"$//' -e 's/\\r\\n$//' > roots.pem
+cat ca.pem >> roots.pem
+
+gcc -O2 -o tls_bench "$TESTS_DIR/tls_bench.c" $TLS_BENCH_CFLAGS -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+# TLS 1.2 like the transport, the client certificate is asked for and checked
+openssl s_server -accept "$PORT" -cert srv.pem -key srv.key -CAfile ca.pem -Verify 1 -tls1_2 -quiet > /dev/null 2>&1 &
+SERVER_PID=$!
+
+for i in $(seq 50); do
+    if (exec 3<> "/dev/tcp/127.0.0.1/$PORT") 2> /dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+echo "Handshake on localhost, $CONNECTS connects each"
+for MODE in full ticket id; do
+    ./tls_bench "$PORT" handshake "$MODE" "$CONNECTS"
+done
+
+echo "Setup before the handshake, $CONNECTS connects each"
+for MODE in per-connect shared; do
+    ./tls_bench "$PORT" setup "$MODE" "$CONNECTS"
+done
+
+echo "Publish loop against a stand-in MQTT broker, $PUBLISHES publishes each"
+for MODE in persistent recycle; do
+    ./tls_bench $((PORT + 1)) session "$MODE" "$PUBLISHES"
+done
@@ -278,11 +278,37 @@ extern void vLoggingPrintf( const char * pcFormatString,
  */
 #define democonfigNETWORK_BUFFER_SIZE        ( 5 * 1024U )
 
+/**
+ * @brief RAM of the telemetry path: the scratch arenas of the network and
+ * sampling tasks, the socket receive buffers, the send coalescing buffer of the
+ * connection and the telemetry queue, which gets whatever the others leave.
+ * With the 5 KB network buffer that is 4816 + 3456 + 2400 + 1200 bytes and
+ * 5536 bytes of queue, 13 CBOR messages.
+ *
+ * Task stacks come from configTOTAL_HEAP_SIZE and are not counted, the DNS
+ * refresh task of the socket wrapper among them (configMINIMAL_STACK_SIZE * 4
+ * words, 1440 bytes).
+ */
+#define democonfigTELEMETRY_RAM_BUDGET       ( 17 * 1024U )
+
+/**
+ * @brief Receive buffers of the socket wrapper, ES_WIFI_PAYLOAD_SIZE for each
+ * of its wificonfigMAX_SOCKETS sockets. The wrapper fails the build when they
+ * need more.
+ */
+#define democonfigSOCKETS_RX_BUFFER_RAM      ( 2 * 1200U )
+
 /**
  * @brief IoTHub endpoint port.
  */
 #define democonfigIOTHUB_PORT                ( 8883 )
 
+/**
+ * @brief Largest socket send the TLS records are gathered into, the payload
+ * of one WIFI_SendData exchange with the Inventek module (ES_WIFI_PAYLOAD_SIZE).
+ */
+#define democonfigSEND_COALESCE_SIZE         ( 1200U )
+
 /**
  * @brief Wifi SSID
  *
@@ -347,4 +373,7 @@ extern void vLoggingPrintf( const char * pcFormatString,
 #define democonfigSNTP_INIT_WAIT             1000000000U
 #define democonfigSNTP_INIT_RETRY_DELAY      5000
 
+/* Seconds between resyncs of the tick based time with the WiFi module. */
+#define democonfigTIME_RESYNC_INTERVAL_S     3600
+
 #endif /* DEMO_CONFIG_H */
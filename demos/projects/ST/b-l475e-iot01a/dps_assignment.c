@@ -0,0 +1,149 @@
+//========================================================================================================== INCLUDES
+#include "dps_assignment.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define RECORD_MAGIC 0x41535044u      // "DPSA"
+#define RECORD_VERSION 1
+
+// Record layout, little endian
+#define RECORD_MAGIC_OFFSET 0
+#define RECORD_VERSION_OFFSET 4
+#define RECORD_HOSTNAME_LENGTH_OFFSET 5
+#define RECORD_DEVICE_ID_LENGTH_OFFSET 6
+#define RECORD_SETTINGS_OFFSET 8      // crc of the ID scope and registration ID the assignment is for
+#define RECORD_HOSTNAME_OFFSET 12
+#define RECORD_DEVICE_ID_OFFSET (RECORD_HOSTNAME_OFFSET + DPS_ASSIGNMENT_MAX_LENGTH + 1)
+#define RECORD_CRC_OFFSET (RECORD_DEVICE_ID_OFFSET + DPS_ASSIGNMENT_MAX_LENGTH + 1)
+
+#if (RECORD_CRC_OFFSET + 4) != DPS_ASSIGNMENT_RECORD_SIZE
+#error "DPS_ASSIGNMENT_RECORD_SIZE does not match the record layout"
+#endif
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t length);
+static uint32_t settings_crc(const char* id_scope, const char* registration_id);
+static void put_u32(uint8_t* record, uint32_t offset, uint32_t value);
+static uint32_t get_u32(const uint8_t* record, uint32_t offset);
+static bool encode(const dps_assignment_t* assignment, uint32_t settings, uint8_t* record);
+static bool decode(const uint8_t* record, uint32_t settings, dps_assignment_t* assignment);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+bool dps_assignment_load(dps_assignment_t* assignment, const char* id_scope, const char* registration_id){
+  uint8_t record[DPS_ASSIGNMENT_RECORD_SIZE];
+
+  if(!dps_assignment_storage_read(record, sizeof(record))){
+    return false;
+  }
+
+  return decode(record, settings_crc(id_scope, registration_id), assignment);
+}
+
+bool dps_assignment_save(const dps_assignment_t* assignment, const char* id_scope, const char* registration_id){
+  uint8_t record[DPS_ASSIGNMENT_RECORD_SIZE];
+  uint8_t stored[DPS_ASSIGNMENT_RECORD_SIZE];
+
+  if(!encode(assignment, settings_crc(id_scope, registration_id), record)){
+    return false;
+  }
+
+  // Registering again mostly gives the same hub, spare the flash
+  if(dps_assignment_storage_read(stored, sizeof(stored)) && memcmp(record, stored, sizeof(record)) == 0){
+    return true;
+  }
+
+  return dps_assignment_storage_write(record, sizeof(record));
+}
+
+void dps_assignment_clear(void){
+  (void)dps_assignment_storage_erase();
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t length){
+  uint32_t bit;
+
+  crc = ~crc;
+
+  while(length-- > 0){
+    crc ^= *data++;
+
+    for(bit = 0; bit < 8; bit++){
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+
+  return ~crc;
+}
+
+static uint32_t settings_crc(const char* id_scope, const char* registration_id){
+  static const uint8_t separator = 0;
+  uint32_t crc;
+
+  crc = crc32_update(0, (const uint8_t*)id_scope, (uint32_t)strlen(id_scope));
+  crc = crc32_update(crc, &separator, 1);
+
+  return crc32_update(crc, (const uint8_t*)registration_id, (uint32_t)strlen(registration_id));
+}
+
+static void put_u32(uint8_t* record, uint32_t offset, uint32_t value){
+  record[offset] = (uint8_t)value;
+  record[offset + 1] = (uint8_t)(value >> 8);
+  record[offset + 2] = (uint8_t)(value >> 16);
+  record[offset + 3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t* record, uint32_t offset){
+  return (uint32_t)record[offset] | ((uint32_t)record[offset + 1] << 8) |
+         ((uint32_t)record[offset + 2] << 16) | ((uint32_t)record[offset + 3] << 24);
+}
+
+static bool encode(const dps_assignment_t* assignment, uint32_t settings, uint8_t* record){
+  if(assignment->hostname_length == 0 || assignment->hostname_length > DPS_ASSIGNMENT_MAX_LENGTH ||
+     assignment->device_id_length == 0 || assignment->device_id_length > DPS_ASSIGNMENT_MAX_LENGTH){
+    return false;
+  }
+
+  // Unused bytes are zero, the same assignment always gives the same record
+  memset(record, 0, DPS_ASSIGNMENT_RECORD_SIZE);
+  put_u32(record, RECORD_MAGIC_OFFSET, RECORD_MAGIC);
+  record[RECORD_VERSION_OFFSET] = RECORD_VERSION;
+  record[RECORD_HOSTNAME_LENGTH_OFFSET] = (uint8_t)assignment->hostname_length;
+  record[RECORD_DEVICE_ID_LENGTH_OFFSET] = (uint8_t)assignment->device_id_length;
+  put_u32(record, RECORD_SETTINGS_OFFSET, settings);
+  memcpy(record + RECORD_HOSTNAME_OFFSET, assignment->hostname, assignment->hostname_length);
+  memcpy(record + RECORD_DEVICE_ID_OFFSET, assignment->device_id, assignment->device_id_length);
+  put_u32(record, RECORD_CRC_OFFSET, crc32_update(0, record, RECORD_CRC_OFFSET));
+
+  return true;
+}
+
+static bool decode(const uint8_t* record, uint32_t settings, dps_assignment_t* assignment){
+  uint32_t hostname_length = record[RECORD_HOSTNAME_LENGTH_OFFSET];
+  uint32_t device_id_length = record[RECORD_DEVICE_ID_LENGTH_OFFSET];
+
+  if(get_u32(record, RECORD_MAGIC_OFFSET) != RECORD_MAGIC || record[RECORD_VERSION_OFFSET] != RECORD_VERSION ||
+     get_u32(record, RECORD_CRC_OFFSET) != crc32_update(0, record, RECORD_CRC_OFFSET)){
+    return false;
+  }
+
+  // Assigned for another ID scope or registration ID, the device was set up again
+  if(get_u32(record, RECORD_SETTINGS_OFFSET) != settings){
+    return false;
+  }
+
+  if(hostname_length == 0 || hostname_length > DPS_ASSIGNMENT_MAX_LENGTH ||
+     device_id_length == 0 || device_id_length > DPS_ASSIGNMENT_MAX_LENGTH){
+    return false;
+  }
+
+  memset(assignment, 0, sizeof(*assignment));
+  memcpy(assignment->hostname, record + RECORD_HOSTNAME_OFFSET, hostname_length);
+  assignment->hostname_length = hostname_length;
+  memcpy(assignment->device_id, record + RECORD_DEVICE_ID_OFFSET, device_id_length);
+  assignment->device_id_length = device_id_length;
+
+  return true;
+}
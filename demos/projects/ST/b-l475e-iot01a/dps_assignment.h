@@ -0,0 +1,48 @@
+#ifndef DPS_ASSIGNMENT_H_
+#define DPS_ASSIGNMENT_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define DPS_ASSIGNMENT_MAX_LENGTH 127     // Of the hub hostname and the device ID, the buffers keep a terminator
+#define DPS_ASSIGNMENT_RECORD_SIZE 272    // Stored record, a multiple of the 8 byte flash programming unit
+
+// Hub and device ID the provisioning service assigned. Kept across boots so the device
+// connects to the hub straight away and only registers again when the hub refuses it.
+typedef struct{
+  uint8_t hostname[DPS_ASSIGNMENT_MAX_LENGTH + 1];  // Zero terminated
+  uint32_t hostname_length;
+  uint8_t device_id[DPS_ASSIGNMENT_MAX_LENGTH + 1]; // Zero terminated
+  uint32_t device_id_length;
+}dps_assignment_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// Assignment stored for this ID scope and registration ID, false when there is none.
+// A record written for other settings, blank or torn by a reset is ignored.
+bool dps_assignment_load(dps_assignment_t* assignment, const char* id_scope, const char* registration_id);
+
+// Stores the assignment, the write is skipped when the same one is stored already
+bool dps_assignment_save(const dps_assignment_t* assignment, const char* id_scope, const char* registration_id);
+
+// Forgets the stored assignment, the next boot registers again
+void dps_assignment_clear(void);
+
+// One record of DPS_ASSIGNMENT_RECORD_SIZE bytes in non-volatile storage, provided by the port.
+// A write replaces the whole record, reading an erased record gives any content.
+bool dps_assignment_storage_read(uint8_t* record, uint32_t size);
+bool dps_assignment_storage_write(const uint8_t* record, uint32_t size);
+bool dps_assignment_storage_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DPS_ASSIGNMENT_H_ */
@@ -0,0 +1,168 @@
+//========================================================================================================== INCLUDES
+#include "frame_layout.h"
+#include "frame_parser.h"
+#include <stddef.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define FRAME_FIELD(type, status_type, member) {type, 1, offsetof(status_type, member)}
+#define FRAME_ARRAY(type, status_type, member, count) {type, count, offsetof(status_type, member)}
+#define FRAME_LAYOUT(fields, decode) {fields, sizeof(fields) / sizeof(fields[0]), decode}
+
+//========================================================================================================== VARIABLES
+static void unit_status_decode(const uint8_t payload[], void* status);
+static void skid_status_decode(const uint8_t payload[], void* status);
+
+static const frame_field_t unit_status_fields[] = {
+  FRAME_FIELD(FIELD_UINT8,        UNIT_status_t, unit_status),
+  FRAME_FIELD(FIELD_UINT8,        UNIT_status_t, unit_state),
+  FRAME_FIELD(FIELD_UINT16,       UNIT_status_t, heater_status),
+  FRAME_ARRAY(FIELD_Q16_UNSIGNED, UNIT_status_t, heater_temperatures, NUMBER_OF_HEATERS),
+  FRAME_FIELD(FIELD_UINT8,        UNIT_status_t, valve_status),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   UNIT_status_t, vacuum_sensor),
+  FRAME_FIELD(FIELD_Q16_UNSIGNED, UNIT_status_t, ambient_humidity),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   UNIT_status_t, ambient_temperature),
+  FRAME_FIELD(FIELD_UINT32,       UNIT_status_t, errors)
+};
+
+static const frame_field_t skid_status_fields[] = {
+  FRAME_FIELD(FIELD_UINT8,        SKID_status_t, skid_status),
+  FRAME_FIELD(FIELD_UINT8,        SKID_status_t, skid_state),
+  FRAME_FIELD(FIELD_UINT16,       SKID_status_t, outputs_status),
+  FRAME_FIELD(FIELD_Q16_UNSIGNED, SKID_status_t, o2_sensor),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   SKID_status_t, mass_flow),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   SKID_status_t, co2_sensor),
+  FRAME_FIELD(FIELD_Q16_UNSIGNED, SKID_status_t, tank_pressure),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   SKID_status_t, proportional_valve_pressure),
+  FRAME_FIELD(FIELD_Q16_SIGNED,   SKID_status_t, temperature),
+  FRAME_FIELD(FIELD_Q16_UNSIGNED, SKID_status_t, humidity),
+  FRAME_FIELD(FIELD_UINT32,       SKID_status_t, errors)
+};
+
+const frame_layout_t unit_status_layout = FRAME_LAYOUT(unit_status_fields, unit_status_decode);
+const frame_layout_t skid_status_layout = FRAME_LAYOUT(skid_status_fields, skid_status_decode);
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static inline uint32_t read_big_endian_32(const uint8_t* data);
+static uint8_t field_wire_size(uint8_t type);
+static uint8_t field_status_size(uint8_t type);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void frame_layout_decode(const frame_layout_t* layout, const uint8_t frame[], void* status){
+  if(layout->decode != NULL){
+    layout->decode(frame + FRAME_HEADER_LENGTH, status);
+  }
+  else{
+    frame_layout_decode_fields(layout, frame, status);
+  }
+}
+
+void frame_layout_decode_fields(const frame_layout_t* layout, const uint8_t frame[], void* status){
+  const uint8_t* wire = frame + FRAME_HEADER_LENGTH;
+  uint8_t* base = (uint8_t*)status;
+
+  for(uint8_t f = 0; f < layout->field_count; f++){
+    const frame_field_t* field = &layout->fields[f];
+    uint8_t* destination = base + field->status_offset;
+
+    for(uint8_t i = 0; i < field->count; i++){
+      switch(field->type){
+        case FIELD_UINT8:
+          *(uint8_t*)destination = wire[0];
+          break;
+        case FIELD_UINT16:
+          *(uint16_t*)destination = (uint16_t)((wire[0] << 8) | wire[1]);
+          break;
+        case FIELD_UINT32:
+          *(uint32_t*)destination = read_big_endian_32(wire);
+          break;
+        case FIELD_Q16_UNSIGNED:
+          *(sensor_value_t*)destination = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(wire));
+          break;
+        case FIELD_Q16_SIGNED:
+          *(sensor_value_t*)destination = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(wire));
+          break;
+        default:
+          break;
+      }
+
+      wire += field_wire_size(field->type);
+      destination += field_status_size(field->type);
+    }
+  }
+}
+
+uint16_t frame_layout_length(const frame_layout_t* layout){
+  uint16_t length = FRAME_HEADER_LENGTH + 1; // Header and crc
+
+  for(uint8_t f = 0; f < layout->field_count; f++){
+    length += field_wire_size(layout->fields[f].type) * layout->fields[f].count;
+  }
+
+  return length;
+}
+
+// unit_status_fields unrolled, test_frame_decode checks they stay the same
+static void unit_status_decode(const uint8_t payload[], void* status){
+  UNIT_status_t* unit = (UNIT_status_t*)status;
+  const uint8_t* values = payload + 4;
+
+  unit->unit_status = payload[0];
+  unit->unit_state = payload[1];
+  unit->heater_status = (uint16_t)((payload[2] << 8) | payload[3]);
+
+  for(uint8_t i = 0; i < NUMBER_OF_HEATERS; i++, values += 4){
+    unit->heater_temperatures[i] = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(values));
+  }
+
+  unit->valve_status = values[0];
+  unit->vacuum_sensor = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 1));
+  unit->ambient_humidity = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(values + 5));
+  unit->ambient_temperature = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 9));
+  unit->errors = read_big_endian_32(values + 13);
+}
+
+// skid_status_fields unrolled
+static void skid_status_decode(const uint8_t payload[], void* status){
+  SKID_status_t* skid = (SKID_status_t*)status;
+  const uint8_t* values = payload + 4;
+
+  skid->skid_status = payload[0];
+  skid->skid_state = payload[1];
+  skid->outputs_status = (uint16_t)((payload[2] << 8) | payload[3]);
+  skid->o2_sensor = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(values));
+  skid->mass_flow = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 4));
+  skid->co2_sensor = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 8));
+  skid->tank_pressure = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(values + 12));
+  skid->proportional_valve_pressure = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 16));
+  skid->temperature = SENSOR_VALUE_FROM_Q16((int32_t)read_big_endian_32(values + 20));
+  skid->humidity = SENSOR_VALUE_FROM_UQ16(read_big_endian_32(values + 24));
+  skid->errors = read_big_endian_32(values + 28);
+}
+
+static inline uint32_t read_big_endian_32(const uint8_t* data){
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static uint8_t field_wire_size(uint8_t type){
+  switch(type){
+    case FIELD_UINT8:
+      return 1;
+    case FIELD_UINT16:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+static uint8_t field_status_size(uint8_t type){
+  switch(type){
+    case FIELD_UINT8:
+      return sizeof(uint8_t);
+    case FIELD_UINT16:
+      return sizeof(uint16_t);
+    case FIELD_UINT32:
+      return sizeof(uint32_t);
+    default:
+      return sizeof(sensor_value_t);
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef FRAME_LAYOUT_H_
+#define FRAME_LAYOUT_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include "sensor_value.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define NUMBER_OF_HEATERS 9             // Its a continuous array for now
+
+#if 0
+// Structures in controllino for reference
+typedef struct{
+	uint8_t unit_status; //Flags//000//setup_state_synching_flag//just_started_flag//reset_flag//halt_flag//error_flag
+    uint8_t unit_state;
+    uint16_t heater_status;  //Heater//000000//9//8//7//6//5//4//3//2//1
+    uint32_t heater_temperatures[9];
+    uint8_t valve_status; //00000//Butterfly2//Butterfly1//Fan1
+    int32_t vacuum_sensor;
+    uint32_t ambient_humidity;
+    int32_t ambient_temperature;
+    uint32_t errors;
+}UNIT_status; //57 bytes
+
+typedef struct{
+	uint8_t skid_status; //Flags//0000//reset_flag//halt_flag//error_flag
+    uint8_t skid_state;
+    uint16_t outputs_status; 
+//0000000//CONDENSER//VACUUM_PUMP//COMPRESSOR//THREE_WAY_VALVE_AFTER_VACUUM_PUMP//THREE_WAY_VACUUM_RELEASE_VALVE_BEFORE_CONDENSATOR//VACUUM_RELEASE_VALVE_IN_WT//TWO_WAY_GAS_VALVE_AFTER_WT//TWO_WAY_WATER_OUTLET_VALVE_IN_WT//TWO_WAY_GAS_VALVE_BEFORE_WT
+    uint32_t o2_sensor;
+    int32_t mass_flow;
+    int32_t co2_sensor;
+    uint32_t tank_pressure;
+    int32_t proportional_valve_pressure;
+    int32_t temperature;
+    uint32_t humidity;
+    uint32_t errors;
+}SKID_status; //36 bytes
+#endif
+
+typedef struct{
+    uint8_t unit_status; //Flags//000//setup_state_synching_flag//just_started_flag//reset_flag//halt_flag//error_flag
+    uint8_t unit_state;
+    uint16_t heater_status;  //Heater//000000//9//8//7//6//5//4//3//2//1
+    sensor_value_t heater_temperatures[NUMBER_OF_HEATERS];
+    uint8_t valve_status; //00000//Butterfly2//Butterfly1//Fan1
+    sensor_value_t vacuum_sensor;
+    sensor_value_t ambient_humidity;
+    sensor_value_t ambient_temperature;
+    uint32_t errors;
+}UNIT_status_t;
+
+typedef struct{
+    uint8_t skid_status; //Flags//0000//reset_flag//halt_flag//error_flag
+    uint8_t skid_state;
+    uint16_t outputs_status;
+//0000000//CONDENSER//VACUUM_PUMP//COMPRESSOR//THREE_WAY_VALVE_AFTER_VACUUM_PUMP//THREE_WAY_VACUUM_RELEASE_VALVE_BEFORE_CONDENSATOR//VACUUM_RELEASE_VALVE_IN_WT//TWO_WAY_GAS_VALVE_AFTER_WT//TWO_WAY_WATER_OUTLET_VALVE_IN_WT//TWO_WAY_GAS_VALVE_BEFORE_WT
+    sensor_value_t o2_sensor;
+    sensor_value_t mass_flow;
+    sensor_value_t co2_sensor;
+    sensor_value_t tank_pressure;
+    sensor_value_t proportional_valve_pressure;
+    sensor_value_t temperature;
+    sensor_value_t humidity;
+    uint32_t errors;
+}SKID_status_t;
+
+// How a field is sent by the controller, all big endian
+typedef enum{
+  FIELD_UINT8,
+  FIELD_UINT16,
+  FIELD_UINT32,
+  FIELD_Q16_UNSIGNED,   // uint32_t Q16.16, stored as sensor_value_t
+  FIELD_Q16_SIGNED      // int32_t Q16.16, stored as sensor_value_t
+}frame_field_type_t;
+
+// One field of a frame payload. Fields follow each other on the wire in the order
+// of the table, right after the header, so only the destination has to be given.
+typedef struct{
+  uint8_t type;           // frame_field_type_t
+  uint8_t count;          // Consecutive fields of the same type going to an array
+  uint16_t status_offset; // offsetof() the destination in the status struct
+}frame_field_t;
+
+// The table describes the frame. A layout that is decoded on every frame may also have a hand
+// written decoder of the same fields, walking the table costs some 3.5x as much.
+typedef struct{
+  const frame_field_t* fields;
+  uint8_t field_count;
+  void (*decode)(const uint8_t payload[], void* status); // NULL to walk the table
+}frame_layout_t;
+
+//========================================================================================================== VARIABLES
+extern const frame_layout_t unit_status_layout;
+extern const frame_layout_t skid_status_layout;
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// Decodes a frame with a valid crc into status, frame points at the 'D' header byte
+void frame_layout_decode(const frame_layout_t* layout, const uint8_t frame[], void* status);
+
+// Same, always walking the table, the reference for the hand written decoders
+void frame_layout_decode_fields(const frame_layout_t* layout, const uint8_t frame[], void* status);
+
+// Frame length the layout describes, header and crc included
+uint16_t frame_layout_length(const frame_layout_t* layout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_LAYOUT_H_ */
@@ -0,0 +1,194 @@
+//========================================================================================================== INCLUDES
+#include "frame_parser.h"
+#include <memory.h>
+#include <stdbool.h>
+#if FRAME_CRC_HARDWARE
+#include "stm32l4xx_hal.h"
+#endif
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Table entry for one byte value: the byte shifted through the polynomial 8 times.
+// Expanded by the compiler, no table has to be generated at startup or pasted in.
+#define CRC_STEP(crc) ((((crc) << 1) ^ (((crc) & 0x80) ? CRC_POLYNOMIAL : 0)) & 0xFF)
+#define CRC_ENTRY(byte) (uint8_t)CRC_STEP(CRC_STEP(CRC_STEP(CRC_STEP(CRC_STEP(CRC_STEP(CRC_STEP(CRC_STEP(byte))))))))
+#define CRC_ROW(byte) CRC_ENTRY((byte) + 0), CRC_ENTRY((byte) + 1), CRC_ENTRY((byte) + 2), CRC_ENTRY((byte) + 3), \
+                      CRC_ENTRY((byte) + 4), CRC_ENTRY((byte) + 5), CRC_ENTRY((byte) + 6), CRC_ENTRY((byte) + 7), \
+                      CRC_ENTRY((byte) + 8), CRC_ENTRY((byte) + 9), CRC_ENTRY((byte) + 10), CRC_ENTRY((byte) + 11), \
+                      CRC_ENTRY((byte) + 12), CRC_ENTRY((byte) + 13), CRC_ENTRY((byte) + 14), CRC_ENTRY((byte) + 15)
+
+//========================================================================================================== VARIABLES
+#if !FRAME_CRC_HARDWARE
+static const uint8_t crc_table[256] = {
+  CRC_ROW(0x00), CRC_ROW(0x10), CRC_ROW(0x20), CRC_ROW(0x30), CRC_ROW(0x40), CRC_ROW(0x50), CRC_ROW(0x60), CRC_ROW(0x70),
+  CRC_ROW(0x80), CRC_ROW(0x90), CRC_ROW(0xA0), CRC_ROW(0xB0), CRC_ROW(0xC0), CRC_ROW(0xD0), CRC_ROW(0xE0), CRC_ROW(0xF0)
+};
+#endif
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint8_t frame_length_for_type(uint8_t type);
+static void frame_parser_drop(frame_parser_t* parser, uint8_t count);
+static void frame_parser_release(frame_parser_t* parser);
+static void frame_parser_resync(frame_parser_t* parser);
+static frame_type_t frame_parser_process(frame_parser_t* parser);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void frame_parser_init(frame_parser_t* parser){
+  parser->length = 0;
+  parser->expected = 1; // Wait for the 'D' byte first
+  parser->returned = 0;
+  memset(&parser->counters, 0, sizeof(parser->counters));
+}
+
+uint16_t frame_parser_bytes_needed(frame_parser_t* parser){
+  frame_parser_release(parser);
+
+  // Bytes kept from a failed frame may already be enough, then commit 0 bytes
+  return (parser->length >= parser->expected) ? 0 : parser->expected - parser->length;
+}
+
+uint8_t* frame_parser_next_bytes(frame_parser_t* parser){
+  frame_parser_release(parser);
+
+  return parser->data + parser->length;
+}
+
+frame_type_t frame_parser_commit(frame_parser_t* parser, uint16_t data_size){
+  frame_parser_release(parser);
+  parser->length += data_size;
+
+  return frame_parser_process(parser);
+}
+
+frame_type_t frame_parser_push(frame_parser_t* parser, const uint8_t* data, uint16_t data_size, uint16_t* consumed){
+  frame_type_t type = FRAME_NONE;
+  uint16_t used = 0;
+  uint16_t chunk = 0;
+
+  // Bytes held back from a failed frame come first
+  type = frame_parser_commit(parser, 0);
+
+  while((used < data_size) && (type == FRAME_NONE)){
+    chunk = frame_parser_bytes_needed(parser);
+    if(chunk > (data_size - used)){
+      chunk = data_size - used;
+    }
+
+    memcpy(frame_parser_next_bytes(parser), data + used, chunk);
+    used += chunk;
+    type = frame_parser_commit(parser, chunk);
+  }
+
+  if(consumed != NULL){
+    *consumed = used;
+  }
+
+  return type;
+}
+
+// Removes count bytes from the front, whatever follows is parsed again from the 'D' search
+static void frame_parser_drop(frame_parser_t* parser, uint8_t count){
+  memmove(parser->data, parser->data + count, parser->length - count);
+  parser->length -= count;
+  parser->expected = 1;
+}
+
+// The frame handed out by the last call is no longer needed
+static void frame_parser_release(frame_parser_t* parser){
+  if(parser->returned != 0){
+    frame_parser_drop(parser, parser->returned);
+    parser->returned = 0;
+  }
+}
+
+// The 'D' at the front did not start a valid frame. A lost byte shifts the real frame
+// boundary somewhere into what was collected, so restart from the next 'D' in there
+// instead of throwing it all away.
+static void frame_parser_resync(frame_parser_t* parser){
+  const uint8_t* next = memchr(parser->data + 1, 'D', parser->length - 1);
+  uint8_t skipped = (next != NULL) ? (uint8_t)(next - parser->data) : parser->length;
+
+  parser->counters.skipped_bytes += skipped;
+  frame_parser_drop(parser, skipped);
+}
+
+// Runs the state machine over everything held until it needs more bytes or finds a frame
+static frame_type_t frame_parser_process(frame_parser_t* parser){
+  while(parser->length >= parser->expected){
+    if(parser->expected == 1){ // First header byte
+      if(parser->data[0] == 'D'){
+        parser->expected = FRAME_HEADER_LENGTH;
+      }
+      else{
+        frame_parser_resync(parser);
+      }
+    }
+    else if(parser->expected == FRAME_HEADER_LENGTH){ // Three next header bytes
+      parser->expected = frame_length_for_type(parser->data[2]);
+      if(parser->expected == 0){ // Unknown type
+        parser->counters.header_mismatches++;
+        frame_parser_resync(parser);
+      }
+    }
+    else{ // Whole frame, check if crc valid
+      if(CalcCrc(parser->data, parser->expected - 1) == parser->data[parser->expected - 1]){
+        parser->counters.frames++;
+        parser->returned = parser->expected;
+        return (parser->data[2] == 'U') ? FRAME_UNIT_STATUS : FRAME_SKID_STATUS;
+      }
+
+      parser->counters.crc_failures++;
+      frame_parser_resync(parser);
+    }
+  }
+
+  return FRAME_NONE;
+}
+
+static uint8_t frame_length_for_type(uint8_t type){
+  switch(type){
+    case 'U':
+      return MESSAGE_LENGTH_UNIT_STATUS;
+    case 'S':
+      return MESSAGE_LENGTH_SKID_STATUS;
+    default:
+      return 0;
+  }
+}
+
+#if FRAME_CRC_HARDWARE
+// The CRC unit takes the same 8-bit polynomial and initial value, one byte per write.
+// Only the uart task checks frames so the unit is not shared.
+uint8_t CalcCrc(uint8_t data[], uint8_t nbrOfBytes)
+{
+  static bool crc_unit_ready = false;
+  uint8_t byteCtr;
+
+  if(!crc_unit_ready){
+    __HAL_RCC_CRC_CLK_ENABLE();
+    CRC->POL = CRC_POLYNOMIAL;
+    CRC->INIT = 0xFF;
+    crc_unit_ready = true;
+  }
+
+  CRC->CR = CRC_CR_POLYSIZE_1 | CRC_CR_RESET; // 8-bit polynomial, no reflection, load INIT
+
+  for(byteCtr = 0; byteCtr < nbrOfBytes; byteCtr++) {
+    *(__IO uint8_t*)&CRC->DR = data[byteCtr];
+  }
+
+  return (uint8_t)CRC->DR;
+}
+#else
+uint8_t CalcCrc(uint8_t data[], uint8_t nbrOfBytes)
+{
+  uint8_t crc = 0xFF; // calculated checksum
+  uint8_t byteCtr;    // byte counter
+
+  // 8-Bit checksum with given polynomial, one table lookup per byte
+  for(byteCtr = 0; byteCtr < nbrOfBytes; byteCtr++) {
+    crc = crc_table[crc ^ data[byteCtr]];
+  }
+
+  return crc;
+}
+#endif
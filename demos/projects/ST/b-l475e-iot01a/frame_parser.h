@@ -0,0 +1,77 @@
+#ifndef FRAME_PARSER_H_
+#define FRAME_PARSER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define CRC_POLYNOMIAL 0x42
+#ifndef FRAME_CRC_HARDWARE
+#define FRAME_CRC_HARDWARE 0            // 1: check frames with the STM32 CRC unit instead of the lookup table
+#endif
+#define MESSAGE_LENGTH_UNIT_STATUS 62   //UNIT_status 57 bytes + header 4 bytes + crc 1 byte = 62 bytes
+#define MESSAGE_LENGTH_SKID_STATUS 41   //SKID_status 36 bytes + header 4 bytes + crc 1 byte = 41 bytes
+#define MESSAGE_LENGTH_IOT_COMMAND 6    //IOT_COMMAND header 5 bytes + crc 1 byte = 6 bytes
+
+#define FRAME_HEADER_LENGTH 4           //'D' + 1 byte + type ('U' or 'S') + 1 byte
+#define FRAME_MAX_LENGTH MESSAGE_LENGTH_UNIT_STATUS
+
+typedef enum{
+  FRAME_NONE,         // No complete frame yet
+  FRAME_UNIT_STATUS,  // 'U' frame with a valid crc in frame_parser_t.data
+  FRAME_SKID_STATUS   // 'S' frame with a valid crc in frame_parser_t.data
+}frame_type_t;
+
+// What the parser has seen on the link since frame_parser_init
+typedef struct{
+  uint32_t frames;              // Frames with a valid crc
+  uint32_t crc_failures;        // Complete frames thrown away for a bad crc
+  uint32_t header_mismatches;   // 'D' headers with an unknown frame type
+  uint32_t skipped_bytes;       // Bytes that did not end up in a valid frame
+}frame_parser_counters_t;
+
+// Incremental parser for the controller 'D' frames.
+// Bytes can be pushed in any chunk size, the parser only ever asks for as many
+// bytes as it needs to finish the current step so that a blocking reader can
+// wait for exactly that amount. After a bad header or crc it searches the bytes
+// it already holds for the next 'D', so a lost byte costs at most the frame it
+// was lost from.
+typedef struct{
+  uint8_t data[FRAME_MAX_LENGTH];
+  uint8_t length;     // Bytes held, the current frame first
+  uint8_t expected;   // Bytes needed to finish the current step
+  uint8_t returned;   // Length of the frame handed out by the last call, dropped on the next one
+  frame_parser_counters_t counters;
+}frame_parser_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void frame_parser_init(frame_parser_t* parser);
+
+// Number of bytes the parser needs before it can make progress. Can be 0 right after
+// a failed frame, when the bytes kept from it have to be parsed again first.
+uint16_t frame_parser_bytes_needed(frame_parser_t* parser);
+
+// Consumes bytes until a frame completes or data runs out. When a frame is returned
+// it stays at the start of parser->data until the next call to the parser. consumed (optional) tells how many
+// bytes were used, the rest have to be pushed again.
+frame_type_t frame_parser_push(frame_parser_t* parser, const uint8_t* data, uint16_t data_size, uint16_t* consumed);
+
+// Zero copy alternative to frame_parser_push for a reader that asks for exactly
+// frame_parser_bytes_needed() bytes: write them to frame_parser_next_bytes() and
+// commit how many were written.
+uint8_t* frame_parser_next_bytes(frame_parser_t* parser);
+frame_type_t frame_parser_commit(frame_parser_t* parser, uint16_t data_size);
+
+uint8_t CalcCrc(uint8_t data[], uint8_t nbrOfBytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_PARSER_H_ */
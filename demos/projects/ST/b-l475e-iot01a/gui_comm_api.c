@@ -12,34 +12,34 @@
 #include <stdio.h>
 
 #include "gui_comm_api.h"
+#include "gui_comm_api_ll.h"
 #include "uart_api.h"
+#include "spsc_ring.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 
 //========================================================================================================== DEFINITIONS AND MACROS
-#define CIRCULAR_BUFFER_LENGTH 500
-
-typedef struct{
-	uint8_t buffer[CIRCULAR_BUFFER_LENGTH];
-	const uint8_t* buffer_end;
-
-	uint8_t* buffer_tail;
-	uint8_t* buffer_head;
-
-}gui_comm_rx_buffers_t;
+#define CIRCULAR_BUFFER_LENGTH 512   // Power of two for spsc_ring_t
 
 //========================================================================================================== VARIABLES
-gui_comm_rx_buffers_t rx;
+// Filled by the uart interrupt, emptied by the uart task, no interrupt masking on either side
+static uint8_t rx_buffer[CIRCULAR_BUFFER_LENGTH];
+static spsc_ring_t rx;
 
+// Task blocked in gui_comm_wait_for_received_data and how many bytes it waits for.
+// Whoever swaps rx_waiting_task back to NULL owns the wake up.
+static TaskHandle_t rx_waiting_task = NULL;
+static volatile uint16_t rx_wanted = 0;
+
+// Bytes that arrived while the buffer was full
+static volatile uint32_t rx_dropped_bytes = 0;
 
 //========================================================================================================== FUNCTIONS DECLARATIONS
 
 //========================================================================================================== FUNCTIONS DEFINITIONS
 error_t gui_comm_init(void){
-	rx.buffer_end = rx.buffer + CIRCULAR_BUFFER_LENGTH;
-	rx.buffer_tail = rx.buffer;
-	rx.buffer_head = rx.buffer;
+	spsc_ring_init(&rx, rx_buffer, CIRCULAR_BUFFER_LENGTH);
 
 	uart_api_init();
 
@@ -53,60 +53,68 @@ error_t gui_comm_send_data(uint8_t* data, uint16_t data_size, tx_callback_t pre_
 }
 
 void gui_comm_rx_buffer_add(uint8_t message_buf){
-	static uint8_t *next = NULL;
-
-	taskDISABLE_INTERRUPTS();
+	gui_comm_rx_buffer_add_block(&message_buf, 1);
+}
 
-	next = rx.buffer_head + 1;
+void gui_comm_rx_buffer_add_block(const uint8_t* data, uint16_t data_size){
+	TaskHandle_t waiting_task = NULL;
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	uint32_t written = 0;
 
-	if(next >= rx.buffer_end){
-		next = rx.buffer;
+	written = spsc_ring_write(&rx, data, data_size);
+	if(written < data_size){
+		rx_dropped_bytes += data_size - written; // Reader is behind, drop what does not fit
 	}
 
-	if(next == rx.buffer_tail){
-		taskENABLE_INTERRUPTS();
-		return;
-	}
+	// Pairs with the fence in gui_comm_wait_for_received_data: either the reader sees
+	// the new bytes or we see it waiting
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-	*rx.buffer_head = message_buf;
-	rx.buffer_head = next;
+	// Wake the reader only once everything it asked for is in the buffer
+	if((__atomic_load_n(&rx_waiting_task, __ATOMIC_ACQUIRE) != NULL) && (spsc_ring_available(&rx) >= rx_wanted)){
+		waiting_task = __atomic_exchange_n(&rx_waiting_task, NULL, __ATOMIC_ACQ_REL);
+	}
 
-	taskENABLE_INTERRUPTS();
+	if(waiting_task != NULL){
+		vTaskNotifyGiveFromISR(waiting_task, &higher_priority_task_woken);
+		portYIELD_FROM_ISR(higher_priority_task_woken);
+	}
 }
 
 uint16_t gui_comm_check_for_received_data(uint8_t* data, uint16_t data_size){
-	static uint8_t *next = NULL;
-	static uint8_t first_part_len = 0;
-
-	taskDISABLE_INTERRUPTS();
-
-	if((rx.buffer_head == rx.buffer_tail) ||
-
-	  ((rx.buffer_head > rx.buffer_tail) && ((rx.buffer_head - rx.buffer_tail) < data_size)) ||
-
-	  ((rx.buffer_head > rx.buffer_tail) && ((rx.buffer_end - rx.buffer_tail) + (rx.buffer_head - rx.buffer) < data_size))){
-
-		taskENABLE_INTERRUPTS();
+	if(spsc_ring_read(&rx, data, data_size) != data_size){
 		return FAILED;
 	}
 
-	next = rx.buffer_tail + data_size;
-
-	first_part_len = 0;
-	if(next >= rx.buffer_end){
-		first_part_len = ((rx.buffer_end) - rx.buffer_tail);
-		next = rx.buffer + data_size - first_part_len;
-
-		memcpy((void*)data, (const void*)rx.buffer_tail, first_part_len);
+	return DONE;
+}
 
-		rx.buffer_tail = rx.buffer;
+uint16_t gui_comm_wait_for_received_data(uint8_t* data, uint16_t data_size, TickType_t ticks_to_wait){
+	while(gui_comm_check_for_received_data(data, data_size) == FAILED){
+		rx_wanted = data_size;
+		__atomic_store_n(&rx_waiting_task, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		// Bytes may have arrived since the check above, only sleep if still short
+		if(spsc_ring_available(&rx) >= data_size){
+			if(__atomic_exchange_n(&rx_waiting_task, NULL, __ATOMIC_ACQ_REL) == NULL){
+				ulTaskNotifyTake(pdTRUE, 0); // The interrupt got there first, drop its notification
+			}
+			continue;
+		}
+
+		if(ulTaskNotifyTake(pdTRUE, ticks_to_wait) == 0){
+			if(__atomic_exchange_n(&rx_waiting_task, NULL, __ATOMIC_ACQ_REL) == NULL){
+				continue; // Woken just as the wait expired, the data is there
+			}
+
+			return FAILED;
+		}
 	}
 
-	memcpy((void*)(data + first_part_len), (const void*)rx.buffer_tail, data_size - first_part_len);
-
-	rx.buffer_tail = next;
-
-	taskENABLE_INTERRUPTS();
-
 	return DONE;
 }
+
+uint32_t gui_comm_rx_dropped_bytes(void){
+	return rx_dropped_bytes;
+}
@@ -16,6 +16,8 @@
 #include "errors.h"
 #include "uart_data_struct.h"
 
+#include "FreeRTOS.h"
+
 //========================================================================================================== DEFINITIONS AND MACROS
 
 //========================================================================================================== VARIABLES
@@ -25,6 +27,12 @@ error_t gui_comm_init(void);
 error_t gui_comm_send_data(uint8_t* data, uint16_t data_size, tx_callback_t pre_trans_callback, tx_callback_t post_trans_callback, void* callback_args);
 uint16_t gui_comm_check_for_received_data(uint8_t* data, uint16_t data_size);
 
+// Blocks the calling task until data_size bytes are received or ticks_to_wait expires
+uint16_t gui_comm_wait_for_received_data(uint8_t* data, uint16_t data_size, TickType_t ticks_to_wait);
+
+// Bytes dropped since start because the rx buffer was full
+uint32_t gui_comm_rx_dropped_bytes(void);
+
 #ifdef __cplusplus
 }
 #endif
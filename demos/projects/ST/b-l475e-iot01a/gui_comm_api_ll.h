@@ -13,6 +13,7 @@
 #endif
 
 //========================================================================================================== INCLUDES
+#include <stdint.h>
 
 //========================================================================================================== DEFINITIONS AND MACROS
 
@@ -21,6 +22,10 @@
 //========================================================================================================== FUNCTIONS DECLARATIONS
 void gui_comm_rx_buffer_add(uint8_t message_buf);
 
+// Copies a whole burst (e.g. everything the DMA received since the last idle line)
+// into the rx buffer and wakes the reader at most once. Bytes that do not fit are dropped.
+void gui_comm_rx_buffer_add_block(const uint8_t* data, uint16_t data_size);
+
 #ifdef __cplusplus
 }
 #endif
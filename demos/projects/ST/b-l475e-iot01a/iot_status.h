@@ -0,0 +1,121 @@
+#ifndef IOT_STATUS_H_
+#define IOT_STATUS_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+#include "frame_layout.h"
+#include "running_stats.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// UNIT/SKID state as the iot side sees it, statistics instead of raw samples.
+// Kept apart from system_data.h so the telemetry can be built without the uart and RTOS headers.
+#define NUMBER_OF_CARTRIDGES 3          // For now we have hardcoded this as skid also has hardcoded 9 heaters
+#define NUMBER_OF_ZONES_PER_CARTRIDGE 3 // This is hardcoded as well
+
+typedef enum{
+    ZERO,
+    ONE
+}component_status_t;
+typedef struct{
+    component_status_t status;
+    sensor_stats_t stats; 
+}sensor_info_t;
+
+typedef enum{
+    FLAG_UNSET,
+    FLAG_SET
+}flag_state_t;
+
+// Enum for unit/skid high level state
+typedef enum{
+    Error_Handling = 0,
+    Init_State = 1,
+    Adsorb_State = 2,
+    Evacuation_State = 3,
+    Desorb_State = 4,
+    Vacuum_Release_State = 5,
+    Lock_State = 6,
+    Desorb_Setup_State = 7,
+    Safe_State = 8,
+    Unlock_State = 9
+}sequence_state_t;
+
+typedef enum{
+    SKID_O2,
+    SKID_MASS_FLOW,
+    SKID_CO2,
+    SKID_PROPOTIONAL_VALVE_SENSOR,
+    SKID_TEMPERATURE,
+    SKID_HUMIDITY,
+    UNIT_VACUUM_SENSOR,
+    UNIT_AMBIENT_HUMIDITY,
+    UNIT_AMBIENT_TEMPERATURE,
+    UNIT_HEATER,
+    TANK_PRESSURE
+}sensor_name_t;
+
+typedef struct{
+	// uint8_t unit_status; //Flags//000//setup_state_synching_flag//just_started_flag//reset_flag//halt_flag//error_flag
+    flag_state_t error_flag;
+    flag_state_t halt_flag;
+    flag_state_t reset_flag;
+    flag_state_t just_started_flag;
+    flag_state_t setup_state_synching_flag;
+
+    sequence_state_t unit_state;
+
+    sensor_info_t heater_info[NUMBER_OF_HEATERS];
+
+    component_status_t fan_status;
+    component_status_t butterfly_valve_1_status;
+    component_status_t butterfly_valve_2_status;
+
+    sensor_info_t vacuum_sensor;
+    sensor_info_t ambient_humidity;
+    sensor_info_t ambient_temperature;
+    bool send_alert;
+    uint32_t errors;
+}UNIT_iot_status_t;
+
+typedef struct{
+    flag_state_t error_flag;
+    flag_state_t halt_flag;
+    flag_state_t reset_flag;
+
+    sequence_state_t skid_state;
+
+    component_status_t two_way_gas_valve_before_water_trap;
+    component_status_t two_way_gas_valve_in_water_trap;
+    component_status_t two_way_gas_valve_after_water_trap;
+    component_status_t vacuum_release_valve_in_water_trap;
+    component_status_t three_way_vacuum_release_valve_before_condenser;
+    component_status_t three_valve_after_vacuum_pump;
+    component_status_t compressor;
+    component_status_t vacuum_pump;
+    component_status_t condenser;
+
+    sensor_info_t o2_sensor;
+    sensor_info_t mass_flow;
+    sensor_info_t co2_sensor;
+    sensor_info_t tank_pressure;    // @todo: Do we move to tank structure?
+    sensor_info_t proportional_valve_pressure;
+    sensor_info_t temperature;
+    sensor_info_t humidity;
+    bool send_alert;
+    uint32_t errors;
+}SKID_iot_status_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_STATUS_H_ */
@@ -9,6 +9,7 @@
 #include "main.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 #include <time.h>
 
@@ -37,6 +38,7 @@
 
 #include "gui_comm_api.h"
 #include "system_data.h"
+#include "time_service.h"
 
 /* Define the default wifi ssid and password.
  * User must override this in demo_config.h
@@ -79,6 +81,8 @@ xSemaphoreHandle xWifiSemaphoreHandle;
 static UART_HandleTypeDef xConsoleUart;
 /* Use by the pseudo random number generator. */
 static UBaseType_t ulNextRand;
+/* Unix time from the tick count, synced with the WiFi module's SNTP time. */
+static time_service_t xTimeService;
 
 /* Private function prototypes -----------------------------------------------*/
 static void Init_MEM1_Sensors( void );
@@ -303,20 +307,6 @@ void setLocalTimestamp(uint32_t localTimeSeconds) {
 }
 /*-----------------------------------------------------------*/
 
-// @todo: Fix this better way in new code
-void Reset_Hour( RTC_TimeTypeDef sTime, RTC_DateTypeDef sDate )
-{
-    // Reset the hour to 0
-    sTime.Hours = 0;
-
-    // Update the weekday (assuming Sunday is 0 and Saturday is 6)
-    sDate.WeekDay = (sDate.WeekDay + 1) % 7;
-
-    // Update the RTC time and date with the new hour and weekday
-    HAL_RTC_SetTime(&xHrtc, &sTime, RTC_FORMAT_BIN);
-    HAL_RTC_SetDate(&xHrtc, &sDate, RTC_FORMAT_BIN);
-}
-
 BaseType_t prvInitializeSNTP( void )
 {
     BaseType_t ret = 0;
@@ -346,6 +336,7 @@ BaseType_t prvInitializeSNTP( void )
 
         // Set the time as we got the utc seconds
         setLocalTimestamp(unixTime);
+        time_service_sync( &xTimeService, unixTime, xTaskGetTickCount() );
     }
 
     return ret;
@@ -442,6 +433,7 @@ void uart_loop(void* arg){
     system_data_init();
 
     while(1){
+        // Blocks until the uart interrupt has received the next part of a frame
         read_incoming_system_data();
     }
 }
@@ -483,11 +475,12 @@ static void prvMiscInitialization( void )
 
     /* RTC init. */
     RTC_Init();
+    time_service_init( &xTimeService, configTICK_RATE_HZ, democonfigTIME_RESYNC_INTERVAL_S );
 
     /* UART console init. */
     Console_UART_Init();
 
-    xTaskCreate(uart_loop, "uart_task", 256, NULL, 0, NULL);
+    xTaskCreate(uart_loop, "uart_task", 256, NULL, tskIDLE_PRIORITY + 1, NULL);
     xTaskCreate(test_loop, "test_task", 256, NULL, 0, NULL);
     /* Discovery and Initialize all the Target's Features */
     Init_MEM1_Sensors();
@@ -884,12 +877,70 @@ int mbedtls_platform_entropy_poll( void * data,
 }
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Resyncs the time service with the WiFi module once the resync
+ * interval passed. The AT command round trip is made outside the critical
+ * section, two callers finding it due at once both just resync.
+ */
+static void prvResyncTime( void )
+{
+    uint32_t unixTime = 0;
+    BaseType_t xDue;
+
+    taskENTER_CRITICAL();
+    xDue = time_service_resync_due( &xTimeService, xTaskGetTickCount() );
+    taskEXIT_CRITICAL();
+
+    if( xDue == pdFALSE )
+    {
+        return;
+    }
+
+    if( ( WIFI_GetTime( &unixTime ) == WIFI_STATUS_OK ) && ( unixTime >= democonfigSNTP_INIT_WAIT ) )
+    {
+        taskENTER_CRITICAL();
+        time_service_sync( &xTimeService, unixTime, xTaskGetTickCount() );
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        configPRINTF( ( "!!!ERROR: ES-WIFI Get Time Failed, retrying in %d s.\r\n", TIME_SERVICE_RETRY_S ) );
+
+        taskENTER_CRITICAL();
+        time_service_sync_failed( &xTimeService, xTaskGetTickCount() );
+        taskEXIT_CRITICAL();
+    }
+}
+/*-----------------------------------------------------------*/
+
 uint64_t ullGetUnixTime( void )
 {
     uint32_t unixTime;
 
-    WIFI_GetTime( &unixTime );
+    prvResyncTime();
+
+    taskENTER_CRITICAL();
+    unixTime = time_service_unix( &xTimeService, xTaskGetTickCount() );
+    taskEXIT_CRITICAL();
 
     return ( uint64_t ) unixTime;
 }
 /*-----------------------------------------------------------*/
+
+void vGetTimestampUtc( char * pcTimestamp )
+{
+    taskENTER_CRITICAL();
+    memcpy( pcTimestamp, time_service_iso8601( &xTimeService, xTaskGetTickCount() ), TIME_SERVICE_ISO8601_LENGTH );
+    taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+void vGetTimeServiceStats( time_service_stats_t * pxStats,
+                           uint32_t * pulResyncInterval )
+{
+    taskENTER_CRITICAL();
+    *pxStats = xTimeService.stats;
+    *pulResyncInterval = xTimeService.resync_interval_s;
+    taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
@@ -15,6 +15,7 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
     #include "stm32l475e_iot01.h"
+    #include "time_service.h"
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
@@ -39,9 +40,13 @@
 /* Exported functions prototypes ---------------------------------------------*/
     void Error_Handler( void );
 
-    void Reset_Hour( RTC_TimeTypeDef sTime, RTC_DateTypeDef sDate );
-
 /* USER CODE BEGIN EFP */
+    /* Cached UTC time as 2024-02-02T12:00:00Z, at least TIME_SERVICE_ISO8601_LENGTH bytes. */
+    void vGetTimestampUtc( char * pcTimestamp );
+
+    /* Drift seen at the resyncs with the WiFi module and how often they happen. */
+    void vGetTimeServiceStats( time_service_stats_t * pxStats,
+                               uint32_t * pulResyncInterval );
 
 /* USER CODE END EFP */
 
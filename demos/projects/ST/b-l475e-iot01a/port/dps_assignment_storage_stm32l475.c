@@ -0,0 +1,87 @@
+/* Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License. */
+
+//========================================================================================================== INCLUDES
+#include "dps_assignment.h"
+#include <string.h>
+#include "stm32l4xx_hal.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Last page of the bank running, past FLASH and FLASH_UC in STM32L475VGTx_FLASH.ld. The bank
+// an update is written to is erased whole, after the swap the device registers once again.
+#define STORAGE_PAGE (FLASH_BANK_SIZE / FLASH_PAGE_SIZE - 1)
+#define STORAGE_ADDRESS (FLASH_BASE + FLASH_BANK_SIZE - FLASH_PAGE_SIZE)
+#define STORAGE_DOUBLE_WORD 8
+
+#if DPS_ASSIGNMENT_RECORD_SIZE > FLASH_PAGE_SIZE || DPS_ASSIGNMENT_RECORD_SIZE % STORAGE_DOUBLE_WORD != 0
+#error "The DPS assignment record does not fit the flash page"
+#endif
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint32_t running_bank(void);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+bool dps_assignment_storage_read(uint8_t* record, uint32_t size){
+  if(size > FLASH_PAGE_SIZE){
+    return false;
+  }
+
+  memcpy(record, (const void*)STORAGE_ADDRESS, size);
+
+  return true;
+}
+
+bool dps_assignment_storage_write(const uint8_t* record, uint32_t size){
+  uint64_t double_word;
+  uint32_t offset;
+  bool written = true;
+
+  if(size % STORAGE_DOUBLE_WORD != 0 || !dps_assignment_storage_erase()){
+    return false;
+  }
+
+  HAL_FLASH_Unlock();
+
+  for(offset = 0; offset < size; offset += STORAGE_DOUBLE_WORD){
+    memcpy(&double_word, record + offset, sizeof(double_word));
+
+    if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, STORAGE_ADDRESS + offset, double_word) != HAL_OK){
+      written = false;
+      break;
+    }
+  }
+
+  HAL_FLASH_Lock();
+
+  return written;
+}
+
+// The bank stalls code fetches while the page is erased, some 25 ms, only when registering
+bool dps_assignment_storage_erase(void){
+  FLASH_EraseInitTypeDef erase;
+  uint32_t page_error;
+  HAL_StatusTypeDef status;
+
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Banks = running_bank();
+  erase.Page = STORAGE_PAGE;
+  erase.NbPages = 1;
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  status = HAL_FLASHEx_Erase(&erase, &page_error);
+  HAL_FLASH_Lock();
+
+  return status == HAL_OK;
+}
+
+// Bank mapped at FLASH_BASE, the other one than azure_iot_flash_platform.c erases for an update
+static uint32_t running_bank(void){
+  FLASH_OBProgramInitTypeDef option_bytes;
+
+  HAL_FLASHEx_OBGetConfig(&option_bytes);
+
+  return ((option_bytes.USERConfig & OB_BFB2_ENABLE) == OB_BFB2_ENABLE) ? FLASH_BANK_2 : FLASH_BANK_1;
+}
@@ -7,6 +7,7 @@
  */
 
 #include "sockets_wrapper.h"
+#include "sockets_dns_cache.h"
 
 /* Standard includes. */
 #include <string.h>
@@ -14,6 +15,10 @@
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+
+/* Demo includes. */
+#include "demo_config.h"
 
 /* Wifi module */
 #include "es_wifi.h"
@@ -59,10 +64,48 @@
  * the SPI driver will poll for extended periods, preventing lower
  * priority tasks from executing.  Therefore timeouts are mocked in
  * the secure sockets layer, and this constant sets the sleep time
- * between each read attempt during the receive timeout period.
+ * after the first empty read attempt during the receive timeout period.
  */
 #define stsecuresocketsFIVE_MILLISECONDS           ( pdMS_TO_TICKS( 5 ) )
 
+/**
+ * @brief Time after the last send or receive on a socket during which read
+ * attempts stay stsecuresocketsFIVE_MILLISECONDS apart, a reply may be on its way.
+ */
+#ifndef stsecuresocketsREPLY_WINDOW
+    #define stsecuresocketsREPLY_WINDOW            ( pdMS_TO_TICKS( 250 ) )
+#endif
+
+/**
+ * @brief Longest sleep between read attempts.
+ *
+ * Once the socket was quiet for stsecuresocketsREPLY_WINDOW the sleep doubles
+ * after every empty read attempt up to this value. A send on the socket or a
+ * disconnect wakes the receiving task at once.
+ */
+#ifndef stsecuresocketsMAX_POLL_DELAY
+    #define stsecuresocketsMAX_POLL_DELAY          ( pdMS_TO_TICKS( 40 ) )
+#endif
+
+/**
+ * @brief Task notification the receiving task sleeps on, index 0 is left to
+ * the application.
+ */
+#define stsecuresocketsNOTIFY_INDEX                ( 1 )
+
+#if ( configTASK_NOTIFICATION_ARRAY_ENTRIES <= stsecuresocketsNOTIFY_INDEX )
+    #error "configTASK_NOTIFICATION_ARRAY_ENTRIES must be at least 2 for the WiFi sockets wrapper"
+#endif
+
+/**
+ * @brief Size of the per socket receive buffer.
+ *
+ * Small reads, like the 5 byte TLS record header, are served from what one
+ * module read drained, instead of costing a read each. The module does not
+ * hand out more than ES_WIFI_PAYLOAD_SIZE bytes per read.
+ */
+#define stsecuresocketsRX_BUFFER_SIZE              ( ES_WIFI_PAYLOAD_SIZE )
+
 /**
  * @brief The timeout supplied to the Inventek module in receive operation.
  *
@@ -74,8 +117,19 @@
 
 /**
  * @brief Maximum number of sockets that can be created simultaneously.
+ *
+ * Each one holds a stsecuresocketsRX_BUFFER_SIZE receive buffer, see
+ * democonfigSOCKETS_RX_BUFFER_RAM. The demo has one TLS connection open at a
+ * time, to the provisioning service or the hub, the second socket covers a
+ * connection opened before the last one is closed.
  */
-#define wificonfigMAX_SOCKETS                      ( 4 )
+#define wificonfigMAX_SOCKETS                      ( 2 )
+
+/* The telemetry RAM budget counts the receive buffers at democonfigSOCKETS_RX_BUFFER_RAM. */
+#if defined( democonfigTELEMETRY_RAM_BUDGET ) && \
+    ( democonfigSOCKETS_RX_BUFFER_RAM < ( wificonfigMAX_SOCKETS * stsecuresocketsRX_BUFFER_SIZE ) )
+    #error "democonfigSOCKETS_RX_BUFFER_RAM is less than the socket receive buffers take."
+#endif
 
 /**
  * @brief Default socket send timeout.
@@ -92,11 +146,16 @@
  */
 typedef struct STSecureSocket
 {
-    uint8_t ucInUse;            /**< Tracks whether the socket is in use or not. */
-    uint8_t esWifiSocketNumber; /**< Socket number used in eswifi layer. */
-    uint32_t ulFlags;           /**< Various properties of the socket (secured etc.). */
-    uint32_t ulSendTimeout;     /**< Send timeout. */
-    uint32_t ulReceiveTimeout;  /**< Receive timeout. */
+    uint8_t ucInUse;                                     /**< Tracks whether the socket is in use or not. */
+    uint8_t esWifiSocketNumber;                          /**< Socket number used in eswifi layer. */
+    uint32_t ulFlags;                                    /**< Various properties of the socket (secured etc.). */
+    uint32_t ulSendTimeout;                              /**< Send timeout. */
+    uint32_t ulReceiveTimeout;                           /**< Receive timeout. */
+    TaskHandle_t xReceivingTask;                         /**< Task sleeping in Sockets_Recv, NULL when none. */
+    TickType_t xLastTraffic;                             /**< Last send or receive on the socket. */
+    uint16_t usRxHead;                                   /**< Next byte of ucRxBuffer handed out. */
+    uint16_t usRxTail;                                   /**< End of the bytes drained from the module. */
+    uint8_t ucRxBuffer[ stsecuresocketsRX_BUFFER_SIZE ]; /**< Bytes read from the module but not yet by the caller. */
 } STSecureSocket_t;
 
 static STSecureSocket_t xSockets[ wificonfigMAX_SOCKETS ];
@@ -230,6 +289,193 @@ static uint32_t prvGetHostByName( const char * pcHostName )
 }
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Hand out bytes already drained from the module.
+ *
+ * @param pxSecureSocket
+ * @param pucReceiveBuffer
+ * @param xReceiveBufferLength
+ * @return number of bytes copied.
+ */
+static BaseType_t prvReadBuffered( STSecureSocket_t * pxSecureSocket,
+                                   uint8_t * pucReceiveBuffer,
+                                   size_t xReceiveBufferLength )
+{
+    size_t xAvailable = ( size_t ) ( pxSecureSocket->usRxTail - pxSecureSocket->usRxHead );
+
+    if( xReceiveBufferLength > xAvailable )
+    {
+        xReceiveBufferLength = xAvailable;
+    }
+
+    memcpy( pucReceiveBuffer, &( pxSecureSocket->ucRxBuffer[ pxSecureSocket->usRxHead ] ), xReceiveBufferLength );
+    pxSecureSocket->usRxHead += ( uint16_t ) xReceiveBufferLength;
+
+    return ( BaseType_t ) xReceiveBufferLength;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Wake the task sleeping between read attempts on the socket, if any.
+ *
+ * @param pxSecureSocket
+ */
+static void prvWakeReceiver( STSecureSocket_t * pxSecureSocket )
+{
+    TaskHandle_t xTask;
+
+    taskENTER_CRITICAL();
+    {
+        xTask = pxSecureSocket->xReceivingTask;
+    }
+    taskEXIT_CRITICAL();
+
+    if( xTask != NULL )
+    {
+        ( void ) xTaskNotifyGiveIndexed( xTask, stsecuresocketsNOTIFY_INDEX );
+    }
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reset the module after an error left it unusable, all sockets are
+ * marked closed and free.
+ *
+ * @return pdTRUE when the module was reset.
+ */
+static BaseType_t prvResetModule( void )
+{
+    BaseType_t xReset = pdFALSE;
+
+    /* Reset the WiFi Module. Since the WIFI_Reset function
+     * acquires the same semaphore, we must not acquire
+     * it. */
+    if( WIFI_ResetModule() == WIFI_STATUS_OK )
+    {
+        /* Try to acquire the semaphore. */
+        if( xSemaphoreTake( xWifiSemaphoreHandle, portMAX_DELAY ) == pdTRUE )
+        {
+            /* Reinitialize the socket structures which
+             * marks all sockets as closed and free. */
+            Sockets_Init();
+
+            /* Return the semaphore. */
+            ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
+        }
+
+        xReset = pdTRUE;
+    }
+
+    return xReset;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Events ready on a socket for Sockets_Poll. A wait to receive with
+ * nothing buffered drains the module into the receive buffer, where the next
+ * Sockets_Recv finds it.
+ *
+ * @param ulSocketNumber
+ * @param ulEvents
+ * @param pxWiFiResult Set to the status of the module read, if one was made.
+ * @return the SOCKETS_POLL_ events ready.
+ */
+static uint32_t prvPollSocket( uint32_t ulSocketNumber,
+                               uint32_t ulEvents,
+                               WIFI_Status_t * pxWiFiResult )
+{
+    STSecureSocket_t * pxSecureSocket;
+    uint32_t ulReady = 0;
+    uint16_t usReceivedBytes = 0;
+
+    if( prvIsValidSocket( ulSocketNumber ) == pdFALSE )
+    {
+        return SOCKETS_POLL_ERROR;
+    }
+
+    pxSecureSocket = &( xSockets[ ulSocketNumber ] );
+
+    if( ( ( pxSecureSocket->ulFlags & stsecuresocketsSOCKET_IS_CONNECTED_FLAG ) == 0U ) ||
+        ( ( pxSecureSocket->ulFlags & stsecuresocketsSOCKET_READ_CLOSED_FLAG ) != 0U ) )
+    {
+        return SOCKETS_POLL_ERROR;
+    }
+
+    /* The module takes a send whenever the socket is connected. */
+    if( ( ulEvents & SOCKETS_POLL_WRITE ) != 0U )
+    {
+        ulReady |= SOCKETS_POLL_WRITE;
+    }
+
+    if( ( ulEvents & SOCKETS_POLL_READ ) != 0U )
+    {
+        if( pxSecureSocket->usRxHead != pxSecureSocket->usRxTail )
+        {
+            ulReady |= SOCKETS_POLL_READ;
+        }
+        else if( xSemaphoreTake( xWifiSemaphoreHandle, stsecuresocketsFIVE_MILLISECONDS ) == pdTRUE )
+        {
+            *pxWiFiResult = WIFI_ReceiveData( ( uint8_t ) ulSocketNumber,
+                                              pxSecureSocket->ucRxBuffer,
+                                              ( uint16_t ) stsecuresocketsRX_BUFFER_SIZE,
+                                              &( usReceivedBytes ),
+                                              stsecuresocketsONE_MILLISECOND );
+
+            ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
+
+            if( ( *pxWiFiResult == WIFI_STATUS_OK ) && ( usReceivedBytes != 0 ) )
+            {
+                pxSecureSocket->usRxHead = 0;
+                pxSecureSocket->usRxTail = usReceivedBytes;
+                pxSecureSocket->xLastTraffic = xTaskGetTickCount();
+                ulReady |= SOCKETS_POLL_READ;
+            }
+            else if( ( *pxWiFiResult != WIFI_STATUS_OK ) && ( *pxWiFiResult != WIFI_STATUS_TIMEOUT ) )
+            {
+                ulReady |= SOCKETS_POLL_ERROR;
+            }
+        }
+        else
+        {
+            /* The module is busy with another socket, checked again on the
+             * next round. */
+        }
+    }
+
+    return ulReady;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Set the task woken by a send or disconnect on the polled sockets.
+ *
+ * @param pxEntries
+ * @param xEntryCount
+ * @param xTask NULL to clear it.
+ */
+static void prvSetPollingTask( const SocketsPollEntry_t * pxEntries,
+                               size_t xEntryCount,
+                               TaskHandle_t xTask )
+{
+    uint32_t ulSocketNumber;
+    size_t xIndex;
+
+    for( xIndex = 0; xIndex < xEntryCount; xIndex++ )
+    {
+        ulSocketNumber = ( uint32_t ) pxEntries[ xIndex ].xSocket;
+
+        if( prvIsValidSocket( ulSocketNumber ) == pdTRUE )
+        {
+            taskENTER_CRITICAL();
+            {
+                xSockets[ ulSocketNumber ].xReceivingTask = xTask;
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t Sockets_Init()
 {
     uint32_t ulIndex;
@@ -239,6 +485,8 @@ BaseType_t Sockets_Init()
     {
         xSockets[ ulIndex ].ucInUse = 0;
         xSockets[ ulIndex ].ulFlags = 0;
+        xSockets[ ulIndex ].usRxHead = 0;
+        xSockets[ ulIndex ].usRxTail = 0;
 
         xSockets[ ulIndex ].ulFlags |= stsecuresocketsSOCKET_READ_CLOSED_FLAG;
         xSockets[ ulIndex ].ulFlags |= stsecuresocketsSOCKET_WRITE_CLOSED_FLAG;
@@ -265,6 +513,9 @@ SocketHandle Sockets_Open()
         pxSecureSocket->ulFlags = stsecuresocketsSOCKET_SECURE_FLAG;
         pxSecureSocket->ulSendTimeout = socketsconfigDEFAULT_SEND_TIMEOUT;
         pxSecureSocket->ulReceiveTimeout = socketsconfigDEFAULT_RECV_TIMEOUT;
+        pxSecureSocket->xReceivingTask = NULL;
+        pxSecureSocket->usRxHead = 0;
+        pxSecureSocket->usRxTail = 0;
     }
 
     return ( SocketHandle ) ulSocketNumber;
@@ -301,7 +552,7 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
     {
         pxSecureSocket = &( xSockets[ ulSocketNumber ] );
 
-        if( ( ulIPAddres = prvGetHostByName( pcHostName ) ) == 0 )
+        if( ( ulIPAddres = SocketsDnsCache_GetHostByName( pcHostName, prvGetHostByName ) ) == 0 )
         {
             lRetVal = SOCKETS_SOCKET_ERROR;
         }
@@ -320,10 +571,12 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 
                 /* Mark that the socket is connected. */
                 pxSecureSocket->ulFlags |= stsecuresocketsSOCKET_IS_CONNECTED_FLAG;
+                pxSecureSocket->xLastTraffic = xTaskGetTickCount();
             }
             else
             {
                 /* Connection failed. */
+                SocketsDnsCache_ConnectFailed( pcHostName, ulIPAddres );
                 lRetVal = SOCKETS_SOCKET_ERROR;
             }
 
@@ -336,6 +589,12 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+uint32_t Sockets_GetHostByName( const char * pcHostName )
+{
+    return SocketsDnsCache_GetHostByName( pcHostName, prvGetHostByName );
+}
+/*-----------------------------------------------------------*/
+
 void Sockets_Disconnect( SocketHandle xSocket )
 {
     uint32_t ulSocketNumber = ( uint32_t ) xSocket;
@@ -351,6 +610,9 @@ void Sockets_Disconnect( SocketHandle xSocket )
         pxSecureSocket->ulFlags |= stsecuresocketsSOCKET_READ_CLOSED_FLAG;
         pxSecureSocket->ulFlags |= stsecuresocketsSOCKET_WRITE_CLOSED_FLAG;
 
+        /* A receive waiting on the socket gives up at its next attempt. */
+        prvWakeReceiver( pxSecureSocket );
+
         /* Try to acquire the semaphore. */
         if( xSemaphoreTake( xWifiSemaphoreHandle, xSemaphoreWaitTicks ) == pdTRUE )
         {
@@ -376,103 +638,141 @@ BaseType_t Sockets_Recv( SocketHandle xSocket,
     uint16_t usReceivedBytes = 0;
     BaseType_t xRetVal;
     WIFI_Status_t xWiFiResult = WIFI_STATUS_OK;
-    TickType_t xTimeOnEntering = xTaskGetTickCount(), xSemaphoreWait;
+    TickType_t xTimeOnEntering = xTaskGetTickCount(), xSemaphoreWait, xNow;
+    TickType_t xPollDelay = stsecuresocketsFIVE_MILLISECONDS;
+    uint8_t * pucTarget;
 
     /* Shortcut for easy access. */
     pxSecureSocket = &( xSockets[ ulSocketNumber ] );
 
-    /* WiFi module does not support receiving more than ES_WIFI_PAYLOAD_SIZE
-     * bytes at a time. */
-    if( xReceiveBufferLength > ( uint32_t ) ES_WIFI_PAYLOAD_SIZE )
+    if( pxSecureSocket->usRxHead != pxSecureSocket->usRxTail )
     {
-        xReceiveBufferLength = ( uint32_t ) ES_WIFI_PAYLOAD_SIZE;
+        /* Bytes drained by an earlier read, no need to talk to the module. */
+        xRetVal = prvReadBuffered( pxSecureSocket, pucReceiveBuffer, xReceiveBufferLength );
     }
+    else
+    {
+        /* A read of a full buffer or more goes straight to the caller. A smaller
+         * one drains up to a full buffer, the module keeps the rest of its data
+         * until the buffer is empty again. WiFi module does not support receiving
+         * more than ES_WIFI_PAYLOAD_SIZE bytes at a time. */
+        pucTarget = ( xReceiveBufferLength >= ( size_t ) stsecuresocketsRX_BUFFER_SIZE ) ?
+                    pucReceiveBuffer : pxSecureSocket->ucRxBuffer;
 
-    xSemaphoreWait = pxSecureSocket->ulReceiveTimeout + stsecuresocketsFIVE_MILLISECONDS;
+        xSemaphoreWait = pxSecureSocket->ulReceiveTimeout + stsecuresocketsFIVE_MILLISECONDS;
 
-    for( ; ; )
-    {
-        /* Try to acquire the semaphore. */
-        if( xSemaphoreTake( xWifiSemaphoreHandle, xSemaphoreWait ) == pdTRUE )
+        taskENTER_CRITICAL();
         {
-            /* Receive the data. */
-            xWiFiResult = WIFI_ReceiveData( ( uint8_t ) ulSocketNumber,
-                                            ( uint8_t * ) pucReceiveBuffer,
-                                            ( uint16_t ) xReceiveBufferLength,
-                                            &( usReceivedBytes ),
-                                            stsecuresocketsONE_MILLISECOND );
+            pxSecureSocket->xReceivingTask = xTaskGetCurrentTaskHandle();
+        }
+        taskEXIT_CRITICAL();
 
-            /* Return the semaphore. */
-            ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
+        /* A wakeup left over from an earlier receive is stale. */
+        ( void ) ulTaskNotifyTakeIndexed( stsecuresocketsNOTIFY_INDEX, pdTRUE, 0 );
 
-            if( ( xWiFiResult == WIFI_STATUS_OK ) && ( usReceivedBytes != 0 ) )
-            {
-                /* Success, return the number of bytes received. */
-                xRetVal = ( BaseType_t ) usReceivedBytes;
-                break;
-            }
-            else if( ( xWiFiResult == WIFI_STATUS_TIMEOUT ) || ( ( xWiFiResult == WIFI_STATUS_OK ) && ( usReceivedBytes == 0 ) ) )
+        for( ; ; )
+        {
+            /* Try to acquire the semaphore. */
+            if( xSemaphoreTake( xWifiSemaphoreHandle, xSemaphoreWait ) == pdTRUE )
             {
-                /* The WiFi poll timed out, but has the socket timeout expired
-                 * too? */
-                if( ( xTaskGetTickCount() - xTimeOnEntering ) < pxSecureSocket->ulReceiveTimeout )
+                /* Receive the data. */
+                xWiFiResult = WIFI_ReceiveData( ( uint8_t ) ulSocketNumber,
+                                                pucTarget,
+                                                ( uint16_t ) stsecuresocketsRX_BUFFER_SIZE,
+                                                &( usReceivedBytes ),
+                                                stsecuresocketsONE_MILLISECOND );
+
+                /* Return the semaphore. */
+                ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
+
+                if( ( xWiFiResult == WIFI_STATUS_OK ) && ( usReceivedBytes != 0 ) )
+                {
+                    pxSecureSocket->xLastTraffic = xTaskGetTickCount();
+
+                    if( pucTarget == pxSecureSocket->ucRxBuffer )
+                    {
+                        pxSecureSocket->usRxHead = 0;
+                        pxSecureSocket->usRxTail = usReceivedBytes;
+                        xRetVal = prvReadBuffered( pxSecureSocket, pucReceiveBuffer, xReceiveBufferLength );
+                    }
+                    else
+                    {
+                        /* Success, return the number of bytes received. */
+                        xRetVal = ( BaseType_t ) usReceivedBytes;
+                    }
+
+                    break;
+                }
+                else if( ( xWiFiResult == WIFI_STATUS_TIMEOUT ) || ( ( xWiFiResult == WIFI_STATUS_OK ) && ( usReceivedBytes == 0 ) ) )
                 {
-                    /* The socket has not timed out, but the driver supplied
-                     * with the board is polling, which would block other tasks, so
-                     * block for a short while to allow other tasks to run before
-                     * trying again. */
-                    vTaskDelay( stsecuresocketsFIVE_MILLISECONDS );
+                    /* The WiFi poll timed out, but has the socket timeout expired
+                     * too? */
+                    xNow = xTaskGetTickCount();
+
+                    if( ( xNow - xTimeOnEntering ) < pxSecureSocket->ulReceiveTimeout )
+                    {
+                        /* The socket has not timed out, but the driver supplied
+                         * with the board is polling, which would block other tasks, so
+                         * block for a while to allow other tasks to run before
+                         * trying again. The sleep grows once the socket is quiet,
+                         * a send on the socket ends it early. */
+                        if( ( xNow - pxSecureSocket->xLastTraffic ) < stsecuresocketsREPLY_WINDOW )
+                        {
+                            xPollDelay = stsecuresocketsFIVE_MILLISECONDS;
+                        }
+                        else
+                        {
+                            xPollDelay = ( xPollDelay < ( stsecuresocketsMAX_POLL_DELAY / 2U ) ) ?
+                                         ( xPollDelay * 2U ) : stsecuresocketsMAX_POLL_DELAY;
+                        }
+
+                        if( xPollDelay > ( pxSecureSocket->ulReceiveTimeout - ( xNow - xTimeOnEntering ) ) )
+                        {
+                            xPollDelay = pxSecureSocket->ulReceiveTimeout - ( xNow - xTimeOnEntering );
+                        }
+
+                        ( void ) ulTaskNotifyTakeIndexed( stsecuresocketsNOTIFY_INDEX, pdTRUE, xPollDelay );
+                    }
+                    else
+                    {
+                        /* The socket read has timed out too. Returning
+                         * SOCKETS_EWOULDBLOCK will cause mBedTLS to fail
+                         * and so we must return zero. */
+                        xRetVal = 0;
+                        break;
+                    }
                 }
                 else
                 {
-                    /* The socket read has timed out too. Returning
-                     * SOCKETS_EWOULDBLOCK will cause mBedTLS to fail
-                     * and so we must return zero. */
-                    xRetVal = 0;
+                    /* xWiFiResult contains an error status. */
+                    xRetVal = SOCKETS_SOCKET_ERROR;
                     break;
                 }
             }
             else
             {
-                /* xWiFiResult contains an error status. */
-                xRetVal = SOCKETS_SOCKET_ERROR;
+                /* Semaphore wait time was longer than the receive timeout so this
+                 * is also a socket timeout. Returning SOCKETS_EWOULDBLOCK will
+                 * cause mBedTLS to fail and so we must return zero.*/
+                xRetVal = 0;
                 break;
             }
         }
-        else
+
+        taskENTER_CRITICAL();
         {
-            /* Semaphore wait time was longer than the receive timeout so this
-             * is also a socket timeout. Returning SOCKETS_EWOULDBLOCK will
-             * cause mBedTLS to fail and so we must return zero.*/
-            xRetVal = 0;
-            break;
+            pxSecureSocket->xReceivingTask = NULL;
         }
+        taskEXIT_CRITICAL();
     }
 
     /* The following code attempts to revive the Inventek WiFi module
      * from its unusable state.*/
-    if( xWiFiResult == WIFI_STATUS_ERROR )
+    if( ( xWiFiResult == WIFI_STATUS_ERROR ) && ( prvResetModule() == pdTRUE ) )
     {
-        /* Reset the WiFi Module. Since the WIFI_Reset function
-         * acquires the same semaphore, we must not acquire
-         * it. */
-        if( WIFI_ResetModule() == WIFI_STATUS_OK )
-        {
-            /* Try to acquire the semaphore. */
-            if( xSemaphoreTake( xWifiSemaphoreHandle, portMAX_DELAY ) == pdTRUE )
-            {
-                /* Reinitialize the socket structures which
-                 * marks all sockets as closed and free. */
-                Sockets_Init();
-
-                /* Return the semaphore. */
-                ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
-            }
-
-            /* Set the error code to indicate that
-             * WiFi needs to be reconnected to network. */
-            xRetVal = SOCKETS_PERIPHERAL_RESET;
-        }
+        /* Set the error code to indicate that
+         * WiFi needs to be reconnected to network. */
+        xRetVal = SOCKETS_PERIPHERAL_RESET;
     }
 
     return xRetVal;
@@ -513,30 +813,21 @@ BaseType_t Sockets_Send( SocketHandle xSocket,
         ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
     }
 
+    /* A reply to what was sent is due, a task waiting on the socket polls
+     * the module now instead of sleeping on. */
+    if( xRetVal > 0 )
+    {
+        pxSecureSocket->xLastTraffic = xTaskGetTickCount();
+        prvWakeReceiver( pxSecureSocket );
+    }
+
     /* The following code attempts to revive the Inventek WiFi module
      * from its unusable state.*/
-    if( xWiFiResult == WIFI_STATUS_ERROR )
+    if( ( xWiFiResult == WIFI_STATUS_ERROR ) && ( prvResetModule() == pdTRUE ) )
     {
-        /* Reset the WiFi Module. Since the WIFI_Reset function
-         * acquires the same semaphore, we must not acquire
-         * it. */
-        if( WIFI_ResetModule() == WIFI_STATUS_OK )
-        {
-            /* Try to acquire the semaphore. */
-            if( xSemaphoreTake( xWifiSemaphoreHandle, portMAX_DELAY ) == pdTRUE )
-            {
-                /* Reinitialize the socket structures which
-                 * marks all sockets as closed and free. */
-                Sockets_Init();
-
-                /* Return the semaphore. */
-                ( void ) xSemaphoreGive( xWifiSemaphoreHandle );
-            }
-
-            /* Set the error code to indicate that
-             * WiFi needs to be reconnected to network. */
-            xRetVal = SOCKETS_PERIPHERAL_RESET;
-        }
+        /* Set the error code to indicate that
+         * WiFi needs to be reconnected to network. */
+        xRetVal = SOCKETS_PERIPHERAL_RESET;
     }
 
     /* To allow other tasks of equal priority that are using this API to run as
@@ -550,6 +841,93 @@ BaseType_t Sockets_Send( SocketHandle xSocket,
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t Sockets_Poll( SocketsPollEntry_t * pxEntries,
+                         size_t xEntryCount,
+                         TickType_t xTimeout )
+{
+    BaseType_t xRetVal = 0;
+    WIFI_Status_t xWiFiResult = WIFI_STATUS_OK;
+    TickType_t xTimeOnEntering = xTaskGetTickCount(), xNow, xQuiet;
+    TickType_t xPollDelay = stsecuresocketsFIVE_MILLISECONDS;
+    uint32_t ulSocketNumber;
+    size_t xIndex;
+
+    if( ( pxEntries == NULL ) || ( xEntryCount == 0 ) )
+    {
+        return SOCKETS_EINVAL;
+    }
+
+    prvSetPollingTask( pxEntries, xEntryCount, xTaskGetCurrentTaskHandle() );
+
+    /* A wakeup left over from an earlier wait is stale. */
+    ( void ) ulTaskNotifyTakeIndexed( stsecuresocketsNOTIFY_INDEX, pdTRUE, 0 );
+
+    for( ; ; )
+    {
+        xNow = xTaskGetTickCount();
+        xQuiet = portMAX_DELAY;
+
+        for( xIndex = 0; ( xIndex < xEntryCount ) && ( xWiFiResult != WIFI_STATUS_ERROR ); xIndex++ )
+        {
+            ulSocketNumber = ( uint32_t ) pxEntries[ xIndex ].xSocket;
+            pxEntries[ xIndex ].ulReady = prvPollSocket( ulSocketNumber,
+                                                         pxEntries[ xIndex ].ulEvents,
+                                                         &xWiFiResult );
+
+            if( pxEntries[ xIndex ].ulReady != 0U )
+            {
+                xRetVal++;
+            }
+            else if( ( xNow - xSockets[ ulSocketNumber ].xLastTraffic ) < xQuiet )
+            {
+                /* Only connected sockets get here. */
+                xQuiet = xNow - xSockets[ ulSocketNumber ].xLastTraffic;
+            }
+        }
+
+        if( ( xRetVal != 0 ) || ( xWiFiResult == WIFI_STATUS_ERROR ) )
+        {
+            break;
+        }
+
+        /* Same cadence as Sockets_Recv, a reply on any of the sockets may be
+         * on its way. */
+        xNow = xTaskGetTickCount();
+
+        if( ( xNow - xTimeOnEntering ) >= xTimeout )
+        {
+            break;
+        }
+
+        if( xQuiet < stsecuresocketsREPLY_WINDOW )
+        {
+            xPollDelay = stsecuresocketsFIVE_MILLISECONDS;
+        }
+        else
+        {
+            xPollDelay = ( xPollDelay < ( stsecuresocketsMAX_POLL_DELAY / 2U ) ) ?
+                         ( xPollDelay * 2U ) : stsecuresocketsMAX_POLL_DELAY;
+        }
+
+        if( ( xTimeout != portMAX_DELAY ) && ( xPollDelay > ( xTimeout - ( xNow - xTimeOnEntering ) ) ) )
+        {
+            xPollDelay = xTimeout - ( xNow - xTimeOnEntering );
+        }
+
+        ( void ) ulTaskNotifyTakeIndexed( stsecuresocketsNOTIFY_INDEX, pdTRUE, xPollDelay );
+    }
+
+    prvSetPollingTask( pxEntries, xEntryCount, NULL );
+
+    if( ( xWiFiResult == WIFI_STATUS_ERROR ) && ( prvResetModule() == pdTRUE ) )
+    {
+        xRetVal = SOCKETS_PERIPHERAL_RESET;
+    }
+
+    return xRetVal;
+}
+/*-----------------------------------------------------------*/
+
 int32_t Sockets_SetSockOpt( SocketHandle xSocket,
                             int32_t lOptionName,
                             const void * pvOptionValue,
@@ -0,0 +1,206 @@
+//========================================================================================================== INCLUDES
+#include "running_stats.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static bool running_stats_is_valid(const running_stats_t* stats, sensor_value_t value);
+static uint32_t running_stats_priority(uint16_t node);
+static bool running_stats_less(const running_stats_t* stats, uint16_t node, uint16_t other);
+static uint16_t running_stats_size(const running_stats_t* stats, uint16_t node);
+static void running_stats_resize(running_stats_t* stats, uint16_t node);
+static void running_stats_split(running_stats_t* stats, uint16_t node, uint16_t key, uint16_t* less, uint16_t* not_less);
+static uint16_t running_stats_merge(running_stats_t* stats, uint16_t less, uint16_t not_less);
+static void running_stats_insert(running_stats_t* stats, uint16_t* link, uint16_t node);
+static void running_stats_remove(running_stats_t* stats, uint16_t* link, uint16_t node);
+static sensor_value_t running_stats_select(const running_stats_t* stats, uint16_t rank);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void running_stats_init(running_stats_t* stats, sensor_value_t* samples, running_stats_node_t* nodes, uint16_t window, sensor_value_t valid_min, sensor_value_t valid_max, sensor_value_t initial_value){
+  stats->samples = samples;
+  stats->nodes = nodes;
+  stats->root = RUNNING_STATS_NONE;
+  stats->window = window;
+  stats->valid_min = valid_min;
+  stats->valid_max = valid_max;
+  stats->latest = initial_value;
+  stats->total = 0;
+  stats->valid_samples = 0;
+
+  for(uint16_t i = 0; i < window; i++){
+    stats->samples[i] = initial_value;
+    running_stats_insert(stats, &stats->root, i);
+  }
+
+  if(running_stats_is_valid(stats, initial_value)){
+    stats->total = (sensor_value_sum_t)initial_value * window;
+    stats->valid_samples = window;
+  }
+}
+
+bool running_stats_replace(running_stats_t* stats, uint16_t slot, sensor_value_t new_value){
+  sensor_value_t old_value = stats->samples[slot];
+  bool valid = running_stats_is_valid(stats, new_value);
+
+  if(running_stats_is_valid(stats, old_value)){
+    stats->total -= old_value;
+    stats->valid_samples--;
+  }
+  if(valid){
+    stats->total += new_value;
+    stats->valid_samples++;
+  }
+  stats->latest = new_value;
+
+  // The slot moves to the position of its new sample
+  running_stats_remove(stats, &stats->root, slot);
+  stats->samples[slot] = new_value;
+  running_stats_insert(stats, &stats->root, slot);
+
+  return valid;
+}
+
+void running_stats_get(const running_stats_t* stats, sensor_stats_t* result){
+  result->min = running_stats_select(stats, 0);
+  result->max = running_stats_select(stats, stats->window - 1);
+
+  if(stats->window % 2 == 0){
+    result->median = sensor_value_midpoint(running_stats_select(stats, stats->window / 2 - 1), running_stats_select(stats, stats->window / 2));
+  }
+  else{
+    result->median = running_stats_select(stats, stats->window / 2);
+  }
+
+  // Nothing valid to average, report the latest reading rather than a stale value
+  result->avg = (stats->valid_samples != 0) ? sensor_value_average(stats->total, stats->valid_samples) : stats->latest;
+}
+
+static bool running_stats_is_valid(const running_stats_t* stats, sensor_value_t value){
+  return (value >= stats->valid_min) && (value <= stats->valid_max);
+}
+
+// Heap priority of a node, the index scrambled so that priorities look random and the expected
+// depth of the treap stays logarithmic whatever order the samples come in
+static uint32_t running_stats_priority(uint16_t node){
+  uint32_t hash = ((uint32_t)node + 1u) * 0x9E3779B1u;
+
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6Bu;
+
+  return hash ^ (hash >> 13);
+}
+
+// Order of the nodes in the tree, equal values by node index so that a window of
+// equal samples (as after init) is still a balanced tree
+static bool running_stats_less(const running_stats_t* stats, uint16_t node, uint16_t other){
+  sensor_value_t value = stats->samples[node];
+  sensor_value_t other_value = stats->samples[other];
+
+  return (value < other_value) || ((value == other_value) && (node < other));
+}
+
+static uint16_t running_stats_size(const running_stats_t* stats, uint16_t node){
+  return (node != RUNNING_STATS_NONE) ? stats->nodes[node].size : 0;
+}
+
+static void running_stats_resize(running_stats_t* stats, uint16_t node){
+  running_stats_node_t* entry = &stats->nodes[node];
+
+  entry->size = running_stats_size(stats, entry->left) + running_stats_size(stats, entry->right) + 1;
+}
+
+// Splits the subtree into the nodes ordered before key and the rest
+static void running_stats_split(running_stats_t* stats, uint16_t node, uint16_t key, uint16_t* less, uint16_t* not_less){
+  if(node == RUNNING_STATS_NONE){
+    *less = RUNNING_STATS_NONE;
+    *not_less = RUNNING_STATS_NONE;
+    return;
+  }
+
+  if(running_stats_less(stats, node, key)){
+    *less = node;
+    running_stats_split(stats, stats->nodes[node].right, key, &stats->nodes[node].right, not_less);
+  }
+  else{
+    *not_less = node;
+    running_stats_split(stats, stats->nodes[node].left, key, less, &stats->nodes[node].left);
+  }
+
+  running_stats_resize(stats, node);
+}
+
+// Joins two subtrees, every node of less is ordered before the nodes of not_less
+static uint16_t running_stats_merge(running_stats_t* stats, uint16_t less, uint16_t not_less){
+  if(less == RUNNING_STATS_NONE){
+    return not_less;
+  }
+  if(not_less == RUNNING_STATS_NONE){
+    return less;
+  }
+
+  if(running_stats_priority(less) > running_stats_priority(not_less)){
+    stats->nodes[less].right = running_stats_merge(stats, stats->nodes[less].right, not_less);
+    running_stats_resize(stats, less);
+    return less;
+  }
+
+  stats->nodes[not_less].left = running_stats_merge(stats, less, stats->nodes[not_less].left);
+  running_stats_resize(stats, not_less);
+  return not_less;
+}
+
+static void running_stats_insert(running_stats_t* stats, uint16_t* link, uint16_t node){
+  running_stats_node_t* entry = &stats->nodes[node];
+
+  if(*link == RUNNING_STATS_NONE){
+    entry->left = RUNNING_STATS_NONE;
+    entry->right = RUNNING_STATS_NONE;
+    entry->size = 1;
+    *link = node;
+  }
+  else if(running_stats_priority(node) > running_stats_priority(*link)){
+    running_stats_split(stats, *link, node, &entry->left, &entry->right);
+    running_stats_resize(stats, node);
+    *link = node;
+  }
+  else{
+    stats->nodes[*link].size++;
+    running_stats_insert(stats, running_stats_less(stats, node, *link) ? &stats->nodes[*link].left : &stats->nodes[*link].right, node);
+  }
+}
+
+// Takes node out of the subtree, node has to be in there
+static void running_stats_remove(running_stats_t* stats, uint16_t* link, uint16_t node){
+  running_stats_node_t* entry = &stats->nodes[*link];
+
+  if(*link == node){
+    *link = running_stats_merge(stats, entry->left, entry->right);
+    return;
+  }
+
+  entry->size--;
+  running_stats_remove(stats, running_stats_less(stats, node, *link) ? &entry->left : &entry->right, node);
+}
+
+// Value with rank values below it in the window
+static sensor_value_t running_stats_select(const running_stats_t* stats, uint16_t rank){
+  uint16_t node = stats->root;
+
+  for(;;){
+    const running_stats_node_t* entry = &stats->nodes[node];
+    uint16_t left_size = running_stats_size(stats, entry->left);
+
+    if(rank < left_size){
+      node = entry->left;
+    }
+    else if(rank == left_size){
+      return stats->samples[node];
+    }
+    else{
+      rank -= left_size + 1;
+      node = entry->right;
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef RUNNING_STATS_H_
+#define RUNNING_STATS_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+#include "sensor_value.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Data structures that the sample iot runner will receive on get calls
+// Keeping things simple now, we will anyway ditch this and have SDK on MEGA
+typedef struct{
+    sensor_value_t avg;
+    sensor_value_t max;
+    sensor_value_t min;
+    sensor_value_t median;
+}sensor_stats_t;
+
+#define RUNNING_STATS_NONE 0xFFFF     // No node, windows are shorter than this
+
+// Window slot in the order statistics tree, node i stands for samples[i]. Kept by the
+// caller, the nodes only ever move within the tree.
+typedef struct{
+  uint16_t left;
+  uint16_t right;
+  uint16_t size;                        // Nodes in the subtree, gives the rank of a value
+}running_stats_node_t;
+
+// Statistics of one sensor over the last window samples, kept up to date as samples
+// come in so that reading them does not have to walk the window.
+// The window samples are the caller's (a sample store column), the statistics write
+// each new sample into its slot. The slots are ordered in a treap with subtree sizes,
+// min/max/median are the samples of rank 0, window - 1 and window / 2.
+typedef struct{
+  sensor_value_t* samples;
+  running_stats_node_t* nodes;
+  uint16_t root;
+  uint16_t window;
+  uint16_t valid_samples;               // Samples within [valid_min, valid_max], the average is taken over those
+  sensor_value_sum_t total;             // Sum of the valid samples, exact in both representations
+  sensor_value_t valid_min;
+  sensor_value_t valid_max;
+  sensor_value_t latest;
+}running_stats_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// samples and nodes have to hold window entries, window is below RUNNING_STATS_NONE.
+// The samples are set to initial_value.
+void running_stats_init(running_stats_t* stats, sensor_value_t* samples, running_stats_node_t* nodes, uint16_t window, sensor_value_t valid_min, sensor_value_t valid_max, sensor_value_t initial_value);
+
+// Replaces the sample in slot (the oldest in the window) with new_value. Returns false if new_value is out of range,
+// it then still counts for min/max/median but not for the average. O(log window) steps.
+bool running_stats_replace(running_stats_t* stats, uint16_t slot, sensor_value_t new_value);
+
+void running_stats_get(const running_stats_t* stats, sensor_stats_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RUNNING_STATS_H_ */
@@ -0,0 +1,40 @@
+//========================================================================================================== INCLUDES
+#include "sample_store.h"
+#include <memory.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void sample_store_init(sample_store_t* store, sensor_value_t* columns, uint16_t channels, uint16_t window){
+  store->columns = columns;
+  store->channels = channels;
+  store->window = window;
+  store->next = 0;
+
+  memset(columns, 0, (uint32_t)channels * window * sizeof(sensor_value_t));
+}
+
+sensor_value_t* sample_store_column(const sample_store_t* store, uint16_t channel){
+  return store->columns + (uint32_t)channel * store->window;
+}
+
+uint16_t sample_store_slot(const sample_store_t* store){
+  return store->next;
+}
+
+sensor_value_t sample_store_latest(const sample_store_t* store, uint16_t channel){
+  uint16_t latest = (store->next != 0) ? store->next - 1 : store->window - 1;
+
+  return sample_store_column(store, channel)[latest];
+}
+
+void sample_store_advance(sample_store_t* store){
+  store->next++;
+  if(store->next >= store->window){
+    store->next = 0;
+  }
+}
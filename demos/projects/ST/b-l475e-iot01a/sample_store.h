@@ -0,0 +1,45 @@
+#ifndef SAMPLE_STORE_H_
+#define SAMPLE_STORE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include "sensor_value.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Last window samples of a group of sensor channels received together (one UNIT or SKID frame).
+// Stored column wise, every channel has its own contiguous array of window values, so
+// working on one channel is a plain linear walk over memory. The columns are the windows
+// of the channel statistics, running_stats_replace writes the samples of a frame.
+typedef struct{
+  sensor_value_t* columns;  // channels * window values, channel c at columns + c * window
+  uint16_t channels;
+  uint16_t window;
+  uint16_t next;            // Slot the next frame is written to, holds the oldest samples until then
+}sample_store_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// columns has to hold channels * window values, all samples start at 0
+void sample_store_init(sample_store_t* store, sensor_value_t* columns, uint16_t channels, uint16_t window);
+
+// Contiguous window samples of a channel, in slot order (not oldest first)
+sensor_value_t* sample_store_column(const sample_store_t* store, uint16_t channel);
+
+// Slot the incoming frame is written to, it holds the oldest samples until then
+uint16_t sample_store_slot(const sample_store_t* store);
+
+sensor_value_t sample_store_latest(const sample_store_t* store, uint16_t channel);
+
+// Makes the slot written last the latest one
+void sample_store_advance(sample_store_t* store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SAMPLE_STORE_H_ */
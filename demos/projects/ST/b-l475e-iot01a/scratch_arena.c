@@ -0,0 +1,48 @@
+//========================================================================================================== INCLUDES
+#include "scratch_arena.h"
+#include <stddef.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void scratch_arena_init(scratch_arena_t* arena, uint8_t* buffer, uint32_t size){
+  arena->buffer = buffer;
+  arena->size = size;
+  arena->used = 0;
+  arena->peak = 0;
+}
+
+uint8_t* scratch_arena_alloc(scratch_arena_t* arena, uint32_t size){
+  uint8_t* allocation = arena->buffer + arena->used;
+
+  if(size > arena->size - arena->used){
+    return NULL;
+  }
+
+  arena->used += size;
+  if(arena->used > arena->peak){
+    arena->peak = arena->used;
+  }
+
+  return allocation;
+}
+
+uint32_t scratch_arena_remaining(const scratch_arena_t* arena, uint8_t** top){
+  *top = arena->buffer + arena->used;
+
+  return arena->size - arena->used;
+}
+
+scratch_arena_mark_t scratch_arena_mark(const scratch_arena_t* arena){
+  return arena->used;
+}
+
+void scratch_arena_reset(scratch_arena_t* arena, scratch_arena_mark_t mark){
+  if(mark < arena->used){
+    arena->used = mark;
+  }
+}
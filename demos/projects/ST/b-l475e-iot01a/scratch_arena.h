@@ -0,0 +1,45 @@
+#ifndef SCRATCH_ARENA_H_
+#define SCRATCH_ARENA_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Bump allocator over one static buffer. Allocations are taken from the top and only
+// given back together: take a mark, allocate, reset to the mark when the scope ends.
+// Nothing is cleared on reset, callers write every byte they use.
+typedef struct{
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t used;
+  uint32_t peak;    // Highest used since init
+}scratch_arena_t;
+
+typedef uint32_t scratch_arena_mark_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void scratch_arena_init(scratch_arena_t* arena, uint8_t* buffer, uint32_t size);
+
+// size bytes from the top, NULL and nothing taken if they do not fit
+uint8_t* scratch_arena_alloc(scratch_arena_t* arena, uint32_t size);
+
+// Free space above the top, for writers that find out their length while writing:
+// write into *top, then scratch_arena_alloc() what was written.
+uint32_t scratch_arena_remaining(const scratch_arena_t* arena, uint8_t** top);
+
+scratch_arena_mark_t scratch_arena_mark(const scratch_arena_t* arena);
+
+// Gives back everything allocated after mark
+void scratch_arena_reset(scratch_arena_t* arena, scratch_arena_mark_t mark);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCRATCH_ARENA_H_ */
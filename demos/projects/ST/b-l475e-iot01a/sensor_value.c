@@ -0,0 +1,155 @@
+//========================================================================================================== INCLUDES
+#include "sensor_value.h"
+#include <stdbool.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define SENSOR_VALUE_MAX_FRACTIONAL_DIGITS 6
+
+//========================================================================================================== VARIABLES
+static const uint32_t powers_of_10[SENSOR_VALUE_MAX_FRACTIONAL_DIGITS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint32_t scaled_to_text(uint64_t scaled, uint8_t fractional_digits, bool negative, char* buffer, uint32_t buffer_size);
+#if SENSOR_VALUE_FIXED_POINT
+static sensor_value_t quotient_to_value(int64_t numerator, uint32_t denominator);
+#endif
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+#if SENSOR_VALUE_FIXED_POINT
+sensor_value_t sensor_value_average(sensor_value_sum_t total, uint16_t count){
+  return quotient_to_value(total, count);
+}
+
+sensor_value_t sensor_value_midpoint(sensor_value_t a, sensor_value_t b){
+  return quotient_to_value((int64_t)a + b, 2);
+}
+
+uint32_t sensor_value_to_text(sensor_value_t value, uint8_t fractional_digits, char* buffer, uint32_t buffer_size){
+  uint64_t magnitude = (value < 0) ? -(int64_t)value : value;
+
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  // Exact: the fraction is a multiple of 2^-16, scaling by 10^digits first loses nothing
+  return scaled_to_text((magnitude * powers_of_10[fractional_digits]) >> SENSOR_VALUE_FRACTION_BITS,
+                        fractional_digits, value < 0, buffer, buffer_size);
+}
+
+int64_t sensor_value_to_scaled(sensor_value_t value, uint8_t fractional_digits){
+  uint64_t magnitude = (value < 0) ? -(int64_t)value : value;
+  int64_t scaled;
+
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  scaled = (magnitude * powers_of_10[fractional_digits]) >> SENSOR_VALUE_FRACTION_BITS;
+  return (value < 0) ? -scaled : scaled;
+}
+
+sensor_value_t sensor_value_from_scaled(int64_t scaled, uint8_t fractional_digits){
+  uint64_t magnitude = (scaled < 0) ? -scaled : scaled;
+  int64_t value;
+
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  // Rounded up, so truncating it again gives back the same digits
+  value = ((magnitude << SENSOR_VALUE_FRACTION_BITS) + powers_of_10[fractional_digits] - 1) / powers_of_10[fractional_digits];
+  return (sensor_value_t)((scaled < 0) ? -value : value);
+}
+
+// numerator / denominator rounded half away from zero, unless that moves it across a SENSOR_VALUE_DECIMALS
+// digit: truncating the exact quotient and the Q16.16 one has to give the same digits
+static sensor_value_t quotient_to_value(int64_t numerator, uint32_t denominator){
+  uint64_t magnitude = (numerator < 0) ? -numerator : numerator;
+  uint64_t value = (magnitude + denominator / 2) / denominator;
+  uint64_t digits = (magnitude * powers_of_10[SENSOR_VALUE_DECIMALS]) / ((uint64_t)denominator << SENSOR_VALUE_FRACTION_BITS);
+  uint64_t value_digits = (value * powers_of_10[SENSOR_VALUE_DECIMALS]) >> SENSOR_VALUE_FRACTION_BITS;
+
+  // Smallest value printing digits + 1, less one; or the smallest value printing digits
+  if(value_digits > digits){
+    value = (((digits + 1) << SENSOR_VALUE_FRACTION_BITS) + powers_of_10[SENSOR_VALUE_DECIMALS] - 1) / powers_of_10[SENSOR_VALUE_DECIMALS] - 1;
+  }
+  else if(value_digits < digits){
+    value = ((digits << SENSOR_VALUE_FRACTION_BITS) + powers_of_10[SENSOR_VALUE_DECIMALS] - 1) / powers_of_10[SENSOR_VALUE_DECIMALS];
+  }
+
+  return (sensor_value_t)((numerator < 0) ? -(int64_t)value : (int64_t)value);
+}
+#else
+sensor_value_t sensor_value_average(sensor_value_sum_t total, uint16_t count){
+  return total / (double)count;
+}
+
+sensor_value_t sensor_value_midpoint(sensor_value_t a, sensor_value_t b){
+  return (a + b) / 2.0;
+}
+
+uint32_t sensor_value_to_text(sensor_value_t value, uint8_t fractional_digits, char* buffer, uint32_t buffer_size){
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  return scaled_to_text((uint64_t)((value < 0 ? -value : value) * powers_of_10[fractional_digits]),
+                        fractional_digits, value < 0, buffer, buffer_size);
+}
+
+int64_t sensor_value_to_scaled(sensor_value_t value, uint8_t fractional_digits){
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  return (int64_t)(value * powers_of_10[fractional_digits]);
+}
+
+sensor_value_t sensor_value_from_scaled(int64_t scaled, uint8_t fractional_digits){
+  if(fractional_digits > SENSOR_VALUE_MAX_FRACTIONAL_DIGITS){
+    fractional_digits = SENSOR_VALUE_MAX_FRACTIONAL_DIGITS;
+  }
+
+  // Half a digit away from zero, so truncating it again gives back the same digits
+  return (scaled + ((scaled < 0) ? -0.5 : 0.5)) / powers_of_10[fractional_digits];
+}
+#endif
+
+// scaled is the magnitude times 10^fractional_digits, already truncated
+static uint32_t scaled_to_text(uint64_t scaled, uint8_t fractional_digits, bool negative, char* buffer, uint32_t buffer_size){
+  char digits[SENSOR_VALUE_TEXT_LENGTH];
+  uint8_t count = 0;
+  uint8_t minimum = 0;
+  uint32_t length = 0;
+
+  // Trailing zeros of the fraction are not printed
+  while((fractional_digits > 0) && (scaled % 10 == 0)){
+    scaled /= 10;
+    fractional_digits--;
+  }
+
+  // Digits come out last to first: the fraction, the point and at least one whole digit
+  minimum = (fractional_digits > 0) ? fractional_digits + 2 : 1;
+  do{
+    digits[count++] = '0' + (scaled % 10);
+    scaled /= 10;
+    if(count == fractional_digits){
+      digits[count++] = '.';
+    }
+  }while(((scaled != 0) || (count < minimum)) && (count < SENSOR_VALUE_TEXT_LENGTH - 1));
+
+  if(negative && !((count == 1) && (digits[0] == '0'))){
+    digits[count++] = '-';
+  }
+
+  if((scaled != 0) || (count >= buffer_size)){
+    return 0;
+  }
+
+  while(count > 0){
+    buffer[length++] = digits[--count];
+  }
+  buffer[length] = '\0';
+
+  return length;
+}
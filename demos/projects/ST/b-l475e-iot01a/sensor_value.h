@@ -0,0 +1,69 @@
+#ifndef SENSOR_VALUE_H_
+#define SENSOR_VALUE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// 1 - sensor values stay in the Q16.16 format the controller sends them in, all statistics are integer math
+//     (the Cortex-M4 FPU is single precision only, doubles are done in software)
+// 0 - sensor values are converted to double on arrival
+#ifndef SENSOR_VALUE_FIXED_POINT
+#define SENSOR_VALUE_FIXED_POINT 1
+#endif
+
+#define SENSOR_VALUE_FRACTION_BITS 16
+#define SENSOR_VALUE_DECIMALS 3         // Digits after the point in the telemetry
+#define SENSOR_VALUE_TEXT_LENGTH 16     // "-32768.999999" and a terminator
+
+#if SENSOR_VALUE_FIXED_POINT
+typedef int32_t sensor_value_t;         // Q16.16
+typedef int64_t sensor_value_sum_t;
+
+#define SENSOR_VALUE_FROM_Q16(raw) ((sensor_value_t)(raw))
+// Unsigned readings of 32768.0 and above (the all ones error word among them) saturate instead of turning
+// negative, so they stay out of range the same way the double path keeps them
+#define SENSOR_VALUE_FROM_UQ16(raw) ((sensor_value_t)((raw) > (uint32_t)INT32_MAX ? (uint32_t)INT32_MAX : (raw)))
+#define SENSOR_VALUE(constant) ((sensor_value_t)((constant) * (1 << SENSOR_VALUE_FRACTION_BITS)))
+#define SENSOR_VALUE_LOWEST INT32_MIN
+#define SENSOR_VALUE_INTEGER_PART(value) ((int32_t)((value) / (1 << SENSOR_VALUE_FRACTION_BITS)))
+#else
+typedef double sensor_value_t;
+typedef double sensor_value_sum_t;
+
+#define SENSOR_VALUE_FROM_Q16(raw) ((double)(raw) / (1 << SENSOR_VALUE_FRACTION_BITS))
+#define SENSOR_VALUE_FROM_UQ16(raw) ((double)(uint32_t)(raw) / (1 << SENSOR_VALUE_FRACTION_BITS))
+#define SENSOR_VALUE(constant) ((double)(constant))
+#define SENSOR_VALUE_LOWEST (-__DBL_MAX__)
+#define SENSOR_VALUE_INTEGER_PART(value) ((int32_t)(value))
+#endif
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// total / count and halfway between a and b, rounded to the nearest representable value. In fixed point the
+// result is kept to the SENSOR_VALUE_DECIMALS digits of the exact quotient, so it prints the same as the
+// double path does, at the cost of up to one more bit of error next to a digit boundary.
+sensor_value_t sensor_value_average(sensor_value_sum_t total, uint16_t count);
+sensor_value_t sensor_value_midpoint(sensor_value_t a, sensor_value_t b);
+
+// Decimal text with at most fractional_digits digits after the point, extra digits are truncated and
+// trailing zeros dropped (same as the JSON writer does for doubles). Returns the text length, 0 if it
+// does not fit in buffer_size.
+uint32_t sensor_value_to_text(sensor_value_t value, uint8_t fractional_digits, char* buffer, uint32_t buffer_size);
+
+// value times 10^fractional_digits, truncated the same way sensor_value_to_text does
+int64_t sensor_value_to_scaled(sensor_value_t value, uint8_t fractional_digits);
+
+// A value sensor_value_to_scaled turns back into scaled, for reading scaled values back in
+sensor_value_t sensor_value_from_scaled(int64_t scaled, uint8_t fractional_digits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SENSOR_VALUE_H_ */
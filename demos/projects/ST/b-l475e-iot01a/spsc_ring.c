@@ -0,0 +1,95 @@
+//========================================================================================================== INCLUDES
+#include "spsc_ring.h"
+#include <memory.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// The side owning an index reads it plainly, the other side needs the ordering
+#define LOAD_ACQUIRE(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void spsc_ring_init(spsc_ring_t* ring, uint8_t* buffer, uint32_t capacity){
+  ring->buffer = buffer;
+  ring->mask = capacity - 1;
+  ring->head = 0;
+  ring->tail = 0;
+}
+
+uint32_t spsc_ring_free(const spsc_ring_t* ring){
+  return ring->mask + 1 - (ring->head - LOAD_ACQUIRE(ring->tail));
+}
+
+uint32_t spsc_ring_write(spsc_ring_t* ring, const uint8_t* data, uint32_t data_size){
+  uint32_t head = ring->head;
+  uint32_t free_space = spsc_ring_free(ring);
+  uint32_t offset = head & ring->mask;
+  uint32_t first_part_len = 0;
+
+  if(data_size > free_space){
+    data_size = free_space;
+  }
+
+  first_part_len = ring->mask + 1 - offset;
+  if(first_part_len > data_size){
+    first_part_len = data_size;
+  }
+
+  memcpy(ring->buffer + offset, data, first_part_len);
+  memcpy(ring->buffer, data + first_part_len, data_size - first_part_len);
+
+  // Bytes first, then the index that hands them over
+  STORE_RELEASE(ring->head, head + data_size);
+
+  return data_size;
+}
+
+uint32_t spsc_ring_available(const spsc_ring_t* ring){
+  return LOAD_ACQUIRE(ring->head) - ring->tail;
+}
+
+uint32_t spsc_ring_peek(const spsc_ring_t* ring, const uint8_t** first, uint32_t* first_length,
+                        const uint8_t** second, uint32_t* second_length){
+  uint32_t available = spsc_ring_available(ring);
+  uint32_t offset = ring->tail & ring->mask;
+
+  *first = ring->buffer + offset;
+  *first_length = ring->mask + 1 - offset;
+  if(*first_length > available){
+    *first_length = available;
+  }
+
+  *second = ring->buffer;
+  *second_length = available - *first_length;
+
+  return available;
+}
+
+void spsc_ring_consume(spsc_ring_t* ring, uint32_t data_size){
+  // Done reading the bytes before the producer may overwrite them
+  STORE_RELEASE(ring->tail, ring->tail + data_size);
+}
+
+uint32_t spsc_ring_read(spsc_ring_t* ring, uint8_t* data, uint32_t data_size){
+  const uint8_t* first;
+  const uint8_t* second;
+  uint32_t first_length;
+  uint32_t second_length;
+
+  if(spsc_ring_peek(ring, &first, &first_length, &second, &second_length) < data_size){
+    return 0;
+  }
+
+  if(first_length > data_size){
+    first_length = data_size;
+  }
+
+  memcpy(data, first, first_length);
+  memcpy(data + first_length, second, data_size - first_length);
+  spsc_ring_consume(ring, data_size);
+
+  return data_size;
+}
@@ -0,0 +1,53 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Byte ring for exactly one producer and one consumer, e.g. an interrupt and a task.
+// Neither side needs a critical section: each index is written by one side only and
+// published with release ordering after the bytes it covers, the other side reads it
+// with acquire ordering. The indices run freely and are masked on access, so the
+// whole capacity is usable and capacity has to be a power of two.
+typedef struct{
+  uint8_t* buffer;
+  uint32_t mask;    // capacity - 1
+  uint32_t head;    // Bytes written so far, producer only
+  uint32_t tail;    // Bytes consumed so far, consumer only
+}spsc_ring_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void spsc_ring_init(spsc_ring_t* ring, uint8_t* buffer, uint32_t capacity);
+
+//------------------------------------------ producer side
+uint32_t spsc_ring_free(const spsc_ring_t* ring);
+
+// Copies as much of data as fits, returns how many bytes that was
+uint32_t spsc_ring_write(spsc_ring_t* ring, const uint8_t* data, uint32_t data_size);
+
+//------------------------------------------ consumer side
+uint32_t spsc_ring_available(const spsc_ring_t* ring);
+
+// Everything available without copying, in up to two parts because of the wrap
+// point. Returns the total, second is empty (length 0) when nothing wraps.
+uint32_t spsc_ring_peek(const spsc_ring_t* ring, const uint8_t** first, uint32_t* first_length,
+                        const uint8_t** second, uint32_t* second_length);
+
+// Gives data_size peeked bytes back to the producer
+void spsc_ring_consume(spsc_ring_t* ring, uint32_t data_size);
+
+// Copies out data_size bytes if that many are available, returns 0 and takes nothing otherwise
+uint32_t spsc_ring_read(spsc_ring_t* ring, uint8_t* data, uint32_t data_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPSC_RING_H_ */
@@ -0,0 +1,66 @@
+//========================================================================================================== INCLUDES
+#include "state_alarm.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// The pending bits are shared, the events are ordered by them and notify is set from another task
+#define LOAD_ACQUIRE(value) __atomic_load_n(&(value), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(value, new_value) __atomic_store_n(&(value), (new_value), __ATOMIC_RELEASE)
+#define LOAD_RELAXED(value) __atomic_load_n(&(value), __ATOMIC_RELAXED)
+#define STORE_RELAXED(value, new_value) __atomic_store_n(&(value), (new_value), __ATOMIC_RELAXED)
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void state_alarm_init(state_alarm_t* alarm){
+  memset(alarm, 0, sizeof(*alarm));
+}
+
+void state_alarm_set_notify(state_alarm_t* alarm, state_alarm_notify_t notify, void* context){
+  alarm->context = context;
+  STORE_RELEASE(alarm->notify, notify);
+}
+
+bool state_alarm_is_alarm_state(sequence_state_t state){
+  return (state == Lock_State) || (state == Safe_State);
+}
+
+bool state_alarm_update(state_alarm_t* alarm, state_alarm_source_t source, sequence_state_t state, uint32_t tick){
+  sequence_state_t last_state = alarm->last_state[source];
+  state_alarm_notify_t notify;
+
+  alarm->last_state[source] = state;
+
+  if(!state_alarm_is_alarm_state(state) || state == last_state){
+    return false;
+  }
+
+  alarm->transitions++;
+  STORE_RELAXED(alarm->last_event[source].state, state);
+  STORE_RELAXED(alarm->last_event[source].tick, tick);
+  __atomic_fetch_or(&alarm->pending, STATE_ALARM_BIT(source), __ATOMIC_RELEASE);
+
+  notify = LOAD_ACQUIRE(alarm->notify);
+  if(notify != NULL){
+    notify(alarm->context);
+  }
+
+  return true;
+}
+
+uint32_t state_alarm_take(state_alarm_t* alarm){
+  return __atomic_exchange_n(&alarm->pending, 0, __ATOMIC_ACQUIRE);
+}
+
+state_alarm_event_t state_alarm_last_event(const state_alarm_t* alarm, state_alarm_source_t source){
+  state_alarm_event_t event;
+
+  // A frame apart from the next transition, the two fields always belong to the same one
+  event.state = LOAD_RELAXED(alarm->last_event[source].state);
+  event.tick = LOAD_RELAXED(alarm->last_event[source].tick);
+
+  return event;
+}
@@ -0,0 +1,68 @@
+#ifndef STATE_ALARM_H_
+#define STATE_ALARM_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+#include "iot_status.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+typedef enum{
+  STATE_ALARM_SKID,
+  STATE_ALARM_UNIT,
+  STATE_ALARM_SOURCES
+}state_alarm_source_t;
+
+#define STATE_ALARM_BIT(source) (1u << (source))
+
+// Called from the decoder on every alarm transition, e.g. to give a task notification
+typedef void (*state_alarm_notify_t)(void* context);
+
+typedef struct{
+  sequence_state_t state;   // The alarm state entered
+  uint32_t tick;            // When the decoder saw it
+}state_alarm_event_t;
+
+// Transitions of the SKID and unit sequence into Lock_State or Safe_State, seen frame by frame
+// as the decoder gets them. The decoder is the only writer of the states, the task publishing
+// the alarm takes the pending ones, so neither needs a lock. All zeros is a valid initial
+// state without a notify, the last states then start at Error_Handling.
+typedef struct{
+  sequence_state_t last_state[STATE_ALARM_SOURCES];   // Decoder only
+  state_alarm_event_t last_event[STATE_ALARM_SOURCES]; // Written before the transition is pending
+  uint32_t pending;                                    // STATE_ALARM_BIT of the sources with a transition not taken yet
+  uint32_t transitions;                                // Seen so far, decoder only
+  state_alarm_notify_t notify;
+  void* context;
+}state_alarm_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void state_alarm_init(state_alarm_t* alarm);
+
+// notify may be NULL. Set before the decoder runs, or by the task that takes the alarms
+void state_alarm_set_notify(state_alarm_t* alarm, state_alarm_notify_t notify, void* context);
+
+bool state_alarm_is_alarm_state(sequence_state_t state);
+
+//------------------------------------------ decoder side
+// Returns true, and calls notify, when state is a transition of source into an alarm state
+bool state_alarm_update(state_alarm_t* alarm, state_alarm_source_t source, sequence_state_t state, uint32_t tick);
+
+//------------------------------------------ publisher side
+// STATE_ALARM_BIT of the sources with a transition since the last call, and clears them
+uint32_t state_alarm_take(state_alarm_t* alarm);
+
+// Last transition of a source taken as pending, valid until the decoder sees its next one
+state_alarm_event_t state_alarm_last_event(const state_alarm_t* alarm, state_alarm_source_t source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_ALARM_H_ */
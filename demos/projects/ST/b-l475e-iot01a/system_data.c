@@ -9,23 +9,39 @@
 #include "system_data.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+#include "sample_store.h"
 #include <memory.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <math.h>
 
 //========================================================================================================== DEFINITIONS AND MACROS
 #define MUTEX_MAX_BLOCKING_TIME 1000
-#define NUMBER_OF_SAMPLES 30
+#ifndef NUMBER_OF_SAMPLES
+#define NUMBER_OF_SAMPLES 30            // Statistics window, every sensor channel keeps this many samples
+#endif
+#define NUMBER_OF_SENSOR_NAMES (TANK_PRESSURE + 1)
+
+#define UNIT_CHANNELS (NUMBER_OF_HEATERS + 3)
+#define SKID_CHANNELS 7
+
+// Plausible range of each sensor, samples outside are left out of the average
+typedef struct{
+  sensor_value_t min;
+  sensor_value_t max;
+}sensor_range_t;
 
 //========================================================================================================== VARIABLES
-UNIT_status_t unit_status[NUMBER_OF_SAMPLES] = {0};
-SKID_status_t skid_status[NUMBER_OF_SAMPLES] = {0};
+// Latest frames, the sensor values are also kept over time in the sample stores below
+UNIT_status_t unit_status = {0};
+SKID_status_t skid_status = {0};
 
-// We receive unit and skid separately so need to manage separate indexes
+// We receive unit and skid separately so need to manage separate stores
 // Not good but that is how it is!!
-static uint8_t unit_circular_buffer_index = 0;
-static uint8_t skid_circular_buffer_index = 0;
+static sensor_value_t unit_columns[UNIT_CHANNELS * NUMBER_OF_SAMPLES];
+static sensor_value_t skid_columns[SKID_CHANNELS * NUMBER_OF_SAMPLES];
+static sample_store_t unit_samples;
+static sample_store_t skid_samples;
 
 //------------------------------------------ mutexes for read write operations on unit/skid status data structs
 SemaphoreHandle_t skid_status_rw_mutex;
@@ -34,13 +50,59 @@ StaticSemaphore_t skid_mutex_buffer;
 SemaphoreHandle_t unit_status_rw_mutex;
 StaticSemaphore_t unit_mutex_buffer;
 
+//------------------------------------------ statistics over the sample buffers, updated as frames arrive
+static const sensor_range_t sensor_ranges[NUMBER_OF_SENSOR_NAMES] = {
+  [SKID_O2]                       = {SENSOR_VALUE(0), SENSOR_VALUE(100)},
+  [SKID_MASS_FLOW]                = {SENSOR_VALUE_LOWEST, SENSOR_VALUE(60)},
+  [SKID_CO2]                      = {SENSOR_VALUE(0), SENSOR_VALUE(1)},
+  [SKID_PROPOTIONAL_VALVE_SENSOR] = {SENSOR_VALUE(0), SENSOR_VALUE(3)},
+  [SKID_TEMPERATURE]              = {SENSOR_VALUE(-20), SENSOR_VALUE(120)},
+  [SKID_HUMIDITY]                 = {SENSOR_VALUE(0), SENSOR_VALUE(100)},
+  [UNIT_VACUUM_SENSOR]            = {SENSOR_VALUE(0), SENSOR_VALUE(1.2)},
+  [UNIT_AMBIENT_HUMIDITY]         = {SENSOR_VALUE(0), SENSOR_VALUE(100)},
+  [UNIT_AMBIENT_TEMPERATURE]      = {SENSOR_VALUE(-20), SENSOR_VALUE(120)},
+  [UNIT_HEATER]                   = {SENSOR_VALUE(0), SENSOR_VALUE(150)},
+  [TANK_PRESSURE]                 = {SENSOR_VALUE(0), SENSOR_VALUE(6)}
+};
+
+// Column of each sensor in its sample store, the heaters take NUMBER_OF_HEATERS columns from UNIT_HEATER on
+static const uint8_t sensor_channels[NUMBER_OF_SENSOR_NAMES] = {
+  [SKID_O2]                       = 0,
+  [SKID_MASS_FLOW]                = 1,
+  [SKID_CO2]                      = 2,
+  [SKID_PROPOTIONAL_VALVE_SENSOR] = 3,
+  [SKID_TEMPERATURE]              = 4,
+  [SKID_HUMIDITY]                 = 5,
+  [TANK_PRESSURE]                 = 6,
+  [UNIT_HEATER]                   = 0,
+  [UNIT_VACUUM_SENSOR]            = NUMBER_OF_HEATERS,
+  [UNIT_AMBIENT_HUMIDITY]         = NUMBER_OF_HEATERS + 1,
+  [UNIT_AMBIENT_TEMPERATURE]      = NUMBER_OF_HEATERS + 2
+};
+
+static running_stats_t unit_stats[UNIT_CHANNELS];
+static running_stats_t skid_stats[SKID_CHANNELS];
+static running_stats_node_t unit_nodes[UNIT_CHANNELS][NUMBER_OF_SAMPLES];
+static running_stats_node_t skid_nodes[SKID_CHANNELS][NUMBER_OF_SAMPLES];
+
+//------------------------------------------ Lock_State and Safe_State transitions, zeroed before system_data_init so a
+// notify can be set whichever task starts first
+static state_alarm_t state_alarm;
+
+//------------------------------------------ controller frame parser state
+static frame_parser_t parser;
+
+// Frame count and time of the previous get_controller_link_stats call, for the frame rate
+static uint32_t link_stats_last_frames = 0;
+static TickType_t link_stats_last_ticks = 0;
+
 //========================================================================================================== FUNCTIONS DECLARATIONS
 void read_unit_status(uint8_t incoming_data[]);
 void read_skid_status(uint8_t incoming_data[]);
-uint8_t CalcCrc(uint8_t data[], uint8_t nbrOfBytes);
 
-uint8_t get_latest_index(bool skid);
-void sensor_average_max_min(sensor_name_t name, uint8_t heater_index, sensor_info_t* sensor_info);
+static bool is_skid_sensor(sensor_name_t name);
+static running_stats_t* get_sensor_stats(sensor_name_t name, uint8_t heater_index);
+static void add_sensor_sample(sensor_name_t name, uint8_t heater_index, sensor_value_t value);
 
 //========================================================================================================== FUNCTIONS DEFINITIONS
 void system_data_init(void){
@@ -65,63 +127,46 @@ void system_data_init(void){
   }
   #endif
 
+  sample_store_init(&unit_samples, unit_columns, UNIT_CHANNELS, NUMBER_OF_SAMPLES);
+  sample_store_init(&skid_samples, skid_columns, SKID_CHANNELS, NUMBER_OF_SAMPLES);
+
+  // The statistics windows are the sample store columns, all starting at zero
+  for(uint8_t i=0;i<NUMBER_OF_SENSOR_NAMES;++i){
+    if(is_skid_sensor(i)){
+      running_stats_init(&skid_stats[sensor_channels[i]], sample_store_column(&skid_samples, sensor_channels[i]), skid_nodes[sensor_channels[i]], NUMBER_OF_SAMPLES, sensor_ranges[i].min, sensor_ranges[i].max, 0);
+    }
+    else if(i != UNIT_HEATER){
+      running_stats_init(&unit_stats[sensor_channels[i]], sample_store_column(&unit_samples, sensor_channels[i]), unit_nodes[sensor_channels[i]], NUMBER_OF_SAMPLES, sensor_ranges[i].min, sensor_ranges[i].max, 0);
+    }
+  }
+  for(uint8_t i=0;i<NUMBER_OF_HEATERS;++i){
+    running_stats_init(&unit_stats[sensor_channels[UNIT_HEATER] + i], sample_store_column(&unit_samples, sensor_channels[UNIT_HEATER] + i),
+                       unit_nodes[sensor_channels[UNIT_HEATER] + i], NUMBER_OF_SAMPLES,
+                       sensor_ranges[UNIT_HEATER].min, sensor_ranges[UNIT_HEATER].max, 0);
+  }
+
+  frame_parser_init(&parser);
+  link_stats_last_ticks = xTaskGetTickCount();
   gui_comm_init();
 }
 
 void read_incoming_system_data(void){
-  static uint8_t incoming_data[64] = {0};
-  static uint8_t state = 0;
-
-  switch(state){
-    case 0:
-      if(gui_comm_check_for_received_data(incoming_data, 1) != FAILED){ // Read first header byte
-        //configPRINTF(("incoming_data[0] = %c\r\n", (char)(incoming_data[0])));
-        if(incoming_data[0] == 'D'){
-          state = 1;
-          // configPRINTF( ( "---------RECEIVED D---------\r\n" ) );
-        }
-      }
-      break;
-    case 1:
-      if(gui_comm_check_for_received_data((incoming_data + 1), 3) != FAILED){ // Read three next header bytes
-        //configPRINTF(("incoming_data[0] = %c\r\n", (char)(incoming_data[2])));
-        if((incoming_data[2] == 'U') || (incoming_data[2] == 'S')){
-          state = 2;
-          // configPRINTF( ( "---------RECEIVED U or S---------\r\n" ) );
-        }
-        else{state = 3;}
-      }
+  uint16_t bytes_needed = frame_parser_bytes_needed(&parser);
+
+  // Sleep until the uart interrupt has collected what the parser asks for,
+  // the bytes are copied out of the ring buffer straight into the frame
+  if(gui_comm_wait_for_received_data(frame_parser_next_bytes(&parser), bytes_needed, portMAX_DELAY) == FAILED){
+    return;
+  }
+
+  switch(frame_parser_commit(&parser, bytes_needed)){
+    case FRAME_UNIT_STATUS:
+      read_unit_status(parser.data);
       break;
-    case 2: // Read data
-      switch(incoming_data[2]){
-        case 'U': // Unit data
-          //Read rest data from uart
-          if(gui_comm_check_for_received_data((incoming_data + 4), MESSAGE_LENGTH_UNIT_STATUS - 4) != FAILED){ // Read rest of data
-              // for (uint8_t i = 0; i < 64; i++)
-              // {
-              //   configPRINTF(("%X ", incoming_data[i]));
-              // }
-              //configPRINTF(("CRC: %X\n\r\n", CalcCrc(incoming_data, MESSAGE_LENGTH_SKID_STATUS - 1)));
-              if(CalcCrc(incoming_data, MESSAGE_LENGTH_UNIT_STATUS - 1) == incoming_data[MESSAGE_LENGTH_UNIT_STATUS - 1]){ //Check if crc valid
-                  read_unit_status(incoming_data);
-              }
-              state = 3;
-          }
-          break;
-        case 'S': // SKID data
-          //Read rest data from uart
-          if(gui_comm_check_for_received_data((incoming_data + 4), MESSAGE_LENGTH_SKID_STATUS - 4) != FAILED){ // Read rest of data
-              if(CalcCrc(incoming_data, MESSAGE_LENGTH_SKID_STATUS - 1) == incoming_data[MESSAGE_LENGTH_SKID_STATUS - 1]){ //Check if crc valid 
-                  read_skid_status(incoming_data);
-              }
-              state = 3;
-          }
-          break;
-      }
+    case FRAME_SKID_STATUS:
+      read_skid_status(parser.data);
       break;
-    case 3: //Reset state 
-      state = 0;
-      memset(incoming_data, 0, sizeof(incoming_data));
+    default:
       break;
   }
 }
@@ -136,283 +181,71 @@ void send_unlock_status(void){
 }
 
 void read_unit_status(uint8_t incoming_data[]){
-  static uint8_t end = 4;
+  sequence_state_t unit_state;
 
   xSemaphoreTake(unit_status_rw_mutex, MUTEX_MAX_BLOCKING_TIME);
 
-  end = 4;
+  frame_layout_decode(&unit_status_layout, incoming_data, &unit_status);
+  unit_state = unit_status.unit_state;
 
-  unit_status[unit_circular_buffer_index].unit_status = incoming_data[end++];
-
-  unit_status[unit_circular_buffer_index].unit_state = incoming_data[end++];
-
-  unit_status[unit_circular_buffer_index].heater_status = (((uint16_t)(incoming_data[end++]) << 8) & 0xFF00);
-  unit_status[unit_circular_buffer_index].heater_status |= ((uint16_t)(incoming_data[end++]) & 0xFF);
-
-  uint32_t tmp_sensor = 0;
-  for(int i = 0;i<NUMBER_OF_HEATERS;i++){
-    tmp_sensor = 0;
-    tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-    tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-    tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-    tmp_sensor |= (uint32_t)(incoming_data[end++]) & 0xFF;
-    unit_status[unit_circular_buffer_index].heater_temperatures[i] = (double)tmp_sensor / (1 << 16);
+  for(uint8_t i=0;i<NUMBER_OF_HEATERS;++i){
+    add_sensor_sample(UNIT_HEATER, i, unit_status.heater_temperatures[i]);
   }
+  add_sensor_sample(UNIT_VACUUM_SENSOR, 0, unit_status.vacuum_sensor);
+  add_sensor_sample(UNIT_AMBIENT_HUMIDITY, 0, unit_status.ambient_humidity);
+  add_sensor_sample(UNIT_AMBIENT_TEMPERATURE, 0, unit_status.ambient_temperature);
 
-  unit_status[unit_circular_buffer_index].valve_status = incoming_data[end++];
-
-  int32_t tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  unit_status[unit_circular_buffer_index].vacuum_sensor = (double)tmp_sensor_1 / (1 << 16);
-
-  tmp_sensor = 0;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor |= (uint32_t)(incoming_data[end++]) & 0xFF;
-  unit_status[unit_circular_buffer_index].ambient_humidity = (double)tmp_sensor / (1 << 16);
-
-  tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  unit_status[unit_circular_buffer_index].ambient_temperature = (double)tmp_sensor_1 / (1 << 16);
-
-  unit_status[unit_circular_buffer_index].errors = 0;
-  unit_status[unit_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  unit_status[unit_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  unit_status[unit_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  unit_status[unit_circular_buffer_index].errors |= (uint32_t)(incoming_data[end++]) & 0xFF;
-
-  // Update the circular index for next turn once current index is filled
-  unit_circular_buffer_index++;
-  if(unit_circular_buffer_index >= NUMBER_OF_SAMPLES){
-    unit_circular_buffer_index = 0;
-  }
+  // Move to the next slot for next turn once current one is filled
+  sample_store_advance(&unit_samples);
 
   xSemaphoreGive(unit_status_rw_mutex);
+
+  // Every frame, so the alarm goes out without waiting for the next publish
+  state_alarm_update(&state_alarm, STATE_ALARM_UNIT, unit_state, xTaskGetTickCount());
 }
 
 void read_skid_status(uint8_t incoming_data[]){
-  static uint8_t end = 4;
+  sequence_state_t skid_state;
 
   xSemaphoreTake(skid_status_rw_mutex, MUTEX_MAX_BLOCKING_TIME);
 
-  end = 4;
-
-  skid_status[skid_circular_buffer_index].skid_status = incoming_data[end++];
-  skid_status[skid_circular_buffer_index].skid_state = incoming_data[end++];
-
-  skid_status[skid_circular_buffer_index].outputs_status = (((uint16_t)(incoming_data[end++]) << 8) & 0xFF00); 
-  skid_status[skid_circular_buffer_index].outputs_status |= ((uint16_t)(incoming_data[end++]) & 0xFF);
-
-  uint32_t tmp_sensor = 0;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor |= (uint32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].o2_sensor = (double)tmp_sensor / (1 << 16);
-
-  int32_t tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].mass_flow = (double)tmp_sensor_1 / (1 << 16);
-
-  tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].co2_sensor = (double)tmp_sensor_1 / (1 << 16);
-
-  tmp_sensor = 0;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor |= (uint32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].tank_pressure = (double)tmp_sensor / (1 << 16);
-
-  tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].proportional_valve_pressure = (double)tmp_sensor_1 / (1 << 16);
-
-  tmp_sensor_1 = 0;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor_1 |= ((int32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor_1 |= (int32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].temperature = (double)tmp_sensor_1 / (1 << 16);
-
-  tmp_sensor = 0;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  tmp_sensor |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  tmp_sensor |= (uint32_t)(incoming_data[end++]) & 0xFF;
-  skid_status[skid_circular_buffer_index].humidity = (double)tmp_sensor / (1 << 16);
-
-  skid_status[skid_circular_buffer_index].errors = 0;
-  skid_status[skid_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 24) & 0xFF000000;
-  skid_status[skid_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 16) & 0xFF0000;
-  skid_status[skid_circular_buffer_index].errors |= ((uint32_t)(incoming_data[end++]) << 8) & 0xFF00;
-  skid_status[skid_circular_buffer_index].errors |= (uint32_t)(incoming_data[end++]) & 0xFF;
-
-  // Update the circular index for next turn once current index is filled
-  skid_circular_buffer_index++;
-  if(skid_circular_buffer_index >= NUMBER_OF_SAMPLES){
-    skid_circular_buffer_index = 0;
-  }
+  frame_layout_decode(&skid_status_layout, incoming_data, &skid_status);
+  skid_state = skid_status.skid_state;
 
-  xSemaphoreGive(skid_status_rw_mutex);
-}
-
-uint8_t get_latest_index(bool skid){
-  uint8_t index = unit_circular_buffer_index;
-  if (skid){
-    index = skid_circular_buffer_index;
-  }
+  add_sensor_sample(SKID_O2, 0, skid_status.o2_sensor);
+  add_sensor_sample(SKID_MASS_FLOW, 0, skid_status.mass_flow);
+  add_sensor_sample(SKID_CO2, 0, skid_status.co2_sensor);
+  add_sensor_sample(TANK_PRESSURE, 0, skid_status.tank_pressure);
+  add_sensor_sample(SKID_PROPOTIONAL_VALVE_SENSOR, 0, skid_status.proportional_valve_pressure);
+  add_sensor_sample(SKID_TEMPERATURE, 0, skid_status.temperature);
+  add_sensor_sample(SKID_HUMIDITY, 0, skid_status.humidity);
 
-  if(index != 0){
-    // We do one back as the indexes are always jumped to next after updating
-    index--;
-  }
-  else{
-    index = NUMBER_OF_SAMPLES - 1;
-  }
-
-  return index;
-}
+  // Move to the next slot for next turn once current one is filled
+  sample_store_advance(&skid_samples);
 
-double get_sensor_value(uint8_t sample_index, sensor_name_t name, uint8_t heater_index){
-  double sensor_value = 0.0;
-  switch(name){
-    // Skid sensors
-    case SKID_O2:
-      sensor_value = skid_status[sample_index].o2_sensor;
-    break;
-    case SKID_MASS_FLOW:
-      sensor_value = skid_status[sample_index].mass_flow;
-    break;
-    case SKID_CO2:
-      sensor_value = skid_status[sample_index].co2_sensor;
-    break;
-    case SKID_PROPOTIONAL_VALVE_SENSOR:
-      sensor_value = skid_status[sample_index].proportional_valve_pressure;
-    break;
-    case SKID_TEMPERATURE:
-      sensor_value = skid_status[sample_index].temperature;
-    break;
-    case SKID_HUMIDITY:
-      sensor_value = skid_status[sample_index].humidity;
-    break;
-    // Unit sensors
-    case UNIT_VACUUM_SENSOR:
-      sensor_value = unit_status[sample_index].vacuum_sensor;
-    break;
-    case UNIT_AMBIENT_HUMIDITY:
-      sensor_value = unit_status[sample_index].ambient_humidity;
-    break;
-    case UNIT_AMBIENT_TEMPERATURE:
-      sensor_value = unit_status[sample_index].ambient_temperature;
-    break;
-    case UNIT_HEATER:
-      sensor_value = unit_status[sample_index].heater_temperatures[heater_index];
-    break;
-    case TANK_PRESSURE:
-      sensor_value = skid_status[sample_index].tank_pressure;
-    break;
-    default:
-      break;
-  }
+  xSemaphoreGive(skid_status_rw_mutex);
 
-  return sensor_value;
+  state_alarm_update(&state_alarm, STATE_ALARM_SKID, skid_state, xTaskGetTickCount());
 }
 
-// Predicate for qsort used to get to media
-int compare_for_sort(const void *a, const void *b) {
-    return (*(double *)a - *(double *)b);
+static bool is_skid_sensor(sensor_name_t name){
+  return (name <= SKID_HUMIDITY) || (name == TANK_PRESSURE);
 }
 
-double get_median(double sensor_samples[]){
-  qsort(sensor_samples, NUMBER_OF_SAMPLES, sizeof(double), compare_for_sort);
-
-  if (NUMBER_OF_SAMPLES % 2 == 0) {
-      // If the number of elements is even
-      return (sensor_samples[NUMBER_OF_SAMPLES / 2 - 1] + sensor_samples[NUMBER_OF_SAMPLES / 2]) / 2.0;
-  } else {
-      // If the number of elements is odd
-      return skid_status[NUMBER_OF_SAMPLES / 2].o2_sensor;
+static running_stats_t* get_sensor_stats(sensor_name_t name, uint8_t heater_index){
+  if(is_skid_sensor(name)){
+    return &skid_stats[sensor_channels[name]];
   }
-}
 
-void update_sensor_total(sensor_name_t name, double sensor_value, double* total, uint8_t* number_of_valid_samples)
-{
-    if( (name == SKID_O2 && (sensor_value < 0 || sensor_value > 100)) ||
-        (name == SKID_MASS_FLOW && (sensor_value > 60)) ||
-        (name == SKID_CO2 && (sensor_value < 0 || sensor_value > 1)) ||
-        (name == SKID_PROPOTIONAL_VALVE_SENSOR && (sensor_value < 0 || sensor_value > 3)) ||
-        (name == SKID_TEMPERATURE && (sensor_value < -20 || sensor_value > 120)) ||
-        (name == SKID_HUMIDITY && (sensor_value < 0 || sensor_value > 100)) ||
-        (name == UNIT_VACUUM_SENSOR && (sensor_value < 0 || sensor_value > 1.2)) ||
-        (name == UNIT_AMBIENT_HUMIDITY && (sensor_value < 0 || sensor_value > 100)) ||
-        (name == UNIT_AMBIENT_TEMPERATURE && (sensor_value < -20 || sensor_value > 120)) ||
-        (name == UNIT_HEATER && (sensor_value < 0 || sensor_value > 150)) ||
-        (name == TANK_PRESSURE && (sensor_value < 0 || sensor_value > 6)) )
-    {
-      double integer_part = 0;
-      modf(sensor_value, &integer_part);
-      configPRINTF( ( "Invalid sensor (%d) value integer-part (%d)\r\n" , name, (int32_t)integer_part) );
-    }
-    else {
-      *total += sensor_value;
-      *number_of_valid_samples += 1;
-    }
+  return &unit_stats[sensor_channels[name] + heater_index];
 }
 
-void sensor_average_max_min(sensor_name_t name, uint8_t heater_index, sensor_info_t* sensor_info){
-  double total = 0.0;
-  double sensor_samples[NUMBER_OF_SAMPLES];
-  double sensor_value = 0.0;
-  uint8_t number_of_valid_samples = 0;
-
-  sensor_samples[0] = sensor_info->stats.avg = sensor_info->stats.max
-    = sensor_info->stats.min = sensor_info->stats.median = sensor_value = get_sensor_value(0, name, heater_index);
-  update_sensor_total(name, sensor_value, &total, &number_of_valid_samples);
-
-  // uint8_t num_of_valid_samples = 0;
-
-  for(uint8_t i=1;i<NUMBER_OF_SAMPLES;++i){
-    sensor_value = sensor_samples[i] = get_sensor_value(i, name, heater_index);
-
-    // if(sensor_value != __DBL_MAX__){
-      update_sensor_total(name, sensor_value, &total, &number_of_valid_samples);
-
-      if(sensor_value > sensor_info->stats.max){
-        sensor_info->stats.max = sensor_value;
-      }
-      if(sensor_value < sensor_info->stats.min) {
-        sensor_info->stats.min = sensor_value;
-      }
-      // num_of_valid_samples++;
-    // }
-  }
-
-  // get median from the samples
-  // We are collecting the samples in a separate array to avoid updating the original
-  sensor_info->stats.median = get_median(sensor_samples);
+// Puts the sample into the frame slot being filled, the sample it replaces leaves the statistics window
+static void add_sensor_sample(sensor_name_t name, uint8_t heater_index, sensor_value_t value){
+  sample_store_t* store = is_skid_sensor(name) ? &skid_samples : &unit_samples;
 
-  // get avg
-  if(number_of_valid_samples != 0)
-  {
-    sensor_info->stats.avg = total / (double)number_of_valid_samples;
+  if(!running_stats_replace(get_sensor_stats(name, heater_index), sample_store_slot(store), value)){
+    configPRINTF( ( "Invalid sensor (%d) value integer-part (%d)\r\n" , name, SENSOR_VALUE_INTEGER_PART(value)) );
   }
 }
 
@@ -421,13 +254,12 @@ SKID_iot_status_t get_skid_status(sequence_state_t last_skid_state){
 
   xSemaphoreTake(skid_status_rw_mutex, MUTEX_MAX_BLOCKING_TIME);
   
-  // First the items from the latest index
-  uint8_t index = get_latest_index(true);
-  tmp.error_flag = (skid_status[index].skid_status & 0x01) ? FLAG_SET:FLAG_UNSET;
-  tmp.halt_flag = (skid_status[index].skid_status & 0x02) ? FLAG_SET:FLAG_UNSET;
-  tmp.reset_flag = (skid_status[index].skid_status & 0x04) ? FLAG_SET:FLAG_UNSET;
+  // First the items from the latest frame
+  tmp.error_flag = (skid_status.skid_status & 0x01) ? FLAG_SET:FLAG_UNSET;
+  tmp.halt_flag = (skid_status.skid_status & 0x02) ? FLAG_SET:FLAG_UNSET;
+  tmp.reset_flag = (skid_status.skid_status & 0x04) ? FLAG_SET:FLAG_UNSET;
   
-  tmp.skid_state = skid_status[index].skid_state;
+  tmp.skid_state = skid_status.skid_state;
 
   // Hack - Check if alert should be sent or not
   tmp.send_alert = false;
@@ -436,26 +268,26 @@ SKID_iot_status_t get_skid_status(sequence_state_t last_skid_state){
     tmp.send_alert = true;
   }
 
-  tmp.two_way_gas_valve_before_water_trap = (skid_status[index].outputs_status & 0x0001) ? ONE:ZERO;
-  tmp.two_way_gas_valve_in_water_trap = (skid_status[index].outputs_status & 0x0002) ? ONE:ZERO;
-  tmp.two_way_gas_valve_after_water_trap = (skid_status[index].outputs_status & 0x0004) ? ONE:ZERO;
-  tmp.vacuum_release_valve_in_water_trap = (skid_status[index].outputs_status & 0x0008) ? ONE:ZERO;
-  tmp.three_way_vacuum_release_valve_before_condenser = (skid_status[index].outputs_status & 0x0010) ? ONE:ZERO;
-  tmp.three_valve_after_vacuum_pump = (skid_status[index].outputs_status & 0x0020) ? ONE:ZERO;
-  tmp.compressor = (skid_status[index].outputs_status & 0x0040) ? ONE:ZERO;
-  tmp.vacuum_pump = (skid_status[index].outputs_status & 0x0080) ? ONE:ZERO;
-  tmp.condenser = (skid_status[index].outputs_status & 0x0100) ? ONE:ZERO;
-
-  // The transformed ones (Avg, Max, Min and Median)
-  sensor_average_max_min(SKID_O2, 0, &tmp.o2_sensor);
-  sensor_average_max_min(SKID_MASS_FLOW, 0, &tmp.mass_flow);
-  sensor_average_max_min(SKID_CO2, 0, &tmp.co2_sensor);
-  sensor_average_max_min(TANK_PRESSURE, 0, &tmp.tank_pressure);
-  sensor_average_max_min(SKID_PROPOTIONAL_VALVE_SENSOR, 0, &tmp.proportional_valve_pressure);
-  sensor_average_max_min(SKID_TEMPERATURE, 0, &tmp.temperature);
-  sensor_average_max_min(SKID_HUMIDITY, 0, &tmp.humidity);
-
-  tmp.errors = skid_status[index].errors;
+  tmp.two_way_gas_valve_before_water_trap = (skid_status.outputs_status & 0x0001) ? ONE:ZERO;
+  tmp.two_way_gas_valve_in_water_trap = (skid_status.outputs_status & 0x0002) ? ONE:ZERO;
+  tmp.two_way_gas_valve_after_water_trap = (skid_status.outputs_status & 0x0004) ? ONE:ZERO;
+  tmp.vacuum_release_valve_in_water_trap = (skid_status.outputs_status & 0x0008) ? ONE:ZERO;
+  tmp.three_way_vacuum_release_valve_before_condenser = (skid_status.outputs_status & 0x0010) ? ONE:ZERO;
+  tmp.three_valve_after_vacuum_pump = (skid_status.outputs_status & 0x0020) ? ONE:ZERO;
+  tmp.compressor = (skid_status.outputs_status & 0x0040) ? ONE:ZERO;
+  tmp.vacuum_pump = (skid_status.outputs_status & 0x0080) ? ONE:ZERO;
+  tmp.condenser = (skid_status.outputs_status & 0x0100) ? ONE:ZERO;
+
+  // The transformed ones (Avg, Max, Min and Median), already up to date
+  running_stats_get(get_sensor_stats(SKID_O2, 0), &tmp.o2_sensor.stats);
+  running_stats_get(get_sensor_stats(SKID_MASS_FLOW, 0), &tmp.mass_flow.stats);
+  running_stats_get(get_sensor_stats(SKID_CO2, 0), &tmp.co2_sensor.stats);
+  running_stats_get(get_sensor_stats(TANK_PRESSURE, 0), &tmp.tank_pressure.stats);
+  running_stats_get(get_sensor_stats(SKID_PROPOTIONAL_VALVE_SENSOR, 0), &tmp.proportional_valve_pressure.stats);
+  running_stats_get(get_sensor_stats(SKID_TEMPERATURE, 0), &tmp.temperature.stats);
+  running_stats_get(get_sensor_stats(SKID_HUMIDITY, 0), &tmp.humidity.stats);
+
+  tmp.errors = skid_status.errors;
 
   xSemaphoreGive(skid_status_rw_mutex);
 
@@ -467,15 +299,14 @@ UNIT_iot_status_t get_unit_status(sequence_state_t last_unit_state){
 
   xSemaphoreTake(unit_status_rw_mutex, MUTEX_MAX_BLOCKING_TIME);
   
-  // First the items from the latest index
-  uint8_t index = get_latest_index(false);
-  tmp.error_flag = (unit_status[index].unit_status & 0x01) ? FLAG_SET:FLAG_UNSET;
-  tmp.halt_flag = (unit_status[index].unit_status & 0x02) ? FLAG_SET:FLAG_UNSET;
-  tmp.reset_flag = (unit_status[index].unit_status & 0x04) ? FLAG_SET:FLAG_UNSET;
-  tmp.just_started_flag = (unit_status[index].unit_status & 0x08) ? FLAG_SET:FLAG_UNSET;
-  tmp.setup_state_synching_flag = (unit_status[index].unit_status & 0x10) ? FLAG_SET:FLAG_UNSET;
+  // First the items from the latest frame
+  tmp.error_flag = (unit_status.unit_status & 0x01) ? FLAG_SET:FLAG_UNSET;
+  tmp.halt_flag = (unit_status.unit_status & 0x02) ? FLAG_SET:FLAG_UNSET;
+  tmp.reset_flag = (unit_status.unit_status & 0x04) ? FLAG_SET:FLAG_UNSET;
+  tmp.just_started_flag = (unit_status.unit_status & 0x08) ? FLAG_SET:FLAG_UNSET;
+  tmp.setup_state_synching_flag = (unit_status.unit_status & 0x10) ? FLAG_SET:FLAG_UNSET;
 
-  tmp.unit_state = unit_status[index].unit_state;
+  tmp.unit_state = unit_status.unit_state;
 
   // Hack - Check if alert should be sent or not
   tmp.send_alert = false;
@@ -485,45 +316,56 @@ UNIT_iot_status_t get_unit_status(sequence_state_t last_unit_state){
   }
 
   for(uint8_t i=0;i<NUMBER_OF_HEATERS;++i){
-    tmp.heater_info[i].status = (unit_status[index].heater_status & (1 << i)) ? ONE:ZERO;
+    tmp.heater_info[i].status = (unit_status.heater_status & (1 << i)) ? ONE:ZERO;
 
     // The transformed ones (Avg, Max and Min)
-    sensor_average_max_min(UNIT_HEATER, i, &tmp.heater_info[i]);
+    running_stats_get(get_sensor_stats(UNIT_HEATER, i), &tmp.heater_info[i].stats);
   }
 
-  tmp.fan_status = (unit_status[index].valve_status & 0x01) ? ONE:ZERO;
-  tmp.butterfly_valve_1_status = (unit_status[index].valve_status & 0x02) ? ONE:ZERO;
-  tmp.butterfly_valve_2_status = (unit_status[index].valve_status & 0x04) ? ONE:ZERO;
+  tmp.fan_status = (unit_status.valve_status & 0x01) ? ONE:ZERO;
+  tmp.butterfly_valve_1_status = (unit_status.valve_status & 0x02) ? ONE:ZERO;
+  tmp.butterfly_valve_2_status = (unit_status.valve_status & 0x04) ? ONE:ZERO;
 
-  // The transformed ones (Avg, Max, Min and Median)
-  sensor_average_max_min(UNIT_VACUUM_SENSOR, 0, &tmp.vacuum_sensor);
-  sensor_average_max_min(UNIT_AMBIENT_HUMIDITY, 0, &tmp.ambient_humidity);
-  sensor_average_max_min(UNIT_AMBIENT_TEMPERATURE, 0, &tmp.ambient_temperature);
+  // The transformed ones (Avg, Max, Min and Median), already up to date
+  running_stats_get(get_sensor_stats(UNIT_VACUUM_SENSOR, 0), &tmp.vacuum_sensor.stats);
+  running_stats_get(get_sensor_stats(UNIT_AMBIENT_HUMIDITY, 0), &tmp.ambient_humidity.stats);
+  running_stats_get(get_sensor_stats(UNIT_AMBIENT_TEMPERATURE, 0), &tmp.ambient_temperature.stats);
 
-  tmp.errors = unit_status[index].errors;
+  tmp.errors = unit_status.errors;
 
   xSemaphoreGive(unit_status_rw_mutex);
 
   return tmp;
 }
 
-uint8_t CalcCrc(uint8_t data[], uint8_t nbrOfBytes)
-{
-  uint8_t bit;        // bit mask
-  uint8_t crc = 0xFF; // calculated checksum
-  uint8_t byteCtr;    // byte counter
-  
-  // calculates 8-Bit checksum with given polynomial
-  for(byteCtr = 0; byteCtr < nbrOfBytes; byteCtr++) {
-    crc ^= data[byteCtr];
-    for(bit = 8; bit > 0; --bit) {
-      if(crc & 0x80) {
-        crc = (crc << 1) ^ CRC_POLYNOMIAL;
-      } else {
-        crc = (crc << 1);
-      }
-    }
+// Counters are only written by the uart task, 32-bit reads of them are atomic
+controller_link_stats_t get_controller_link_stats(void){
+  controller_link_stats_t stats;
+  TickType_t now = xTaskGetTickCount();
+  TickType_t elapsed = now - link_stats_last_ticks;
+
+  stats.parser = parser.counters;
+  stats.ring_overflow_bytes = gui_comm_rx_dropped_bytes();
+  stats.frames_per_second = 0;
+
+  if(elapsed > 0){
+    stats.frames_per_second = ((stats.parser.frames - link_stats_last_frames) * configTICK_RATE_HZ + elapsed / 2) / elapsed;
   }
-  
-  return crc;
-}
\ No newline at end of file
+
+  link_stats_last_frames = stats.parser.frames;
+  link_stats_last_ticks = now;
+
+  return stats;
+}
+
+void set_state_alarm_notify(state_alarm_notify_t notify, void* context){
+  state_alarm_set_notify(&state_alarm, notify, context);
+}
+
+uint32_t take_state_alarms(void){
+  return state_alarm_take(&state_alarm);
+}
+
+state_alarm_event_t get_state_alarm_event(state_alarm_source_t source){
+  return state_alarm_last_event(&state_alarm, source);
+}
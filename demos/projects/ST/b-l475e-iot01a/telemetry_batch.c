@@ -0,0 +1,82 @@
+//========================================================================================================== INCLUDES
+#include "telemetry_batch.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void telemetry_batch_init(telemetry_batch_t* batch, uint32_t size, uint32_t flush_timeout, uint32_t ticks_per_second){
+  batch->size = size;
+  batch->flush_timeout = flush_timeout;
+  batch->ticks_per_second = ticks_per_second;
+  batch->start_tick = 0;
+  batch->flush_requested = false;
+}
+
+bool telemetry_batch_set_size(telemetry_batch_t* batch, int32_t size){
+  if(size < 1 || size > TELEMETRY_BATCH_MAX_SIZE){
+    return false;
+  }
+
+  batch->size = (uint32_t)size;
+
+  return true;
+}
+
+bool telemetry_batch_set_flush_timeout(telemetry_batch_t* batch, int32_t flush_timeout){
+  if(flush_timeout < 0 || flush_timeout > TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT){
+    return false;
+  }
+
+  batch->flush_timeout = (uint32_t)flush_timeout;
+
+  return true;
+}
+
+void telemetry_batch_queued(telemetry_batch_t* batch, uint32_t waiting, uint32_t tick, bool flush){
+  // The first message of a batch starts its timeout
+  if(waiting == 0){
+    batch->start_tick = tick;
+  }
+
+  if(flush){
+    batch->flush_requested = true;
+  }
+}
+
+bool telemetry_batch_due(const telemetry_batch_t* batch, uint32_t waiting, uint32_t tick){
+  return (waiting >= batch->size) || batch->flush_requested ||
+         ((waiting != 0) && (telemetry_batch_age(batch, tick) >= batch->flush_timeout * batch->ticks_per_second));
+}
+
+uint32_t telemetry_batch_age(const telemetry_batch_t* batch, uint32_t tick){
+  return tick - batch->start_tick;
+}
+
+void telemetry_batch_sent(telemetry_batch_t* batch, uint32_t waiting){
+  // A flush lasts until everything queued before it left
+  if(waiting == 0){
+    batch->flush_requested = false;
+  }
+}
+
+uint32_t telemetry_batch_acknowledged(uint32_t records, uint32_t dropped){
+  return (dropped < records) ? (records - dropped) : 0;
+}
+
+void telemetry_latency_add(telemetry_latency_t* latency, uint32_t ticks){
+  latency->last = ticks;
+  latency->total += ticks;
+  latency->count++;
+
+  if(ticks > latency->max){
+    latency->max = ticks;
+  }
+}
+
+uint32_t telemetry_latency_average(const telemetry_latency_t* latency){
+  return (latency->count != 0) ? (latency->total / latency->count) : 0;
+}
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_BATCH_H_
+#define TELEMETRY_BATCH_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define TELEMETRY_BATCH_MAX_SIZE 16                       // Most windows put in one message
+#define TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT (24 * 60 * 60)  // Seconds, the tick count would wrap long before the int32 does
+
+// When the windows waiting in the telemetry queue are sent. Each window is queued as its own
+// message, they go out together once size of them wait, the oldest one waited flush_timeout
+// seconds, or a message that does not wait for the batch, like an error, was queued.
+// Ticks are those of the caller's clock, wrapping around is fine.
+typedef struct{
+  uint32_t size;              // Windows per message, 1 to TELEMETRY_BATCH_MAX_SIZE
+  uint32_t flush_timeout;     // Seconds, 0 to TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT
+  uint32_t ticks_per_second;
+  uint32_t start_tick;        // When the oldest waiting message was queued
+  bool flush_requested;
+}telemetry_batch_t;
+
+// Latency of one stage a message goes through, in ticks
+typedef struct{
+  uint32_t last;
+  uint32_t max;
+  uint32_t total;
+  uint32_t count;
+}telemetry_latency_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void telemetry_batch_init(telemetry_batch_t* batch, uint32_t size, uint32_t flush_timeout, uint32_t ticks_per_second);
+
+// Settings from the writable properties, false and the setting kept when out of range
+bool telemetry_batch_set_size(telemetry_batch_t* batch, int32_t size);
+bool telemetry_batch_set_flush_timeout(telemetry_batch_t* batch, int32_t flush_timeout);
+
+// A message was queued behind waiting others, flush when it does not wait for the batch
+void telemetry_batch_queued(telemetry_batch_t* batch, uint32_t waiting, uint32_t tick, bool flush);
+
+bool telemetry_batch_due(const telemetry_batch_t* batch, uint32_t waiting, uint32_t tick);
+
+// Ticks the oldest waiting message has been queued
+uint32_t telemetry_batch_age(const telemetry_batch_t* batch, uint32_t tick);
+
+// A send ended with waiting messages left in the queue
+void telemetry_batch_sent(telemetry_batch_t* batch, uint32_t waiting);
+
+// Records of an acknowledged batch still to take out of the queue. The queue is not locked
+// during the send, when it was full meanwhile it dropped its oldest records, dropped of them,
+// and those came out of the batch first.
+uint32_t telemetry_batch_acknowledged(uint32_t records, uint32_t dropped);
+
+void telemetry_latency_add(telemetry_latency_t* latency, uint32_t ticks);
+
+// 0 before the first one
+uint32_t telemetry_latency_average(const telemetry_latency_t* latency);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_BATCH_H_ */
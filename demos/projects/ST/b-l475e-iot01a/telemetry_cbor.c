@@ -0,0 +1,486 @@
+//========================================================================================================== INCLUDES
+#include "telemetry_cbor.h"
+#include "sensor_value.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Major types and simple values of RFC 8949
+#define CBOR_MAJOR_UNSIGNED 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_NULL 0xF6
+#define CBOR_HEAD_MAX_LENGTH 9
+
+#define DATA(member) offsetof(telemetry_data_t, member)
+#define DATA_SIZE(member) sizeof(((telemetry_data_t*)0)->member)
+#define SENSOR(member) offsetof(sensor_info_t, member)
+#define SENSOR_SIZE(member) sizeof(((sensor_info_t*)0)->member)
+#define TABLE_LENGTH(table) (sizeof(table) / sizeof(table[0]))
+
+typedef enum{
+  CBOR_ARRAY,         // Array head for count items
+  CBOR_UINT,          // Constant unsigned number, value
+  CBOR_TEXT,          // Constant text string
+  CBOR_STRING,        // Zero terminated char array of length bytes
+  CBOR_ENUM,          // Enum field, the value has to be below count
+  CBOR_VALUE,         // sensor_value_t in TELEMETRY_CBOR_DECIMALS
+  CBOR_SCHEMA,        // Sub-schema on the field
+  CBOR_REPEAT,        // Array of count sub-schema elements, length bytes apart
+  CBOR_ELEMENT_IF     // Sub-schema when the enum field equals value, null otherwise
+}cbor_op_type_t;
+
+typedef struct{
+  uint8_t type;       // cbor_op_type_t
+  uint8_t size;       // ENUM, ELEMENT_IF: size of the enum field
+  uint8_t count;      // ARRAY: items, ENUM: values, REPEAT: elements
+  uint8_t value;      // UINT: the number, ELEMENT_IF: enum value the element is written for
+  uint16_t offset;    // Field offset from the current base
+  uint16_t length;    // TEXT: text length, STRING: field size, REPEAT: bytes between elements
+  const void* data;   // TEXT: the text, SCHEMA, REPEAT and ELEMENT_IF: the sub-schema
+}cbor_op_t;
+
+struct telemetry_cbor_schema{
+  const cbor_op_t* ops;
+  uint16_t op_count;
+};
+
+#define ARRAY(items) {CBOR_ARRAY, 0, items, 0, 0, 0, NULL}
+#define UINT(number) {CBOR_UINT, 0, 0, number, 0, 0, NULL}
+#define TEXT(literal) {CBOR_TEXT, 0, 0, 0, 0, sizeof(literal) - 1, literal}
+#define STRING(offset, size) {CBOR_STRING, 0, 0, 0, offset, size, NULL}
+#define ENUM(table, offset, size) {CBOR_ENUM, size, TABLE_LENGTH(table), 0, offset, 0, NULL}
+#define VALUE(offset) {CBOR_VALUE, 0, 0, 0, offset, 0, NULL}
+#define SUB_SCHEMA(schema, offset) {CBOR_SCHEMA, 0, 0, 0, offset, 0, &schema}
+#define REPEAT(schema, offset, count, stride) {CBOR_REPEAT, 0, count, 0, offset, stride, &schema}
+#define ELEMENT_IF(schema, offset, size, value) {CBOR_ELEMENT_IF, size, 0, value, offset, 0, &schema}
+#define SCHEMA(ops) {ops, TABLE_LENGTH(ops)}
+
+#define DATA_ENUM(table, member) ENUM(table, DATA(member), DATA_SIZE(member))
+#define DATA_STRING(member) STRING(DATA(member), DATA_SIZE(member))
+#define DATA_VALUE(member) VALUE(DATA(member))
+#define DATA_SENSOR(member) SUB_SCHEMA(sensor_schema, DATA(member))
+
+typedef struct{
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t length;
+}cbor_output_t;
+
+typedef struct{
+  const uint8_t* buffer;
+  uint32_t length;
+  uint32_t position;
+}cbor_input_t;
+
+//========================================================================================================== VARIABLES
+// Sensor, the base is a sensor_info_t
+static const cbor_op_t sensor_ops[] = {
+  ARRAY(5),
+  ENUM(telemetry_sensor_status_texts, SENSOR(status), SENSOR_SIZE(status)),
+  VALUE(SENSOR(stats.avg)),
+  VALUE(SENSOR(stats.max)),
+  VALUE(SENSOR(stats.min)),
+  VALUE(SENSOR(stats.median))
+};
+static const telemetry_cbor_schema_t sensor_schema = SCHEMA(sensor_ops);
+
+// Heater zone, the base is the heater's sensor_info_t
+static const cbor_op_t zone_ops[] = {
+  ARRAY(5),
+  ENUM(telemetry_component_status_texts, SENSOR(status), SENSOR_SIZE(status)),
+  VALUE(SENSOR(stats.avg)),
+  VALUE(SENSOR(stats.max)),
+  VALUE(SENSOR(stats.avg)),         // @todo min is the average, as in the JSON
+  VALUE(SENSOR(stats.median))
+};
+static const telemetry_cbor_schema_t zone_schema = SCHEMA(zone_ops);
+
+// Cartridge, the base is the sensor_info_t of its first heater
+static const cbor_op_t cartridge_ops[] = {
+  REPEAT(zone_schema, 0, NUMBER_OF_ZONES_PER_CARTRIDGE, sizeof(sensor_info_t))
+};
+static const telemetry_cbor_schema_t cartridge_schema = SCHEMA(cartridge_ops);
+
+#define CARTRIDGES_OPS \
+  REPEAT(cartridge_schema, DATA(unit.heater_info), NUMBER_OF_CARTRIDGES, NUMBER_OF_ZONES_PER_CARTRIDGE * sizeof(sensor_info_t))
+
+#define SKID_SENSORS_OPS \
+  DATA_SENSOR(skid.o2_sensor), \
+  DATA_SENSOR(skid.mass_flow), \
+  DATA_SENSOR(skid.co2_sensor), \
+  DATA_SENSOR(skid.proportional_valve_pressure), \
+  DATA_SENSOR(skid.temperature), \
+  DATA_SENSOR(skid.humidity)
+
+// @todo ambient temperature status and median are read from the humidity sensor, as in the JSON
+#define UNIT_SENSORS_OPS \
+  DATA_SENSOR(unit.vacuum_sensor), \
+  DATA_SENSOR(unit.ambient_humidity), \
+  ARRAY(5), \
+  DATA_ENUM(telemetry_sensor_status_texts, unit.ambient_humidity.status), \
+  DATA_VALUE(unit.ambient_temperature.stats.avg), \
+  DATA_VALUE(unit.ambient_temperature.stats.max), \
+  DATA_VALUE(unit.ambient_temperature.stats.min), \
+  DATA_VALUE(unit.ambient_humidity.stats.median)
+
+static const cbor_op_t telemetry_message_ops[] = {
+  ARRAY(7),
+  UINT(TELEMETRY_CBOR_TELEMETRY),
+  TEXT(telemetry_MESSAGE_VERSION),
+  UINT(telemetry_MEASUREMENT_COUNT),
+  DATA_STRING(timestamp_utc),
+  // ccu
+  ARRAY(5),
+  DATA_STRING(ccu_serial_number),
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  ARRAY(6),
+  SKID_SENSORS_OPS,
+  ARRAY(3),
+  DATA_ENUM(telemetry_flag_state_texts, skid.error_flag),
+  DATA_ENUM(telemetry_flag_state_texts, skid.halt_flag),
+  DATA_ENUM(telemetry_flag_state_texts, skid.reset_flag),
+  ARRAY(9),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_before_water_trap),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_in_water_trap),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_after_water_trap),
+  DATA_ENUM(telemetry_valve_status_texts, skid.vacuum_release_valve_in_water_trap),
+  DATA_ENUM(telemetry_three_way_valve_texts, skid.three_way_vacuum_release_valve_before_condenser),
+  DATA_ENUM(telemetry_three_way_valve_texts, skid.three_valve_after_vacuum_pump),
+  DATA_ENUM(telemetry_component_status_texts, skid.compressor),
+  DATA_ENUM(telemetry_component_status_texts, skid.vacuum_pump),
+  DATA_ENUM(telemetry_component_status_texts, skid.condenser),
+  // units, a single one for now
+  ARRAY(1),
+  ARRAY(6),
+  TEXT(telemetry_UNIT_SERIAL_NUMBER),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  CARTRIDGES_OPS,
+  ARRAY(5),
+  DATA_ENUM(telemetry_flag_state_texts, unit.error_flag),
+  DATA_ENUM(telemetry_flag_state_texts, unit.halt_flag),
+  DATA_ENUM(telemetry_flag_state_texts, unit.reset_flag),
+  DATA_ENUM(telemetry_flag_state_texts, unit.just_started_flag),
+  DATA_ENUM(telemetry_flag_state_texts, unit.setup_state_synching_flag),
+  ARRAY(3),
+  DATA_ENUM(telemetry_component_status_texts, unit.fan_status),
+  DATA_ENUM(telemetry_valve_status_texts, unit.butterfly_valve_1_status),
+  DATA_ENUM(telemetry_valve_status_texts, unit.butterfly_valve_2_status),
+  ARRAY(3),
+  UNIT_SENSORS_OPS,
+  // tank
+  ARRAY(2),
+  TEXT(telemetry_TANK_SERIAL_NUMBER),
+  ARRAY(1),
+  DATA_SENSOR(skid.tank_pressure)
+};
+
+// Errors array entries, on the same base as the message: [timestamp_utc, error_code, current_state, previous_state, sensors, ...]
+static const cbor_op_t skid_error_ops[] = {
+  ARRAY(5),
+  DATA_STRING(timestamp_utc),
+  DATA_STRING(skid_error_code),
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  // @todo need to implement current and previous states
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  ARRAY(7),
+  SKID_SENSORS_OPS,
+  DATA_SENSOR(skid.tank_pressure)
+};
+static const telemetry_cbor_schema_t skid_error_schema = SCHEMA(skid_error_ops);
+
+static const cbor_op_t unit_error_ops[] = {
+  ARRAY(6),
+  DATA_STRING(timestamp_utc),
+  DATA_STRING(unit_error_code),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  ARRAY(3),
+  UNIT_SENSORS_OPS,
+  CARTRIDGES_OPS
+};
+static const telemetry_cbor_schema_t unit_error_schema = SCHEMA(unit_error_ops);
+
+static const cbor_op_t error_message_ops[] = {
+  ARRAY(4),
+  UINT(TELEMETRY_CBOR_ERROR),
+  TEXT(error_MESSAGE_VERSION),
+  DATA_STRING(timestamp_utc),
+  ARRAY(2),
+  ELEMENT_IF(skid_error_schema, DATA(skid.skid_state), DATA_SIZE(skid.skid_state), Lock_State),
+  ELEMENT_IF(unit_error_schema, DATA(unit.unit_state), DATA_SIZE(unit.unit_state), Lock_State)
+};
+
+static const cbor_op_t bootup_message_ops[] = {
+  ARRAY(5),
+  UINT(TELEMETRY_CBOR_BOOTUP),
+  TEXT(bootup_MESSAGE_VERSION),
+  TEXT(azure_sdk_version),
+  DATA_STRING(timestamp_utc),
+  ARRAY(2),
+  ARRAY(2),
+  TEXT(ccu_IDENTIFIER),
+  TEXT(ccu_FIRMWARE_VERSION),
+  ARRAY(2),
+  TEXT(unit1_IDENTIFIER),
+  TEXT(unit1_FIRMWARE_VERSION)
+};
+
+const telemetry_cbor_schema_t telemetry_message_cbor = SCHEMA(telemetry_message_ops);
+const telemetry_cbor_schema_t error_message_cbor = SCHEMA(error_message_ops);
+const telemetry_cbor_schema_t bootup_message_cbor = SCHEMA(bootup_message_ops);
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static bool write_schema(const telemetry_cbor_schema_t* schema, const uint8_t* base, cbor_output_t* output);
+static bool write_head(cbor_output_t* output, uint8_t major, uint64_t value);
+static bool write_bytes(cbor_output_t* output, const void* bytes, uint32_t length);
+static bool read_schema(const telemetry_cbor_schema_t* schema, uint8_t* base, cbor_input_t* input);
+static bool read_head(cbor_input_t* input, uint8_t* major, uint64_t* value);
+static bool read_expected(cbor_input_t* input, uint8_t major, uint64_t value);
+static uint32_t read_enum(const uint8_t* field, uint8_t size);
+static void store_enum(uint8_t* field, uint8_t size, uint32_t value);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+uint32_t telemetry_cbor_write(const telemetry_cbor_schema_t* schema, const telemetry_data_t* data, uint8_t* buffer, uint32_t buffer_size){
+  cbor_output_t output = {buffer, buffer_size, 0};
+
+  if(!write_schema(schema, (const uint8_t*)data, &output)){
+    return 0;
+  }
+
+  return output.length;
+}
+
+bool telemetry_cbor_read(const telemetry_cbor_schema_t* schema, const uint8_t* buffer, uint32_t length, telemetry_data_t* data){
+  cbor_input_t input = {buffer, length, 0};
+
+  return read_schema(schema, (uint8_t*)data, &input) && (input.position == length);
+}
+
+static bool write_schema(const telemetry_cbor_schema_t* schema, const uint8_t* base, cbor_output_t* output){
+  for(uint16_t o = 0; o < schema->op_count; o++){
+    const cbor_op_t* op = &schema->ops[o];
+    const uint8_t* field = base + op->offset;
+    bool written = false;
+
+    switch(op->type){
+      case CBOR_ARRAY:
+        written = write_head(output, CBOR_MAJOR_ARRAY, op->count);
+        break;
+      case CBOR_UINT:
+        written = write_head(output, CBOR_MAJOR_UNSIGNED, op->value);
+        break;
+      case CBOR_TEXT:
+        written = write_head(output, CBOR_MAJOR_TEXT, op->length) && write_bytes(output, op->data, op->length);
+        break;
+      case CBOR_STRING:{
+        uint32_t length = strlen((const char*)field);
+        written = write_head(output, CBOR_MAJOR_TEXT, length) && write_bytes(output, field, length);
+        break;
+      }
+      case CBOR_ENUM:{
+        uint32_t value = read_enum(field, op->size);
+        written = (value < op->count) && write_head(output, CBOR_MAJOR_UNSIGNED, value);
+        break;
+      }
+      case CBOR_VALUE:{
+        int64_t scaled = sensor_value_to_scaled(*(const sensor_value_t*)field, TELEMETRY_CBOR_DECIMALS);
+        written = (scaled < 0) ? write_head(output, CBOR_MAJOR_NEGATIVE, (uint64_t)(-1 - scaled))
+                               : write_head(output, CBOR_MAJOR_UNSIGNED, (uint64_t)scaled);
+        break;
+      }
+      case CBOR_SCHEMA:
+        written = write_schema((const telemetry_cbor_schema_t*)op->data, field, output);
+        break;
+      case CBOR_REPEAT:
+        written = write_head(output, CBOR_MAJOR_ARRAY, op->count);
+        for(uint8_t i = 0; written && (i < op->count); i++){
+          written = write_schema((const telemetry_cbor_schema_t*)op->data, field + i * op->length, output);
+        }
+        break;
+      case CBOR_ELEMENT_IF:{
+        static const uint8_t null = CBOR_NULL;
+        written = (read_enum(field, op->size) == op->value) ? write_schema((const telemetry_cbor_schema_t*)op->data, base, output)
+                                                            : write_bytes(output, &null, 1);
+        break;
+      }
+      default:
+        break;
+    }
+
+    if(!written){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Shortest head for the value, as the deterministic encoding of RFC 8949 asks for
+static bool write_head(cbor_output_t* output, uint8_t major, uint64_t value){
+  uint8_t head[CBOR_HEAD_MAX_LENGTH];
+  uint8_t bytes;
+
+  if(value < 24){
+    head[0] = (major << 5) | (uint8_t)value;
+    return write_bytes(output, head, 1);
+  }
+
+  bytes = (value <= UINT8_MAX) ? 1 : (value <= UINT16_MAX) ? 2 : (value <= UINT32_MAX) ? 4 : 8;
+  head[0] = (major << 5) | ((bytes == 1) ? 24 : (bytes == 2) ? 25 : (bytes == 4) ? 26 : 27);
+  for(uint8_t i = 0; i < bytes; i++){
+    head[bytes - i] = (uint8_t)(value >> (8 * i));
+  }
+
+  return write_bytes(output, head, bytes + 1);
+}
+
+static bool write_bytes(cbor_output_t* output, const void* bytes, uint32_t length){
+  if(length > output->size - output->length){
+    return false;
+  }
+
+  memcpy(output->buffer + output->length, bytes, length);
+  output->length += length;
+
+  return true;
+}
+
+static bool read_schema(const telemetry_cbor_schema_t* schema, uint8_t* base, cbor_input_t* input){
+  for(uint16_t o = 0; o < schema->op_count; o++){
+    const cbor_op_t* op = &schema->ops[o];
+    uint8_t* field = base + op->offset;
+    uint8_t major;
+    uint64_t value;
+    bool read = false;
+
+    switch(op->type){
+      case CBOR_ARRAY:
+        read = read_expected(input, CBOR_MAJOR_ARRAY, op->count);
+        break;
+      case CBOR_UINT:
+        read = read_expected(input, CBOR_MAJOR_UNSIGNED, op->value);
+        break;
+      case CBOR_TEXT:
+        read = read_expected(input, CBOR_MAJOR_TEXT, op->length) &&
+               (memcmp(input->buffer + input->position, op->data, op->length) == 0);
+        input->position += read ? op->length : 0;
+        break;
+      case CBOR_STRING:
+        read = read_head(input, &major, &value) && (major == CBOR_MAJOR_TEXT) &&
+               (value < op->length) && (value <= input->length - input->position);
+        if(read){
+          memcpy(field, input->buffer + input->position, value);
+          field[value] = '\0';
+          input->position += value;
+        }
+        break;
+      case CBOR_ENUM:
+        read = read_head(input, &major, &value) && (major == CBOR_MAJOR_UNSIGNED) && (value < op->count);
+        if(read){
+          store_enum(field, op->size, value);
+        }
+        break;
+      case CBOR_VALUE:
+        read = read_head(input, &major, &value) && ((major == CBOR_MAJOR_UNSIGNED) || (major == CBOR_MAJOR_NEGATIVE)) &&
+               (value <= INT64_MAX);
+        if(read){
+          *(sensor_value_t*)field = sensor_value_from_scaled((major == CBOR_MAJOR_NEGATIVE) ? -1 - (int64_t)value : (int64_t)value,
+                                                             TELEMETRY_CBOR_DECIMALS);
+        }
+        break;
+      case CBOR_SCHEMA:
+        read = read_schema((const telemetry_cbor_schema_t*)op->data, field, input);
+        break;
+      case CBOR_REPEAT:
+        read = read_expected(input, CBOR_MAJOR_ARRAY, op->count);
+        for(uint8_t i = 0; read && (i < op->count); i++){
+          read = read_schema((const telemetry_cbor_schema_t*)op->data, field + i * op->length, input);
+        }
+        break;
+      case CBOR_ELEMENT_IF:
+        if((input->position < input->length) && (input->buffer[input->position] == CBOR_NULL)){
+          input->position++;
+          read = true;
+        }
+        else{
+          read = read_schema((const telemetry_cbor_schema_t*)op->data, base, input);
+        }
+        break;
+      default:
+        break;
+    }
+
+    if(!read){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool read_head(cbor_input_t* input, uint8_t* major, uint64_t* value){
+  uint8_t initial;
+  uint8_t bytes;
+
+  if(input->position >= input->length){
+    return false;
+  }
+
+  initial = input->buffer[input->position++];
+  *major = initial >> 5;
+  *value = initial & 0x1F;
+
+  if(*value < 24){
+    return true;
+  }
+  if(*value > 27){
+    return false;   // Indefinite lengths and reserved values are never written
+  }
+
+  bytes = 1 << (*value - 24);
+  if(bytes > input->length - input->position){
+    return false;
+  }
+
+  *value = 0;
+  for(uint8_t i = 0; i < bytes; i++){
+    *value = (*value << 8) | input->buffer[input->position++];
+  }
+
+  return true;
+}
+
+static bool read_expected(cbor_input_t* input, uint8_t major, uint64_t value){
+  uint8_t read_major;
+  uint64_t read_value;
+
+  return read_head(input, &read_major, &read_value) && (read_major == major) && (read_value == value) &&
+         ((major != CBOR_MAJOR_TEXT) || (value <= input->length - input->position));
+}
+
+static uint32_t read_enum(const uint8_t* field, uint8_t size){
+  switch(size){
+    case sizeof(uint8_t):
+      return *field;
+    case sizeof(uint16_t):
+      return *(const uint16_t*)field;
+    default:
+      return *(const uint32_t*)field;
+  }
+}
+
+static void store_enum(uint8_t* field, uint8_t size, uint32_t value){
+  switch(size){
+    case sizeof(uint8_t):
+      *field = (uint8_t)value;
+      break;
+    case sizeof(uint16_t):
+      *(uint16_t*)field = (uint16_t)value;
+      break;
+    default:
+      *(uint32_t*)field = value;
+      break;
+  }
+}
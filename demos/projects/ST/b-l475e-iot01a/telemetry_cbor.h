@@ -0,0 +1,55 @@
+#ifndef TELEMETRY_CBOR_H_
+#define TELEMETRY_CBOR_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+#include "telemetry_schema.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// 1 - boot-up, error and telemetry messages are sent as CBOR (RFC 8949), content type application/cbor
+// 0 - they are sent as the JSON of telemetry_schema.c
+#ifndef TELEMETRY_CBOR
+#define TELEMETRY_CBOR 0
+#endif
+
+#define TELEMETRY_CBOR_DECIMALS SENSOR_VALUE_DECIMALS   // Sensor values are sent as integers in thousandths, the precision of the JSON
+
+// The messages carry the same fields as the JSON ones, in the same order, as nested arrays.
+// Keys, sensor names and what follows from the position (zone, slot, cartridge serial number)
+// are left out, enums are sent as their value in iot_status.h. The first element tells the message apart:
+// [TELEMETRY_CBOR_TELEMETRY, version, measurement_count, timestamp_utc, ccu, units, tank]
+// [TELEMETRY_CBOR_ERROR, version, timestamp_utc, [skid error or null, unit error or null]]
+// [TELEMETRY_CBOR_BOOTUP, version, azure_sdk_version, timestamp_utc, firmware_versions]
+// A sensor is [status, avg, max, min, median].
+typedef enum{
+  TELEMETRY_CBOR_TELEMETRY,
+  TELEMETRY_CBOR_ERROR,
+  TELEMETRY_CBOR_BOOTUP
+}telemetry_cbor_message_t;
+
+typedef struct telemetry_cbor_schema telemetry_cbor_schema_t;
+
+//========================================================================================================== VARIABLES
+extern const telemetry_cbor_schema_t telemetry_message_cbor;
+extern const telemetry_cbor_schema_t error_message_cbor;
+extern const telemetry_cbor_schema_t bootup_message_cbor;
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// Writes the message the schema describes into buffer. Returns the message length, 0 if it does not fit
+// or a field holds a value the schema has no name for.
+uint32_t telemetry_cbor_write(const telemetry_cbor_schema_t* schema, const telemetry_data_t* data, uint8_t* buffer, uint32_t buffer_size);
+
+// Reads a message written with the same schema back into data, for the cloud side tools and the tests.
+// Only the fields the message carries are set. Returns false if the message does not match the schema.
+bool telemetry_cbor_read(const telemetry_cbor_schema_t* schema, const uint8_t* buffer, uint32_t length, telemetry_data_t* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_CBOR_H_ */
@@ -0,0 +1,320 @@
+//========================================================================================================== INCLUDES
+#include "telemetry_delta.h"
+#include "sensor_value.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define delta_MESSAGE_VERSION "1.0"
+#define delta_MESSAGE_TYPE "telemetry_delta"
+
+#define KEY(name) "\"" name "\":"
+#define QUOTED(text) "\"" text "\""
+#define TEXT_LENGTH(literal) (sizeof(literal) - 1)
+#define TABLE_LENGTH(table) (sizeof(table) / sizeof(table[0]))
+
+#define DATA(member) offsetof(telemetry_data_t, member)
+#define DATA_SIZE(member) sizeof(((telemetry_data_t*)0)->member)
+
+// How a field is compared and written
+typedef enum{
+  DELTA_ENUM,     // Name of the enum value
+  DELTA_SENSOR,   // Sensor object as in sensor_measurements
+  DELTA_ZONE      // Heater zone object, min sent as the average like the full message does
+}delta_field_type_t;
+
+// A field of the telemetry message that is sent on its own when it changes.
+// The path names it in the "changes" object, built from the keys of the full message.
+typedef struct{
+  const char* path;           // Quoted key with the colon
+  uint8_t path_length;
+  uint8_t type;               // delta_field_type_t
+  uint8_t size;               // DELTA_ENUM: size of the enum field
+  uint8_t deadband;           // DELTA_SENSOR, DELTA_ZONE: telemetry_deadband_t
+  uint16_t offset;            // In telemetry_data_t, the enum or the sensor_info_t
+  uint16_t status_offset;     // Sensors: sensor_info_t the status and median come from
+  const telemetry_text_t* texts;
+  uint8_t text_count;
+}delta_field_t;
+
+#define ENUM_FIELD(path, member, texts) \
+  {KEY(path), TEXT_LENGTH(KEY(path)), DELTA_ENUM, DATA_SIZE(member), 0, DATA(member), 0, texts, TABLE_LENGTH(texts)}
+#define SENSOR_FIELD(path, member, status_member, deadband) \
+  {KEY(path), TEXT_LENGTH(KEY(path)), DELTA_SENSOR, 0, deadband, DATA(member), DATA(status_member), \
+   telemetry_sensor_status_texts, TABLE_LENGTH(telemetry_sensor_status_texts)}
+#define ZONE_FIELD(path, heater) \
+  {KEY(path), TEXT_LENGTH(KEY(path)), DELTA_ZONE, 0, DEADBAND_TEMPERATURE, DATA(unit.heater_info[heater]), DATA(unit.heater_info[heater]), \
+   telemetry_component_status_texts, TABLE_LENGTH(telemetry_component_status_texts)}
+
+typedef struct{
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t length;
+}delta_output_t;
+
+//========================================================================================================== VARIABLES
+static const sensor_value_t default_deadbands[DEADBAND_CLASSES] = {
+  [DEADBAND_TEMPERATURE]  = SENSOR_VALUE(0.5),
+  [DEADBAND_HUMIDITY]     = SENSOR_VALUE(1),
+  [DEADBAND_PRESSURE]     = SENSOR_VALUE(0.05),
+  [DEADBAND_O2]           = SENSOR_VALUE(0.2),
+  [DEADBAND_CO2]          = SENSOR_VALUE(0.01),
+  [DEADBAND_MASS_FLOW]    = SENSOR_VALUE(0.5)
+};
+
+// Same fields and quirks as telemetry_message_schema.
+// @todo ambient temperature status and median are read from the humidity sensor, as in the full message
+static const delta_field_t delta_fields[TELEMETRY_DELTA_FIELDS] = {
+  ENUM_FIELD("ccu.ccu_state", skid.skid_state, telemetry_sequence_state_texts),
+  SENSOR_FIELD("ccu.sensor_measurements.o2", skid.o2_sensor, skid.o2_sensor, DEADBAND_O2),
+  SENSOR_FIELD("ccu.sensor_measurements.mass_flow", skid.mass_flow, skid.mass_flow, DEADBAND_MASS_FLOW),
+  SENSOR_FIELD("ccu.sensor_measurements.co2", skid.co2_sensor, skid.co2_sensor, DEADBAND_CO2),
+  SENSOR_FIELD("ccu.sensor_measurements.propotional_valve_pressure", skid.proportional_valve_pressure,
+               skid.proportional_valve_pressure, DEADBAND_PRESSURE),
+  SENSOR_FIELD("ccu.sensor_measurements.temperature", skid.temperature, skid.temperature, DEADBAND_TEMPERATURE),
+  SENSOR_FIELD("ccu.sensor_measurements.humidity", skid.humidity, skid.humidity, DEADBAND_HUMIDITY),
+  ENUM_FIELD("ccu.ccu_status.error_flag", skid.error_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("ccu.ccu_status.halt_flag", skid.halt_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("ccu.ccu_status.reset_flag", skid.reset_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("ccu.component_status.two_way_gas_valve_before_water_trap", skid.two_way_gas_valve_before_water_trap,
+             telemetry_valve_status_texts),
+  ENUM_FIELD("ccu.component_status.two_way_gas_valve_in_water_trap", skid.two_way_gas_valve_in_water_trap,
+             telemetry_valve_status_texts),
+  ENUM_FIELD("ccu.component_status.two_way_gas_valve_after_water_trap", skid.two_way_gas_valve_after_water_trap,
+             telemetry_valve_status_texts),
+  ENUM_FIELD("ccu.component_status.vacuum_release_valve_in_water_trap", skid.vacuum_release_valve_in_water_trap,
+             telemetry_valve_status_texts),
+  ENUM_FIELD("ccu.component_status.three_way_vacuum_release_valve_before_condenser",
+             skid.three_way_vacuum_release_valve_before_condenser, telemetry_three_way_valve_texts),
+  ENUM_FIELD("ccu.component_status.three_way_valve_after_vacuum_pump", skid.three_valve_after_vacuum_pump,
+             telemetry_three_way_valve_texts),
+  ENUM_FIELD("ccu.component_status.compressor", skid.compressor, telemetry_component_status_texts),
+  ENUM_FIELD("ccu.component_status.vacuum_pump", skid.vacuum_pump, telemetry_component_status_texts),
+  ENUM_FIELD("ccu.component_status.condenser", skid.condenser, telemetry_component_status_texts),
+  ENUM_FIELD("units.1.unit_state", unit.unit_state, telemetry_sequence_state_texts),
+  ZONE_FIELD("units.1.cartridges.1.zones.1", 0),
+  ZONE_FIELD("units.1.cartridges.1.zones.2", 1),
+  ZONE_FIELD("units.1.cartridges.1.zones.3", 2),
+  ZONE_FIELD("units.1.cartridges.2.zones.1", 3),
+  ZONE_FIELD("units.1.cartridges.2.zones.2", 4),
+  ZONE_FIELD("units.1.cartridges.2.zones.3", 5),
+  ZONE_FIELD("units.1.cartridges.3.zones.1", 6),
+  ZONE_FIELD("units.1.cartridges.3.zones.2", 7),
+  ZONE_FIELD("units.1.cartridges.3.zones.3", 8),
+  ENUM_FIELD("units.1.unit_status.error_flag", unit.error_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("units.1.unit_status.halt_flag", unit.halt_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("units.1.unit_status.reset_flag", unit.reset_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("units.1.unit_status.just_started_flag", unit.just_started_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("units.1.unit_status.setup_state_synching_flag", unit.setup_state_synching_flag, telemetry_flag_state_texts),
+  ENUM_FIELD("units.1.component_status.fan_status", unit.fan_status, telemetry_component_status_texts),
+  ENUM_FIELD("units.1.component_status.butterfly_valve_1_status", unit.butterfly_valve_1_status, telemetry_valve_status_texts),
+  ENUM_FIELD("units.1.component_status.butterfly_valve_2_status", unit.butterfly_valve_2_status, telemetry_valve_status_texts),
+  SENSOR_FIELD("units.1.sensor_measurements.vacuum_sensor", unit.vacuum_sensor, unit.vacuum_sensor, DEADBAND_PRESSURE),
+  SENSOR_FIELD("units.1.sensor_measurements.ambient_humidity", unit.ambient_humidity, unit.ambient_humidity, DEADBAND_HUMIDITY),
+  SENSOR_FIELD("units.1.sensor_measurements.ambient_temperature", unit.ambient_temperature, unit.ambient_humidity,
+               DEADBAND_TEMPERATURE),
+  SENSOR_FIELD("tank.sensor_measurements.tank_pressure", skid.tank_pressure, skid.tank_pressure, DEADBAND_PRESSURE)
+};
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static void read_field(const delta_field_t* field, const telemetry_data_t* data, telemetry_published_t* current);
+static bool field_changed(const telemetry_delta_t* delta, const delta_field_t* field, const telemetry_published_t* current,
+                          const telemetry_published_t* published);
+static bool write_field(const delta_field_t* field, const telemetry_published_t* current, delta_output_t* output);
+static bool moved(sensor_value_t value, sensor_value_t published, sensor_value_t deadband);
+static uint32_t read_enum(const uint8_t* field, uint8_t size);
+static bool write_bytes(delta_output_t* output, const char* bytes, uint32_t length);
+static bool write_text(delta_output_t* output, const telemetry_text_t* texts, uint8_t count, uint32_t value);
+static bool write_value(delta_output_t* output, sensor_value_t value);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void telemetry_delta_init(telemetry_delta_t* delta, uint16_t keyframe_interval){
+  memset(delta->published, 0, sizeof(delta->published));
+  memcpy(delta->deadbands, default_deadbands, sizeof(delta->deadbands));
+  delta->keyframe_interval = keyframe_interval;
+  delta->since_keyframe = 0;
+  delta->keyframe_due = true;
+  delta->changes = 0;
+}
+
+void telemetry_delta_set_deadband(telemetry_delta_t* delta, telemetry_deadband_t deadband, sensor_value_t value){
+  if(deadband < DEADBAND_CLASSES){
+    delta->deadbands[deadband] = value;
+  }
+}
+
+void telemetry_delta_force_keyframe(telemetry_delta_t* delta){
+  delta->keyframe_due = true;
+}
+
+telemetry_delta_result_t telemetry_delta_write(telemetry_delta_t* delta, const telemetry_data_t* data,
+                                               uint8_t* buffer, uint32_t buffer_size, uint32_t* length){
+  static const char header[] = "{" KEY("version") QUOTED(delta_MESSAGE_VERSION) "," KEY("timestamp_utc") "\"";
+  static const char serial_number[] = "\"," KEY("message_type") QUOTED(delta_MESSAGE_TYPE) "," KEY("serial_number") "\"";
+  static const char changes_begin[] = "\"," KEY("changes") "{";
+  telemetry_published_t current[TELEMETRY_DELTA_FIELDS];
+  bool changed[TELEMETRY_DELTA_FIELDS];
+  delta_output_t output = {buffer, buffer_size, 0};
+  uint16_t changes = 0;
+  bool written;
+
+  *length = 0;
+
+  for(uint16_t f = 0; f < TELEMETRY_DELTA_FIELDS; f++){
+    read_field(&delta_fields[f], data, &current[f]);
+  }
+
+  if(delta->keyframe_due || (delta->since_keyframe + 1 >= delta->keyframe_interval)){
+    *length = telemetry_schema_write(&telemetry_message_schema, data, buffer, buffer_size);
+    if(*length == 0){
+      return TELEMETRY_DELTA_NO_SPACE;
+    }
+
+    memcpy(delta->published, current, sizeof(delta->published));
+    delta->since_keyframe = 0;
+    delta->keyframe_due = false;
+    delta->changes = 0;
+    return TELEMETRY_DELTA_KEYFRAME;
+  }
+
+  delta->since_keyframe++;
+
+  written = write_bytes(&output, header, TEXT_LENGTH(header)) &&
+            write_bytes(&output, data->timestamp_utc, strlen(data->timestamp_utc)) &&
+            write_bytes(&output, serial_number, TEXT_LENGTH(serial_number)) &&
+            write_bytes(&output, data->ccu_serial_number, strlen(data->ccu_serial_number)) &&
+            write_bytes(&output, changes_begin, TEXT_LENGTH(changes_begin));
+
+  for(uint16_t f = 0; written && (f < TELEMETRY_DELTA_FIELDS); f++){
+    changed[f] = field_changed(delta, &delta_fields[f], &current[f], &delta->published[f]);
+
+    if(changed[f]){
+      written = ((changes++ == 0) || write_bytes(&output, ",", 1)) &&
+                write_field(&delta_fields[f], &current[f], &output);
+    }
+  }
+
+  if(!written || !write_bytes(&output, "}}", 2)){
+    return TELEMETRY_DELTA_NO_SPACE;
+  }
+
+  if(changes == 0){
+    return TELEMETRY_DELTA_NO_CHANGE;
+  }
+
+  // The message is complete, what it carries is now what the cloud has
+  for(uint16_t f = 0; f < TELEMETRY_DELTA_FIELDS; f++){
+    if(changed[f]){
+      delta->published[f] = current[f];
+    }
+  }
+
+  delta->changes = changes;
+  *length = output.length;
+  return TELEMETRY_DELTA_CHANGES;
+}
+
+static void read_field(const delta_field_t* field, const telemetry_data_t* data, telemetry_published_t* current){
+  const sensor_info_t* values = (const sensor_info_t*)((const uint8_t*)data + field->offset);
+  const sensor_info_t* status = (const sensor_info_t*)((const uint8_t*)data + field->status_offset);
+
+  if(field->type == DELTA_ENUM){
+    memset(current, 0, sizeof(*current));
+    current->value = read_enum((const uint8_t*)data + field->offset, field->size);
+    return;
+  }
+
+  current->value = status->status;
+  current->avg = values->stats.avg;
+  current->max = values->stats.max;
+  // @todo zones have always sent the average as min, see zone_ops in telemetry_schema.c
+  current->min = (field->type == DELTA_ZONE) ? values->stats.avg : values->stats.min;
+  current->median = status->stats.median;
+}
+
+static bool field_changed(const telemetry_delta_t* delta, const delta_field_t* field, const telemetry_published_t* current,
+                          const telemetry_published_t* published){
+  sensor_value_t deadband = delta->deadbands[field->deadband];
+
+  if(field->type == DELTA_ENUM){
+    return current->value != published->value;
+  }
+
+  return (current->value != published->value) ||
+         moved(current->avg, published->avg, deadband) ||
+         moved(current->max, published->max, deadband) ||
+         moved(current->min, published->min, deadband) ||
+         moved(current->median, published->median, deadband);
+}
+
+static bool write_field(const delta_field_t* field, const telemetry_published_t* current, delta_output_t* output){
+  static const char status[] = "{" KEY("status") "\"";
+  static const char avg[] = "\"," KEY("avg");
+  static const char max[] = "," KEY("max");
+  static const char min[] = "," KEY("min");
+  static const char median[] = "," KEY("median");
+
+  if(!write_bytes(output, field->path, field->path_length)){
+    return false;
+  }
+
+  if(field->type == DELTA_ENUM){
+    return write_bytes(output, "\"", 1) &&
+           write_text(output, field->texts, field->text_count, current->value) &&
+           write_bytes(output, "\"", 1);
+  }
+
+  return write_bytes(output, status, TEXT_LENGTH(status)) &&
+         write_text(output, field->texts, field->text_count, current->value) &&
+         write_bytes(output, avg, TEXT_LENGTH(avg)) &&
+         write_value(output, current->avg) &&
+         write_bytes(output, max, TEXT_LENGTH(max)) &&
+         write_value(output, current->max) &&
+         write_bytes(output, min, TEXT_LENGTH(min)) &&
+         write_value(output, current->min) &&
+         write_bytes(output, median, TEXT_LENGTH(median)) &&
+         write_value(output, current->median) &&
+         write_bytes(output, "}", 1);
+}
+
+// Differences are taken wide, two far apart fixed point values do not fit sensor_value_t
+static bool moved(sensor_value_t value, sensor_value_t published, sensor_value_t deadband){
+  sensor_value_sum_t difference = (sensor_value_sum_t)value - (sensor_value_sum_t)published;
+
+  return (difference > deadband) || (difference < -(sensor_value_sum_t)deadband);
+}
+
+static uint32_t read_enum(const uint8_t* field, uint8_t size){
+  switch(size){
+    case sizeof(uint8_t):
+      return *field;
+    case sizeof(uint16_t):
+      return *(const uint16_t*)field;
+    default:
+      return *(const uint32_t*)field;
+  }
+}
+
+static bool write_bytes(delta_output_t* output, const char* bytes, uint32_t length){
+  if(length > output->size - output->length){
+    return false;
+  }
+
+  memcpy(output->buffer + output->length, bytes, length);
+  output->length += length;
+
+  return true;
+}
+
+static bool write_text(delta_output_t* output, const telemetry_text_t* texts, uint8_t count, uint32_t value){
+  return (value < count) && write_bytes(output, texts[value].text, texts[value].length);
+}
+
+static bool write_value(delta_output_t* output, sensor_value_t value){
+  uint32_t length = sensor_value_to_text(value, SENSOR_VALUE_DECIMALS, (char*)output->buffer + output->length,
+                                         output->size - output->length);
+
+  output->length += length;
+
+  return (length != 0);
+}
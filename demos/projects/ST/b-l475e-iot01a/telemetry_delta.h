@@ -0,0 +1,77 @@
+#ifndef TELEMETRY_DELTA_H_
+#define TELEMETRY_DELTA_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+#include "telemetry_schema.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#ifndef TELEMETRY_KEYFRAME_INTERVAL
+#define TELEMETRY_KEYFRAME_INTERVAL 10  // Publish cycles per full message, 1 sends only full messages
+#endif
+
+// Sensors sharing a deadband, a sensor counts as changed when one of its statistics moved
+// further than the deadband from what was last published
+typedef enum{
+  DEADBAND_TEMPERATURE,   // Heaters, ambient and skid temperature, C
+  DEADBAND_HUMIDITY,      // %
+  DEADBAND_PRESSURE,      // Tank, vacuum and proportional valve, bar
+  DEADBAND_O2,            // %
+  DEADBAND_CO2,           // Fraction
+  DEADBAND_MASS_FLOW,
+  DEADBAND_CLASSES
+}telemetry_deadband_t;
+
+#define TELEMETRY_DELTA_FIELDS 41        // Fields of the telemetry message that can be sent on their own
+
+// What was last sent for a field: the enum value, or a sensor's status and statistics
+typedef struct{
+  uint32_t value;
+  sensor_value_t avg;
+  sensor_value_t max;
+  sensor_value_t min;
+  sensor_value_t median;
+}telemetry_published_t;
+
+typedef enum{
+  TELEMETRY_DELTA_NO_CHANGE,  // Nothing moved since the last message, nothing written
+  TELEMETRY_DELTA_CHANGES,    // Delta message with the changed fields written
+  TELEMETRY_DELTA_KEYFRAME,   // Full telemetry message written
+  TELEMETRY_DELTA_NO_SPACE    // The message did not fit, nothing counts as published
+}telemetry_delta_result_t;
+
+// Change detection against what the cloud was last sent. Only fields written into a
+// message are taken over, so slow drifts add up until they cross the deadband.
+typedef struct{
+  telemetry_published_t published[TELEMETRY_DELTA_FIELDS];
+  sensor_value_t deadbands[DEADBAND_CLASSES];
+  uint16_t keyframe_interval;
+  uint16_t since_keyframe;    // Publish cycles since the last full message
+  bool keyframe_due;          // Nothing published yet, or the last message may have been lost
+  uint16_t changes;           // Fields in the last delta message
+}telemetry_delta_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void telemetry_delta_init(telemetry_delta_t* delta, uint16_t keyframe_interval);
+void telemetry_delta_set_deadband(telemetry_delta_t* delta, telemetry_deadband_t deadband, sensor_value_t value);
+
+// Makes the next message a full one, e.g. after a failed send or a new connection
+void telemetry_delta_force_keyframe(telemetry_delta_t* delta);
+
+// One publish cycle: a full telemetry message when a keyframe is due, otherwise the fields
+// that changed. length is set to the bytes written, 0 unless a message was written.
+telemetry_delta_result_t telemetry_delta_write(telemetry_delta_t* delta, const telemetry_data_t* data,
+                                               uint8_t* buffer, uint32_t buffer_size, uint32_t* length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_DELTA_H_ */
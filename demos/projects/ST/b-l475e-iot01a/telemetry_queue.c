@@ -0,0 +1,274 @@
+//========================================================================================================== INCLUDES
+#include "telemetry_queue.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define RECORD_HEADER 2         // Little endian length in front of every record
+#define RECORD_DEPENDENT 0x8000 // Header bit of a record that depends on the one before it
+#define RECORD_PADDING 0xFFFF   // Header marking the unused end of the buffer, the next record is at 0
+
+//========================================================================================================== VARIABLES
+const telemetry_queue_format_t telemetry_queue_json = {"[", ",", "]"};
+const telemetry_queue_format_t telemetry_queue_cbor = {"\x9F", "", "\xFF"};
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint16_t record_header(const telemetry_queue_t* queue, uint32_t offset);
+static uint16_t record_length(const telemetry_queue_t* queue, uint32_t offset);
+static uint32_t next_record(const telemetry_queue_t* queue, uint32_t offset);
+static bool find_room(telemetry_queue_t* queue, uint32_t length, uint32_t* offset);
+static void remove_oldest(telemetry_queue_t* queue);
+static void drop_oldest(telemetry_queue_t* queue);
+static bool oldest_dependent(const telemetry_queue_t* queue);
+static uint32_t spilled_count(const telemetry_queue_t* queue);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void telemetry_queue_init(telemetry_queue_t* queue, uint8_t* buffer, uint32_t size,
+                          telemetry_queue_policy_t policy, const telemetry_queue_spill_t* spill){
+  queue->buffer = buffer;
+  queue->size = size;
+  queue->head = 0;
+  queue->tail = 0;
+  queue->count = 0;
+  queue->policy = policy;
+  queue->spill = spill;
+  memset(&queue->stats, 0, sizeof(queue->stats));
+}
+
+telemetry_queue_result_t telemetry_queue_push(telemetry_queue_t* queue, const uint8_t* record, uint16_t length, bool dependent){
+  const telemetry_queue_spill_t* spill = queue->spill;
+  telemetry_queue_result_t result = TELEMETRY_QUEUE_QUEUED;
+  uint32_t needed = RECORD_HEADER + (uint32_t)length;
+  uint16_t header = (uint16_t)(length | (dependent ? RECORD_DEPENDENT : 0));
+  uint32_t offset;
+
+  if(length == 0 || length > TELEMETRY_QUEUE_MAX_RECORD || needed > queue->size){
+    queue->stats.rejected++;
+    return TELEMETRY_QUEUE_REJECTED;
+  }
+
+  while(!find_room(queue, needed, &offset)){
+    if(spill != NULL && spill->push(spill->context, queue->buffer + queue->head + RECORD_HEADER,
+                                    record_length(queue, queue->head), (record_header(queue, queue->head) & RECORD_DEPENDENT) != 0)){
+      remove_oldest(queue);
+      queue->stats.spilled++;
+      continue;
+    }
+
+    if(queue->policy == TELEMETRY_QUEUE_DROP_NEWEST){
+      queue->stats.rejected++;
+      return TELEMETRY_QUEUE_REJECTED;
+    }
+
+    drop_oldest(queue);
+    result = TELEMETRY_QUEUE_DROPPED;
+
+    // What the record depends on went as well
+    if(dependent && telemetry_queue_count(queue) == 0){
+      queue->stats.rejected++;
+      return TELEMETRY_QUEUE_REJECTED;
+    }
+  }
+
+  // Wrapping around, tell the reader the end is unused
+  if(offset < queue->tail && queue->size - queue->tail >= RECORD_HEADER){
+    queue->buffer[queue->tail] = (uint8_t)RECORD_PADDING;
+    queue->buffer[queue->tail + 1] = (uint8_t)(RECORD_PADDING >> 8);
+  }
+
+  queue->buffer[offset] = (uint8_t)header;
+  queue->buffer[offset + 1] = (uint8_t)(header >> 8);
+  memcpy(queue->buffer + offset + RECORD_HEADER, record, length);
+
+  queue->tail = offset + needed;
+  queue->count++;
+  queue->stats.queued++;
+
+  return result;
+}
+
+uint32_t telemetry_queue_count(const telemetry_queue_t* queue){
+  return spilled_count(queue) + queue->count;
+}
+
+uint32_t telemetry_queue_batch(const telemetry_queue_t* queue, uint32_t max_records, const telemetry_queue_format_t* format,
+                               uint8_t* buffer, uint32_t size, uint32_t* records){
+  const telemetry_queue_spill_t* spill = queue->spill;
+  uint32_t spilled = spilled_count(queue);
+  uint32_t total = spilled + queue->count;
+  uint32_t begin_length = strlen(format->begin);
+  uint32_t separator_length = strlen(format->separator);
+  uint32_t end_length = strlen(format->end);
+  uint32_t position = begin_length;
+  uint32_t offset = queue->head;
+  uint32_t length = 0;
+  uint32_t first_length = 0;
+
+  *records = 0;
+  if(total == 0 || max_records == 0){
+    return 0;
+  }
+
+  // As many whole records as fit between begin and end
+  while(max_records > 1 && *records < total && *records < max_records && begin_length + end_length <= size){
+    uint32_t record_position = position + (*records != 0 ? separator_length : 0);
+    uint32_t capacity;
+
+    if(record_position + end_length >= size){
+      break;
+    }
+
+    capacity = size - record_position - end_length;
+    if(*records < spilled){
+      length = spill->read(spill->context, *records, buffer + record_position, capacity);
+    }
+    else{
+      length = record_length(queue, offset);
+      if(length > capacity){
+        length = 0;
+      }
+      else{
+        memcpy(buffer + record_position, queue->buffer + offset + RECORD_HEADER, length);
+        offset = next_record(queue, offset);
+      }
+    }
+
+    if(length == 0){
+      break;
+    }
+
+    memcpy(buffer + position, format->separator, record_position - position);
+    position = record_position + length;
+    if(*records == 0){
+      first_length = length;
+    }
+    (*records)++;
+  }
+
+  if(*records > 1){
+    memcpy(buffer, format->begin, begin_length);
+    memcpy(buffer + position, format->end, end_length);
+    return position + end_length;
+  }
+
+  // One record goes as it is
+  if(*records == 1){
+    memmove(buffer, buffer + begin_length, first_length);
+    return first_length;
+  }
+
+  if(spilled != 0){
+    length = spill->read(spill->context, 0, buffer, size);
+  }
+  else{
+    length = record_length(queue, queue->head);
+    if(length > size){
+      return 0;
+    }
+    memcpy(buffer, queue->buffer + queue->head + RECORD_HEADER, length);
+  }
+
+  *records = length != 0 ? 1 : 0;
+  return length;
+}
+
+void telemetry_queue_drop(telemetry_queue_t* queue, uint32_t records){
+  uint32_t spilled = spilled_count(queue);
+
+  if(spilled != 0){
+    if(spilled > records){
+      spilled = records;
+    }
+    queue->spill->drop(queue->spill->context, spilled);
+    queue->stats.sent += spilled;
+    records -= spilled;
+  }
+
+  while(records != 0 && queue->count != 0){
+    remove_oldest(queue);
+    queue->stats.sent++;
+    records--;
+  }
+}
+
+static uint16_t record_header(const telemetry_queue_t* queue, uint32_t offset){
+  return (uint16_t)(queue->buffer[offset] | (queue->buffer[offset + 1] << 8));
+}
+
+static uint16_t record_length(const telemetry_queue_t* queue, uint32_t offset){
+  return (uint16_t)(record_header(queue, offset) & ~RECORD_DEPENDENT);
+}
+
+// Offset of the record after the one at offset
+static uint32_t next_record(const telemetry_queue_t* queue, uint32_t offset){
+  offset += RECORD_HEADER + record_length(queue, offset);
+
+  if(queue->size - offset < RECORD_HEADER || record_header(queue, offset) == RECORD_PADDING){
+    return 0;
+  }
+
+  return offset;
+}
+
+// Where a record of length bytes, header included, can be written without touching the queued ones
+static bool find_room(telemetry_queue_t* queue, uint32_t length, uint32_t* offset){
+  if(queue->count == 0){
+    queue->head = 0;
+    queue->tail = 0;
+    *offset = 0;
+    return length <= queue->size;
+  }
+
+  if(queue->tail > queue->head){
+    if(length <= queue->size - queue->tail){
+      *offset = queue->tail;
+      return true;
+    }
+
+    *offset = 0;
+    return length <= queue->head;
+  }
+
+  *offset = queue->tail;
+  return length <= queue->head - queue->tail;
+}
+
+static void remove_oldest(telemetry_queue_t* queue){
+  queue->count--;
+  if(queue->count == 0){
+    queue->head = 0;
+    queue->tail = 0;
+    return;
+  }
+
+  queue->head = next_record(queue, queue->head);
+}
+
+// The oldest record, then the ones that only made sense after it
+static void drop_oldest(telemetry_queue_t* queue){
+  do{
+    if(spilled_count(queue) != 0){
+      queue->spill->drop(queue->spill->context, 1);
+    }
+    else{
+      remove_oldest(queue);
+    }
+    queue->stats.dropped++;
+  }while(telemetry_queue_count(queue) != 0 && oldest_dependent(queue));
+}
+
+static bool oldest_dependent(const telemetry_queue_t* queue){
+  if(spilled_count(queue) != 0){
+    return queue->spill->dependent(queue->spill->context);
+  }
+
+  return (record_header(queue, queue->head) & RECORD_DEPENDENT) != 0;
+}
+
+static uint32_t spilled_count(const telemetry_queue_t* queue){
+  if(queue->spill == NULL){
+    return 0;
+  }
+
+  return queue->spill->count(queue->spill->context);
+}
@@ -0,0 +1,96 @@
+#ifndef TELEMETRY_QUEUE_H_
+#define TELEMETRY_QUEUE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// What happens to a new record when the queue and the spill are full
+typedef enum{
+  TELEMETRY_QUEUE_DROP_OLDEST,    // Oldest records go until the new one fits, the end of an outage is kept
+  TELEMETRY_QUEUE_DROP_NEWEST     // The new record is refused, the start of an outage is kept
+}telemetry_queue_policy_t;
+
+typedef enum{
+  TELEMETRY_QUEUE_QUEUED,         // Record queued
+  TELEMETRY_QUEUE_DROPPED,        // Record queued, older records were dropped to make room
+  TELEMETRY_QUEUE_REJECTED        // Record not queued: too long, full with TELEMETRY_QUEUE_DROP_NEWEST,
+                                  // or what it depends on had to be dropped
+}telemetry_queue_result_t;
+
+#define TELEMETRY_QUEUE_MAX_RECORD 0x7FFE   // The top bit of the length marks dependent records
+
+// Optional second stage behind the RAM ring, e.g. data flash, records that no longer fit in
+// RAM are moved there. Everything spilled is older than what is in RAM and is sent first.
+typedef struct{
+  void* context;
+  bool (*push)(void* context, const uint8_t* record, uint16_t length, bool dependent); // false when full
+  uint16_t (*read)(void* context, uint32_t index, uint8_t* buffer, uint32_t size);     // index from the oldest, 0 if it does not fit
+  void (*drop)(void* context, uint32_t records);                                      // The oldest ones
+  uint32_t (*count)(void* context);
+  bool (*dependent)(void* context);                                                   // Of the oldest record
+}telemetry_queue_spill_t;
+
+// How several records are put into one message. A batch of one record is the record itself.
+typedef struct{
+  const char* begin;
+  const char* separator;
+  const char* end;
+}telemetry_queue_format_t;
+
+typedef struct{
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t rejected;
+  uint32_t spilled;
+}telemetry_queue_stats_t;
+
+// Encoded messages waiting for the hub, oldest first. Records sit in one byte ring, each behind
+// a two byte length, and are never split: one that does not fit before the end starts over at 0.
+// Records are only taken out once they are sent, a failed send keeps them for the next session.
+// A dependent record, like a delta message after its keyframe, is dropped together with the
+// record before it, so whatever is left can still be read from its first record on.
+typedef struct{
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t head;    // Oldest record
+  uint32_t tail;    // Where the next one is written
+  uint32_t count;   // Records in RAM
+  telemetry_queue_policy_t policy;
+  const telemetry_queue_spill_t* spill;
+  telemetry_queue_stats_t stats;
+}telemetry_queue_t;
+
+//========================================================================================================== VARIABLES
+extern const telemetry_queue_format_t telemetry_queue_json;  // [a,b,c]
+extern const telemetry_queue_format_t telemetry_queue_cbor;  // Indefinite length array of the messages
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// spill may be NULL, records that no longer fit are dropped then
+void telemetry_queue_init(telemetry_queue_t* queue, uint8_t* buffer, uint32_t size,
+                          telemetry_queue_policy_t policy, const telemetry_queue_spill_t* spill);
+
+telemetry_queue_result_t telemetry_queue_push(telemetry_queue_t* queue, const uint8_t* record, uint16_t length, bool dependent);
+
+// Records waiting, spilled ones included
+uint32_t telemetry_queue_count(const telemetry_queue_t* queue);
+
+// Copies up to max_records of the oldest records into buffer as one message. Returns its length
+// and sets records to how many it holds, 0 if the queue is empty or the oldest record does not fit.
+uint32_t telemetry_queue_batch(const telemetry_queue_t* queue, uint32_t max_records, const telemetry_queue_format_t* format,
+                               uint8_t* buffer, uint32_t size, uint32_t* records);
+
+// Takes out the oldest records once the batch holding them is sent
+void telemetry_queue_drop(telemetry_queue_t* queue, uint32_t records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_QUEUE_H_ */
@@ -0,0 +1,404 @@
+//========================================================================================================== INCLUDES
+#include "telemetry_schema.h"
+#include "sensor_value.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+// Keys and punctuation are joined into string literals by the compiler, the writer only copies them
+#define KEY(name) "\"" name "\":"
+#define QUOTED(text) "\"" text "\""
+#define STRINGIFY(x) #x
+#define NUMBER(x) STRINGIFY(x)
+
+#define DATA(member) offsetof(telemetry_data_t, member)
+#define DATA_SIZE(member) sizeof(((telemetry_data_t*)0)->member)
+#define SENSOR(member) offsetof(sensor_info_t, member)
+#define SENSOR_SIZE(member) sizeof(((sensor_info_t*)0)->member)
+#define TABLE_LENGTH(table) (sizeof(table) / sizeof(table[0]))
+
+#define TEXT(literal) {SCHEMA_TEXT, 0, 0, 0, 0, sizeof(literal) - 1, literal}
+#define STRING(offset) {SCHEMA_STRING, 0, 0, 0, offset, 0, NULL}
+#define ENUM(table, offset, size) {SCHEMA_ENUM, size, TABLE_LENGTH(table), 0, offset, 0, table}
+#define VALUE(offset) {SCHEMA_SENSOR_VALUE, 0, 0, 0, offset, 0, NULL}
+#define INDEX() {SCHEMA_INDEX, 0, 0, 0, 0, 0, NULL}
+#define REPEAT(schema, offset, count, stride) {SCHEMA_REPEAT, 0, count, 0, offset, stride, &schema}
+#define ELEMENT_IF(schema, offset, size, value) {SCHEMA_ELEMENT_IF, size, 0, value, offset, 0, &schema}
+#define SCHEMA(ops) {ops, TABLE_LENGTH(ops)}
+
+#define DATA_ENUM(table, member) ENUM(table, DATA(member), DATA_SIZE(member))
+#define DATA_STRING(member) STRING(DATA(member))
+#define DATA_VALUE(member) VALUE(DATA(member))
+
+// One entry of a sensor_measurements array: the name is constant, the rest comes from the sensor
+#define SENSOR_ENTRY(separator, name, member) \
+  TEXT(separator "{" KEY("name") QUOTED(name) ","), \
+  REPEAT(sensor_schema, DATA(member), 1, 0)
+
+#define TEXT_ENTRY(literal) {literal, sizeof(literal) - 1}
+
+typedef struct{
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t length;
+}schema_output_t;
+
+//========================================================================================================== VARIABLES
+// Value names, indexed by the enums in iot_status.h
+const telemetry_text_t telemetry_valve_status_texts[] = {
+  TEXT_ENTRY("CLOSED"),
+  TEXT_ENTRY("OPENED")
+};
+
+const telemetry_text_t telemetry_three_way_valve_texts[] = {
+  TEXT_ENTRY("to_Tank"),
+  TEXT_ENTRY("to_Air")
+};
+
+const telemetry_text_t telemetry_component_status_texts[] = {
+  TEXT_ENTRY("OFF"),
+  TEXT_ENTRY("ON")
+};
+
+const telemetry_text_t telemetry_sensor_status_texts[] = {
+  TEXT_ENTRY("NO-ERROR"),
+  TEXT_ENTRY("ERROR")
+};
+
+const telemetry_text_t telemetry_flag_state_texts[] = {
+  TEXT_ENTRY("UNSET"),
+  TEXT_ENTRY("SET")
+};
+
+const telemetry_text_t telemetry_sequence_state_texts[] = {
+  TEXT_ENTRY("Error_Handling"),
+  TEXT_ENTRY("Init_State"),
+  TEXT_ENTRY("Adsorb_State"),
+  TEXT_ENTRY("Evacuation_State"),
+  TEXT_ENTRY("Desorb_State"),
+  TEXT_ENTRY("Vacuum_Release_State"),
+  TEXT_ENTRY("Lock_State"),
+  TEXT_ENTRY("Desorb_Setup_State"),
+  TEXT_ENTRY("Safe_State"),
+  TEXT_ENTRY("Unlock_State")
+};
+
+// Sensor object after its name, the base is a sensor_info_t
+static const telemetry_op_t sensor_ops[] = {
+  TEXT(KEY("status") "\""),
+  ENUM(telemetry_sensor_status_texts, SENSOR(status), SENSOR_SIZE(status)),
+  TEXT("\"," KEY("avg")),
+  VALUE(SENSOR(stats.avg)),
+  TEXT("," KEY("max")),
+  VALUE(SENSOR(stats.max)),
+  TEXT("," KEY("min")),
+  VALUE(SENSOR(stats.min)),
+  TEXT("," KEY("median")),
+  VALUE(SENSOR(stats.median)),
+  TEXT("}")
+};
+static const telemetry_schema_t sensor_schema = SCHEMA(sensor_ops);
+
+// Heater zone, the base is the heater's sensor_info_t.
+// The zone is the position in the cartridge, same as (heater % NUMBER_OF_CARTRIDGES) + 1 the writer used.
+static const telemetry_op_t zone_ops[] = {
+  TEXT("{" KEY("zone")),
+  INDEX(),
+  TEXT("," KEY("status") "\""),
+  ENUM(telemetry_component_status_texts, SENSOR(status), SENSOR_SIZE(status)),
+  TEXT("\"," KEY("avg")),
+  VALUE(SENSOR(stats.avg)),
+  TEXT("," KEY("max")),
+  VALUE(SENSOR(stats.max)),
+  TEXT("," KEY("min")),
+  VALUE(SENSOR(stats.avg)),         // @todo min has always been sent as the average, kept until the cloud side is checked
+  TEXT("," KEY("median")),
+  VALUE(SENSOR(stats.median)),
+  TEXT("}")
+};
+static const telemetry_schema_t zone_schema = SCHEMA(zone_ops);
+
+// Cartridge, the base is the sensor_info_t of its first heater.
+// @todo: For now 9 heaters are read sequentially as 3 cartridges with 3 zones each, slots are 1, 2, 3...
+static const telemetry_op_t cartridge_ops[] = {
+  TEXT("{" KEY("serial_number") "\"" telemetry_CARTRIDGE_SERIAL_NUMBER),
+  INDEX(),
+  TEXT("\"," KEY("slot")),
+  INDEX(),
+  TEXT("," KEY("zones") "["),
+  REPEAT(zone_schema, 0, NUMBER_OF_ZONES_PER_CARTRIDGE, sizeof(sensor_info_t)),
+  TEXT("]}")
+};
+static const telemetry_schema_t cartridge_schema = SCHEMA(cartridge_ops);
+
+#define CARTRIDGES_OPS \
+  REPEAT(cartridge_schema, DATA(unit.heater_info), NUMBER_OF_CARTRIDGES, NUMBER_OF_ZONES_PER_CARTRIDGE * sizeof(sensor_info_t))
+
+#define SKID_SENSORS_OPS \
+  SENSOR_ENTRY("", "o2", skid.o2_sensor), \
+  SENSOR_ENTRY(",", "mass_flow", skid.mass_flow), \
+  SENSOR_ENTRY(",", "co2", skid.co2_sensor), \
+  SENSOR_ENTRY(",", "propotional_valve_pressure", skid.proportional_valve_pressure), \
+  SENSOR_ENTRY(",", "temperature", skid.temperature), \
+  SENSOR_ENTRY(",", "humidity", skid.humidity)
+
+// @todo ambient temperature status and median are read from the humidity sensor, as they always were
+#define UNIT_SENSORS_OPS \
+  SENSOR_ENTRY("", "vacuum_sensor", unit.vacuum_sensor), \
+  SENSOR_ENTRY(",", "ambient_humidity", unit.ambient_humidity), \
+  TEXT(",{" KEY("name") QUOTED("ambient_temperature") "," KEY("status") "\""), \
+  DATA_ENUM(telemetry_sensor_status_texts, unit.ambient_humidity.status), \
+  TEXT("\"," KEY("avg")), \
+  DATA_VALUE(unit.ambient_temperature.stats.avg), \
+  TEXT("," KEY("max")), \
+  DATA_VALUE(unit.ambient_temperature.stats.max), \
+  TEXT("," KEY("min")), \
+  DATA_VALUE(unit.ambient_temperature.stats.min), \
+  TEXT("," KEY("median")), \
+  DATA_VALUE(unit.ambient_humidity.stats.median), \
+  TEXT("}")
+
+static const telemetry_op_t telemetry_message_ops[] = {
+  TEXT("{" KEY("version") QUOTED(telemetry_MESSAGE_VERSION) ","
+       KEY("measurement_count") NUMBER(telemetry_MEASUREMENT_COUNT) ","
+       KEY("timestamp_utc") "\""),
+  DATA_STRING(timestamp_utc),
+  TEXT("\"," KEY("message_type") QUOTED(telemetry_MESSAGE_TYPE) ","
+       KEY("ccu") "{" KEY("serial_number") "\""),
+  DATA_STRING(ccu_serial_number),
+  TEXT("\"," KEY("ccu_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  TEXT("\"," KEY("sensor_measurements") "["),
+  SKID_SENSORS_OPS,
+  TEXT("]," KEY("ccu_status") "{" KEY("error_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, skid.error_flag),
+  TEXT("\"," KEY("halt_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, skid.halt_flag),
+  TEXT("\"," KEY("reset_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, skid.reset_flag),
+  TEXT("\"}," KEY("component_status") "{" KEY("two_way_gas_valve_before_water_trap") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_before_water_trap),
+  TEXT("\"," KEY("two_way_gas_valve_in_water_trap") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_in_water_trap),
+  TEXT("\"," KEY("two_way_gas_valve_after_water_trap") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, skid.two_way_gas_valve_after_water_trap),
+  TEXT("\"," KEY("vacuum_release_valve_in_water_trap") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, skid.vacuum_release_valve_in_water_trap),
+  TEXT("\"," KEY("three_way_vacuum_release_valve_before_condenser") "\""),
+  DATA_ENUM(telemetry_three_way_valve_texts, skid.three_way_vacuum_release_valve_before_condenser),
+  TEXT("\"," KEY("three_way_valve_after_vacuum_pump") "\""),
+  DATA_ENUM(telemetry_three_way_valve_texts, skid.three_valve_after_vacuum_pump),
+  TEXT("\"," KEY("compressor") "\""),
+  DATA_ENUM(telemetry_component_status_texts, skid.compressor),
+  TEXT("\"," KEY("vacuum_pump") "\""),
+  DATA_ENUM(telemetry_component_status_texts, skid.vacuum_pump),
+  TEXT("\"," KEY("condenser") "\""),
+  DATA_ENUM(telemetry_component_status_texts, skid.condenser),
+  // @todo: For now we have a single unit, Unit-2 and Unit-3 come with the new Controllino code
+  TEXT("\"}}," KEY("units") "[{" KEY("serial_number") QUOTED(telemetry_UNIT_SERIAL_NUMBER) ","
+       KEY("unit_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  TEXT("\"," KEY("cartridges") "["),
+  CARTRIDGES_OPS,
+  TEXT("]," KEY("unit_status") "{" KEY("error_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, unit.error_flag),
+  TEXT("\"," KEY("halt_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, unit.halt_flag),
+  TEXT("\"," KEY("reset_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, unit.reset_flag),
+  TEXT("\"," KEY("just_started_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, unit.just_started_flag),
+  TEXT("\"," KEY("setup_state_synching_flag") "\""),
+  DATA_ENUM(telemetry_flag_state_texts, unit.setup_state_synching_flag),
+  TEXT("\"}," KEY("component_status") "{" KEY("fan_status") "\""),
+  DATA_ENUM(telemetry_component_status_texts, unit.fan_status),
+  TEXT("\"," KEY("butterfly_valve_1_status") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, unit.butterfly_valve_1_status),
+  TEXT("\"," KEY("butterfly_valve_2_status") "\""),
+  DATA_ENUM(telemetry_valve_status_texts, unit.butterfly_valve_2_status),
+  TEXT("\"}," KEY("sensor_measurements") "["),
+  UNIT_SENSORS_OPS,
+  TEXT("]}]," KEY("tank") "{" KEY("serial_number") QUOTED(telemetry_TANK_SERIAL_NUMBER) ","
+       KEY("sensor_measurements") "["),
+  SENSOR_ENTRY("", "tank_pressure", skid.tank_pressure),
+  TEXT("]}}")
+};
+
+// Errors array entries, written on the same base as the message
+static const telemetry_op_t skid_error_ops[] = {
+  TEXT("{" KEY("timestamp_utc") "\""),
+  DATA_STRING(timestamp_utc),
+  TEXT("\"," KEY("error_code") "\""),
+  DATA_STRING(skid_error_code),
+  TEXT("\"," KEY("version") QUOTED(error_MESSAGE_VERSION) ","
+       KEY("location") QUOTED(ccu_LOCATION) ","
+       KEY("current_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  // @todo need to implement current and previous states
+  TEXT("\"," KEY("previous_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, skid.skid_state),
+  TEXT("\"," KEY("sensor_measurements") "["),
+  SKID_SENSORS_OPS,
+  SENSOR_ENTRY(",", "tank_pressure", skid.tank_pressure),
+  TEXT("]," KEY("body") "{}}")
+};
+static const telemetry_schema_t skid_error_schema = SCHEMA(skid_error_ops);
+
+static const telemetry_op_t unit_error_ops[] = {
+  TEXT("{" KEY("timestamp_utc") "\""),
+  DATA_STRING(timestamp_utc),
+  TEXT("\"," KEY("error_code") "\""),
+  DATA_STRING(unit_error_code),
+  TEXT("\"," KEY("version") QUOTED(error_MESSAGE_VERSION) ","
+       KEY("location") QUOTED(unit1_LOCATION) ","
+       KEY("current_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  TEXT("\"," KEY("previous_state") "\""),
+  DATA_ENUM(telemetry_sequence_state_texts, unit.unit_state),
+  TEXT("\"," KEY("sensor_measurements") "["),
+  UNIT_SENSORS_OPS,
+  TEXT("]," KEY("body") "{" KEY("cartridges") "["),
+  CARTRIDGES_OPS,
+  TEXT("]}}")
+};
+static const telemetry_schema_t unit_error_schema = SCHEMA(unit_error_ops);
+
+static const telemetry_op_t error_message_ops[] = {
+  TEXT("{" KEY("message_type") QUOTED(error_MESSAGE_TYPE) ","
+       KEY("version") QUOTED(error_MESSAGE_VERSION) ","
+       KEY("timestamp_utc") "\""),
+  DATA_STRING(timestamp_utc),
+  TEXT("\"," KEY("errors") "["),
+  ELEMENT_IF(skid_error_schema, DATA(skid.skid_state), DATA_SIZE(skid.skid_state), Lock_State),
+  ELEMENT_IF(unit_error_schema, DATA(unit.unit_state), DATA_SIZE(unit.unit_state), Lock_State),
+  TEXT("]}")
+};
+
+// @todo hardware versions
+static const telemetry_op_t bootup_message_ops[] = {
+  TEXT("{" KEY("message_type") QUOTED(bootup_MESSAGE_TYPE) ","
+       KEY("version") QUOTED(bootup_MESSAGE_VERSION) ","
+       KEY("azure_sdk_version") QUOTED(azure_sdk_version) ","
+       KEY("timestamp_utc") "\""),
+  DATA_STRING(timestamp_utc),
+  TEXT("\"," KEY("firmware_versions") "["
+       "{" KEY("identifier") QUOTED(ccu_IDENTIFIER) "," KEY("version") QUOTED(ccu_FIRMWARE_VERSION) "},"
+       "{" KEY("identifier") QUOTED(unit1_IDENTIFIER) "," KEY("version") QUOTED(unit1_FIRMWARE_VERSION) "}"
+       "]}")
+};
+
+const telemetry_schema_t telemetry_message_schema = SCHEMA(telemetry_message_ops);
+const telemetry_schema_t error_message_schema = SCHEMA(error_message_ops);
+const telemetry_schema_t bootup_message_schema = SCHEMA(bootup_message_ops);
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static bool write_schema(const telemetry_schema_t* schema, const uint8_t* base, uint8_t index, schema_output_t* output);
+static bool write_bytes(schema_output_t* output, const char* bytes, uint32_t length);
+static bool write_index(schema_output_t* output, uint8_t index);
+static uint32_t read_enum(const uint8_t* field, uint8_t size);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+uint32_t telemetry_schema_write(const telemetry_schema_t* schema, const telemetry_data_t* data, uint8_t* buffer, uint32_t buffer_size){
+  schema_output_t output = {buffer, buffer_size, 0};
+
+  if(!write_schema(schema, (const uint8_t*)data, 0, &output)){
+    return 0;
+  }
+
+  return output.length;
+}
+
+static bool write_schema(const telemetry_schema_t* schema, const uint8_t* base, uint8_t index, schema_output_t* output){
+  uint8_t elements = 0;
+
+  for(uint16_t o = 0; o < schema->op_count; o++){
+    const telemetry_op_t* op = &schema->ops[o];
+    const uint8_t* field = base + op->offset;
+    bool written = false;
+
+    switch(op->type){
+      case SCHEMA_TEXT:
+        written = write_bytes(output, (const char*)op->data, op->length);
+        break;
+      case SCHEMA_STRING:
+        written = write_bytes(output, (const char*)field, strlen((const char*)field));
+        break;
+      case SCHEMA_ENUM:{
+        uint32_t value = read_enum(field, op->size);
+
+        if(value < op->count){
+          const telemetry_text_t* text = &((const telemetry_text_t*)op->data)[value];
+          written = write_bytes(output, text->text, text->length);
+        }
+        break;
+      }
+      case SCHEMA_SENSOR_VALUE:{
+        uint32_t length = sensor_value_to_text(*(const sensor_value_t*)field, SENSOR_VALUE_DECIMALS,
+                                               (char*)output->buffer + output->length, output->size - output->length);
+        output->length += length;
+        written = (length != 0);
+        break;
+      }
+      case SCHEMA_INDEX:
+        written = write_index(output, index + 1);
+        break;
+      case SCHEMA_REPEAT:
+        written = true;
+        for(uint8_t i = 0; written && (i < op->count); i++){
+          written = ((i == 0) || write_bytes(output, ",", 1)) &&
+                    write_schema((const telemetry_schema_t*)op->data, field + i * op->length, i, output);
+        }
+        break;
+      case SCHEMA_ELEMENT_IF:
+        written = true;
+        if(read_enum(field, op->size) == op->value){
+          written = ((elements++ == 0) || write_bytes(output, ",", 1)) &&
+                    write_schema((const telemetry_schema_t*)op->data, base, index, output);
+        }
+        break;
+      default:
+        break;
+    }
+
+    if(!written){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool write_bytes(schema_output_t* output, const char* bytes, uint32_t length){
+  if(length > output->size - output->length){
+    return false;
+  }
+
+  memcpy(output->buffer + output->length, bytes, length);
+  output->length += length;
+
+  return true;
+}
+
+static bool write_index(schema_output_t* output, uint8_t index){
+  char digits[3];
+  uint8_t count = 0;
+
+  do{
+    digits[sizeof(digits) - 1 - count++] = '0' + (index % 10);
+    index /= 10;
+  }while(index != 0);
+
+  return write_bytes(output, &digits[sizeof(digits) - count], count);
+}
+
+static uint32_t read_enum(const uint8_t* field, uint8_t size){
+  switch(size){
+    case sizeof(uint8_t):
+      return *field;
+    case sizeof(uint16_t):
+      return *(const uint16_t*)field;
+    default:
+      return *(const uint32_t*)field;
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef TELEMETRY_SCHEMA_H_
+#define TELEMETRY_SCHEMA_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include "iot_status.h"
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define TELEMETRY_TIMESTAMP_LENGTH 30
+#define TELEMETRY_ERROR_CODE_LENGTH 60
+#define TELEMETRY_SERIAL_NUMBER_LENGTH 32
+
+// Constant values shared by the message encodings, @todo serial numbers need to be picked from desired properties
+#define telemetry_MESSAGE_VERSION           "1.0"
+#define telemetry_MEASUREMENT_COUNT         30              // Constant for now
+#define telemetry_MESSAGE_TYPE              "telemetry"
+#define telemetry_UNIT_SERIAL_NUMBER        "Unit123"
+#define telemetry_CARTRIDGE_SERIAL_NUMBER   "Cartridge"
+#define telemetry_TANK_SERIAL_NUMBER        "Tank123"
+#define bootup_MESSAGE_VERSION              "1.0"
+#define bootup_MESSAGE_TYPE                 "boot-up"
+#define error_MESSAGE_VERSION               "1.0"
+#define error_MESSAGE_TYPE                  "error"
+#define azure_sdk_version                   "0.0.0"
+#define ccu_IDENTIFIER                      "CCU"
+#define unit1_IDENTIFIER                    "UNIT1"
+#define ccu_FIRMWARE_VERSION                "0.0.0"
+#define unit1_FIRMWARE_VERSION              "0.0.0"
+#define ccu_LOCATION                        "CCU"
+#define unit1_LOCATION                      "UNIT1"
+
+// Everything a message is made from. The schemas point into this structure, so the
+// caller fills it once per publish cycle and every message is written from it.
+typedef struct{
+    SKID_iot_status_t skid;
+    UNIT_iot_status_t unit;
+    char timestamp_utc[TELEMETRY_TIMESTAMP_LENGTH];
+    char ccu_serial_number[TELEMETRY_SERIAL_NUMBER_LENGTH];   // Depends on the setup, see sample_azure_iot.c
+    char skid_error_code[TELEMETRY_ERROR_CODE_LENGTH];        // Only used by the error message
+    char unit_error_code[TELEMETRY_ERROR_CODE_LENGTH];
+}telemetry_data_t;
+
+typedef enum{
+    SCHEMA_TEXT,            // Constant text: keys, punctuation and constant values, rendered at compile time
+    SCHEMA_STRING,          // Zero terminated char array, written without quotes (the text around it has them)
+    SCHEMA_ENUM,            // Name of an enum value, looked up in a table of texts
+    SCHEMA_SENSOR_VALUE,    // sensor_value_t with 3 decimals
+    SCHEMA_INDEX,           // Position in the enclosing repeat, counting from 1
+    SCHEMA_REPEAT,          // Sub-schema for count elements, length bytes apart, comma separated
+    SCHEMA_ELEMENT_IF       // Sub-schema as an array element, only when the enum field equals value
+}telemetry_op_type_t;
+
+typedef struct{
+    const char* text;
+    uint8_t length;
+}telemetry_text_t;
+
+typedef struct telemetry_schema telemetry_schema_t;
+
+typedef struct{
+    uint8_t type;           // telemetry_op_type_t
+    uint8_t size;           // ENUM, ELEMENT_IF: size of the enum field
+    uint8_t count;          // ENUM: entries in the table, REPEAT: elements
+    uint8_t value;          // ELEMENT_IF: enum value the element is written for
+    uint16_t offset;        // Field offset from the current base
+    uint16_t length;        // TEXT: text length, REPEAT: bytes between elements
+    const void* data;       // TEXT: the text, ENUM: telemetry_text_t table, REPEAT and ELEMENT_IF: the sub-schema
+}telemetry_op_t;
+
+struct telemetry_schema{
+    const telemetry_op_t* ops;
+    uint16_t op_count;
+};
+
+//========================================================================================================== VARIABLES
+// Names the enums in iot_status.h are sent as
+extern const telemetry_text_t telemetry_valve_status_texts[2];
+extern const telemetry_text_t telemetry_three_way_valve_texts[2];
+extern const telemetry_text_t telemetry_component_status_texts[2];
+extern const telemetry_text_t telemetry_sensor_status_texts[2];
+extern const telemetry_text_t telemetry_flag_state_texts[2];
+extern const telemetry_text_t telemetry_sequence_state_texts[10];
+
+extern const telemetry_schema_t telemetry_message_schema;
+extern const telemetry_schema_t error_message_schema;
+extern const telemetry_schema_t bootup_message_schema;
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+// Writes the message the schema describes into buffer. Returns the message length, 0 if it does not fit
+// or a field holds a value the schema has no text for.
+uint32_t telemetry_schema_write(const telemetry_schema_t* schema, const telemetry_data_t* data, uint8_t* buffer, uint32_t buffer_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_SCHEMA_H_ */
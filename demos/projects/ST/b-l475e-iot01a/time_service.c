@@ -0,0 +1,168 @@
+//========================================================================================================== INCLUDES
+#include "time_service.h"
+#include <stddef.h>
+#include <string.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define REBASE_TICKS 0x40000000u    // Base moved forward long before the tick counter wraps
+#define SECONDS_PER_DAY 86400u
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+static uint64_t local_ms(time_service_t* service, uint32_t tick);
+static void format_iso8601(char* buffer, uint64_t unix_time);
+static void put_digits(char* buffer, uint32_t value, uint32_t digits);
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void time_service_init(time_service_t* service, uint32_t tick_rate_hz, uint32_t resync_interval_s){
+  memset(service, 0, sizeof(*service));
+  service->tick_rate_hz = tick_rate_hz;
+  time_service_set_resync_interval(service, resync_interval_s);
+  format_iso8601(service->iso8601, 0);
+}
+
+void time_service_set_resync_interval(time_service_t* service, uint32_t resync_interval_s){
+  if(resync_interval_s == 0){
+    resync_interval_s = 1;
+  }
+  if(resync_interval_s > TIME_SERVICE_MAX_INTERVAL_S){
+    resync_interval_s = TIME_SERVICE_MAX_INTERVAL_S;
+  }
+
+  service->resync_interval_s = resync_interval_s;
+  if(service->synced && service->retry_s > resync_interval_s){
+    service->retry_s = resync_interval_s;
+  }
+}
+
+bool time_service_synced(const time_service_t* service){
+  return service->synced;
+}
+
+bool time_service_resync_due(const time_service_t* service, uint32_t tick){
+  if(!service->synced && service->stats.failures == 0){
+    return true;
+  }
+
+  return (tick - service->attempt_tick) >= service->retry_s * service->tick_rate_hz;
+}
+
+void time_service_sync(time_service_t* service, uint32_t unix_time, uint32_t tick){
+  uint64_t reference_ms = (uint64_t)unix_time * 1000u;
+  int64_t drift_ms;
+  int32_t drift_abs;
+
+  if(service->synced){
+    drift_ms = (int64_t)(local_ms(service, tick) - reference_ms);
+    drift_abs = (int32_t)(drift_ms < 0 ? -drift_ms : drift_ms);
+
+    service->stats.last_drift_ms = (int32_t)drift_ms;
+    if(drift_abs > service->stats.max_drift_ms){
+      service->stats.max_drift_ms = drift_abs;
+    }
+    if(reference_ms > service->sync_ms){
+      service->stats.drift_ppm = (int32_t)(drift_ms * 1000000 / (int64_t)(reference_ms - service->sync_ms));
+    }
+    if(drift_ms > TIME_SERVICE_MAX_HOLD_MS){
+      service->last_ms = reference_ms;
+    }
+  }
+
+  service->synced = true;
+  service->base_ms = reference_ms;
+  service->base_tick = tick;
+  service->sync_ms = reference_ms;
+  service->attempt_tick = tick;
+  service->retry_s = service->resync_interval_s;
+  service->stats.syncs++;
+}
+
+void time_service_sync_failed(time_service_t* service, uint32_t tick){
+  service->attempt_tick = tick;
+  service->retry_s = TIME_SERVICE_RETRY_S < service->resync_interval_s ? TIME_SERVICE_RETRY_S : service->resync_interval_s;
+  service->stats.failures++;
+}
+
+uint64_t time_service_unix_ms(time_service_t* service, uint32_t tick){
+  uint64_t now_ms;
+
+  if(!service->synced){
+    return 0;
+  }
+
+  now_ms = local_ms(service, tick);
+  if(now_ms < service->last_ms){
+    return service->last_ms;
+  }
+
+  service->last_ms = now_ms;
+  return now_ms;
+}
+
+uint32_t time_service_unix(time_service_t* service, uint32_t tick){
+  return (uint32_t)(time_service_unix_ms(service, tick) / 1000u);
+}
+
+const char* time_service_iso8601(time_service_t* service, uint32_t tick){
+  uint64_t second = time_service_unix_ms(service, tick) / 1000u;
+
+  if(second != service->iso8601_second){
+    format_iso8601(service->iso8601, second);
+    service->iso8601_second = second;
+  }
+
+  return service->iso8601;
+}
+
+// Unix time from the ticks, not clamped
+static uint64_t local_ms(time_service_t* service, uint32_t tick){
+  uint32_t elapsed = tick - service->base_tick;
+
+  // Whole seconds only, nothing is lost to the division
+  if(elapsed >= REBASE_TICKS){
+    elapsed -= elapsed % service->tick_rate_hz;
+    service->base_ms += (uint64_t)(elapsed / service->tick_rate_hz) * 1000u;
+    service->base_tick += elapsed;
+    elapsed = tick - service->base_tick;
+  }
+
+  return service->base_ms + (uint64_t)elapsed * 1000u / service->tick_rate_hz;
+}
+
+// Days to a civil date after H. Hinnant, no gmtime or sprintf
+static void format_iso8601(char* buffer, uint64_t unix_time){
+  uint32_t days = (uint32_t)(unix_time / SECONDS_PER_DAY);
+  uint32_t seconds = (uint32_t)(unix_time % SECONDS_PER_DAY);
+  uint32_t z = days + 719468u;
+  uint32_t era = z / 146097u;
+  uint32_t day_of_era = z - era * 146097u;
+  uint32_t year_of_era = (day_of_era - day_of_era / 1460u + day_of_era / 36524u - day_of_era / 146096u) / 365u;
+  uint32_t day_of_year = day_of_era - (365u * year_of_era + year_of_era / 4u - year_of_era / 100u);
+  uint32_t month_index = (5u * day_of_year + 2u) / 153u;
+  uint32_t day = day_of_year - (153u * month_index + 2u) / 5u + 1u;
+  uint32_t month = month_index < 10u ? month_index + 3u : month_index - 9u;
+  uint32_t year = year_of_era + era * 400u + (month <= 2u ? 1u : 0u);
+
+  put_digits(buffer, year, 4);
+  buffer[4] = '-';
+  put_digits(buffer + 5, month, 2);
+  buffer[7] = '-';
+  put_digits(buffer + 8, day, 2);
+  buffer[10] = 'T';
+  put_digits(buffer + 11, seconds / 3600u, 2);
+  buffer[13] = ':';
+  put_digits(buffer + 14, seconds / 60u % 60u, 2);
+  buffer[16] = ':';
+  put_digits(buffer + 17, seconds % 60u, 2);
+  buffer[19] = 'Z';
+  buffer[20] = '\0';
+}
+
+static void put_digits(char* buffer, uint32_t value, uint32_t digits){
+  while(digits != 0){
+    digits--;
+    buffer[digits] = (char)('0' + value % 10u);
+    value /= 10u;
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef TIME_SERVICE_H_
+#define TIME_SERVICE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+#include <stdbool.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+#define TIME_SERVICE_ISO8601_LENGTH 21      // 2024-02-02T12:00:00Z and the terminator
+#define TIME_SERVICE_RETRY_S 60             // Wait after a failed resync, shorter than the interval
+#define TIME_SERVICE_MAX_INTERVAL_S 86400   // Longest resync interval, keeps the drift and the tick math small
+#define TIME_SERVICE_MAX_HOLD_MS 5000       // Ticks further ahead than this are a wrong time, stepped back
+
+typedef struct{
+  uint32_t syncs;           // Successful ones, the first included
+  uint32_t failures;
+  int32_t last_drift_ms;    // Local minus reference time at the last resync, positive when the ticks ran fast
+  int32_t max_drift_ms;     // Largest absolute drift seen
+  int32_t drift_ppm;        // Last drift over the time since the resync before it
+}time_service_stats_t;
+
+// Unix time from the tick counter once synced to a reference like SNTP, resynced every interval.
+// Time handed out never goes back: when a resync finds the ticks ran fast it stays at the last
+// value until the reference catches up, unless they ran more than TIME_SERVICE_MAX_HOLD_MS ahead.
+// The ISO-8601 string is only rebuilt when the second changes. Not thread safe, callers
+// serialise the calls.
+typedef struct{
+  uint32_t tick_rate_hz;
+  uint32_t resync_interval_s;
+  bool synced;
+  uint64_t base_ms;         // Unix time in ms at base_tick
+  uint32_t base_tick;
+  uint32_t attempt_tick;    // Last resync, failed or not
+  uint32_t retry_s;         // Wait after attempt_tick
+  uint64_t sync_ms;         // Reference time of the last successful resync
+  uint64_t last_ms;         // Latest time handed out
+  uint64_t iso8601_second;
+  char iso8601[TIME_SERVICE_ISO8601_LENGTH];
+  time_service_stats_t stats;
+}time_service_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void time_service_init(time_service_t* service, uint32_t tick_rate_hz, uint32_t resync_interval_s);
+
+// Clamped to 1..TIME_SERVICE_MAX_INTERVAL_S, applies from the next resync on
+void time_service_set_resync_interval(time_service_t* service, uint32_t resync_interval_s);
+
+bool time_service_synced(const time_service_t* service);
+
+// True before the first sync, then once the interval, or the retry wait after a failure, passed
+bool time_service_resync_due(const time_service_t* service, uint32_t tick);
+
+// unix_time as read from the reference at tick
+void time_service_sync(time_service_t* service, uint32_t unix_time, uint32_t tick);
+void time_service_sync_failed(time_service_t* service, uint32_t tick);
+
+// 0 before the first sync
+uint64_t time_service_unix_ms(time_service_t* service, uint32_t tick);
+uint32_t time_service_unix(time_service_t* service, uint32_t tick);
+
+// UTC, 1970-01-01T00:00:00Z before the first sync. Valid until the next call.
+const char* time_service_iso8601(time_service_t* service, uint32_t tick);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIME_SERVICE_H_ */
@@ -13,10 +13,26 @@
 #include "stm32l4xx_hal_rcc.h"
 #include "stm32l4xx_hal_gpio.h"
 #include "gui_comm_api_ll.h"
+#include "uart_dma_rx.h"
+
+#include "FreeRTOS.h"
 
 #include "stm32l475e_iot01.h" //debug
 
 //========================================================================================================== DEFINITIONS AND MACROS
+#ifndef UART_BAUD_RATE
+#define UART_BAUD_RATE 57600
+#endif
+
+// 1 - reception through circular DMA, the cpu is interrupted on idle line and half/full buffer only
+// 0 - one interrupt per received byte
+#ifndef UART_RX_USE_DMA
+#define UART_RX_USE_DMA 1
+#endif
+
+// Has to hold everything that can arrive between two interrupts, two UNIT frames with margin
+#define UART_RX_DMA_BUFFER_LENGTH 256
+
 typedef enum{
   READY,
   BUSY
@@ -29,8 +45,19 @@ uart_tx_struct_t uart_current_process_data;
 
 uart_state_t state = READY;
 
+#if UART_RX_USE_DMA
+DMA_HandleTypeDef uart3_dma_rx;
+
+static uint8_t uart_dma_buf[UART_RX_DMA_BUFFER_LENGTH];
+static uart_dma_rx_t uart_dma_rx;
+#else
 uint8_t uart_message_buf;
+#endif
 //========================================================================================================== FUNCTIONS DECLARATIONS
+static void uart_rx_start(void);
+#if UART_RX_USE_DMA
+static void uart_rx_dma_update(void);
+#endif
 
 //========================================================================================================== FUNCTIONS DEFINITIONS
 void uart_api_init(void){
@@ -52,7 +79,7 @@ void uart_api_init(void){
 
   /* USART configuration */
     uart3.Instance = USART3;
-    uart3.Init.BaudRate = 57600;
+    uart3.Init.BaudRate = UART_BAUD_RATE;
     uart3.Init.WordLength = UART_WORDLENGTH_8B;
     uart3.Init.StopBits = UART_STOPBITS_1;
     uart3.Init.Parity = UART_PARITY_NONE;
@@ -64,22 +91,93 @@ void uart_api_init(void){
 
     HAL_UART_Init(&uart3);
 
-    HAL_NVIC_SetPriority(USART3_IRQn, 0, 0);
+#if UART_RX_USE_DMA
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    uart3_dma_rx.Instance = DMA1_Channel3;
+    uart3_dma_rx.Init.Request = DMA_REQUEST_2;
+    uart3_dma_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    uart3_dma_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    uart3_dma_rx.Init.MemInc = DMA_MINC_ENABLE;
+    uart3_dma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    uart3_dma_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    uart3_dma_rx.Init.Mode = DMA_CIRCULAR;
+    uart3_dma_rx.Init.Priority = DMA_PRIORITY_HIGH;
+
+    HAL_DMA_Init(&uart3_dma_rx);
+    __HAL_LINKDMA(&uart3, hdmarx, uart3_dma_rx);
+
+    HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+
+    uart_dma_rx_init(&uart_dma_rx, uart_dma_buf, UART_RX_DMA_BUFFER_LENGTH, gui_comm_rx_buffer_add_block);
+#endif
+
+    // The rx callback wakes the reader task, so the interrupt has to stay within the kernel's reach
+    HAL_NVIC_SetPriority(USART3_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(USART3_IRQn);
 
-    HAL_UART_Receive_IT(&uart3, &uart_message_buf, 1);
+    uart_rx_start();
+}
+
+static void uart_rx_start(void){
+#if UART_RX_USE_DMA
+  uart_dma_rx.last_position = 0;
+  HAL_UART_Receive_DMA(&uart3, uart_dma_buf, UART_RX_DMA_BUFFER_LENGTH);
+
+  // This HAL has no ReceiveToIdle, the idle line interrupt is handled in USART3_IRQHandler
+  __HAL_UART_CLEAR_IDLEFLAG(&uart3);
+  __HAL_UART_ENABLE_IT(&uart3, UART_IT_IDLE);
+#else
+  HAL_UART_Receive_IT(&uart3, &uart_message_buf, 1);
+#endif
+}
+
+#if UART_RX_USE_DMA
+// Hands everything the DMA wrote since the last call over to the rx buffer
+static void uart_rx_dma_update(void){
+  uart_dma_rx_update(&uart_dma_rx, UART_RX_DMA_BUFFER_LENGTH - __HAL_DMA_GET_COUNTER(&uart3_dma_rx));
+}
+
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart){
+  uart_rx_dma_update();
 }
 
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart){
+  uart_rx_dma_update();
+}
+
+void DMA1_Channel3_IRQHandler(void){
+  HAL_DMA_IRQHandler(&uart3_dma_rx);
+}
+#else
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart){
   gui_comm_rx_buffer_add(uart_message_buf);
   HAL_UART_Receive_IT(&uart3, &uart_message_buf, 1);
 }
+#endif
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){
+  if(huart != &uart3) return;
+
+#if UART_RX_USE_DMA
+  uart_rx_dma_update(); // Keep what arrived before the error
+#endif
+  // The HAL stops reception on overrun/framing errors, start it again
+  uart_rx_start();
+}
 
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){
   state = READY;
 }
 
 void USART3_IRQHandler(void){
+#if UART_RX_USE_DMA
+  if(__HAL_UART_GET_FLAG(&uart3, UART_FLAG_IDLE) && __HAL_UART_GET_IT_SOURCE(&uart3, UART_IT_IDLE)){
+    __HAL_UART_CLEAR_IDLEFLAG(&uart3);
+    uart_rx_dma_update(); // Line went quiet, usually right after the end of a frame
+  }
+#endif
   HAL_UART_IRQHandler(&uart3);
 }
 
@@ -0,0 +1,39 @@
+//========================================================================================================== INCLUDES
+#include "uart_dma_rx.h"
+#include <stddef.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+
+//========================================================================================================== FUNCTIONS DEFINITIONS
+void uart_dma_rx_init(uart_dma_rx_t* rx, const uint8_t* buffer, uint16_t size, uart_dma_rx_sink_t sink){
+  rx->buffer = buffer;
+  rx->size = size;
+  rx->last_position = 0;
+  rx->sink = sink;
+}
+
+void uart_dma_rx_update(uart_dma_rx_t* rx, uint16_t position){
+  if(position >= rx->size){ // Counter reloaded, the DMA is back at the start
+    position = 0;
+  }
+
+  if(position == rx->last_position){
+    return;
+  }
+
+  if(position > rx->last_position){
+    rx->sink(rx->buffer + rx->last_position, position - rx->last_position);
+  }
+  else{ // DMA wrapped around, tail of the buffer first
+    rx->sink(rx->buffer + rx->last_position, rx->size - rx->last_position);
+    if(position > 0){
+      rx->sink(rx->buffer, position);
+    }
+  }
+
+  rx->last_position = position;
+}
@@ -0,0 +1,39 @@
+#ifndef UART_DMA_RX_H_
+#define UART_DMA_RX_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//========================================================================================================== INCLUDES
+#include <stdint.h>
+
+//========================================================================================================== DEFINITIONS AND MACROS
+typedef void (*uart_dma_rx_sink_t)(const uint8_t* data, uint16_t data_size);
+
+// Bookkeeping for a UART receiving into a circular DMA buffer.
+// The DMA only reports how far it has written, this remembers how far the
+// data was already handed over so every new byte reaches the sink exactly once.
+// Hardware independent so the same code runs against a fake DMA in host tests.
+typedef struct{
+  const uint8_t* buffer;      // Circular buffer the DMA writes to
+  uint16_t size;              // Length of the buffer
+  uint16_t last_position;     // First byte not yet handed to the sink
+  uart_dma_rx_sink_t sink;    // Receives the new bytes, at most two calls per update
+}uart_dma_rx_t;
+
+//========================================================================================================== VARIABLES
+
+//========================================================================================================== FUNCTIONS DECLARATIONS
+void uart_dma_rx_init(uart_dma_rx_t* rx, const uint8_t* buffer, uint16_t size, uart_dma_rx_sink_t sink);
+
+// Call on idle line, half transfer and transfer complete events with the DMA write
+// position (buffer size - remaining transfer count). The consumer has to keep up
+// with the DMA, a whole buffer written between two updates can not be detected.
+void uart_dma_rx_update(uart_dma_rx_t* rx, uint16_t position);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UART_DMA_RX_H_ */
@@ -50,6 +50,10 @@
 #define configRECORD_STACK_HIGH_ADDRESS              1
 #define configUSE_STATS_FORMATTING_FUNCTIONS         1
 
+/* Notification 0 is left to the application, the WiFi sockets wrapper waits
+ * for its receive wakeups on notification 1. */
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES        2
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES                        0
 #define configMAX_CO_ROUTINE_PRIORITIES              ( 2 )
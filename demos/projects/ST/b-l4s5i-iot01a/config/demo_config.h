@@ -226,6 +226,26 @@ extern void vLoggingPrintf( const char * pcFormatString,
  */
 #define democonfigNETWORK_BUFFER_SIZE        ( 5 * 1024U )
 
+/**
+ * @brief RAM of the telemetry path: the scratch arenas of the network and
+ * sampling tasks, the socket receive buffers, the send coalescing buffer of the
+ * connection when democonfigSEND_COALESCE_SIZE is set and the telemetry queue,
+ * which gets whatever the others leave. With the 5 KB network buffer that is
+ * 4816 + 3456 + 2400 bytes and 5712 bytes of queue, 13 CBOR messages.
+ *
+ * Task stacks come from configTOTAL_HEAP_SIZE and are not counted, the DNS
+ * refresh task of the socket wrapper among them (configMINIMAL_STACK_SIZE * 4
+ * words, 1440 bytes).
+ */
+#define democonfigTELEMETRY_RAM_BUDGET       ( 16 * 1024U )
+
+/**
+ * @brief Receive buffers of the socket wrapper, ES_WIFI_PAYLOAD_SIZE for each
+ * of its wificonfigMAX_SOCKETS sockets. The wrapper fails the build when they
+ * need more.
+ */
+#define democonfigSOCKETS_RX_BUFFER_RAM      ( 2 * 1200U )
+
 /**
  * @brief IoTHub endpoint port.
  */
@@ -10,6 +10,7 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 
 /* Demo Specific configs. */
 #include "demo_config.h"
@@ -19,8 +20,13 @@
 
 /* Azure Provisioning/IoT Hub library includes */
 #include "azure_iot_hub_client.h"
+#include "azure_iot_hub_client_properties.h"
 #include "azure_iot_provisioning_client.h"
 
+/* Azure JSON includes */
+#include "azure_iot_json_reader.h"
+#include "azure_iot_json_writer.h"
+
 /* Exponential backoff retry include. */
 #include "backoff_algorithm.h"
 
@@ -30,12 +36,30 @@
 /* Crypto helper header. */
 #include "azure_sample_crypto.h"
 
-/* Azure JSON includes */
-#include "azure_iot_json_writer.h"
-
 // For IoT data reading
 #include "system_data.h"
 
+// Message layouts
+#include "telemetry_schema.h"
+
+// Message and property buffers
+#include "scratch_arena.h"
+
+// Telemetry sent as changes between full messages
+#include "telemetry_delta.h"
+
+// Compact binary encoding of the same messages
+#include "telemetry_cbor.h"
+
+// Messages kept while the hub cannot be reached
+#include "telemetry_queue.h"
+
+// When the queued windows are sent
+#include "telemetry_batch.h"
+
+// Hub assigned by DPS, kept across boots
+#include "dps_assignment.h"
+
 // Overriding the asserts to let IoT connectivity continue.
 // @todo: Before restarting unsubscribing and TLS disconnect might not
 //        need to be done because the assert might be because of
@@ -104,115 +128,14 @@
 // #define sampleazureiotMESSAGE                                 "Hello World : %d !"
 
 /**
- * @brief Telemetry Objects and Values
- */
-// Primary objects
-#define sampleazureiotTELEMETRY_OBJECT_CCU                        ( "ccu" )
-#define sampleazureiotTELEMETRY_OBJECT_UNITS                      ( "units" )
-#define sampleazureiotTELEMETRY_OBJECT_TANK                       ( "tank" )
-
-// Secondary
-#define sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS        ( "sensor_measurements" )
-
-// Sensors
-#define sampleazureiotTELEMETRY_O2                                ( "o2" )
-#define sampleazureiotTELEMETRY_MASSFLOW                          ( "mass_flow" )
-#define sampleazureiotTELEMETRY_CO2                               ( "co2" )
-#define sampleazureiotTELEMETRY_TANK_PRESSURE                     ( "tank_pressure" )
-#define sampleazureiotTELEMETRY_TEMPERATURE                       ( "temperature" )
-#define sampleazureiotTELEMETRY_HUMIDITY                          ( "humidity" )
-#define sampleazureiotTELEMETRY_VACUUM_SENSOR                     ( "vacuum_sensor" )
-#define sampleazureiotTELEMETRY_AMBIENT_HUMIDITY                  ( "ambient_humidity" )
-#define sampleazureiotTELEMETRY_AMBIENT_TEMPERATURE               ( "ambient_temperature" )
-#define sampleazureiotTELEMETRY_PROPOTIONAL_VALVE_SENSOR          ( "propotional_valve_pressure" )
-
-// Heaters and catridge objects
-#define sampleazureiotTELEMETRY_OBJECT_CARTRIDGES                 ( "cartridges" )
-#define sampleazureiotTELEMETRY_OBJECT_ZONES                      ( "zones" )
-
-// Status related
-#define sampleazureiotTELEMETRY_OBJECT_COMPONENT_STATUS           ( "component_status" )
-#define sampleazureiotTELEMETRY_OBJECT_CCU_STATUS                 ( "ccu_status" )
-#define sampleazureiotTELEMETRY_OBJECT_UNIT_STATUS                ( "unit_status" )
-
-// Telemetry
-#define sampleazureiotTELEMETRY_MEASUREMENT_COUNT                 ( "measurement_count" )
-#define sampleazureiotMESSAGE_VERSION                             ( "version" )
-#define sampleazureiot_TIMESTAMP_UTC                              ( "timestamp_utc" )
-#define sampleazureiotMESSAGE_TYPE                                ( "message_type" )
-#define sampleazureiotTELEMETRY_SERIAL_NUMBER                     ( "serial_number" )
-#define sampleazureiotTELEMETRY_SLOT                              ( "slot" )
-#define sampleazureiotTELEMETRY_CCU_STATE                         ( "ccu_state" )
-#define sampleazureiotTELEMETRY_UNIT_STATE                        ( "unit_state" )
-#define sampleazureiotTELEMETRY_SENSOR_NAME                       ( "name" )
-#define sampleazureiotTELEMETRY_ZONE                              ( "zone" )
-#define sampleazureiotTELEMETRY_STATUS                            ( "status" )
-#define sampleazureiotTELEMETRY_AVG                               ( "avg" )
-#define sampleazureiotTELEMETRY_MAX                               ( "max" )
-#define sampleazureiotTELEMETRY_MIN                               ( "min" )
-#define sampleazureiotTELEMETRY_MEDIAN                            ( "median" )
-
-// Error msg
-#define sampleazureiotTELEMETRY_CURRENT_STATE                     ( "current_state" )
-#define sampleazureiotTELEMETRY_PREVIOUS_STATE                    ( "previous_state" )
-#define sampleazureiotTELEMETRY_ERROR_CODE                        ( "error_code" )
-#define sampleazureiotTELEMETRY_LOCATION                          ( "location" )
-#define sampleazureiotTELEMETRY_OBJECT_ERRORS                     ( "errors" )
-#define sampleazureiotTELEMETRY_OBJECT_BODY                       ( "body" )
-
-// components status
-#define sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_BEFORE_WATER_TRAP             ( "two_way_gas_valve_before_water_trap" )
-#define sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_IN_WATER_TRAP                 ( "two_way_gas_valve_in_water_trap" )
-#define sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_AFTER_WATER_TRAP              ( "two_way_gas_valve_after_water_trap" )
-#define sampleazureiotTELEMETRY_VACUUM_RELEASE_VALVE_IN_WATER_TRAP              ( "vacuum_release_valve_in_water_trap" )
-#define sampleazureiotTELEMETRY_THREE_WAY_VACUUM_RELEASE_VALVE_BEFORE_CONDENSER ( "three_way_vacuum_release_valve_before_condenser" )
-#define sampleazureiotTELEMETRY_THREE_WAY_VALVE_AFTER_VACUUM_PUMP               ( "three_way_valve_after_vacuum_pump" )
-#define sampleazureiotTELEMETRY_COMPRESSOR                                      ( "compressor" )
-#define sampleazureiotTELEMETRY_VACUUM_PUMP                                     ( "vacuum_pump" )
-#define sampleazureiotTELEMETRY_CONDENSER                                       ( "condenser" )
-// Skid/Unit status
-#define sampleazureiotTELEMETRY_ERROR_FLAG                                      ( "error_flag" )
-#define sampleazureiotTELEMETRY_HALT_FLAG                                       ( "halt_flag" )
-#define sampleazureiotTELEMETRY_RESET_FLAG                                      ( "reset_flag" )
-#define sampleazureiotTELEMETRY_JUST_STARTED_FLAG                               ( "just_started_flag" )
-#define sampleazureiotTELEMETRY_SETUP_STATE_SYNCHING_FLAG                       ( "setup_state_synching_flag" )
-// Valve status
-#define sampleazureiotTELEMETRY_FAN_STATUS                                      ( "fan_status" )
-#define sampleazureiotTELEMETRY_BUTTERFLY_VALVE_1_STATUS                        ( "butterfly_valve_1_status" )
-#define sampleazureiotTELEMETRY_BUTTERFLY_VALVE_2_STATUS                        ( "butterfly_valve_2_status" )
-
-// versions
-#define sampleazureiot_AZURE_SDK_VERSION                                        ( "azure_sdk_version" )
-#define sampleazureiot_FIRMWARE_VERSIONS                                        ( "firmware_versions" )
-#define sampleazureiot_HARDWARE_VERSIONS                                        ( "hardware_versions" )
-#define sampleazureiot_IDENTIFIER                                               ( "identifier" )
-
-// constant Values
-#define telemetry_MESSAGE_VERSION           "1.0"
-#define telemetry_MEASUREMENT_COUNT         30              // Constant for now
-#define telemetry_MESSAGE_TYPE              "telemetry"
+ * @brief Serial number reported for the CCU. The rest of the telemetry constants
+ * live with the message schemas in telemetry_schema.c.
+ */
 #ifndef FIELDLESS_SETUP
     #define telemetry_CCU_SERIAL_NUMBER         "Ccu123"        // @todo This needs to be picked from desired properties
 #else
     #define telemetry_CCU_SERIAL_NUMBER         "skytree_iot_fieldless_pilot"        // @todo This needs to be picked from desired properties
 #endif
-#define telemetry_UNIT_SERIAL_NUMBER        "Unit123"       // @todo This needs to be picked from desired properties
-#define telemetry_CARTRIDGE_SERIAL_NUMBER   "Cartridge"     // @todo This needs to be picked from desired properties
-#define telemetry_TANK_SERIAL_NUMBER        "Tank123"       // @todo This needs to be picked from desired properties
-#define bootup_MESSAGE_VERSION              "1.0"
-#define bootup_MESSAGE_TYPE                 "boot-up"
-#define error_MESSAGE_VERSION               "1.0"
-#define error_MESSAGE_TYPE                  "error"
-#define azure_sdk_version                   "0.0.0"
-#define ccu_IDENTIFIER                      "CCU"
-#define unit1_IDENTIFIER                    "UNIT1"
-#define ccu_FIRMWARE_VERSION                "0.0.0"
-#define unit1_FIRMWARE_VERSION              "0.0.0"
-#define ccu_LOCATION                        "CCU"
-#define unit1_LOCATION                      "UNIT1"
-
-// For getting the length of the telemetry names
-#define lengthof( x )                  ( sizeof( x ) - 1 )
 
 /**
  * @brief  The content type of the Telemetry message published in this example.
@@ -220,15 +143,45 @@
  *         This message property is not required to send telemetry.
  */
 // #define sampleazureiotMESSAGE_CONTENT_TYPE                    "text%2Fplain"
-#define sampleazureiotMESSAGE_CONTENT_TYPE                    "application%2Fjson"
+#if TELEMETRY_CBOR
+    #define sampleazureiotMESSAGE_CONTENT_TYPE                "application%2Fcbor"
+#else
+    #define sampleazureiotMESSAGE_CONTENT_TYPE                "application%2Fjson"
+#endif
 
 /**
  * @brief  The content encoding of the Telemetry message published in this example.
  * @remark Message properties must be url-encoded.
- *         This message property is not required to send telemetry.
+ *         This message property is not required to send telemetry, binary
+ *         messages are sent without it.
  */
 // #define sampleazureiotMESSAGE_CONTENT_ENCODING                "us-ascii"
-#define sampleazureiotMESSAGE_CONTENT_ENCODING                "utf-8"
+#if !TELEMETRY_CBOR
+    #define sampleazureiotMESSAGE_CONTENT_ENCODING            "utf-8"
+#endif
+
+/**
+ * @brief Message layouts of the encoding the build selects, see TELEMETRY_CBOR.
+ */
+#if TELEMETRY_CBOR
+    typedef telemetry_cbor_schema_t MessageSchema_t;
+    #define sampleazureiotWRITE_MESSAGE      telemetry_cbor_write
+    #define sampleazureiotTELEMETRY_SCHEMA   telemetry_message_cbor
+    #define sampleazureiotERROR_SCHEMA       error_message_cbor
+    #define sampleazureiotBOOTUP_SCHEMA      bootup_message_cbor
+    #define sampleazureiotQUEUE_FORMAT       telemetry_queue_cbor
+    #define sampleazureiotLOG_MESSAGE( pcName, pucMessage, ulLength ) \
+    LogInfo( ( "%s msg: %u bytes of CBOR\r\n", pcName, ( unsigned ) ( ulLength ) ) )
+#else
+    typedef telemetry_schema_t MessageSchema_t;
+    #define sampleazureiotWRITE_MESSAGE      telemetry_schema_write
+    #define sampleazureiotTELEMETRY_SCHEMA   telemetry_message_schema
+    #define sampleazureiotERROR_SCHEMA       error_message_schema
+    #define sampleazureiotBOOTUP_SCHEMA      bootup_message_schema
+    #define sampleazureiotQUEUE_FORMAT       telemetry_queue_json
+    #define sampleazureiotLOG_MESSAGE( pcName, pucMessage, ulLength ) \
+    LogInfo( ( "%s msg: %.*s and ulScratchBufferLength =%d\r\n", pcName, ulLength, pucMessage, ulLength ) )
+#endif
 
 /**
  * @brief The reported property payload to send to IoT Hub
@@ -263,7 +216,11 @@
 */
 #define sampleazureiotDELAY_AT_START                          ( sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS - pdMS_TO_TICKS( 10000U ) )
 
-#define sampleazureiotDELAY_ON_ERROR                          ( pdMS_TO_TICKS( 5000U ) )
+/**
+ * @brief Delay (in ticks) between reported property updates and pipeline stats,
+ * every other publish period.
+ */
+#define sampleazureiotREPORT_INTERVAL_TICKS                   ( 2 * sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS )
 
 /**
  * @brief Transport timeout in milliseconds for transport send and receive.
@@ -279,6 +236,64 @@
  * @brief Wait timeout for subscribe to finish.
  */
 #define sampleazureiotSUBSCRIBE_TIMEOUT                       ( 10 * 1000U )
+
+/**
+ * @brief Keep the IoT Hub session open across publish cycles.
+ *
+ * When 1, the MQTT/TLS connection is only torn down when the transport reports
+ * an error. When 0, the connection is recycled every
+ * sampleazureiotMAX_PUBLISH_COUNT publishes, as the original demo did.
+ */
+#ifndef sampleazureiotPERSISTENT_CONNECTION
+    #define sampleazureiotPERSISTENT_CONNECTION               ( 1 )
+#endif
+
+/**
+ * @brief Number of publishes per connection when the session is not persistent.
+ */
+#define sampleazureiotMAX_PUBLISH_COUNT                       ( 15 )
+
+/**
+ * @brief Sampling windows sent together in one telemetry message, each window
+ * keeps its own timestamp. 1 sends every window as it is taken.
+ *
+ * Set at run time through the telemetryBatchSize writable property, between 1
+ * and TELEMETRY_BATCH_MAX_SIZE.
+ */
+#ifndef sampleazureiotTELEMETRY_BATCH_SIZE
+    #define sampleazureiotTELEMETRY_BATCH_SIZE                ( 1U )
+#endif
+
+/**
+ * @brief Seconds a window waits for the rest of its batch before it is sent
+ * anyway, e.g. when nothing changed and no delta was queued.
+ *
+ * Set at run time through the telemetryFlushTimeout writable property, up to
+ * TELEMETRY_BATCH_MAX_FLUSH_TIMEOUT.
+ */
+#ifndef sampleazureiotTELEMETRY_FLUSH_TIMEOUT_S
+    #define sampleazureiotTELEMETRY_FLUSH_TIMEOUT_S           ( 300U )
+#endif
+
+/**
+ * @brief Writable properties setting the batching, acknowledged with the value in use.
+ */
+#define sampleazureiotBATCH_SIZE_PROPERTY                     "telemetryBatchSize"
+#define sampleazureiotFLUSH_TIMEOUT_PROPERTY                  "telemetryFlushTimeout"
+#define sampleazureiotPROPERTY_SUCCESS                        "success"
+#define sampleazureiotPROPERTY_OUT_OF_RANGE                   "out of range, value not changed"
+
+/**
+ * @brief Room the PUBLISH packet needs in the MQTT buffer besides the payload:
+ * fixed header, topic with the device and module ID, the property bag and the
+ * packet identifier.
+ */
+#define sampleazureiotPUBLISH_OVERHEAD                        ( 384U )
+
+/**
+ * @brief Largest telemetry batch, whatever the MQTT buffer holds besides the topic.
+ */
+#define sampleazureiotBATCH_BUFFER_LENGTH                     ( democonfigNETWORK_BUFFER_SIZE - sampleazureiotPUBLISH_OVERHEAD )
 /*-----------------------------------------------------------*/
 
 /**
@@ -291,15 +306,127 @@ uint64_t ullGetUnixTime( void );
 
 /* Define buffer for IoT Hub info.  */
 #ifdef democonfigENABLE_DPS_SAMPLE
-    static uint8_t ucSampleIotHubHostname[ 128 ];
-    static uint8_t ucSampleIotHubDeviceId[ 128 ];
+    static dps_assignment_t xDpsAssignment;
     static AzureIoTProvisioningClient_t xAzureIoTProvisioningClient;
 #endif /* democonfigENABLE_DPS_SAMPLE */
 
-#define SCRATCH_BUFFER_LENGTH 3200
-#define MINI_SCRATCH_BUFFER_LENGTH 2304
-static uint8_t ucPropertyBuffer[ 80 ];
+/**
+ * @brief Scratch space of the network task: the telemetry property bag lives
+ * for a connection, each batch and reported property until it is sent.
+ */
+#define PROPERTY_BUFFER_LENGTH 80
+#define SCRATCH_BUFFER_LENGTH ( PROPERTY_BUFFER_LENGTH + sampleazureiotBATCH_BUFFER_LENGTH )
 static uint8_t ucScratchBuffer[ SCRATCH_BUFFER_LENGTH ];
+static scratch_arena_t xScratchArena;
+
+/**
+ * @brief Scratch space of the sampling task, each message is written there
+ * and copied into the telemetry queue.
+ */
+#define SAMPLE_SCRATCH_BUFFER_LENGTH 3456    // Longest telemetry, see test_scratch_arena
+static uint8_t ucSampleScratchBuffer[ SAMPLE_SCRATCH_BUFFER_LENGTH ];
+static scratch_arena_t xSampleScratchArena;
+
+/**
+ * @brief Messages built in the scratch arenas, peak usage is kept per type.
+ */
+typedef enum
+{
+    eMessageBootUp = 0,
+    eMessageError,
+    eMessageTelemetry,
+    eMessageReportedProperties,
+    eMessageBatch,
+    eMessageTypeCount
+} MessageType_t;
+
+static uint32_t ulScratchPeak[ eMessageTypeCount ];
+
+/**
+ * @brief Messages waiting for the IoT Hub, sent oldest first and several per
+ * publish. The sampling task queues them and the network task sends them, the
+ * queue is bounded: when the network falls behind, whether for a slow TLS
+ * write or while the hub cannot be reached, sampling goes on and the oldest
+ * messages are dropped.
+ * @todo Spill to the QSPI flash once the board has a driver for it.
+ */
+#ifdef democonfigTELEMETRY_RAM_BUDGET
+    /* The coalescing buffer is allocated by the transport for the one connection. */
+    #ifdef democonfigSEND_COALESCE_SIZE
+        #define TELEMETRY_SEND_COALESCE_RAM    democonfigSEND_COALESCE_SIZE
+    #else
+        #define TELEMETRY_SEND_COALESCE_RAM    0
+    #endif
+    #define TELEMETRY_QUEUE_LENGTH    ( democonfigTELEMETRY_RAM_BUDGET - SCRATCH_BUFFER_LENGTH - SAMPLE_SCRATCH_BUFFER_LENGTH - democonfigSOCKETS_RX_BUFFER_RAM - TELEMETRY_SEND_COALESCE_RAM )
+#else
+    #define TELEMETRY_QUEUE_LENGTH    8192    // A keyframe interval of JSON telemetry, 19 CBOR messages
+#endif
+
+/* The longest message and its two byte length have to fit. */
+#if TELEMETRY_QUEUE_LENGTH < ( SAMPLE_SCRATCH_BUFFER_LENGTH + 2 )
+    #error "democonfigTELEMETRY_RAM_BUDGET leaves no room for the telemetry queue."
+#endif
+static uint8_t ucTelemetryQueueBuffer[ TELEMETRY_QUEUE_LENGTH ];
+static telemetry_queue_t xTelemetryQueue;
+
+/**
+ * @brief Guards the telemetry queue, the batching state, the telemetry delta and
+ * data. Only taken for copies and encoding, never across a network call.
+ */
+static SemaphoreHandle_t xTelemetryQueueMutex;
+static StaticSemaphore_t xTelemetryQueueMutexBuffer;
+
+/**
+ * @brief When the decoder saw the state transition of the error message queued
+ * last, until the message is sent.
+ */
+static bool xAlarmQueued;
+static TickType_t xAlarmTick;
+
+/**
+ * @brief Batching in use, see sampleazureiotTELEMETRY_BATCH_SIZE. The batch is
+ * due once it holds that many messages, its oldest one waited the timeout, or
+ * an error or boot-up message was queued.
+ */
+static telemetry_batch_t xTelemetryBatch;
+
+/**
+ * @brief Stages a message goes through, from sampling to the IoT Hub.
+ */
+typedef enum
+{
+    eStageSample = 0, /**< Reading the status, encoding and queuing one window. */
+    eStageQueue,      /**< Oldest message of a batch waiting in the queue. */
+    eStageSend,       /**< Handing a batch to the client, TLS write included. */
+    eStageAlarm,      /**< Lock_State seen by the decoder until its error message is sent. */
+    eStageCount
+} PipelineStage_t;
+
+/**
+ * @brief Latency of each pipeline stage. Each stage is written by one task only,
+ * the log line reading them all may see a cycle old value.
+ */
+static telemetry_latency_t xStageStats[ eStageCount ];
+
+/**
+ * @brief Stack and priority of the sampling task. It runs above the network
+ * task so a stalled TLS write does not delay sampling.
+ */
+#ifndef sampleazureiotSAMPLE_TASK_STACKSIZE
+    #define sampleazureiotSAMPLE_TASK_STACKSIZE               ( 1024U )
+#endif
+#define sampleazureiotSAMPLE_TASK_PRIORITY                    ( tskIDLE_PRIORITY + 1 )
+
+/**
+ * @brief Stack and priority of the alarm task, woken by the decoder on a Lock_State
+ * or Safe_State transition. Above sampling, so the error message is queued at once.
+ */
+#ifndef sampleazureiotALARM_TASK_STACKSIZE
+    #define sampleazureiotALARM_TASK_STACKSIZE                ( 1024U )
+#endif
+#define sampleazureiotALARM_TASK_PRIORITY                     ( tskIDLE_PRIORITY + 2 )
+
+static TaskHandle_t xAlarmTaskHandle;
 
 /* Each compilation unit must define the NetworkContext struct. */
 struct NetworkContext
@@ -309,7 +436,21 @@ struct NetworkContext
 
 static AzureIoTHubClient_t xAzureIoTHubClient;
 
-static bool xBootUpMessageSent = false;
+/**
+ * @brief Counters used to measure what the IoT Hub connection costs.
+ */
+typedef struct SampleConnectionStats
+{
+    uint32_t ulHandshakeCount;       /**< TLS handshakes completed, DPS included. */
+    uint32_t ulProvisioningCount;    /**< DPS registrations, none when the stored hub was used. */
+    TickType_t xFirstTelemetryTicks; /**< Ticks from boot to the first telemetry the hub took, 0 until then. */
+    uint32_t ulReconnectCount;       /**< Hub sessions re-established after a loss. */
+    TickType_t xLastReconnectTicks;  /**< Ticks from losing the session to subscriptions restored. */
+    TickType_t xMaxReconnectTicks;   /**< Worst reconnect latency seen so far. */
+    TickType_t xTotalReconnectTicks; /**< Sum of all reconnect latencies. */
+} SampleConnectionStats_t;
+
+static SampleConnectionStats_t xConnectionStats = { 0 };
 
 // externs
 extern RTC_HandleTypeDef xHrtc;
@@ -322,31 +463,57 @@ sequence_state_t xUnitLastState;
 #ifdef democonfigENABLE_DPS_SAMPLE
 
 /**
- * @brief Gets the IoT Hub endpoint and deviceId from Provisioning service.
+ * @brief Gets the IoT Hub endpoint and deviceId from Provisioning service into
+ *   xDpsAssignment and stores them for the next boots.
  *   This function will block for Provisioning service for result or return failure.
  *
  * @param[in] pXNetworkCredentials  Network credential used to connect to Provisioning service
- * @param[out] ppucIothubHostname  Pointer to uint8_t* IoT Hub hostname return from Provisioning Service
- * @param[in,out] pulIothubHostnameLength  Length of hostname
- * @param[out] ppucIothubDeviceId  Pointer to uint8_t* deviceId return from Provisioning Service
- * @param[in,out] pulIothubDeviceIdLength  Length of deviceId
+ * @param[in] pcLastHostname  Hub assigned before, resolved while the registration is
+ *   polled in case it is assigned again. NULL for none, only read while polling.
  */
     static uint32_t prvIoTHubInfoGet( NetworkCredentials_t * pXNetworkCredentials,
-                                      uint8_t ** ppucIothubHostname,
-                                      uint32_t * pulIothubHostnameLength,
-                                      uint8_t ** ppucIothubDeviceId,
-                                      uint32_t * pulIothubDeviceIdLength );
+                                      const char * pcLastHostname );
+
+/**
+ * @brief Load the IoT Hub assigned on an earlier boot into xDpsAssignment.
+ *
+ * @return true when one is stored for the configured ID scope and registration ID.
+ */
+    static bool prvLoadDpsAssignment( void );
+
+/**
+ * @brief Register again after the assigned IoT Hub refused the device or went
+ *   away, the stored assignment is forgotten first.
+ */
+    static uint32_t prvReprovision( NetworkCredentials_t * pXNetworkCredentials );
 
 #endif /* democonfigENABLE_DPS_SAMPLE */
 
 /**
- * @brief The task used to demonstrate the MQTT API.
+ * @brief The task used to demonstrate the MQTT API. It owns the IoT Hub client
+ * and sends what the sampling task queued.
  *
  * @param[in] pvParameters Parameters as passed at the time of task creation. Not
  * used in this example.
  */
 static void prvAzureDemoTask( void * pvParameters );
 
+/**
+ * @brief Samples the SKID and unit status every publish period and queues the
+ * messages, whatever state the IoT Hub connection is in.
+ *
+ * @param[in] pvParameters Not used.
+ */
+static void prvSampleTask( void * pvParameters );
+
+/**
+ * @brief Queues the error message as soon as the decoder sees the SKID or unit
+ * go into Lock_State, the demo task sends it within one process loop interval.
+ *
+ * @param[in] pvParameters Not used.
+ */
+static void prvAlarmTask( void * pvParameters );
+
 /**
  * @brief Connect to endpoint with reconnection retries.
  *
@@ -364,6 +531,25 @@ static uint32_t prvConnectToServerWithBackoffRetries( const char * pcHostName,
                                                       uint32_t ulPort,
                                                       NetworkCredentials_t * pxNetworkCredentials,
                                                       NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Run the IoT Hub process loop until the given time has elapsed.
+ *
+ * Keeps the MQTT keep-alive and incoming messages serviced while the demo is
+ * waiting between publishes.
+ *
+ * @param xTicksToWait Time in ticks to keep the process loop running.
+ * @return eAzureIoTSuccess, or the first process loop error.
+ */
+static AzureIoTResult_t prvProcessLoopForTicks( TickType_t xTicksToWait );
+
+/**
+ * @brief Claims the message just written at the top of a scratch arena and
+ * updates the peak usage of its type.
+ */
+static void prvClaimScratch( scratch_arena_t * pxArena,
+                             MessageType_t xType,
+                             uint32_t ulMessageLength );
 /*-----------------------------------------------------------*/
 
 /**
@@ -407,109 +593,61 @@ static void prvHandleCommand( AzureIoTHubClientCommandRequest_t * pxMessage,
 }
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Property mesage callback handler
- */
-static void prvHandlePropertiesMessage( AzureIoTHubClientPropertiesResponse_t * pxMessage,
-                                        void * pvContext )
+static void prvSkipPropertyAndValue( AzureIoTJSONReader_t * pxReader )
 {
-    ( void ) pvContext;
-
-    switch( pxMessage->xMessageType )
-    {
-        case eAzureIoTHubPropertiesRequestedMessage:
-            LogInfo( ( "Device property document GET received" ) );
-            break;
-
-        case eAzureIoTHubPropertiesReportedResponseMessage:
-            LogInfo( ( "Device property reported property response received" ) );
-            break;
+    AzureIoTResult_t xResult;
 
-        case eAzureIoTHubPropertiesWritablePropertyMessage:
-            LogInfo( ( "Device property desired property received" ) );
-            break;
+    xResult = AzureIoTJSONReader_NextToken( pxReader );
+    configASSERT( xResult == eAzureIoTSuccess );
 
-        default:
-            LogError( ( "Unknown property message" ) );
-    }
+    xResult = AzureIoTJSONReader_SkipChildren( pxReader );
+    configASSERT( xResult == eAzureIoTSuccess );
 
-    LogInfo( ( "Property document payload : %.*s \r\n",
-               ( int ) pxMessage->ulPayloadLength,
-               ( const char * ) pxMessage->pvMessagePayload ) );
+    xResult = AzureIoTJSONReader_NextToken( pxReader );
+    configASSERT( xResult == eAzureIoTSuccess );
 }
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Setup transport credentials.
+ * @brief Acknowledges a writable property with the value in use, written in
+ * the scratch arena above whatever the session holds.
  */
-static uint32_t prvSetupNetworkCredentials( NetworkCredentials_t * pxNetworkCredentials )
-{
-    pxNetworkCredentials->xDisableSni = pdFALSE;
-    /* Set the credentials for establishing a TLS connection. */
-    pxNetworkCredentials->pucRootCa = ( const unsigned char * ) democonfigROOT_CA_PEM;
-    pxNetworkCredentials->xRootCaSize = sizeof( democonfigROOT_CA_PEM );
-    #ifdef democonfigCLIENT_CERTIFICATE_PEM
-        pxNetworkCredentials->pucClientCert = ( const unsigned char * ) democonfigCLIENT_CERTIFICATE_PEM;
-        pxNetworkCredentials->xClientCertSize = sizeof( democonfigCLIENT_CERTIFICATE_PEM );
-        pxNetworkCredentials->pucPrivateKey = ( const unsigned char * ) democonfigCLIENT_PRIVATE_KEY_PEM;
-        pxNetworkCredentials->xPrivateKeySize = sizeof( democonfigCLIENT_PRIVATE_KEY_PEM );
-    #endif
-
-    return 0;
-}
-/*-----------------------------------------------------------*/
-
-// Scratch buffers, improve these later
-static uint8_t ucScratchTempBuffer[ SCRATCH_BUFFER_LENGTH ];
-static uint8_t ucScratchTempHalfBuffer[ MINI_SCRATCH_BUFFER_LENGTH ];
-static uint8_t ucScratchTempHalfBuffer2[ MINI_SCRATCH_BUFFER_LENGTH ];
-
-uint32_t prvCreateSkidComponentStatusTelemetry( SKID_iot_status_t skid_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+static void prvReportWritableProperty( const char * pcName,
+                                       uint32_t ulValue,
+                                       int32_t lStatus,
+                                       uint32_t ulVersion,
+                                       const char * pcDescription )
 {
     AzureIoTResult_t xResult;
     AzureIoTJSONWriter_t xWriter;
+    scratch_arena_mark_t xMessageMark = scratch_arena_mark( &xScratchArena );
+    uint8_t * pucPayload;
+    uint32_t ulRemaining = scratch_arena_remaining( &xScratchArena, &pucPayload );
     int32_t lBytesWritten;
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
+    xResult = AzureIoTJSONWriter_Init( &xWriter, pucPayload, ulRemaining );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    // Begin top object
     xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_BEFORE_WATER_TRAP, lengthof( sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_BEFORE_WATER_TRAP ),
-                                                                ( uint8_t * )valve_status_stringified[skid_data.two_way_gas_valve_before_water_trap], strlen(valve_status_stringified[skid_data.two_way_gas_valve_before_water_trap]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_IN_WATER_TRAP, lengthof( sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_IN_WATER_TRAP ),
-                                                                ( uint8_t * )valve_status_stringified[skid_data.two_way_gas_valve_in_water_trap], strlen(valve_status_stringified[skid_data.two_way_gas_valve_in_water_trap]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_AFTER_WATER_TRAP, lengthof( sampleazureiotTELEMETRY_TWO_WAY_GAS_VALVE_AFTER_WATER_TRAP ),
-                                                                ( uint8_t * )valve_status_stringified[skid_data.two_way_gas_valve_after_water_trap], strlen(valve_status_stringified[skid_data.two_way_gas_valve_after_water_trap]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_VACUUM_RELEASE_VALVE_IN_WATER_TRAP, lengthof( sampleazureiotTELEMETRY_VACUUM_RELEASE_VALVE_IN_WATER_TRAP ),
-                                                                ( uint8_t * )valve_status_stringified[skid_data.vacuum_release_valve_in_water_trap], strlen(valve_status_stringified[skid_data.vacuum_release_valve_in_water_trap]));
+    xResult = AzureIoTHubClientProperties_BuilderBeginResponseStatus( &xAzureIoTHubClient,
+                                                                      &xWriter,
+                                                                      ( const uint8_t * ) pcName,
+                                                                      strlen( pcName ),
+                                                                      lStatus,
+                                                                      ulVersion,
+                                                                      ( const uint8_t * ) pcDescription,
+                                                                      strlen( pcDescription ) );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_THREE_WAY_VACUUM_RELEASE_VALVE_BEFORE_CONDENSER, lengthof( sampleazureiotTELEMETRY_THREE_WAY_VACUUM_RELEASE_VALVE_BEFORE_CONDENSER ),
-                                                                ( uint8_t * )three_way_valve_stringified[skid_data.three_way_vacuum_release_valve_before_condenser],
-                                                                strlen(three_way_valve_stringified[skid_data.three_way_vacuum_release_valve_before_condenser]));
+    xResult = AzureIoTJSONWriter_AppendInt32( &xWriter, ( int32_t ) ulValue );
     configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_THREE_WAY_VALVE_AFTER_VACUUM_PUMP, lengthof( sampleazureiotTELEMETRY_THREE_WAY_VALVE_AFTER_VACUUM_PUMP ),
-                                                                ( uint8_t * )three_way_valve_stringified[skid_data.three_valve_after_vacuum_pump],
-                                                                strlen(three_way_valve_stringified[skid_data.three_valve_after_vacuum_pump]));
-    configASSERT( xResult == eAzureIoTSuccess )
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_COMPRESSOR, lengthof( sampleazureiotTELEMETRY_COMPRESSOR ),
-                                                                ( uint8_t * )component_status_stringified[skid_data.compressor], strlen(component_status_stringified[skid_data.compressor]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_VACUUM_PUMP, lengthof( sampleazureiotTELEMETRY_VACUUM_PUMP ),
-                                                                ( uint8_t * )component_status_stringified[skid_data.vacuum_pump], strlen(component_status_stringified[skid_data.vacuum_pump]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_CONDENSER, lengthof( sampleazureiotTELEMETRY_CONDENSER ),
-                                                                ( uint8_t * )component_status_stringified[skid_data.condenser], strlen(component_status_stringified[skid_data.condenser]));
+    xResult = AzureIoTHubClientProperties_BuilderEndResponseStatus( &xAzureIoTHubClient,
+                                                                    &xWriter );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    // End top object
     xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
     configASSERT( xResult == eAzureIoTSuccess );
 
@@ -517,1337 +655,686 @@ uint32_t prvCreateSkidComponentStatusTelemetry( SKID_iot_status_t skid_data, uin
 
     if( lBytesWritten < 0 )
     {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+        LogError( ( "Error getting the bytes written for the properties confirmation JSON" ) );
     }
+    else
+    {
+        prvClaimScratch( &xScratchArena, eMessageReportedProperties, ( uint32_t ) lBytesWritten );
+        xResult = AzureIoTHubClient_SendPropertiesReported( &xAzureIoTHubClient, pucPayload, lBytesWritten, NULL );
 
-    // LogInfo( ( "Skid component status data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+        if( xResult != eAzureIoTSuccess )
+        {
+            LogError( ( "There was an error sending the reported properties: 0x%08x", xResult ) );
+        }
+    }
 
-    return ( uint32_t ) lBytesWritten;
+    scratch_arena_reset( &xScratchArena, xMessageMark );
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateUnitComponentStatusTelemetry( UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Reads the value of the writable property the reader is at and hands it
+ * to the setter, which refuses it when out of range. The value in use, pulValue,
+ * is acknowledged either way.
+ */
+static AzureIoTResult_t prvUpdateWritableProperty( AzureIoTJSONReader_t * pxReader,
+                                                   uint32_t ulVersion,
+                                                   const char * pcName,
+                                                   bool ( * pxSetValue )( telemetry_batch_t * pxBatch, int32_t lValue ),
+                                                   const uint32_t * pulValue )
 {
     AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+    int32_t lNewValue;
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
+    xResult = AzureIoTJSONReader_NextToken( pxReader );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+    xResult = AzureIoTJSONReader_GetTokenInt32( pxReader, &lNewValue );
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_FAN_STATUS, lengthof( sampleazureiotTELEMETRY_FAN_STATUS ),
-                                                                ( uint8_t * )component_status_stringified[unit_data.fan_status], strlen(component_status_stringified[unit_data.fan_status]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_BUTTERFLY_VALVE_1_STATUS, lengthof( sampleazureiotTELEMETRY_BUTTERFLY_VALVE_1_STATUS ),
-                                                                ( uint8_t * )valve_status_stringified[unit_data.butterfly_valve_1_status], strlen(valve_status_stringified[unit_data.butterfly_valve_1_status]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_BUTTERFLY_VALVE_2_STATUS, lengthof( sampleazureiotTELEMETRY_BUTTERFLY_VALVE_2_STATUS ),
-                                                                ( uint8_t * )valve_status_stringified[unit_data.butterfly_valve_2_status], strlen(valve_status_stringified[unit_data.butterfly_valve_2_status]));
-    configASSERT( xResult == eAzureIoTSuccess );
+    if( xResult != eAzureIoTSuccess )
+    {
+        LogError( ( "Error getting the property %s: result 0x%08x", pcName, xResult ) );
+        return xResult;
+    }
 
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
+    xResult = AzureIoTJSONReader_NextToken( pxReader );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
+    if( !pxSetValue( &xTelemetryBatch, lNewValue ) )
     {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+        LogWarn( ( "%s property %ld out of range, keeping %lu.", pcName, ( long ) lNewValue,
+                   ( unsigned long ) *pulValue ) );
+        prvReportWritableProperty( pcName, *pulValue, 400, ulVersion, sampleazureiotPROPERTY_OUT_OF_RANGE );
+    }
+    else
+    {
+        LogInfo( ( "%s property received: %lu.", pcName, ( unsigned long ) *pulValue ) );
+        prvReportWritableProperty( pcName, *pulValue, 200, ulVersion, sampleazureiotPROPERTY_SUCCESS );
     }
 
-    // LogInfo( ( "Skid component status data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
+    return eAzureIoTSuccess;
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateSkidStatusTelemetry( SKID_iot_status_t skid_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Takes the telemetry batching from the writable properties, the others are skipped.
+ */
+static AzureIoTResult_t prvProcessProperties( AzureIoTHubClientPropertiesResponse_t * pxMessage )
 {
     AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+    AzureIoTJSONReader_t xReader;
+    const uint8_t * pucComponentName = NULL;
+    uint32_t ulComponentNameLength = 0;
+    uint32_t ulVersion;
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
+    xResult = AzureIoTJSONReader_Init( &xReader, pxMessage->pvMessagePayload, pxMessage->ulPayloadLength );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+    xResult = AzureIoTHubClientProperties_GetPropertiesVersion( &xAzureIoTHubClient, &xReader, pxMessage->xMessageType, &ulVersion );
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_ERROR_FLAG, lengthof( sampleazureiotTELEMETRY_ERROR_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[skid_data.error_flag], strlen(flag_state_stringified[skid_data.error_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_HALT_FLAG, lengthof( sampleazureiotTELEMETRY_HALT_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[skid_data.halt_flag], strlen(flag_state_stringified[skid_data.halt_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_RESET_FLAG, lengthof( sampleazureiotTELEMETRY_RESET_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[skid_data.reset_flag], strlen(flag_state_stringified[skid_data.reset_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
+    if( xResult != eAzureIoTSuccess )
+    {
+        LogError( ( "Error getting the property version" ) );
+        return xResult;
+    }
 
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
+    /* Reset JSON reader to the beginning */
+    xResult = AzureIoTJSONReader_Init( &xReader, pxMessage->pvMessagePayload, pxMessage->ulPayloadLength );
     configASSERT( xResult == eAzureIoTSuccess );
 
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+    while( ( xResult = AzureIoTHubClientProperties_GetNextComponentProperty( &xAzureIoTHubClient, &xReader,
+                                                                             pxMessage->xMessageType, eAzureIoTHubClientPropertyWritable,
+                                                                             &pucComponentName, &ulComponentNameLength ) ) == eAzureIoTSuccess )
+    {
+        if( ulComponentNameLength > 0 )
+        {
+            /* There are no components on this device. */
+            prvSkipPropertyAndValue( &xReader );
+        }
+        else if( AzureIoTJSONReader_TokenIsTextEqual( &xReader, ( const uint8_t * ) sampleazureiotBATCH_SIZE_PROPERTY,
+                                                      sizeof( sampleazureiotBATCH_SIZE_PROPERTY ) - 1 ) )
+        {
+            xResult = prvUpdateWritableProperty( &xReader, ulVersion, sampleazureiotBATCH_SIZE_PROPERTY,
+                                                 telemetry_batch_set_size, &xTelemetryBatch.size );
+        }
+        else if( AzureIoTJSONReader_TokenIsTextEqual( &xReader, ( const uint8_t * ) sampleazureiotFLUSH_TIMEOUT_PROPERTY,
+                                                      sizeof( sampleazureiotFLUSH_TIMEOUT_PROPERTY ) - 1 ) )
+        {
+            xResult = prvUpdateWritableProperty( &xReader, ulVersion, sampleazureiotFLUSH_TIMEOUT_PROPERTY,
+                                                 telemetry_batch_set_flush_timeout, &xTelemetryBatch.flush_timeout );
+        }
+        else
+        {
+            prvSkipPropertyAndValue( &xReader );
+        }
 
-    if( lBytesWritten < 0 )
+        if( xResult != eAzureIoTSuccess )
+        {
+            break;
+        }
+    }
+
+    if( xResult != eAzureIoTErrorEndOfProperties )
     {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+        LogError( ( "There was an error parsing the properties: 0x%08x", xResult ) );
+        return xResult;
     }
 
-    // LogInfo( ( "Skid status data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+    LogInfo( ( "Telemetry batching: %lu windows per message, sent after %lu seconds at the latest.",
+               ( unsigned long ) xTelemetryBatch.size, ( unsigned long ) xTelemetryBatch.flush_timeout ) );
 
-    return ( uint32_t ) lBytesWritten;
+    return eAzureIoTSuccess;
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateUnitStatusTelemetry( UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Property mesage callback handler
+ */
+static void prvHandlePropertiesMessage( AzureIoTHubClientPropertiesResponse_t * pxMessage,
+                                        void * pvContext )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+    ( void ) pvContext;
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
+    LogInfo( ( "Property document payload : %.*s \r\n",
+               ( int ) pxMessage->ulPayloadLength,
+               ( const char * ) pxMessage->pvMessagePayload ) );
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+    switch( pxMessage->xMessageType )
+    {
+        case eAzureIoTHubPropertiesRequestedMessage:
+            LogInfo( ( "Device property document GET received" ) );
 
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_ERROR_FLAG, lengthof( sampleazureiotTELEMETRY_ERROR_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[unit_data.error_flag], strlen(flag_state_stringified[unit_data.error_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_HALT_FLAG, lengthof( sampleazureiotTELEMETRY_HALT_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[unit_data.halt_flag], strlen(flag_state_stringified[unit_data.halt_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_RESET_FLAG, lengthof( sampleazureiotTELEMETRY_RESET_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[unit_data.reset_flag], strlen(flag_state_stringified[unit_data.reset_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_JUST_STARTED_FLAG, lengthof( sampleazureiotTELEMETRY_JUST_STARTED_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[unit_data.just_started_flag], strlen(flag_state_stringified[unit_data.just_started_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SETUP_STATE_SYNCHING_FLAG, lengthof( sampleazureiotTELEMETRY_SETUP_STATE_SYNCHING_FLAG ),
-                                                                ( uint8_t * )flag_state_stringified[unit_data.setup_state_synching_flag], strlen(flag_state_stringified[unit_data.setup_state_synching_flag]));
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
+            if( prvProcessProperties( pxMessage ) != eAzureIoTSuccess )
+            {
+                LogError( ( "There was an error processing incoming properties" ) );
+            }
 
-    // LogInfo( ( "Unit status data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+            break;
 
-    return ( uint32_t ) lBytesWritten;
-}
+        case eAzureIoTHubPropertiesReportedResponseMessage:
+            LogInfo( ( "Device property reported property response received" ) );
+            break;
 
-uint32_t prvCreateSkidSensorTelemetry( sensor_name_t sensor_name, SKID_iot_status_t skid_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
-{
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+        case eAzureIoTHubPropertiesWritablePropertyMessage:
+            LogInfo( ( "Device property desired property received" ) );
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
+            if( prvProcessProperties( pxMessage ) != eAzureIoTSuccess )
+            {
+                LogError( ( "There was an error processing incoming properties" ) );
+            }
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+            break;
 
-    double sensor_avg = 0.0;
-    double sensor_max = 0.0;
-    double sensor_min = 0.0;
-    double sensor_median = 0.0;
-    char name[30] = {0};
-    component_status_t status;
-
-    // Get the desired sensor avg,max,min
-    switch(sensor_name){
-        // Skid sensors
-        case SKID_O2:
-            sensor_avg = skid_data.o2_sensor.stats.avg;
-            sensor_max = skid_data.o2_sensor.stats.max;
-            sensor_min = skid_data.o2_sensor.stats.min;
-            sensor_median = skid_data.o2_sensor.stats.median;
-            status = skid_data.o2_sensor.status;
-            strncpy(name, sampleazureiotTELEMETRY_O2, lengthof(sampleazureiotTELEMETRY_O2));
-        break;
-        case SKID_MASS_FLOW:
-            sensor_avg = skid_data.mass_flow.stats.avg;
-            sensor_max = skid_data.mass_flow.stats.max;
-            sensor_min = skid_data.mass_flow.stats.min;
-            sensor_median = skid_data.mass_flow.stats.median;
-            status = skid_data.mass_flow.status;
-            strncpy(name, sampleazureiotTELEMETRY_MASSFLOW, lengthof(sampleazureiotTELEMETRY_MASSFLOW));
-        break;
-        case SKID_CO2:
-            sensor_avg = skid_data.co2_sensor.stats.avg;
-            sensor_max = skid_data.co2_sensor.stats.max;
-            sensor_min = skid_data.co2_sensor.stats.min;
-            sensor_median = skid_data.co2_sensor.stats.median;
-            status = skid_data.co2_sensor.status;
-            strncpy(name, sampleazureiotTELEMETRY_CO2, lengthof(sampleazureiotTELEMETRY_CO2));
-        break;
-        case SKID_PROPOTIONAL_VALVE_SENSOR:
-            sensor_avg = skid_data.proportional_valve_pressure.stats.avg;
-            sensor_max = skid_data.proportional_valve_pressure.stats.max;
-            sensor_min = skid_data.proportional_valve_pressure.stats.min;
-            sensor_median = skid_data.proportional_valve_pressure.stats.median;
-            status = skid_data.proportional_valve_pressure.status;
-            strncpy(name, sampleazureiotTELEMETRY_PROPOTIONAL_VALVE_SENSOR, lengthof(sampleazureiotTELEMETRY_PROPOTIONAL_VALVE_SENSOR));
-        break;
-        case SKID_TEMPERATURE:
-            sensor_avg = skid_data.temperature.stats.avg;
-            sensor_max = skid_data.temperature.stats.max;
-            sensor_min = skid_data.temperature.stats.min;
-            sensor_median = skid_data.temperature.stats.median;
-            status = skid_data.temperature.status;
-            strncpy(name, sampleazureiotTELEMETRY_TEMPERATURE, lengthof(sampleazureiotTELEMETRY_TEMPERATURE));
-        break;
-        case SKID_HUMIDITY:
-            sensor_avg = skid_data.humidity.stats.avg;
-            sensor_max = skid_data.humidity.stats.max;
-            sensor_min = skid_data.humidity.stats.min;
-            sensor_median = skid_data.humidity.stats.median;
-            status = skid_data.humidity.status;
-            strncpy(name, sampleazureiotTELEMETRY_HUMIDITY, lengthof(sampleazureiotTELEMETRY_HUMIDITY));
-        break;
-        // @todo later move tank pressure out of skid list
-        case TANK_PRESSURE:
-            sensor_avg = skid_data.tank_pressure.stats.avg;
-            sensor_max = skid_data.tank_pressure.stats.max;
-            sensor_min = skid_data.tank_pressure.stats.min;
-            sensor_median = skid_data.tank_pressure.stats.median;
-            status = skid_data.tank_pressure.status;
-            strncpy(name, sampleazureiotTELEMETRY_TANK_PRESSURE, lengthof(sampleazureiotTELEMETRY_TANK_PRESSURE));
-        break;
         default:
-            LogError( ( "Invalid skid sensor selected" ) );
-            return 0;
-        break;
-    }
-
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SENSOR_NAME, lengthof( sampleazureiotTELEMETRY_SENSOR_NAME ), ( uint8_t * ) name, strlen(name));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_STATUS, lengthof( sampleazureiotTELEMETRY_STATUS ),
-                                                                ( uint8_t * )sensor_status_stringified[status], strlen(sensor_status_stringified[status]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_AVG, lengthof( sampleazureiotTELEMETRY_AVG ), sensor_avg, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MAX, lengthof( sampleazureiotTELEMETRY_MAX ), sensor_max, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MIN, lengthof( sampleazureiotTELEMETRY_MIN ), sensor_min, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MEDIAN, lengthof( sampleazureiotTELEMETRY_MEDIAN ), sensor_median, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // End of top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+            LogError( ( "Unknown property message" ) );
     }
-
-    // LogInfo( ( "Skid sensor data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateUnitSensorTelemetry( sensor_name_t sensor_name, UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Setup transport credentials.
+ */
+static uint32_t prvSetupNetworkCredentials( NetworkCredentials_t * pxNetworkCredentials )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    double sensor_avg = 0.0;
-    double sensor_max = 0.0;
-    double sensor_min = 0.0;
-    double sensor_median = 0.0;
-    char name[25] = {0};
-    component_status_t status;
-
-    // Get the desired sensor avg,max,min
-    switch(sensor_name){
-        // Skid sensors
-        case UNIT_VACUUM_SENSOR:
-            sensor_avg = unit_data.vacuum_sensor.stats.avg;
-            sensor_max = unit_data.vacuum_sensor.stats.max;
-            sensor_min = unit_data.vacuum_sensor.stats.min;
-            sensor_median = unit_data.vacuum_sensor.stats.median;
-            status = unit_data.vacuum_sensor.status;
-            strncpy(name, sampleazureiotTELEMETRY_VACUUM_SENSOR, lengthof(sampleazureiotTELEMETRY_VACUUM_SENSOR));
-        break;
-        case UNIT_AMBIENT_HUMIDITY:
-            sensor_avg = unit_data.ambient_humidity.stats.avg;
-            sensor_max = unit_data.ambient_humidity.stats.max;
-            sensor_min = unit_data.ambient_humidity.stats.min;
-            sensor_median = unit_data.ambient_humidity.stats.median;
-            status = unit_data.ambient_humidity.status;
-            strncpy(name, sampleazureiotTELEMETRY_AMBIENT_HUMIDITY, lengthof(sampleazureiotTELEMETRY_AMBIENT_HUMIDITY));
-        break;
-        case UNIT_AMBIENT_TEMPERATURE:
-            sensor_avg = unit_data.ambient_temperature.stats.avg;
-            sensor_max = unit_data.ambient_temperature.stats.max;
-            sensor_min = unit_data.ambient_temperature.stats.min;
-            sensor_median = unit_data.ambient_humidity.stats.median;
-            status = unit_data.ambient_humidity.status;
-            strncpy(name, sampleazureiotTELEMETRY_AMBIENT_TEMPERATURE, lengthof(sampleazureiotTELEMETRY_AMBIENT_TEMPERATURE));
-        break;
-        default:
-            LogError( ( "Invalid unit sensor selected" ) );
-            return 0;
-        break;
-    }
-
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SENSOR_NAME, lengthof( sampleazureiotTELEMETRY_SENSOR_NAME ), ( uint8_t * ) name, strlen(name));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_STATUS, lengthof( sampleazureiotTELEMETRY_STATUS ),
-                                                                ( uint8_t * )sensor_status_stringified[status], strlen(sensor_status_stringified[status]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_AVG, lengthof( sampleazureiotTELEMETRY_AVG ), sensor_avg, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MAX, lengthof( sampleazureiotTELEMETRY_MAX ), sensor_max, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MIN, lengthof( sampleazureiotTELEMETRY_MIN ), sensor_min, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MEDIAN, lengthof( sampleazureiotTELEMETRY_MEDIAN ), sensor_median, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // End of top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
-
-    // LogInfo( ( "Unit sensor data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+    pxNetworkCredentials->xDisableSni = pdFALSE;
+    /* Reconnects resume the last TLS session instead of a full handshake. */
+    pxNetworkCredentials->xEnableSessionResumption = pdTRUE;
+    #ifdef democonfigSEND_COALESCE_SIZE
+        /* Records share a socket send instead of one exchange with the module each. */
+        pxNetworkCredentials->xSendCoalesceSize = democonfigSEND_COALESCE_SIZE;
+    #endif
+    /* Set the credentials for establishing a TLS connection. */
+    pxNetworkCredentials->pucRootCa = ( const unsigned char * ) democonfigROOT_CA_PEM;
+    pxNetworkCredentials->xRootCaSize = sizeof( democonfigROOT_CA_PEM );
+    #ifdef democonfigCLIENT_CERTIFICATE_PEM
+        pxNetworkCredentials->pucClientCert = ( const unsigned char * ) democonfigCLIENT_CERTIFICATE_PEM;
+        pxNetworkCredentials->xClientCertSize = sizeof( democonfigCLIENT_CERTIFICATE_PEM );
+        pxNetworkCredentials->pucPrivateKey = ( const unsigned char * ) democonfigCLIENT_PRIVATE_KEY_PEM;
+        pxNetworkCredentials->xPrivateKeySize = sizeof( democonfigCLIENT_PRIVATE_KEY_PEM );
+    #endif
 
-    return ( uint32_t ) lBytesWritten;
+    return 0;
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateUnitHeatersTelemetry( uint8_t index, UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
-{
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    double sensor_avg = unit_data.heater_info[index].stats.avg;
-    double sensor_max = unit_data.heater_info[index].stats.max;
-    double sensor_min = unit_data.heater_info[index].stats.avg;
-    double sensor_median = unit_data.heater_info[index].stats.median;
-    component_status_t status = unit_data.heater_info[index].status;
-
-    xResult = AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_ZONE, lengthof( sampleazureiotTELEMETRY_ZONE ), (index % NUMBER_OF_CARTRIDGES) + 1 );
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_STATUS, lengthof( sampleazureiotTELEMETRY_STATUS ),
-                                                                ( uint8_t * )component_status_stringified[status], strlen(component_status_stringified[status]));
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_AVG, lengthof( sampleazureiotTELEMETRY_AVG ), sensor_avg, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MAX, lengthof( sampleazureiotTELEMETRY_MAX ), sensor_max, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MIN, lengthof( sampleazureiotTELEMETRY_MIN ), sensor_min, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-    xResult = AzureIoTJSONWriter_AppendPropertyWithDoubleValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MEDIAN, lengthof( sampleazureiotTELEMETRY_MEDIAN ), sensor_median, 3);
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // End of top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
-
-    // LogInfo( ( "Units sensor data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+/**
+ * @brief Everything the telemetry, error and boot-up messages are written from.
+ */
+static telemetry_data_t xTelemetryData = { .ccu_serial_number = telemetry_CCU_SERIAL_NUMBER };
 
-    return ( uint32_t ) lBytesWritten;
-}
+/**
+ * @brief What the cloud was last sent, telemetry between keyframes only carries
+ * the fields that moved past their deadband.
+ */
+static telemetry_delta_t xTelemetryDelta;
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateSkidTelemetry( SKID_iot_status_t skid_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Get current timestamp in utc format, the one the time service
+ * caches and rebuilds once a second.
+ */
+void get_timestamp_utc(char* timestamp_utc)
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Other non-nested stuff
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SERIAL_NUMBER, lengthof( sampleazureiotTELEMETRY_SERIAL_NUMBER ),
-                                                                    ( uint8_t * )telemetry_CCU_SERIAL_NUMBER, strlen(telemetry_CCU_SERIAL_NUMBER));
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_CCU_STATE, lengthof( sampleazureiotTELEMETRY_CCU_STATE ),
-                                                                    ( uint8_t * )sequence_state_stringified[skid_data.skid_state], strlen(sequence_state_stringified[skid_data.skid_state]));
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // sensor measurements
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS, lengthof( sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        // o2
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_O2, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // mass flow
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_MASS_FLOW, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // co2
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_CO2, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // proptional valve sensor
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_PROPOTIONAL_VALVE_SENSOR, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // temperature
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_TEMPERATURE, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // humidity
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-            lBytesWritten = prvCreateSkidSensorTelemetry( SKID_HUMIDITY, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-        
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // Skid status
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_CCU_STATUS, lengthof( sampleazureiotTELEMETRY_OBJECT_CCU_STATUS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-        lBytesWritten = prvCreateSkidStatusTelemetry( skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // Skid component status
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_COMPONENT_STATUS, lengthof( sampleazureiotTELEMETRY_OBJECT_COMPONENT_STATUS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-        lBytesWritten = prvCreateSkidComponentStatusTelemetry( skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // End of top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
-
-    // LogInfo( ( "Skid data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
-}
-
-uint32_t prvCreateUnit1Telemetry( UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
-{
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Other non-nested stuff
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SERIAL_NUMBER, lengthof( sampleazureiotTELEMETRY_SERIAL_NUMBER ),
-                                                                    ( uint8_t * )telemetry_UNIT_SERIAL_NUMBER, strlen(telemetry_UNIT_SERIAL_NUMBER));
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_UNIT_STATE, lengthof( sampleazureiotTELEMETRY_UNIT_STATE ),
-                                                                    ( uint8_t * )sequence_state_stringified[unit_data.unit_state], strlen(sequence_state_stringified[unit_data.unit_state]));
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // cartridges
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_CARTRIDGES, lengthof( sampleazureiotTELEMETRY_OBJECT_CARTRIDGES ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        // Begin of cartridges array
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        // Begin cartridges loop
-        // @todo: For now, we are filling by reading sequentially from 9 heaters
-        //        to make it 3 cartridges with 3 zones each per cartridge.
-        for(uint8_t cart = 0;cart<NUMBER_OF_CARTRIDGES;++cart){
-            xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            char cartridge_sl_num[15] = {0};
-            sprintf(cartridge_sl_num, "%s%d", telemetry_CARTRIDGE_SERIAL_NUMBER, cart + 1);
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SERIAL_NUMBER, lengthof( sampleazureiotTELEMETRY_SERIAL_NUMBER ),
-                                                                        ( uint8_t * )cartridge_sl_num, strlen(cartridge_sl_num));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // @todo we need to get slot number also from desired properties?
-            //       For now using sequential numbers 1, 2, 3...
-            xResult = AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SLOT, lengthof( sampleazureiotTELEMETRY_SLOT ), cart+1);
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // zones
-            {
-                xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_ZONES, lengthof( sampleazureiotTELEMETRY_OBJECT_ZONES ) );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                // Begin of Zones array
-                xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                // Zones array in a loop
-                for(uint8_t zone = 0;zone<NUMBER_OF_ZONES_PER_CARTRIDGE;++zone){
-                    // zone, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-                    lBytesWritten = prvCreateUnitHeatersTelemetry( (cart * NUMBER_OF_ZONES_PER_CARTRIDGE + zone), unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // Endof zones array
-                xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
-
-            // Endof cartridges loop
-            xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // Endof cartridges array
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // Unit status
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_UNIT_STATUS, lengthof( sampleazureiotTELEMETRY_OBJECT_UNIT_STATUS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-        lBytesWritten = prvCreateUnitStatusTelemetry( unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // component status
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_COMPONENT_STATUS, lengthof( sampleazureiotTELEMETRY_OBJECT_COMPONENT_STATUS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-        lBytesWritten = prvCreateUnitComponentStatusTelemetry( unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // sensor measurements
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS, lengthof( sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        // vacuum sensor
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-            lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_VACUUM_SENSOR, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // ambient humidity
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-            lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_AMBIENT_HUMIDITY, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        // ambient temperature
-        {
-            // Sensor: name, status, avg, max, min, median
-            memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-            lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_AMBIENT_TEMPERATURE, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-            xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
-
-    // LogInfo( ( "Unit1 data %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
+    vGetTimestampUtc( timestamp_utc );
 }
+/*-----------------------------------------------------------*/
 
-uint32_t prvCreateUnitsTelemetry( UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Claims the message just written at the top of a scratch arena and
+ * updates the peak usage of its type. Each type is only built in one arena.
+ */
+static void prvClaimScratch( scratch_arena_t * pxArena,
+                             MessageType_t xType,
+                             uint32_t ulMessageLength )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
+    configASSERT( scratch_arena_alloc( pxArena, ulMessageLength ) != NULL );
 
-    // Unit-1
-    // @todo: For now we are having only single unit. With Controllino new code. Otherwise we should loop to get 3 units.
+    if( pxArena->used > ulScratchPeak[ xType ] )
     {
-        memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-        lBytesWritten = prvCreateUnit1Telemetry(unit_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // Unit-2, Unit-3 later
-    // @todo: This needs to be taken care with Controllino new code
-
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
-
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+        ulScratchPeak[ xType ] = pxArena->used;
     }
-
-    LogInfo( ( "Units data length = %d \n data = %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
 }
 
 /**
- * @brief Get current timestamp in utc format.
+ * @brief Adds one latency measurement of a pipeline stage.
  */
-void get_timestamp_utc(char* timestamp_utc)
+static void prvRecordLatency( PipelineStage_t xStage,
+                              TickType_t xTicks )
 {
-    RTC_TimeTypeDef sTime;
-    RTC_DateTypeDef sDate;
-
-    HAL_RTC_GetTime(&xHrtc, &sTime, RTC_FORMAT_BIN);
-    HAL_RTC_GetDate(&xHrtc, &sDate, RTC_FORMAT_BIN);
-
-    // Hack for now, to be handled in new code better
-    if( sTime.Hours >= 24 )
-    {
-        Reset_Hour(sTime, sDate);
-
-        HAL_RTC_GetTime(&xHrtc, &sTime, RTC_FORMAT_BIN);
-        HAL_RTC_GetDate(&xHrtc, &sDate, RTC_FORMAT_BIN);
-    }
-
-    sprintf(timestamp_utc, "%04d-%02d-%02dT%02d:%02d:%02dZ",
-            sDate.Year + 2000, sDate.Month, sDate.Date,
-            sTime.Hours, sTime.Minutes, sTime.Seconds);
+    telemetry_latency_add( &xStageStats[ xStage ], ( uint32_t ) xTicks );
 }
 
-uint32_t prvCreateErrorMessage( SKID_iot_status_t skid_data, UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Stamps the data with the current time and writes the message the schema
+ * describes straight into the sampling scratch arena. The caller resets the arena
+ * once the message is queued.
+ */
+static uint32_t prvCreateMessage( MessageType_t xType,
+                                  const MessageSchema_t * pxSchema,
+                                  telemetry_data_t * pxData,
+                                  uint8_t ** ppucMessageData )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
-
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
-
-    // non-nested attributes
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_TYPE, lengthof( sampleazureiotMESSAGE_TYPE ),
-                                                                    ( uint8_t * )error_MESSAGE_TYPE, strlen(error_MESSAGE_TYPE));
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                    ( uint8_t * )error_MESSAGE_VERSION, strlen(error_MESSAGE_VERSION));
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        char timestamp_utc[30] = {0};
-        get_timestamp_utc(timestamp_utc);
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_TIMESTAMP_UTC, lengthof( sampleazureiot_TIMESTAMP_UTC ),
-                                                                   ( uint8_t * )timestamp_utc, strlen(timestamp_utc));
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-
-    // nested errors
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_ERRORS, lengthof( sampleazureiotTELEMETRY_OBJECT_ERRORS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        if( skid_data.skid_state == Lock_State )
-        {
-            xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // @todo update timestamp while storing from SKid
-            char timestamp_utc[30] = {0};
-            get_timestamp_utc(timestamp_utc);
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_TIMESTAMP_UTC, lengthof( sampleazureiot_TIMESTAMP_UTC ),
-                                                                        ( uint8_t * )timestamp_utc, strlen(timestamp_utc));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            char error_code[60] = {0};
-            stringifyErrorCode(error_code, skid_data.errors);
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_ERROR_CODE, lengthof( sampleazureiotTELEMETRY_ERROR_CODE ),
-                                                                        ( uint8_t * )error_code, strlen(error_code));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                        ( uint8_t * )error_MESSAGE_VERSION, strlen(error_MESSAGE_VERSION));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_LOCATION, lengthof( sampleazureiotTELEMETRY_LOCATION ),
-                                                                        ( uint8_t * )ccu_LOCATION, strlen(ccu_LOCATION));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_CURRENT_STATE, lengthof( sampleazureiotTELEMETRY_CURRENT_STATE ),
-                                                                        ( uint8_t * )sequence_state_stringified[skid_data.skid_state], strlen(sequence_state_stringified[skid_data.skid_state]));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // @todo need to implement current and previous states
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_PREVIOUS_STATE, lengthof( sampleazureiotTELEMETRY_PREVIOUS_STATE ),
-                                                                        ( uint8_t * )sequence_state_stringified[skid_data.skid_state], strlen(sequence_state_stringified[skid_data.skid_state]));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // sensor measurements
-            {
-                xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS, lengthof( sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS ) );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                // o2
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_O2, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // mass flow
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_MASS_FLOW, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // co2
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_CO2, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // proptional valve sensor
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_PROPOTIONAL_VALVE_SENSOR, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // temperature
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_TEMPERATURE, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // humidity
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( SKID_HUMIDITY, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // tank pressure
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                    lBytesWritten = prvCreateSkidSensorTelemetry( TANK_PRESSURE, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-                
-                xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
-
-            // body, @todo nothing now
-            {
-                xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_BODY, lengthof( sampleazureiotTELEMETRY_OBJECT_BODY ) );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
-
-            xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
-
-        if( unit_data.unit_state == Lock_State )
-        {
-            xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // @todo update timestamp while storing from SKid
-            char timestamp_utc[30] = {0};
-            get_timestamp_utc(timestamp_utc);
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_TIMESTAMP_UTC, lengthof( sampleazureiot_TIMESTAMP_UTC ),
-                                                                        ( uint8_t * )timestamp_utc, strlen(timestamp_utc));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            char error_code[60] = {0};
-            stringifyErrorCode(error_code, unit_data.errors);
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_ERROR_CODE, lengthof( sampleazureiotTELEMETRY_ERROR_CODE ),
-                                                                        ( uint8_t * )error_code, strlen(error_code));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                        ( uint8_t * )error_MESSAGE_VERSION, strlen(error_MESSAGE_VERSION));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_LOCATION, lengthof( sampleazureiotTELEMETRY_LOCATION ),
-                                                                        ( uint8_t * )unit1_LOCATION, strlen(unit1_LOCATION));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_CURRENT_STATE, lengthof( sampleazureiotTELEMETRY_CURRENT_STATE ),
-                                                                        ( uint8_t * )sequence_state_stringified[unit_data.unit_state], strlen(sequence_state_stringified[unit_data.unit_state]));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // @todo need to implement current and previous states
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_PREVIOUS_STATE, lengthof( sampleazureiotTELEMETRY_PREVIOUS_STATE ),
-                                                                        ( uint8_t * )sequence_state_stringified[unit_data.unit_state], strlen(sequence_state_stringified[unit_data.unit_state]));
-            configASSERT( xResult == eAzureIoTSuccess );
-
-            // sensor measurements
-            {
-                xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS, lengthof( sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS ) );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-
-                // vacuum sensor
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-                    lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_VACUUM_SENSOR, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // ambient humidity
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-                    lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_AMBIENT_HUMIDITY, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                // ambient temperature
-                {
-                    // Sensor: name, status, avg, max, min, median
-                    memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-                    lBytesWritten = prvCreateUnitSensorTelemetry( UNIT_AMBIENT_TEMPERATURE, unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-                    xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
-
-                xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
-
-            // body, @todo might change
-            {
-                xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_BODY, lengthof( sampleazureiotTELEMETRY_OBJECT_BODY ) );
-                configASSERT( xResult == eAzureIoTSuccess );
+    uint32_t ulBytesWritten;
+    uint32_t ulRemaining = scratch_arena_remaining( &xSampleScratchArena, ppucMessageData );
 
-                xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-                
-                // cartridges
-                {
-                    xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_CARTRIDGES, lengthof( sampleazureiotTELEMETRY_OBJECT_CARTRIDGES ) );
-                    configASSERT( xResult == eAzureIoTSuccess );
-
-                    // Begin of cartridges array
-                    xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-                    configASSERT( xResult == eAzureIoTSuccess );
-
-                    // Begin cartridges loop
-                    // @todo: For now, we are filling by reading sequentially from 9 heaters
-                    //        to make it 3 cartridges with 3 zones each per cartridge.
-                    for(uint8_t cart = 0;cart<NUMBER_OF_CARTRIDGES;++cart){
-                        xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-                        configASSERT( xResult == eAzureIoTSuccess );
-
-                        char cartridge_sl_num[15] = {0};
-                        sprintf(cartridge_sl_num, "%s%d", telemetry_CARTRIDGE_SERIAL_NUMBER, cart + 1);
-                        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SERIAL_NUMBER, lengthof( sampleazureiotTELEMETRY_SERIAL_NUMBER ),
-                                                                                    ( uint8_t * )cartridge_sl_num, strlen(cartridge_sl_num));
-                        configASSERT( xResult == eAzureIoTSuccess );
-
-                        // @todo we need to get slot number also from desired properties?
-                        //       For now using sequential numbers 1, 2, 3...
-                        xResult = AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SLOT, lengthof( sampleazureiotTELEMETRY_SLOT ), cart+1);
-                        configASSERT( xResult == eAzureIoTSuccess );
-
-                        // zones
-                        {
-                            xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_ZONES, lengthof( sampleazureiotTELEMETRY_OBJECT_ZONES ) );
-                            configASSERT( xResult == eAzureIoTSuccess );
-
-                            // Begin of Zones array
-                            xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-                            configASSERT( xResult == eAzureIoTSuccess );
-
-                            // Zones array in a loop
-                            for(uint8_t zone = 0;zone<NUMBER_OF_ZONES_PER_CARTRIDGE;++zone){
-                                // zone, status, avg, max, min, median
-                                memset(ucScratchTempHalfBuffer2, '\0', sizeof(ucScratchTempHalfBuffer2));
-                                lBytesWritten = prvCreateUnitHeatersTelemetry( (cart * NUMBER_OF_ZONES_PER_CARTRIDGE + zone), unit_data, ucScratchTempHalfBuffer2, sizeof(ucScratchTempHalfBuffer2) );
-
-                                xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer2, lBytesWritten );
-                                configASSERT( xResult == eAzureIoTSuccess );
-                            }
-
-                            // Endof zones array
-                            xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-                            configASSERT( xResult == eAzureIoTSuccess );
-                        }
-
-                        // Endof cartridges loop
-                        xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-                        configASSERT( xResult == eAzureIoTSuccess );
-                    }
+    get_timestamp_utc( pxData->timestamp_utc );
 
-                    // Endof cartridges array
-                    xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-                    configASSERT( xResult == eAzureIoTSuccess );
-                }
+    ulBytesWritten = sampleazureiotWRITE_MESSAGE( pxSchema, pxData, *ppucMessageData, ulRemaining );
+    configASSERT( ulBytesWritten != 0 );
 
-                xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
+    prvClaimScratch( &xSampleScratchArena, xType, ulBytesWritten );
 
-            xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
-        }
+    return ulBytesWritten;
+}
 
+/**
+ * @brief Stamps the data with the current time and writes this cycle's telemetry
+ * into the scratch arena, the full message when a keyframe is due and the changed
+ * fields otherwise. Returns 0 when nothing changed and there is nothing to send.
+ * Delta messages are JSON only, with TELEMETRY_CBOR every cycle is a full message.
+ */
+static uint32_t prvCreateTelemetry( telemetry_data_t * pxData,
+                                    uint8_t ** ppucMessageData )
+{
+    #if TELEMETRY_CBOR
+        return prvCreateMessage( eMessageTelemetry, &sampleazureiotTELEMETRY_SCHEMA, pxData, ppucMessageData );
+    #else
+        uint32_t ulBytesWritten;
+        uint32_t ulRemaining = scratch_arena_remaining( &xSampleScratchArena, ppucMessageData );
+        telemetry_delta_result_t xDeltaResult;
 
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
+        get_timestamp_utc( pxData->timestamp_utc );
 
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+        xDeltaResult = telemetry_delta_write( &xTelemetryDelta, pxData, *ppucMessageData, ulRemaining, &ulBytesWritten );
+        configASSERT( xDeltaResult != TELEMETRY_DELTA_NO_SPACE );
 
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+        if( ulBytesWritten != 0 )
+        {
+            prvClaimScratch( &xSampleScratchArena, eMessageTelemetry, ulBytesWritten );
+        }
 
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
-    }
+        return ulBytesWritten;
+    #endif
+}
 
-    // LogInfo( ( "error message to be sent %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+/**
+ * @brief Reads the current SKID and unit status. Called with xTelemetryQueueMutex
+ * held, the sampling and alarm tasks both write the telemetry data.
+ */
+static void prvReadStatus( void )
+{
+    xTelemetryData.skid = get_skid_status( xSkidLastState );
+    xSkidLastState = xTelemetryData.skid.skid_state;
 
-    return ( uint32_t ) lBytesWritten;
+    xTelemetryData.unit = get_unit_status( xUnitLastState );
+    xUnitLastState = xTelemetryData.unit.unit_state;
 }
 
-uint32_t prvCreateBootUpMessage( uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+/**
+ * @brief Copies a message from the scratch arena into the telemetry queue. This
+ * and the functions queuing messages are called with xTelemetryQueueMutex held.
+ */
+static telemetry_queue_result_t prvQueueRecord( const uint8_t * pucMessage,
+                                                uint32_t ulLength,
+                                                bool xDependent,
+                                                bool xFlush )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+    telemetry_queue_result_t xQueueResult;
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
+    telemetry_batch_queued( &xTelemetryBatch, telemetry_queue_count( &xTelemetryQueue ), xTaskGetTickCount(), xFlush );
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+    xQueueResult = telemetry_queue_push( &xTelemetryQueue, pucMessage, ( uint16_t ) ulLength, xDependent );
 
-    // non-nested attributes
+    if( xQueueResult == TELEMETRY_QUEUE_DROPPED )
     {
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_TYPE, lengthof( sampleazureiotMESSAGE_TYPE ),
-                                                                    ( uint8_t * )bootup_MESSAGE_TYPE, strlen(bootup_MESSAGE_TYPE));
-        configASSERT( xResult == eAzureIoTSuccess );
+        LogWarn( ( "Telemetry queue full, %lu messages dropped so far.\r\n",
+                   ( unsigned long ) xTelemetryQueue.stats.dropped ) );
+    }
+    else if( xQueueResult == TELEMETRY_QUEUE_REJECTED )
+    {
+        LogError( ( "Message of %lu bytes not queued, %lu refused so far.\r\n",
+                    ( unsigned long ) ulLength, ( unsigned long ) xTelemetryQueue.stats.rejected ) );
+    }
 
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                    ( uint8_t * )bootup_MESSAGE_VERSION, strlen(bootup_MESSAGE_VERSION));
-        configASSERT( xResult == eAzureIoTSuccess );
+    return xQueueResult;
+}
 
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_AZURE_SDK_VERSION, lengthof( sampleazureiot_AZURE_SDK_VERSION ),
-                                                                    ( uint8_t * )azure_sdk_version, strlen(azure_sdk_version));
-        configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Writes the error or boot-up message of the current data and queues it,
+ * it is sent without waiting for the telemetry batch.
+ */
+static void prvQueueMessage( MessageType_t xType,
+                             const MessageSchema_t * pxSchema,
+                             const char * pcName )
+{
+    scratch_arena_mark_t xMessageMark = scratch_arena_mark( &xSampleScratchArena );
+    uint8_t * pucMessage;
+    uint32_t ulLength;
+
+    ulLength = prvCreateMessage( xType, pxSchema, &xTelemetryData, &pucMessage );
+    sampleazureiotLOG_MESSAGE( pcName, pucMessage, ulLength );
+    ( void ) prvQueueRecord( pucMessage, ulLength, false, true );
+    scratch_arena_reset( &xSampleScratchArena, xMessageMark );
+
+    /* No delta is queued across another message, dropping the records up to
+     * this one must not leave deltas behind it without their keyframe. */
+    telemetry_delta_force_keyframe( &xTelemetryDelta );
+}
 
-        char timestamp_utc[30] = {0};
-        get_timestamp_utc(timestamp_utc);
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_TIMESTAMP_UTC, lengthof( sampleazureiot_TIMESTAMP_UTC ),
-                                                                   ( uint8_t * )timestamp_utc, strlen(timestamp_utc));
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
+/**
+ * @brief Writes this cycle's telemetry and queues it. A delta depends on the
+ * messages before it, when it cannot be queued the next telemetry is a full one.
+ */
+static void prvQueueTelemetry( void )
+{
+    scratch_arena_mark_t xMessageMark = scratch_arena_mark( &xSampleScratchArena );
+    uint8_t * pucMessage;
+    uint32_t ulLength;
+    bool xDependent = false;
+
+    // @todo We are sending single unit data, ok for now till we re-work on this
+    ulLength = prvCreateTelemetry( &xTelemetryData, &pucMessage );
 
-    // firmware versions
+    if( ulLength != 0 )
     {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiot_FIRMWARE_VERSIONS, lengthof( sampleazureiot_FIRMWARE_VERSIONS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
+        sampleazureiotLOG_MESSAGE( "telemetry", pucMessage, ulLength );
 
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
+        #if !TELEMETRY_CBOR
+            xDependent = ( xTelemetryDelta.since_keyframe != 0 );
+        #endif
 
-        // skid
+        if( prvQueueRecord( pucMessage, ulLength, xDependent, false ) == TELEMETRY_QUEUE_REJECTED )
         {
-            xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+            telemetry_delta_force_keyframe( &xTelemetryDelta );
+        }
+    }
+    else
+    {
+        LogInfo( ( "No telemetry changes since the last message, nothing queued.\r\n" ) );
+    }
 
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_IDENTIFIER, lengthof( sampleazureiot_IDENTIFIER ),
-                                                                        ( uint8_t * )ccu_IDENTIFIER, strlen(ccu_IDENTIFIER));
-            configASSERT( xResult == eAzureIoTSuccess );
+    scratch_arena_reset( &xSampleScratchArena, xMessageMark );
+}
 
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                        ( uint8_t * )ccu_FIRMWARE_VERSION, strlen(ccu_FIRMWARE_VERSION));
-            configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Sends the queued messages, oldest first and several per publish, as
+ * many as fit the MQTT buffer. They only leave the queue once the client took
+ * them, after a failure the rest is kept for the next session. The queue is only
+ * locked while a batch is copied out, sampling goes on during the send.
+ */
+static AzureIoTResult_t prvSendQueued( AzureIoTMessageProperties_t * pxPropertyBag )
+{
+    AzureIoTResult_t xResult = eAzureIoTSuccess;
+    scratch_arena_mark_t xMessageMark;
+    uint8_t * pucBatch;
+    uint32_t ulLength;
+    uint32_t ulRecords;
+    uint32_t ulWaiting;
+    uint32_t ulDropped;
+    TickType_t xSendTick;
+    bool xFirstBatch = true;
+
+    xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
+
+    while( ( xResult == eAzureIoTSuccess ) && ( telemetry_queue_count( &xTelemetryQueue ) != 0 ) )
+    {
+        xMessageMark = scratch_arena_mark( &xScratchArena );
+        ulLength = scratch_arena_remaining( &xScratchArena, &pucBatch );
 
-            xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+        if( ulLength > sampleazureiotBATCH_BUFFER_LENGTH )
+        {
+            ulLength = sampleazureiotBATCH_BUFFER_LENGTH;
         }
 
-        // Unit1
-        // @todo - for now we have only 1 unit
+        ulLength = telemetry_queue_batch( &xTelemetryQueue, TELEMETRY_BATCH_MAX_SIZE, &sampleazureiotQUEUE_FORMAT,
+                                          pucBatch, ulLength, &ulRecords );
+
+        if( ulLength == 0 )
         {
-            xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+            /* Messages are written in the smaller sampling arena, this only
+             * happens when the session holds more of this one. */
+            LogError( ( "Queued message does not fit the batch buffer, dropped.\r\n" ) );
+            telemetry_queue_drop( &xTelemetryQueue, 1 );
+            continue;
+        }
 
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_IDENTIFIER, lengthof( sampleazureiot_IDENTIFIER ),
-                                                                        ( uint8_t * )unit1_IDENTIFIER, strlen(unit1_IDENTIFIER));
-            configASSERT( xResult == eAzureIoTSuccess );
+        prvClaimScratch( &xScratchArena, eMessageBatch, ulLength );
 
-            xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                        ( uint8_t * )unit1_FIRMWARE_VERSION, strlen(unit1_FIRMWARE_VERSION));
+        ulWaiting = telemetry_queue_count( &xTelemetryQueue );
+        ulDropped = xTelemetryQueue.stats.dropped;
+        xSendTick = xTaskGetTickCount();
 
-            xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+        if( xFirstBatch )
+        {
+            prvRecordLatency( eStageQueue, telemetry_batch_age( &xTelemetryBatch, xSendTick ) );
+            xFirstBatch = false;
         }
 
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
+        xSemaphoreGive( xTelemetryQueueMutex );
 
-    // hardware versions
-    {
-        // @todo
-    }
+        LogInfo( ( "Sending %lu of %lu queued messages, %lu bytes.\r\n", ( unsigned long ) ulRecords,
+                   ( unsigned long ) ulWaiting, ( unsigned long ) ulLength ) );
+        xResult = AzureIoTHubClient_SendTelemetry( &xAzureIoTHubClient,
+                                                   pucBatch, ulLength,
+                                                   pxPropertyBag, eAzureIoTHubMessageQoS1, NULL );
+        prvRecordLatency( eStageSend, xTaskGetTickCount() - xSendTick );
+        scratch_arena_reset( &xScratchArena, xMessageMark );
 
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+        xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
 
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+        if( xResult == eAzureIoTSuccess )
+        {
+            telemetry_queue_drop( &xTelemetryQueue,
+                                  telemetry_batch_acknowledged( ulRecords, xTelemetryQueue.stats.dropped - ulDropped ) );
 
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+            if( xConnectionStats.xFirstTelemetryTicks == 0 )
+            {
+                /* Ticks count from the scheduler start, shortly after reset. */
+                xConnectionStats.xFirstTelemetryTicks = xTaskGetTickCount();
+                LogInfo( ( "First telemetry %lums after boot, %lu DPS registrations.\r\n",
+                           ( unsigned long ) ( xConnectionStats.xFirstTelemetryTicks * portTICK_PERIOD_MS ),
+                           ( unsigned long ) xConnectionStats.ulProvisioningCount ) );
+            }
+
+            if( xAlarmQueued && ( telemetry_queue_count( &xTelemetryQueue ) == 0 ) )
+            {
+                prvRecordLatency( eStageAlarm, xTaskGetTickCount() - xAlarmTick );
+                xAlarmQueued = false;
+            }
+        }
+        else
+        {
+            LogError( ( "Failed to send queued messages: error=0x%08x, %lu kept for the next session.\r\n",
+                        xResult, ( unsigned long ) telemetry_queue_count( &xTelemetryQueue ) ) );
+        }
     }
 
-    // LogInfo( ( "bootup message to be sent %.*s\r\n", lBytesWritten, pucTelemetryData ) );
+    telemetry_batch_sent( &xTelemetryBatch, telemetry_queue_count( &xTelemetryQueue ) );
 
-    return ( uint32_t ) lBytesWritten;
+    xSemaphoreGive( xTelemetryQueueMutex );
+
+    return xResult;
 }
 
 /**
- * @brief Create and fill the telemetry data.
- *        Note: For now just filling the simulated ones
+ * @brief Logs how the sampling to publish pipeline is doing.
  */
-uint32_t prvCreateTelemetry( SKID_iot_status_t skid_data, UNIT_iot_status_t unit_data, uint8_t * pucTelemetryData, uint32_t ulTelemetryDataLength )
+static void prvLogPipelineStats( void )
 {
-    AzureIoTResult_t xResult;
-    AzureIoTJSONWriter_t xWriter;
-    int32_t lBytesWritten;
+    controller_link_stats_t xLinkStats = get_controller_link_stats();
+    time_service_stats_t xTimeStats;
+    uint32_t ulResyncInterval;
+    const char * const pcStageNames[ eStageCount ] = { "sample", "queue", "send", "alarm" };
+    uint32_t ulStage;
+
+    LogInfo( ( "Controller link: frames=%lu (%lu/s) crc_failures=%lu header_mismatches=%lu skipped=%lu overflow=%lu\r\n",
+               ( unsigned long ) xLinkStats.parser.frames,
+               ( unsigned long ) xLinkStats.frames_per_second,
+               ( unsigned long ) xLinkStats.parser.crc_failures,
+               ( unsigned long ) xLinkStats.parser.header_mismatches,
+               ( unsigned long ) xLinkStats.parser.skipped_bytes,
+               ( unsigned long ) xLinkStats.ring_overflow_bytes ) );
+    LogInfo( ( "Scratch arena peak: boot-up=%lu error=%lu telemetry=%lu of %lu bytes, properties=%lu batch=%lu of %lu bytes\r\n",
+               ( unsigned long ) ulScratchPeak[ eMessageBootUp ],
+               ( unsigned long ) ulScratchPeak[ eMessageError ],
+               ( unsigned long ) ulScratchPeak[ eMessageTelemetry ],
+               ( unsigned long ) sizeof( ucSampleScratchBuffer ),
+               ( unsigned long ) ulScratchPeak[ eMessageReportedProperties ],
+               ( unsigned long ) ulScratchPeak[ eMessageBatch ],
+               ( unsigned long ) sizeof( ucScratchBuffer ) ) );
+    LogInfo( ( "Telemetry queue: queued=%lu sent=%lu dropped=%lu rejected=%lu waiting=%lu\r\n",
+               ( unsigned long ) xTelemetryQueue.stats.queued,
+               ( unsigned long ) xTelemetryQueue.stats.sent,
+               ( unsigned long ) xTelemetryQueue.stats.dropped,
+               ( unsigned long ) xTelemetryQueue.stats.rejected,
+               ( unsigned long ) telemetry_queue_count( &xTelemetryQueue ) ) );
+
+    vGetTimeServiceStats( &xTimeStats, &ulResyncInterval );
+    LogInfo( ( "Time service: resync every %lus syncs=%lu failures=%lu drift last=%ldms max=%ldms rate=%ldppm\r\n",
+               ( unsigned long ) ulResyncInterval,
+               ( unsigned long ) xTimeStats.syncs,
+               ( unsigned long ) xTimeStats.failures,
+               ( long ) xTimeStats.last_drift_ms,
+               ( long ) xTimeStats.max_drift_ms,
+               ( long ) xTimeStats.drift_ppm ) );
+
+    for( ulStage = 0; ulStage < eStageCount; ulStage++ )
+    {
+        LogInfo( ( "Pipeline %s: count=%lu last=%lums max=%lums avg=%lums\r\n",
+                   pcStageNames[ ulStage ],
+                   ( unsigned long ) xStageStats[ ulStage ].count,
+                   ( unsigned long ) ( xStageStats[ ulStage ].last * portTICK_PERIOD_MS ),
+                   ( unsigned long ) ( xStageStats[ ulStage ].max * portTICK_PERIOD_MS ),
+                   ( unsigned long ) ( telemetry_latency_average( &xStageStats[ ulStage ] ) * portTICK_PERIOD_MS ) ) );
+    }
+}
+/*-----------------------------------------------------------*/
 
-    xResult = AzureIoTJSONWriter_Init( &xWriter, pucTelemetryData, ulTelemetryDataLength );
-    configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Sampling task: reads the SKID and unit status every publish period and
+ * queues the error and telemetry messages. It never touches the network, a slow
+ * TLS write or a WiFi outage only fills the queue.
+ */
+static void prvSampleTask( void * pvParameters )
+{
+    TickType_t xLastWakeTick;
+    TickType_t xStartTick;
 
-    // Begin top object
-    xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+    ( void ) pvParameters;
 
-    // Note: Later optimize the code separating common code etc!!
+    // @todo SDK crashes sometimes because of WiFi/ TLS issues, so ideally we are supposed to send boot-up only when SKID/Unit restarts
+    // Queued ahead of the telemetry, it waits there for the first session
+    xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
+    prvQueueMessage( eMessageBootUp, &sampleazureiotBOOTUP_SCHEMA, "boot-up" );
+    xSemaphoreGive( xTelemetryQueueMutex );
 
-    // non-nested attributes
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_VERSION, lengthof( sampleazureiotMESSAGE_VERSION ),
-                                                                    ( uint8_t * )telemetry_MESSAGE_VERSION, strlen(telemetry_MESSAGE_VERSION));
-        configASSERT( xResult == eAzureIoTSuccess );
+    /* Idle for some time so that telemetry is populated first time upon boot. */
+    LogInfo( ( "On boot-up: Sampling starts in %d seconds...\r\n\r\n", sampleazureiotDELAY_AT_START / 1000 ) );
+    vTaskDelay( sampleazureiotDELAY_AT_START );
 
-        // For now the count is constant, to be deduced from sampling frequency later
-        xResult = AzureIoTJSONWriter_AppendPropertyWithInt32Value( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_MEASUREMENT_COUNT, lengthof( sampleazureiotTELEMETRY_MEASUREMENT_COUNT ),
-                                                                   telemetry_MEASUREMENT_COUNT);
-        configASSERT( xResult == eAzureIoTSuccess );
+    xLastWakeTick = xTaskGetTickCount();
 
-        char timestamp_utc[30] = {0};
-        get_timestamp_utc(timestamp_utc);
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiot_TIMESTAMP_UTC, lengthof( sampleazureiot_TIMESTAMP_UTC ),
-                                                                   ( uint8_t * )timestamp_utc, strlen(timestamp_utc));
-        configASSERT( xResult == eAzureIoTSuccess );
+    for( ; ; )
+    {
+        xStartTick = xTaskGetTickCount();
 
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotMESSAGE_TYPE, lengthof( sampleazureiotMESSAGE_TYPE ),
-                                                                    ( uint8_t * )telemetry_MESSAGE_TYPE, strlen(telemetry_MESSAGE_TYPE));
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
+        xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
 
-    // Skid
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_CCU, lengthof( sampleazureiotTELEMETRY_OBJECT_CCU ) );
-        configASSERT( xResult == eAzureIoTSuccess );
+        // Read the current sensor data
+        prvReadStatus();
+        prvQueueTelemetry();
+        xSemaphoreGive( xTelemetryQueueMutex );
 
-        // All skid sensors
-        memset(ucScratchTempBuffer, '\0', sizeof(ucScratchTempBuffer));
-        lBytesWritten = prvCreateSkidTelemetry(skid_data, ucScratchTempBuffer, sizeof(ucScratchTempBuffer) );
+        prvRecordLatency( eStageSample, xTaskGetTickCount() - xStartTick );
 
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempBuffer, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
+        vTaskDelayUntil( &xLastWakeTick, sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS );
     }
-    // Endof Skid
+}
+/*-----------------------------------------------------------*/
 
-    // Units
-    {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_UNITS, lengthof( sampleazureiotTELEMETRY_OBJECT_UNITS ) );
-        configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Called by the decoder in the uart task on every alarm transition.
+ */
+static void prvNotifyAlarm( void * pvContext )
+{
+    xTaskNotifyGive( ( TaskHandle_t ) pvContext );
+}
 
-        xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Whether source has a pending transition into Lock_State, moves
+ * pxEarliestTick back to when the decoder saw it.
+ */
+static bool prvLockAlarm( uint32_t ulAlarms,
+                          state_alarm_source_t xSource,
+                          TickType_t * pxEarliestTick )
+{
+    state_alarm_event_t xEvent;
 
-        // All Units
-        memset(ucScratchTempBuffer, '\0', sizeof(ucScratchTempBuffer));
-        lBytesWritten = prvCreateUnitsTelemetry( unit_data, ucScratchTempBuffer, sizeof(ucScratchTempBuffer) );
+    if( ( ulAlarms & STATE_ALARM_BIT( xSource ) ) == 0 )
+    {
+        return false;
+    }
 
-        xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempBuffer, lBytesWritten );
-        configASSERT( xResult == eAzureIoTSuccess );
+    xEvent = get_state_alarm_event( xSource );
 
-        xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
+    if( xEvent.state != Lock_State )
+    {
+        return false;
     }
-    // Endof Units
 
-    // Tank
+    if( ( *pxEarliestTick - ( TickType_t ) xEvent.tick ) < portMAX_DELAY / 2 )
     {
-        xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_TANK, lengthof( sampleazureiotTELEMETRY_OBJECT_TANK ) );
-        configASSERT( xResult == eAzureIoTSuccess );
-
-        // Begin tank object
-        xResult = AzureIoTJSONWriter_AppendBeginObject( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
+        *pxEarliestTick = ( TickType_t ) xEvent.tick;
+    }
 
-        xResult = AzureIoTJSONWriter_AppendPropertyWithStringValue( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_SERIAL_NUMBER, lengthof( sampleazureiotTELEMETRY_SERIAL_NUMBER ),
-                                                                    ( uint8_t * )telemetry_TANK_SERIAL_NUMBER, strlen(telemetry_TANK_SERIAL_NUMBER));
-        configASSERT( xResult == eAzureIoTSuccess );
+    return true;
+}
 
-        // sensor measurements
-        {
-            xResult = AzureIoTJSONWriter_AppendPropertyName( &xWriter, ( uint8_t * ) sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS, lengthof( sampleazureiotTELEMETRY_OBJECT_SENSOR_MEASUREMENTS ) );
-            configASSERT( xResult == eAzureIoTSuccess );
+/**
+ * @brief Alarm task: waits for the decoder and queues the error message of a
+ * Lock_State transition ahead of the batch. Safe_State transitions go out with
+ * the next telemetry.
+ */
+static void prvAlarmTask( void * pvParameters )
+{
+    uint32_t ulAlarms;
+    TickType_t xSeenTick;
+    bool xSkidLock;
+    bool xUnitLock;
 
-            xResult = AzureIoTJSONWriter_AppendBeginArray( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+    ( void ) pvParameters;
 
-            // tank pressure
-            {
-                // Sensor: name, status, avg, max, min, median
-                memset(ucScratchTempHalfBuffer, '\0', sizeof(ucScratchTempHalfBuffer));
-                lBytesWritten = prvCreateSkidSensorTelemetry( TANK_PRESSURE, skid_data, ucScratchTempHalfBuffer, sizeof(ucScratchTempHalfBuffer) );
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
 
-                xResult = AzureIoTJSONWriter_AppendJSONText( &xWriter, ucScratchTempHalfBuffer, lBytesWritten );
-                configASSERT( xResult == eAzureIoTSuccess );
-            }
+        /* One notification per transition, the first one may take them all. */
+        ulAlarms = take_state_alarms();
+        xSeenTick = xTaskGetTickCount();
+        xSkidLock = prvLockAlarm( ulAlarms, STATE_ALARM_SKID, &xSeenTick );
+        xUnitLock = prvLockAlarm( ulAlarms, STATE_ALARM_UNIT, &xSeenTick );
 
-            xResult = AzureIoTJSONWriter_AppendEndArray( &xWriter );
-            configASSERT( xResult == eAzureIoTSuccess );
+        if( !xSkidLock && !xUnitLock )
+        {
+            continue;
         }
 
-        // End tank object
-        xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-        configASSERT( xResult == eAzureIoTSuccess );
-    }
-    // Endof Tank
+        xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
 
-    // End top object
-    xResult = AzureIoTJSONWriter_AppendEndObject( &xWriter );
-    configASSERT( xResult == eAzureIoTSuccess );
+        prvReadStatus();
+        stringifyErrorCode( xTelemetryData.skid_error_code, xTelemetryData.skid.errors );
+        stringifyErrorCode( xTelemetryData.unit_error_code, xTelemetryData.unit.errors );
+        prvQueueMessage( eMessageError, &sampleazureiotERROR_SCHEMA, "error" );
 
-    lBytesWritten = AzureIoTJSONWriter_GetBytesUsed( &xWriter );
+        /* Latency of the earliest transition not sent yet. */
+        if( !xAlarmQueued )
+        {
+            xAlarmTick = xSeenTick;
+            xAlarmQueued = true;
+        }
 
-    if( lBytesWritten < 0 )
-    {
-        LogError( ( "Error getting the bytes written for the telemetry JSON" ) );
-        return 0;
+        xSemaphoreGive( xTelemetryQueueMutex );
     }
-
-    // LogInfo( ( "Telemetry message to be sent %.*s\r\n", lBytesWritten, pucTelemetryData ) );
-
-    return ( uint32_t ) lBytesWritten;
 }
 /*-----------------------------------------------------------*/
 
@@ -1858,9 +1345,17 @@ uint32_t prvCreateTelemetry( SKID_iot_status_t skid_data, UNIT_iot_status_t unit
 static void prvAzureDemoTask( void * pvParameters )
 {
     int lPublishCount = 0;
+    int lReportCount = 0;
+    TickType_t xLastReportTick;
+    bool xSendDue;
 
     uint32_t ulScratchBufferLength = 0U;
-    const int lMaxPublishCount = 15;
+    uint8_t * pucScratchMessage = NULL;
+    uint8_t * pucPropertyBuffer = NULL;
+    scratch_arena_mark_t xSessionMark;
+    scratch_arena_mark_t xMessageMark;
+    TickType_t xSessionLostTick = 0;
+    bool xSessionLost = false;
     NetworkCredentials_t xNetworkCredentials = { 0 };
     AzureIoTTransportInterface_t xTransport;
     NetworkContext_t xNetworkContext = { 0 };
@@ -1872,8 +1367,8 @@ static void prvAzureDemoTask( void * pvParameters )
     bool xSessionPresent;
 
     #ifdef democonfigENABLE_DPS_SAMPLE
-        uint8_t * pucIotHubHostname = NULL;
-        uint8_t * pucIotHubDeviceId = NULL;
+        uint8_t * pucIotHubHostname = xDpsAssignment.hostname;
+        uint8_t * pucIotHubDeviceId = xDpsAssignment.device_id;
         uint32_t pulIothubHostnameLength = 0;
         uint32_t pulIothubDeviceIdLength = 0;
     #else
@@ -1892,33 +1387,39 @@ static void prvAzureDemoTask( void * pvParameters )
     configASSERT( ulStatus == 0 );
 
     #ifdef democonfigENABLE_DPS_SAMPLE
-        /* Run DPS.  */
-        if( ( ulStatus = prvIoTHubInfoGet( &xNetworkCredentials, &pucIotHubHostname,
-                                           &pulIothubHostnameLength, &pucIotHubDeviceId,
-                                           &pulIothubDeviceIdLength ) ) != 0 )
+        /* Connect straight to the hub assigned on an earlier boot, run DPS
+         * only when there is none. */
+        if( prvLoadDpsAssignment() )
+        {
+            LogInfo( ( "Using the IoT Hub %s assigned on an earlier boot.\r\n", xDpsAssignment.hostname ) );
+        }
+        else if( ( ulStatus = prvIoTHubInfoGet( &xNetworkCredentials, NULL ) ) != 0 )
         {
             LogError( ( "Failed on sample_dps_entry!: error code = 0x%08x\r\n", ulStatus ) );
             return;
         }
+
+        pulIothubHostnameLength = xDpsAssignment.hostname_length;
+        pulIothubDeviceIdLength = xDpsAssignment.device_id_length;
     #endif /* democonfigENABLE_DPS_SAMPLE */
 
     xNetworkContext.pParams = &xTlsTransportParams;
 
+    scratch_arena_init( &xScratchArena, ucScratchBuffer, sizeof( ucScratchBuffer ) );
+
     for( ; ; )
     {
-        if( xAzureSample_IsConnectedToInternet() )
+        /* Attempt to establish TLS session with IoT Hub. If connection fails,
+         * retry after a timeout. Timeout value will be exponentially increased
+         * until  the maximum number of attempts are reached or the maximum timeout
+         * value is reached. The function returns a failure status if the TCP
+         * connection cannot be established to the IoT Hub after the configured
+         * number of attempts, the messages stay queued until a later iteration. */
+        if( xAzureSample_IsConnectedToInternet() &&
+            ( prvConnectToServerWithBackoffRetries( ( const char * ) pucIotHubHostname,
+                                                    democonfigIOTHUB_PORT,
+                                                    &xNetworkCredentials, &xNetworkContext ) == 0 ) )
         {
-            /* Attempt to establish TLS session with IoT Hub. If connection fails,
-             * retry after a timeout. Timeout value will be exponentially increased
-             * until  the maximum number of attempts are reached or the maximum timeout
-             * value is reached. The function returns a failure status if the TCP
-             * connection cannot be established to the IoT Hub after the configured
-             * number of attempts. */
-            ulStatus = prvConnectToServerWithBackoffRetries( ( const char * ) pucIotHubHostname,
-                                                             democonfigIOTHUB_PORT,
-                                                             &xNetworkCredentials, &xNetworkContext );
-            configASSERT( ulStatus == 0 );
-
             /* Fill in Transport Interface send and receive function pointers. */
             xTransport.pxNetworkContext = &xNetworkContext;
             xTransport.xSend = TLS_Socket_Send;
@@ -1955,6 +1456,27 @@ static void prvAzureDemoTask( void * pvParameters )
             xResult = AzureIoTHubClient_Connect( &xAzureIoTHubClient,
                                                  false, &xSessionPresent,
                                                  sampleazureiotCONNACK_RECV_TIMEOUT_MS );
+
+            #ifdef democonfigENABLE_DPS_SAMPLE
+                if( xResult == eAzureIoTErrorServerError )
+                {
+                    /* The hub refused the CONNECT, the device was moved to
+                     * another hub or deleted from this one. */
+                    LogWarn( ( "IoT Hub %s refused the device, registering again.\r\n", pucIotHubHostname ) );
+                    TLS_Socket_Disconnect( &xNetworkContext );
+
+                    if( ( ulStatus = prvReprovision( &xNetworkCredentials ) ) != 0 )
+                    {
+                        LogError( ( "Failed on sample_dps_entry!: error code = 0x%08x\r\n", ulStatus ) );
+                        return;
+                    }
+
+                    pulIothubHostnameLength = xDpsAssignment.hostname_length;
+                    pulIothubDeviceIdLength = xDpsAssignment.device_id_length;
+                    continue;
+                }
+            #endif /* democonfigENABLE_DPS_SAMPLE */
+
             configASSERT( xResult == eAzureIoTSuccess );
 
             xResult = AzureIoTHubClient_SubscribeCloudToDeviceMessage( &xAzureIoTHubClient, prvHandleCloudMessage,
@@ -1973,8 +1495,40 @@ static void prvAzureDemoTask( void * pvParameters )
             xResult = AzureIoTHubClient_RequestPropertiesAsync( &xAzureIoTHubClient );
             configASSERT( xResult == eAzureIoTSuccess );
 
-            /* Create a bag of properties for the telemetry */
-            xResult = AzureIoTMessage_PropertiesInit( &xPropertyBag, ucPropertyBuffer, 0, sizeof( ucPropertyBuffer ) );
+            if( xSessionLost )
+            {
+                /* Time the hub was unreachable for, including backoff and the handshake. */
+                xConnectionStats.xLastReconnectTicks = xTaskGetTickCount() - xSessionLostTick;
+                xConnectionStats.xTotalReconnectTicks += xConnectionStats.xLastReconnectTicks;
+
+                if( xConnectionStats.xLastReconnectTicks > xConnectionStats.xMaxReconnectTicks )
+                {
+                    xConnectionStats.xMaxReconnectTicks = xConnectionStats.xLastReconnectTicks;
+                }
+
+                xConnectionStats.ulReconnectCount++;
+                xSessionLost = false;
+            }
+
+            LogInfo( ( "Connection stats: handshakes=%lu reconnects=%lu last=%lums max=%lums total=%lums\r\n",
+                       ( unsigned long ) xConnectionStats.ulHandshakeCount,
+                       ( unsigned long ) xConnectionStats.ulReconnectCount,
+                       ( unsigned long ) ( xConnectionStats.xLastReconnectTicks * portTICK_PERIOD_MS ),
+                       ( unsigned long ) ( xConnectionStats.xMaxReconnectTicks * portTICK_PERIOD_MS ),
+                       ( unsigned long ) ( xConnectionStats.xTotalReconnectTicks * portTICK_PERIOD_MS ) ) );
+
+            /* Create a bag of properties for the telemetry, kept until the session ends */
+            xSessionMark = scratch_arena_mark( &xScratchArena );
+            pucPropertyBuffer = scratch_arena_alloc( &xScratchArena, PROPERTY_BUFFER_LENGTH );
+            configASSERT( pucPropertyBuffer != NULL );
+
+            /* What the client took just before the last session was lost may not
+             * have arrived, start from a full message. */
+            xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
+            telemetry_delta_force_keyframe( &xTelemetryDelta );
+            xSemaphoreGive( xTelemetryQueueMutex );
+
+            xResult = AzureIoTMessage_PropertiesInit( &xPropertyBag, pucPropertyBuffer, 0, PROPERTY_BUFFER_LENGTH );
             configASSERT( xResult == eAzureIoTSuccess );
 
             /* Sending a default property (Content-Type). */
@@ -1983,111 +1537,81 @@ static void prvAzureDemoTask( void * pvParameters )
                                                         ( uint8_t * ) sampleazureiotMESSAGE_CONTENT_TYPE, sizeof( sampleazureiotMESSAGE_CONTENT_TYPE ) - 1 );
             configASSERT( xResult == eAzureIoTSuccess );
 
-            /* Sending a default property (Content-Encoding). */
-            xResult = AzureIoTMessage_PropertiesAppend( &xPropertyBag,
-                                                        ( uint8_t * ) AZ_IOT_MESSAGE_PROPERTIES_CONTENT_ENCODING, sizeof( AZ_IOT_MESSAGE_PROPERTIES_CONTENT_ENCODING ) - 1,
-                                                        ( uint8_t * ) sampleazureiotMESSAGE_CONTENT_ENCODING, sizeof( sampleazureiotMESSAGE_CONTENT_ENCODING ) - 1 );
-            configASSERT( xResult == eAzureIoTSuccess );
+            #ifdef sampleazureiotMESSAGE_CONTENT_ENCODING
+                /* Sending a default property (Content-Encoding). */
+                xResult = AzureIoTMessage_PropertiesAppend( &xPropertyBag,
+                                                            ( uint8_t * ) AZ_IOT_MESSAGE_PROPERTIES_CONTENT_ENCODING, sizeof( AZ_IOT_MESSAGE_PROPERTIES_CONTENT_ENCODING ) - 1,
+                                                            ( uint8_t * ) sampleazureiotMESSAGE_CONTENT_ENCODING, sizeof( sampleazureiotMESSAGE_CONTENT_ENCODING ) - 1 );
+                configASSERT( xResult == eAzureIoTSuccess );
+            #endif
 
             /* How to send an user-defined custom property. */
             xResult = AzureIoTMessage_PropertiesAppend( &xPropertyBag, ( uint8_t * ) "name", sizeof( "name" ) - 1,
                                                         ( uint8_t * ) "value", sizeof( "value" ) - 1 );
             configASSERT( xResult == eAzureIoTSuccess );
 
-            // @todo SDK crashes sometimes because of WiFi/ TLS issues, so ideally we are supposed to send boot-up only when SKID/Unit restarts
-            if(!xBootUpMessageSent)
-            {
-                memset(ucScratchBuffer, '\0', sizeof (ucScratchBuffer) );
-                // Create the json boot-up msg payload
-                ulScratchBufferLength = prvCreateBootUpMessage( ucScratchBuffer, sizeof( ucScratchBuffer ) );
-                LogInfo( ( "boot-up msg: ucScratchBuffer = %s and ulScratchBufferLength =%d\r\n", ucScratchBuffer, ulScratchBufferLength ) );
-
-                xResult = AzureIoTHubClient_SendTelemetry( &xAzureIoTHubClient,
-                                                           ucScratchBuffer, ulScratchBufferLength,
-                                                           &xPropertyBag, eAzureIoTHubMessageQoS1, NULL );
-                configASSERT( xResult == eAzureIoTSuccess );
-   
-                // Not to be sent again
-                xBootUpMessageSent = true;
-
-                /* Idle for some time so that telemetry is populated first time upon boot. */
-                LogInfo( ( "On boot-up: Keeping Connection Idle for %d seconds...\r\n\r\n", sampleazureiotDELAY_AT_START / 1000 ) );
-                vTaskDelay( sampleazureiotDELAY_AT_START );
-            }
+            /* Send what the sampling task queued once the batch is due, servicing
+             * keep-alive and incoming messages in between. The loop only ends when
+             * the transport fails, unless the session is configured to be recycled
+             * after a fixed number of publishes. */
+            xLastReportTick = xTaskGetTickCount() - sampleazureiotREPORT_INTERVAL_TICKS;
 
-            /* Publish messages with QoS1, send and process Keep alive messages. */
-            for( lPublishCount = 0;
-                 lPublishCount < lMaxPublishCount && xAzureSample_IsConnectedToInternet();
-                 lPublishCount++ )
+            for( lPublishCount = 0, lReportCount = 0;
+                 ( xResult == eAzureIoTSuccess ) && xAzureSample_IsConnectedToInternet(); )
             {
+                #if ( sampleazureiotPERSISTENT_CONNECTION == 0 )
+                    if( lPublishCount >= sampleazureiotMAX_PUBLISH_COUNT )
+                    {
+                        break;
+                    }
+                #endif
 
-                // just force to test
-                // if( prvInitializeSNTP() != 0 )
-                // {
-                //     Error_Handler();
-                // }
-
-                // Read the current sensor data
-                SKID_iot_status_t skid_data = get_skid_status(xSkidLastState);
-                xSkidLastState = skid_data.skid_state;
-
-                // Read the current sensor data
-                UNIT_iot_status_t unit_data = get_unit_status(xUnitLastState);
-                xUnitLastState = unit_data.unit_state;
+                xSemaphoreTake( xTelemetryQueueMutex, portMAX_DELAY );
+                xSendDue = telemetry_batch_due( &xTelemetryBatch, telemetry_queue_count( &xTelemetryQueue ),
+                                                xTaskGetTickCount() );
+                xSemaphoreGive( xTelemetryQueueMutex );
 
-                // @todo error handling till we jump to new code
-                if( (skid_data.skid_state == Lock_State && skid_data.send_alert) ||
-                    (unit_data.unit_state == Lock_State && unit_data.send_alert) )
+                if( xSendDue )
                 {
-                    memset(ucScratchBuffer, '\0', sizeof (ucScratchBuffer) );
-                    // Create the json error msg payload
-                    ulScratchBufferLength = prvCreateErrorMessage( skid_data, unit_data, ucScratchBuffer, sizeof( ucScratchBuffer ) );
-                    LogInfo( ( "error msg: ucScratchBuffer = %s and ulScratchBufferLength =%d\r\n", ucScratchBuffer, ulScratchBufferLength ) );
-
-                    xResult = AzureIoTHubClient_SendTelemetry( &xAzureIoTHubClient,
-                                                                ucScratchBuffer, ulScratchBufferLength,
-                                                                &xPropertyBag, eAzureIoTHubMessageQoS1, NULL );
-                    configASSERT( xResult == eAzureIoTSuccess );
-
-                    /* Idle for some time so that telemetry is populated first time upon boot. */
-                    LogInfo( ( "On error: Keeping Connection Idle for %d seconds...\r\n\r\n", sampleazureiotDELAY_ON_ERROR / 1000 ) );
-                    vTaskDelay( sampleazureiotDELAY_ON_ERROR );
-                }
+                    xResult = prvSendQueued( &xPropertyBag );
+                    lPublishCount++;
 
-                memset(ucScratchBuffer, '\0', sizeof (ucScratchBuffer) );
-                // Create the json telemetry payload
-                // @todo We are sending single unit data, ok for now till we re-work on this
-                ulScratchBufferLength = prvCreateTelemetry( skid_data, unit_data, ucScratchBuffer, sizeof( ucScratchBuffer ) );
-                LogInfo( ( "ucScratchBuffer = %s and ulScratchBufferLength =%d\r\n", ucScratchBuffer, ulScratchBufferLength ) );
+                    if( xResult != eAzureIoTSuccess )
+                    {
+                        break;
+                    }
+                }
 
-                xResult = AzureIoTHubClient_SendTelemetry( &xAzureIoTHubClient,
-                                                           ucScratchBuffer, ulScratchBufferLength,
-                                                           &xPropertyBag, eAzureIoTHubMessageQoS1, NULL );
-                configASSERT( xResult == eAzureIoTSuccess );
+                if( ( xTaskGetTickCount() - xLastReportTick ) >= sampleazureiotREPORT_INTERVAL_TICKS )
+                {
+                    xLastReportTick = xTaskGetTickCount();
+                    prvLogPipelineStats();
 
-                LogInfo( ( "Attempt to receive publish message from IoT Hub.\r\n" ) );
-                xResult = AzureIoTHubClient_ProcessLoop( &xAzureIoTHubClient,
-                                                         sampleazureiotPROCESS_LOOP_TIMEOUT_MS );
-                configASSERT( xResult == eAzureIoTSuccess );
+                    /* Send reported property */
+                    xMessageMark = scratch_arena_mark( &xScratchArena );
+                    ulScratchBufferLength = scratch_arena_remaining( &xScratchArena, &pucScratchMessage );
+                    ulScratchBufferLength = snprintf( ( char * ) pucScratchMessage, ulScratchBufferLength,
+                                                      sampleazureiotPROPERTY, ++lReportCount );
+                    prvClaimScratch( &xScratchArena, eMessageReportedProperties, ulScratchBufferLength );
 
-                if( lPublishCount % 2 == 0 )
-                {
-                    /* Send reported property every other cycle */
-                    ulScratchBufferLength = snprintf( ( char * ) ucScratchBuffer, sizeof( ucScratchBuffer ),
-                                                      sampleazureiotPROPERTY, lPublishCount / 2 + 1 );
                     LogInfo( ( "Attempt to send reported properties from IoT Hub.\r\n" ) );
                     xResult = AzureIoTHubClient_SendPropertiesReported( &xAzureIoTHubClient,
-                                                                        ucScratchBuffer, ulScratchBufferLength,
+                                                                        pucScratchMessage, ulScratchBufferLength,
                                                                         NULL );
-                    configASSERT( xResult == eAzureIoTSuccess );
+                    scratch_arena_reset( &xScratchArena, xMessageMark );
+
+                    if( xResult != eAzureIoTSuccess )
+                    {
+                        LogError( ( "Failed to send reported properties: error=0x%08x", xResult ) );
+                        break;
+                    }
                 }
 
-                /* Leave Connection Idle for some time. */
-                LogInfo( ( "Keeping Connection Idle for %d seconds...\r\n\r\n", sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS / 1000 ) );
-                vTaskDelay( sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS );
+                /* One process loop interval, the longest a due batch waits. */
+                xResult = prvProcessLoopForTicks( pdMS_TO_TICKS( sampleazureiotPROCESS_LOOP_TIMEOUT_MS ) );
             }
 
-            if( xAzureSample_IsConnectedToInternet() )
+            if( ( xResult == eAzureIoTSuccess ) && xAzureSample_IsConnectedToInternet() )
             {
                 xResult = AzureIoTHubClient_UnsubscribeProperties( &xAzureIoTHubClient );
                 configASSERT( xResult == eAzureIoTSuccess );
@@ -2105,15 +1629,52 @@ static void prvAzureDemoTask( void * pvParameters )
                 xResult = AzureIoTHubClient_Disconnect( &xAzureIoTHubClient );
                 configASSERT( xResult == eAzureIoTSuccess );
             }
+            else
+            {
+                LogWarn( ( "IoT Hub session lost after %d publishes, reconnecting.\r\n", lPublishCount ) );
+
+                /* Only a failed session counts as a reconnect, not a planned recycle. */
+                xSessionLostTick = xTaskGetTickCount();
+                xSessionLost = true;
+            }
 
             /* Close the network connection.  */
             TLS_Socket_Disconnect( &xNetworkContext );
 
+            /* The property bag goes with the session. */
+            scratch_arena_reset( &xScratchArena, xSessionMark );
+
             /* Wait for some time between two iterations to ensure that we do not
              * bombard the IoT Hub. */
             // LogInfo( ( "Demo completed successfully.\r\n" ) );
         }
 
+        #ifdef democonfigENABLE_DPS_SAMPLE
+            else if( xAzureSample_IsConnectedToInternet() &&
+                     ( Sockets_GetHostByName( ( const char * ) pucIotHubHostname ) == 0 ) &&
+                     ( Sockets_GetHostByName( democonfigENDPOINT ) != 0 ) )
+            {
+                /* The name of the assigned hub is gone while DPS still resolves,
+                 * the hub was deleted. */
+                LogWarn( ( "IoT Hub %s no longer resolves, registering again.\r\n", pucIotHubHostname ) );
+
+                if( ( ulStatus = prvReprovision( &xNetworkCredentials ) ) != 0 )
+                {
+                    LogError( ( "Failed on sample_dps_entry!: error code = 0x%08x\r\n", ulStatus ) );
+                    return;
+                }
+
+                pulIothubHostnameLength = xDpsAssignment.hostname_length;
+                pulIothubDeviceIdLength = xDpsAssignment.device_id_length;
+                continue;
+            }
+        #endif /* democonfigENABLE_DPS_SAMPLE */
+
+        /* The sampling task goes on meanwhile, the messages go out in order
+         * with the next session. */
+        LogInfo( ( "%lu messages queued for the next session.\r\n",
+                   ( unsigned long ) telemetry_queue_count( &xTelemetryQueue ) ) );
+
         LogInfo( ( "Short delay (%d seconds) before starting the next iteration.... \r\n\r\n", sampleazureiotDELAY_BETWEEN_DEMO_ITERATIONS_TICKS / 1000 ) );
         vTaskDelay( sampleazureiotDELAY_BETWEEN_DEMO_ITERATIONS_TICKS );
     }
@@ -2127,17 +1688,14 @@ static void prvAzureDemoTask( void * pvParameters )
  *   This function will block for Provisioning service for result or return failure.
  */
     static uint32_t prvIoTHubInfoGet( NetworkCredentials_t * pXNetworkCredentials,
-                                      uint8_t ** ppucIothubHostname,
-                                      uint32_t * pulIothubHostnameLength,
-                                      uint8_t ** ppucIothubDeviceId,
-                                      uint32_t * pulIothubDeviceIdLength )
+                                      const char * pcLastHostname )
     {
         NetworkContext_t xNetworkContext = { 0 };
         TlsTransportParams_t xTlsTransportParams = { 0 };
         AzureIoTResult_t xResult;
         AzureIoTTransportInterface_t xTransport;
-        uint32_t ucSamplepIothubHostnameLength = sizeof( ucSampleIotHubHostname );
-        uint32_t ucSamplepIothubDeviceIdLength = sizeof( ucSampleIotHubDeviceId );
+        uint32_t ucSamplepIothubHostnameLength = sizeof( xDpsAssignment.hostname ) - 1;
+        uint32_t ucSamplepIothubDeviceIdLength = sizeof( xDpsAssignment.device_id ) - 1;
         uint32_t ulStatus;
 
         /* Set the pParams member of the network context with desired transport. */
@@ -2194,13 +1752,21 @@ static void prvAzureDemoTask( void * pvParameters )
         {
             xResult = AzureIoTProvisioningClient_Register( &xAzureIoTProvisioningClient,
                                                            sampleazureiotProvisioning_Registration_TIMEOUT_MS );
+
+            /* The service mostly assigns the same hub again, look it up while
+             * the registration is pending so the hub connect finds it cached. */
+            if( ( xResult == eAzureIoTErrorPending ) && ( pcLastHostname != NULL ) )
+            {
+                ( void ) Sockets_GetHostByName( pcLastHostname );
+                pcLastHostname = NULL;
+            }
         } while( xResult == eAzureIoTErrorPending );
 
         configASSERT( xResult == eAzureIoTSuccess );
 
         xResult = AzureIoTProvisioningClient_GetDeviceAndHub( &xAzureIoTProvisioningClient,
-                                                              ucSampleIotHubHostname, &ucSamplepIothubHostnameLength,
-                                                              ucSampleIotHubDeviceId, &ucSamplepIothubDeviceIdLength );
+                                                              xDpsAssignment.hostname, &ucSamplepIothubHostnameLength,
+                                                              xDpsAssignment.device_id, &ucSamplepIothubDeviceIdLength );
         configASSERT( xResult == eAzureIoTSuccess );
 
         AzureIoTProvisioningClient_Deinit( &xAzureIoTProvisioningClient );
@@ -2208,13 +1774,42 @@ static void prvAzureDemoTask( void * pvParameters )
         /* Close the network connection.  */
         TLS_Socket_Disconnect( &xNetworkContext );
 
-        *ppucIothubHostname = ucSampleIotHubHostname;
-        *pulIothubHostnameLength = ucSamplepIothubHostnameLength;
-        *ppucIothubDeviceId = ucSampleIotHubDeviceId;
-        *pulIothubDeviceIdLength = ucSamplepIothubDeviceIdLength;
+        xDpsAssignment.hostname[ ucSamplepIothubHostnameLength ] = '\0';
+        xDpsAssignment.hostname_length = ucSamplepIothubHostnameLength;
+        xDpsAssignment.device_id[ ucSamplepIothubDeviceIdLength ] = '\0';
+        xDpsAssignment.device_id_length = ucSamplepIothubDeviceIdLength;
+        xConnectionStats.ulProvisioningCount++;
+
+        #ifndef democonfigUSE_HSM
+            /* Later boots connect to the hub without DPS. */
+            if( !dps_assignment_save( &xDpsAssignment, democonfigID_SCOPE, democonfigREGISTRATION_ID ) )
+            {
+                LogWarn( ( "Failed to store the IoT Hub assignment, the next boot runs DPS again.\r\n" ) );
+            }
+        #endif
 
         return 0;
     }
+/*-----------------------------------------------------------*/
+
+    static bool prvLoadDpsAssignment( void )
+    {
+        #ifdef democonfigUSE_HSM
+            /* The registration ID is only known once read from the HSM. */
+            return false;
+        #else
+            return dps_assignment_load( &xDpsAssignment, democonfigID_SCOPE, democonfigREGISTRATION_ID );
+        #endif
+    }
+/*-----------------------------------------------------------*/
+
+    static uint32_t prvReprovision( NetworkCredentials_t * pXNetworkCredentials )
+    {
+        /* A reset while registering boots into DPS rather than the refused hub. */
+        dps_assignment_clear();
+
+        return prvIoTHubInfoGet( pXNetworkCredentials, ( const char * ) xDpsAssignment.hostname );
+    }
 
 #endif /* democonfigENABLE_DPS_SAMPLE */
 /*-----------------------------------------------------------*/
@@ -2275,17 +1870,73 @@ static uint32_t prvConnectToServerWithBackoffRetries( const char * pcHostName,
         }
     } while( ( xNetworkStatus != eTLSTransportSuccess ) && ( xBackoffAlgStatus == BackoffAlgorithmSuccess ) );
 
+    if( xNetworkStatus == eTLSTransportSuccess )
+    {
+        xConnectionStats.ulHandshakeCount++;
+    }
+
     return xNetworkStatus == eTLSTransportSuccess ? 0 : 1;
 }
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Run the process loop until xTicksToWait has elapsed.
+ */
+static AzureIoTResult_t prvProcessLoopForTicks( TickType_t xTicksToWait )
+{
+    AzureIoTResult_t xResult = eAzureIoTSuccess;
+    TickType_t xStartTick = xTaskGetTickCount();
+
+    do
+    {
+        xResult = AzureIoTHubClient_ProcessLoop( &xAzureIoTHubClient,
+                                                 sampleazureiotPROCESS_LOOP_TIMEOUT_MS );
+
+        if( xResult != eAzureIoTSuccess )
+        {
+            LogError( ( "Process loop failed: error=0x%08x", xResult ) );
+        }
+    } while( ( xResult == eAzureIoTSuccess ) &&
+             ( ( xTaskGetTickCount() - xStartTick ) < xTicksToWait ) );
+
+    return xResult;
+}
+/*-----------------------------------------------------------*/
+
 /*
  * @brief Create the task that demonstrates the AzureIoTHub demo
  */
 void vStartDemoTask( void )
 {
-    /* This example uses a single application task, which in turn is used to
-     * connect, subscribe, publish, unsubscribe and disconnect from the IoT Hub */
+    /* Everything the two tasks share is set up before either runs. */
+    xTelemetryQueueMutex = xSemaphoreCreateMutexStatic( &xTelemetryQueueMutexBuffer );
+    scratch_arena_init( &xSampleScratchArena, ucSampleScratchBuffer, sizeof( ucSampleScratchBuffer ) );
+    telemetry_delta_init( &xTelemetryDelta, TELEMETRY_KEYFRAME_INTERVAL );
+    telemetry_queue_init( &xTelemetryQueue, ucTelemetryQueueBuffer, sizeof( ucTelemetryQueueBuffer ),
+                          TELEMETRY_QUEUE_DROP_OLDEST, NULL );
+    telemetry_batch_init( &xTelemetryBatch, sampleazureiotTELEMETRY_BATCH_SIZE,
+                          sampleazureiotTELEMETRY_FLUSH_TIMEOUT_S, configTICK_RATE_HZ );
+
+    /* The sampling and alarm tasks fill the telemetry queue, the demo task owns
+     * the IoT Hub client: it connects, subscribes, sends the queue and disconnects. */
+    xTaskCreate( prvAlarmTask,                       /* Function that implements the task. */
+                 "AlarmTask",                        /* Text name for the task - only used for debugging. */
+                 sampleazureiotALARM_TASK_STACKSIZE, /* Size of stack (in words, not bytes) to allocate for the task. */
+                 NULL,                               /* Task parameter - not used in this case. */
+                 sampleazureiotALARM_TASK_PRIORITY,  /* Task priority, must be between 0 and configMAX_PRIORITIES - 1. */
+                 &xAlarmTaskHandle );                /* Notified by the decoder. */
+
+    /* Transitions the decoder saw before are still pending, look at them once. */
+    set_state_alarm_notify( prvNotifyAlarm, xAlarmTaskHandle );
+    xTaskNotifyGive( xAlarmTaskHandle );
+
+    xTaskCreate( prvSampleTask,                       /* Function that implements the task. */
+                 "SampleTask",                        /* Text name for the task - only used for debugging. */
+                 sampleazureiotSAMPLE_TASK_STACKSIZE, /* Size of stack (in words, not bytes) to allocate for the task. */
+                 NULL,                                /* Task parameter - not used in this case. */
+                 sampleazureiotSAMPLE_TASK_PRIORITY,  /* Task priority, must be between 0 and configMAX_PRIORITIES - 1. */
+                 NULL );                              /* Used to pass out a handle to the created task - not used in this case. */
+
     xTaskCreate( prvAzureDemoTask,         /* Function that implements the task. */
                  "AzureDemoTask",          /* Text name for the task - only used for debugging. */
                  democonfigDEMO_STACKSIZE, /* Size of stack (in words, not bytes) to allocate for the task. */